@@ -37,7 +37,7 @@
 static void dvcman_channel_free(DVCMAN_CHANNEL* channel);
 static UINT dvcman_channel_close(DVCMAN_CHANNEL* channel, BOOL perRequest, BOOL fromHashTableFn);
 static void dvcman_free(drdynvcPlugin* drdynvc, IWTSVirtualChannelManager* pChannelMgr);
-static UINT drdynvc_write_data(drdynvcPlugin* drdynvc, UINT32 ChannelId, const BYTE* data,
+static UINT drdynvc_write_data(drdynvcPlugin* drdynvc, DVCMAN_CHANNEL* channel, const BYTE* data,
                                UINT32 dataSize, BOOL* close);
 static UINT drdynvc_send(drdynvcPlugin* drdynvc, wStream* s);
 
@@ -390,6 +390,8 @@ static void dvcman_channel_free(DVCMAN_CHANNEL* channel)
 	if (channel->dvc_data)
 		Stream_Release(channel->dvc_data);
 
+	zgfx_context_free(channel->compressor);
+	zgfx_context_free(channel->decompressor);
 	DeleteCriticalSection(&(channel->lock));
 	free(channel->channel_name);
 	free(channel);
@@ -474,6 +476,15 @@ static UINT dvcman_channel_close(DVCMAN_CHANNEL* channel, BOOL perRequest, BOOL
 					WLog_Print(drdynvc->log, WLOG_DEBUG, "sending close confirm for '%s'",
 					           channel->channel_name);
 
+				const DRDYNVC_CHANNEL_STATISTICS* stats = &channel->stats;
+				if (stats->SentCompressedPdus || stats->ReceivedCompressedPdus)
+					WLog_Print(drdynvc->log, WLOG_DEBUG,
+					           "'%s' sent %" PRIu64 "/%" PRIu64 " received %" PRIu64 "/%" PRIu64
+					           " bytes (payload/wire)",
+					           channel->channel_name, stats->SentPayloadBytes,
+					           stats->SentWireBytes, stats->ReceivedPayloadBytes,
+					           stats->ReceivedWireBytes);
+
 				error = dvcchannel_send_close(channel);
 				if (error != CHANNEL_RC_OK)
 				{
@@ -623,8 +634,7 @@ static UINT dvcman_write_channel(IWTSVirtualChannel* pChannel, ULONG cbSize, con
 		return CHANNEL_RC_BAD_CHANNEL;
 
 	EnterCriticalSection(&(channel->lock));
-	status =
-	    drdynvc_write_data(channel->dvcman->drdynvc, channel->channel_id, pBuffer, cbSize, &close);
+	status = drdynvc_write_data(channel->dvcman->drdynvc, channel, pBuffer, cbSize, &close);
 	LeaveCriticalSection(&(channel->lock));
 	/* Close delayed, it removes the channel struct */
 	if (close)
@@ -868,6 +878,58 @@ out:
 	return status;
 }
 
+/**
+ * Function description
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT dvcman_receive_channel_payload(DVCMAN_CHANNEL* channel, wStream* data, BOOL compressed,
+                                           UINT32 ThreadingFlags)
+{
+	wStream sbuffer = { 0 };
+	wStream* payload = data;
+	const size_t wireSize = Stream_GetRemainingLength(data);
+
+	WINPR_ASSERT(channel);
+	WINPR_ASSERT(channel->dvcman);
+	if (compressed)
+	{
+		drdynvcPlugin* drdynvc = channel->dvcman->drdynvc;
+		const BYTE* pDstData = NULL;
+		UINT32 DstSize = 0;
+
+		if (!channel->decompressor)
+			channel->decompressor = zgfx_context_new(FALSE);
+
+		if (!channel->decompressor)
+		{
+			WLog_Print(drdynvc->log, WLOG_ERROR, "zgfx_context_new failed!");
+			return CHANNEL_RC_NO_MEMORY;
+		}
+
+		if ((wireSize > UINT32_MAX) ||
+		    !zgfx_decompress_bulk(channel->decompressor, Stream_ConstPointer(data),
+		                          (UINT32)wireSize, &pDstData, &DstSize))
+		{
+			WLog_Print(drdynvc->log, WLOG_ERROR, "failed to decompress data for '%s'",
+			           channel->channel_name);
+			return ERROR_INVALID_DATA;
+		}
+
+		Stream_Seek(data, wireSize);
+		payload = Stream_StaticConstInit(&sbuffer, pDstData, DstSize);
+	}
+
+	EnterCriticalSection(&(channel->lock));
+	channel->stats.ReceivedPayloadBytes += Stream_GetRemainingLength(payload);
+	channel->stats.ReceivedWireBytes += wireSize;
+	if (compressed)
+		channel->stats.ReceivedCompressedPdus++;
+	LeaveCriticalSection(&(channel->lock));
+
+	return dvcman_receive_channel_data(channel, payload, ThreadingFlags);
+}
+
 static UINT8 drdynvc_write_variable_uint(wStream* s, UINT32 val)
 {
 	UINT8 cb = 0;
@@ -933,12 +995,99 @@ static UINT drdynvc_send(drdynvcPlugin* drdynvc, wStream* s)
 	}
 }
 
+static BOOL drdynvc_compression_enabled(const drdynvcPlugin* drdynvc)
+{
+	WINPR_ASSERT(drdynvc);
+
+	if ((drdynvc->version < DRDYNVC_CAPS_VERSION_COMPRESSION) || !drdynvc->rdpcontext)
+		return FALSE;
+
+	/* the specification only has servers send compressed data, so this is opt in */
+	return freerdp_settings_get_bool(drdynvc->rdpcontext->settings,
+	                                 FreeRDP_DynamicChannelCompression);
+}
+
 /**
  * Function description
  *
  * @return 0 on success, otherwise a Win32 error code
  */
-static UINT drdynvc_write_data(drdynvcPlugin* drdynvc, UINT32 ChannelId, const BYTE* data,
+static UINT drdynvc_write_data_compressed(drdynvcPlugin* drdynvc, DVCMAN_CHANNEL* channel,
+                                          const BYTE* data, UINT32 dataSize)
+{
+	UINT status = CHANNEL_RC_OK;
+	BOOL first = dataSize > DRDYNVC_COMPRESSED_CHUNK_LENGTH;
+	DVCMAN* dvcman = (DVCMAN*)drdynvc->channel_mgr;
+
+	WINPR_ASSERT(dvcman);
+	WINPR_ASSERT(channel);
+
+	if (!channel->compressor)
+		channel->compressor = zgfx_context_new(TRUE);
+
+	if (!channel->compressor)
+	{
+		WLog_Print(drdynvc->log, WLOG_ERROR, "zgfx_context_new failed!");
+		return CHANNEL_RC_NO_MEMORY;
+	}
+
+	while ((status == CHANNEL_RC_OK) && (dataSize > 0))
+	{
+		UINT8 cbLen = 0;
+		UINT8 Cmd = DATA_COMPRESSED_PDU;
+		const UINT32 chunkLength = MIN(dataSize, DRDYNVC_COMPRESSED_CHUNK_LENGTH);
+		wStream* data_out = StreamPool_Take(dvcman->pool, CHANNEL_CHUNK_LENGTH);
+
+		if (!data_out)
+		{
+			WLog_Print(drdynvc->log, WLOG_ERROR, "StreamPool_Take failed!");
+			return CHANNEL_RC_NO_MEMORY;
+		}
+
+		Stream_SetPosition(data_out, 1);
+		const UINT8 cbChId = drdynvc_write_variable_uint(data_out, channel->channel_id);
+
+		if (first)
+		{
+			/* the total length before compression */
+			cbLen = drdynvc_write_variable_uint(data_out, dataSize);
+			Cmd = DATA_FIRST_COMPRESSED_PDU;
+			first = FALSE;
+		}
+
+		const size_t pos = Stream_GetPosition(data_out);
+
+		if (!zgfx_compress_bulk(channel->compressor, data_out, data, chunkLength))
+		{
+			WLog_Print(drdynvc->log, WLOG_ERROR, "zgfx_compress_bulk failed!");
+			Stream_Release(data_out);
+			return ERROR_INTERNAL_ERROR;
+		}
+
+		const size_t end = Stream_GetPosition(data_out);
+		const INT32 pdu = (Cmd << 4) | (cbLen << 2) | cbChId;
+		Stream_SetPosition(data_out, 0);
+		Stream_Write_UINT8(data_out, WINPR_ASSERTING_INT_CAST(UINT8, pdu));
+		Stream_SetPosition(data_out, end);
+
+		channel->stats.SentPayloadBytes += chunkLength;
+		channel->stats.SentWireBytes += end - pos;
+		channel->stats.SentCompressedPdus++;
+
+		data += chunkLength;
+		dataSize -= chunkLength;
+		status = drdynvc_send(drdynvc, data_out);
+	}
+
+	return status;
+}
+
+/**
+ * Function description
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT drdynvc_write_data(drdynvcPlugin* drdynvc, DVCMAN_CHANNEL* channel, const BYTE* data,
                                UINT32 dataSize, BOOL* close)
 {
 	wStream* data_out = NULL;
@@ -954,9 +1103,17 @@ static UINT drdynvc_write_data(drdynvcPlugin* drdynvc, UINT32 ChannelId, const B
 
 	dvcman = (DVCMAN*)drdynvc->channel_mgr;
 	WINPR_ASSERT(dvcman);
+	WINPR_ASSERT(channel);
 
+	const UINT32 ChannelId = channel->channel_id;
 	WLog_Print(drdynvc->log, WLOG_TRACE, "write_data: ChannelId=%" PRIu32 " size=%" PRIu32 "",
 	           ChannelId, dataSize);
+
+	if ((dataSize > 0) && drdynvc_compression_enabled(drdynvc))
+		return drdynvc_write_data_compressed(drdynvc, channel, data, dataSize);
+
+	channel->stats.SentPayloadBytes += dataSize;
+	channel->stats.SentWireBytes += dataSize;
 	data_out = StreamPool_Take(dvcman->pool, CHANNEL_CHUNK_LENGTH);
 
 	if (!data_out)
@@ -1097,7 +1254,7 @@ static UINT drdynvc_process_capability_request(drdynvcPlugin* drdynvc, int Sp, i
 	Stream_Read_UINT16(s, drdynvc->version);
 
 	/* RDP8 servers offer version 3, though Microsoft forgot to document it
-	 * in their early documents.  It behaves the same as version 2.
+	 * in their early documents.  It adds compressed data PDUs to version 2.
 	 */
 	if ((drdynvc->version == 2) || (drdynvc->version == 3))
 	{
@@ -1268,7 +1425,7 @@ static UINT drdynvc_process_create_request(drdynvcPlugin* drdynvc, UINT8 Sp, UIN
  * @return 0 on success, otherwise a Win32 error code
  */
 static UINT drdynvc_process_data_first(drdynvcPlugin* drdynvc, int Sp, int cbChId, wStream* s,
-                                       UINT32 ThreadingFlags)
+                                       BOOL compressed, UINT32 ThreadingFlags)
 {
 	UINT status = CHANNEL_RC_OK;
 	UINT32 Length = 0;
@@ -1304,7 +1461,7 @@ static UINT drdynvc_process_data_first(drdynvcPlugin* drdynvc, int Sp, int cbChI
 	status = dvcman_receive_channel_data_first(channel, Length);
 
 	if (status == CHANNEL_RC_OK)
-		status = dvcman_receive_channel_data(channel, s, ThreadingFlags);
+		status = dvcman_receive_channel_payload(channel, s, compressed, ThreadingFlags);
 
 	if (status != CHANNEL_RC_OK)
 		status = dvcman_channel_close(channel, FALSE, FALSE);
@@ -1320,7 +1477,7 @@ out:
  * @return 0 on success, otherwise a Win32 error code
  */
 static UINT drdynvc_process_data(drdynvcPlugin* drdynvc, int Sp, int cbChId, wStream* s,
-                                 UINT32 ThreadingFlags)
+                                 BOOL compressed, UINT32 ThreadingFlags)
 {
 	UINT32 ChannelId = 0;
 	DVCMAN_CHANNEL* channel = NULL;
@@ -1349,7 +1506,7 @@ static UINT drdynvc_process_data(drdynvcPlugin* drdynvc, int Sp, int cbChId, wSt
 	if (channel->state != DVC_CHANNEL_RUNNING)
 		goto out;
 
-	status = dvcman_receive_channel_data(channel, s, ThreadingFlags);
+	status = dvcman_receive_channel_payload(channel, s, compressed, ThreadingFlags);
 	if (status != CHANNEL_RC_OK)
 		status = dvcman_channel_close(channel, FALSE, FALSE);
 
@@ -1419,10 +1576,16 @@ static UINT drdynvc_order_recv(drdynvcPlugin* drdynvc, wStream* s, UINT32 Thread
 			return drdynvc_process_create_request(drdynvc, Sp, cbChId, s);
 
 		case DATA_FIRST_PDU:
-			return drdynvc_process_data_first(drdynvc, Sp, cbChId, s, ThreadingFlags);
+			return drdynvc_process_data_first(drdynvc, Sp, cbChId, s, FALSE, ThreadingFlags);
 
 		case DATA_PDU:
-			return drdynvc_process_data(drdynvc, Sp, cbChId, s, ThreadingFlags);
+			return drdynvc_process_data(drdynvc, Sp, cbChId, s, FALSE, ThreadingFlags);
+
+		case DATA_FIRST_COMPRESSED_PDU:
+			return drdynvc_process_data_first(drdynvc, Sp, cbChId, s, TRUE, ThreadingFlags);
+
+		case DATA_COMPRESSED_PDU:
+			return drdynvc_process_data(drdynvc, Sp, cbChId, s, TRUE, ThreadingFlags);
 
 		case CLOSE_REQUEST_PDU:
 			return drdynvc_process_close_request(drdynvc, Sp, cbChId, s);
@@ -1984,6 +2147,28 @@ static int drdynvc_get_version(DrdynvcClientContext* context)
 	return drdynvc->version;
 }
 
+static BOOL drdynvc_get_channel_statistics(DrdynvcClientContext* context, UINT32 ChannelId,
+                                           DRDYNVC_CHANNEL_STATISTICS* stats)
+{
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(stats);
+	drdynvcPlugin* drdynvc = (drdynvcPlugin*)context->handle;
+	WINPR_ASSERT(drdynvc);
+
+	if (!drdynvc->channel_mgr)
+		return FALSE;
+
+	DVCMAN_CHANNEL* channel = dvcman_get_channel_by_id(drdynvc->channel_mgr, ChannelId, TRUE);
+	if (!channel)
+		return FALSE;
+
+	EnterCriticalSection(&(channel->lock));
+	*stats = channel->stats;
+	LeaveCriticalSection(&(channel->lock));
+	dvcman_channel_unref(channel);
+	return TRUE;
+}
+
 /* drdynvc is always built-in */
 #define VirtualChannelEntryEx drdynvc_VirtualChannelEntryEx
 
@@ -2026,6 +2211,7 @@ FREERDP_ENTRY_POINT(BOOL VCAPITYPE VirtualChannelEntryEx(PCHANNEL_ENTRY_POINTS_E
 		context->custom = NULL;
 		drdynvc->context = context;
 		context->GetVersion = drdynvc_get_version;
+		context->GetChannelStatistics = drdynvc_get_channel_statistics;
 		drdynvc->rdpcontext = pEntryPointsEx->context;
 		if (!freerdp_settings_get_bool(drdynvc->rdpcontext->settings,
 		                               FreeRDP_TransportDumpReplay) &&
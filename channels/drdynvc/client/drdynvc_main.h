@@ -33,6 +33,7 @@
 #include <freerdp/addin.h>
 #include <freerdp/channels/log.h>
 #include <freerdp/client/drdynvc.h>
+#include <freerdp/codec/zgfx.h>
 #include <freerdp/freerdp.h>
 
 typedef struct drdynvc_plugin drdynvcPlugin;
@@ -92,6 +93,11 @@ typedef struct
 	wStream* dvc_data;
 	UINT32 dvc_data_length;
 	CRITICAL_SECTION lock;
+
+	/* per direction RDP8 bulk histories, created on the first compressed PDU */
+	ZGFX_CONTEXT* compressor;
+	ZGFX_CONTEXT* decompressor;
+	DRDYNVC_CHANNEL_STATISTICS stats;
 } DVCMAN_CHANNEL;
 
 typedef enum
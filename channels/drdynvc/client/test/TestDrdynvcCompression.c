@@ -0,0 +1,446 @@
+#include <winpr/crt.h>
+#include <winpr/path.h>
+#include <winpr/file.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+#include <winpr/wtsapi.h>
+#include <winpr/tools/makecert.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/listener.h>
+#include <freerdp/peer.h>
+#include <freerdp/channels/channels.h>
+#include <freerdp/channels/drdynvc.h>
+#include <freerdp/channels/echo.h>
+#include <freerdp/channels/wtsvc.h>
+#include <freerdp/client/cmdline.h>
+#include <freerdp/crypto/certificate.h>
+#include <freerdp/crypto/privatekey.h>
+
+#define TEST_TIMEOUT 20000
+
+/* small, a single compressed chunk, fragmented, and larger than a send batch */
+static const UINT32 TEST_MESSAGE_SIZES[] = { 100, 1590, 1591, 5000, 70000 };
+
+typedef struct
+{
+	char* path;
+	char* socket;
+	freerdp_listener* listener;
+	freerdp_peer* peer;
+	HANDLE vcm;
+	HANDLE channel;
+	BOOL opened;
+	BOOL written;
+	size_t received;
+	BYTE* buffer;
+	BOOL compression;
+	BOOL result;
+} TEST_SERVER;
+
+static void test_fill(BYTE* data, UINT32 size, UINT32 seed)
+{
+	/* repeated records that differ a little, compressible but not trivially */
+	for (UINT32 x = 0; x < size; x++)
+		data[x] = (BYTE)(((x / 7) % 31) + (x % 5) * seed);
+}
+
+static BOOL test_peer_post_connect(freerdp_peer* client)
+{
+	WINPR_UNUSED(client);
+	return TRUE;
+}
+
+static BOOL test_peer_accepted(freerdp_listener* listener, freerdp_peer* client)
+{
+	TEST_SERVER* server = listener->info;
+
+	if (server->peer)
+		return FALSE;
+
+	server->peer = client;
+	return TRUE;
+}
+
+static BOOL test_server_init_peer(TEST_SERVER* server)
+{
+	freerdp_peer* client = server->peer;
+	rdpPrivateKey* key = NULL;
+	rdpCertificate* cert = NULL;
+	char* keyFile = GetCombinedPath(server->path, "test.key");
+	char* certFile = GetCombinedPath(server->path, "test.crt");
+	BOOL rc = FALSE;
+
+	if (!keyFile || !certFile || !freerdp_peer_context_new(client))
+		goto fail;
+
+	rdpSettings* settings = client->context->settings;
+	key = freerdp_key_new_from_file(keyFile);
+	cert = freerdp_certificate_new_from_file(certFile);
+
+	if (!key || !cert)
+		goto fail;
+
+	if (!freerdp_settings_set_pointer_len(settings, FreeRDP_RdpServerRsaKey, key, 1))
+		goto fail;
+	key = NULL;
+
+	if (!freerdp_settings_set_pointer_len(settings, FreeRDP_RdpServerCertificate, cert, 1))
+		goto fail;
+	cert = NULL;
+
+	if (!freerdp_settings_set_bool(settings, FreeRDP_RdpSecurity, FALSE) ||
+	    !freerdp_settings_set_bool(settings, FreeRDP_TlsSecurity, TRUE) ||
+	    !freerdp_settings_set_bool(settings, FreeRDP_NlaSecurity, FALSE))
+		goto fail;
+
+	/* the plain session runs with the defaults */
+	if (server->compression &&
+	    !freerdp_settings_set_bool(settings, FreeRDP_DynamicChannelCompression, TRUE))
+		goto fail;
+
+	client->PostConnect = test_peer_post_connect;
+
+	if (!client->Initialize(client))
+		goto fail;
+
+	server->vcm = WTSOpenServerA((LPSTR)client->context);
+	rc = server->vcm && (server->vcm != INVALID_HANDLE_VALUE);
+fail:
+	freerdp_key_free(key);
+	freerdp_certificate_free(cert);
+	free(keyFile);
+	free(certFile);
+	return rc;
+}
+
+static BOOL test_server_open_channel(TEST_SERVER* server)
+{
+	DWORD BytesReturned = 0;
+	PULONG pSessionId = NULL;
+
+	if (WTSVirtualChannelManagerGetDrdynvcState(server->vcm) != DRDYNVC_STATE_READY)
+		return TRUE;
+
+	if (!WTSQuerySessionInformationA(server->vcm, WTS_CURRENT_SESSION, WTSSessionId,
+	                                 (LPSTR*)&pSessionId, &BytesReturned))
+		return FALSE;
+
+	server->channel =
+	    WTSVirtualChannelOpenEx(*pSessionId, ECHO_DVC_CHANNEL_NAME, WTS_CHANNEL_OPTION_DYNAMIC);
+	WTSFreeMemory(pSessionId);
+	return server->channel != NULL;
+}
+
+static BOOL test_server_write(TEST_SERVER* server)
+{
+	void* buffer = NULL;
+	DWORD BytesReturned = 0;
+
+	if (!WTSVirtualChannelQuery(server->channel, WTSVirtualChannelReady, &buffer, &BytesReturned))
+		return FALSE;
+
+	server->opened = *(BOOL*)buffer;
+	WTSFreeMemory(buffer);
+
+	if (!server->opened)
+		return TRUE;
+
+	for (size_t x = 0; x < ARRAYSIZE(TEST_MESSAGE_SIZES); x++)
+	{
+		ULONG written = 0;
+		const UINT32 size = TEST_MESSAGE_SIZES[x];
+
+		test_fill(server->buffer, size, (UINT32)x);
+
+		if (!WTSVirtualChannelWrite(server->channel, (PCHAR)server->buffer, size, &written) ||
+		    (written != size))
+			return FALSE;
+	}
+
+	server->written = TRUE;
+	return TRUE;
+}
+
+static BOOL test_server_check_statistics(TEST_SERVER* server)
+{
+	UINT64 total = 0;
+	DRDYNVC_CHANNEL_STATISTICS stats = { 0 };
+
+	for (size_t x = 0; x < ARRAYSIZE(TEST_MESSAGE_SIZES); x++)
+		total += TEST_MESSAGE_SIZES[x];
+
+	if (!WTSChannelGetStatisticsByHandle(server->channel, &stats))
+		return FALSE;
+
+	printf("sent %" PRIu64 " -> %" PRIu64 " bytes in %" PRIu64 " PDUs, received %" PRIu64
+	       " -> %" PRIu64 " bytes in %" PRIu64 " PDUs\n",
+	       stats.SentPayloadBytes, stats.SentWireBytes, stats.SentCompressedPdus,
+	       stats.ReceivedPayloadBytes, stats.ReceivedWireBytes, stats.ReceivedCompressedPdus);
+
+	if ((stats.SentPayloadBytes != total) || (stats.ReceivedPayloadBytes != total))
+		return FALSE;
+
+	/* without compression, as by default, the peers must not send compressed PDUs at all */
+	if (!server->compression)
+		return (stats.SentCompressedPdus == 0) && (stats.ReceivedCompressedPdus == 0);
+
+	/* both directions went through the bulk compressor */
+	return (stats.SentCompressedPdus > 0) && (stats.SentWireBytes < total) &&
+	       (stats.ReceivedCompressedPdus > 0) && (stats.ReceivedWireBytes < total);
+}
+
+static BOOL test_server_read(TEST_SERVER* server)
+{
+	BYTE* expect = server->buffer + TEST_MESSAGE_SIZES[ARRAYSIZE(TEST_MESSAGE_SIZES) - 1];
+
+	while (server->received < ARRAYSIZE(TEST_MESSAGE_SIZES))
+	{
+		ULONG read = 0;
+		const UINT32 size = TEST_MESSAGE_SIZES[server->received];
+
+		if (!WTSVirtualChannelRead(server->channel, 0, (PCHAR)server->buffer, size, &read))
+			return TRUE;
+
+		test_fill(expect, size, (UINT32)server->received);
+
+		if ((read != size) || (memcmp(server->buffer, expect, size) != 0))
+		{
+			(void)fprintf(stderr, "message %" PRIuz " of %" PRIu32 " bytes came back wrong\n",
+			              server->received, size);
+			return FALSE;
+		}
+
+		server->received++;
+	}
+
+	server->result = test_server_check_statistics(server);
+	return FALSE;
+}
+
+static DWORD WINAPI test_server_thread(LPVOID arg)
+{
+	TEST_SERVER* server = arg;
+	const UINT64 deadline = GetTickCount64() + TEST_TIMEOUT;
+
+	while (!server->peer && (GetTickCount64() < deadline))
+	{
+		HANDLE handles[32] = { 0 };
+		const DWORD count = server->listener->GetEventHandles(server->listener, handles, 32);
+
+		if ((count == 0) || (WaitForMultipleObjects(count, handles, FALSE, 100) == WAIT_FAILED) ||
+		    !server->listener->CheckFileDescriptor(server->listener))
+			return 0;
+	}
+
+	if (!server->peer || !test_server_init_peer(server))
+		return 0;
+
+	freerdp_peer* client = server->peer;
+
+	while (GetTickCount64() < deadline)
+	{
+		HANDLE handles[33] = { 0 };
+		DWORD count = client->GetEventHandles(client, handles, 32);
+
+		if (count == 0)
+			break;
+
+		HANDLE channelEvent = WTSVirtualChannelManagerGetEventHandle(server->vcm);
+		handles[count++] = channelEvent;
+
+		if (WaitForMultipleObjects(count, handles, FALSE, 100) == WAIT_FAILED)
+			break;
+
+		if (!client->CheckFileDescriptor(client))
+			break;
+
+		if (!client->activated ||
+		    !WTSVirtualChannelManagerIsChannelJoined(server->vcm, DRDYNVC_SVC_CHANNEL_NAME))
+			continue;
+
+		/* the first call opens the drdynvc channel, the later ones send what is queued */
+		if (((WTSVirtualChannelManagerGetDrdynvcState(server->vcm) == DRDYNVC_STATE_NONE) ||
+		     (WaitForSingleObject(channelEvent, 0) == WAIT_OBJECT_0)) &&
+		    !WTSVirtualChannelManagerCheckFileDescriptor(server->vcm))
+			break;
+
+		BOOL rc = TRUE;
+
+		if (!server->channel)
+			rc = test_server_open_channel(server);
+		else if (!server->written)
+			rc = test_server_write(server);
+		else
+			rc = test_server_read(server);
+
+		if (!rc)
+			break;
+	}
+
+	if (server->channel)
+		(void)WTSVirtualChannelClose(server->channel);
+
+	client->Disconnect(client);
+	return 0;
+}
+
+static BOOL test_create_certificate(const char* path)
+{
+	BOOL rc = FALSE;
+	char* argv[] = { "makecert", "-rdp", "-live", "-silent", "-y", "1" };
+	MAKECERT_CONTEXT* makecert = makecert_context_new();
+
+	if (!makecert || (makecert_context_process(makecert, (int)ARRAYSIZE(argv), argv) < 0))
+		goto fail;
+
+	if ((makecert_context_set_output_file_name(makecert, "test") != 1) ||
+	    (makecert_context_output_certificate_file(makecert, path) != 1) ||
+	    (makecert_context_output_private_key_file(makecert, path) != 1))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	makecert_context_free(makecert);
+	return rc;
+}
+
+static BOOL test_client_run(TEST_SERVER* server, HANDLE thread)
+{
+	BOOL rc = FALSE;
+	RDP_CLIENT_ENTRY_POINTS clientEntryPoints = { 0 };
+	/* the password is wiped from the arguments, it must not be a literal */
+	char password[] = "/p:test";
+	char* argv[] = { "test", "/cert:ignore", "/sec:tls", "/u:test", password, "/echo" };
+
+	clientEntryPoints.Size = sizeof(RDP_CLIENT_ENTRY_POINTS);
+	clientEntryPoints.Version = RDP_CLIENT_INTERFACE_VERSION;
+	clientEntryPoints.ContextSize = sizeof(rdpContext);
+
+	rdpContext* context = freerdp_client_context_new(&clientEntryPoints);
+
+	if (!context)
+		return FALSE;
+
+	rdpSettings* settings = context->settings;
+	context->instance->AuthenticateEx = NULL;
+
+	if (freerdp_client_settings_parse_command_line(settings, ARRAYSIZE(argv), argv, FALSE) < 0)
+		goto fail;
+
+	if (!freerdp_settings_set_string(settings, FreeRDP_ServerHostname, server->socket) ||
+	    !freerdp_settings_set_bool(settings, FreeRDP_DeactivateClientDecoding, TRUE))
+		goto fail;
+
+	if (server->compression &&
+	    !freerdp_settings_set_bool(settings, FreeRDP_DynamicChannelCompression, TRUE))
+		goto fail;
+
+	if (!freerdp_client_load_addins(context->channels, settings))
+		goto fail;
+
+	if (!freerdp_connect(context->instance))
+		goto fail;
+
+	while (WaitForSingleObject(thread, 0) == WAIT_TIMEOUT)
+	{
+		HANDLE handles[MAXIMUM_WAIT_OBJECTS] = { 0 };
+		DWORD count = freerdp_get_event_handles(context, handles, ARRAYSIZE(handles) - 1);
+
+		if (count == 0)
+			break;
+
+		handles[count++] = thread;
+
+		if ((WaitForMultipleObjects(count, handles, FALSE, 100) == WAIT_FAILED) ||
+		    !freerdp_check_event_handles(context))
+			break;
+	}
+
+	rc = TRUE;
+	(void)freerdp_disconnect(context->instance);
+fail:
+	freerdp_client_context_free(context);
+	return rc;
+}
+
+static BOOL test_session(const char* path, BOOL compression)
+{
+	BOOL rc = FALSE;
+	HANDLE thread = NULL;
+	TEST_SERVER server = { 0 };
+
+	server.path = _strdup(path);
+	server.socket = GetCombinedPath(path, compression ? "compressed" : "plain");
+	server.buffer = malloc(2ull * TEST_MESSAGE_SIZES[ARRAYSIZE(TEST_MESSAGE_SIZES) - 1]);
+	server.listener = freerdp_listener_new();
+	server.compression = compression;
+
+	if (!server.path || !server.socket || !server.buffer || !server.listener)
+		goto fail;
+
+	server.listener->info = &server;
+	server.listener->PeerAccepted = test_peer_accepted;
+
+	if (!server.listener->OpenLocal(server.listener, server.socket))
+		goto fail;
+
+	thread = CreateThread(NULL, 0, test_server_thread, &server, 0, NULL);
+
+	if (!thread)
+		goto fail;
+
+	const BOOL connected = test_client_run(&server, thread);
+	(void)WaitForSingleObject(thread, INFINITE);
+	rc = connected && server.result;
+fail:
+	if (thread)
+		(void)CloseHandle(thread);
+	if (server.vcm)
+		WTSCloseServer(server.vcm);
+	if (server.peer)
+	{
+		freerdp_peer_context_free(server.peer);
+		freerdp_peer_free(server.peer);
+	}
+	if (server.listener)
+	{
+		server.listener->Close(server.listener);
+		freerdp_listener_free(server.listener);
+	}
+	free(server.buffer);
+	free(server.socket);
+	free(server.path);
+	return rc;
+}
+
+int TestDrdynvcCompression(int argc, char* argv[])
+{
+	int rc = -1;
+	char name[64] = { 0 };
+	char* temp = GetKnownPath(KNOWN_PATH_TEMP);
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!WTSRegisterWtsApiFunctionTable(FreeRDP_InitWtsApi()))
+		goto fail;
+
+	(void)sprintf_s(name, ARRAYSIZE(name), "TestDrdynvcCompression-%" PRIu64, GetTickCount64());
+	char* path = temp ? GetCombinedPath(temp, name) : NULL;
+
+	if (!path || !winpr_PathMakePath(path, NULL) || !test_create_certificate(path))
+		goto fail;
+
+	if (!test_session(path, FALSE) || !test_session(path, TRUE))
+		goto fail;
+
+	rc = 0;
+fail:
+	if (path)
+		winpr_RemoveDirectory_RecursiveA(path);
+	free(path);
+	free(temp);
+	return rc;
+}
@@ -0,0 +1,746 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * File System Virtual Channel
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <winpr/crt.h>
+#include <winpr/string.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
+#include <winpr/collections.h>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/inotify.h>
+#define DRIVE_CACHE_INOTIFY
+#endif
+
+#include "drive_cache.h"
+#include "drive_file.h"
+
+/* The SMB redirector keeps file information for 10 seconds, stay below that */
+#define DRIVE_CACHE_LIFETIME_MS 5000
+
+#define DRIVE_CACHE_MAX_ENTRIES 4096
+#define DRIVE_CACHE_MAX_LISTINGS 64
+#define DRIVE_CACHE_MAX_LISTED (8 * DRIVE_CACHE_MAX_LISTING)
+#define DRIVE_CACHE_MAX_WATCHES 1024
+#define DRIVE_CACHE_MAX_BUFFERS 16
+
+#ifdef DRIVE_CACHE_INOTIFY
+#define DRIVE_CACHE_EVENTS                                                                \
+	(IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MODIFY | \
+	 IN_MOVE_SELF | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+#endif
+
+typedef struct
+{
+	DRIVE_CACHE_TAG tag;
+	BOOL hasAttributes;
+	DWORD attributes;
+	BOOL hasInformation;
+	BY_HANDLE_FILE_INFORMATION information;
+} DRIVE_CACHE_ENTRY;
+
+typedef struct
+{
+	DRIVE_CACHE_TAG tag;
+	DRIVE_CACHE_LISTING* listing;
+} DRIVE_CACHE_LISTING_ENTRY;
+
+struct s_drive_cache
+{
+	CRITICAL_SECTION lock;
+	int fd;
+	UINT64 epoch;
+	size_t sequence;
+
+	/* watch descriptor -> generation, bumped with every event in the directory */
+	wHashTable* watches;
+	/* directory -> watch descriptor and back, each directory is only added once */
+	wHashTable* directories;
+	wHashTable* watchPaths;
+	wHashTable* entries;
+	wHashTable* listings;
+	size_t listed;
+
+	wBufferPool* buffers;
+	size_t buffersInUse;
+
+	wArrayList* writebacks;
+
+	DRIVE_CACHE_STATS stats;
+};
+
+static void drive_cache_listing_entry_free(void* obj)
+{
+	DRIVE_CACHE_LISTING_ENTRY* entry = obj;
+
+	if (!entry)
+		return;
+
+	drive_cache_listing_release(entry->listing);
+	free(entry);
+}
+
+static BOOL drive_cache_enabled(const DRIVE_CACHE* cache)
+{
+	return cache && (cache->fd >= 0);
+}
+
+static void drive_cache_reset(DRIVE_CACHE* cache)
+{
+#ifdef DRIVE_CACHE_INOTIFY
+	/* Closing the descriptor drops all watches at once */
+	if (cache->fd >= 0)
+		close(cache->fd);
+
+	cache->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+	cache->epoch++;
+	HashTable_Clear(cache->watches);
+	HashTable_Clear(cache->directories);
+	HashTable_Clear(cache->watchPaths);
+	HashTable_Clear(cache->entries);
+	HashTable_Clear(cache->listings);
+	cache->listed = 0;
+}
+
+#ifdef DRIVE_CACHE_INOTIFY
+/* Forgets a watch the kernel dropped, called with the lock held */
+static void drive_cache_unwatch(DRIVE_CACHE* cache, void* key)
+{
+	const char* directory = HashTable_GetItemValue(cache->watchPaths, key);
+
+	if (directory)
+		HashTable_Remove(cache->directories, directory);
+
+	HashTable_Remove(cache->watchPaths, key);
+	HashTable_Remove(cache->watches, key);
+}
+
+/* Returns the watch of directory, adding one only if there is none yet */
+static int drive_cache_watch(DRIVE_CACHE* cache, const char* directory)
+{
+	const size_t known = (size_t)HashTable_GetItemValue(cache->directories, directory);
+
+	if (known > 0)
+		return (int)known;
+
+	if (HashTable_Count(cache->watches) >= DRIVE_CACHE_MAX_WATCHES)
+		drive_cache_reset(cache);
+
+	if (cache->fd < 0)
+		return -1;
+
+	const int wd = inotify_add_watch(cache->fd, directory, DRIVE_CACHE_EVENTS);
+
+	if (wd <= 0)
+		return -1;
+
+	/* Not remembering the directory only costs another inotify_add_watch */
+	void* key = (void*)(size_t)wd;
+
+	if (HashTable_Insert(cache->watchPaths, key, directory) &&
+	    !HashTable_Insert(cache->directories, directory, key))
+		HashTable_Remove(cache->watchPaths, key);
+
+	return wd;
+}
+#endif
+
+/* Applies all pending change notifications, called with the lock held */
+static void drive_cache_drain(DRIVE_CACHE* cache)
+{
+#ifdef DRIVE_CACHE_INOTIFY
+	union
+	{
+		struct inotify_event event;
+		char data[4096];
+	} buffer;
+
+	while (cache->fd >= 0)
+	{
+		const ssize_t rc = read(cache->fd, buffer.data, sizeof(buffer.data));
+
+		if (rc <= 0)
+			break;
+
+		for (size_t offset = 0; offset + sizeof(struct inotify_event) <= (size_t)rc;)
+		{
+			const struct inotify_event* event =
+			    (const struct inotify_event*)(void*)&buffer.data[offset];
+			void* key = (void*)(size_t)event->wd;
+
+			offset += sizeof(struct inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				drive_cache_reset(cache);
+				return;
+			}
+
+			if (event->mask & IN_IGNORED)
+				drive_cache_unwatch(cache, key);
+			else if (HashTable_Contains(cache->watches, key))
+				HashTable_SetItemValue(cache->watches, key, (void*)++cache->sequence);
+		}
+	}
+#else
+	WINPR_UNUSED(cache);
+#endif
+}
+
+static BOOL drive_cache_tag_valid_int(DRIVE_CACHE* cache, const DRIVE_CACHE_TAG* tag)
+{
+	if (tag->epoch != cache->epoch)
+		return FALSE;
+
+	if (GetTickCount64() >= tag->expires)
+		return FALSE;
+
+	return (size_t)HashTable_GetItemValue(cache->watches, (void*)(size_t)tag->wd) ==
+	       tag->generation;
+}
+
+static BOOL drive_cache_tag_equal(const DRIVE_CACHE_TAG* a, const DRIVE_CACHE_TAG* b)
+{
+	return (a->epoch == b->epoch) && (a->wd == b->wd) && (a->generation == b->generation);
+}
+
+DRIVE_CACHE* drive_cache_new(void)
+{
+	DRIVE_CACHE* cache = (DRIVE_CACHE*)calloc(1, sizeof(DRIVE_CACHE));
+
+	if (!cache)
+		return NULL;
+
+	InitializeCriticalSection(&cache->lock);
+	cache->fd = -1;
+	cache->epoch = 1;
+	cache->watches = HashTable_New(FALSE);
+	cache->entries = HashTable_New(FALSE);
+	cache->directories = HashTable_New(FALSE);
+	cache->watchPaths = HashTable_New(FALSE);
+	cache->listings = HashTable_New(FALSE);
+	cache->buffers = BufferPool_New(FALSE, DRIVE_CACHE_BUFFER_SIZE, 0);
+	cache->writebacks = ArrayList_New(TRUE);
+
+	if (!cache->watches || !cache->directories || !cache->watchPaths || !cache->entries ||
+	    !cache->listings || !cache->buffers || !cache->writebacks)
+		goto fail;
+
+	if (!HashTable_SetupForStringData(cache->entries, FALSE) ||
+	    !HashTable_SetupForStringData(cache->listings, FALSE) ||
+	    !HashTable_SetupForStringData(cache->directories, FALSE))
+		goto fail;
+
+	HashTable_ValueObject(cache->watchPaths)->fnObjectNew = HashTable_StringClone;
+	HashTable_ValueObject(cache->watchPaths)->fnObjectFree = HashTable_StringFree;
+
+	HashTable_ValueObject(cache->entries)->fnObjectFree = free;
+	HashTable_ValueObject(cache->listings)->fnObjectFree = drive_cache_listing_entry_free;
+
+#ifdef DRIVE_CACHE_INOTIFY
+	cache->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (cache->fd < 0)
+		WLog_WARN(TAG, "inotify not available, attributes and listings are not cached");
+#endif
+
+	return cache;
+
+fail:
+	drive_cache_free(cache);
+	return NULL;
+}
+
+void drive_cache_free(DRIVE_CACHE* cache)
+{
+	if (!cache)
+		return;
+
+	WLog_DBG(TAG,
+	         "cache stats: attributes %" PRIu64 "/%" PRIu64 ", listings %" PRIu64 "/%" PRIu64
+	         ", read-ahead %" PRIu64 "/%" PRIu64 " (hits/misses), %" PRIu64
+	         " writes coalesced into %" PRIu64 " flushes",
+	         cache->stats.attributeHits, cache->stats.attributeMisses, cache->stats.listingHits,
+	         cache->stats.listingMisses, cache->stats.readAheadHits, cache->stats.readAheadMisses,
+	         cache->stats.coalescedWrites, cache->stats.writeFlushes);
+
+#ifdef DRIVE_CACHE_INOTIFY
+	if (cache->fd >= 0)
+		close(cache->fd);
+#endif
+
+	HashTable_Free(cache->listings);
+	HashTable_Free(cache->entries);
+	HashTable_Free(cache->watchPaths);
+	HashTable_Free(cache->directories);
+	HashTable_Free(cache->watches);
+	BufferPool_Free(cache->buffers);
+	ArrayList_Free(cache->writebacks);
+	DeleteCriticalSection(&cache->lock);
+	free(cache);
+}
+
+void drive_cache_get_stats(DRIVE_CACHE* cache, DRIVE_CACHE_STATS* stats)
+{
+	WINPR_ASSERT(stats);
+
+	if (!cache)
+	{
+		memset(stats, 0, sizeof(DRIVE_CACHE_STATS));
+		return;
+	}
+
+	EnterCriticalSection(&cache->lock);
+	*stats = cache->stats;
+	LeaveCriticalSection(&cache->lock);
+}
+
+void drive_cache_count_read(DRIVE_CACHE* cache, BOOL hit)
+{
+	if (!cache)
+		return;
+
+	EnterCriticalSection(&cache->lock);
+
+	if (hit)
+		cache->stats.readAheadHits++;
+	else
+		cache->stats.readAheadMisses++;
+
+	LeaveCriticalSection(&cache->lock);
+}
+
+void drive_cache_count_write(DRIVE_CACHE* cache, BOOL coalesced)
+{
+	if (!cache)
+		return;
+
+	EnterCriticalSection(&cache->lock);
+
+	if (coalesced)
+		cache->stats.coalescedWrites++;
+	else
+		cache->stats.writeFlushes++;
+
+	LeaveCriticalSection(&cache->lock);
+}
+
+BOOL drive_cache_get_tag(DRIVE_CACHE* cache, const WCHAR* path, DRIVE_CACHE_TAG* tag)
+{
+#ifdef DRIVE_CACHE_INOTIFY
+	BOOL rc = FALSE;
+
+	if (!drive_cache_enabled(cache) || !path || !tag)
+		return FALSE;
+
+	char* directory = ConvertWCharToUtf8Alloc(path, NULL);
+
+	if (!directory)
+		return FALSE;
+
+	char* sep = strrchr(directory, '/');
+
+	if (!sep)
+		goto out;
+
+	if (sep == directory)
+		sep[1] = '\0';
+	else
+		*sep = '\0';
+
+	EnterCriticalSection(&cache->lock);
+	drive_cache_drain(cache);
+
+	const int wd = drive_cache_watch(cache, directory);
+
+	if (wd > 0)
+	{
+		void* key = (void*)(size_t)wd;
+		size_t generation = (size_t)HashTable_GetItemValue(cache->watches, key);
+
+		if (generation == 0)
+		{
+			generation = ++cache->sequence;
+
+			if (!HashTable_Insert(cache->watches, key, (void*)generation))
+				generation = 0;
+		}
+
+		if (generation != 0)
+		{
+			tag->epoch = cache->epoch;
+			tag->wd = wd;
+			tag->generation = generation;
+			tag->expires = GetTickCount64() + DRIVE_CACHE_LIFETIME_MS;
+			rc = TRUE;
+		}
+	}
+
+	LeaveCriticalSection(&cache->lock);
+out:
+	free(directory);
+	return rc;
+#else
+	WINPR_UNUSED(cache);
+	WINPR_UNUSED(path);
+	WINPR_UNUSED(tag);
+	return FALSE;
+#endif
+}
+
+BOOL drive_cache_tag_valid(DRIVE_CACHE* cache, const DRIVE_CACHE_TAG* tag)
+{
+	if (!drive_cache_enabled(cache) || !tag)
+		return FALSE;
+
+	EnterCriticalSection(&cache->lock);
+	drive_cache_drain(cache);
+	const BOOL rc = drive_cache_tag_valid_int(cache, tag);
+	LeaveCriticalSection(&cache->lock);
+	return rc;
+}
+
+/* Returns the valid entry for key, called with the lock held */
+static DRIVE_CACHE_ENTRY* drive_cache_lookup(DRIVE_CACHE* cache, const char* key)
+{
+	drive_cache_drain(cache);
+
+	DRIVE_CACHE_ENTRY* entry = HashTable_GetItemValue(cache->entries, key);
+
+	if (!entry || !drive_cache_tag_valid_int(cache, &entry->tag))
+		return NULL;
+
+	return entry;
+}
+
+/* Returns the entry to store data tagged with tag in, called with the lock held */
+static DRIVE_CACHE_ENTRY* drive_cache_update(DRIVE_CACHE* cache, const char* key,
+                                             const DRIVE_CACHE_TAG* tag)
+{
+	DRIVE_CACHE_ENTRY* entry = HashTable_GetItemValue(cache->entries, key);
+
+	if (entry)
+	{
+		/* Data read under an older generation is not known to be current any more */
+		if (!drive_cache_tag_equal(&entry->tag, tag))
+		{
+			entry->tag = *tag;
+			entry->hasAttributes = FALSE;
+			entry->hasInformation = FALSE;
+		}
+
+		return entry;
+	}
+
+	if (HashTable_Count(cache->entries) >= DRIVE_CACHE_MAX_ENTRIES)
+		HashTable_Clear(cache->entries);
+
+	entry = (DRIVE_CACHE_ENTRY*)calloc(1, sizeof(DRIVE_CACHE_ENTRY));
+
+	if (!entry)
+		return NULL;
+
+	entry->tag = *tag;
+
+	if (!HashTable_Insert(cache->entries, key, entry))
+	{
+		free(entry);
+		return NULL;
+	}
+
+	return entry;
+}
+
+BOOL drive_cache_get_attributes(DRIVE_CACHE* cache, const WCHAR* path, DWORD* attributes)
+{
+	BOOL rc = FALSE;
+
+	if (!drive_cache_enabled(cache) || !path || !attributes)
+		return FALSE;
+
+	char* key = ConvertWCharToUtf8Alloc(path, NULL);
+
+	if (!key)
+		return FALSE;
+
+	EnterCriticalSection(&cache->lock);
+	const DRIVE_CACHE_ENTRY* entry = drive_cache_lookup(cache, key);
+
+	if (entry && entry->hasAttributes)
+	{
+		*attributes = entry->attributes;
+		cache->stats.attributeHits++;
+		rc = TRUE;
+	}
+	else
+		cache->stats.attributeMisses++;
+
+	LeaveCriticalSection(&cache->lock);
+	free(key);
+	return rc;
+}
+
+void drive_cache_set_attributes(DRIVE_CACHE* cache, const WCHAR* path, const DRIVE_CACHE_TAG* tag,
+                                DWORD attributes)
+{
+	if (!drive_cache_enabled(cache) || !path || !tag)
+		return;
+
+	char* key = ConvertWCharToUtf8Alloc(path, NULL);
+
+	if (!key)
+		return;
+
+	EnterCriticalSection(&cache->lock);
+	DRIVE_CACHE_ENTRY* entry = drive_cache_update(cache, key, tag);
+
+	if (entry)
+	{
+		entry->attributes = attributes;
+		entry->hasAttributes = TRUE;
+	}
+
+	LeaveCriticalSection(&cache->lock);
+	free(key);
+}
+
+BOOL drive_cache_get_information(DRIVE_CACHE* cache, const WCHAR* path,
+                                 BY_HANDLE_FILE_INFORMATION* information)
+{
+	BOOL rc = FALSE;
+
+	if (!drive_cache_enabled(cache) || !path || !information)
+		return FALSE;
+
+	char* key = ConvertWCharToUtf8Alloc(path, NULL);
+
+	if (!key)
+		return FALSE;
+
+	EnterCriticalSection(&cache->lock);
+	const DRIVE_CACHE_ENTRY* entry = drive_cache_lookup(cache, key);
+
+	if (entry && entry->hasInformation)
+	{
+		*information = entry->information;
+		cache->stats.attributeHits++;
+		rc = TRUE;
+	}
+	else
+		cache->stats.attributeMisses++;
+
+	LeaveCriticalSection(&cache->lock);
+	free(key);
+	return rc;
+}
+
+void drive_cache_set_information(DRIVE_CACHE* cache, const WCHAR* path, const DRIVE_CACHE_TAG* tag,
+                                 const BY_HANDLE_FILE_INFORMATION* information)
+{
+	if (!drive_cache_enabled(cache) || !path || !tag || !information)
+		return;
+
+	char* key = ConvertWCharToUtf8Alloc(path, NULL);
+
+	if (!key)
+		return;
+
+	EnterCriticalSection(&cache->lock);
+	DRIVE_CACHE_ENTRY* entry = drive_cache_update(cache, key, tag);
+
+	if (entry)
+	{
+		entry->information = *information;
+		entry->hasInformation = TRUE;
+	}
+
+	LeaveCriticalSection(&cache->lock);
+	free(key);
+}
+
+DRIVE_CACHE_LISTING* drive_cache_get_listing(DRIVE_CACHE* cache, const WCHAR* pattern)
+{
+	DRIVE_CACHE_LISTING* listing = NULL;
+
+	if (!drive_cache_enabled(cache) || !pattern)
+		return NULL;
+
+	char* key = ConvertWCharToUtf8Alloc(pattern, NULL);
+
+	if (!key)
+		return NULL;
+
+	EnterCriticalSection(&cache->lock);
+	drive_cache_drain(cache);
+
+	const DRIVE_CACHE_LISTING_ENTRY* entry = HashTable_GetItemValue(cache->listings, key);
+
+	if (entry && drive_cache_tag_valid_int(cache, &entry->tag))
+	{
+		listing = entry->listing;
+		InterlockedIncrement(&listing->refcount);
+		cache->stats.listingHits++;
+	}
+	else
+		cache->stats.listingMisses++;
+
+	LeaveCriticalSection(&cache->lock);
+	free(key);
+	return listing;
+}
+
+void drive_cache_set_listing(DRIVE_CACHE* cache, const WCHAR* pattern, const DRIVE_CACHE_TAG* tag,
+                             DRIVE_CACHE_LISTING* listing)
+{
+	if (!drive_cache_enabled(cache) || !pattern || !tag || !listing)
+		return;
+
+	if (listing->count > DRIVE_CACHE_MAX_LISTING)
+		return;
+
+	char* key = ConvertWCharToUtf8Alloc(pattern, NULL);
+
+	if (!key)
+		return;
+
+	DRIVE_CACHE_LISTING_ENTRY* entry =
+	    (DRIVE_CACHE_LISTING_ENTRY*)calloc(1, sizeof(DRIVE_CACHE_LISTING_ENTRY));
+
+	if (!entry)
+	{
+		free(key);
+		return;
+	}
+
+	InterlockedIncrement(&listing->refcount);
+	entry->tag = *tag;
+	entry->listing = listing;
+
+	EnterCriticalSection(&cache->lock);
+	const DRIVE_CACHE_LISTING_ENTRY* old = HashTable_GetItemValue(cache->listings, key);
+
+	if (old)
+		cache->listed -= old->listing->count;
+
+	if ((HashTable_Count(cache->listings) >= DRIVE_CACHE_MAX_LISTINGS) ||
+	    (cache->listed + listing->count > DRIVE_CACHE_MAX_LISTED))
+	{
+		HashTable_Clear(cache->listings);
+		cache->listed = 0;
+	}
+
+	if (HashTable_Insert(cache->listings, key, entry))
+		cache->listed += listing->count;
+	else
+		drive_cache_listing_entry_free(entry);
+
+	LeaveCriticalSection(&cache->lock);
+	free(key);
+}
+
+DRIVE_CACHE_LISTING* drive_cache_listing_new(void)
+{
+	DRIVE_CACHE_LISTING* listing = (DRIVE_CACHE_LISTING*)calloc(1, sizeof(DRIVE_CACHE_LISTING));
+
+	if (!listing)
+		return NULL;
+
+	listing->refcount = 1;
+	return listing;
+}
+
+BOOL drive_cache_listing_append(DRIVE_CACHE_LISTING* listing, const WIN32_FIND_DATAW* entry)
+{
+	WINPR_ASSERT(listing);
+	WINPR_ASSERT(entry);
+
+	if (listing->count == listing->capacity)
+	{
+		const size_t capacity = (listing->capacity > 0) ? listing->capacity * 2 : 32;
+		WIN32_FIND_DATAW* entries =
+		    (WIN32_FIND_DATAW*)realloc(listing->entries, capacity * sizeof(WIN32_FIND_DATAW));
+
+		if (!entries)
+			return FALSE;
+
+		listing->entries = entries;
+		listing->capacity = capacity;
+	}
+
+	listing->entries[listing->count++] = *entry;
+	return TRUE;
+}
+
+void drive_cache_listing_release(DRIVE_CACHE_LISTING* listing)
+{
+	if (!listing)
+		return;
+
+	if (InterlockedDecrement(&listing->refcount) > 0)
+		return;
+
+	free(listing->entries);
+	free(listing);
+}
+
+wArrayList* drive_cache_get_writebacks(DRIVE_CACHE* cache)
+{
+	if (!cache)
+		return NULL;
+
+	return cache->writebacks;
+}
+
+BYTE* drive_cache_take_buffer(DRIVE_CACHE* cache)
+{
+	BYTE* buffer = NULL;
+
+	if (!cache)
+		return NULL;
+
+	EnterCriticalSection(&cache->lock);
+
+	if (cache->buffersInUse < DRIVE_CACHE_MAX_BUFFERS)
+	{
+		buffer = BufferPool_Take(cache->buffers, DRIVE_CACHE_BUFFER_SIZE);
+
+		if (buffer)
+			cache->buffersInUse++;
+	}
+
+	LeaveCriticalSection(&cache->lock);
+	return buffer;
+}
+
+void drive_cache_return_buffer(DRIVE_CACHE* cache, BYTE* buffer)
+{
+	if (!cache || !buffer)
+		return;
+
+	EnterCriticalSection(&cache->lock);
+	BufferPool_Return(cache->buffers, buffer);
+	cache->buffersInUse--;
+	LeaveCriticalSection(&cache->lock);
+}
@@ -0,0 +1,111 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * File System Virtual Channel
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_CHANNEL_DRIVE_CLIENT_CACHE_H
+#define FREERDP_CHANNEL_DRIVE_CLIENT_CACHE_H
+
+#include <winpr/wtypes.h>
+#include <winpr/file.h>
+#include <winpr/collections.h>
+
+/* Size of the pooled read-ahead and write-back buffers */
+#define DRIVE_CACHE_BUFFER_SIZE (256 * 1024)
+
+/* Listings with more entries are served from the file system and not cached */
+#define DRIVE_CACHE_MAX_LISTING 1024
+
+/**
+ * Per drive cache of file attributes and directory listings.
+ *
+ * Entries are tagged with an inotify watch on the directory holding the path and are
+ * dropped as soon as anything in that directory changes, whether through this drive or
+ * locally. Times of a subdirectory change with its children which the watch does not
+ * report, so entries also expire after a few seconds.
+ * Without inotify nothing is cached, the pooled buffers are available either way.
+ */
+typedef struct s_drive_cache DRIVE_CACHE;
+
+typedef struct
+{
+	UINT64 epoch;
+	INT32 wd;
+	size_t generation;
+	UINT64 expires;
+} DRIVE_CACHE_TAG;
+
+typedef struct
+{
+	LONG refcount;
+	size_t count;
+	size_t capacity;
+	WIN32_FIND_DATAW* entries;
+} DRIVE_CACHE_LISTING;
+
+typedef struct
+{
+	UINT64 attributeHits;
+	UINT64 attributeMisses;
+	UINT64 listingHits;
+	UINT64 listingMisses;
+	UINT64 readAheadHits;
+	UINT64 readAheadMisses;
+	UINT64 coalescedWrites;
+	UINT64 writeFlushes;
+} DRIVE_CACHE_STATS;
+
+DRIVE_CACHE* drive_cache_new(void);
+void drive_cache_free(DRIVE_CACHE* cache);
+
+void drive_cache_get_stats(DRIVE_CACHE* cache, DRIVE_CACHE_STATS* stats);
+void drive_cache_count_read(DRIVE_CACHE* cache, BOOL hit);
+void drive_cache_count_write(DRIVE_CACHE* cache, BOOL coalesced);
+
+/**
+ * Watches the directory holding path. Call it before reading what is to be cached,
+ * a change in between then invalidates the tag.
+ */
+BOOL drive_cache_get_tag(DRIVE_CACHE* cache, const WCHAR* path, DRIVE_CACHE_TAG* tag);
+BOOL drive_cache_tag_valid(DRIVE_CACHE* cache, const DRIVE_CACHE_TAG* tag);
+
+BOOL drive_cache_get_attributes(DRIVE_CACHE* cache, const WCHAR* path, DWORD* attributes);
+void drive_cache_set_attributes(DRIVE_CACHE* cache, const WCHAR* path, const DRIVE_CACHE_TAG* tag,
+                                DWORD attributes);
+BOOL drive_cache_get_information(DRIVE_CACHE* cache, const WCHAR* path,
+                                 BY_HANDLE_FILE_INFORMATION* information);
+void drive_cache_set_information(DRIVE_CACHE* cache, const WCHAR* path, const DRIVE_CACHE_TAG* tag,
+                                 const BY_HANDLE_FILE_INFORMATION* information);
+
+/** Returns a referenced listing for the search pattern, release it when done */
+DRIVE_CACHE_LISTING* drive_cache_get_listing(DRIVE_CACHE* cache, const WCHAR* pattern);
+void drive_cache_set_listing(DRIVE_CACHE* cache, const WCHAR* pattern, const DRIVE_CACHE_TAG* tag,
+                             DRIVE_CACHE_LISTING* listing);
+
+DRIVE_CACHE_LISTING* drive_cache_listing_new(void);
+BOOL drive_cache_listing_append(DRIVE_CACHE_LISTING* listing, const WIN32_FIND_DATAW* entry);
+void drive_cache_listing_release(DRIVE_CACHE_LISTING* listing);
+
+/**
+ * Handles holding writes not yet passed to the file system. Lock the list to access their
+ * write-back state, the handles remove themselves once flushed.
+ */
+wArrayList* drive_cache_get_writebacks(DRIVE_CACHE* cache);
+
+/** Returns a DRIVE_CACHE_BUFFER_SIZE buffer or NULL if too many are in use */
+BYTE* drive_cache_take_buffer(DRIVE_CACHE* cache);
+void drive_cache_return_buffer(DRIVE_CACHE* cache, BYTE* buffer);
+
+#endif /* FREERDP_CHANNEL_DRIVE_CLIENT_CACHE_H */
@@ -44,6 +44,9 @@
 
 #include "drive_file.h"
 
+/* Writes up to this size are collected until the client stops writing sequentially */
+#define DRIVE_FILE_COALESCE_LIMIT (16 * 1024)
+
 #ifdef WITH_DEBUG_RDPDR
 #define DEBUG_WSTR(msg, wstr)                                    \
 	do                                                           \
@@ -186,10 +189,28 @@ static BOOL drive_file_set_fullpath(DRIVE_FILE* file, WCHAR* fullpath)
 	return TRUE;
 }
 
+static DWORD drive_file_get_attributes(DRIVE_FILE* file)
+{
+	DRIVE_CACHE_TAG tag = { 0 };
+	DWORD dwAttr = INVALID_FILE_ATTRIBUTES;
+
+	if (drive_cache_get_attributes(file->cache, file->fullpath, &dwAttr))
+		return dwAttr;
+
+	/* Watch before asking, a change in between then invalidates the entry */
+	const BOOL cacheable = drive_cache_get_tag(file->cache, file->fullpath, &tag);
+	dwAttr = GetFileAttributesW(file->fullpath);
+
+	if (cacheable && (dwAttr != INVALID_FILE_ATTRIBUTES))
+		drive_cache_set_attributes(file->cache, file->fullpath, &tag, dwAttr);
+
+	return dwAttr;
+}
+
 static BOOL drive_file_init(DRIVE_FILE* file)
 {
 	UINT CreateDisposition = 0;
-	DWORD dwAttr = GetFileAttributesW(file->fullpath);
+	DWORD dwAttr = drive_file_get_attributes(file);
 
 	if (dwAttr != INVALID_FILE_ATTRIBUTES)
 	{
@@ -313,9 +334,10 @@ static BOOL drive_file_init(DRIVE_FILE* file)
 	return file->file_handle != INVALID_HANDLE_VALUE;
 }
 
-DRIVE_FILE* drive_file_new(const WCHAR* base_path, const WCHAR* path, UINT32 PathWCharLength,
-                           UINT32 id, UINT32 DesiredAccess, UINT32 CreateDisposition,
-                           UINT32 CreateOptions, UINT32 FileAttributes, UINT32 SharedAccess)
+DRIVE_FILE* drive_file_new(const WCHAR* base_path, DRIVE_CACHE* cache, const WCHAR* path,
+                           UINT32 PathWCharLength, UINT32 id, UINT32 DesiredAccess,
+                           UINT32 CreateDisposition, UINT32 CreateOptions, UINT32 FileAttributes,
+                           UINT32 SharedAccess)
 {
 	DRIVE_FILE* file = NULL;
 
@@ -339,8 +361,12 @@ DRIVE_FILE* drive_file_new(const WCHAR* base_path, const WCHAR* path, UINT32 Pat
 	file->CreateDisposition = CreateDisposition;
 	file->CreateOptions = CreateOptions;
 	file->SharedAccess = SharedAccess;
+	file->cache = cache;
 	drive_file_set_fullpath(file, drive_file_combine_fullpath(base_path, path, PathWCharLength));
 
+	/* Other handles might still hold writes to the file, it is opened or replaced after them */
+	drive_file_flush_path(cache, file->fullpath);
+
 	if (!drive_file_init(file))
 	{
 		DWORD lastError = GetLastError();
@@ -352,6 +378,116 @@ DRIVE_FILE* drive_file_new(const WCHAR* base_path, const WCHAR* path, UINT32 Pat
 	return file;
 }
 
+static BOOL drive_file_position(DRIVE_FILE* file, UINT64 Offset)
+{
+	LARGE_INTEGER loffset = { 0 };
+
+	loffset.QuadPart = (LONGLONG)Offset;
+	return SetFilePointerEx(file->file_handle, loffset, NULL, FILE_BEGIN);
+}
+
+static BOOL drive_file_write_at(DRIVE_FILE* file, UINT64 Offset, const BYTE* buffer,
+                                UINT32 Length)
+{
+	DWORD written = 0;
+	const UINT64 end = Offset + Length;
+
+	if (!drive_file_position(file, Offset))
+		return FALSE;
+
+	while (Length > 0)
+	{
+		if (!WriteFile(file->file_handle, buffer, Length, &written, NULL))
+			return FALSE;
+
+		Length -= written;
+		buffer += written;
+	}
+
+	/* WinPR files are buffered, seeking passes the data on to the file system where other
+	 * handles see it and a failure to write it shows */
+	return drive_file_position(file, end);
+}
+
+/**
+ * Passes coalesced writes on to the handle and completes the requests that made them, a
+ * failure is reported to these and not to the request that caused the flush.
+ * Called with the write-back list locked, the file leaves it.
+ */
+static BOOL drive_file_flush_locked(DRIVE_FILE* file, wArrayList* writebacks)
+{
+	const UINT32 length = file->writeback_length;
+
+	if (length == 0)
+		return TRUE;
+
+	file->writeback_length = 0;
+	ArrayList_Remove(writebacks, file);
+	drive_cache_count_write(file->cache, FALSE);
+
+	const BOOL rc = drive_file_write_at(file, file->writeback_offset, file->writeback, length);
+	DWORD error = 0;
+
+	if (!rc)
+	{
+		error = GetLastError();
+
+		if (error == 0)
+			error = ERROR_WRITE_FAULT;
+	}
+
+	for (size_t x = 0; x < file->writeback_count; x++)
+	{
+		const UINT status = file->WriteComplete(file->writeback_requests[x], error);
+
+		if (status != CHANNEL_RC_OK)
+			WLog_WARN(TAG, "completing a deferred write failed with %" PRIu32, status);
+	}
+
+	file->writeback_count = 0;
+	SetLastError(error);
+	return rc;
+}
+
+void drive_file_flush(DRIVE_FILE* file)
+{
+	wArrayList* writebacks = drive_cache_get_writebacks(file->cache);
+
+	if (!writebacks)
+		return;
+
+	ArrayList_Lock(writebacks);
+	(void)drive_file_flush_locked(file, writebacks);
+	ArrayList_Unlock(writebacks);
+}
+
+void drive_file_flush_path(DRIVE_CACHE* cache, const WCHAR* path)
+{
+	wArrayList* writebacks = drive_cache_get_writebacks(cache);
+
+	if (!writebacks)
+		return;
+
+	ArrayList_Lock(writebacks);
+
+	/* Handles only ever touch their own file outside of the lock while they are not listed */
+	for (size_t x = ArrayList_Count(writebacks); x > 0; x--)
+	{
+		DRIVE_FILE* file = ArrayList_GetItem(writebacks, x - 1);
+
+		if (!path || (file->fullpath && (_wcscmp(file->fullpath, path) == 0)))
+			(void)drive_file_flush_locked(file, writebacks);
+	}
+
+	ArrayList_Unlock(writebacks);
+}
+
+static void drive_file_drop_readahead(DRIVE_FILE* file)
+{
+	file->readahead_filled = FALSE;
+	file->readahead_length = 0;
+}
+
 BOOL drive_file_free(DRIVE_FILE* file)
 {
 	BOOL rc = FALSE;
@@ -359,6 +495,11 @@ BOOL drive_file_free(DRIVE_FILE* file)
 	if (!file)
 		return FALSE;
 
+	drive_file_flush(file);
+	drive_cache_return_buffer(file->cache, file->readahead);
+	drive_cache_return_buffer(file->cache, file->writeback);
+	drive_cache_listing_release(file->listing);
+
 	if (file->file_handle != INVALID_HANDLE_VALUE)
 	{
 		(void)CloseHandle(file->file_handle);
@@ -392,16 +533,72 @@ fail:
 
 BOOL drive_file_seek(DRIVE_FILE* file, UINT64 Offset)
 {
-	LARGE_INTEGER loffset = { 0 };
-
 	if (!file)
 		return FALSE;
 
 	if (Offset > INT64_MAX)
 		return FALSE;
 
-	loffset.QuadPart = (LONGLONG)Offset;
-	return SetFilePointerEx(file->file_handle, loffset, NULL, FILE_BEGIN);
+	if (file->file_handle == INVALID_HANDLE_VALUE)
+	{
+		SetLastError(ERROR_INVALID_HANDLE);
+		return FALSE;
+	}
+
+	file->offset = Offset;
+	return TRUE;
+}
+
+/* Serves the read from the read-ahead buffer if that holds the whole range */
+static BOOL drive_file_read_buffered(DRIVE_FILE* file, BYTE* buffer, UINT32* Length)
+{
+	const UINT64 start = file->readahead_offset;
+	const UINT64 end = start + file->readahead_length;
+
+	if (!file->readahead_filled || (file->offset < start) || (file->offset > end))
+		return FALSE;
+
+	/* A short buffer ended at the end of the file, anything beyond is not there */
+	const UINT64 available = end - file->offset;
+
+	if ((available < *Length) && (file->readahead_length == DRIVE_CACHE_BUFFER_SIZE))
+		return FALSE;
+
+	if (!drive_cache_tag_valid(file->cache, &file->readahead_tag))
+	{
+		drive_file_drop_readahead(file);
+		return FALSE;
+	}
+
+	*Length = (UINT32)MIN(*Length, available);
+	memcpy(buffer, &file->readahead[file->offset - start], *Length);
+	return TRUE;
+}
+
+static BOOL drive_file_fill_readahead(DRIVE_FILE* file)
+{
+	DWORD read = 0;
+
+	drive_file_drop_readahead(file);
+
+	/* Watch before reading, a change in between then invalidates the data */
+	if (!drive_cache_get_tag(file->cache, file->fullpath, &file->readahead_tag))
+		return FALSE;
+
+	if (!file->readahead)
+		file->readahead = drive_cache_take_buffer(file->cache);
+
+	if (!file->readahead)
+		return FALSE;
+
+	if (!drive_file_position(file, file->offset) ||
+	    !ReadFile(file->file_handle, file->readahead, DRIVE_CACHE_BUFFER_SIZE, &read, NULL))
+		return FALSE;
+
+	file->readahead_offset = file->offset;
+	file->readahead_length = read;
+	file->readahead_filled = TRUE;
+	return TRUE;
 }
 
 BOOL drive_file_read(DRIVE_FILE* file, BYTE* buffer, UINT32* Length)
@@ -413,34 +610,117 @@ BOOL drive_file_read(DRIVE_FILE* file, BYTE* buffer, UINT32* Length)
 
 	DEBUG_WSTR("Read file %s", file->fullpath);
 
+	drive_file_flush_path(file->cache, file->fullpath);
+
+	if (drive_file_read_buffered(file, buffer, Length))
+	{
+		drive_cache_count_read(file->cache, TRUE);
+		file->readahead_next = file->offset + *Length;
+		return TRUE;
+	}
+
+	drive_cache_count_read(file->cache, FALSE);
+
+	/* Only reads continuing where the last one ended are worth reading ahead for */
+	if ((file->offset == file->readahead_next) && (*Length < DRIVE_CACHE_BUFFER_SIZE) &&
+	    drive_file_fill_readahead(file) && drive_file_read_buffered(file, buffer, Length))
+	{
+		file->readahead_next = file->offset + *Length;
+		return TRUE;
+	}
+
+	if (!drive_file_position(file, file->offset))
+		return FALSE;
+
 	if (ReadFile(file->file_handle, buffer, *Length, &read, NULL))
 	{
 		*Length = read;
+		file->readahead_next = file->offset + read;
 		return TRUE;
 	}
 
 	return FALSE;
 }
 
-BOOL drive_file_write(DRIVE_FILE* file, const BYTE* buffer, UINT32 Length)
+/* Appends to the write-back buffer if the write continues it, called with the list locked */
+static BOOL drive_file_coalesce(DRIVE_FILE* file, wArrayList* writebacks, const BYTE* buffer,
+                                UINT32 Length)
 {
-	DWORD written = 0;
+	if ((Length == 0) || (Length > DRIVE_FILE_COALESCE_LIMIT))
+		return FALSE;
 
-	if (!file || !buffer)
+	if (file->writeback_length > 0)
+	{
+		if ((file->offset != file->writeback_offset + file->writeback_length) ||
+		    (Length > DRIVE_CACHE_BUFFER_SIZE - file->writeback_length) ||
+		    (file->writeback_count >= DRIVE_FILE_MAX_DEFERRED))
+			return FALSE;
+	}
+	else
+	{
+		if (!file->writeback)
+			file->writeback = drive_cache_take_buffer(file->cache);
+
+		if (!file->writeback || !ArrayList_Append(writebacks, file))
+			return FALSE;
+
+		file->writeback_offset = file->offset;
+	}
+
+	memcpy(&file->writeback[file->writeback_length], buffer, Length);
+	file->writeback_length += Length;
+	drive_cache_count_write(file->cache, TRUE);
+	return TRUE;
+}
+
+BOOL drive_file_write(DRIVE_FILE* file, const BYTE* buffer, UINT32 Length, void* request,
+                      BOOL* deferred)
+{
+	if (!file || !buffer || !deferred)
 		return FALSE;
 
 	DEBUG_WSTR("Write file %s", file->fullpath);
 
-	while (Length > 0)
+	*deferred = FALSE;
+
+	/* Writes through the handle are buffered before inotify gets to see them */
+	drive_file_drop_readahead(file);
+
+	wArrayList* writebacks = drive_cache_get_writebacks(file->cache);
+
+	if (writebacks)
 	{
-		if (!WriteFile(file->file_handle, buffer, Length, &written, NULL))
-			return FALSE;
+		BOOL rc = TRUE;
+		ArrayList_Lock(writebacks);
 
-		Length -= written;
-		buffer += written;
+		BOOL coalesced = drive_file_coalesce(file, writebacks, buffer, Length);
+
+		/* A write not continuing the buffered ones starts over once they are written */
+		if (!coalesced && (file->writeback_length > 0))
+		{
+			(void)drive_file_flush_locked(file, writebacks);
+			coalesced = drive_file_coalesce(file, writebacks, buffer, Length);
+		}
+
+		if (coalesced)
+		{
+			/* Without a request to complete later the write has to be done now */
+			if (request && file->WriteComplete)
+			{
+				file->writeback_requests[file->writeback_count++] = request;
+				*deferred = TRUE;
+			}
+			else
+				rc = drive_file_flush_locked(file, writebacks);
+
+			ArrayList_Unlock(writebacks);
+			return rc;
+		}
+
+		ArrayList_Unlock(writebacks);
 	}
 
-	return TRUE;
+	return drive_file_write_at(file, file->offset, buffer, Length);
 }
 
 static BOOL drive_file_query_from_handle_information(const DRIVE_FILE* file,
@@ -574,12 +854,26 @@ static BOOL drive_file_query_from_attributes(const DRIVE_FILE* file,
 BOOL drive_file_query_information(DRIVE_FILE* file, UINT32 FsInformationClass, wStream* output)
 {
 	BY_HANDLE_FILE_INFORMATION fileInformation = { 0 };
+	DRIVE_CACHE_TAG tag = { 0 };
 	BOOL status = 0;
 	HANDLE hFile = NULL;
 
 	if (!file || !output)
 		return FALSE;
 
+	drive_file_flush_path(file->cache, file->fullpath);
+
+	if (drive_cache_get_information(file->cache, file->fullpath, &fileInformation))
+	{
+		if (!drive_file_query_from_handle_information(file, &fileInformation, FsInformationClass,
+		                                              output))
+			goto out_fail;
+
+		return TRUE;
+	}
+
+	/* Watch before asking, a change in between then invalidates the entry */
+	const BOOL cacheable = drive_cache_get_tag(file->cache, file->fullpath, &tag);
 	hFile = CreateFileW(file->fullpath, 0, FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
 	                    FILE_ATTRIBUTE_NORMAL, NULL);
 	if (hFile != INVALID_HANDLE_VALUE)
@@ -589,6 +883,9 @@ BOOL drive_file_query_information(DRIVE_FILE* file, UINT32 FsInformationClass, w
 		if (!status)
 			goto out_fail;
 
+		if (cacheable)
+			drive_cache_set_information(file->cache, file->fullpath, &tag, &fileInformation);
+
 		if (!drive_file_query_from_handle_information(file, &fileInformation, FsInformationClass,
 		                                              output))
 			goto out_fail;
@@ -636,6 +933,11 @@ BOOL drive_file_set_information(DRIVE_FILE* file, UINT32 FsInformationClass, UIN
 	if (!file || !input)
 		return FALSE;
 
+	/* Pending writes go first, a truncation must apply to them */
+	drive_file_flush_path(file->cache, file->fullpath);
+
+	drive_file_drop_readahead(file);
+
 	switch (FsInformationClass)
 	{
 		case FileBasicInformation:
@@ -822,6 +1124,81 @@ BOOL drive_file_set_information(DRIVE_FILE* file, UINT32 FsInformationClass, UIN
 	return TRUE;
 }
 
+static BOOL drive_file_find_next(DRIVE_FILE* file)
+{
+	if (file->listing && (file->listing_index < file->listing->count))
+	{
+		file->find_data = file->listing->entries[file->listing_index++];
+		return TRUE;
+	}
+
+	if (file->find_handle == INVALID_HANDLE_VALUE)
+	{
+		SetLastError(ERROR_NO_MORE_FILES);
+		return FALSE;
+	}
+
+	return FindNextFileW(file->find_handle, &file->find_data);
+}
+
+static BOOL drive_file_find_first(DRIVE_FILE* file, const WCHAR* ent_path)
+{
+	DRIVE_CACHE_TAG tag = { 0 };
+
+	file->listing = drive_cache_get_listing(file->cache, ent_path);
+	file->listing_index = 0;
+
+	if (file->listing)
+		return drive_file_find_next(file);
+
+	/* Watch before listing, a change in between then invalidates the listing */
+	const BOOL cacheable = drive_cache_get_tag(file->cache, ent_path, &tag);
+	file->find_handle = FindFirstFileW(ent_path, &file->find_data);
+
+	if (file->find_handle == INVALID_HANDLE_VALUE)
+		return FALSE;
+
+	if (!cacheable)
+		return TRUE;
+
+	/* Take a snapshot, the first entry is served from it as well */
+	DRIVE_CACHE_LISTING* listing = drive_cache_listing_new();
+
+	if (!listing || !drive_cache_listing_append(listing, &file->find_data))
+	{
+		drive_cache_listing_release(listing);
+		return TRUE;
+	}
+
+	while (listing->count < DRIVE_CACHE_MAX_LISTING)
+	{
+		WIN32_FIND_DATAW find_data = { 0 };
+
+		if (!FindNextFileW(file->find_handle, &find_data))
+		{
+			/* Complete, what the handle would return next is the error */
+			if (GetLastError() == ERROR_NO_MORE_FILES)
+			{
+				FindClose(file->find_handle);
+				file->find_handle = INVALID_HANDLE_VALUE;
+				drive_cache_set_listing(file->cache, ent_path, &tag, listing);
+			}
+
+			break;
+		}
+
+		if (!drive_cache_listing_append(listing, &find_data))
+		{
+			drive_cache_listing_release(listing);
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+			return FALSE;
+		}
+	}
+
+	file->listing = listing;
+	return drive_file_find_next(file);
+}
+
 BOOL drive_file_query_directory(DRIVE_FILE* file, UINT32 FsInformationClass, BYTE InitialQuery,
                                 const WCHAR* path, UINT32 PathWCharLength, wStream* output)
 {
@@ -837,15 +1214,22 @@ BOOL drive_file_query_directory(DRIVE_FILE* file, UINT32 FsInformationClass, BYT
 		if (file->find_handle != INVALID_HANDLE_VALUE)
 			FindClose(file->find_handle);
 
+		file->find_handle = INVALID_HANDLE_VALUE;
+		drive_cache_listing_release(file->listing);
+		file->listing = NULL;
+
+		/* Sizes and times in the listing have to include writes not passed on yet */
+		drive_file_flush_path(file->cache, NULL);
+
 		ent_path = drive_file_combine_fullpath(file->basepath, path, PathWCharLength);
 		/* open new search handle and retrieve the first entry */
-		file->find_handle = FindFirstFileW(ent_path, &file->find_data);
+		const BOOL found = ent_path && drive_file_find_first(file, ent_path);
 		free(ent_path);
 
-		if (file->find_handle == INVALID_HANDLE_VALUE)
+		if (!found)
 			goto out_fail;
 	}
-	else if (!FindNextFileW(file->find_handle, &file->find_data))
+	else if (!drive_file_find_next(file))
 		goto out_fail;
 
 	length = _wcslen(file->find_data.cFileName) * 2;
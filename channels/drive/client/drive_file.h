@@ -30,8 +30,19 @@
 #include <winpr/file.h>
 #include <freerdp/channels/log.h>
 
+#include "drive_cache.h"
+
 #define TAG CHANNELS_TAG("drive.client")
 
+/* Write requests completed together once their coalesced data is written */
+#define DRIVE_FILE_MAX_DEFERRED 64
+
+/**
+ * Completes a write request drive_file_write deferred, error is 0 if the data was written.
+ * Called with the write-back list of the cache locked.
+ */
+typedef UINT (*pcDriveFileWriteComplete)(void* request, DWORD error);
+
 typedef struct
 {
 	UINT32 id;
@@ -47,17 +58,61 @@ typedef struct
 	UINT32 DesiredAccess;
 	UINT32 CreateDisposition;
 	UINT32 CreateOptions;
+	DRIVE_CACHE* cache;
+
+	/* set by drive_file_seek, the handle is only positioned when it is accessed */
+	UINT64 offset;
+
+	/* sequential read-ahead */
+	BYTE* readahead;
+	BOOL readahead_filled;
+	UINT64 readahead_offset;
+	UINT32 readahead_length;
+	UINT64 readahead_next;
+	DRIVE_CACHE_TAG readahead_tag;
+
+	/* small sequential writes not yet passed to the handle and the requests that made them,
+	 * protected by the write-back list lock of the cache */
+	BYTE* writeback;
+	UINT64 writeback_offset;
+	UINT32 writeback_length;
+	void* writeback_requests[DRIVE_FILE_MAX_DEFERRED];
+	size_t writeback_count;
+	pcDriveFileWriteComplete WriteComplete;
+
+	/* directory listing snapshot, served before find_handle is continued */
+	DRIVE_CACHE_LISTING* listing;
+	size_t listing_index;
+
+	/* IRP scheduling, protected by the drive lock */
+	UINT32 worker;
+	UINT32 outstanding;
 } DRIVE_FILE;
 
-DRIVE_FILE* drive_file_new(const WCHAR* base_path, const WCHAR* path, UINT32 PathWCharLength,
-                           UINT32 id, UINT32 DesiredAccess, UINT32 CreateDisposition,
-                           UINT32 CreateOptions, UINT32 FileAttributes, UINT32 SharedAccess);
+DRIVE_FILE* drive_file_new(const WCHAR* base_path, DRIVE_CACHE* cache, const WCHAR* path,
+                           UINT32 PathWCharLength, UINT32 id, UINT32 DesiredAccess,
+                           UINT32 CreateDisposition, UINT32 CreateOptions, UINT32 FileAttributes,
+                           UINT32 SharedAccess);
 BOOL drive_file_free(DRIVE_FILE* file);
 
 BOOL drive_file_open(DRIVE_FILE* file);
 BOOL drive_file_seek(DRIVE_FILE* file, UINT64 Offset);
 BOOL drive_file_read(DRIVE_FILE* file, BYTE* buffer, UINT32* Length);
-BOOL drive_file_write(DRIVE_FILE* file, const BYTE* buffer, UINT32 Length);
+
+/**
+ * Writes at the offset set by drive_file_seek. If request is not NULL a small sequential write
+ * may be coalesced with the following ones, deferred is then set and request is completed
+ * through WriteComplete once the data is written.
+ */
+BOOL drive_file_write(DRIVE_FILE* file, const BYTE* buffer, UINT32 Length, void* request,
+                      BOOL* deferred);
+
+/** Writes the coalesced data of the handle and completes the requests waiting for it */
+void drive_file_flush(DRIVE_FILE* file);
+
+/** Writes the coalesced data of all handles to path, of all handles if path is NULL */
+void drive_file_flush_path(DRIVE_CACHE* cache, const WCHAR* path);
+
 BOOL drive_file_query_information(DRIVE_FILE* file, UINT32 FsInformationClass, wStream* output);
 BOOL drive_file_set_information(DRIVE_FILE* file, UINT32 FsInformationClass, UINT32 Length,
                                 wStream* input);
@@ -46,6 +46,17 @@
 
 #include "drive_file.h"
 
+/* File I/O bound, the workers mostly wait for the file system */
+#define DRIVE_WORKER_COUNT 4
+
+typedef struct
+{
+	DEVICE* device;
+	HANDLE thread;
+	wMessageQueue* queue;
+	UINT32 outstanding;
+} DRIVE_WORKER;
+
 typedef struct
 {
 	DEVICE device;
@@ -54,11 +65,16 @@ typedef struct
 	BOOL automount;
 	UINT32 PathLength;
 	wListDictionary* files;
+	DRIVE_CACHE* cache;
 
 	HANDLE thread;
 	BOOL async;
 	wMessageQueue* IrpQueue;
 
+	/* IRPs of one file run in order on one worker, independent files run in parallel */
+	CRITICAL_SECTION lock;
+	DRIVE_WORKER workers[DRIVE_WORKER_COUNT];
+
 	DEVMAN* devman;
 
 	rdpContext* rdpcontext;
@@ -143,6 +159,28 @@ static DRIVE_FILE* drive_get_file_by_id(DRIVE_DEVICE* drive, UINT32 id)
 	return file;
 }
 
+/**
+ * Completes a write IRP whose data was coalesced with the writes following it
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT drive_irp_write_complete(void* request, DWORD error)
+{
+	IRP* irp = (IRP*)request;
+
+	WINPR_ASSERT(irp);
+
+	if (error != 0)
+	{
+		irp->IoStatus = drive_map_windows_err(error);
+		Stream_Rewind(irp->output, 5);
+		Stream_Write_UINT32(irp->output, 0); /* Length */
+		Stream_Write_UINT8(irp->output, 0);  /* Padding */
+	}
+
+	return irp->Complete(irp);
+}
+
 /**
  * Function description
  *
@@ -180,9 +218,12 @@ static UINT drive_process_irp_create(DRIVE_DEVICE* drive, IRP* irp)
 		return ERROR_INVALID_DATA;
 
 	path = Stream_ConstPointer(irp->input);
+	EnterCriticalSection(&drive->lock);
 	FileId = irp->devman->id_sequence++;
-	file = drive_file_new(drive->path, path, PathLength / sizeof(WCHAR), FileId, DesiredAccess,
-	                      CreateDisposition, CreateOptions, FileAttributes, SharedAccess);
+	LeaveCriticalSection(&drive->lock);
+	file = drive_file_new(drive->path, drive->cache, path, PathLength / sizeof(WCHAR), FileId,
+	                      DesiredAccess, CreateDisposition, CreateOptions, FileAttributes,
+	                      SharedAccess);
 
 	if (!file)
 	{
@@ -193,6 +234,7 @@ static UINT drive_process_irp_create(DRIVE_DEVICE* drive, IRP* irp)
 	else
 	{
 		void* key = (void*)(size_t)file->id;
+		file->WriteComplete = drive_irp_write_complete;
 
 		if (!ListDictionary_Add(drive->files, key, file))
 		{
@@ -248,7 +290,9 @@ static UINT drive_process_irp_close(DRIVE_DEVICE* drive, IRP* irp)
 		irp->IoStatus = STATUS_UNSUCCESSFUL;
 	else
 	{
+		EnterCriticalSection(&drive->lock);
 		ListDictionary_Take(drive->files, key);
+		LeaveCriticalSection(&drive->lock);
 
 		if (drive_file_free(file))
 			irp->IoStatus = STATUS_SUCCESS;
@@ -343,24 +387,36 @@ static UINT drive_process_irp_write(DRIVE_DEVICE* drive, IRP* irp)
 		return ERROR_INVALID_DATA;
 	file = drive_get_file_by_id(drive, irp->FileId);
 
+	/* The response is written up front, a deferred write completes the IRP later */
+	Stream_Write_UINT32(irp->output, Length);
+	Stream_Write_UINT8(irp->output, 0); /* Padding */
+
 	if (!file)
-	{
 		irp->IoStatus = STATUS_UNSUCCESSFUL;
-		Length = 0;
-	}
 	else if (!drive_file_seek(file, Offset))
-	{
 		irp->IoStatus = drive_map_windows_err(GetLastError());
-		Length = 0;
+	else
+	{
+		BOOL deferred = FALSE;
+
+		/* Only coalesce while the next request for the file is already queued */
+		EnterCriticalSection(&drive->lock);
+		const BOOL queued = file->outstanding > 1;
+		LeaveCriticalSection(&drive->lock);
+
+		if (!drive_file_write(file, ptr, Length, queued ? irp : NULL, &deferred))
+			irp->IoStatus = drive_map_windows_err(GetLastError());
+		else if (deferred)
+			return CHANNEL_RC_OK;
 	}
-	else if (!drive_file_write(file, ptr, Length))
+
+	if (irp->IoStatus != STATUS_SUCCESS)
 	{
-		irp->IoStatus = drive_map_windows_err(GetLastError());
-		Length = 0;
+		Stream_Rewind(irp->output, 5);
+		Stream_Write_UINT32(irp->output, 0); /* Length */
+		Stream_Write_UINT8(irp->output, 0);  /* Padding */
 	}
 
-	Stream_Write_UINT32(irp->output, Length);
-	Stream_Write_UINT8(irp->output, 0); /* Padding */
 	return irp->Complete(irp);
 }
 
@@ -600,6 +656,25 @@ static UINT drive_process_irp_silent_ignore(DRIVE_DEVICE* drive, IRP* irp)
 	return irp->Complete(irp);
 }
 
+/**
+ * Function description
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT drive_process_irp_lock_control(DRIVE_DEVICE* drive, IRP* irp)
+{
+	if (!drive || !irp)
+		return ERROR_INVALID_PARAMETER;
+
+	/* Locks are not enforced, but whoever takes one expects to see all data written before */
+	DRIVE_FILE* file = drive_get_file_by_id(drive, irp->FileId);
+
+	if (file)
+		drive_file_flush_path(drive->cache, file->fullpath);
+
+	return drive_process_irp_silent_ignore(drive, irp);
+}
+
 /**
  * Function description
  *
@@ -698,6 +773,16 @@ static UINT drive_process_irp(DRIVE_DEVICE* drive, IRP* irp)
 
 	irp->IoStatus = STATUS_SUCCESS;
 
+	/* A write is only deferred while another request for the file is queued, whatever that
+	 * request is the write is done and completed before it */
+	if ((irp->MajorFunction != IRP_MJ_CREATE) && (irp->MajorFunction != IRP_MJ_WRITE))
+	{
+		DRIVE_FILE* file = drive_get_file_by_id(drive, irp->FileId);
+
+		if (file)
+			drive_file_flush(file);
+	}
+
 	switch (irp->MajorFunction)
 	{
 		case IRP_MJ_CREATE:
@@ -729,7 +814,7 @@ static UINT drive_process_irp(DRIVE_DEVICE* drive, IRP* irp)
 			break;
 
 		case IRP_MJ_LOCK_CONTROL:
-			error = drive_process_irp_silent_ignore(drive, irp);
+			error = drive_process_irp_lock_control(drive, irp);
 			break;
 
 		case IRP_MJ_DIRECTORY_CONTROL:
@@ -766,6 +851,116 @@ static BOOL drive_poll_run(DRIVE_DEVICE* drive, IRP* irp)
 	return TRUE;
 }
 
+static DWORD WINAPI drive_worker_thread_func(LPVOID arg)
+{
+	DRIVE_WORKER* worker = (DRIVE_WORKER*)arg;
+	UINT error = CHANNEL_RC_OK;
+
+	WINPR_ASSERT(worker);
+	DRIVE_DEVICE* drive = (DRIVE_DEVICE*)worker->device;
+	WINPR_ASSERT(drive);
+
+	while (1)
+	{
+		if (!MessageQueue_Wait(worker->queue))
+		{
+			WLog_ERR(TAG, "MessageQueue_Wait failed!");
+			error = ERROR_INTERNAL_ERROR;
+			break;
+		}
+
+		if (MessageQueue_Size(worker->queue) < 1)
+			continue;
+
+		wMessage message = { 0 };
+		if (!MessageQueue_Peek(worker->queue, &message, TRUE))
+		{
+			WLog_ERR(TAG, "MessageQueue_Peek failed!");
+			continue;
+		}
+
+		if (message.id == WMQ_QUIT)
+			break;
+
+		/* The IRP is gone once it completed */
+		IRP* irp = (IRP*)message.wParam;
+		const UINT32 FileId = irp->FileId;
+		const UINT32 MajorFunction = irp->MajorFunction;
+		const BOOL rc = drive_poll_run(drive, irp);
+
+		EnterCriticalSection(&drive->lock);
+		worker->outstanding--;
+
+		if (MajorFunction != IRP_MJ_CREATE)
+		{
+			DRIVE_FILE* file = drive_get_file_by_id(drive, FileId);
+
+			if (file && (file->outstanding > 0))
+				file->outstanding--;
+		}
+
+		LeaveCriticalSection(&drive->lock);
+
+		if (!rc)
+		{
+			error = ERROR_INTERNAL_ERROR;
+			break;
+		}
+	}
+
+	if (error && drive->rdpcontext)
+		setChannelError(drive->rdpcontext, error, "drive_worker_thread_func reported an error");
+
+	ExitThread(error);
+	return error;
+}
+
+static BOOL drive_dispatch_irp(DRIVE_DEVICE* drive, IRP* irp)
+{
+	DRIVE_FILE* file = NULL;
+	size_t index = 0;
+
+	WINPR_ASSERT(drive);
+	WINPR_ASSERT(irp);
+
+	EnterCriticalSection(&drive->lock);
+
+	if (irp->MajorFunction != IRP_MJ_CREATE)
+		file = drive_get_file_by_id(drive, irp->FileId);
+
+	/* Stay on the worker still busy with this file, otherwise take the least loaded one */
+	if (file && (file->outstanding > 0))
+		index = file->worker;
+	else
+	{
+		for (size_t x = 1; x < ARRAYSIZE(drive->workers); x++)
+		{
+			if (drive->workers[x].outstanding < drive->workers[index].outstanding)
+				index = x;
+		}
+	}
+
+	DRIVE_WORKER* worker = &drive->workers[index];
+
+	if (!MessageQueue_Post(worker->queue, NULL, 0, (void*)irp, NULL))
+	{
+		LeaveCriticalSection(&drive->lock);
+		WLog_ERR(TAG, "MessageQueue_Post failed!");
+		return FALSE;
+	}
+
+	worker->outstanding++;
+
+	if (file)
+	{
+		file->worker = (UINT32)index;
+		file->outstanding++;
+	}
+
+	LeaveCriticalSection(&drive->lock);
+	return TRUE;
+}
+
 static DWORD WINAPI drive_thread_func(LPVOID arg)
 {
 	DRIVE_DEVICE* drive = (DRIVE_DEVICE*)arg;
@@ -800,8 +995,11 @@ static DWORD WINAPI drive_thread_func(LPVOID arg)
 			break;
 
 		IRP* irp = (IRP*)message.wParam;
-		if (!drive_poll_run(drive, irp))
+		if (irp && !drive_dispatch_irp(drive, irp))
+		{
+			error = ERROR_INTERNAL_ERROR;
 			break;
+		}
 	}
 
 fail:
@@ -850,8 +1048,27 @@ static UINT drive_free_int(DRIVE_DEVICE* drive)
 		return ERROR_INVALID_PARAMETER;
 
 	(void)CloseHandle(drive->thread);
+
+	for (size_t x = 0; x < ARRAYSIZE(drive->workers); x++)
+	{
+		DRIVE_WORKER* worker = &drive->workers[x];
+
+		if (worker->thread && MessageQueue_PostQuit(worker->queue, 0) &&
+		    (WaitForSingleObject(worker->thread, INFINITE) == WAIT_FAILED))
+		{
+			error = GetLastError();
+			WLog_ERR(TAG, "WaitForSingleObject failed with error %" PRIu32 "", error);
+		}
+
+		(void)CloseHandle(worker->thread);
+		MessageQueue_Free(worker->queue);
+	}
+
+	/* Open files return their buffers to the cache */
 	ListDictionary_Free(drive->files);
+	drive_cache_free(drive->cache);
 	MessageQueue_Free(drive->IrpQueue);
+	DeleteCriticalSection(&drive->lock);
 	Stream_Free(drive->device.data, TRUE);
 	free(drive->path);
 	free(drive);
@@ -935,6 +1152,7 @@ static UINT drive_register_drive_path(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints,
 			return CHANNEL_RC_NO_MEMORY;
 		}
 
+		InitializeCriticalSection(&drive->lock);
 		drive->device.type = RDPDR_DTYP_FILESYSTEM;
 		drive->device.IRPRequest = drive_irp_request;
 		drive->device.Free = drive_free;
@@ -996,6 +1214,15 @@ static UINT drive_register_drive_path(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints,
 		}
 
 		ListDictionary_ValueObject(drive->files)->fnObjectFree = drive_file_objfree;
+		drive->cache = drive_cache_new();
+
+		if (!drive->cache)
+		{
+			WLog_ERR(TAG, "drive_cache_new failed!");
+			error = CHANNEL_RC_NO_MEMORY;
+			goto out_error;
+		}
+
 		drive->IrpQueue = MessageQueue_New(NULL);
 
 		if (!drive->IrpQueue)
@@ -1019,6 +1246,31 @@ static UINT drive_register_drive_path(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints,
 		                                          FreeRDP_SynchronousStaticChannels);
 		if (drive->async)
 		{
+			for (size_t x = 0; x < ARRAYSIZE(drive->workers); x++)
+			{
+				DRIVE_WORKER* worker = &drive->workers[x];
+				worker->device = &drive->device;
+				worker->queue = MessageQueue_New(NULL);
+
+				if (!worker->queue)
+				{
+					WLog_ERR(TAG, "MessageQueue_New failed!");
+					error = CHANNEL_RC_NO_MEMORY;
+					goto out_error;
+				}
+
+				obj = MessageQueue_Object(worker->queue);
+				WINPR_ASSERT(obj);
+				obj->fnObjectFree = drive_message_free;
+
+				if (!(worker->thread = CreateThread(NULL, 0, drive_worker_thread_func, worker, 0,
+				                                    NULL)))
+				{
+					WLog_ERR(TAG, "CreateThread failed!");
+					goto out_error;
+				}
+			}
+
 			if (!(drive->thread =
 			          CreateThread(NULL, 0, drive_thread_func, drive, CREATE_SUSPENDED, NULL)))
 			{
@@ -0,0 +1,467 @@
+#include <winpr/crt.h>
+#include <winpr/path.h>
+#include <winpr/file.h>
+#include <winpr/sysinfo.h>
+#include <winpr/synch.h>
+#include <winpr/interlocked.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/channels/rdpdr.h>
+
+#include "../drive_file.h"
+
+typedef struct
+{
+	UINT32 completions;
+	DWORD error;
+} TEST_REQUEST;
+
+typedef struct
+{
+	IRP irp;
+	HANDLE done;
+	HANDLE release;
+	LONG order;
+} TEST_IRP;
+
+static LONG test_completions = 0;
+
+extern UINT VCAPITYPE drive_DeviceServiceEntry(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints);
+
+static UINT test_write_complete(void* request, DWORD error)
+{
+	TEST_REQUEST* req = (TEST_REQUEST*)request;
+
+	req->completions++;
+	req->error = error;
+	return CHANNEL_RC_OK;
+}
+
+static DRIVE_FILE* test_open(const WCHAR* base, DRIVE_CACHE* cache, const char* name, UINT32 id,
+                             UINT32 DesiredAccess, UINT32 CreateDisposition, UINT32 CreateOptions)
+{
+	size_t length = 0;
+	WCHAR* path = ConvertUtf8ToWCharAlloc(name, &length);
+
+	if (!path)
+		return NULL;
+
+	DRIVE_FILE* file =
+	    drive_file_new(base, cache, path, (UINT32)length, id, DesiredAccess, CreateDisposition,
+	                   CreateOptions, FILE_ATTRIBUTE_NORMAL, 0);
+	free(path);
+
+	if (file)
+		file->WriteComplete = test_write_complete;
+
+	return file;
+}
+
+static BOOL test_write(DRIVE_FILE* file, UINT64 offset, const char* data, TEST_REQUEST* request,
+                       BOOL expectDeferred)
+{
+	BOOL deferred = FALSE;
+
+	if (!drive_file_seek(file, offset))
+		return FALSE;
+
+	if (!drive_file_write(file, (const BYTE*)data, (UINT32)strlen(data), request, &deferred))
+		return FALSE;
+
+	if (deferred != expectDeferred)
+	{
+		(void)fprintf(stderr, "write at %" PRIu64 " %s deferred\n", offset,
+		              deferred ? "was" : "was not");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL test_read(DRIVE_FILE* file, UINT64 offset, const char* expect)
+{
+	BYTE buffer[64] = { 0 };
+	UINT32 length = (UINT32)strlen(expect);
+
+	if (!drive_file_seek(file, offset) || !drive_file_read(file, buffer, &length))
+		return FALSE;
+
+	if ((length != strlen(expect)) || (memcmp(buffer, expect, length) != 0))
+	{
+		(void)fprintf(stderr, "read '%.*s' instead of '%s'\n", (int)length, (const char*)buffer,
+		              expect);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL test_completed(const TEST_REQUEST* request, BOOL failed)
+{
+	if (request->completions != 1)
+	{
+		(void)fprintf(stderr, "request completed %" PRIu32 " times\n", request->completions);
+		return FALSE;
+	}
+
+	return (request->error != 0) == failed;
+}
+
+static BOOL test_end_of_file(DRIVE_FILE* file, UINT64 expect)
+{
+	BOOL rc = FALSE;
+	wStream* s = Stream_New(NULL, 64);
+
+	if (!s || !drive_file_query_information(file, FileStandardInformation, s))
+		goto fail;
+
+	/* Length, AllocationSize, EndOfFile */
+	Stream_SetPosition(s, 12);
+	const UINT64 size = Stream_Get_UINT64(s);
+
+	if (size != expect)
+	{
+		(void)fprintf(stderr, "size is %" PRIu64 " instead of %" PRIu64 "\n", size, expect);
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	Stream_Free(s, TRUE);
+	return rc;
+}
+
+static BOOL test_listed_size(DRIVE_FILE* dir, const char* name, UINT64 expect)
+{
+	BOOL rc = FALSE;
+	size_t length = 0;
+	WCHAR* path = ConvertUtf8ToWCharAlloc(name, &length);
+	wStream* s = Stream_New(NULL, 1024);
+
+	if (!path || !s)
+		goto fail;
+
+	if (!drive_file_query_directory(dir, FileDirectoryInformation, 1, path,
+	                                (UINT32)((length + 1) * sizeof(WCHAR)), s))
+		goto fail;
+
+	/* Length, NextEntryOffset, FileIndex, 4 times, EndOfFile */
+	Stream_SetPosition(s, 4 + 4 + 4 + 4 * 8);
+	const UINT64 size = Stream_Get_UINT64(s);
+
+	if (size != expect)
+	{
+		(void)fprintf(stderr, "listed size is %" PRIu64 " instead of %" PRIu64 "\n", size,
+		              expect);
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	Stream_Free(s, TRUE);
+	free(path);
+	return rc;
+}
+
+static BOOL test_writeback(const WCHAR* base, DRIVE_CACHE* cache)
+{
+	BOOL rc = FALSE;
+	TEST_REQUEST requests[6] = { 0 };
+	DRIVE_FILE* dir = NULL;
+	DRIVE_FILE* reader = NULL;
+	DRIVE_FILE* readonly = NULL;
+	DRIVE_FILE* writer = test_open(base, cache, "\\test.bin", 1, GENERIC_READ | GENERIC_WRITE,
+	                               FILE_OVERWRITE_IF, FILE_NON_DIRECTORY_FILE);
+
+	if (!writer)
+		goto fail;
+
+	/* Sequential writes are coalesced, none of them completed yet */
+	if (!test_write(writer, 0, "abcd", &requests[0], TRUE) ||
+	    !test_write(writer, 4, "efgh", &requests[1], TRUE))
+		goto fail;
+
+	if ((requests[0].completions != 0) || (requests[1].completions != 0))
+		goto fail;
+
+	/* Opening the file from another handle writes them first */
+	reader = test_open(base, cache, "\\test.bin", 2, GENERIC_READ, FILE_OPEN,
+	                   FILE_NON_DIRECTORY_FILE);
+
+	if (!reader || !test_completed(&requests[0], FALSE) || !test_completed(&requests[1], FALSE))
+		goto fail;
+
+	if (!test_read(reader, 0, "abcdefgh"))
+		goto fail;
+
+	/* A read through another handle sees writes not passed on yet */
+	if (!test_write(writer, 8, "ijkl", &requests[2], TRUE) || !test_read(reader, 4, "efghijkl") ||
+	    !test_completed(&requests[2], FALSE))
+		goto fail;
+
+	/* So do the size queried and listed for the path */
+	if (!test_write(writer, 12, "mnop", &requests[3], TRUE) || !test_end_of_file(reader, 16) ||
+	    !test_completed(&requests[3], FALSE))
+		goto fail;
+
+	dir = test_open(base, cache, "", 3, GENERIC_READ, FILE_OPEN, FILE_DIRECTORY_FILE);
+
+	if (!dir || !test_write(writer, 16, "qrst", &requests[4], TRUE) ||
+	    !test_listed_size(dir, "\\test.bin", 20) || !test_completed(&requests[4], FALSE))
+		goto fail;
+
+	/* A write without a request to complete later is written right away */
+	if (!test_write(writer, 20, "uvwx", NULL, FALSE) || !test_read(reader, 16, "qrstuvwx"))
+		goto fail;
+
+	/* A write that cannot be done fails its own request, not the one causing the flush */
+	readonly = test_open(base, cache, "\\test.bin", 4, GENERIC_READ, FILE_OPEN,
+	                     FILE_NON_DIRECTORY_FILE);
+
+	if (!readonly || !test_write(readonly, 0, "ABCD", &requests[5], TRUE))
+		goto fail;
+
+	if (!test_read(reader, 0, "abcd") || !test_completed(&requests[5], TRUE))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	if (readonly && !drive_file_free(readonly))
+		rc = FALSE;
+	if (dir && !drive_file_free(dir))
+		rc = FALSE;
+	if (reader && !drive_file_free(reader))
+		rc = FALSE;
+	if (writer && !drive_file_free(writer))
+		rc = FALSE;
+	return rc;
+}
+
+static UINT test_irp_complete(IRP* irp)
+{
+	TEST_IRP* test = (TEST_IRP*)irp;
+
+	test->order = InterlockedIncrement(&test_completions);
+	(void)SetEvent(test->done);
+
+	/* Hold the worker until the requests behind this one are queued */
+	if (test->release && (WaitForSingleObject(test->release, 5000) != WAIT_OBJECT_0))
+		return ERROR_INTERNAL_ERROR;
+
+	return CHANNEL_RC_OK;
+}
+
+static BOOL test_irp_init(TEST_IRP* test, DEVMAN* devman)
+{
+	test->irp.devman = devman;
+	test->irp.Complete = test_irp_complete;
+	test->irp.input = Stream_New(NULL, 256);
+	test->irp.output = Stream_New(NULL, 256);
+	test->done = CreateEventA(NULL, TRUE, FALSE, NULL);
+	return test->irp.input && test->irp.output && test->done;
+}
+
+static void test_irp_uninit(TEST_IRP* test)
+{
+	Stream_Free(test->irp.input, TRUE);
+	Stream_Free(test->irp.output, TRUE);
+	(void)CloseHandle(test->done);
+}
+
+static BOOL test_irp_request(TEST_IRP* test, DEVICE* device, UINT32 FileId,
+                             UINT32 MajorFunction)
+{
+	test->irp.device = device;
+	test->irp.FileId = FileId;
+	test->irp.MajorFunction = MajorFunction;
+	Stream_SealLength(test->irp.input);
+	Stream_SetPosition(test->irp.input, 0);
+	return device->IRPRequest(device, &test->irp) == CHANNEL_RC_OK;
+}
+
+static BOOL test_irp_wait(TEST_IRP* test)
+{
+	if (WaitForSingleObject(test->done, 5000) != WAIT_OBJECT_0)
+	{
+		(void)fprintf(stderr, "IRP 0x%08" PRIx32 " did not complete\n",
+		              test->irp.MajorFunction);
+		return FALSE;
+	}
+
+	return test->irp.IoStatus == STATUS_SUCCESS;
+}
+
+static UINT test_register_device(DEVMAN* devman, DEVICE* device)
+{
+	devman->plugin = device;
+	return CHANNEL_RC_OK;
+}
+
+static BOOL test_dispatch(const char* base)
+{
+	BOOL rc = FALSE;
+	TEST_IRP irps[6] = { 0 };
+	DEVMAN devman = { 0 };
+	RDPDR_DRIVE drive = { 0 };
+	rdpContext context = { 0 };
+	DEVICE_SERVICE_ENTRY_POINTS entry = { 0 };
+	DEVICE* device = NULL;
+	FILE* fp = NULL;
+	char data[8] = { 0 };
+	size_t length = 0;
+	WCHAR* path = ConvertUtf8ToWCharAlloc("\\dispatch.bin", &length);
+	char* name = GetCombinedPath(base, "dispatch.bin");
+	HANDLE release = CreateEventA(NULL, TRUE, FALSE, NULL);
+
+	context.settings = freerdp_settings_new(0);
+	drive.device.Type = RDPDR_DTYP_FILESYSTEM;
+	drive.device.Name = "test";
+	drive.Path = WINPR_CAST_CONST_PTR_AWAY(base, char*);
+	entry.devman = &devman;
+	entry.RegisterDevice = test_register_device;
+	entry.device = &drive.device;
+	entry.rdpcontext = &context;
+	devman.id_sequence = 1;
+
+	for (size_t x = 0; x < ARRAYSIZE(irps); x++)
+	{
+		if (!test_irp_init(&irps[x], &devman))
+			goto fail;
+	}
+
+	/* The requests go through the worker threads */
+	if (!path || !name || !release || !context.settings ||
+	    !freerdp_settings_set_bool(context.settings, FreeRDP_SynchronousStaticChannels, FALSE))
+		goto fail;
+
+	if (drive_DeviceServiceEntry(&entry) != CHANNEL_RC_OK)
+		goto fail;
+
+	device = (DEVICE*)devman.plugin;
+
+	if (!device)
+		goto fail;
+
+	TEST_IRP* create = &irps[0];
+	Stream_Write_UINT32(create->irp.input, GENERIC_READ | GENERIC_WRITE); /* DesiredAccess */
+	Stream_Write_UINT64(create->irp.input, 0);                            /* AllocationSize */
+	Stream_Write_UINT32(create->irp.input, FILE_ATTRIBUTE_NORMAL);        /* FileAttributes */
+	Stream_Write_UINT32(create->irp.input, 0);                            /* SharedAccess */
+	Stream_Write_UINT32(create->irp.input, FILE_OVERWRITE_IF);       /* CreateDisposition */
+	Stream_Write_UINT32(create->irp.input, FILE_NON_DIRECTORY_FILE); /* CreateOptions */
+	Stream_Write_UINT32(create->irp.input, (UINT32)((length + 1) * sizeof(WCHAR)));
+	Stream_Write(create->irp.input, path, (length + 1) * sizeof(WCHAR));
+
+	if (!test_irp_request(create, device, 0, IRP_MJ_CREATE) || !test_irp_wait(create))
+		goto fail;
+
+	Stream_SetPosition(create->irp.output, 0);
+	const UINT32 FileId = Stream_Get_UINT32(create->irp.output);
+
+	/* Keep the worker of the file busy */
+	TEST_IRP* busy = &irps[1];
+	busy->release = release;
+	Stream_Write_UINT32(busy->irp.input, FileBasicInformation);
+
+	if (!test_irp_request(busy, device, FileId, IRP_MJ_QUERY_INFORMATION) ||
+	    !test_irp_wait(busy))
+		goto fail;
+
+	/* Queue a write and a request that does not touch the file data behind it */
+	TEST_IRP* write = &irps[2];
+	Stream_Write_UINT32(write->irp.input, 4); /* Length */
+	Stream_Write_UINT64(write->irp.input, 0); /* Offset */
+	Stream_Zero(write->irp.input, 20);        /* Padding */
+	Stream_Write(write->irp.input, "abcd", 4);
+
+	TEST_IRP* volume = &irps[3];
+	Stream_Write_UINT32(volume->irp.input, FileFsVolumeInformation);
+
+	if (!test_irp_request(write, device, FileId, IRP_MJ_WRITE) ||
+	    !test_irp_request(volume, device, FileId, IRP_MJ_QUERY_VOLUME_INFORMATION))
+		goto fail;
+
+	/* Requests are dispatched in order, once one for no file completed on another worker the
+	 * ones before it are queued */
+	TEST_IRP* other = &irps[4];
+	Stream_Write_UINT32(other->irp.input, FileFsVolumeInformation);
+
+	if (!test_irp_request(other, device, FileId + 1, IRP_MJ_QUERY_VOLUME_INFORMATION) ||
+	    !test_irp_wait(other))
+		goto fail;
+
+	/* The write is deferred and has to complete before the request behind it */
+	(void)SetEvent(release);
+
+	if (!test_irp_wait(write) || !test_irp_wait(volume))
+		goto fail;
+
+	if (write->order > volume->order)
+	{
+		(void)fprintf(stderr, "deferred write completed after the request following it\n");
+		goto fail;
+	}
+
+	TEST_IRP* close = &irps[5];
+
+	if (!test_irp_request(close, device, FileId, IRP_MJ_CLOSE) || !test_irp_wait(close))
+		goto fail;
+
+	fp = winpr_fopen(name, "rb");
+
+	if (!fp || (fread(data, 1, sizeof(data), fp) != 4) || (memcmp(data, "abcd", 4) != 0))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	if (fp)
+		(void)fclose(fp);
+	if (release)
+		(void)SetEvent(release);
+	if (device && (device->Free(device) != CHANNEL_RC_OK))
+		rc = FALSE;
+	for (size_t x = 0; x < ARRAYSIZE(irps); x++)
+		test_irp_uninit(&irps[x]);
+	(void)CloseHandle(release);
+	freerdp_settings_free(context.settings);
+	free(name);
+	free(path);
+	return rc;
+}
+
+int TestDriveWriteback(int argc, char* argv[])
+{
+	int rc = -1;
+	char name[64] = { 0 };
+	WCHAR* base = NULL;
+	DRIVE_CACHE* cache = NULL;
+	char* temp = GetKnownPath(KNOWN_PATH_TEMP);
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	(void)sprintf_s(name, ARRAYSIZE(name), "TestDriveWriteback-%" PRIu64, GetTickCount64());
+	char* path = temp ? GetCombinedPath(temp, name) : NULL;
+
+	if (!path || !winpr_PathMakePath(path, NULL))
+		goto fail;
+
+	base = ConvertUtf8ToWCharAlloc(path, NULL);
+	cache = drive_cache_new();
+
+	if (!base || !cache)
+		goto fail;
+
+	if (!test_writeback(base, cache) || !test_dispatch(path))
+		goto fail;
+
+	rc = 0;
+fail:
+	drive_cache_free(cache);
+	if (path)
+		winpr_RemoveDirectory_RecursiveA(path);
+	free(base);
+	free(path);
+	free(temp);
+	return rc;
+}
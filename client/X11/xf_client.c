@@ -102,6 +102,7 @@
 #include "xf_graphics.h"
 #include "xf_keyboard.h"
 #include "xf_channels.h"
+#include "xf_shm.h"
 #include "xf_client.h"
 #include "xfreerdp.h"
 #include "xf_utils.h"
@@ -422,14 +423,26 @@ static BOOL xf_paint(xfContext* xfc, const GDI_RGN* region)
 	}
 	else
 	{
-		XPutImage(xfc->display, xfc->primary, xfc->gc, xfc->image, region->x, region->y, region->x,
-		          region->y, WINPR_ASSERTING_INT_CAST(UINT16, region->w),
-		          WINPR_ASSERTING_INT_CAST(UINT16, region->h));
+		xf_shm_put_image(xfc, xfc->primary, xfc->gc, xfc->image, region->x, region->y, region->x,
+		                 region->y, WINPR_ASSERTING_INT_CAST(UINT16, region->w),
+		                 WINPR_ASSERTING_INT_CAST(UINT16, region->h));
 		xf_draw_screen(xfc, region->x, region->y, region->w, region->h);
 	}
 	return TRUE;
 }
 
+static BOOL xf_begin_paint(rdpContext* context)
+{
+	xfContext* xfc = (xfContext*)context;
+	WINPR_ASSERT(xfc);
+
+	/* The X server might still be reading the previous frame from the shared primary buffer */
+	if (xf_shm_is_shm_image(xfc->image))
+		xf_shm_wait(xfc);
+
+	return IFCALLRESULT(TRUE, xfc->BeginPaint, context);
+}
+
 static BOOL xf_end_paint(rdpContext* context)
 {
 	xfContext* xfc = (xfContext*)context;
@@ -482,32 +495,56 @@ static BOOL xf_sw_desktop_resize(rdpContext* context)
 	xfContext* xfc = (xfContext*)context;
 	rdpSettings* settings = context->settings;
 	BOOL ret = FALSE;
+	const UINT32 width = freerdp_settings_get_uint32(settings, FreeRDP_DesktopWidth);
+	const UINT32 height = freerdp_settings_get_uint32(settings, FreeRDP_DesktopHeight);
 
-	if (!gdi_resize(gdi, freerdp_settings_get_uint32(settings, FreeRDP_DesktopWidth),
-	                freerdp_settings_get_uint32(settings, FreeRDP_DesktopHeight)))
+	/* Same size, gdi keeps drawing into the existing segment */
+	if (xf_shm_is_shm_image(xfc->image) && (xfc->image->width == (int)width) &&
+	    (xfc->image->height == (int)height))
+	{
+		xf_lock_x11(xfc);
+		ret = xf_desktop_resize(context);
+		xf_unlock_x11(xfc);
+		return ret;
+	}
+
+	XImage* image = xf_shm_create_image(xfc, width, height, 0);
+
+	if (image)
+	{
+		if (!gdi_resize_ex(gdi, width, height,
+		                   WINPR_ASSERTING_INT_CAST(uint32_t, image->bytes_per_line), 0,
+		                   (BYTE*)image->data, NULL))
+		{
+			xf_shm_free_image(xfc, image);
+			return FALSE;
+		}
+	}
+	else if (!gdi_resize(gdi, width, height))
 		return FALSE;
 
 	/* Do not lock during gdi_resize, there might still be drawing operations in progress.
 	 * locking will deadlock. */
 	xf_lock_x11(xfc);
-	if (xfc->image)
-	{
-		xfc->image->data = NULL;
-		XDestroyImage(xfc->image);
-	}
+	xf_shm_free_image(xfc, xfc->image);
+	xfc->image = image;
 
-	WINPR_ASSERT(xfc->depth != 0);
-	if (!(xfc->image = XCreateImage(
-	          xfc->display, xfc->visual, WINPR_ASSERTING_INT_CAST(uint32_t, xfc->depth), ZPixmap, 0,
-	          (char*)gdi->primary_buffer, WINPR_ASSERTING_INT_CAST(uint32_t, gdi->width),
-	          WINPR_ASSERTING_INT_CAST(uint32_t, gdi->height), xfc->scanline_pad,
-	          WINPR_ASSERTING_INT_CAST(int, gdi->stride))))
+	if (!xfc->image)
 	{
-		goto out;
+		WINPR_ASSERT(xfc->depth != 0);
+		xfc->image = XCreateImage(
+		    xfc->display, xfc->visual, WINPR_ASSERTING_INT_CAST(uint32_t, xfc->depth), ZPixmap, 0,
+		    (char*)gdi->primary_buffer, WINPR_ASSERTING_INT_CAST(uint32_t, gdi->width),
+		    WINPR_ASSERTING_INT_CAST(uint32_t, gdi->height), xfc->scanline_pad,
+		    WINPR_ASSERTING_INT_CAST(int, gdi->stride));
+
+		if (!xfc->image)
+			goto out;
+
+		xfc->image->byte_order = LSBFirst;
+		xfc->image->bitmap_bit_order = LSBFirst;
 	}
 
-	xfc->image->byte_order = LSBFirst;
-	xfc->image->bitmap_bit_order = LSBFirst;
 	ret = xf_desktop_resize(context);
 out:
 	xf_unlock_x11(xfc);
@@ -755,12 +792,8 @@ static void xf_window_free(xfContext* xfc)
 	}
 #endif
 
-	if (xfc->image)
-	{
-		xfc->image->data = NULL;
-		XDestroyImage(xfc->image);
-		xfc->image = NULL;
-	}
+	xf_shm_free_image(xfc, xfc->image);
+	xfc->image = NULL;
 
 	if (xfc->bitmap_mono)
 	{
@@ -958,6 +991,9 @@ static void xf_check_extensions(xfContext* context)
 		}
 	}
 #endif
+
+	if (xf_shm_init(context))
+		WLog_DBG(TAG, "MIT-SHM available, presenting from shared memory");
 }
 
 #ifdef WITH_XI
@@ -1399,7 +1435,24 @@ static BOOL xf_post_connect(freerdp* instance)
 	if (!xf_get_pixmap_info(xfc))
 		return FALSE;
 
-	if (!gdi_init(instance, xf_get_local_color_format(xfc, TRUE)))
+	XImage* image =
+	    xf_shm_create_image(xfc, freerdp_settings_get_uint32(settings, FreeRDP_DesktopWidth),
+	                        freerdp_settings_get_uint32(settings, FreeRDP_DesktopHeight), 0);
+
+	if (image)
+	{
+		/* gdi draws straight into the segment the X server presents from */
+		if (!gdi_init_ex(instance, xf_get_local_color_format(xfc, TRUE),
+		                 WINPR_ASSERTING_INT_CAST(uint32_t, image->bytes_per_line),
+		                 (BYTE*)image->data, NULL))
+		{
+			xf_shm_free_image(xfc, image);
+			return FALSE;
+		}
+
+		xfc->image = image;
+	}
+	else if (!gdi_init(instance, xf_get_local_color_format(xfc, TRUE)))
 		return FALSE;
 
 	if (!xf_create_image(xfc))
@@ -1434,6 +1487,8 @@ static BOOL xf_post_connect(freerdp* instance)
 		}
 	}
 
+	xfc->BeginPaint = update->BeginPaint;
+	update->BeginPaint = xf_begin_paint;
 	update->DesktopResize = xf_sw_desktop_resize;
 	update->EndPaint = xf_end_paint;
 	update->PlaySound = xf_play_sound;
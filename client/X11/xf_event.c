@@ -40,6 +40,7 @@
 #include "xf_gfx.h"
 #include "xf_graphics.h"
 #include "xf_utils.h"
+#include "xf_shm.h"
 
 #include "xf_event.h"
 
@@ -1186,6 +1187,9 @@ BOOL xf_event_process(freerdp* instance, const XEvent* event)
 	rdpSettings* settings = xfc->common.context.settings;
 	WINPR_ASSERT(settings);
 
+	if (xf_shm_handle_event(xfc, event))
+		return TRUE;
+
 	if (xfc->remote_app)
 	{
 		xfAppWindow* appWindow = xf_AppWindowFromX11Window(xfc, event->xany.window);
@@ -29,6 +29,7 @@
 #include <freerdp/log.h>
 #include "xf_gfx.h"
 #include "xf_rail.h"
+#include "xf_shm.h"
 
 #include <X11/Xutil.h>
 
@@ -94,10 +95,10 @@ static UINT xf_OutputUpdate(xfContext* xfc, xfGfxSurface* surface)
 
 		if (xfc->remote_app)
 		{
-			XPutImage(xfc->display, xfc->primary, xfc->gc, surface->image,
-			          WINPR_ASSERTING_INT_CAST(int, nXSrc), WINPR_ASSERTING_INT_CAST(int, nYSrc),
-			          WINPR_ASSERTING_INT_CAST(int, nXDst), WINPR_ASSERTING_INT_CAST(int, nYDst),
-			          dwidth, dheight);
+			xf_shm_put_image(
+			    xfc, xfc->primary, xfc->gc, surface->image, WINPR_ASSERTING_INT_CAST(int, nXSrc),
+			    WINPR_ASSERTING_INT_CAST(int, nYSrc), WINPR_ASSERTING_INT_CAST(int, nXDst),
+			    WINPR_ASSERTING_INT_CAST(int, nYDst), dwidth, dheight);
 			xf_lock_x11(xfc);
 			xf_rail_paint_surface(xfc, surface->gdi.windowId, rect);
 			xf_unlock_x11(xfc);
@@ -107,10 +108,10 @@ static UINT xf_OutputUpdate(xfContext* xfc, xfGfxSurface* surface)
 		    if (freerdp_settings_get_bool(settings, FreeRDP_SmartSizing) ||
 		        freerdp_settings_get_bool(settings, FreeRDP_MultiTouchGestures))
 		{
-			XPutImage(xfc->display, xfc->primary, xfc->gc, surface->image,
-			          WINPR_ASSERTING_INT_CAST(int, nXSrc), WINPR_ASSERTING_INT_CAST(int, nYSrc),
-			          WINPR_ASSERTING_INT_CAST(int, nXDst), WINPR_ASSERTING_INT_CAST(int, nYDst),
-			          dwidth, dheight);
+			xf_shm_put_image(
+			    xfc, xfc->primary, xfc->gc, surface->image, WINPR_ASSERTING_INT_CAST(int, nXSrc),
+			    WINPR_ASSERTING_INT_CAST(int, nYSrc), WINPR_ASSERTING_INT_CAST(int, nXDst),
+			    WINPR_ASSERTING_INT_CAST(int, nYDst), dwidth, dheight);
 			xf_draw_screen(xfc, WINPR_ASSERTING_INT_CAST(int32_t, nXDst),
 			               WINPR_ASSERTING_INT_CAST(int32_t, nYDst),
 			               WINPR_ASSERTING_INT_CAST(int32_t, dwidth),
@@ -119,10 +120,10 @@ static UINT xf_OutputUpdate(xfContext* xfc, xfGfxSurface* surface)
 		else
 #endif
 		{
-			XPutImage(xfc->display, xfc->drawable, xfc->gc, surface->image,
-			          WINPR_ASSERTING_INT_CAST(int, nXSrc), WINPR_ASSERTING_INT_CAST(int, nYSrc),
-			          WINPR_ASSERTING_INT_CAST(int, nXDst), WINPR_ASSERTING_INT_CAST(int, nYDst),
-			          dwidth, dheight);
+			xf_shm_put_image(
+			    xfc, xfc->drawable, xfc->gc, surface->image, WINPR_ASSERTING_INT_CAST(int, nXSrc),
+			    WINPR_ASSERTING_INT_CAST(int, nYSrc), WINPR_ASSERTING_INT_CAST(int, nXDst),
+			    WINPR_ASSERTING_INT_CAST(int, nYDst), dwidth, dheight);
 		}
 	}
 
@@ -130,7 +131,10 @@ static UINT xf_OutputUpdate(xfContext* xfc, xfGfxSurface* surface)
 fail:
 	region16_clear(&surface->gdi.invalidRegion);
 	XSetClipMask(xfc->display, xfc->gc, None);
-	XSync(xfc->display, False);
+
+	/* Shared memory surfaces are waited for in xf_StartFrame, before the codecs write them */
+	if (!xf_shm_is_shm_image(surface->image))
+		XSync(xfc->display, False);
 	return rc;
 }
 
@@ -273,6 +277,25 @@ static UINT32 x11_pad_scanline(UINT32 scanline, UINT32 inPad)
 	return scanline;
 }
 
+static void xf_gfx_free_surface_buffers(xfContext* xfc, xfGfxSurface* surface)
+{
+	/* A shared segment backs the stage buffer if there is one, the GDI data otherwise */
+	if (xf_shm_is_shm_image(surface->image))
+	{
+		if (surface->stage)
+			surface->stage = NULL;
+		else
+			surface->gdi.data = NULL;
+	}
+
+	xf_shm_free_image(xfc, surface->image);
+	surface->image = NULL;
+	winpr_aligned_free(surface->stage);
+	surface->stage = NULL;
+	winpr_aligned_free(surface->gdi.data);
+	surface->gdi.data = NULL;
+}
+
 /**
  * Function description
  *
@@ -327,7 +350,18 @@ static UINT xf_CreateSurface(RdpgfxClientContext* context,
 	surface->gdi.scanline = x11_pad_scanline(surface->gdi.scanline,
 	                                         WINPR_ASSERTING_INT_CAST(uint32_t, xfc->scanline_pad));
 	size = 1ull * surface->gdi.scanline * surface->gdi.height;
-	surface->gdi.data = (BYTE*)winpr_aligned_malloc(size, 16);
+
+	const BOOL direct = FreeRDPAreColorFormatsEqualNoAlpha(gdi->dstFormat, surface->gdi.format);
+
+	/* Let the codecs decode straight into memory shared with the X server */
+	if (direct)
+		surface->image = xf_shm_create_image(xfc, surface->gdi.width, surface->gdi.height,
+		                                     surface->gdi.scanline);
+
+	if (surface->image)
+		surface->gdi.data = (BYTE*)surface->image->data;
+	else
+		surface->gdi.data = (BYTE*)winpr_aligned_malloc(size, 16);
 
 	if (!surface->gdi.data)
 	{
@@ -337,13 +371,16 @@ static UINT xf_CreateSurface(RdpgfxClientContext* context,
 
 	ZeroMemory(surface->gdi.data, size);
 
-	if (FreeRDPAreColorFormatsEqualNoAlpha(gdi->dstFormat, surface->gdi.format))
+	if (direct)
 	{
-		WINPR_ASSERT(xfc->depth != 0);
-		surface->image = XCreateImage(
-		    xfc->display, xfc->visual, WINPR_ASSERTING_INT_CAST(uint32_t, xfc->depth), ZPixmap, 0,
-		    (char*)surface->gdi.data, surface->gdi.mappedWidth, surface->gdi.mappedHeight,
-		    xfc->scanline_pad, WINPR_ASSERTING_INT_CAST(int, surface->gdi.scanline));
+		if (!surface->image)
+		{
+			WINPR_ASSERT(xfc->depth != 0);
+			surface->image = XCreateImage(
+			    xfc->display, xfc->visual, WINPR_ASSERTING_INT_CAST(uint32_t, xfc->depth), ZPixmap,
+			    0, (char*)surface->gdi.data, surface->gdi.mappedWidth, surface->gdi.mappedHeight,
+			    xfc->scanline_pad, WINPR_ASSERTING_INT_CAST(int, surface->gdi.scanline));
+		}
 	}
 	else
 	{
@@ -353,7 +390,13 @@ static UINT xf_CreateSurface(RdpgfxClientContext* context,
 		surface->stageScanline = x11_pad_scanline(
 		    surface->stageScanline, WINPR_ASSERTING_INT_CAST(uint32_t, xfc->scanline_pad));
 		size = 1ull * surface->stageScanline * surface->gdi.height;
-		surface->stage = (BYTE*)winpr_aligned_malloc(size, 16);
+		surface->image = xf_shm_create_image(xfc, surface->gdi.width, surface->gdi.height,
+		                                     surface->stageScanline);
+
+		if (surface->image)
+			surface->stage = (BYTE*)surface->image->data;
+		else
+			surface->stage = (BYTE*)winpr_aligned_malloc(size, 16);
 
 		if (!surface->stage)
 		{
@@ -362,17 +405,21 @@ static UINT xf_CreateSurface(RdpgfxClientContext* context,
 		}
 
 		ZeroMemory(surface->stage, size);
-		WINPR_ASSERT(xfc->depth != 0);
-		surface->image = XCreateImage(
-		    xfc->display, xfc->visual, WINPR_ASSERTING_INT_CAST(uint32_t, xfc->depth), ZPixmap, 0,
-		    (char*)surface->stage, surface->gdi.mappedWidth, surface->gdi.mappedHeight,
-		    xfc->scanline_pad, WINPR_ASSERTING_INT_CAST(int, surface->stageScanline));
+
+		if (!surface->image)
+		{
+			WINPR_ASSERT(xfc->depth != 0);
+			surface->image = XCreateImage(
+			    xfc->display, xfc->visual, WINPR_ASSERTING_INT_CAST(uint32_t, xfc->depth), ZPixmap,
+			    0, (char*)surface->stage, surface->gdi.mappedWidth, surface->gdi.mappedHeight,
+			    xfc->scanline_pad, WINPR_ASSERTING_INT_CAST(int, surface->stageScanline));
+		}
 	}
 
 	if (!surface->image)
 	{
 		WLog_ERR(TAG, "an error occurred when creating the XImage");
-		goto error_surface_image;
+		goto out_free_gdidata;
 	}
 
 	surface->image->byte_order = LSBFirst;
@@ -383,17 +430,12 @@ static UINT xf_CreateSurface(RdpgfxClientContext* context,
 	if (context->SetSurfaceData(context, surface->gdi.surfaceId, (void*)surface) != CHANNEL_RC_OK)
 	{
 		WLog_ERR(TAG, "an error occurred during SetSurfaceData");
-		goto error_set_surface_data;
+		goto out_free_gdidata;
 	}
 
 	return CHANNEL_RC_OK;
-error_set_surface_data:
-	surface->image->data = NULL;
-	XDestroyImage(surface->image);
-error_surface_image:
-	winpr_aligned_free(surface->stage);
 out_free_gdidata:
-	winpr_aligned_free(surface->gdi.data);
+	xf_gfx_free_surface_buffers(xfc, surface);
 out_free:
 	free(surface);
 	return ret;
@@ -410,6 +452,8 @@ static UINT xf_DeleteSurface(RdpgfxClientContext* context,
 	rdpCodecs* codecs = NULL;
 	xfGfxSurface* surface = NULL;
 	UINT status = 0;
+	rdpGdi* gdi = (rdpGdi*)context->custom;
+	xfContext* xfc = (xfContext*)gdi->context;
 	EnterCriticalSection(&context->mux);
 	surface = (xfGfxSurface*)context->GetSurfaceData(context, deleteSurface->surfaceId);
 
@@ -421,10 +465,7 @@ static UINT xf_DeleteSurface(RdpgfxClientContext* context,
 #ifdef WITH_GFX_H264
 		h264_context_free(surface->gdi.h264);
 #endif
-		surface->image->data = NULL;
-		XDestroyImage(surface->image);
-		winpr_aligned_free(surface->gdi.data);
-		winpr_aligned_free(surface->stage);
+		xf_gfx_free_surface_buffers(xfc, surface);
 		region16_uninit(&surface->gdi.invalidRegion);
 		codecs = surface->gdi.codecs;
 		free(surface);
@@ -457,6 +498,21 @@ static UINT xf_UpdateWindowFromSurface(RdpgfxClientContext* context, gdiGfxSurfa
 	return CHANNEL_RC_OK;
 }
 
+static UINT xf_StartFrame(RdpgfxClientContext* context, const RDPGFX_START_FRAME_PDU* startFrame)
+{
+	WINPR_ASSERT(context);
+
+	rdpGdi* gdi = (rdpGdi*)context->custom;
+	WINPR_ASSERT(gdi);
+
+	xfContext* xfc = (xfContext*)gdi->context;
+	WINPR_ASSERT(xfc);
+
+	/* The X server might still be reading the last frame from the shared surfaces */
+	xf_shm_wait(xfc);
+	return IFCALLRESULT(CHANNEL_RC_OK, xfc->StartFrame, context, startFrame);
+}
+
 void xf_graphics_pipeline_init(xfContext* xfc, RdpgfxClientContext* gfx)
 {
 	rdpGdi* gdi = NULL;
@@ -476,6 +532,8 @@ void xf_graphics_pipeline_init(xfContext* xfc, RdpgfxClientContext* gfx)
 		gfx->UpdateSurfaces = xf_UpdateSurfaces;
 		gfx->CreateSurface = xf_CreateSurface;
 		gfx->DeleteSurface = xf_DeleteSurface;
+		xfc->StartFrame = gfx->StartFrame;
+		gfx->StartFrame = xf_StartFrame;
 	}
 	gfx->UpdateWindowFromSurface = xf_UpdateWindowFromSurface;
 }
@@ -0,0 +1,325 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * X11 MIT-SHM Presentation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <string.h>
+
+#include <winpr/assert.h>
+#include <winpr/cast.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/log.h>
+
+#include "xf_shm.h"
+
+#ifdef WITH_XSHM
+#include <poll.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#endif
+
+#define TAG CLIENT_TAG("x11")
+
+#ifdef WITH_XSHM
+/* How long a frame waits for the X server to read the previous one, in ms */
+#define XF_SHM_WAIT_TIMEOUT 100
+
+/* How long to sleep on the connection without the X lock, in ms. The event thread may read a
+ * completion off the connection meanwhile, the wait then only notices the next time it looks */
+#define XF_SHM_POLL_INTERVAL 2
+
+static BOOL xf_shm_attach_error = FALSE;
+
+static int xf_shm_error_handler(Display* display, XErrorEvent* event)
+{
+	WINPR_UNUSED(display);
+	WINPR_UNUSED(event);
+	xf_shm_attach_error = TRUE;
+	return 0;
+}
+
+/* A remote X server would attach whatever segment has the same id on its host */
+static BOOL xf_shm_is_local_display(Display* display)
+{
+	const char* name = DisplayString(display);
+
+	if (!name)
+		return FALSE;
+
+	return (name[0] == ':') || (name[0] == '/') || (strncmp(name, "unix:", 5) == 0);
+}
+
+static Bool xf_shm_is_completion(Display* display, XEvent* event, XPointer arg)
+{
+	const xfContext* xfc = (const xfContext*)arg;
+
+	WINPR_UNUSED(display);
+	return event->type == xfc->shmCompletionEvent;
+}
+
+static void xf_shm_release(XImage* image)
+{
+	XShmSegmentInfo* shminfo = (XShmSegmentInfo*)image->obdata;
+
+	if (shminfo->shmaddr != (char*)-1)
+		shmdt(shminfo->shmaddr);
+
+	/* XDestroyImage frees obdata */
+	image->data = NULL;
+	XDestroyImage(image);
+}
+#endif
+
+BOOL xf_shm_init(xfContext* xfc)
+{
+	WINPR_ASSERT(xfc);
+
+	xfc->shmAvailable = FALSE;
+	xfc->shmPending = 0;
+
+#ifdef WITH_XSHM
+	/* Opt-in until it saw more X servers than the ones it was written against */
+	if (!freerdp_settings_get_bool(xfc->common.context.settings, FreeRDP_SharedMemoryPresentation))
+		return FALSE;
+
+	if (!xf_shm_is_local_display(xfc->display))
+		return FALSE;
+
+	/* Images are written LSBFirst, the server does not convert shared memory */
+	if (ImageByteOrder(xfc->display) != LSBFirst)
+		return FALSE;
+
+	if (!XShmQueryExtension(xfc->display))
+		return FALSE;
+
+	xfc->shmCompletionEvent = XShmGetEventBase(xfc->display) + ShmCompletion;
+	xfc->shmAvailable = TRUE;
+#endif
+	return xfc->shmAvailable;
+}
+
+XImage* xf_shm_create_image(xfContext* xfc, UINT32 width, UINT32 height, UINT32 stride)
+{
+	WINPR_ASSERT(xfc);
+
+#ifdef WITH_XSHM
+	XImage* image = NULL;
+
+	if (!xfc->shmAvailable)
+		return NULL;
+
+	XShmSegmentInfo* shminfo = calloc(1, sizeof(XShmSegmentInfo));
+
+	if (!shminfo)
+		return NULL;
+
+	shminfo->shmid = -1;
+	shminfo->shmaddr = (char*)-1;
+	shminfo->readOnly = False;
+
+	WINPR_ASSERT(xfc->depth != 0);
+	xf_lock_x11(xfc);
+	image = XShmCreateImage(xfc->display, xfc->visual,
+	                        WINPR_ASSERTING_INT_CAST(uint32_t, xfc->depth), ZPixmap, NULL, shminfo,
+	                        width, height);
+	xf_unlock_x11(xfc);
+
+	if (!image)
+	{
+		free(shminfo);
+		return NULL;
+	}
+
+	if ((image->bytes_per_line <= 0) ||
+	    ((stride > 0) && ((UINT32)image->bytes_per_line != stride)))
+		goto fail;
+
+	shminfo->shmid =
+	    shmget(IPC_PRIVATE, 1ull * WINPR_ASSERTING_INT_CAST(size_t, image->bytes_per_line) * height,
+	           IPC_CREAT | 0600);
+
+	if (shminfo->shmid < 0)
+		goto fail;
+
+	shminfo->shmaddr = image->data = shmat(shminfo->shmid, NULL, 0);
+
+	if (shminfo->shmaddr == (char*)-1)
+		goto fail;
+
+	xf_lock_x11(xfc);
+	XSync(xfc->display, False);
+	xf_shm_attach_error = FALSE;
+	int (*handler)(Display*, XErrorEvent*) = XSetErrorHandler(xf_shm_error_handler);
+	const Status status = XShmAttach(xfc->display, shminfo);
+	XSync(xfc->display, False);
+	XSetErrorHandler(handler);
+	xf_unlock_x11(xfc);
+
+	if (!status || xf_shm_attach_error)
+	{
+		WLog_WARN(TAG, "MIT-SHM attach failed, falling back to XPutImage");
+		xfc->shmAvailable = FALSE;
+		goto fail;
+	}
+
+	/* The segment goes away as soon as both sides detached */
+	shmctl(shminfo->shmid, IPC_RMID, NULL);
+	image->byte_order = LSBFirst;
+	image->bitmap_bit_order = LSBFirst;
+	return image;
+
+fail:
+	if (shminfo->shmid >= 0)
+		shmctl(shminfo->shmid, IPC_RMID, NULL);
+
+	xf_shm_release(image);
+	return NULL;
+#else
+	WINPR_UNUSED(width);
+	WINPR_UNUSED(height);
+	WINPR_UNUSED(stride);
+	return NULL;
+#endif
+}
+
+void xf_shm_free_image(xfContext* xfc, XImage* image)
+{
+	WINPR_ASSERT(xfc);
+
+	if (!image)
+		return;
+
+#ifdef WITH_XSHM
+	if (xf_shm_is_shm_image(image))
+	{
+		xf_shm_wait(xfc);
+		xf_lock_x11(xfc);
+		XShmDetach(xfc->display, (XShmSegmentInfo*)image->obdata);
+		XSync(xfc->display, False);
+		xf_unlock_x11(xfc);
+		xf_shm_release(image);
+		return;
+	}
+#endif
+
+	image->data = NULL;
+	XDestroyImage(image);
+}
+
+BOOL xf_shm_is_shm_image(const XImage* image)
+{
+#ifdef WITH_XSHM
+	return image && image->obdata;
+#else
+	WINPR_UNUSED(image);
+	return FALSE;
+#endif
+}
+
+void xf_shm_put_image(xfContext* xfc, Drawable drawable, GC gc, XImage* image, int src_x,
+                      int src_y, int dst_x, int dst_y, UINT32 width, UINT32 height)
+{
+	WINPR_ASSERT(xfc);
+	WINPR_ASSERT(image);
+
+#ifdef WITH_XSHM
+	if (xf_shm_is_shm_image(image))
+	{
+		xf_lock_x11(xfc);
+		if (XShmPutImage(xfc->display, drawable, gc, image, src_x, src_y, dst_x, dst_y, width,
+		                 height, True))
+			xfc->shmPending++;
+		xf_unlock_x11(xfc);
+		return;
+	}
+#endif
+
+	XPutImage(xfc->display, drawable, gc, image, src_x, src_y, dst_x, dst_y, width, height);
+}
+
+void xf_shm_wait(xfContext* xfc)
+{
+	WINPR_ASSERT(xfc);
+
+#ifdef WITH_XSHM
+	xf_lock_x11(xfc);
+
+	if (xfc->shmPending > 0)
+	{
+		const UINT64 deadline = GetTickCount64() + XF_SHM_WAIT_TIMEOUT;
+		XEvent event = { 0 };
+
+		XFlush(xfc->display);
+
+		while (xfc->shmPending > 0)
+		{
+			if (XCheckIfEvent(xfc->display, &event, xf_shm_is_completion, (XPointer)xfc))
+			{
+				xfc->shmPending--;
+				continue;
+			}
+
+			const UINT64 now = GetTickCount64();
+
+			if (now >= deadline)
+				break;
+
+			/* Reads whatever arrived without blocking, wait for more only if nothing did */
+			if (XEventsQueued(xfc->display, QueuedAfterReading) > 0)
+				continue;
+
+			/* Other threads need the display while the X server is busy */
+			struct pollfd pfd = { .fd = ConnectionNumber(xfc->display), .events = POLLIN };
+			xf_unlock_x11(xfc);
+			(void)poll(&pfd, 1, (int)MIN(deadline - now, XF_SHM_POLL_INTERVAL));
+			xf_lock_x11(xfc);
+		}
+
+		/* A put that failed never sends a completion. After the round trip every completion
+		 * is queued, whatever is still missing will not come. */
+		if (xfc->shmPending > 0)
+		{
+			XSync(xfc->display, False);
+
+			while (XCheckIfEvent(xfc->display, &event, xf_shm_is_completion, (XPointer)xfc))
+				;
+
+			xfc->shmPending = 0;
+		}
+	}
+
+	xf_unlock_x11(xfc);
+#endif
+}
+
+BOOL xf_shm_handle_event(xfContext* xfc, const XEvent* event)
+{
+	WINPR_ASSERT(xfc);
+	WINPR_ASSERT(event);
+
+	if ((xfc->shmCompletionEvent == 0) || (event->type != xfc->shmCompletionEvent))
+		return FALSE;
+
+	if (xfc->shmPending > 0)
+		xfc->shmPending--;
+
+	return TRUE;
+}
@@ -0,0 +1,52 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * X11 MIT-SHM Presentation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_CLIENT_X11_SHM_H
+#define FREERDP_CLIENT_X11_SHM_H
+
+#include <winpr/wtypes.h>
+
+#include <X11/Xlib.h>
+
+#include "xfreerdp.h"
+
+BOOL xf_shm_init(xfContext* xfc);
+
+/**
+ * Creates an image backed by a shared memory segment the X server reads from directly.
+ * Returns NULL if MIT-SHM is not usable, the caller then falls back to XCreateImage.
+ * If stride is not 0 the image is only created if its scanline matches.
+ */
+XImage* xf_shm_create_image(xfContext* xfc, UINT32 width, UINT32 height, UINT32 stride);
+
+/** Frees images from xf_shm_create_image as well as XCreateImage images not owning their data */
+void xf_shm_free_image(xfContext* xfc, XImage* image);
+
+BOOL xf_shm_is_shm_image(const XImage* image);
+
+void xf_shm_put_image(xfContext* xfc, Drawable drawable, GC gc, XImage* image, int src_x,
+                      int src_y, int dst_x, int dst_y, UINT32 width, UINT32 height);
+
+/**
+ * Blocks until the X server is done reading all shared memory images put so far.
+ * Call it right before writing into a shared image again, not right after putting it.
+ */
+void xf_shm_wait(xfContext* xfc);
+
+BOOL xf_shm_handle_event(xfContext* xfc, const XEvent* event);
+
+#endif /* FREERDP_CLIENT_X11_SHM_H */
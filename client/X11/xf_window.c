@@ -56,6 +56,7 @@
 #include "xf_input.h"
 #include "xf_keyboard.h"
 #include "xf_utils.h"
+#include "xf_shm.h"
 
 #define TAG CLIENT_TAG("x11")
 
@@ -1366,9 +1367,9 @@ void xf_UpdateWindowArea(xfContext* xfc, xfAppWindow* appWindow, int x, int y, i
 
 	if (freerdp_settings_get_bool(settings, FreeRDP_SoftwareGdi))
 	{
-		XPutImage(xfc->display, appWindow->pixmap, appWindow->gc, xfc->image, ax, ay, x, y,
-		          WINPR_ASSERTING_INT_CAST(uint32_t, width),
-		          WINPR_ASSERTING_INT_CAST(uint32_t, height));
+		xf_shm_put_image(xfc, appWindow->pixmap, appWindow->gc, xfc->image, ax, ay, x, y,
+		                 WINPR_ASSERTING_INT_CAST(uint32_t, width),
+		                 WINPR_ASSERTING_INT_CAST(uint32_t, height));
 	}
 
 	XCopyArea(xfc->display, appWindow->pixmap, appWindow->handle, appWindow->gc, x, y,
@@ -45,6 +45,7 @@ typedef struct xf_context xfContext;
 #endif
 
 #include <freerdp/gdi/gdi.h>
+#include <freerdp/client/rdpgfx.h>
 #include <freerdp/codec/rfx.h>
 #include <freerdp/codec/nsc.h>
 #include <freerdp/codec/clear.h>
@@ -292,6 +293,11 @@ struct xf_context
 
 	BOOL xkbAvailable;
 	BOOL xrenderAvailable;
+	BOOL shmAvailable;
+	int shmCompletionEvent;
+	UINT32 shmPending;
+	pBeginPaint BeginPaint;
+	pcRdpgfxStartFrame StartFrame;
 
 	/* value to be sent over wire for each logical client mouse button */
 	button_map button_map[NUM_BUTTONS_MAPPED];
@@ -0,0 +1,786 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Recorded session replay benchmark
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/path.h>
+#include <winpr/assert.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/gdi/gfx.h>
+#include <freerdp/streamdump.h>
+#include <freerdp/transport_io.h>
+#include <freerdp/channels/rdpgfx.h>
+#include <freerdp/client/cmdline.h>
+#include <freerdp/client/rdpgfx.h>
+
+/**
+ * Replays a session recorded with /dump:record,file:<file> through the complete client
+ * stack (fast-path and slow-path parsing, orders, channels, rdpgfx, codecs and gdi),
+ * without pacing and without a display, and reports where the time went.
+ */
+
+#if defined(__GLIBC__)
+/* Count the heap allocations of the whole process by interposing the allocator.
+ * The replacements are exported so the shared libraries resolve to them. */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+extern void* __libc_valloc(size_t size);
+extern void* __libc_pvalloc(size_t size);
+extern void __libc_free(void* ptr);
+
+static UINT64 replay_bench_allocations = 0;
+static UINT64 replay_bench_reallocations = 0;
+static UINT64 replay_bench_frees = 0;
+static UINT64 replay_bench_allocated = 0;
+
+static void replay_bench_count_allocation(UINT64* counter, size_t size)
+{
+	(void)__atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+	(void)__atomic_fetch_add(&replay_bench_allocated, size, __ATOMIC_RELAXED);
+}
+
+DECLSPEC_EXPORT void* malloc(size_t size)
+{
+	replay_bench_count_allocation(&replay_bench_allocations, size);
+	return __libc_malloc(size);
+}
+
+DECLSPEC_EXPORT void* calloc(size_t nmemb, size_t size)
+{
+	replay_bench_count_allocation(&replay_bench_allocations, nmemb * size);
+	return __libc_calloc(nmemb, size);
+}
+
+DECLSPEC_EXPORT void* realloc(void* ptr, size_t size)
+{
+	replay_bench_count_allocation(ptr ? &replay_bench_reallocations : &replay_bench_allocations,
+	                              size);
+	return __libc_realloc(ptr, size);
+}
+
+DECLSPEC_EXPORT int posix_memalign(void** memptr, size_t alignment, size_t size)
+{
+	if ((alignment % sizeof(void*)) || (alignment & (alignment - 1)))
+		return EINVAL;
+
+	replay_bench_count_allocation(&replay_bench_allocations, size);
+	*memptr = __libc_memalign(alignment, size);
+	return *memptr ? 0 : ENOMEM;
+}
+
+DECLSPEC_EXPORT void* aligned_alloc(size_t alignment, size_t size)
+{
+	replay_bench_count_allocation(&replay_bench_allocations, size);
+	return __libc_memalign(alignment, size);
+}
+
+DECLSPEC_EXPORT void* memalign(size_t alignment, size_t size)
+{
+	replay_bench_count_allocation(&replay_bench_allocations, size);
+	return __libc_memalign(alignment, size);
+}
+
+DECLSPEC_EXPORT void* valloc(size_t size)
+{
+	replay_bench_count_allocation(&replay_bench_allocations, size);
+	return __libc_valloc(size);
+}
+
+DECLSPEC_EXPORT void* pvalloc(size_t size)
+{
+	replay_bench_count_allocation(&replay_bench_allocations, size);
+	return __libc_pvalloc(size);
+}
+
+DECLSPEC_EXPORT void free(void* ptr)
+{
+	if (ptr)
+		(void)__atomic_fetch_add(&replay_bench_frees, 1, __ATOMIC_RELAXED);
+	__libc_free(ptr);
+}
+#endif
+
+typedef enum
+{
+	REPLAY_STAGE_TRANSPORT,
+	REPLAY_STAGE_BITMAP_UPDATE,
+	REPLAY_STAGE_SURFACE_BITS,
+	REPLAY_STAGE_PRIMARY_ORDERS,
+	REPLAY_STAGE_SECONDARY_ORDERS,
+	REPLAY_STAGE_GFX_UNCOMPRESSED,
+	REPLAY_STAGE_GFX_REMOTEFX,
+	REPLAY_STAGE_GFX_CLEARCODEC,
+	REPLAY_STAGE_GFX_PLANAR,
+	REPLAY_STAGE_GFX_AVC420,
+	REPLAY_STAGE_GFX_ALPHA,
+	REPLAY_STAGE_GFX_AVC444,
+	REPLAY_STAGE_GFX_PROGRESSIVE,
+	REPLAY_STAGE_GFX_SOLIDFILL,
+	REPLAY_STAGE_GFX_SURFACE_TO_SURFACE,
+	REPLAY_STAGE_GFX_CACHE,
+	REPLAY_STAGE_GFX_END_FRAME,
+	REPLAY_STAGE_COUNT
+} replay_bench_stage_id;
+
+static const char* replay_bench_stage_names[REPLAY_STAGE_COUNT] = {
+	"transport read",
+	"bitmap update",
+	"surface bits",
+	"primary orders",
+	"secondary orders",
+	"gfx uncompressed",
+	"gfx remotefx",
+	"gfx clearcodec",
+	"gfx planar",
+	"gfx avc420",
+	"gfx alpha",
+	"gfx avc444",
+	"gfx progressive",
+	"gfx solidfill",
+	"gfx surface to surface",
+	"gfx cache",
+	"gfx end frame",
+};
+
+/* rdpgfx callbacks run on the dynamic channel thread, concurrently with the main thread.
+ * Every thread only updates its own tallies, they are read once the threads are gone. */
+typedef enum
+{
+	REPLAY_THREAD_MAIN,
+	REPLAY_THREAD_CHANNEL,
+	REPLAY_THREAD_COUNT
+} replay_bench_thread_id;
+
+typedef struct
+{
+	UINT64 count[REPLAY_THREAD_COUNT];
+	UINT64 ns[REPLAY_THREAD_COUNT];
+} replay_bench_stage;
+
+/* the callbacks the benchmark replaced with its timing wrappers */
+typedef struct
+{
+	pTransportRWFkt ReadPdu;
+
+	pBitmapUpdate BitmapUpdate;
+	pSurfaceBits SurfaceBits;
+	pEndPaint EndPaint;
+
+	pDstBlt DstBlt;
+	pPatBlt PatBlt;
+	pScrBlt ScrBlt;
+	pOpaqueRect OpaqueRect;
+	pMultiOpaqueRect MultiOpaqueRect;
+	pLineTo LineTo;
+	pPolyline Polyline;
+	pMemBlt MemBlt;
+	pMem3Blt Mem3Blt;
+	pGlyphIndex GlyphIndex;
+	pFastIndex FastIndex;
+	pFastGlyph FastGlyph;
+	pPolygonSC PolygonSC;
+	pPolygonCB PolygonCB;
+	pEllipseSC EllipseSC;
+	pEllipseCB EllipseCB;
+
+	pCacheBitmap CacheBitmap;
+	pCacheBitmapV2 CacheBitmapV2;
+	pCacheBitmapV3 CacheBitmapV3;
+	pCacheColorTable CacheColorTable;
+	pCacheGlyph CacheGlyph;
+	pCacheGlyphV2 CacheGlyphV2;
+	pCacheBrush CacheBrush;
+
+	pcRdpgfxSurfaceCommand SurfaceCommand;
+	pcRdpgfxSolidFill SolidFill;
+	pcRdpgfxSurfaceToSurface SurfaceToSurface;
+	pcRdpgfxSurfaceToCache SurfaceToCache;
+	pcRdpgfxCacheToSurface CacheToSurface;
+	pcRdpgfxEndFrame EndFrame;
+} replay_bench_callbacks;
+
+typedef struct
+{
+	rdpClientContext common;
+
+	replay_bench_callbacks saved;
+	DWORD mainThreadId;
+	replay_bench_stage stages[REPLAY_STAGE_COUNT];
+	UINT64 paints[REPLAY_THREAD_COUNT];
+	UINT64 gfxFrames;
+	UINT64 bytes;
+	BOOL exhausted;
+} replayBenchContext;
+
+static replay_bench_thread_id replay_bench_thread(const replayBenchContext* bench)
+{
+	return (GetCurrentThreadId() == bench->mainThreadId) ? REPLAY_THREAD_MAIN
+	                                                     : REPLAY_THREAD_CHANNEL;
+}
+
+static void replay_bench_stage_add(replayBenchContext* bench, replay_bench_stage_id id,
+                                   UINT64 start)
+{
+	const replay_bench_thread_id thread = replay_bench_thread(bench);
+	replay_bench_stage* stage = &bench->stages[id];
+
+	stage->count[thread]++;
+	stage->ns[thread] += winpr_GetTickCount64NS() - start;
+}
+
+static int replay_bench_read_pdu(rdpTransport* transport, wStream* s)
+{
+	replayBenchContext* bench = (replayBenchContext*)transport_get_context(transport);
+	WINPR_ASSERT(bench);
+
+	const UINT64 start = winpr_GetTickCount64NS();
+	const int rc = bench->saved.ReadPdu(transport, s);
+	replay_bench_stage_add(bench, REPLAY_STAGE_TRANSPORT, start);
+
+	if (rc < 0)
+		bench->exhausted = TRUE;
+	else
+		bench->bytes += Stream_Length(s);
+	return rc;
+}
+
+#define REPLAY_BENCH_UPDATE_WRAPPER(callback, type, stage)             \
+	static BOOL replay_bench_##callback(rdpContext* context, type arg) \
+	{                                                                  \
+		replayBenchContext* bench = (replayBenchContext*)context;      \
+		const UINT64 start = winpr_GetTickCount64NS();                 \
+		const BOOL rc = bench->saved.callback(context, arg);           \
+		replay_bench_stage_add(bench, stage, start);                   \
+		return rc;                                                     \
+	}
+
+REPLAY_BENCH_UPDATE_WRAPPER(BitmapUpdate, const BITMAP_UPDATE*, REPLAY_STAGE_BITMAP_UPDATE)
+REPLAY_BENCH_UPDATE_WRAPPER(SurfaceBits, const SURFACE_BITS_COMMAND*, REPLAY_STAGE_SURFACE_BITS)
+REPLAY_BENCH_UPDATE_WRAPPER(DstBlt, const DSTBLT_ORDER*, REPLAY_STAGE_PRIMARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(PatBlt, PATBLT_ORDER*, REPLAY_STAGE_PRIMARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(ScrBlt, const SCRBLT_ORDER*, REPLAY_STAGE_PRIMARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(OpaqueRect, const OPAQUE_RECT_ORDER*, REPLAY_STAGE_PRIMARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(MultiOpaqueRect, const MULTI_OPAQUE_RECT_ORDER*,
+                            REPLAY_STAGE_PRIMARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(LineTo, const LINE_TO_ORDER*, REPLAY_STAGE_PRIMARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(Polyline, const POLYLINE_ORDER*, REPLAY_STAGE_PRIMARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(MemBlt, MEMBLT_ORDER*, REPLAY_STAGE_PRIMARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(Mem3Blt, MEM3BLT_ORDER*, REPLAY_STAGE_PRIMARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(GlyphIndex, GLYPH_INDEX_ORDER*, REPLAY_STAGE_PRIMARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(FastIndex, const FAST_INDEX_ORDER*, REPLAY_STAGE_PRIMARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(FastGlyph, const FAST_GLYPH_ORDER*, REPLAY_STAGE_PRIMARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(PolygonSC, const POLYGON_SC_ORDER*, REPLAY_STAGE_PRIMARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(PolygonCB, POLYGON_CB_ORDER*, REPLAY_STAGE_PRIMARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(EllipseSC, const ELLIPSE_SC_ORDER*, REPLAY_STAGE_PRIMARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(EllipseCB, const ELLIPSE_CB_ORDER*, REPLAY_STAGE_PRIMARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(CacheBitmap, const CACHE_BITMAP_ORDER*, REPLAY_STAGE_SECONDARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(CacheBitmapV2, CACHE_BITMAP_V2_ORDER*, REPLAY_STAGE_SECONDARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(CacheBitmapV3, CACHE_BITMAP_V3_ORDER*, REPLAY_STAGE_SECONDARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(CacheColorTable, const CACHE_COLOR_TABLE_ORDER*,
+                            REPLAY_STAGE_SECONDARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(CacheGlyph, const CACHE_GLYPH_ORDER*, REPLAY_STAGE_SECONDARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(CacheGlyphV2, const CACHE_GLYPH_V2_ORDER*,
+                            REPLAY_STAGE_SECONDARY_ORDERS)
+REPLAY_BENCH_UPDATE_WRAPPER(CacheBrush, const CACHE_BRUSH_ORDER*, REPLAY_STAGE_SECONDARY_ORDERS)
+
+#define REPLAY_BENCH_HOOK(table, callback)               \
+	do                                                   \
+	{                                                    \
+		if ((table)->callback)                           \
+		{                                                \
+			bench->saved.callback = (table)->callback;   \
+			(table)->callback = replay_bench_##callback; \
+		}                                                \
+	} while (0)
+
+static BOOL replay_bench_end_paint(rdpContext* context)
+{
+	replayBenchContext* bench = (replayBenchContext*)context;
+
+	bench->paints[replay_bench_thread(bench)]++;
+	if (!bench->saved.EndPaint)
+		return TRUE;
+	return bench->saved.EndPaint(context);
+}
+
+static void replay_bench_hook_update(replayBenchContext* bench)
+{
+	rdpUpdate* update = bench->common.context.update;
+	WINPR_ASSERT(update);
+
+	rdpPrimaryUpdate* primary = update->primary;
+	rdpSecondaryUpdate* secondary = update->secondary;
+	WINPR_ASSERT(primary);
+	WINPR_ASSERT(secondary);
+
+	bench->saved.EndPaint = update->EndPaint;
+	update->EndPaint = replay_bench_end_paint;
+
+	REPLAY_BENCH_HOOK(update, BitmapUpdate);
+	REPLAY_BENCH_HOOK(update, SurfaceBits);
+	REPLAY_BENCH_HOOK(primary, DstBlt);
+	REPLAY_BENCH_HOOK(primary, PatBlt);
+	REPLAY_BENCH_HOOK(primary, ScrBlt);
+	REPLAY_BENCH_HOOK(primary, OpaqueRect);
+	REPLAY_BENCH_HOOK(primary, MultiOpaqueRect);
+	REPLAY_BENCH_HOOK(primary, LineTo);
+	REPLAY_BENCH_HOOK(primary, Polyline);
+	REPLAY_BENCH_HOOK(primary, MemBlt);
+	REPLAY_BENCH_HOOK(primary, Mem3Blt);
+	REPLAY_BENCH_HOOK(primary, GlyphIndex);
+	REPLAY_BENCH_HOOK(primary, FastIndex);
+	REPLAY_BENCH_HOOK(primary, FastGlyph);
+	REPLAY_BENCH_HOOK(primary, PolygonSC);
+	REPLAY_BENCH_HOOK(primary, PolygonCB);
+	REPLAY_BENCH_HOOK(primary, EllipseSC);
+	REPLAY_BENCH_HOOK(primary, EllipseCB);
+	REPLAY_BENCH_HOOK(secondary, CacheBitmap);
+	REPLAY_BENCH_HOOK(secondary, CacheBitmapV2);
+	REPLAY_BENCH_HOOK(secondary, CacheBitmapV3);
+	REPLAY_BENCH_HOOK(secondary, CacheColorTable);
+	REPLAY_BENCH_HOOK(secondary, CacheGlyph);
+	REPLAY_BENCH_HOOK(secondary, CacheGlyphV2);
+	REPLAY_BENCH_HOOK(secondary, CacheBrush);
+}
+
+static replayBenchContext* replay_bench_from_gfx(RdpgfxClientContext* gfx)
+{
+	WINPR_ASSERT(gfx);
+
+	rdpGdi* gdi = (rdpGdi*)gfx->custom;
+	WINPR_ASSERT(gdi);
+	return (replayBenchContext*)gdi->context;
+}
+
+static replay_bench_stage_id replay_bench_codec_stage(UINT32 codecId)
+{
+	switch (codecId)
+	{
+		case RDPGFX_CODECID_CAVIDEO:
+			return REPLAY_STAGE_GFX_REMOTEFX;
+		case RDPGFX_CODECID_CLEARCODEC:
+			return REPLAY_STAGE_GFX_CLEARCODEC;
+		case RDPGFX_CODECID_PLANAR:
+			return REPLAY_STAGE_GFX_PLANAR;
+		case RDPGFX_CODECID_AVC420:
+			return REPLAY_STAGE_GFX_AVC420;
+		case RDPGFX_CODECID_ALPHA:
+			return REPLAY_STAGE_GFX_ALPHA;
+		case RDPGFX_CODECID_AVC444:
+		case RDPGFX_CODECID_AVC444v2:
+			return REPLAY_STAGE_GFX_AVC444;
+		case RDPGFX_CODECID_CAPROGRESSIVE:
+		case RDPGFX_CODECID_CAPROGRESSIVE_V2:
+			return REPLAY_STAGE_GFX_PROGRESSIVE;
+		case RDPGFX_CODECID_UNCOMPRESSED:
+		default:
+			return REPLAY_STAGE_GFX_UNCOMPRESSED;
+	}
+}
+
+static UINT replay_bench_SurfaceCommand(RdpgfxClientContext* gfx, const RDPGFX_SURFACE_COMMAND* cmd)
+{
+	replayBenchContext* bench = replay_bench_from_gfx(gfx);
+	WINPR_ASSERT(cmd);
+
+	const UINT64 start = winpr_GetTickCount64NS();
+	const UINT rc = bench->saved.SurfaceCommand(gfx, cmd);
+	replay_bench_stage_add(bench, replay_bench_codec_stage(cmd->codecId), start);
+	return rc;
+}
+
+#define REPLAY_BENCH_GFX_WRAPPER(callback, type, stage)                     \
+	static UINT replay_bench_##callback(RdpgfxClientContext* gfx, type arg) \
+	{                                                                       \
+		replayBenchContext* bench = replay_bench_from_gfx(gfx);             \
+		const UINT64 start = winpr_GetTickCount64NS();                      \
+		const UINT rc = bench->saved.callback(gfx, arg);                    \
+		replay_bench_stage_add(bench, stage, start);                        \
+		return rc;                                                          \
+	}
+
+REPLAY_BENCH_GFX_WRAPPER(SolidFill, const RDPGFX_SOLID_FILL_PDU*, REPLAY_STAGE_GFX_SOLIDFILL)
+REPLAY_BENCH_GFX_WRAPPER(SurfaceToSurface, const RDPGFX_SURFACE_TO_SURFACE_PDU*,
+                         REPLAY_STAGE_GFX_SURFACE_TO_SURFACE)
+REPLAY_BENCH_GFX_WRAPPER(SurfaceToCache, const RDPGFX_SURFACE_TO_CACHE_PDU*,
+                         REPLAY_STAGE_GFX_CACHE)
+REPLAY_BENCH_GFX_WRAPPER(CacheToSurface, const RDPGFX_CACHE_TO_SURFACE_PDU*,
+                         REPLAY_STAGE_GFX_CACHE)
+
+static UINT replay_bench_EndFrame(RdpgfxClientContext* gfx, const RDPGFX_END_FRAME_PDU* endFrame)
+{
+	replayBenchContext* bench = replay_bench_from_gfx(gfx);
+
+	const UINT64 start = winpr_GetTickCount64NS();
+	const UINT rc = bench->saved.EndFrame(gfx, endFrame);
+	replay_bench_stage_add(bench, REPLAY_STAGE_GFX_END_FRAME, start);
+	bench->gfxFrames++;
+	return rc;
+}
+
+static void replay_bench_hook_gfx(replayBenchContext* bench, RdpgfxClientContext* gfx)
+{
+	REPLAY_BENCH_HOOK(gfx, SurfaceCommand);
+	REPLAY_BENCH_HOOK(gfx, SolidFill);
+	REPLAY_BENCH_HOOK(gfx, SurfaceToSurface);
+	REPLAY_BENCH_HOOK(gfx, SurfaceToCache);
+	REPLAY_BENCH_HOOK(gfx, CacheToSurface);
+	REPLAY_BENCH_HOOK(gfx, EndFrame);
+}
+
+static void replay_bench_OnChannelConnectedEventHandler(void* context,
+                                                        const ChannelConnectedEventArgs* e)
+{
+	replayBenchContext* bench = (replayBenchContext*)context;
+
+	WINPR_ASSERT(bench);
+	WINPR_ASSERT(e);
+
+	freerdp_client_OnChannelConnectedEventHandler(&bench->common, e);
+
+	if (strcmp(e->name, RDPGFX_DVC_CHANNEL_NAME) == 0)
+		replay_bench_hook_gfx(bench, (RdpgfxClientContext*)e->pInterface);
+}
+
+static void replay_bench_OnChannelDisconnectedEventHandler(void* context,
+                                                           const ChannelDisconnectedEventArgs* e)
+{
+	replayBenchContext* bench = (replayBenchContext*)context;
+
+	WINPR_ASSERT(bench);
+	freerdp_client_OnChannelDisconnectedEventHandler(&bench->common, e);
+}
+
+static BOOL replay_bench_desktop_resize(rdpContext* context)
+{
+	WINPR_ASSERT(context);
+
+	const rdpSettings* settings = context->settings;
+	return gdi_resize(context->gdi, freerdp_settings_get_uint32(settings, FreeRDP_DesktopWidth),
+	                  freerdp_settings_get_uint32(settings, FreeRDP_DesktopHeight));
+}
+
+static BOOL replay_bench_pre_connect(freerdp* instance)
+{
+	WINPR_ASSERT(instance);
+	WINPR_ASSERT(instance->context);
+
+	PubSub_SubscribeChannelConnected(instance->context->pubSub,
+	                                 replay_bench_OnChannelConnectedEventHandler);
+	PubSub_SubscribeChannelDisconnected(instance->context->pubSub,
+	                                    replay_bench_OnChannelDisconnectedEventHandler);
+	return TRUE;
+}
+
+static BOOL replay_bench_post_connect(freerdp* instance)
+{
+	WINPR_ASSERT(instance);
+
+	if (!gdi_init(instance, PIXEL_FORMAT_BGRX32))
+		return FALSE;
+
+	rdpContext* context = instance->context;
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(context->update);
+
+	context->update->DesktopResize = replay_bench_desktop_resize;
+	replay_bench_hook_update((replayBenchContext*)context);
+	return TRUE;
+}
+
+static void replay_bench_post_disconnect(freerdp* instance)
+{
+	if (!instance || !instance->context)
+		return;
+
+	PubSub_UnsubscribeChannelConnected(instance->context->pubSub,
+	                                   replay_bench_OnChannelConnectedEventHandler);
+	PubSub_UnsubscribeChannelDisconnected(instance->context->pubSub,
+	                                      replay_bench_OnChannelDisconnectedEventHandler);
+	gdi_free(instance);
+}
+
+static BOOL replay_bench_client_new(freerdp* instance, rdpContext* context)
+{
+	if (!instance || !context)
+		return FALSE;
+
+	instance->PreConnect = replay_bench_pre_connect;
+	instance->PostConnect = replay_bench_post_connect;
+	instance->PostDisconnect = replay_bench_post_disconnect;
+	return TRUE;
+}
+
+static int replay_bench_client_entry(RDP_CLIENT_ENTRY_POINTS* pEntryPoints)
+{
+	WINPR_ASSERT(pEntryPoints);
+
+	ZeroMemory(pEntryPoints, sizeof(RDP_CLIENT_ENTRY_POINTS));
+	pEntryPoints->Version = RDP_CLIENT_INTERFACE_VERSION;
+	pEntryPoints->Size = sizeof(RDP_CLIENT_ENTRY_POINTS_V1);
+	pEntryPoints->ContextSize = sizeof(replayBenchContext);
+	pEntryPoints->ClientNew = replay_bench_client_new;
+	return 0;
+}
+
+static BOOL replay_bench_configure(rdpContext* context, const char* file)
+{
+	rdpSettings* settings = context->settings;
+	WINPR_ASSERT(settings);
+
+	/* the host is never contacted, but the connection sequence expects one */
+	if (!freerdp_settings_get_string(settings, FreeRDP_ServerHostname))
+	{
+		if (!freerdp_settings_set_string(settings, FreeRDP_ServerHostname, "replay"))
+			return FALSE;
+	}
+
+	if (!freerdp_settings_set_bool(settings, FreeRDP_TransportDump, FALSE) ||
+	    !freerdp_settings_set_bool(settings, FreeRDP_TransportDumpReplay, TRUE) ||
+	    !freerdp_settings_set_bool(settings, FreeRDP_TransportDumpReplayNodelay, TRUE) ||
+	    !freerdp_settings_set_string(settings, FreeRDP_TransportDumpFile, file) ||
+	    !freerdp_settings_set_bool(settings, FreeRDP_DeactivateClientDecoding, FALSE) ||
+	    !freerdp_settings_set_bool(settings, FreeRDP_AutoReconnectionEnabled, FALSE))
+		return FALSE;
+
+	if (!stream_dump_register_handlers(context, CONNECTION_STATE_MCS_CREATE_REQUEST, FALSE))
+		return FALSE;
+
+	/* time the replay transport itself */
+	const rdpTransportIo* dfl = freerdp_get_io_callbacks(context);
+	WINPR_ASSERT(dfl);
+
+	rdpTransportIo io = *dfl;
+	replayBenchContext* bench = (replayBenchContext*)context;
+	bench->saved.ReadPdu = io.ReadPdu;
+	io.ReadPdu = replay_bench_read_pdu;
+	return freerdp_set_io_callbacks(context, &io);
+}
+
+static BOOL replay_bench_run(rdpContext* context)
+{
+	HANDLE handles[MAXIMUM_WAIT_OBJECTS] = { 0 };
+	freerdp* instance = context->instance;
+	replayBenchContext* bench = (replayBenchContext*)context;
+
+	bench->mainThreadId = GetCurrentThreadId();
+
+	if (!freerdp_connect(instance))
+	{
+		(void)fprintf(stderr, "replay failed during the connection sequence: %s\n",
+		              freerdp_get_last_error_string(freerdp_get_last_error(context)));
+		return FALSE;
+	}
+
+	while (!freerdp_shall_disconnect_context(context))
+	{
+		const DWORD count = freerdp_get_event_handles(context, handles, ARRAYSIZE(handles));
+
+		if (count == 0)
+			break;
+
+		if (WaitForMultipleObjects(count, handles, FALSE, 100) == WAIT_FAILED)
+			break;
+
+		if (!freerdp_check_event_handles(context))
+			break;
+	}
+
+	freerdp_disconnect(instance);
+
+	/* the replay ends when the transport runs out of recorded data */
+	if (!bench->exhausted)
+		(void)fprintf(stderr, "replay stopped before the end of the recording: %s\n",
+		              freerdp_get_last_error_string(freerdp_get_last_error(context)));
+	return bench->exhausted;
+}
+
+static UINT64 replay_bench_peak_rss(void)
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters = { 0 };
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage = { 0 };
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#if defined(__APPLE__)
+	return (UINT64)usage.ru_maxrss;
+#else
+	return (UINT64)usage.ru_maxrss * 1024ull;
+#endif
+#endif
+}
+
+/**
+ * Print the stages timed on one kind of thread, the share is of the wall clock time.
+ *
+ * @return the nanoseconds spent in these stages
+ */
+static UINT64 replay_bench_report_stages(const replayBenchContext* bench,
+                                         replay_bench_thread_id thread, UINT64 elapsed)
+{
+	UINT64 staged = 0;
+
+	for (size_t x = 0; x < ARRAYSIZE(bench->stages); x++)
+	{
+		const UINT64 count = bench->stages[x].count[thread];
+		const UINT64 ns = bench->stages[x].ns[thread];
+
+		if (count == 0)
+			continue;
+
+		staged += ns;
+		printf("%-24s %10" PRIu64 " %12.3f %10.3f %6.1f%%\n", replay_bench_stage_names[x], count,
+		       (double)ns / 1000000.0, (double)ns / 1000.0 / (double)count,
+		       (elapsed > 0) ? 100.0 * (double)ns / (double)elapsed : 0.0);
+	}
+
+	return staged;
+}
+
+static void replay_bench_report(const replayBenchContext* bench, const char* file, UINT64 elapsed)
+{
+	const double seconds = (double)elapsed / 1000000000.0;
+	const UINT64 paints = bench->paints[REPLAY_THREAD_MAIN] + bench->paints[REPLAY_THREAD_CHANNEL];
+	const UINT64 frames = (bench->gfxFrames > 0) ? bench->gfxFrames : paints;
+
+	printf("replayed %s: %" PRIu64 " bytes in %.3f s\n", file, bench->bytes, seconds);
+	printf("frames: %" PRIu64 " gfx, %" PRIu64 " paints, %.1f frames/s\n", bench->gfxFrames,
+	       paints, (seconds > 0.0) ? (double)frames / seconds : 0.0);
+	printf("%-24s %10s %12s %10s %7s\n", "main thread stage", "calls", "total ms", "avg us",
+	       "share");
+
+	const UINT64 staged = replay_bench_report_stages(bench, REPLAY_THREAD_MAIN, elapsed);
+
+	/* connection sequence, PDU parsing, channel dispatch and everything not hooked above */
+	const UINT64 other = (elapsed > staged) ? elapsed - staged : 0;
+	printf("%-24s %10s %12.3f %10s %6.1f%%\n", "other", "", (double)other / 1000000.0, "",
+	       (elapsed > 0) ? 100.0 * (double)other / (double)elapsed : 0.0);
+
+	/* these overlap the main thread, they are not part of its total */
+	printf("%-24s %10s %12s %10s %7s\n", "channel thread stage", "calls", "total ms", "avg us",
+	       "share");
+	if (replay_bench_report_stages(bench, REPLAY_THREAD_CHANNEL, elapsed) == 0)
+		printf("%-24s\n", "none");
+
+	printf("peak RSS: %" PRIu64 " KiB\n", replay_bench_peak_rss() / 1024);
+#if defined(__GLIBC__)
+	printf("allocations: %" PRIu64 ", reallocations: %" PRIu64 ", frees: %" PRIu64
+	       ", %" PRIu64 " bytes requested\n",
+	       __atomic_load_n(&replay_bench_allocations, __ATOMIC_RELAXED),
+	       __atomic_load_n(&replay_bench_reallocations, __ATOMIC_RELAXED),
+	       __atomic_load_n(&replay_bench_frees, __ATOMIC_RELAXED),
+	       __atomic_load_n(&replay_bench_allocated, __ATOMIC_RELAXED));
+#else
+	printf("allocations: not available on this platform\n");
+#endif
+}
+
+static void replay_bench_usage(const char* name)
+{
+	printf("Usage: %s <dump file> [client options]\n", name);
+	printf("\n");
+	printf("Replays a session recorded with /dump:record,file:<dump file> as fast as possible\n");
+	printf("through the client stack without a display. Pass the options used while\n");
+	printf("recording (e.g. /gfx, /rfx, /size) so the replay negotiates the same features.\n");
+}
+
+int main(int argc, char* argv[])
+{
+	int rc = -1;
+	RDP_CLIENT_ENTRY_POINTS clientEntryPoints = { 0 };
+
+	if ((argc < 2) || (strcmp(argv[1], "--help") == 0) || (strcmp(argv[1], "-h") == 0))
+	{
+		replay_bench_usage(argv[0]);
+		return (argc < 2) ? -1 : 0;
+	}
+
+	const char* file = argv[1];
+
+	if (!winpr_PathFileExists(file))
+	{
+		(void)fprintf(stderr, "dump file %s does not exist\n", file);
+		return -1;
+	}
+
+	/* hand everything after the dump file to the regular client command line parser */
+	argv[1] = argv[0];
+	argc--;
+	argv++;
+
+	replay_bench_client_entry(&clientEntryPoints);
+	rdpContext* context = freerdp_client_context_new(&clientEntryPoints);
+
+	if (!context)
+		goto fail;
+
+	if (argc > 1)
+	{
+		const int status =
+		    freerdp_client_settings_parse_command_line(context->settings, argc, argv, FALSE);
+		if (status)
+		{
+			rc = freerdp_client_settings_command_line_status_print(context->settings, status,
+			                                                       argc, argv);
+			goto fail;
+		}
+	}
+
+	if (!replay_bench_configure(context, file))
+		goto fail;
+
+	if (freerdp_client_start(context) != 0)
+		goto fail;
+
+	const UINT64 start = winpr_GetTickCount64NS();
+	const BOOL replayed = replay_bench_run(context);
+	const UINT64 elapsed = winpr_GetTickCount64NS() - start;
+
+	if (freerdp_client_stop(context) != 0)
+		goto fail;
+
+	replay_bench_report((replayBenchContext*)context, file, elapsed);
+
+	if (replayed)
+		rc = 0;
+
+fail:
+	freerdp_client_context_free(context);
+	return rc;
+}
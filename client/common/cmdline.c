@@ -4779,6 +4779,11 @@ static int freerdp_client_settings_parse_command_line_arguments_int(
 			if (!freerdp_settings_set_string(settings, FreeRDP_ShellWorkingDirectory, arg->Value))
 				return fail_at(arg, COMMAND_LINE_ERROR_MEMORY);
 		}
+		CommandLineSwitchCase(arg, "shm")
+		{
+			if (!freerdp_settings_set_bool(settings, FreeRDP_SharedMemoryPresentation, enable))
+				return fail_at(arg, COMMAND_LINE_ERROR);
+		}
 		CommandLineSwitchCase(arg, "audio-mode")
 		{
 			const int rc = parse_audio_mode_options(settings, arg);
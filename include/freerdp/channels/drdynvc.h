@@ -32,6 +32,18 @@
 #define DRDYNVC_CHANNEL_NAME "drdynvc"
 #define DRDYNVC_SVC_CHANNEL_NAME "drdynvc"
 
+/** The capability version adding compressed data PDUs (DYNVC_CAPS_VERSION3)
+ *
+ *  \since version 3.11.0
+ */
+#define DRDYNVC_CAPS_VERSION_COMPRESSION 3
+
+/** The most uncompressed data carried by a single compressed data PDU
+ *
+ *  \since version 3.11.0
+ */
+#define DRDYNVC_COMPRESSED_CHUNK_LENGTH 1590
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -65,6 +77,24 @@ extern "C"
 		SOFT_SYNC_RESPONSE_PDU = 0x09
 	} DynamicChannelPDU;
 
+	/** @brief Compression statistics of a dynamic channel
+	 *
+	 *  The payload counters hold the channel data before compression, the wire counters the
+	 *  size it took in the data PDUs (PDU headers excluded). Data sent or received without
+	 *  compression counts the same in both.
+	 *
+	 *  @since version 3.11.0
+	 */
+	typedef struct
+	{
+		UINT64 SentPayloadBytes;
+		UINT64 SentWireBytes;
+		UINT64 SentCompressedPdus;
+		UINT64 ReceivedPayloadBytes;
+		UINT64 ReceivedWireBytes;
+		UINT64 ReceivedCompressedPdus;
+	} DRDYNVC_CHANNEL_STATISTICS;
+
 #ifdef __cplusplus
 }
 #endif
@@ -34,6 +34,7 @@
 
 #include <freerdp/types.h>
 #include <freerdp/peer.h>
+#include <freerdp/channels/drdynvc.h>
 
 #include <winpr/winpr.h>
 #include <winpr/wtypes.h>
@@ -91,6 +92,17 @@ extern "C"
 
 	FREERDP_API UINT32 WTSChannelGetIdByHandle(HANDLE hChannelHandle);
 
+	/** @brief Get the compression statistics of a dynamic channel
+	 *
+	 *  @param hChannelHandle A dynamic channel opened with WTSVirtualChannelOpenEx
+	 *  @param stats Receives the statistics
+	 *
+	 *  @return \b TRUE for success, \b FALSE if the handle is not a dynamic channel
+	 *  @since version 3.11.0
+	 */
+	FREERDP_API BOOL WTSChannelGetStatisticsByHandle(HANDLE hChannelHandle,
+	                                                 DRDYNVC_CHANNEL_STATISTICS* stats);
+
 #ifdef __cplusplus
 }
 #endif
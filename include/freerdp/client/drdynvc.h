@@ -22,6 +22,8 @@
 #ifndef FREERDP_CHANNEL_DRDYNVC_CLIENT_DRDYNVC_H
 #define FREERDP_CHANNEL_DRDYNVC_CLIENT_DRDYNVC_H
 
+#include <freerdp/channels/drdynvc.h>
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -43,6 +45,13 @@ extern "C"
 	typedef UINT (*pcDrdynvcOnChannelDetached)(DrdynvcClientContext* context, const char* name,
 	                                           void* pInterface);
 
+	/** @brief Get the compression statistics of an open channel
+	 *  @since version 3.11.0
+	 */
+	typedef BOOL (*pcDrdynvcGetChannelStatistics)(DrdynvcClientContext* context,
+	                                              UINT32 ChannelId,
+	                                              DRDYNVC_CHANNEL_STATISTICS* stats);
+
 	struct s_drdynvc_client_context
 	{
 		void* handle;
@@ -53,6 +62,7 @@ extern "C"
 		pcDrdynvcOnChannelDisconnected OnChannelDisconnected;
 		pcDrdynvcOnChannelAttached OnChannelAttached;
 		pcDrdynvcOnChannelDetached OnChannelDetached;
+		pcDrdynvcGetChannelStatistics GetChannelStatistics; /** @since version 3.11.0 */
 	};
 
 #ifdef __cplusplus
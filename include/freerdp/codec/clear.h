@@ -38,6 +38,28 @@ extern "C"
 	                               BYTE** WINPR_RESTRICT ppDstData,
 	                               UINT32* WINPR_RESTRICT pDstSize);
 
+	/** @brief Encode a bitmap with ClearCodec
+	 *
+	 *  The encoder keeps mirrors of the client side vBar, short vBar and glyph caches,
+	 *  so every encoded bitmap must be sent (in order) to the same client context.
+	 *  Bitmaps of up to 1024 pixels are placed in the glyph cache.
+	 *
+	 *  @param clear A context created with \b clear_context_new(TRUE)
+	 *  @param s The stream to append the encoded data to
+	 *  @param pSrcData The source bitmap
+	 *  @param SrcFormat The pixel format of \b pSrcData
+	 *  @param nSrcStep The line length of \b pSrcData in bytes
+	 *  @param nWidth The width of the bitmap
+	 *  @param nHeight The height of the bitmap
+	 *
+	 *  @return 0 for success, a negative value otherwise
+	 *  @since version 3.11.0
+	 */
+	FREERDP_API int clear_compress_to_stream(CLEAR_CONTEXT* WINPR_RESTRICT clear,
+	                                         wStream* WINPR_RESTRICT s,
+	                                         const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcFormat,
+	                                         UINT32 nSrcStep, UINT32 nWidth, UINT32 nHeight);
+
 	FREERDP_API INT32 clear_decompress(CLEAR_CONTEXT* WINPR_RESTRICT clear,
 	                                   const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize,
 	                                   UINT32 nWidth, UINT32 nHeight, BYTE* WINPR_RESTRICT pDstData,
@@ -82,6 +82,71 @@ extern "C"
 	FREERDP_API BOOL progressive_rfx_write_message_progressive_simple(
 	    PROGRESSIVE_CONTEXT* progressive, wStream* s, const RFX_MESSAGE* msg);
 
+	/** Set the number of quality passes \link progressive_compress_surface splits tiles into.
+	 *  With more than one pass the first pass is sent at a coarse quality and the remaining
+	 *  passes are produced by \link progressive_compress_upgrade
+	 *  @param progressive The progressive codec context
+	 *  @param passes The number of passes, 1 (the default) sends tiles at full quality
+	 *
+	 *  @since version 3.11.0
+	 *  @return \b TRUE in case of success, \b FALSE if passes is out of range
+	 */
+	FREERDP_API BOOL progressive_context_set_passes(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
+	                                                UINT32 passes);
+
+	/** Compress the invalid region of a surface as the first quality pass of its tiles.
+	 *  The encoder remembers the tiles of the surface that still need upgrade passes.
+	 *  The arguments match \link progressive_compress
+	 *  @param progressive The progressive codec context
+	 *  @param surfaceId The surface the tiles belong to
+	 *
+	 *  @since version 3.11.0
+	 *  @return 1 if data was produced, 0 if the region is empty, a negative value on error
+	 */
+	FREERDP_API int progressive_compress_surface(
+	    PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive, UINT16 surfaceId,
+	    const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize, UINT32 SrcFormat, UINT32 Width,
+	    UINT32 Height, UINT32 ScanLine, const REGION16* WINPR_RESTRICT invalidRegion,
+	    BYTE** WINPR_RESTRICT ppDstData, UINT32* WINPR_RESTRICT pDstSize);
+
+	/** Compress the next quality pass of tiles of a surface that are not at full quality yet.
+	 *  Tiles at the lowest quality are upgraded first.
+	 *  @param progressive The progressive codec context
+	 *  @param surfaceId The surface to upgrade
+	 *  @param maxTiles The maximum number of tiles to upgrade, 0 for all
+	 *  @param ppDstData Pointer receiving the compressed data, owned by the context
+	 *  @param pDstSize Pointer receiving the size of the compressed data
+	 *
+	 *  @since version 3.11.0
+	 *  @return 1 if data was produced, 0 if no upgrade is pending, a negative value on error
+	 */
+	FREERDP_API int progressive_compress_upgrade(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
+	                                             UINT16 surfaceId, UINT32 maxTiles,
+	                                             BYTE** WINPR_RESTRICT ppDstData,
+	                                             UINT32* WINPR_RESTRICT pDstSize);
+
+	/** Get the number of tiles of a surface waiting for upgrade passes
+	 *  @param progressive The progressive codec context
+	 *  @param surfaceId The surface to query
+	 *
+	 *  @since version 3.11.0
+	 *  @return The number of tiles not at full quality yet
+	 */
+	FREERDP_API UINT32 progressive_get_pending_upgrades(
+	    PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive, UINT16 surfaceId);
+
+	/** Add the tiles of a surface waiting for upgrade passes to a region
+	 *  @param progressive The progressive codec context
+	 *  @param surfaceId The surface to query
+	 *  @param region An initialized region receiving the tile rectangles
+	 *
+	 *  @since version 3.11.0
+	 *  @return \b TRUE in case of success, \b FALSE for any error
+	 */
+	FREERDP_API BOOL progressive_get_pending_region(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
+	                                                UINT16 surfaceId,
+	                                                REGION16* WINPR_RESTRICT region);
+
 #ifdef __cplusplus
 }
 #endif
@@ -120,6 +120,21 @@ extern "C"
 	FREERDP_API BOOL region16_union_rect(REGION16* dst, const REGION16* src,
 	                                     const RECTANGLE_16* rect);
 
+	/** replaces the region with rectangles that are already y-x banded, this is much
+	 * cheaper than adding them one by one. The rectangles must not be empty and are
+	 * sorted by top then left. Rectangles with the same top form a band: they have the
+	 * same bottom and neither overlap nor touch. A band starts below the previous one.
+	 * Touching bands with the same rectangles are merged.
+	 * @param dst destination region
+	 * @param rects the rectangles
+	 * @param nbRects the number of rectangles
+	 * @return if the operation was successful (false meaning out-of-memory or rectangles
+	 * that are not banded)
+	 * @since version 3.11.0
+	 */
+	FREERDP_API BOOL region16_set_banded_rects(REGION16* dst, const RECTANGLE_16* rects,
+	                                           UINT32 nbRects);
+
 	/** returns if a rectangle intersects the region
 	 * @param src the region
 	 * @param arg2 the rectangle
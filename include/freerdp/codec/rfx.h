@@ -113,6 +113,20 @@ extern "C"
 	FREERDP_API BOOL rfx_write_message(RFX_CONTEXT* context, wStream* s,
 	                                   const RFX_MESSAGE* message);
 
+	/** Write the RemoteFX header blocks if they were not sent since the last context reset.
+	 *
+	 *  Messages written by \b rfx_write_message after this call contain frame data only,
+	 *  which does not depend on the context that wrote the headers.
+	 *
+	 *  @param context The RFX encoder context
+	 *  @param s The stream to write to
+	 *
+	 *  @since version 3.11.0
+	 *  @return \b TRUE in case of success, \b FALSE for any error
+	 */
+	FREERDP_API BOOL rfx_write_message_header(RFX_CONTEXT* WINPR_RESTRICT context,
+	                                          wStream* WINPR_RESTRICT s);
+
 	FREERDP_API void rfx_context_free(RFX_CONTEXT* context);
 
 	WINPR_ATTR_MALLOC(rfx_context_free, 1)
@@ -135,6 +149,51 @@ extern "C"
 	 */
 	FREERDP_API RLGR_MODE rfx_context_get_mode(RFX_CONTEXT* WINPR_RESTRICT context);
 
+	/** Enable or disable the encoded tile cache of a RFX encoder
+	 *
+	 *  Tiles whose pixels match a cached tile reuse the encoded data instead of being
+	 *  encoded again. Every call drops the tiles cached so far.
+	 *
+	 *  @param context The RFX encoder context
+	 *  @param entries The number of tiles to cache, \b 0 disables the cache
+	 *
+	 *  @since version 3.11.0
+	 *  @return \b TRUE in case of success, \b FALSE for any error
+	 */
+	FREERDP_API BOOL rfx_context_set_tile_cache_size(RFX_CONTEXT* WINPR_RESTRICT context,
+	                                                 size_t entries);
+
+	/** Get the statistics of the encoded tile cache of a RFX encoder
+	 *
+	 *  The counters start over whenever the cache size is set.
+	 *
+	 *  @param context The RFX encoder context
+	 *  @param hits    Receives the number of tiles that reused cached data
+	 *  @param misses  Receives the number of tiles encoded while the cache was enabled
+	 *
+	 *  @since version 3.11.0
+	 *  @return \b TRUE in case of success, \b FALSE for any error
+	 */
+	FREERDP_API BOOL rfx_context_get_tile_cache_stats(const RFX_CONTEXT* WINPR_RESTRICT context,
+	                                                  UINT64* WINPR_RESTRICT hits,
+	                                                  UINT64* WINPR_RESTRICT misses);
+
+	/** Set the quantization values a RFX encoder uses for all tiles
+	 *
+	 *  The higher the values the higher the compression rate and the lower the quality.
+	 *  Tiles in the encoded tile cache were quantized with the previous values and are dropped.
+	 *  Messages encoded before the call must have been written already.
+	 *
+	 *  @param context The RFX encoder context
+	 *  @param quantVals The 10 quantization values in the range 6 to 15, in the order
+	 *                   LL3, LH3, HL3, HH3, LH2, HL2, HH2, LH1, HL1, HH1
+	 *
+	 *  @since version 3.11.0
+	 *  @return \b TRUE in case of success, \b FALSE for any error
+	 */
+	FREERDP_API BOOL rfx_context_set_quantization(RFX_CONTEXT* WINPR_RESTRICT context,
+	                                              const UINT32* WINPR_RESTRICT quantVals);
+
 	FREERDP_API void rfx_context_set_pixel_format(RFX_CONTEXT* WINPR_RESTRICT context,
 	                                              UINT32 pixel_format);
 
@@ -32,6 +32,11 @@
 
 #define ZGFX_SEGMENTED_MAXSIZE 65535
 
+#define ZGFX_COMPRESSION_LEVEL_NONE 0    /* segments are sent uncompressed */
+#define ZGFX_COMPRESSION_LEVEL_FAST 1    /* short hash chains, greedy parsing */
+#define ZGFX_COMPRESSION_LEVEL_DEFAULT 2 /* medium hash chains, lazy matching */
+#define ZGFX_COMPRESSION_LEVEL_BEST 3    /* long hash chains, lazy matching */
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -52,6 +57,57 @@ extern "C"
 	                                        const BYTE* WINPR_RESTRICT pUncompressed,
 	                                        UINT32 uncompressedSize, UINT32* WINPR_RESTRICT pFlags);
 
+	/** @brief Select the speed/ratio trade off of a compressor context
+	 *
+	 *  @param zgfx The compressor context to configure
+	 *  @param level One of \b ZGFX_COMPRESSION_LEVEL_*
+	 *
+	 *  @return \b TRUE for success, \b FALSE if the level is invalid or the context was not
+	 * created as compressor
+	 *  @since version 3.11.0
+	 */
+	FREERDP_API BOOL zgfx_context_set_compression_level(ZGFX_CONTEXT* WINPR_RESTRICT zgfx,
+	                                                    UINT32 level);
+
+	/** @brief Return the compression level of a context
+	 *  @since version 3.11.0
+	 */
+	FREERDP_API UINT32 zgfx_context_get_compression_level(const ZGFX_CONTEXT* WINPR_RESTRICT zgfx);
+
+	/** @brief Compress data into a single RDP8_BULK_ENCODED_DATA segment
+	 *
+	 *  Writes the header byte and the data without a segmented data descriptor, the format
+	 *  of compressed dynamic channel data. Data that does not shrink is written uncompressed,
+	 *  so at most \b SrcSize + 1 bytes are written.
+	 *
+	 *  @param zgfx A compressor context, its history is shared by all calls
+	 *  @param sDst The stream to write to
+	 *  @param pSrcData The data to compress
+	 *  @param SrcSize The size of the data, at most \b ZGFX_SEGMENTED_MAXSIZE
+	 *
+	 *  @return \b TRUE for success, \b FALSE otherwise
+	 *  @since version 3.11.0
+	 */
+	FREERDP_API BOOL zgfx_compress_bulk(ZGFX_CONTEXT* WINPR_RESTRICT zgfx,
+	                                    wStream* WINPR_RESTRICT sDst,
+	                                    const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize);
+
+	/** @brief Decompress a single RDP8_BULK_ENCODED_DATA segment
+	 *
+	 *  @param zgfx A decompressor context, its history is shared by all calls
+	 *  @param pSrcData The segment, starting with the header byte
+	 *  @param SrcSize The size of the segment
+	 *  @param ppDstData Receives the data, valid until the next call with this context
+	 *  @param pDstSize Receives the size of the data
+	 *
+	 *  @return \b TRUE for success, \b FALSE otherwise
+	 *  @since version 3.11.0
+	 */
+	FREERDP_API BOOL zgfx_decompress_bulk(ZGFX_CONTEXT* WINPR_RESTRICT zgfx,
+	                                      const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize,
+	                                      const BYTE** WINPR_RESTRICT ppDstData,
+	                                      UINT32* WINPR_RESTRICT pDstSize);
+
 	FREERDP_API void zgfx_context_reset(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, BOOL flush);
 
 	FREERDP_API void zgfx_context_free(ZGFX_CONTEXT* zgfx);
@@ -205,6 +205,33 @@ typedef pstatus_t (*__orC_32u_t)(const UINT32* WINPR_RESTRICT pSrc, UINT32 val,
 	                             UINT32* WINPR_RESTRICT pDst, INT32 len);
 typedef pstatus_t (*primitives_uninit_t)(void);
 
+/** \brief Compare two images in tiles of 16x16 pixels
+ *
+ *  For every tile one byte is written to \b pTiles, \b 0 if the tile is equal in both images,
+ *  \b 1 otherwise. Tiles at the right and bottom border are clipped to the image size.
+ *  Images of the same format are compared bytewise, images of different formats by their
+ *  color channels ignoring alpha.
+ *
+ *  @param pSrc1 The first image buffer
+ *  @param format1 The first image format @ref PIXEL_FORMAT
+ *  @param src1Step The first image line width in bytes (including padding)
+ *  @param pSrc2 The second image buffer
+ *  @param format2 The second image format @ref PIXEL_FORMAT
+ *  @param src2Step The second image line width in bytes (including padding)
+ *  @param width The width of the area to compare in pixels
+ *  @param height The height of the area to compare in pixels
+ *  @param pTiles A buffer of at least \b tilesStep * ((height + 15) / 16) bytes
+ *  @param tilesStep The number of bytes per tile row in \b pTiles, at least (width + 15) / 16
+ *  @param pDirty Optional, receives the number of changed tiles
+ *  @return \b PRIMITIVES_SUCCESS or a negative value for failure
+ *  @since version 3.11.0
+ */
+typedef pstatus_t (*__compare_tiles_t)(const BYTE* WINPR_RESTRICT pSrc1, DWORD format1,
+                                       UINT32 src1Step, const BYTE* WINPR_RESTRICT pSrc2,
+                                       DWORD format2, UINT32 src2Step, UINT32 width,
+                                       UINT32 height, BYTE* WINPR_RESTRICT pTiles,
+                                       UINT32 tilesStep, UINT32* WINPR_RESTRICT pDirty);
+
 typedef struct
 {
 	/* Memory-to-memory copy routines */
@@ -256,6 +283,7 @@ typedef struct
 	__add_16s_inplace_t add_16s_inplace;         /** @since version 3.6.0 */
 	__lShiftC_16s_inplace_t lShiftC_16s_inplace; /** @since version 3.6.0 */
 	__copy_no_overlap_t copy_no_overlap;         /** @since version 3.6.0 */
+	__compare_tiles_t compare_tiles;             /** @since version 3.11.0 */
 } primitives_t;
 
 typedef enum
@@ -59,6 +59,7 @@ extern "C"
 	typedef struct rdp_shadow_capture rdpShadowCapture;
 	typedef struct rdp_shadow_subsystem rdpShadowSubsystem;
 	typedef struct rdp_shadow_multiclient_event rdpShadowMultiClientEvent;
+	typedef struct rdp_shadow_encode_cache rdpShadowEncodeCache;
 
 	typedef struct S_RDP_SHADOW_ENTRY_POINTS RDP_SHADOW_ENTRY_POINTS;
 	typedef int (*pfnShadowSubsystemEntry)(RDP_SHADOW_ENTRY_POINTS* pEntryPoints);
@@ -174,6 +175,7 @@ extern "C"
 		freerdp_listener* listener;
 
 		size_t maxClientsConnected;
+		rdpShadowEncodeCache* encodeCache; /** @since version 3.11.0 */
 	};
 
 	struct rdp_shadow_surface
@@ -299,6 +301,25 @@ extern "C"
 		UINT16 right;
 	} SHADOW_MSG_OUT_AUDIO_OUT_VOLUME;
 
+	/** @brief The decisions of the rate controller of a client encoder
+	 *  and the measurements they are based on
+	 *
+	 *  @since version 3.11.0
+	 */
+	typedef struct
+	{
+		UINT32 fps;            /**< frames per second the screen should be captured at */
+		UINT32 h264BitRate;    /**< H.264 target bit rate in bits per second */
+		UINT32 h264QP;         /**< H.264 quantization parameter */
+		UINT32 rfxQuality;     /**< RemoteFX quantization level, \b 0 is the best quality */
+		UINT32 rtt;            /**< round-trip time in milliseconds, \b 0 if not measured */
+		UINT32 bandwidth;      /**< bandwidth in kilobits per second, \b 0 if not measured */
+		UINT32 ackLatency;     /**< smoothed milliseconds until a frame is acknowledged */
+		UINT32 inFlightFrames; /**< frames sent but not acknowledged yet */
+		UINT32 sendQueue;      /**< bytes waiting in the socket send buffer */
+		BOOL congested;        /**< \b TRUE if the last frame showed signs of congestion */
+	} SHADOW_RATE_CONTROL;
+
 	FREERDP_API void shadow_subsystem_set_entry_builtin(const char* name);
 	FREERDP_API void shadow_subsystem_set_entry(pfnShadowSubsystemEntry pEntry);
 
@@ -375,6 +396,30 @@ extern "C"
 	                                                   UINT32 format2, UINT32 nStep2,
 	                                                   RECTANGLE_16* WINPR_RESTRICT rect);
 
+	/** @brief Compare an area of two framebuffer images and collect the changed tiles
+	 *
+	 *  The area is split in tiles of 16x16 pixels starting at its top left corner.
+	 *  Adjacent changed tiles of a tile row are merged, so \b region describes the changes
+	 *  with multiple rectangles instead of a single bounding box.
+	 *
+	 *  @param pData1  A pointer to the top left pixel of the area in image 1
+	 *  @param format1 The format of image 1
+	 *  @param nStep1  The line width in bytes of image 1
+	 *  @param pData2  A pointer to the top left pixel of the area in image 2
+	 *  @param format2 The format of image 2
+	 *  @param nStep2  The line width in bytes of image 2
+	 *  @param area    The location of the compared area, used for the rectangles in \b region
+	 *  @param region  The region the changed tiles (clipped to \b area) are added to
+	 *
+	 *  @return \b 0 if equal, \b >0 if not equal and \b <0 for any error
+	 *
+	 *  @since version 3.11.0
+	 */
+	FREERDP_API int shadow_capture_compare_region_with_format(
+	    const BYTE* WINPR_RESTRICT pData1, UINT32 format1, UINT32 nStep1,
+	    const BYTE* WINPR_RESTRICT pData2, UINT32 format2, UINT32 nStep2,
+	    const RECTANGLE_16* WINPR_RESTRICT area, REGION16* WINPR_RESTRICT region);
+
 	FREERDP_API void shadow_subsystem_frame_update(rdpShadowSubsystem* subsystem);
 
 	FREERDP_API BOOL shadow_client_post_msg(rdpShadowClient* client, void* context, UINT32 type,
@@ -386,6 +431,21 @@ extern "C"
 	FREERDP_API UINT32 shadow_encoder_preferred_fps(rdpShadowEncoder* encoder);
 	FREERDP_API UINT32 shadow_encoder_inflight_frames(rdpShadowEncoder* encoder);
 
+	/** @brief Get the current decisions of the rate controller of a client encoder
+	 *
+	 *  The rate controller adapts the frame rate and codec quality to the measured round-trip
+	 *  time, bandwidth, frame acknowledge latency and socket send queue once per frame.
+	 *
+	 *  @param encoder The encoder of a client
+	 *  @param rate A pointer receiving a copy of the current state
+	 *
+	 *  @return \b TRUE for success, \b FALSE for invalid arguments
+	 *
+	 *  @since version 3.11.0
+	 */
+	FREERDP_API BOOL shadow_encoder_get_rate_control(rdpShadowEncoder* encoder,
+	                                                 SHADOW_RATE_CONTROL* rate);
+
 	FREERDP_API BOOL shadow_screen_resize(rdpShadowScreen* screen);
 
 #ifdef __cplusplus
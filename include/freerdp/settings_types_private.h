@@ -78,7 +78,13 @@ struct rdp_settings
 	SETTINGS_DEPRECATED(ALIGN64 char* AadServerHostname);       /** 30
 		                                                         * @since version 3.1.0
 		                                                         */
-	UINT64 padding0064[64 - 31];                                /* 31 */
+	SETTINGS_DEPRECATED(ALIGN64 UINT32 TransportWriteBatchThreshold); /** 31
+		                                                               * @since version 3.11.0
+		                                                               */
+	SETTINGS_DEPRECATED(ALIGN64 UINT32 TransportWriteBatchDelay);     /** 32
+		                                                               * @since version 3.11.0
+		                                                               */
+	UINT64 padding0064[64 - 33];                                      /* 33 */
 	/* resource management related options */
 	SETTINGS_DEPRECATED(ALIGN64 UINT32 ThreadingFlags); /* 64 */
 
@@ -414,7 +420,10 @@ struct rdp_settings
 	SETTINGS_DEPRECATED(ALIGN64 BOOL MouseUseRelativeMove);    /* 1607 */
 	SETTINGS_DEPRECATED(ALIGN64 BOOL UseCommonStdioCallbacks); /* 1608 */
 	SETTINGS_DEPRECATED(ALIGN64 BOOL ConnectChildSession);     /* 1609 */
-	UINT64 padding1664[1664 - 1610];                           /* 1610 */
+	SETTINGS_DEPRECATED(ALIGN64 BOOL SharedMemoryPresentation); /** 1610
+	                                                             * @since version 3.11.0
+	                                                             */
+	UINT64 padding1664[1664 - 1611];                           /* 1611 */
 
 	/* Names */
 	SETTINGS_DEPRECATED(ALIGN64 char* ComputerName); /* 1664 */
@@ -720,7 +729,13 @@ struct rdp_settings
 	SETTINGS_DEPRECATED(ALIGN64 BOOL GfxSuspendFrameAck); /** 3850
 		                                                   * @since version 3.6.0
 		                                                   */
-	UINT64 padding3904[3904 - 3851];                      /* 3851 */
+	SETTINGS_DEPRECATED(ALIGN64 BOOL GfxClearCodec);      /** 3851
+		                                                   * @since version 3.11.0
+		                                                   */
+	SETTINGS_DEPRECATED(ALIGN64 BOOL GfxMixedCodecs);     /** 3852
+		                                                   * @since version 3.11.0
+		                                                   */
+	UINT64 padding3904[3904 - 3853];                      /* 3853 */
 
 	/**
 	 * Caches
@@ -810,7 +825,10 @@ struct rdp_settings
 	SETTINGS_DEPRECATED(ALIGN64 BOOL SynchronousDynamicChannels);  /** 5060
 		                                                            * @since version 3.2.0
 		                                                            */
-	UINT64 padding5184[5184 - 5061];                               /* 5061 */
+	SETTINGS_DEPRECATED(ALIGN64 BOOL DynamicChannelCompression);   /** 5061
+		                                                            * @since version 3.11.0
+		                                                            */
+	UINT64 padding5184[5184 - 5062];                               /* 5062 */
 
 	SETTINGS_DEPRECATED(ALIGN64 BOOL SupportEchoChannel);        /* 5184 */
 	SETTINGS_DEPRECATED(ALIGN64 BOOL SupportDisplayControl);     /* 5185 */
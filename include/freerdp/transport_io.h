@@ -139,6 +139,30 @@ extern "C"
 	FREERDP_API rdpContext* transport_get_context(rdpTransport* transport);
 	FREERDP_API rdpTransport* freerdp_get_transport(rdpContext* context);
 
+	/**
+	 * @brief Start queueing outgoing PDUs.
+	 *
+	 * While a batch is open PDUs written with the default \b WritePdu callback are
+	 * collected and sent together in a single TLS write and socket send. The queue is
+	 * flushed early once \b FreeRDP_TransportWriteBatchThreshold bytes are pending or the
+	 * oldest queued PDU is older than \b FreeRDP_TransportWriteBatchDelay milliseconds.
+	 * Batches nest, only the outermost transport_write_batch_end flushes.
+	 *
+	 * @param transport The transport to batch writes on
+	 * @return \b TRUE for success, \b FALSE for any error
+	 * @since version 3.11.0
+	 */
+	FREERDP_API BOOL transport_write_batch_begin(rdpTransport* transport);
+
+	/**
+	 * @brief End a batch started with transport_write_batch_begin
+	 *
+	 * @param transport The transport to batch writes on
+	 * @return \b TRUE for success, \b FALSE if flushing the queued PDUs failed
+	 * @since version 3.11.0
+	 */
+	FREERDP_API BOOL transport_write_batch_end(rdpTransport* transport);
+
 	/**
 	 * @brief Free a transport layer instance
 	 * @param layer A pointer to the layer to free or \b NULL
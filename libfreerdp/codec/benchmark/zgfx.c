@@ -0,0 +1,299 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * ZGFX (RDP8) bulk compression benchmarking tool
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/stream.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/codec/zgfx.h>
+
+/**
+ * A recorded GFX stream is a file of concatenated, uncompressed RDPGFX PDUs
+ * (RDPGFX_HEADER followed by the PDU body), exactly as they are handed to
+ * zgfx_compress_to_stream by the rdpgfx server channel.
+ * Every PDU is compressed separately, sharing the history across the stream.
+ */
+typedef struct
+{
+	BYTE* data;
+	size_t size;
+	size_t* offsets;
+	size_t count;
+} zgfx_benchmark_stream;
+
+static void zgfx_benchmark_stream_free(zgfx_benchmark_stream* stream)
+{
+	if (!stream)
+		return;
+
+	free(stream->data);
+	free(stream->offsets);
+
+	const zgfx_benchmark_stream empty = { 0 };
+	*stream = empty;
+}
+
+static BOOL zgfx_benchmark_stream_split(zgfx_benchmark_stream* stream)
+{
+	size_t capacity = 0;
+	size_t offset = 0;
+
+	while (offset < stream->size)
+	{
+		size_t length = stream->size - offset;
+
+		/* RDPGFX_HEADER: cmdId (2 bytes), flags (2 bytes), pduLength (4 bytes) */
+		if (length >= 8)
+		{
+			wStream sbuffer = { 0 };
+			wStream* s = Stream_StaticConstInit(&sbuffer, &stream->data[offset], length);
+			Stream_Seek(s, 4);
+			const UINT32 pduLength = Stream_Get_UINT32(s);
+
+			if ((pduLength >= 8) && (pduLength <= length))
+				length = pduLength;
+			else
+				length = MIN(length, ZGFX_SEGMENTED_MAXSIZE);
+		}
+
+		if (stream->count + 2 > capacity)
+		{
+			capacity = MAX(64, capacity * 2);
+			size_t* tmp = realloc(stream->offsets, capacity * sizeof(size_t));
+			if (!tmp)
+				return FALSE;
+			stream->offsets = tmp;
+		}
+
+		stream->offsets[stream->count++] = offset;
+		offset += length;
+	}
+
+	if (!stream->offsets)
+		return FALSE;
+
+	stream->offsets[stream->count] = stream->size;
+	return TRUE;
+}
+
+static BOOL zgfx_benchmark_stream_load(zgfx_benchmark_stream* stream, const char* path)
+{
+	BOOL rc = FALSE;
+	FILE* fp = winpr_fopen(path, "rb");
+
+	if (!fp)
+	{
+		(void)fprintf(stderr, "failed to open %s\n", path);
+		return FALSE;
+	}
+
+	if (_fseeki64(fp, 0, SEEK_END) != 0)
+		goto fail;
+
+	const INT64 size = _ftelli64(fp);
+	if ((size <= 0) || (_fseeki64(fp, 0, SEEK_SET) != 0))
+		goto fail;
+
+	stream->size = (size_t)size;
+	stream->data = malloc(stream->size);
+	if (!stream->data)
+		goto fail;
+
+	if (fread(stream->data, 1, stream->size, fp) != stream->size)
+		goto fail;
+
+	rc = zgfx_benchmark_stream_split(stream);
+fail:
+	(void)fclose(fp);
+	if (!rc)
+		(void)fprintf(stderr, "failed to read %s\n", path);
+	return rc;
+}
+
+/* A synthetic stream of frame control PDUs, small solid fills and bitmap-like payloads */
+static BOOL zgfx_benchmark_stream_generate(zgfx_benchmark_stream* stream)
+{
+	UINT32 state = 0x12345678;
+	wStream* s = Stream_New(NULL, 32ull * 1024 * 1024);
+
+	if (!s)
+		return FALSE;
+
+	for (UINT32 frame = 0; frame < 256; frame++)
+	{
+		/* StartFrame */
+		Stream_Write_UINT16(s, 0x000B);
+		Stream_Write_UINT16(s, 0);
+		Stream_Write_UINT32(s, 16);
+		Stream_Write_UINT32(s, frame * 16);
+		Stream_Write_UINT32(s, frame);
+
+		/* surface command with a repetitive body */
+		state = state * 1103515245u + 12345u;
+		const UINT32 length = 1024 + (state >> 16) % 60000;
+		Stream_Write_UINT16(s, 0x0001);
+		Stream_Write_UINT16(s, 0);
+		Stream_Write_UINT32(s, length + 8);
+		for (UINT32 x = 0; x < length; x++)
+		{
+			if ((x % 256) == 0)
+				state = state * 1103515245u + 12345u;
+			Stream_Write_UINT8(s, (BYTE)((x % 64 < 48) ? (state >> 24) : (x * 7)));
+		}
+
+		/* EndFrame */
+		Stream_Write_UINT16(s, 0x000C);
+		Stream_Write_UINT16(s, 0);
+		Stream_Write_UINT32(s, 12);
+		Stream_Write_UINT32(s, frame);
+	}
+
+	stream->size = Stream_GetPosition(s);
+	stream->data = Stream_Buffer(s);
+	Stream_Free(s, FALSE);
+	return zgfx_benchmark_stream_split(stream);
+}
+
+static const char* zgfx_level_str(UINT32 level)
+{
+	switch (level)
+	{
+		case ZGFX_COMPRESSION_LEVEL_NONE:
+			return "passthrough";
+		case ZGFX_COMPRESSION_LEVEL_FAST:
+			return "fast";
+		case ZGFX_COMPRESSION_LEVEL_DEFAULT:
+			return "default";
+		case ZGFX_COMPRESSION_LEVEL_BEST:
+			return "best";
+		default:
+			return "unknown";
+	}
+}
+
+static BOOL zgfx_benchmark_run(const zgfx_benchmark_stream* stream, UINT32 level)
+{
+	BOOL rc = FALSE;
+	UINT64 compressTime = 0;
+	UINT64 decompressTime = 0;
+	size_t compressed = 0;
+	ZGFX_CONTEXT* compressor = zgfx_context_new(TRUE);
+	ZGFX_CONTEXT* decompressor = zgfx_context_new(FALSE);
+	wStream* s = Stream_New(NULL, 1024);
+
+	if (!compressor || !decompressor || !s)
+		goto fail;
+
+	if (!zgfx_context_set_compression_level(compressor, level))
+		goto fail;
+
+	for (size_t x = 0; x < stream->count; x++)
+	{
+		UINT32 flags = 0;
+		UINT32 size = 0;
+		BYTE* data = NULL;
+		const BYTE* pdu = &stream->data[stream->offsets[x]];
+		const size_t length = stream->offsets[x + 1] - stream->offsets[x];
+
+		Stream_SetPosition(s, 0);
+
+		const UINT64 start = winpr_GetTickCount64NS();
+		if (zgfx_compress_to_stream(compressor, s, pdu, (UINT32)length, &flags) < 0)
+			goto fail;
+		const UINT64 mid = winpr_GetTickCount64NS();
+		const int status = zgfx_decompress(decompressor, Stream_Buffer(s),
+		                                   (UINT32)Stream_GetPosition(s), &data, &size, flags);
+		const UINT64 end = winpr_GetTickCount64NS();
+
+		const BOOL valid = (status >= 0) && (size == length) && (memcmp(data, pdu, length) == 0);
+		free(data);
+
+		if (!valid)
+		{
+			(void)fprintf(stderr, "[%s] PDU %" PRIuz " failed to round trip\n",
+			              zgfx_level_str(level), x);
+			goto fail;
+		}
+
+		compressed += Stream_GetPosition(s);
+		compressTime += mid - start;
+		decompressTime += end - mid;
+	}
+
+	printf("[%-11s] %" PRIuz " PDUs, %" PRIuz " -> %" PRIuz " bytes (%.2f%%), compress %.2f MB/s, "
+	       "decompress %.2f MB/s\n",
+	       zgfx_level_str(level), stream->count, stream->size, compressed,
+	       100.0 * (double)compressed / (double)stream->size,
+	       (1000.0 * (double)stream->size) / (double)MAX(compressTime, 1),
+	       (1000.0 * (double)stream->size) / (double)MAX(decompressTime, 1));
+	rc = TRUE;
+fail:
+	Stream_Free(s, TRUE);
+	zgfx_context_free(compressor);
+	zgfx_context_free(decompressor);
+	return rc;
+}
+
+int main(int argc, char* argv[])
+{
+	int rc = -1;
+	int count = argc - 1;
+
+	if ((argc > 1) && ((strcmp(argv[1], "-h") == 0) || (strcmp(argv[1], "--help") == 0)))
+	{
+		printf("Usage: %s [recorded GFX stream files...]\n", argv[0]);
+		printf("Without arguments a synthetic GFX stream is used.\n");
+		return 0;
+	}
+
+	if (count == 0)
+		count = 1;
+
+	for (int x = 0; x < count; x++)
+	{
+		zgfx_benchmark_stream stream = { 0 };
+		const char* name = (argc > 1) ? argv[1 + x] : "synthetic";
+		const BOOL loaded = (argc > 1) ? zgfx_benchmark_stream_load(&stream, name)
+		                               : zgfx_benchmark_stream_generate(&stream);
+
+		if (!loaded)
+		{
+			zgfx_benchmark_stream_free(&stream);
+			goto fail;
+		}
+
+		printf("%s:\n", name);
+		for (UINT32 level = ZGFX_COMPRESSION_LEVEL_NONE; level <= ZGFX_COMPRESSION_LEVEL_BEST;
+		     level++)
+		{
+			if (!zgfx_benchmark_run(&stream, level))
+			{
+				zgfx_benchmark_stream_free(&stream);
+				goto fail;
+			}
+		}
+		printf("\n");
+		zgfx_benchmark_stream_free(&stream);
+	}
+
+	rc = 0;
+fail:
+	return rc;
+}
@@ -37,6 +37,15 @@
 
 #define CLEARCODEC_VBAR_SIZE 32768
 #define CLEARCODEC_VBAR_SHORT_SIZE 16384
+#define CLEARCODEC_VBAR_MAX_HEIGHT 52
+#define CLEARCODEC_GLYPH_MAX_PIXELS 1024
+
+/* Compressor side lookup tables, hash buckets map to cache index + 1 */
+#define CLEARCODEC_VBAR_HASH_SIZE 65536
+#define CLEARCODEC_VBAR_SHORT_HASH_SIZE 32768
+#define CLEARCODEC_GLYPH_HASH_SIZE 4096
+#define CLEARCODEC_PALETTE_HASH_SIZE 256
+#define CLEARCODEC_RLEX_MAX_PALETTE 127
 
 typedef struct
 {
@@ -55,6 +64,7 @@ typedef struct
 struct S_CLEAR_CONTEXT
 {
 	BOOL Compressor;
+	BOOL CacheReset;
 	NSC_CONTEXT* nsc;
 	UINT32 seqNumber;
 	BYTE* TempBuffer;
@@ -67,6 +77,15 @@ struct S_CLEAR_CONTEXT
 	CLEAR_VBAR_ENTRY VBarStorage[CLEARCODEC_VBAR_SIZE];
 	UINT32 ShortVBarStorageCursor;
 	CLEAR_VBAR_ENTRY ShortVBarStorage[CLEARCODEC_VBAR_SHORT_SIZE];
+	UINT32 GlyphCursor;
+	UINT32* GlyphHash;
+	UINT32* VBarHash;
+	UINT32* ShortVBarHash;
+	UINT32* ColumnSet;
+	UINT32 ColumnSetSize;
+	wStream* residual;
+	wStream* bands;
+	wStream* subcodecs;
 };
 
 static const UINT32 CLEAR_LOG2_FLOOR[256] = {
@@ -103,6 +122,12 @@ static void clear_reset_vbar_storage(CLEAR_CONTEXT* WINPR_RESTRICT clear, BOOL z
 	}
 
 	clear->ShortVBarStorageCursor = 0;
+
+	if (clear->VBarHash)
+		ZeroMemory(clear->VBarHash, sizeof(UINT32) * CLEARCODEC_VBAR_HASH_SIZE);
+
+	if (clear->ShortVBarHash)
+		ZeroMemory(clear->ShortVBarHash, sizeof(UINT32) * CLEARCODEC_VBAR_SHORT_HASH_SIZE);
 }
 
 static void clear_reset_glyph_cache(CLEAR_CONTEXT* WINPR_RESTRICT clear)
@@ -111,6 +136,10 @@ static void clear_reset_glyph_cache(CLEAR_CONTEXT* WINPR_RESTRICT clear)
 		winpr_aligned_free(clear->GlyphCache[i].pixels);
 
 	ZeroMemory(clear->GlyphCache, sizeof(clear->GlyphCache));
+	clear->GlyphCursor = 0;
+
+	if (clear->GlyphHash)
+		ZeroMemory(clear->GlyphHash, sizeof(UINT32) * CLEARCODEC_GLYPH_HASH_SIZE);
 }
 
 static BOOL convert_color(BYTE* WINPR_RESTRICT dst, UINT32 nDstStep, UINT32 DstFormat, UINT32 nXDst,
@@ -1150,11 +1179,749 @@ fail:
 	return rc;
 }
 
+/* The compressor works on BGRX32 pixels with a fixed X byte, so pixels compare as UINT32 */
+static INLINE const BYTE* clear_pixel_bgr(const UINT32* WINPR_RESTRICT pixel)
+{
+	return (const BYTE*)pixel;
+}
+
+static INLINE UINT32 clear_hash(const BYTE* WINPR_RESTRICT data, size_t length)
+{
+	UINT32 hash = 2166136261u; /* FNV-1a */
+
+	for (size_t x = 0; x < length; x++)
+	{
+		hash ^= data[x];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static INLINE size_t clear_run_length_size(UINT32 runLengthFactor)
+{
+	if (runLengthFactor < 0xFF)
+		return 1;
+	if (runLengthFactor < 0xFFFF)
+		return 3;
+	return 7;
+}
+
+static void clear_write_run_length(wStream* WINPR_RESTRICT s, UINT32 runLengthFactor)
+{
+	if (runLengthFactor < 0xFF)
+		Stream_Write_UINT8(s, (BYTE)runLengthFactor);
+	else
+	{
+		Stream_Write_UINT8(s, 0xFF);
+
+		if (runLengthFactor < 0xFFFF)
+			Stream_Write_UINT16(s, (UINT16)runLengthFactor);
+		else
+		{
+			Stream_Write_UINT16(s, 0xFFFF);
+			Stream_Write_UINT32(s, runLengthFactor);
+		}
+	}
+}
+
+static INLINE void clear_write_bgr(wStream* WINPR_RESTRICT s, const UINT32* WINPR_RESTRICT pixel)
+{
+	const BYTE* bgr = clear_pixel_bgr(pixel);
+	Stream_Write_UINT8(s, bgr[0]);
+	Stream_Write_UINT8(s, bgr[1]);
+	Stream_Write_UINT8(s, bgr[2]);
+}
+
+typedef struct
+{
+	UINT32 color;
+	UINT32 count;
+	BYTE index;
+	BOOL used;
+} CLEAR_PALETTE_SLOT;
+
+typedef struct
+{
+	CLEAR_PALETTE_SLOT slots[CLEARCODEC_PALETTE_HASH_SIZE];
+	UINT32 colors[CLEARCODEC_RLEX_MAX_PALETTE];
+	UINT32 count;
+	BOOL overflow;
+} CLEAR_PALETTE;
+
+static CLEAR_PALETTE_SLOT* clear_palette_find(CLEAR_PALETTE* WINPR_RESTRICT palette, UINT32 color)
+{
+	UINT32 hash = (color * 2654435761u) >> 24;
+
+	for (size_t x = 0; x < ARRAYSIZE(palette->slots); x++)
+	{
+		CLEAR_PALETTE_SLOT* slot = &palette->slots[hash];
+
+		if (!slot->used || (slot->color == color))
+			return slot;
+
+		hash = (hash + 1) % ARRAYSIZE(palette->slots);
+	}
+
+	return NULL;
+}
+
+static void clear_palette_add(CLEAR_PALETTE* WINPR_RESTRICT palette, UINT32 color, UINT32 count)
+{
+	CLEAR_PALETTE_SLOT* slot = clear_palette_find(palette, color);
+
+	if (!slot)
+		return;
+
+	if (!slot->used)
+	{
+		if (palette->count >= ARRAYSIZE(palette->colors))
+		{
+			palette->overflow = TRUE;
+			return;
+		}
+
+		slot->used = TRUE;
+		slot->color = color;
+		slot->index = (BYTE)palette->count;
+		palette->colors[palette->count++] = color;
+	}
+
+	slot->count += count;
+}
+
+/* Statistics of a strip of at most CLEARCODEC_VBAR_MAX_HEIGHT lines */
+typedef struct
+{
+	size_t residualSize;
+	size_t rlexSize;
+	UINT32 background;
+	CLEAR_PALETTE palette;
+} CLEAR_STRIP_INFO;
+
+static void clear_scan_strip(const UINT32* WINPR_RESTRICT pixels, UINT32 count,
+                             CLEAR_STRIP_INFO* WINPR_RESTRICT info)
+{
+	UINT32 bkgCount = 0;
+
+	ZeroMemory(info, sizeof(CLEAR_STRIP_INFO));
+
+	for (UINT32 x = 0; x < count;)
+	{
+		UINT32 run = 1;
+		const UINT32 color = pixels[x];
+
+		while ((x + run < count) && (pixels[x + run] == color))
+			run++;
+
+		clear_palette_add(&info->palette, color, run);
+		info->residualSize += 3 + clear_run_length_size(run);
+		info->rlexSize += 1 + clear_run_length_size(run - 1);
+		x += run;
+	}
+
+	for (size_t x = 0; x < ARRAYSIZE(info->palette.slots); x++)
+	{
+		const CLEAR_PALETTE_SLOT* slot = &info->palette.slots[x];
+
+		if (slot->used && (slot->count > bkgCount))
+		{
+			bkgCount = slot->count;
+			info->background = slot->color;
+		}
+	}
+
+	info->rlexSize += 1ull + 3ull * info->palette.count;
+}
+
+static INT32 clear_vbar_lookup(const UINT32* WINPR_RESTRICT hashTable, UINT32 hashSize,
+                               const CLEAR_VBAR_ENTRY* WINPR_RESTRICT storage, UINT32 hash,
+                               const UINT32* WINPR_RESTRICT pixels, UINT32 count)
+{
+	const UINT32 slot = hashTable[hash % hashSize];
+
+	if (slot == 0)
+		return -1;
+
+	const CLEAR_VBAR_ENTRY* entry = &storage[slot - 1];
+
+	if (entry->count != count)
+		return -1;
+
+	if ((count > 0) && (memcmp(entry->pixels, pixels, count * sizeof(UINT32)) != 0))
+		return -1;
+
+	return (INT32)(slot - 1);
+}
+
+static BOOL clear_vbar_insert(CLEAR_CONTEXT* WINPR_RESTRICT clear, UINT32* WINPR_RESTRICT hashTable,
+                              UINT32 hashSize, CLEAR_VBAR_ENTRY* WINPR_RESTRICT entry, UINT32 index,
+                              UINT32 hash, const UINT32* WINPR_RESTRICT pixels, UINT32 count)
+{
+	entry->count = count;
+
+	if (!resize_vbar_entry(clear, entry))
+		return FALSE;
+
+	if (count > 0)
+		memcpy(entry->pixels, pixels, count * sizeof(UINT32));
+
+	hashTable[hash % hashSize] = index + 1;
+	return TRUE;
+}
+
+static BOOL clear_column_set_reset(CLEAR_CONTEXT* WINPR_RESTRICT clear, UINT32 nWidth)
+{
+	UINT32 size = 256;
+
+	/* a full and a short vBar hash per column at a load factor of at most 1/2 */
+	while (size < 4ull * nWidth)
+		size *= 2;
+
+	if (size > clear->ColumnSetSize)
+	{
+		UINT32* tmp = realloc(clear->ColumnSet, size * sizeof(UINT32));
+
+		if (!tmp)
+			return FALSE;
+
+		clear->ColumnSet = tmp;
+		clear->ColumnSetSize = size;
+	}
+
+	ZeroMemory(clear->ColumnSet, clear->ColumnSetSize * sizeof(UINT32));
+	return TRUE;
+}
+
+/* Returns TRUE if the hash was already part of the set */
+static BOOL clear_column_set_insert(CLEAR_CONTEXT* WINPR_RESTRICT clear, UINT32 hash)
+{
+	const UINT32 key = hash | 1;
+	const UINT32 mask = clear->ColumnSetSize - 1;
+
+	for (UINT32 x = key & mask;; x = (x + 1) & mask)
+	{
+		if (clear->ColumnSet[x] == key)
+			return TRUE;
+
+		if (clear->ColumnSet[x] == 0)
+		{
+			clear->ColumnSet[x] = key;
+			return FALSE;
+		}
+	}
+}
+
+/**
+ * Encodes a single band covering the full width of a strip, one vBar per column.
+ * Without an output stream only the size is estimated and the caches are left untouched.
+ */
+static BOOL clear_compress_band(CLEAR_CONTEXT* WINPR_RESTRICT clear, wStream* WINPR_RESTRICT s,
+                                const UINT32* WINPR_RESTRICT pixels, UINT32 nWidth, UINT32 yStart,
+                                UINT32 vBarHeight, UINT32 colorBkg, size_t* WINPR_RESTRICT pSize)
+{
+	size_t size = 11;
+	UINT32 column[CLEARCODEC_VBAR_MAX_HEIGHT] = { 0 };
+
+	WINPR_ASSERT(vBarHeight <= CLEARCODEC_VBAR_MAX_HEIGHT);
+
+	if (!s && !clear_column_set_reset(clear, nWidth))
+		return FALSE;
+
+	if (s)
+	{
+		if (!Stream_EnsureRemainingCapacity(s, 11))
+			return FALSE;
+
+		Stream_Write_UINT16(s, 0);                                 /* xStart */
+		Stream_Write_UINT16(s, (UINT16)(nWidth - 1));              /* xEnd */
+		Stream_Write_UINT16(s, (UINT16)yStart);                    /* yStart */
+		Stream_Write_UINT16(s, (UINT16)(yStart + vBarHeight - 1)); /* yEnd */
+		clear_write_bgr(s, &colorBkg);
+	}
+
+	for (UINT32 x = 0; x < nWidth; x++)
+	{
+		UINT32 vBarYOn = vBarHeight;
+		UINT32 vBarYOff = 0;
+
+		for (UINT32 y = 0; y < vBarHeight; y++)
+		{
+			column[y] = pixels[(yStart + y) * nWidth + x];
+
+			if (column[y] != colorBkg)
+			{
+				vBarYOn = MIN(vBarYOn, y);
+				vBarYOff = y + 1;
+			}
+		}
+
+		if (vBarYOff == 0)
+			vBarYOn = 0;
+
+		const UINT32 shortCount = vBarYOff - vBarYOn;
+		const UINT32 hash = clear_hash((const BYTE*)column, vBarHeight * sizeof(UINT32));
+		const INT32 vBarIndex =
+		    clear_vbar_lookup(clear->VBarHash, CLEARCODEC_VBAR_HASH_SIZE, clear->VBarStorage, hash,
+		                      column, vBarHeight);
+
+		if (!s)
+		{
+			/* columns repeated within the band hit the entry their first occurrence creates */
+			if ((vBarIndex >= 0) || (shortCount == 0) || clear_column_set_insert(clear, hash))
+				size += 2;
+			else
+			{
+				const UINT32 shortHash =
+				    clear_hash((const BYTE*)&column[vBarYOn], shortCount * sizeof(UINT32));
+				if ((clear_vbar_lookup(clear->ShortVBarHash, CLEARCODEC_VBAR_SHORT_HASH_SIZE,
+				                       clear->ShortVBarStorage, shortHash, &column[vBarYOn],
+				                       shortCount) >= 0) ||
+				    clear_column_set_insert(clear, ~shortHash))
+					size += 3;
+				else
+					size += 2ull + 3ull * shortCount;
+			}
+
+			continue;
+		}
+
+		if (!Stream_EnsureRemainingCapacity(s, 2ull + 3ull * CLEARCODEC_VBAR_MAX_HEIGHT))
+			return FALSE;
+
+		if (vBarIndex >= 0)
+		{
+			Stream_Write_UINT16(s, (UINT16)(0x8000 | vBarIndex)); /* VBAR_CACHE_HIT */
+			size += 2;
+			continue;
+		}
+
+		const UINT32 shortHash =
+		    clear_hash((const BYTE*)&column[vBarYOn], shortCount * sizeof(UINT32));
+		const INT32 shortIndex =
+		    (shortCount == 0)
+		        ? -1
+		        : clear_vbar_lookup(clear->ShortVBarHash, CLEARCODEC_VBAR_SHORT_HASH_SIZE,
+		                            clear->ShortVBarStorage, shortHash, &column[vBarYOn],
+		                            shortCount);
+
+		if (shortIndex >= 0)
+		{
+			Stream_Write_UINT16(s, (UINT16)(0x4000 | shortIndex)); /* SHORT_VBAR_CACHE_HIT */
+			Stream_Write_UINT8(s, (BYTE)vBarYOn);
+			size += 3;
+		}
+		else
+		{
+			/* SHORT_VBAR_CACHE_MISS */
+			Stream_Write_UINT16(s, (UINT16)((vBarYOff << 8) | vBarYOn));
+
+			for (UINT32 y = vBarYOn; y < vBarYOff; y++)
+				clear_write_bgr(s, &column[y]);
+
+			size += 2ull + 3ull * shortCount;
+
+			const UINT32 index = clear->ShortVBarStorageCursor;
+			if (!clear_vbar_insert(clear, clear->ShortVBarHash, CLEARCODEC_VBAR_SHORT_HASH_SIZE,
+			                       &clear->ShortVBarStorage[index], index, shortHash,
+			                       &column[vBarYOn], shortCount))
+				return FALSE;
+
+			clear->ShortVBarStorageCursor = (index + 1) % CLEARCODEC_VBAR_SHORT_SIZE;
+		}
+
+		/* the decoder stores every short vBar it expands as a new full vBar */
+		const UINT32 index = clear->VBarStorageCursor;
+		if (!clear_vbar_insert(clear, clear->VBarHash, CLEARCODEC_VBAR_HASH_SIZE,
+		                       &clear->VBarStorage[index], index, hash, column, vBarHeight))
+			return FALSE;
+
+		clear->VBarStorageCursor = (index + 1) % CLEARCODEC_VBAR_SIZE;
+	}
+
+	if (pSize)
+		*pSize = size;
+
+	return TRUE;
+}
+
+static BOOL clear_compress_subcodec_rlex(wStream* WINPR_RESTRICT s,
+                                         const UINT32* WINPR_RESTRICT pixels, UINT32 count,
+                                         CLEAR_PALETTE* WINPR_RESTRICT palette)
+{
+	const UINT32 numBits = CLEAR_LOG2_FLOOR[palette->count - 1] + 1;
+	const UINT32 maxSuiteDepth = CLEAR_8BIT_MASKS[8 - numBits];
+
+	if (!Stream_EnsureRemainingCapacity(s, 1ull + 3ull * palette->count))
+		return FALSE;
+
+	Stream_Write_UINT8(s, (BYTE)palette->count);
+
+	for (UINT32 x = 0; x < palette->count; x++)
+		clear_write_bgr(s, &palette->colors[x]);
+
+	for (UINT32 x = 0; x < count;)
+	{
+		UINT32 run = 1;
+		UINT32 suiteDepth = 0;
+		const UINT32 color = pixels[x];
+		const CLEAR_PALETTE_SLOT* slot = clear_palette_find(palette, color);
+
+		if (!slot || !slot->used)
+			return FALSE;
+
+		while ((x + run < count) && (pixels[x + run] == color))
+			run++;
+
+		/* the last pixel of a run starts a suite of ascending palette entries */
+		while ((suiteDepth < maxSuiteDepth) && (x + run + suiteDepth < count) &&
+		       (slot->index + suiteDepth + 1u < palette->count) &&
+		       (pixels[x + run + suiteDepth] == palette->colors[slot->index + suiteDepth + 1]))
+			suiteDepth++;
+
+		if (!Stream_EnsureRemainingCapacity(s, 8))
+			return FALSE;
+
+		Stream_Write_UINT8(s, (BYTE)((suiteDepth << numBits) | (slot->index + suiteDepth)));
+		clear_write_run_length(s, run - 1);
+		x += run + suiteDepth;
+	}
+
+	return TRUE;
+}
+
+static BOOL clear_compress_subcodec(wStream* WINPR_RESTRICT s, const UINT32* WINPR_RESTRICT pixels,
+                                    UINT32 nWidth, UINT32 yStart, UINT32 height,
+                                    CLEAR_STRIP_INFO* WINPR_RESTRICT info)
+{
+	const UINT32 count = nWidth * height;
+	const BOOL rlex = !info->palette.overflow && (info->rlexSize < 3ull * count);
+
+	if (!Stream_EnsureRemainingCapacity(s, 13))
+		return FALSE;
+
+	const size_t start = Stream_GetPosition(s);
+	Stream_Seek(s, 13);
+
+	if (rlex)
+	{
+		if (!clear_compress_subcodec_rlex(s, pixels, count, &info->palette))
+			return FALSE;
+	}
+	else
+	{
+		if (!Stream_EnsureRemainingCapacity(s, 3ull * count))
+			return FALSE;
+
+		for (UINT32 x = 0; x < count; x++)
+			clear_write_bgr(s, &pixels[x]);
+	}
+
+	const size_t end = Stream_GetPosition(s);
+	Stream_SetPosition(s, start);
+	Stream_Write_UINT16(s, 0);                          /* xStart */
+	Stream_Write_UINT16(s, (UINT16)yStart);             /* yStart */
+	Stream_Write_UINT16(s, (UINT16)nWidth);             /* width */
+	Stream_Write_UINT16(s, (UINT16)height);             /* height */
+	Stream_Write_UINT32(s, (UINT32)(end - start - 13)); /* bitmapDataByteCount */
+	Stream_Write_UINT8(s, rlex ? 2 : 0);                /* subcodecId */
+	Stream_SetPosition(s, end);
+	return TRUE;
+}
+
+static BOOL clear_compress_residual(wStream* WINPR_RESTRICT s, const UINT32* WINPR_RESTRICT pixels,
+                                    UINT32 count, const BYTE* WINPR_RESTRICT covered,
+                                    UINT32 nWidth)
+{
+	UINT32 x = 0;
+
+	while (x < count)
+	{
+		UINT32 run = 1;
+		UINT32 color = pixels[x];
+
+		/* pixels overwritten by bands or subcodecs extend whatever run is current */
+		if (covered[x / nWidth])
+		{
+			while ((x + run < count) && covered[(x + run) / nWidth])
+				run++;
+
+			if (x + run < count)
+				color = pixels[x + run];
+		}
+
+		while ((x + run < count) && ((pixels[x + run] == color) || covered[(x + run) / nWidth]))
+			run++;
+
+		if (!Stream_EnsureRemainingCapacity(s, 10))
+			return FALSE;
+
+		clear_write_bgr(s, &color);
+		clear_write_run_length(s, run);
+		x += run;
+	}
+
+	return TRUE;
+}
+
+static BOOL clear_compress_load(CLEAR_CONTEXT* WINPR_RESTRICT clear,
+                                const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcFormat,
+                                UINT32 nSrcStep, UINT32 nWidth, UINT32 nHeight)
+{
+	if (!updateContextFormat(clear, PIXEL_FORMAT_BGRX32))
+		return FALSE;
+
+	if (!clear_resize_buffer(clear, nWidth, nHeight))
+		return FALSE;
+
+	clear->nTempStep = nWidth * FreeRDPGetBytesPerPixel(clear->format);
+	clear->TempFormat = clear->format;
+
+	if (!freerdp_image_copy_no_overlap(clear->TempBuffer, clear->TempFormat, clear->nTempStep, 0,
+	                                   0, nWidth, nHeight, pSrcData, SrcFormat, nSrcStep, 0, 0,
+	                                   NULL, FREERDP_FLIP_NONE))
+		return FALSE;
+
+	for (size_t x = 0; x < 1ull * nWidth * nHeight; x++)
+		clear->TempBuffer[x * 4 + 3] = 0xFF;
+
+	return TRUE;
+}
+
+static INT32 clear_glyph_lookup(CLEAR_CONTEXT* WINPR_RESTRICT clear,
+                                const UINT32* WINPR_RESTRICT pixels, UINT32 count, UINT32 hash)
+{
+	const UINT32 slot = clear->GlyphHash[hash % CLEARCODEC_GLYPH_HASH_SIZE];
+
+	if (slot == 0)
+		return -1;
+
+	const CLEAR_GLYPH_ENTRY* entry = &clear->GlyphCache[slot - 1];
+
+	if ((entry->count != count) || (memcmp(entry->pixels, pixels, count * sizeof(UINT32)) != 0))
+		return -1;
+
+	return (INT32)(slot - 1);
+}
+
+static BOOL clear_glyph_insert(CLEAR_CONTEXT* WINPR_RESTRICT clear, UINT32 glyphIndex,
+                               const UINT32* WINPR_RESTRICT pixels, UINT32 count, UINT32 hash)
+{
+	CLEAR_GLYPH_ENTRY* glyphEntry = &clear->GlyphCache[glyphIndex];
+
+	if (count > glyphEntry->size)
+	{
+		UINT32* tmp = winpr_aligned_recalloc(glyphEntry->pixels, count, sizeof(UINT32), 32);
+
+		if (!tmp)
+			return FALSE;
+
+		glyphEntry->size = count;
+		glyphEntry->pixels = tmp;
+	}
+
+	glyphEntry->count = count;
+	memcpy(glyphEntry->pixels, pixels, count * sizeof(UINT32));
+	clear->GlyphHash[hash % CLEARCODEC_GLYPH_HASH_SIZE] = glyphIndex + 1;
+	return TRUE;
+}
+
+static BOOL clear_row_is_uniform(const UINT32* WINPR_RESTRICT row, UINT32 nWidth)
+{
+	for (UINT32 x = 1; x < nWidth; x++)
+	{
+		if (row[x] != row[0])
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Strips follow uniform rows, so lines of text separated by blank rows get bands of their own */
+static UINT32 clear_strip_height(const UINT32* WINPR_RESTRICT pixels, UINT32 nWidth,
+                                 UINT32 nHeight, UINT32 yStart)
+{
+	UINT32 height = 1;
+	const BOOL uniform = clear_row_is_uniform(&pixels[1ull * yStart * nWidth], nWidth);
+
+	while ((yStart + height < nHeight) && (height < CLEARCODEC_VBAR_MAX_HEIGHT))
+	{
+		const UINT32* row = &pixels[1ull * (yStart + height) * nWidth];
+
+		if (clear_row_is_uniform(row, nWidth) != uniform)
+			break;
+
+		height++;
+	}
+
+	return height;
+}
+
+static BOOL clear_compress_composition(CLEAR_CONTEXT* WINPR_RESTRICT clear,
+                                       wStream* WINPR_RESTRICT s, const UINT32* pixels,
+                                       UINT32 nWidth, UINT32 nHeight)
+{
+	BOOL rc = FALSE;
+	BOOL residual = FALSE;
+	BYTE* covered = calloc(nHeight, sizeof(BYTE));
+	CLEAR_STRIP_INFO* info = calloc(1, sizeof(CLEAR_STRIP_INFO));
+
+	if (!covered || !info)
+		goto fail;
+
+	Stream_SetPosition(clear->residual, 0);
+	Stream_SetPosition(clear->bands, 0);
+	Stream_SetPosition(clear->subcodecs, 0);
+
+	/**
+	 * Every strip of up to 52 lines is either left to the residual layer, encoded as a band of
+	 * vBars against the most frequent color, or encoded with a subcodec (RLEX or uncompressed),
+	 * whichever is estimated to be the smallest.
+	 */
+	for (UINT32 y = 0, height = 0; y < nHeight; y += height)
+	{
+		size_t bandSize = 0;
+		height = clear_strip_height(pixels, nWidth, nHeight, y);
+		const UINT32* strip = &pixels[1ull * y * nWidth];
+		const size_t rawSize = 3ull * nWidth * height;
+
+		clear_scan_strip(strip, nWidth * height, info);
+
+		const size_t subcodecSize =
+		    13 + (info->palette.overflow ? rawSize : MIN(rawSize, info->rlexSize));
+
+		if (!clear_compress_band(clear, NULL, pixels, nWidth, y, height, info->background,
+		                         &bandSize))
+			goto fail;
+
+		if ((info->residualSize <= bandSize) && (info->residualSize <= subcodecSize))
+			residual = TRUE;
+		else
+		{
+			memset(&covered[y], 1, height);
+
+			if (bandSize <= subcodecSize)
+			{
+				if (!clear_compress_band(clear, clear->bands, pixels, nWidth, y, height,
+				                         info->background, NULL))
+					goto fail;
+			}
+			else if (!clear_compress_subcodec(clear->subcodecs, strip, nWidth, y, height, info))
+				goto fail;
+		}
+	}
+
+	if (residual)
+	{
+		if (!clear_compress_residual(clear->residual, pixels, nWidth * nHeight, covered, nWidth))
+			goto fail;
+	}
+
+	const size_t residualByteCount = Stream_GetPosition(clear->residual);
+	const size_t bandsByteCount = Stream_GetPosition(clear->bands);
+	const size_t subcodecByteCount = Stream_GetPosition(clear->subcodecs);
+
+	if (!Stream_EnsureRemainingCapacity(s, 12ull + residualByteCount + bandsByteCount +
+	                                           subcodecByteCount))
+		goto fail;
+
+	Stream_Write_UINT32(s, (UINT32)residualByteCount);
+	Stream_Write_UINT32(s, (UINT32)bandsByteCount);
+	Stream_Write_UINT32(s, (UINT32)subcodecByteCount);
+	Stream_Write(s, Stream_Buffer(clear->residual), residualByteCount);
+	Stream_Write(s, Stream_Buffer(clear->bands), bandsByteCount);
+	Stream_Write(s, Stream_Buffer(clear->subcodecs), subcodecByteCount);
+	rc = TRUE;
+fail:
+	free(info);
+	free(covered);
+	return rc;
+}
+
+int clear_compress_to_stream(CLEAR_CONTEXT* WINPR_RESTRICT clear, wStream* WINPR_RESTRICT s,
+                             const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcFormat, UINT32 nSrcStep,
+                             UINT32 nWidth, UINT32 nHeight)
+{
+	BYTE glyphFlags = 0;
+	UINT32 glyphHash = 0;
+	UINT32 glyphIndex = 0;
+
+	if (!clear || !clear->Compressor || !s || !pSrcData)
+		return -1;
+
+	if ((nWidth == 0) || (nHeight == 0) || (nWidth > 0xFFFF) || (nHeight > 0xFFFF))
+		return -1;
+
+	if (!clear_compress_load(clear, pSrcData, SrcFormat, nSrcStep, nWidth, nHeight))
+		return -1;
+
+	const UINT32 count = nWidth * nHeight;
+	const UINT32* pixels = (const UINT32*)clear->TempBuffer;
+
+	if (!Stream_EnsureRemainingCapacity(s, 4))
+		return -1;
+
+	if (count <= CLEARCODEC_GLYPH_MAX_PIXELS)
+	{
+		glyphHash = clear_hash((const BYTE*)pixels, count * sizeof(UINT32));
+		const INT32 hit = clear_glyph_lookup(clear, pixels, count, glyphHash);
+
+		glyphFlags = CLEARCODEC_FLAG_GLYPH_INDEX;
+
+		if (hit >= 0)
+		{
+			glyphFlags |= CLEARCODEC_FLAG_GLYPH_HIT;
+			glyphIndex = (UINT32)hit;
+		}
+		else
+		{
+			glyphIndex = clear->GlyphCursor;
+			clear->GlyphCursor = (clear->GlyphCursor + 1) % ARRAYSIZE(clear->GlyphCache);
+		}
+	}
+
+	/* the client keeps its caches, restart its storage cursors in sync with ours */
+	if (clear->CacheReset)
+	{
+		glyphFlags |= CLEARCODEC_FLAG_CACHE_RESET;
+		clear->CacheReset = FALSE;
+	}
+
+	Stream_Write_UINT8(s, glyphFlags);
+	Stream_Write_UINT8(s, (BYTE)clear->seqNumber);
+	clear->seqNumber = (clear->seqNumber + 1) % 256;
+
+	if (glyphFlags & CLEARCODEC_FLAG_GLYPH_INDEX)
+		Stream_Write_UINT16(s, (UINT16)glyphIndex);
+
+	if (glyphFlags & CLEARCODEC_FLAG_GLYPH_HIT)
+		return 0;
+
+	if (!clear_compress_composition(clear, s, pixels, nWidth, nHeight))
+	{
+		WLog_ERR(TAG, "failed to encode %" PRIu32 "x%" PRIu32 " bitmap", nWidth, nHeight);
+		return -1;
+	}
+
+	if (glyphFlags & CLEARCODEC_FLAG_GLYPH_INDEX)
+	{
+		if (!clear_glyph_insert(clear, glyphIndex, pixels, count, glyphHash))
+			return -1;
+	}
+
+	return 0;
+}
+
 int clear_compress(CLEAR_CONTEXT* WINPR_RESTRICT clear, const BYTE* WINPR_RESTRICT pSrcData,
                    UINT32 SrcSize, BYTE** WINPR_RESTRICT ppDstData, UINT32* WINPR_RESTRICT pDstSize)
 {
-	WLog_ERR(TAG, "TODO: not implemented!");
-	return 1;
+	WINPR_UNUSED(clear);
+	WINPR_UNUSED(pSrcData);
+	WINPR_UNUSED(SrcSize);
+	WINPR_UNUSED(ppDstData);
+	WINPR_UNUSED(pDstSize);
+	WLog_ERR(TAG, "the bitmap geometry is unknown, use clear_compress_to_stream");
+	return -1;
 }
 
 BOOL clear_context_reset(CLEAR_CONTEXT* WINPR_RESTRICT clear)
@@ -1195,6 +1962,21 @@ CLEAR_CONTEXT* clear_context_new(BOOL Compressor)
 	if (!clear_context_reset(clear))
 		goto error_nsc;
 
+	if (Compressor)
+	{
+		clear->CacheReset = TRUE;
+		clear->GlyphHash = calloc(CLEARCODEC_GLYPH_HASH_SIZE, sizeof(UINT32));
+		clear->VBarHash = calloc(CLEARCODEC_VBAR_HASH_SIZE, sizeof(UINT32));
+		clear->ShortVBarHash = calloc(CLEARCODEC_VBAR_SHORT_HASH_SIZE, sizeof(UINT32));
+		clear->residual = Stream_New(NULL, 1024);
+		clear->bands = Stream_New(NULL, 1024);
+		clear->subcodecs = Stream_New(NULL, 1024);
+
+		if (!clear->GlyphHash || !clear->VBarHash || !clear->ShortVBarHash || !clear->residual ||
+		    !clear->bands || !clear->subcodecs)
+			goto error_nsc;
+	}
+
 	return clear;
 error_nsc:
 	WINPR_PRAGMA_DIAG_PUSH
@@ -1215,5 +1997,13 @@ void clear_context_free(CLEAR_CONTEXT* clear)
 	clear_reset_vbar_storage(clear, TRUE);
 	clear_reset_glyph_cache(clear);
 
+	free(clear->GlyphHash);
+	free(clear->VBarHash);
+	free(clear->ShortVBarHash);
+	free(clear->ColumnSet);
+	Stream_Free(clear->residual, TRUE);
+	Stream_Free(clear->bands, TRUE);
+	Stream_Free(clear->subcodecs, TRUE);
+
 	winpr_aligned_free(clear);
 }
@@ -585,6 +585,9 @@ int progressive_delete_surface_context(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progr
 {
 	progressive_set_surface_data(progressive, surfaceId, NULL);
 
+	if (progressive->EncoderSurfaces)
+		HashTable_Remove(progressive->EncoderSurfaces, (void*)(((ULONG_PTR)surfaceId) + 1));
+
 	return 1;
 }
 
@@ -759,19 +762,6 @@ static INLINE void progressive_rfx_idwt_y(const INT16* WINPR_RESTRICT pLowBand,
 	}
 }
 
-static INLINE size_t progressive_rfx_get_band_l_count(size_t level)
-{
-	return (64 >> level) + 1;
-}
-
-static INLINE size_t progressive_rfx_get_band_h_count(size_t level)
-{
-	if (level == 1)
-		return (64 >> 1) - 1;
-	else
-		return (64 + (1 << (level - 1))) >> level;
-}
-
 static INLINE void progressive_rfx_dwt_2d_decode_block(INT16* WINPR_RESTRICT buffer,
                                                        INT16* WINPR_RESTRICT temp, size_t level)
 {
@@ -1652,32 +1642,38 @@ static INLINE BOOL progressive_tile_read(PROGRESSIVE_CONTEXT* WINPR_RESTRICT pro
 	return progressive_surface_tile_replace(surface, region, &tile, FALSE);
 }
 
-static void CALLBACK progressive_process_tiles_tile_work_callback(PTP_CALLBACK_INSTANCE instance,
-                                                                  void* context, PTP_WORK work)
+static BOOL progressive_process_tiles_work(void* arg, size_t first, size_t last)
 {
-	PROGRESSIVE_TILE_PROCESS_WORK_PARAM* param = (PROGRESSIVE_TILE_PROCESS_WORK_PARAM*)context;
+	PROGRESSIVE_TILE_PROCESS_WORK_PARAM* param = (PROGRESSIVE_TILE_PROCESS_WORK_PARAM*)arg;
 
-	WINPR_UNUSED(instance);
-	WINPR_UNUSED(work);
+	WINPR_ASSERT(param);
+	WINPR_ASSERT(param->region);
 
-	switch (param->tile->blockType)
+	for (size_t idx = first; idx < last; idx++)
 	{
-		case PROGRESSIVE_WBT_TILE_SIMPLE:
-		case PROGRESSIVE_WBT_TILE_FIRST:
-			progressive_decompress_tile_first(param->progressive, param->tile, param->region,
-			                                  param->context);
-			break;
+		RFX_PROGRESSIVE_TILE* tile = param->region->tiles[idx];
 
-		case PROGRESSIVE_WBT_TILE_UPGRADE:
-			progressive_decompress_tile_upgrade(param->progressive, param->tile, param->region,
-			                                    param->context);
-			break;
-		default:
-			WLog_Print(param->progressive->log, WLOG_ERROR, "Invalid block type %04" PRIx16 " (%s)",
-			           param->tile->blockType,
-			           rfx_get_progressive_block_type_string(param->tile->blockType));
-			break;
+		switch (tile->blockType)
+		{
+			case PROGRESSIVE_WBT_TILE_SIMPLE:
+			case PROGRESSIVE_WBT_TILE_FIRST:
+				progressive_decompress_tile_first(param->progressive, tile, param->region,
+				                                  param->context);
+				break;
+
+			case PROGRESSIVE_WBT_TILE_UPGRADE:
+				progressive_decompress_tile_upgrade(param->progressive, tile, param->region,
+				                                    param->context);
+				break;
+			default:
+				WLog_Print(param->progressive->log, WLOG_ERROR,
+				           "Invalid block type %04" PRIx16 " (%s)", tile->blockType,
+				           rfx_get_progressive_block_type_string(tile->blockType));
+				break;
+		}
 	}
+
+	return TRUE;
 }
 
 static INLINE SSIZE_T progressive_process_tiles(
@@ -1686,13 +1682,11 @@ static INLINE SSIZE_T progressive_process_tiles(
     PROGRESSIVE_SURFACE_CONTEXT* WINPR_RESTRICT surface,
     const PROGRESSIVE_BLOCK_CONTEXT* WINPR_RESTRICT context)
 {
-	int status = 0;
 	size_t end = 0;
 	const size_t start = Stream_GetPosition(s);
 	UINT16 blockType = 0;
 	UINT32 blockLen = 0;
 	UINT32 count = 0;
-	UINT16 close_cnt = 0;
 
 	WINPR_ASSERT(progressive);
 	WINPR_ASSERT(region);
@@ -1774,58 +1768,13 @@ static INLINE SSIZE_T progressive_process_tiles(
 		return -1044;
 	}
 
-	for (UINT32 idx = 0; idx < region->numTiles; idx++)
-	{
-		RFX_PROGRESSIVE_TILE* tile = region->tiles[idx];
-		PROGRESSIVE_TILE_PROCESS_WORK_PARAM* param = &progressive->params[idx];
-		param->progressive = progressive;
-		param->region = region;
-		param->context = context;
-		param->tile = tile;
-
-		if (progressive->rfx_context->priv->UseThreads)
-		{
-			progressive->work_objects[idx] =
-			    CreateThreadpoolWork(progressive_process_tiles_tile_work_callback, (void*)param,
-			                         &progressive->rfx_context->priv->ThreadPoolEnv);
-			if (!progressive->work_objects[idx])
-			{
-				WLog_Print(progressive->log, WLOG_ERROR,
-				           "Failed to create ThreadpoolWork for tile %" PRIu32, idx);
-				status = -1;
-				break;
-			}
-
-			SubmitThreadpoolWork(progressive->work_objects[idx]);
-
-			close_cnt = WINPR_ASSERTING_INT_CAST(UINT16, idx + 1);
-		}
-		else
-		{
-			progressive_process_tiles_tile_work_callback(0, param, 0);
-		}
-
-		if (status < 0)
-		{
-			WLog_Print(progressive->log, WLOG_ERROR, "Failed to decompress %s at %" PRIu16,
-			           rfx_get_progressive_block_type_string(tile->blockType), idx);
-			goto fail;
-		}
-	}
-
-	if (progressive->rfx_context->priv->UseThreads)
+	PROGRESSIVE_TILE_PROCESS_WORK_PARAM param = { progressive, region, context };
+	if (!rfx_context_parallel_for(progressive->rfx_context->priv, region->numTiles, 0,
+	                              progressive_process_tiles_work, &param))
 	{
-		for (UINT32 idx = 0; idx < close_cnt; idx++)
-		{
-			WaitForThreadpoolWorkCallbacks(progressive->work_objects[idx], FALSE);
-			CloseThreadpoolWork(progressive->work_objects[idx]);
-		}
-	}
-
-fail:
-
-	if (status < 0)
+		WLog_Print(progressive->log, WLOG_ERROR, "Failed to decompress tiles");
 		return -1;
+	}
 
 	return (SSIZE_T)(end - start);
 }
@@ -2614,6 +2563,10 @@ BOOL progressive_context_reset(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive)
 	if (!progressive)
 		return FALSE;
 
+	/* the peer dropped its tiles, pending upgrades can not be applied anymore */
+	if (progressive->EncoderSurfaces)
+		HashTable_Clear(progressive->EncoderSurfaces);
+
 	return TRUE;
 }
 
@@ -2656,6 +2609,18 @@ PROGRESSIVE_CONTEXT* progressive_context_new_ex(BOOL Compressor, UINT32 Threadin
 		WINPR_ASSERT(obj);
 		obj->fnObjectFree = progressive_surface_context_free;
 	}
+
+	progressive->numPasses = 1;
+	if (Compressor)
+	{
+		progressive->EncoderSurfaces = HashTable_New(TRUE);
+		if (!progressive->EncoderSurfaces)
+			goto fail;
+
+		wObject* obj = HashTable_ValueObject(progressive->EncoderSurfaces);
+		WINPR_ASSERT(obj);
+		obj->fnObjectFree = progressive_encoder_surface_free;
+	}
 	return progressive;
 fail:
 	WINPR_PRAGMA_DIAG_PUSH
@@ -2676,6 +2641,7 @@ void progressive_context_free(PROGRESSIVE_CONTEXT* progressive)
 
 	BufferPool_Free(progressive->bufferPool);
 	HashTable_Free(progressive->SurfaceContexts);
+	HashTable_Free(progressive->EncoderSurfaces);
 
 	winpr_aligned_free(progressive);
 }
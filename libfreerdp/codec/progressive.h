@@ -148,7 +148,6 @@ typedef struct
 	PROGRESSIVE_CONTEXT* progressive;
 	PROGRESSIVE_BLOCK_REGION* region;
 	const PROGRESSIVE_BLOCK_CONTEXT* context;
-	RFX_PROGRESSIVE_TILE* tile;
 } PROGRESSIVE_TILE_PROCESS_WORK_PARAM;
 
 struct S_PROGRESSIVE_BLOCK_REGION
@@ -228,8 +227,27 @@ struct S_PROGRESSIVE_CONTEXT
 	wStream* buffer;
 	wStream* rects;
 	RFX_CONTEXT* rfx_context;
-	PROGRESSIVE_TILE_PROCESS_WORK_PARAM params[0x10000];
-	PTP_WORK work_objects[0x10000];
+
+	/* multi pass encoder state, see progressive_encode.c */
+	UINT32 numPasses;
+	UINT32 frameIndex;
+	wHashTable* EncoderSurfaces;
 };
 
+/* number of low and high pass coefficients per row of a reduce extrapolate DWT level */
+static INLINE size_t progressive_rfx_get_band_l_count(size_t level)
+{
+	return (64 >> level) + 1;
+}
+
+static INLINE size_t progressive_rfx_get_band_h_count(size_t level)
+{
+	if (level == 1)
+		return (64 >> 1) - 1;
+	else
+		return (64 + (1 << (level - 1))) >> level;
+}
+
+FREERDP_LOCAL void progressive_encoder_surface_free(void* ptr);
+
 #endif /* INTERNAL_CODEC_PROGRESSIVE_H */
@@ -0,0 +1,1040 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Progressive Codec Bitmap Compression - Multi Pass Encoder
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <stddef.h>
+
+#include <winpr/assert.h>
+#include <winpr/cast.h>
+#include <winpr/crt.h>
+#include <winpr/bitstream.h>
+#include <winpr/collections.h>
+
+#include <freerdp/codec/color.h>
+#include <freerdp/codec/progressive.h>
+#include <freerdp/codec/region.h>
+#include <freerdp/log.h>
+
+#include "rfx_differential.h"
+#include "rfx_constants.h"
+#include "rfx_types.h"
+#include "rfx_encode.h"
+#include "progressive.h"
+
+#define TAG FREERDP_TAG("codec.progressive")
+
+/* coarse quality levels sent before a tile reaches the region quantization */
+#define PROGRESSIVE_LEVEL_COUNT 3
+#define PROGRESSIVE_LEVEL_FULL PROGRESSIVE_LEVEL_COUNT
+#define PROGRESSIVE_MAX_PASSES (PROGRESSIVE_LEVEL_COUNT + 1)
+
+/* largest progressive quantization of the levels, bounds the bits a single upgrade adds */
+#define PROGRESSIVE_MAX_PROG_QUANT 5
+
+#define PROGRESSIVE_TILE_FIRST_HEADER_LENGTH 23
+#define PROGRESSIVE_TILE_UPGRADE_HEADER_LENGTH 26
+
+/* Per component output limits. A SRL coded coefficient takes at most the '1' bit,
+ * 10 bits of run length, the sign and its unary magnitude. */
+#define PROGRESSIVE_RLGR_LENGTH 4096
+#define PROGRESSIVE_SRL_LENGTH ((4096 * (12 + (1 << PROGRESSIVE_MAX_PROG_QUANT)) + 7) / 8)
+#define PROGRESSIVE_RAW_LENGTH ((4096 * PROGRESSIVE_MAX_PROG_QUANT + 7) / 8)
+
+typedef struct
+{
+	BYTE level;    /* quality level the peer has for the tile */
+	INT16* coeffs; /* Y, Cb and Cr DWT coefficients, kept while upgrades are pending */
+} PROGRESSIVE_ENCODER_TILE;
+
+typedef struct
+{
+	UINT32 width;
+	UINT32 height;
+	UINT32 gridWidth;
+	UINT32 gridHeight;
+	UINT32 gridSize;
+	UINT32 pending;
+	UINT32 cursor;
+	PROGRESSIVE_ENCODER_TILE* tiles;
+} PROGRESSIVE_ENCODER_SURFACE;
+
+typedef struct
+{
+	UINT32 index;
+	BYTE level;
+	BYTE* data;
+	size_t length;
+} PROGRESSIVE_ENCODER_JOB;
+
+typedef struct
+{
+	PROGRESSIVE_CONTEXT* progressive;
+	PROGRESSIVE_ENCODER_SURFACE* surface;
+	PROGRESSIVE_ENCODER_JOB* jobs;
+	const BYTE* pSrcData; /* NULL for upgrade passes */
+	UINT32 ScanLine;
+} PROGRESSIVE_ENCODER_WORK_PARAM;
+
+typedef struct
+{
+	size_t offset;
+	size_t length;
+	size_t quant;
+} PROGRESSIVE_ENCODER_BAND;
+
+typedef struct
+{
+	wBitStream* bs;
+	UINT32 kp;
+	UINT32 nz;
+} PROGRESSIVE_SRL_ENCODER;
+
+/* the RemoteFX default quantization in RFX_COMPONENT_CODEC_QUANT band order */
+static const RFX_COMPONENT_CODEC_QUANT progressive_encoder_quant = { 6, 6, 6, 6, 7, 7, 8, 8, 8, 9 };
+
+static const RFX_COMPONENT_CODEC_QUANT progressive_encoder_quant_full = { 0 };
+
+static const RFX_PROGRESSIVE_CODEC_QUANT progressive_encoder_levels[PROGRESSIVE_LEVEL_COUNT] = {
+	{ 25,
+	  { 2, 3, 3, 3, 4, 4, 4, 5, 5, 5 },
+	  { 2, 3, 3, 3, 4, 4, 4, 5, 5, 5 },
+	  { 2, 3, 3, 3, 4, 4, 4, 5, 5, 5 } },
+	{ 50,
+	  { 1, 2, 2, 2, 3, 3, 3, 3, 3, 3 },
+	  { 1, 2, 2, 2, 3, 3, 3, 3, 3, 3 },
+	  { 1, 2, 2, 2, 3, 3, 3, 3, 3, 3 } },
+	{ 75,
+	  { 0, 1, 1, 1, 1, 1, 1, 1, 1, 1 },
+	  { 0, 1, 1, 1, 1, 1, 1, 1, 1, 1 },
+	  { 0, 1, 1, 1, 1, 1, 1, 1, 1, 1 } }
+};
+
+/* reduce extrapolate band layout in the order the decoder reads upgrades, LL3 last */
+static const PROGRESSIVE_ENCODER_BAND progressive_encoder_bands[] = {
+	{ 0, 1023, offsetof(RFX_COMPONENT_CODEC_QUANT, HL1) },
+	{ 1023, 1023, offsetof(RFX_COMPONENT_CODEC_QUANT, LH1) },
+	{ 2046, 961, offsetof(RFX_COMPONENT_CODEC_QUANT, HH1) },
+	{ 3007, 272, offsetof(RFX_COMPONENT_CODEC_QUANT, HL2) },
+	{ 3279, 272, offsetof(RFX_COMPONENT_CODEC_QUANT, LH2) },
+	{ 3551, 256, offsetof(RFX_COMPONENT_CODEC_QUANT, HH2) },
+	{ 3807, 72, offsetof(RFX_COMPONENT_CODEC_QUANT, HL3) },
+	{ 3879, 72, offsetof(RFX_COMPONENT_CODEC_QUANT, LH3) },
+	{ 3951, 64, offsetof(RFX_COMPONENT_CODEC_QUANT, HH3) },
+	{ 4015, 81, offsetof(RFX_COMPONENT_CODEC_QUANT, LL3) }
+};
+
+static INLINE UINT32 progressive_encoder_band_quant(const RFX_COMPONENT_CODEC_QUANT* quant,
+                                                    const PROGRESSIVE_ENCODER_BAND* band)
+{
+	const BYTE* values = (const BYTE*)quant;
+	return values[band->quant];
+}
+
+static INLINE BOOL progressive_encoder_band_is_ll(const PROGRESSIVE_ENCODER_BAND* band)
+{
+	return band->quant == offsetof(RFX_COMPONENT_CODEC_QUANT, LL3);
+}
+
+static const RFX_COMPONENT_CODEC_QUANT* progressive_encoder_prog_quant(BYTE level,
+                                                                       size_t component)
+{
+	if (level >= PROGRESSIVE_LEVEL_FULL)
+		return &progressive_encoder_quant_full;
+
+	const RFX_PROGRESSIVE_CODEC_QUANT* quant = &progressive_encoder_levels[level];
+	switch (component)
+	{
+		case 0:
+			return &quant->yQuantValues;
+		case 1:
+			return &quant->cbQuantValues;
+		default:
+			return &quant->crQuantValues;
+	}
+}
+
+static INLINE BYTE progressive_encoder_quality(BYTE level)
+{
+	return (level >= PROGRESSIVE_LEVEL_FULL) ? 0xFF : level;
+}
+
+static INLINE BYTE progressive_encoder_first_level(const PROGRESSIVE_CONTEXT* progressive)
+{
+	return (progressive->numPasses > 1) ? 0 : PROGRESSIVE_LEVEL_FULL;
+}
+
+/* steps up the ladder, the last pass always lands on full quality */
+static INLINE BYTE progressive_encoder_next_level(const PROGRESSIVE_CONTEXT* progressive,
+                                                  BYTE level)
+{
+	if (level + 2u < progressive->numPasses)
+		return level + 1;
+	return PROGRESSIVE_LEVEL_FULL;
+}
+
+static INLINE void* progressive_encoder_surface_key(UINT16 surfaceId)
+{
+	return (void*)(((ULONG_PTR)surfaceId) + 1);
+}
+
+void progressive_encoder_surface_free(void* ptr)
+{
+	PROGRESSIVE_ENCODER_SURFACE* surface = ptr;
+	if (!surface)
+		return;
+
+	if (surface->tiles)
+	{
+		for (UINT32 index = 0; index < surface->gridSize; index++)
+			winpr_aligned_free(surface->tiles[index].coeffs);
+	}
+	free(surface->tiles);
+	free(surface);
+}
+
+static PROGRESSIVE_ENCODER_SURFACE* progressive_encoder_surface_new(UINT32 width, UINT32 height)
+{
+	PROGRESSIVE_ENCODER_SURFACE* surface = calloc(1, sizeof(PROGRESSIVE_ENCODER_SURFACE));
+	if (!surface)
+		return NULL;
+
+	surface->width = width;
+	surface->height = height;
+	surface->gridWidth = (width + 63) / 64;
+	surface->gridHeight = (height + 63) / 64;
+	surface->gridSize = surface->gridWidth * surface->gridHeight;
+	surface->tiles = calloc(surface->gridSize, sizeof(PROGRESSIVE_ENCODER_TILE));
+	if (!surface->tiles)
+	{
+		progressive_encoder_surface_free(surface);
+		return NULL;
+	}
+
+	for (UINT32 index = 0; index < surface->gridSize; index++)
+		surface->tiles[index].level = PROGRESSIVE_LEVEL_FULL;
+	return surface;
+}
+
+static PROGRESSIVE_ENCODER_SURFACE*
+progressive_encoder_get_surface(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive, UINT16 surfaceId,
+                                UINT32 width, UINT32 height)
+{
+	void* key = progressive_encoder_surface_key(surfaceId);
+	PROGRESSIVE_ENCODER_SURFACE* surface =
+	    HashTable_GetItemValue(progressive->EncoderSurfaces, key);
+
+	if (surface && (surface->width == width) && (surface->height == height))
+		return surface;
+
+	/* a resized surface starts over, the peer recreates its tiles as well */
+	HashTable_Remove(progressive->EncoderSurfaces, key);
+	surface = progressive_encoder_surface_new(width, height);
+	if (!surface)
+		return NULL;
+
+	if (!HashTable_Insert(progressive->EncoderSurfaces, key, surface))
+	{
+		progressive_encoder_surface_free(surface);
+		return NULL;
+	}
+	return surface;
+}
+
+static RECTANGLE_16 progressive_encoder_tile_rect(const PROGRESSIVE_ENCODER_SURFACE* surface,
+                                                  UINT32 index)
+{
+	const UINT32 x = (index % surface->gridWidth) * 64;
+	const UINT32 y = (index / surface->gridWidth) * 64;
+	const RECTANGLE_16 rect = { WINPR_ASSERTING_INT_CAST(UINT16, x),
+		                        WINPR_ASSERTING_INT_CAST(UINT16, y),
+		                        WINPR_ASSERTING_INT_CAST(UINT16, MIN(x + 64, surface->width)),
+		                        WINPR_ASSERTING_INT_CAST(UINT16, MIN(y + 64, surface->height)) };
+	return rect;
+}
+
+static BOOL progressive_encoder_tile_covered(const REGION16* region, const RECTANGLE_16* rect)
+{
+	UINT32 count = 0;
+	size_t area = 0;
+	REGION16 intersection = { 0 };
+
+	region16_init(&intersection);
+	if (region16_intersect_rect(&intersection, region, rect))
+	{
+		const RECTANGLE_16* rects = region16_rects(&intersection, &count);
+		for (UINT32 x = 0; x < count; x++)
+			area += 1ull * (rects[x].right - rects[x].left) * (rects[x].bottom - rects[x].top);
+	}
+	region16_uninit(&intersection);
+
+	return area == 1ull * (rect->right - rect->left) * (rect->bottom - rect->top);
+}
+
+/* only tiles waiting for upgrades keep their coefficients */
+static BOOL progressive_encoder_tile_update(PROGRESSIVE_ENCODER_SURFACE* surface,
+                                            PROGRESSIVE_ENCODER_TILE* tile, BYTE level)
+{
+	const BOOL wasPending = tile->level < PROGRESSIVE_LEVEL_FULL;
+	const BOOL pending = level < PROGRESSIVE_LEVEL_FULL;
+
+	if (pending && !tile->coeffs)
+	{
+		tile->coeffs = winpr_aligned_malloc(3ull * 4096ull * sizeof(INT16), 32);
+		if (!tile->coeffs)
+			return FALSE;
+	}
+	else if (!pending)
+	{
+		winpr_aligned_free(tile->coeffs);
+		tile->coeffs = NULL;
+	}
+
+	if (pending && !wasPending)
+		surface->pending++;
+	else if (!pending && wasPending)
+		surface->pending--;
+
+	tile->level = level;
+	return TRUE;
+}
+
+static INLINE INT16 progressive_rfx_dwt_clamp(INT32 value)
+{
+	if (value < INT16_MIN)
+		return INT16_MIN;
+	if (value > INT16_MAX)
+		return INT16_MAX;
+	return (INT16)value;
+}
+
+/**
+ * Forward transform of a row or column, mirrors progressive_rfx_idwt_x/y:
+ * the decoder rebuilds x[2n] = L[n] - (H[n - 1] + H[n]) / 2 and
+ * x[2n + 1] = (x[2n] + x[2n + 2]) / 2 + 2 * H[n], the last low pass
+ * coefficients extrapolate the end of the line.
+ */
+static INLINE void progressive_rfx_dwt(const INT16* pSrc, size_t nSrcStep, INT16* pLow,
+                                       size_t nLowStep, INT16* pHigh, size_t nHighStep,
+                                       size_t nLowCount, size_t nHighCount)
+{
+	for (size_t n = 0; n < nHighCount; n++)
+	{
+		const INT32 x0 = pSrc[(2 * n) * nSrcStep];
+		const INT32 x1 = pSrc[(2 * n + 1) * nSrcStep];
+		const INT32 x2 = pSrc[(2 * n + 2) * nSrcStep];
+		pHigh[n * nHighStep] = progressive_rfx_dwt_clamp((x1 - (x0 + x2) / 2) / 2);
+	}
+
+	for (size_t n = 0; n < nHighCount; n++)
+	{
+		const INT32 x0 = pSrc[(2 * n) * nSrcStep];
+		const INT32 h1 = pHigh[n * nHighStep];
+		const INT32 h0 = (n > 0) ? pHigh[(n - 1) * nHighStep] : h1;
+		pLow[n * nLowStep] = progressive_rfx_dwt_clamp(x0 + (h0 + h1) / 2);
+	}
+
+	const INT32 h = pHigh[(nHighCount - 1) * nHighStep];
+	const INT32 x0 = pSrc[(2 * nHighCount) * nSrcStep];
+
+	if (nLowCount > nHighCount + 1)
+	{
+		const INT32 x1 = pSrc[(2 * nHighCount + 1) * nSrcStep];
+		pLow[nHighCount * nLowStep] = progressive_rfx_dwt_clamp(x0 + h / 2);
+		pLow[(nHighCount + 1) * nLowStep] = progressive_rfx_dwt_clamp(2 * x1 - x0);
+	}
+	else
+		pLow[nHighCount * nLowStep] = progressive_rfx_dwt_clamp(x0 + h);
+}
+
+static void progressive_rfx_dwt_2d_encode_block(const INT16* src, size_t nSrcStep, INT16* band,
+                                                INT16* LL, size_t level,
+                                                INT16* WINPR_RESTRICT temp)
+{
+	const size_t nBandL = progressive_rfx_get_band_l_count(level);
+	const size_t nBandH = progressive_rfx_get_band_h_count(level);
+	const size_t nStep = nBandL + nBandH;
+
+	INT16* HL = &band[0];
+	INT16* LH = &HL[nBandH * nBandL];
+	INT16* HH = &LH[nBandL * nBandH];
+	INT16* L = &temp[0];
+	INT16* H = &temp[nBandL * nStep];
+
+	/* vertical (src -> L + H) */
+	for (size_t x = 0; x < nStep; x++)
+		progressive_rfx_dwt(&src[x], nSrcStep, &L[x], nStep, &H[x], nStep, nBandL, nBandH);
+
+	/* horizontal (L -> LL + HL, H -> LH + HH) */
+	for (size_t y = 0; y < nBandL; y++)
+		progressive_rfx_dwt(&L[y * nStep], 1, &LL[y * nBandL], 1, &HL[y * nBandH], 1, nBandL,
+		                    nBandH);
+
+	for (size_t y = 0; y < nBandH; y++)
+		progressive_rfx_dwt(&H[y * nStep], 1, &LH[y * nBandL], 1, &HH[y * nBandH], 1, nBandL,
+		                    nBandH);
+}
+
+/* transforms a 64x64 plane, the plane is reused for the intermediate LL bands */
+static void progressive_rfx_dwt_2d_encode(INT16* WINPR_RESTRICT data, INT16* WINPR_RESTRICT coeffs,
+                                          INT16* WINPR_RESTRICT temp)
+{
+	progressive_rfx_dwt_2d_encode_block(data, 64, &coeffs[0], data, 1, temp);
+	progressive_rfx_dwt_2d_encode_block(data, 33, &coeffs[3007], data, 2, temp);
+	progressive_rfx_dwt_2d_encode_block(data, 17, &coeffs[3807], &coeffs[4015], 3, temp);
+}
+
+/**
+ * Coefficients are rounded once to the full quality step and truncated for the coarser
+ * levels, so the passes of a tile add up to exactly what a single pass sends.
+ * LL3 is refined with unsigned raw bits and rounds down, the other bands keep the sign
+ * and round the magnitude.
+ */
+static INLINE INT32 progressive_encoder_quantize(INT16 value, UINT32 quant, UINT32 shift, BOOL ll)
+{
+	const INT32 half = 1 << (quant - 2);
+
+	if (ll)
+		return (value + half) >> shift;
+
+	const INT32 magnitude = (abs(value) + half) >> shift;
+	return (value < 0) ? -magnitude : magnitude;
+}
+
+static BOOL progressive_encode_first_component(RFX_CONTEXT* WINPR_RESTRICT rfx,
+                                               const INT16* WINPR_RESTRICT coeffs,
+                                               const RFX_COMPONENT_CODEC_QUANT* progQuant,
+                                               INT16* WINPR_RESTRICT buffer,
+                                               BYTE* WINPR_RESTRICT dst, UINT16* length)
+{
+	for (size_t x = 0; x < ARRAYSIZE(progressive_encoder_bands); x++)
+	{
+		const PROGRESSIVE_ENCODER_BAND* band = &progressive_encoder_bands[x];
+		const UINT32 quant = progressive_encoder_band_quant(&progressive_encoder_quant, band);
+		const UINT32 shift = quant + progressive_encoder_band_quant(progQuant, band) - 1;
+		const BOOL ll = progressive_encoder_band_is_ll(band);
+
+		for (size_t y = band->offset; y < band->offset + band->length; y++)
+			buffer[y] = WINPR_ASSERTING_INT_CAST(
+			    INT16, progressive_encoder_quantize(coeffs[y], quant, shift, ll));
+	}
+
+	rfx_differential_encode(&buffer[4015], 81);
+
+	/**
+	 * The RLGR encoder terminates a run of zeros reaching the end of the input with a value
+	 * of one. Stop at the last non zero coefficient instead, the decoder fills the rest of
+	 * the tile with zeros. An empty component still needs one (zero) byte.
+	 */
+	UINT32 count = 4096;
+	while ((count > 0) && (buffer[count - 1] == 0))
+		count--;
+
+	const int rc = rfx->rlgr_encode(RLGR1, buffer, count, dst, PROGRESSIVE_RLGR_LENGTH);
+	if ((rc < 0) || (rc > PROGRESSIVE_RLGR_LENGTH))
+		return FALSE;
+
+	*length = WINPR_ASSERTING_INT_CAST(UINT16, MAX(rc, 1));
+	return TRUE;
+}
+
+static INLINE void progressive_bits_write_zeros(wBitStream* bs, UINT32 count)
+{
+	while (count > 0)
+	{
+		const UINT32 bits = MIN(count, 16);
+		BitStream_Write_Bits(bs, 0, bits);
+		count -= bits;
+	}
+}
+
+/* the counterpart of progressive_rfx_srl_read */
+static INLINE void progressive_srl_write(PROGRESSIVE_SRL_ENCODER* WINPR_RESTRICT srl, INT32 value,
+                                         UINT32 numBits)
+{
+	const UINT32 k = srl->kp / 8;
+
+	if (value == 0)
+	{
+		/* a full run of 1 << k zeros is a single '0' bit */
+		if (++srl->nz == (1u << k))
+		{
+			BitStream_Write_Bits(srl->bs, 0, 1);
+			srl->nz = 0;
+			srl->kp = MIN(srl->kp + 4, 80);
+		}
+		return;
+	}
+
+	/* '1' bit, the length of the shorter run, the sign and the magnitude in unary */
+	BitStream_Write_Bits(srl->bs, 1, 1);
+	if (k)
+		BitStream_Write_Bits(srl->bs, srl->nz, k);
+	srl->nz = 0;
+
+	BitStream_Write_Bits(srl->bs, (value < 0) ? 1 : 0, 1);
+	srl->kp = (srl->kp < 6) ? 0 : srl->kp - 6;
+
+	if (numBits == 1)
+		return;
+
+	const UINT32 magnitude = WINPR_ASSERTING_INT_CAST(UINT32, abs(value));
+	const UINT32 max = (1u << numBits) - 1;
+	progressive_bits_write_zeros(srl->bs, magnitude - 1);
+	if (magnitude < max)
+		BitStream_Write_Bits(srl->bs, 1, 1);
+}
+
+static INLINE void progressive_srl_finish(PROGRESSIVE_SRL_ENCODER* WINPR_RESTRICT srl)
+{
+	/* the decoder stops reading inside the trailing run */
+	if (srl->nz)
+		BitStream_Write_Bits(srl->bs, 0, 1);
+}
+
+static INLINE BOOL progressive_bits_finish(wBitStream* bs, size_t capacity, UINT16* length)
+{
+	BitStream_Flush(bs);
+
+	const size_t used = (bs->position + 7) / 8;
+	if (used > capacity)
+		return FALSE;
+
+	*length = WINPR_ASSERTING_INT_CAST(UINT16, used);
+	return TRUE;
+}
+
+static BOOL progressive_encode_upgrade_component(const INT16* WINPR_RESTRICT coeffs,
+                                                 const RFX_COMPONENT_CODEC_QUANT* progQuantOld,
+                                                 const RFX_COMPONENT_CODEC_QUANT* progQuantNew,
+                                                 BYTE* WINPR_RESTRICT srlData, UINT16* srlLen,
+                                                 BYTE* WINPR_RESTRICT rawData, UINT16* rawLen)
+{
+	wBitStream s_srl = { 0 };
+	wBitStream s_raw = { 0 };
+	PROGRESSIVE_SRL_ENCODER srl = { &s_srl, 8, 0 };
+
+	BitStream_Attach(&s_srl, srlData, PROGRESSIVE_SRL_LENGTH);
+	BitStream_Attach(&s_raw, rawData, PROGRESSIVE_RAW_LENGTH);
+
+	for (size_t x = 0; x < ARRAYSIZE(progressive_encoder_bands); x++)
+	{
+		const PROGRESSIVE_ENCODER_BAND* band = &progressive_encoder_bands[x];
+		const UINT32 quant = progressive_encoder_band_quant(&progressive_encoder_quant, band);
+		const UINT32 oldQuant = progressive_encoder_band_quant(progQuantOld, band);
+		const UINT32 newQuant = progressive_encoder_band_quant(progQuantNew, band);
+
+		WINPR_ASSERT(oldQuant >= newQuant);
+		const UINT32 numBits = oldQuant - newQuant;
+		if (numBits == 0)
+			continue;
+
+		const UINT32 oldShift = quant + oldQuant - 1;
+		const UINT32 newShift = quant + newQuant - 1;
+		const UINT32 mask = (1u << numBits) - 1;
+
+		for (size_t y = band->offset; y < band->offset + band->length; y++)
+		{
+			if (progressive_encoder_band_is_ll(band))
+			{
+				const INT32 value = progressive_encoder_quantize(coeffs[y], quant, newShift, TRUE);
+				BitStream_Write_Bits(&s_raw, (UINT32)value & mask, numBits);
+				continue;
+			}
+
+			/* coefficients significant in the previous pass are refined from the raw stream */
+			const INT32 value = progressive_encoder_quantize(coeffs[y], quant, newShift, FALSE);
+			if (progressive_encoder_quantize(coeffs[y], quant, oldShift, FALSE) != 0)
+				BitStream_Write_Bits(&s_raw, (UINT32)abs(value) & mask, numBits);
+			else
+				progressive_srl_write(&srl, value, numBits);
+		}
+	}
+
+	progressive_srl_finish(&srl);
+	if (!progressive_bits_finish(&s_srl, PROGRESSIVE_SRL_LENGTH, srlLen))
+		return FALSE;
+	return progressive_bits_finish(&s_raw, PROGRESSIVE_RAW_LENGTH, rawLen);
+}
+
+static BOOL progressive_encode_tile_first(PROGRESSIVE_ENCODER_WORK_PARAM* WINPR_RESTRICT param,
+                                          PROGRESSIVE_ENCODER_JOB* WINPR_RESTRICT job)
+{
+	BOOL rc = FALSE;
+	PROGRESSIVE_CONTEXT* progressive = param->progressive;
+	const PROGRESSIVE_ENCODER_SURFACE* surface = param->surface;
+	const PROGRESSIVE_ENCODER_TILE* tile = &surface->tiles[job->index];
+	RFX_CONTEXT* rfx = progressive->rfx_context;
+	const RECTANGLE_16 rect = progressive_encoder_tile_rect(surface, job->index);
+	const size_t bpp = FreeRDPGetBytesPerPixel(rfx->pixel_format);
+	const BYTE* src = &param->pSrcData[1ull * rect.top * param->ScanLine + bpp * rect.left];
+
+	BYTE* pBuffer = BufferPool_Take(progressive->bufferPool, -1);
+	INT16* temp = BufferPool_Take(progressive->bufferPool, -1);
+	INT16* pool = NULL;
+	INT16* coeffs = tile->coeffs;
+	if (!coeffs)
+		coeffs = pool = BufferPool_Take(progressive->bufferPool, -1);
+
+	/* the RLGR encoder expects zeroed output */
+	job->data = calloc(1, PROGRESSIVE_TILE_FIRST_HEADER_LENGTH + 3ull * PROGRESSIVE_RLGR_LENGTH);
+	if (!pBuffer || !temp || !coeffs || !job->data)
+		goto fail;
+
+	INT16* pSrcDst[3] = { (INT16*)&pBuffer[((8192ULL + 32ULL) * 0ULL) + 16ULL],
+		                  (INT16*)&pBuffer[((8192ULL + 32ULL) * 1ULL) + 16ULL],
+		                  (INT16*)&pBuffer[((8192ULL + 32ULL) * 2ULL) + 16ULL] };
+	rfx_encode_ycbcr(rfx, src, rect.right - rect.left, rect.bottom - rect.top, param->ScanLine,
+	                 pSrcDst);
+
+	UINT16 lengths[3] = { 0 };
+	size_t offset = PROGRESSIVE_TILE_FIRST_HEADER_LENGTH;
+	for (size_t x = 0; x < ARRAYSIZE(pSrcDst); x++)
+	{
+		INT16* component = &coeffs[4096 * x];
+		progressive_rfx_dwt_2d_encode(pSrcDst[x], component, temp);
+		if (!progressive_encode_first_component(rfx, component,
+		                                        progressive_encoder_prog_quant(job->level, x), temp,
+		                                        &job->data[offset], &lengths[x]))
+			goto fail;
+		offset += lengths[x];
+	}
+
+	const BYTE quality = progressive_encoder_quality(job->level);
+	wStream sbuffer = { 0 };
+	wStream* s = Stream_StaticInit(&sbuffer, job->data, PROGRESSIVE_TILE_FIRST_HEADER_LENGTH);
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_TILE_FIRST); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, (UINT32)offset);             /* blockLen (4 bytes) */
+	Stream_Write_UINT8(s, 0);                           /* quantIdxY (1 byte) */
+	Stream_Write_UINT8(s, 0);                           /* quantIdxCb (1 byte) */
+	Stream_Write_UINT8(s, 0);                           /* quantIdxCr (1 byte) */
+	Stream_Write_UINT16(s, rect.left / 64);             /* xIdx (2 bytes) */
+	Stream_Write_UINT16(s, rect.top / 64);              /* yIdx (2 bytes) */
+	Stream_Write_UINT8(s, 0);                           /* flags (1 byte) */
+	Stream_Write_UINT8(s, quality);                     /* quality (1 byte) */
+	Stream_Write_UINT16(s, lengths[0]);                 /* yLen (2 bytes) */
+	Stream_Write_UINT16(s, lengths[1]);                 /* cbLen (2 bytes) */
+	Stream_Write_UINT16(s, lengths[2]);                 /* crLen (2 bytes) */
+	Stream_Write_UINT16(s, 0);                          /* tailLen (2 bytes) */
+	job->length = offset;
+	rc = TRUE;
+fail:
+	if (pool)
+		BufferPool_Return(progressive->bufferPool, pool);
+	if (temp)
+		BufferPool_Return(progressive->bufferPool, temp);
+	if (pBuffer)
+		BufferPool_Return(progressive->bufferPool, pBuffer);
+	return rc;
+}
+
+static BOOL progressive_encode_tile_upgrade(PROGRESSIVE_ENCODER_WORK_PARAM* WINPR_RESTRICT param,
+                                            PROGRESSIVE_ENCODER_JOB* WINPR_RESTRICT job)
+{
+	BOOL rc = FALSE;
+	PROGRESSIVE_CONTEXT* progressive = param->progressive;
+	const PROGRESSIVE_ENCODER_SURFACE* surface = param->surface;
+	const PROGRESSIVE_ENCODER_TILE* tile = &surface->tiles[job->index];
+	const RECTANGLE_16 rect = progressive_encoder_tile_rect(surface, job->index);
+
+	WINPR_ASSERT(tile->coeffs);
+
+	BYTE* raw = BufferPool_Take(progressive->bufferPool, -1);
+	job->data = malloc(PROGRESSIVE_TILE_UPGRADE_HEADER_LENGTH +
+	                   3ull * (PROGRESSIVE_SRL_LENGTH + PROGRESSIVE_RAW_LENGTH));
+	if (!raw || !job->data)
+		goto fail;
+
+	UINT16 srlLen[3] = { 0 };
+	UINT16 rawLen[3] = { 0 };
+	size_t offset = PROGRESSIVE_TILE_UPGRADE_HEADER_LENGTH;
+	for (size_t x = 0; x < ARRAYSIZE(srlLen); x++)
+	{
+		if (!progressive_encode_upgrade_component(
+		        &tile->coeffs[4096 * x], progressive_encoder_prog_quant(tile->level, x),
+		        progressive_encoder_prog_quant(job->level, x), &job->data[offset], &srlLen[x], raw,
+		        &rawLen[x]))
+			goto fail;
+
+		offset += srlLen[x];
+		CopyMemory(&job->data[offset], raw, rawLen[x]);
+		offset += rawLen[x];
+	}
+
+	const BYTE quality = progressive_encoder_quality(job->level);
+	wStream sbuffer = { 0 };
+	wStream* s = Stream_StaticInit(&sbuffer, job->data, PROGRESSIVE_TILE_UPGRADE_HEADER_LENGTH);
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_TILE_UPGRADE); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, (UINT32)offset);               /* blockLen (4 bytes) */
+	Stream_Write_UINT8(s, 0);                             /* quantIdxY (1 byte) */
+	Stream_Write_UINT8(s, 0);                             /* quantIdxCb (1 byte) */
+	Stream_Write_UINT8(s, 0);                             /* quantIdxCr (1 byte) */
+	Stream_Write_UINT16(s, rect.left / 64);               /* xIdx (2 bytes) */
+	Stream_Write_UINT16(s, rect.top / 64);                /* yIdx (2 bytes) */
+	Stream_Write_UINT8(s, quality);                       /* quality (1 byte) */
+	Stream_Write_UINT16(s, srlLen[0]);                    /* ySrlLen (2 bytes) */
+	Stream_Write_UINT16(s, rawLen[0]);                    /* yRawLen (2 bytes) */
+	Stream_Write_UINT16(s, srlLen[1]);                    /* cbSrlLen (2 bytes) */
+	Stream_Write_UINT16(s, rawLen[1]);                    /* cbRawLen (2 bytes) */
+	Stream_Write_UINT16(s, srlLen[2]);                    /* crSrlLen (2 bytes) */
+	Stream_Write_UINT16(s, rawLen[2]);                    /* crRawLen (2 bytes) */
+	job->length = offset;
+	rc = TRUE;
+fail:
+	if (raw)
+		BufferPool_Return(progressive->bufferPool, raw);
+	return rc;
+}
+
+static BOOL progressive_encode_tiles_work(void* arg, size_t first, size_t last)
+{
+	PROGRESSIVE_ENCODER_WORK_PARAM* param = arg;
+
+	WINPR_ASSERT(param);
+	WINPR_ASSERT(param->jobs);
+
+	for (size_t idx = first; idx < last; idx++)
+	{
+		PROGRESSIVE_ENCODER_JOB* job = &param->jobs[idx];
+		const BOOL rc = param->pSrcData ? progressive_encode_tile_first(param, job)
+		                                : progressive_encode_tile_upgrade(param, job);
+		if (!rc)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void progressive_encoder_jobs_free(PROGRESSIVE_ENCODER_JOB* jobs, size_t count)
+{
+	if (!jobs)
+		return;
+
+	for (size_t x = 0; x < count; x++)
+		free(jobs[x].data);
+	free(jobs);
+}
+
+static void progressive_component_codec_quant_write(wStream* WINPR_RESTRICT s,
+                                                    const RFX_COMPONENT_CODEC_QUANT* quant)
+{
+	Stream_Write_UINT8(s, (UINT8)(quant->LL3 | (quant->HL3 << 4))); /* LL3, HL3 (4 bits each) */
+	Stream_Write_UINT8(s, (UINT8)(quant->LH3 | (quant->HH3 << 4))); /* LH3, HH3 (4 bits each) */
+	Stream_Write_UINT8(s, (UINT8)(quant->HL2 | (quant->LH2 << 4))); /* HL2, LH2 (4 bits each) */
+	Stream_Write_UINT8(s, (UINT8)(quant->HH2 | (quant->HL1 << 4))); /* HH2, HL1 (4 bits each) */
+	Stream_Write_UINT8(s, (UINT8)(quant->LH1 | (quant->HH1 << 4))); /* LH1, HH1 (4 bits each) */
+}
+
+static BOOL progressive_encoder_write_message(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
+                                              const REGION16* WINPR_RESTRICT region,
+                                              const PROGRESSIVE_ENCODER_JOB* WINPR_RESTRICT jobs,
+                                              size_t count, BYTE** WINPR_RESTRICT ppDstData,
+                                              UINT32* WINPR_RESTRICT pDstSize)
+{
+	UINT32 numRects = 0;
+	const RECTANGLE_16* rects = region16_rects(region, &numRects);
+
+	size_t tilesDataSize = 0;
+	for (size_t x = 0; x < count; x++)
+		tilesDataSize += jobs[x].length;
+
+	const size_t blockLen =
+	    18ull + 8ull * numRects + 5ull + 16ull * PROGRESSIVE_LEVEL_COUNT + tilesDataSize;
+	if ((numRects == 0) || (numRects > UINT16_MAX) || (count > UINT16_MAX) ||
+	    (blockLen > UINT32_MAX - 40))
+		return FALSE;
+
+	wStream* s = progressive->buffer;
+	Stream_SetPosition(s, 0);
+	if (!Stream_EnsureRemainingCapacity(s, 12ull + 10ull + 12ull + blockLen + 6ull))
+		return FALSE;
+
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_SYNC); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, 12);                   /* blockLen (4 bytes) */
+	Stream_Write_UINT32(s, 0xCACCACCA);           /* magic (4 bytes) */
+	Stream_Write_UINT16(s, 0x0100);               /* version (2 bytes) */
+
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_CONTEXT); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, 10);                      /* blockLen (4 bytes) */
+	Stream_Write_UINT8(s, 0);                        /* ctxId (1 byte) */
+	Stream_Write_UINT16(s, 64);                      /* tileSize (2 bytes) */
+	Stream_Write_UINT8(s, RFX_SUBBAND_DIFFING);      /* flags (1 byte) */
+
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_FRAME_BEGIN); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, 12);                          /* blockLen (4 bytes) */
+	Stream_Write_UINT32(s, progressive->frameIndex++);   /* frameIndex (4 bytes) */
+	Stream_Write_UINT16(s, 1);                           /* regionCount (2 bytes) */
+
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_REGION);    /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, (UINT32)blockLen);          /* blockLen (4 bytes) */
+	Stream_Write_UINT8(s, 64);                         /* tileSize (1 byte) */
+	Stream_Write_UINT16(s, (UINT16)numRects);          /* numRects (2 bytes) */
+	Stream_Write_UINT8(s, 1);                          /* numQuant (1 byte) */
+	Stream_Write_UINT8(s, PROGRESSIVE_LEVEL_COUNT);    /* numProgQuant (1 byte) */
+	Stream_Write_UINT8(s, RFX_DWT_REDUCE_EXTRAPOLATE); /* flags (1 byte) */
+	Stream_Write_UINT16(s, (UINT16)count);             /* numTiles (2 bytes) */
+	Stream_Write_UINT32(s, (UINT32)tilesDataSize);     /* tilesDataSize (4 bytes) */
+
+	for (UINT32 x = 0; x < numRects; x++)
+	{
+		/* TS_RFX_RECT */
+		const RECTANGLE_16* r = &rects[x];
+		Stream_Write_UINT16(s, r->left);            /* x (2 bytes) */
+		Stream_Write_UINT16(s, r->top);             /* y (2 bytes) */
+		Stream_Write_UINT16(s, r->right - r->left); /* width (2 bytes) */
+		Stream_Write_UINT16(s, r->bottom - r->top); /* height (2 bytes) */
+	}
+
+	progressive_component_codec_quant_write(s, &progressive_encoder_quant);
+
+	for (size_t x = 0; x < ARRAYSIZE(progressive_encoder_levels); x++)
+	{
+		const RFX_PROGRESSIVE_CODEC_QUANT* level = &progressive_encoder_levels[x];
+		Stream_Write_UINT8(s, level->quality); /* quality (1 byte) */
+		progressive_component_codec_quant_write(s, &level->yQuantValues);
+		progressive_component_codec_quant_write(s, &level->cbQuantValues);
+		progressive_component_codec_quant_write(s, &level->crQuantValues);
+	}
+
+	for (size_t x = 0; x < count; x++)
+		Stream_Write(s, jobs[x].data, jobs[x].length);
+
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_FRAME_END); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, 6);                         /* blockLen (4 bytes) */
+
+	const size_t pos = Stream_GetPosition(s);
+	WINPR_ASSERT(pos <= UINT32_MAX);
+	*pDstSize = (UINT32)pos;
+	*ppDstData = Stream_Buffer(s);
+	return TRUE;
+}
+
+BOOL progressive_context_set_passes(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive, UINT32 passes)
+{
+	if (!progressive || (passes < 1) || (passes > PROGRESSIVE_MAX_PASSES))
+		return FALSE;
+
+	progressive->numPasses = passes;
+	return TRUE;
+}
+
+int progressive_compress_surface(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive, UINT16 surfaceId,
+                                 const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize,
+                                 UINT32 SrcFormat, UINT32 Width, UINT32 Height, UINT32 ScanLine,
+                                 const REGION16* WINPR_RESTRICT invalidRegion,
+                                 BYTE** WINPR_RESTRICT ppDstData, UINT32* WINPR_RESTRICT pDstSize)
+{
+	int res = -1;
+	size_t count = 0;
+	REGION16 region = { 0 };
+	PROGRESSIVE_ENCODER_JOB* jobs = NULL;
+
+	if (!progressive || !progressive->EncoderSurfaces || !pSrcData || !ppDstData || !pDstSize)
+		return -1;
+
+	if ((Width == 0) || (Height == 0) || (Width > UINT16_MAX) || (Height > UINT16_MAX))
+		return -1;
+
+	if (ScanLine == 0)
+		ScanLine = Width * FreeRDPGetBytesPerPixel(SrcFormat);
+
+	if ((ScanLine == 0) || (SrcSize < 1ull * Height * ScanLine))
+		return -4;
+
+	PROGRESSIVE_ENCODER_SURFACE* surface =
+	    progressive_encoder_get_surface(progressive, surfaceId, Width, Height);
+	if (!surface)
+		return -5;
+
+	const RECTANGLE_16 bounds = { 0, 0, WINPR_ASSERTING_INT_CAST(UINT16, Width),
+		                          WINPR_ASSERTING_INT_CAST(UINT16, Height) };
+	region16_init(&region);
+	if (invalidRegion)
+	{
+		if (!region16_intersect_rect(&region, invalidRegion, &bounds))
+			goto fail;
+	}
+	else if (!region16_union_rect(&region, &region, &bounds))
+		goto fail;
+
+	if (region16_is_empty(&region))
+	{
+		res = 0;
+		goto fail;
+	}
+
+	jobs = calloc(surface->gridSize, sizeof(PROGRESSIVE_ENCODER_JOB));
+	if (!jobs)
+		goto fail;
+
+	for (UINT32 index = 0; index < surface->gridSize; index++)
+	{
+		PROGRESSIVE_ENCODER_TILE* tile = &surface->tiles[index];
+		const RECTANGLE_16 rect = progressive_encoder_tile_rect(surface, index);
+		if (!region16_intersects_rect(&region, &rect))
+			continue;
+
+		/* the upgrades repaint the whole tile, a partially updated tile must not lose
+		 * the quality the peer already shows outside the invalid region */
+		BYTE level = progressive_encoder_first_level(progressive);
+		if (!progressive_encoder_tile_covered(&region, &rect))
+			level = MAX(level, tile->level);
+
+		if (!progressive_encoder_tile_update(surface, tile, level))
+			goto fail;
+
+		jobs[count].index = index;
+		jobs[count].level = level;
+		count++;
+	}
+
+	rfx_context_set_pixel_format(progressive->rfx_context, SrcFormat);
+
+	PROGRESSIVE_ENCODER_WORK_PARAM param = { progressive, surface, jobs, pSrcData, ScanLine };
+	if (!rfx_context_parallel_for(progressive->rfx_context->priv, count, 0,
+	                              progressive_encode_tiles_work, &param))
+	{
+		WLog_Print(progressive->log, WLOG_ERROR, "Failed to compress tiles");
+		goto fail;
+	}
+
+	if (!progressive_encoder_write_message(progressive, &region, jobs, count, ppDstData,
+	                                       pDstSize))
+		goto fail;
+
+	res = 1;
+fail:
+	/* the tile state no longer matches what the peer has */
+	if (res < 0)
+		HashTable_Remove(progressive->EncoderSurfaces, progressive_encoder_surface_key(surfaceId));
+	progressive_encoder_jobs_free(jobs, count);
+	region16_uninit(&region);
+	return res;
+}
+
+int progressive_compress_upgrade(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
+                                 UINT16 surfaceId, UINT32 maxTiles,
+                                 BYTE** WINPR_RESTRICT ppDstData, UINT32* WINPR_RESTRICT pDstSize)
+{
+	int res = -1;
+	size_t count = 0;
+	REGION16 region = { 0 };
+	PROGRESSIVE_ENCODER_JOB* jobs = NULL;
+
+	if (!progressive || !progressive->EncoderSurfaces || !ppDstData || !pDstSize)
+		return -1;
+
+	PROGRESSIVE_ENCODER_SURFACE* surface = HashTable_GetItemValue(
+	    progressive->EncoderSurfaces, progressive_encoder_surface_key(surfaceId));
+	if (!surface || (surface->pending == 0))
+		return 0;
+
+	/* the coarsest tiles go first so the quality evens out over the surface */
+	BYTE level = PROGRESSIVE_LEVEL_FULL;
+	for (UINT32 index = 0; index < surface->gridSize; index++)
+		level = MIN(level, surface->tiles[index].level);
+
+	if ((maxTiles == 0) || (maxTiles > surface->pending))
+		maxTiles = surface->pending;
+
+	region16_init(&region);
+	jobs = calloc(maxTiles, sizeof(PROGRESSIVE_ENCODER_JOB));
+	if (!jobs)
+		goto fail;
+
+	for (UINT32 x = 0; (x < surface->gridSize) && (count < maxTiles); x++)
+	{
+		const UINT32 index = (surface->cursor + x) % surface->gridSize;
+		if (surface->tiles[index].level != level)
+			continue;
+
+		const RECTANGLE_16 rect = progressive_encoder_tile_rect(surface, index);
+		if (!region16_union_rect(&region, &region, &rect))
+			goto fail;
+
+		jobs[count].index = index;
+		jobs[count].level = progressive_encoder_next_level(progressive, level);
+		count++;
+	}
+
+	WINPR_ASSERT(count > 0);
+
+	PROGRESSIVE_ENCODER_WORK_PARAM param = { progressive, surface, jobs, NULL, 0 };
+	if (!rfx_context_parallel_for(progressive->rfx_context->priv, count, 0,
+	                              progressive_encode_tiles_work, &param))
+	{
+		WLog_Print(progressive->log, WLOG_ERROR, "Failed to compress tile upgrades");
+		goto fail;
+	}
+
+	if (!progressive_encoder_write_message(progressive, &region, jobs, count, ppDstData,
+	                                       pDstSize))
+		goto fail;
+
+	for (size_t x = 0; x < count; x++)
+	{
+		if (!progressive_encoder_tile_update(surface, &surface->tiles[jobs[x].index],
+		                                     jobs[x].level))
+			goto fail;
+	}
+
+	surface->cursor = (jobs[count - 1].index + 1) % surface->gridSize;
+	res = 1;
+fail:
+	progressive_encoder_jobs_free(jobs, count);
+	region16_uninit(&region);
+	return res;
+}
+
+UINT32 progressive_get_pending_upgrades(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
+                                        UINT16 surfaceId)
+{
+	if (!progressive || !progressive->EncoderSurfaces)
+		return 0;
+
+	const PROGRESSIVE_ENCODER_SURFACE* surface = HashTable_GetItemValue(
+	    progressive->EncoderSurfaces, progressive_encoder_surface_key(surfaceId));
+	return surface ? surface->pending : 0;
+}
+
+BOOL progressive_get_pending_region(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
+                                    UINT16 surfaceId, REGION16* WINPR_RESTRICT region)
+{
+	if (!progressive || !region)
+		return FALSE;
+
+	if (!progressive->EncoderSurfaces)
+		return TRUE;
+
+	const PROGRESSIVE_ENCODER_SURFACE* surface = HashTable_GetItemValue(
+	    progressive->EncoderSurfaces, progressive_encoder_surface_key(surfaceId));
+
+	if (!surface || (surface->pending == 0))
+		return TRUE;
+
+	for (UINT32 index = 0; index < surface->gridSize; index++)
+	{
+		if (surface->tiles[index].level >= PROGRESSIVE_LEVEL_FULL)
+			continue;
+
+		const RECTANGLE_16 rect = progressive_encoder_tile_rect(surface, index);
+		if (!region16_union_rect(region, region, &rect))
+			return FALSE;
+	}
+
+	return TRUE;
+}
@@ -494,6 +494,60 @@ static BOOL region16_simplify_bands(REGION16* region)
 	return TRUE;
 }
 
+BOOL region16_set_banded_rects(REGION16* dst, const RECTANGLE_16* rects, UINT32 nbRects)
+{
+	RECTANGLE_16 extents = { 0 };
+
+	WINPR_ASSERT(dst);
+	WINPR_ASSERT(dst->data);
+
+	if (nbRects == 0)
+	{
+		region16_clear(dst);
+		return TRUE;
+	}
+
+	if (!rects)
+		return FALSE;
+
+	extents = rects[0];
+
+	for (UINT32 i = 1; i < nbRects; i++)
+	{
+		const RECTANGLE_16* prev = &rects[i - 1];
+		const RECTANGLE_16* rect = &rects[i];
+
+		if (rectangle_is_empty(rect))
+			return FALSE;
+
+		if (rect->top == prev->top)
+		{
+			if ((rect->bottom != prev->bottom) || (rect->left <= prev->right))
+				return FALSE;
+		}
+		else if (rect->top < prev->bottom)
+			return FALSE;
+
+		extents.left = MIN(extents.left, rect->left);
+		extents.right = MAX(extents.right, rect->right);
+		extents.bottom = rect->bottom;
+	}
+
+	if (rectangle_is_empty(&rects[0]))
+		return FALSE;
+
+	REGION16_DATA* data = allocateRegion(nbRects);
+
+	if (!data)
+		return FALSE;
+
+	CopyMemory(&data[1], rects, sizeof(RECTANGLE_16) * nbRects);
+	region16_clear(dst);
+	dst->data = data;
+	dst->extents = extents;
+	return region16_simplify_bands(dst);
+}
+
 BOOL region16_union_rect(REGION16* dst, const REGION16* src, const RECTANGLE_16* rect)
 {
 	const RECTANGLE_16* srcExtents = NULL;
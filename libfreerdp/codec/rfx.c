@@ -49,6 +49,7 @@
 #include "rfx_rlgr.h"
 
 #include "sse/rfx_sse2.h"
+#include "sse/rfx_avx2.h"
 #include "neon/rfx_neon.h"
 
 #define TAG FREERDP_TAG("codec")
@@ -190,7 +191,7 @@ static INLINE void rfx_decoder_tile_free(void* obj)
 static INLINE void* rfx_encoder_tile_new(const void* val)
 {
 	WINPR_UNUSED(val);
-	return winpr_aligned_calloc(1, sizeof(RFX_TILE), 32);
+	return winpr_aligned_calloc(1, sizeof(RFX_ENCODER_TILE), 32);
 }
 
 static INLINE void rfx_encoder_tile_free(void* obj)
@@ -318,6 +319,10 @@ RFX_CONTEXT* rfx_context_new_ex(BOOL encoder, UINT32 ThreadingFlags)
 
 		if (priv->MaxThreadCount)
 			SetThreadpoolThreadMaximum(priv->ThreadPool, priv->MaxThreadCount);
+
+		priv->ParallelFor = winpr_ParallelFor_New(&priv->ThreadPoolEnv);
+		if (!priv->ParallelFor)
+			goto fail;
 	}
 
 	/* initialize the default pixel format */
@@ -332,7 +337,11 @@ RFX_CONTEXT* rfx_context_new_ex(BOOL encoder, UINT32 ThreadingFlags)
 	context->dwt_2d_encode = rfx_dwt_2d_encode;
 	context->rlgr_decode = rfx_rlgr_decode;
 	context->rlgr_encode = rfx_rlgr_encode;
+	context->encode_format_rgb = rfx_encode_format_rgb;
 	rfx_init_sse2(context);
+#if defined(WITH_AVX2)
+	rfx_init_avx2(context);
+#endif
 	rfx_init_neon(context);
 	context->state = RFX_STATE_SEND_HEADERS;
 	context->expectedDataBlockType = WBT_FRAME_BEGIN;
@@ -370,11 +379,10 @@ void rfx_context_free(RFX_CONTEXT* context)
 		ObjectPool_Free(priv->TilePool);
 		if (priv->UseThreads)
 		{
+			winpr_ParallelFor_Free(priv->ParallelFor);
 			if (priv->ThreadPool)
 				CloseThreadpool(priv->ThreadPool);
 			DestroyThreadpoolEnvironment(&priv->ThreadPoolEnv);
-			winpr_aligned_free((void*)priv->workObjects);
-			winpr_aligned_free(priv->tileWorkParams);
 #ifdef WITH_PROFILER
 			WLog_VRB(
 			    TAG,
@@ -382,6 +390,7 @@ void rfx_context_free(RFX_CONTEXT* context)
 #endif
 		}
 
+		rfx_tile_cache_free(priv->TileCache);
 		BufferPool_Free(priv->BufferPool);
 		winpr_aligned_free(priv);
 	}
@@ -432,6 +441,7 @@ void rfx_context_set_palette(RFX_CONTEXT* WINPR_RESTRICT context,
 {
 	WINPR_ASSERT(context);
 	context->palette = palette;
+	rfx_tile_cache_clear(context->priv->TileCache);
 }
 
 const BYTE* rfx_context_get_palette(RFX_CONTEXT* WINPR_RESTRICT context)
@@ -798,16 +808,26 @@ static INLINE BOOL rfx_process_message_region(RFX_CONTEXT* WINPR_RESTRICT contex
 
 typedef struct
 {
-	RFX_TILE* tile;
 	RFX_CONTEXT* context;
+	RFX_MESSAGE* message;
 } RFX_TILE_PROCESS_WORK_PARAM;
 
-static INLINE void CALLBACK rfx_process_message_tile_work_callback(PTP_CALLBACK_INSTANCE instance,
-                                                                   void* context, PTP_WORK work)
+static BOOL rfx_process_message_tiles(void* arg, size_t first, size_t last)
 {
-	RFX_TILE_PROCESS_WORK_PARAM* param = (RFX_TILE_PROCESS_WORK_PARAM*)context;
+	RFX_TILE_PROCESS_WORK_PARAM* param = (RFX_TILE_PROCESS_WORK_PARAM*)arg;
+	BOOL rc = TRUE;
+
 	WINPR_ASSERT(param);
-	rfx_decode_rgb(param->context, param->tile, param->tile->data, 64 * 4);
+	WINPR_ASSERT(param->message);
+
+	for (size_t i = first; i < last; i++)
+	{
+		RFX_TILE* tile = param->message->tiles[i];
+		if (!rfx_decode_rgb(param->context, tile, tile->data, 64 * 4))
+			rc = FALSE;
+	}
+
+	return rc;
 }
 
 static INLINE BOOL rfx_allocate_tiles(RFX_MESSAGE* WINPR_RESTRICT message, size_t count,
@@ -838,7 +858,6 @@ static INLINE BOOL rfx_process_message_tileset(RFX_CONTEXT* WINPR_RESTRICT conte
                                                UINT16* WINPR_RESTRICT pExpectedBlockType)
 {
 	BOOL rc = 0;
-	size_t close_cnt = 0;
 	BYTE quant = 0;
 	RFX_TILE* tile = NULL;
 	UINT32* quants = NULL;
@@ -847,8 +866,6 @@ static INLINE BOOL rfx_process_message_tileset(RFX_CONTEXT* WINPR_RESTRICT conte
 	UINT32 blockLen = 0;
 	UINT32 blockType = 0;
 	UINT32 tilesDataSize = 0;
-	PTP_WORK* work_objects = NULL;
-	RFX_TILE_PROCESS_WORK_PARAM* params = NULL;
 	void* pmem = NULL;
 
 	WINPR_ASSERT(context);
@@ -941,27 +958,7 @@ static INLINE BOOL rfx_process_message_tileset(RFX_CONTEXT* WINPR_RESTRICT conte
 	if (!rfx_allocate_tiles(message, numTiles, FALSE))
 		return FALSE;
 
-	if (context->priv->UseThreads)
-	{
-		work_objects = (PTP_WORK*)winpr_aligned_calloc(message->numTiles, sizeof(PTP_WORK), 32);
-		params = (RFX_TILE_PROCESS_WORK_PARAM*)winpr_aligned_recalloc(
-		    NULL, message->numTiles, sizeof(RFX_TILE_PROCESS_WORK_PARAM), 32);
-
-		if (!work_objects)
-		{
-			winpr_aligned_free(params);
-			return FALSE;
-		}
-
-		if (!params)
-		{
-			winpr_aligned_free((void*)work_objects);
-			return FALSE;
-		}
-	}
-
 	/* tiles */
-	close_cnt = 0;
 	rc = FALSE;
 
 	if (Stream_GetRemainingLength(s) >= tilesDataSize)
@@ -1075,48 +1072,17 @@ static INLINE BOOL rfx_process_message_tileset(RFX_CONTEXT* WINPR_RESTRICT conte
 			}
 			tile->x = tile->xIdx * 64;
 			tile->y = tile->yIdx * 64;
-
-			if (context->priv->UseThreads)
-			{
-				if (!params)
-				{
-					rc = FALSE;
-					break;
-				}
-
-				params[i].context = context;
-				params[i].tile = message->tiles[i];
-
-				if (!(work_objects[i] =
-				          CreateThreadpoolWork(rfx_process_message_tile_work_callback,
-				                               (void*)&params[i], &context->priv->ThreadPoolEnv)))
-				{
-					WLog_Print(context->priv->log, WLOG_ERROR, "CreateThreadpoolWork failed.");
-					rc = FALSE;
-					break;
-				}
-
-				SubmitThreadpoolWork(work_objects[i]);
-				close_cnt = i + 1;
-			}
-			else
-			{
-				rfx_decode_rgb(context, tile, tile->data, 64 * 4);
-			}
 		}
 	}
 
-	if (context->priv->UseThreads)
+	/* all tiles are parsed, decode them in batches on the thread pool */
+	if (rc)
 	{
-		for (size_t i = 0; i < close_cnt; i++)
-		{
-			WaitForThreadpoolWorkCallbacks(work_objects[i], FALSE);
-			CloseThreadpoolWork(work_objects[i]);
-		}
-	}
+		RFX_TILE_PROCESS_WORK_PARAM param = { context, message };
 
-	winpr_aligned_free((void*)work_objects);
-	winpr_aligned_free(params);
+		rc = rfx_context_parallel_for(context->priv, message->numTiles, 0,
+		                              rfx_process_message_tiles, &param);
+	}
 
 	for (size_t i = 0; i < message->numTiles; i++)
 	{
@@ -1441,6 +1407,9 @@ void rfx_message_free(RFX_CONTEXT* WINPR_RESTRICT context, RFX_MESSAGE* WINPR_RE
 				tile->YCbCrData = NULL;
 			}
 
+			if (context->encoder)
+				rfx_encoder_tile_release((RFX_ENCODER_TILE*)tile);
+
 			ObjectPool_Return(context->priv->TilePool, (void*)tile);
 		}
 
@@ -1572,18 +1541,34 @@ static INLINE BOOL rfx_write_tile(wStream* WINPR_RESTRICT s, const RFX_TILE* WIN
 	return TRUE;
 }
 
-struct S_RFX_TILE_COMPOSE_WORK_PARAM
+static BOOL rfx_compose_message_tiles(void* arg, size_t first, size_t last)
 {
-	RFX_TILE* tile;
-	RFX_CONTEXT* context;
-};
+	RFX_TILE_PROCESS_WORK_PARAM* param = (RFX_TILE_PROCESS_WORK_PARAM*)arg;
 
-static INLINE void CALLBACK rfx_compose_message_tile_work_callback(PTP_CALLBACK_INSTANCE instance,
-                                                                   void* context, PTP_WORK work)
-{
-	RFX_TILE_COMPOSE_WORK_PARAM* param = (RFX_TILE_COMPOSE_WORK_PARAM*)context;
 	WINPR_ASSERT(param);
-	rfx_encode_rgb(param->context, param->tile);
+	WINPR_ASSERT(param->context);
+	WINPR_ASSERT(param->message);
+
+	RFX_CONTEXT_PRIV* priv = param->context->priv;
+
+	for (size_t i = first; i < last; i++)
+	{
+		RFX_TILE* tile = param->message->tiles[i];
+
+		/* unchanged tiles reuse the data encoded for an earlier frame */
+		if (rfx_tile_cache_lookup(priv->TileCache, param->context, (RFX_ENCODER_TILE*)tile))
+			continue;
+
+		if (!(tile->YCbCrData = (BYTE*)BufferPool_Take(priv->BufferPool, -1)))
+			return FALSE;
+
+		tile->YData = &(tile->YCbCrData[((8192 + 32) * 0) + 16]);
+		tile->CbData = &(tile->YCbCrData[((8192 + 32) * 1) + 16]);
+		tile->CrData = &(tile->YCbCrData[((8192 + 32) * 2) + 16]);
+		rfx_encode_rgb(param->context, tile);
+	}
+
+	return TRUE;
 }
 
 static INLINE BOOL computeRegion(const RFX_RECT* WINPR_RESTRICT rects, size_t numRects,
@@ -1611,31 +1596,6 @@ static INLINE BOOL computeRegion(const RFX_RECT* WINPR_RESTRICT rects, size_t nu
 
 #define TILE_NO(v) ((v) / 64)
 
-static INLINE BOOL setupWorkers(RFX_CONTEXT* WINPR_RESTRICT context, size_t nbTiles)
-{
-	WINPR_ASSERT(context);
-
-	RFX_CONTEXT_PRIV* priv = context->priv;
-	WINPR_ASSERT(priv);
-
-	void* pmem = NULL;
-
-	if (!context->priv->UseThreads)
-		return TRUE;
-
-	if (!(pmem = winpr_aligned_recalloc((void*)priv->workObjects, nbTiles, sizeof(PTP_WORK), 32)))
-		return FALSE;
-
-	priv->workObjects = (PTP_WORK*)pmem;
-
-	if (!(pmem = winpr_aligned_recalloc(priv->tileWorkParams, nbTiles,
-	                                    sizeof(RFX_TILE_COMPOSE_WORK_PARAM), 32)))
-		return FALSE;
-
-	priv->tileWorkParams = (RFX_TILE_COMPOSE_WORK_PARAM*)pmem;
-	return TRUE;
-}
-
 static INLINE BOOL rfx_ensure_tiles(RFX_MESSAGE* WINPR_RESTRICT message, size_t count)
 {
 	WINPR_ASSERT(message);
@@ -1655,8 +1615,6 @@ RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* WINPR_RESTRICT context,
 	const UINT32 height = h;
 	const UINT32 scanline = (UINT32)s;
 	RFX_MESSAGE* message = NULL;
-	PTP_WORK* workObject = NULL;
-	RFX_TILE_COMPOSE_WORK_PARAM* workParam = NULL;
 	BOOL success = FALSE;
 	REGION16 rectsRegion = { 0 };
 	REGION16 tilesRegion = { 0 };
@@ -1713,15 +1671,6 @@ RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* WINPR_RESTRICT context,
 	if (!rfx_ensure_tiles(message, maxNbTiles))
 		goto skip_encoding_loop;
 
-	if (!setupWorkers(context, maxNbTiles))
-		goto skip_encoding_loop;
-
-	if (context->priv->UseThreads)
-	{
-		workObject = context->priv->workObjects;
-		workParam = context->priv->tileWorkParams;
-	}
-
 	UINT32 regionNbRects = 0;
 	regionRect = region16_rects(&rectsRegion, &regionNbRects);
 
@@ -1804,66 +1753,34 @@ RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* WINPR_RESTRICT context,
 				tile->quantIdxCr = context->quantIdxCr;
 				tile->YLen = tile->CbLen = tile->CrLen = 0;
 
-				if (!(tile->YCbCrData = (BYTE*)BufferPool_Take(context->priv->BufferPool, -1)))
-					goto skip_encoding_loop;
-
-				tile->YData = &(tile->YCbCrData[((8192 + 32) * 0) + 16]);
-				tile->CbData = &(tile->YCbCrData[((8192 + 32) * 1) + 16]);
-				tile->CrData = &(tile->YCbCrData[((8192 + 32) * 2) + 16]);
-
 				if (!rfx_ensure_tiles(message, 1))
 					goto skip_encoding_loop;
 				message->tiles[message->numTiles++] = tile;
 
-				if (context->priv->UseThreads)
-				{
-					workParam->context = context;
-					workParam->tile = tile;
-
-					if (!(*workObject = CreateThreadpoolWork(rfx_compose_message_tile_work_callback,
-					                                         (void*)workParam,
-					                                         &context->priv->ThreadPoolEnv)))
-					{
-						goto skip_encoding_loop;
-					}
-
-					SubmitThreadpoolWork(*workObject);
-					workObject++;
-					workParam++;
-				}
-				else
-				{
-					rfx_encode_rgb(context, tile);
-				}
-
 				if (!region16_union_rect(&tilesRegion, &tilesRegion, &currentTileRect))
 					goto skip_encoding_loop;
 			} /* xIdx */
 		}     /* yIdx */
 	}         /* rects */
 
-	success = TRUE;
-skip_encoding_loop:
+	/* all tiles are set up, encode them in batches on the thread pool */
+	{
+		RFX_TILE_PROCESS_WORK_PARAM param = { context, message };
 
-	/* when using threads ensure all computations are done */
+		success = rfx_context_parallel_for(context->priv, message->numTiles, 0,
+		                                   rfx_compose_message_tiles, &param);
+		if (success)
+			success = rfx_tile_cache_update(context->priv->TileCache, context, message->tiles,
+			                                message->numTiles);
+	}
+
+skip_encoding_loop:
 	if (success)
 	{
 		message->tilesDataSize = 0;
-		workObject = context->priv->workObjects;
 
 		for (UINT32 i = 0; i < message->numTiles; i++)
 		{
-			if (context->priv->UseThreads)
-			{
-				if (*workObject)
-				{
-					WaitForThreadpoolWorkCallbacks(*workObject, FALSE);
-					CloseThreadpoolWork(*workObject);
-				}
-
-				workObject++;
-			}
-
 			const RFX_TILE* tile = message->tiles[i];
 			message->tilesDataSize += rfx_tile_length(tile);
 		}
@@ -2166,19 +2083,28 @@ static INLINE BOOL rfx_write_message_frame_end(RFX_CONTEXT* WINPR_RESTRICT conte
 	return TRUE;
 }
 
+BOOL rfx_write_message_header(RFX_CONTEXT* WINPR_RESTRICT context, wStream* WINPR_RESTRICT s)
+{
+	WINPR_ASSERT(context);
+
+	if (context->state != RFX_STATE_SEND_HEADERS)
+		return TRUE;
+
+	if (!rfx_compose_message_header(context, s))
+		return FALSE;
+
+	context->state = RFX_STATE_SEND_FRAME_DATA;
+	return TRUE;
+}
+
 BOOL rfx_write_message(RFX_CONTEXT* WINPR_RESTRICT context, wStream* WINPR_RESTRICT s,
                        const RFX_MESSAGE* WINPR_RESTRICT message)
 {
 	WINPR_ASSERT(context);
 	WINPR_ASSERT(message);
 
-	if (context->state == RFX_STATE_SEND_HEADERS)
-	{
-		if (!rfx_compose_message_header(context, s))
-			return FALSE;
-
-		context->state = RFX_STATE_SEND_FRAME_DATA;
-	}
+	if (!rfx_write_message_header(context, s))
+		return FALSE;
 
 	if (!rfx_write_message_frame_begin(context, s, message) ||
 	    !rfx_write_message_region(context, s, message) ||
@@ -2220,6 +2146,71 @@ RLGR_MODE rfx_context_get_mode(RFX_CONTEXT* WINPR_RESTRICT context)
 	return context->mode;
 }
 
+BOOL rfx_context_set_tile_cache_size(RFX_CONTEXT* WINPR_RESTRICT context, size_t entries)
+{
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(context->priv);
+
+	if (!context->encoder)
+		return FALSE;
+
+	/* messages still in flight keep their own references on the encoded data */
+	rfx_tile_cache_free(context->priv->TileCache);
+	context->priv->TileCache = NULL;
+
+	if (entries == 0)
+		return TRUE;
+
+	context->priv->TileCache = rfx_tile_cache_new(entries);
+	return context->priv->TileCache != NULL;
+}
+
+BOOL rfx_context_get_tile_cache_stats(const RFX_CONTEXT* WINPR_RESTRICT context,
+                                      UINT64* WINPR_RESTRICT hits, UINT64* WINPR_RESTRICT misses)
+{
+	if (!context || !context->priv || !hits || !misses)
+		return FALSE;
+
+	rfx_tile_cache_get_stats(context->priv->TileCache, hits, misses);
+	return TRUE;
+}
+
+BOOL rfx_context_set_quantization(RFX_CONTEXT* WINPR_RESTRICT context,
+                                  const UINT32* WINPR_RESTRICT quantVals)
+{
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(context->priv);
+	WINPR_ASSERT(quantVals);
+
+	if (!context->encoder)
+		return FALSE;
+
+	for (size_t x = 0; x < ARRAYSIZE(rfx_default_quantization_values); x++)
+	{
+		if ((quantVals[x] < 6) || (quantVals[x] > 15))
+			return FALSE;
+	}
+
+	if (!context->quants)
+	{
+		context->quants =
+		    (UINT32*)winpr_aligned_malloc(sizeof(rfx_default_quantization_values), 32);
+		if (!context->quants)
+			return FALSE;
+	}
+	else if ((context->numQuant == 1) &&
+	         (memcmp(context->quants, quantVals, sizeof(rfx_default_quantization_values)) == 0))
+		return TRUE;
+
+	CopyMemory(context->quants, quantVals, sizeof(rfx_default_quantization_values));
+	context->numQuant = 1;
+	context->quantIdxY = 0;
+	context->quantIdxCb = 0;
+	context->quantIdxCr = 0;
+	rfx_tile_cache_clear(context->priv->TileCache);
+	return TRUE;
+}
+
 UINT32 rfx_context_get_frame_idx(const RFX_CONTEXT* WINPR_RESTRICT context)
 {
 	WINPR_ASSERT(context);
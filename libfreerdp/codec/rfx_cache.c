@@ -0,0 +1,339 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RemoteFX Codec Library - Encoded Tile Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <winpr/crt.h>
+#include <winpr/assert.h>
+#include <winpr/interlocked.h>
+
+#include <freerdp/codec/color.h>
+
+#include "rfx_types.h"
+#include "rfx_cache.h"
+
+#define RFX_TILE_CACHE_QUANT_VALUES 30
+
+struct S_RFX_ENCODED_TILE
+{
+	volatile LONG refCount;
+	UINT16 YLen;
+	UINT16 CbLen;
+	UINT16 CrLen;
+	BYTE data[1];
+};
+
+typedef struct
+{
+	UINT64 hash;
+	UINT32 format;
+	UINT32 width;
+	UINT32 height;
+	RLGR_MODE mode;
+	UINT32 quants[RFX_TILE_CACHE_QUANT_VALUES];
+	BYTE* pixels;
+	RFX_ENCODED_TILE* encoded;
+} RFX_TILE_CACHE_ENTRY;
+
+struct S_RFX_TILE_CACHE
+{
+	size_t count;
+	RFX_TILE_CACHE_ENTRY* entries;
+
+	UINT64 hits;
+	UINT64 misses;
+};
+
+static void rfx_encoded_tile_release(RFX_ENCODED_TILE* encoded)
+{
+	if (!encoded)
+		return;
+
+	if (InterlockedDecrement(&encoded->refCount) == 0)
+		free(encoded);
+}
+
+static RFX_ENCODED_TILE* rfx_encoded_tile_new(const RFX_TILE* WINPR_RESTRICT tile)
+{
+	WINPR_ASSERT(tile);
+
+	const size_t size = 1ull * tile->YLen + tile->CbLen + tile->CrLen;
+	RFX_ENCODED_TILE* encoded = malloc(sizeof(RFX_ENCODED_TILE) + size);
+	if (!encoded)
+		return NULL;
+
+	encoded->refCount = 1;
+	encoded->YLen = tile->YLen;
+	encoded->CbLen = tile->CbLen;
+	encoded->CrLen = tile->CrLen;
+	CopyMemory(&encoded->data[0], tile->YData, tile->YLen);
+	CopyMemory(&encoded->data[tile->YLen], tile->CbData, tile->CbLen);
+	CopyMemory(&encoded->data[1ull * tile->YLen + tile->CbLen], tile->CrData, tile->CrLen);
+	return encoded;
+}
+
+static void rfx_encoder_tile_share(RFX_ENCODER_TILE* WINPR_RESTRICT etile,
+                                   RFX_ENCODED_TILE* WINPR_RESTRICT encoded)
+{
+	WINPR_ASSERT(etile);
+	WINPR_ASSERT(encoded);
+	WINPR_ASSERT(!etile->encoded);
+
+	RFX_TILE* tile = &etile->tile;
+
+	InterlockedIncrement(&encoded->refCount);
+	etile->encoded = encoded;
+	tile->YLen = encoded->YLen;
+	tile->CbLen = encoded->CbLen;
+	tile->CrLen = encoded->CrLen;
+	tile->YData = &encoded->data[0];
+	tile->CbData = &encoded->data[encoded->YLen];
+	tile->CrData = &encoded->data[1ull * encoded->YLen + encoded->CbLen];
+}
+
+static BOOL rfx_tile_cache_enabled(const RFX_TILE_CACHE* WINPR_RESTRICT cache,
+                                   const RFX_CONTEXT* WINPR_RESTRICT context)
+{
+	if (!cache || (cache->count == 0))
+		return FALSE;
+
+	/* the palette is not owned by the context and may change between frames unnoticed */
+	if (context->bits_per_pixel <= 8)
+		return FALSE;
+
+	return context->quants != NULL;
+}
+
+static UINT64 rfx_tile_hash(const RFX_TILE* WINPR_RESTRICT tile, size_t rowSize)
+{
+	UINT64 hash = 0xcbf29ce484222325ull;
+
+	for (UINT32 y = 0; y < tile->height; y++)
+	{
+		const BYTE* line = &tile->data[1ull * y * tile->scanline];
+		size_t x = 0;
+
+		for (; x + sizeof(UINT64) <= rowSize; x += sizeof(UINT64))
+		{
+			UINT64 value = 0;
+			memcpy(&value, &line[x], sizeof(value));
+			hash = (hash ^ value) * 0x100000001b3ull;
+			hash ^= hash >> 29;
+		}
+
+		for (; x < rowSize; x++)
+			hash = (hash ^ line[x]) * 0x100000001b3ull;
+	}
+
+	return hash;
+}
+
+static BOOL rfx_tile_cache_entry_matches(const RFX_TILE_CACHE_ENTRY* WINPR_RESTRICT entry,
+                                         const RFX_CONTEXT* WINPR_RESTRICT context,
+                                         const RFX_TILE* WINPR_RESTRICT tile, UINT64 hash,
+                                         size_t rowSize)
+{
+	if (!entry->encoded || (entry->hash != hash))
+		return FALSE;
+
+	if ((entry->format != context->pixel_format) || (entry->mode != context->mode) ||
+	    (entry->width != tile->width) || (entry->height != tile->height))
+		return FALSE;
+
+	const UINT32 quants[] = { tile->quantIdxY, tile->quantIdxCb, tile->quantIdxCr };
+	for (size_t x = 0; x < ARRAYSIZE(quants); x++)
+	{
+		if (memcmp(&entry->quants[x * 10], &context->quants[10ull * quants[x]],
+		           10 * sizeof(UINT32)) != 0)
+			return FALSE;
+	}
+
+	/* a hash match is not proof enough, compare the pixels */
+	for (UINT32 y = 0; y < tile->height; y++)
+	{
+		if (memcmp(&entry->pixels[y * rowSize], &tile->data[1ull * y * tile->scanline],
+		           rowSize) != 0)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL rfx_tile_cache_insert(RFX_TILE_CACHE* WINPR_RESTRICT cache,
+                                  const RFX_CONTEXT* WINPR_RESTRICT context,
+                                  RFX_ENCODER_TILE* WINPR_RESTRICT etile, size_t rowSize)
+{
+	const RFX_TILE* tile = &etile->tile;
+	RFX_TILE_CACHE_ENTRY* entry = &cache->entries[etile->hash % cache->count];
+
+	if (!entry->pixels)
+	{
+		entry->pixels = winpr_aligned_malloc(64ull * 64ull * 4ull, 32);
+		if (!entry->pixels)
+			return FALSE;
+	}
+
+	RFX_ENCODED_TILE* encoded = rfx_encoded_tile_new(tile);
+	if (!encoded)
+		return FALSE;
+
+	rfx_encoded_tile_release(entry->encoded);
+	entry->encoded = encoded;
+	entry->hash = etile->hash;
+	entry->format = context->pixel_format;
+	entry->mode = context->mode;
+	entry->width = tile->width;
+	entry->height = tile->height;
+
+	const UINT32 quants[] = { tile->quantIdxY, tile->quantIdxCb, tile->quantIdxCr };
+	for (size_t x = 0; x < ARRAYSIZE(quants); x++)
+		CopyMemory(&entry->quants[x * 10], &context->quants[10ull * quants[x]],
+		           10 * sizeof(UINT32));
+
+	for (UINT32 y = 0; y < tile->height; y++)
+		CopyMemory(&entry->pixels[y * rowSize], &tile->data[1ull * y * tile->scanline], rowSize);
+
+	return TRUE;
+}
+
+void rfx_tile_cache_clear(RFX_TILE_CACHE* cache)
+{
+	if (!cache)
+		return;
+
+	for (size_t x = 0; x < cache->count; x++)
+	{
+		RFX_TILE_CACHE_ENTRY* entry = &cache->entries[x];
+		rfx_encoded_tile_release(entry->encoded);
+		entry->encoded = NULL;
+		entry->hash = 0;
+	}
+}
+
+void rfx_tile_cache_free(RFX_TILE_CACHE* cache)
+{
+	if (!cache)
+		return;
+
+	rfx_tile_cache_clear(cache);
+	for (size_t x = 0; x < cache->count; x++)
+		winpr_aligned_free(cache->entries[x].pixels);
+	free(cache->entries);
+	free(cache);
+}
+
+RFX_TILE_CACHE* rfx_tile_cache_new(size_t entries)
+{
+	RFX_TILE_CACHE* cache = calloc(1, sizeof(RFX_TILE_CACHE));
+	if (!cache)
+		return NULL;
+
+	cache->entries = calloc(entries, sizeof(RFX_TILE_CACHE_ENTRY));
+	if (!cache->entries)
+	{
+		rfx_tile_cache_free(cache);
+		return NULL;
+	}
+	cache->count = entries;
+	return cache;
+}
+
+BOOL rfx_tile_cache_lookup(const RFX_TILE_CACHE* WINPR_RESTRICT cache,
+                           const RFX_CONTEXT* WINPR_RESTRICT context,
+                           RFX_ENCODER_TILE* WINPR_RESTRICT tile)
+{
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(tile);
+
+	tile->hit = NULL;
+	if (!rfx_tile_cache_enabled(cache, context))
+		return FALSE;
+
+	const size_t rowSize = 1ull * tile->tile.width * FreeRDPGetBytesPerPixel(context->pixel_format);
+	tile->hash = rfx_tile_hash(&tile->tile, rowSize);
+
+	const RFX_TILE_CACHE_ENTRY* entry = &cache->entries[tile->hash % cache->count];
+	if (!rfx_tile_cache_entry_matches(entry, context, &tile->tile, tile->hash, rowSize))
+		return FALSE;
+
+	tile->hit = entry->encoded;
+	return TRUE;
+}
+
+BOOL rfx_tile_cache_update(RFX_TILE_CACHE* WINPR_RESTRICT cache,
+                           const RFX_CONTEXT* WINPR_RESTRICT context, RFX_TILE** WINPR_RESTRICT tiles,
+                           size_t count)
+{
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(tiles || (count == 0));
+
+	if (!rfx_tile_cache_enabled(cache, context))
+		return TRUE;
+
+	const size_t bpp = FreeRDPGetBytesPerPixel(context->pixel_format);
+
+	/* take references on all hits first, inserting might evict the entries they point to */
+	for (size_t x = 0; x < count; x++)
+	{
+		RFX_ENCODER_TILE* etile = (RFX_ENCODER_TILE*)tiles[x];
+		if (!etile->hit)
+			continue;
+
+		union
+		{
+			const RFX_ENCODED_TILE* cpv;
+			RFX_ENCODED_TILE* pv;
+		} cnv;
+		cnv.cpv = etile->hit;
+		etile->hit = NULL;
+		rfx_encoder_tile_share(etile, cnv.pv);
+		cache->hits++;
+	}
+
+	for (size_t x = 0; x < count; x++)
+	{
+		RFX_ENCODER_TILE* etile = (RFX_ENCODER_TILE*)tiles[x];
+		if (etile->encoded)
+			continue;
+
+		if (!rfx_tile_cache_insert(cache, context, etile, bpp * etile->tile.width))
+			return FALSE;
+
+		cache->misses++;
+	}
+
+	return TRUE;
+}
+
+void rfx_tile_cache_get_stats(const RFX_TILE_CACHE* cache, UINT64* hits, UINT64* misses)
+{
+	WINPR_ASSERT(hits);
+	WINPR_ASSERT(misses);
+
+	*hits = cache ? cache->hits : 0;
+	*misses = cache ? cache->misses : 0;
+}
+
+void rfx_encoder_tile_release(RFX_ENCODER_TILE* tile)
+{
+	if (!tile)
+		return;
+
+	rfx_encoded_tile_release(tile->encoded);
+	tile->encoded = NULL;
+	tile->hit = NULL;
+}
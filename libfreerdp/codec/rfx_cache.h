@@ -0,0 +1,63 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RemoteFX Codec Library - Encoded Tile Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_CODEC_RFX_CACHE_H
+#define FREERDP_LIB_CODEC_RFX_CACHE_H
+
+#include <winpr/wtypes.h>
+
+#include <freerdp/codec/rfx.h>
+#include <freerdp/api.h>
+
+/* encoded Y, Cb and Cr data shared by the cache and all messages using it */
+typedef struct S_RFX_ENCODED_TILE RFX_ENCODED_TILE;
+typedef struct S_RFX_TILE_CACHE RFX_TILE_CACHE;
+
+/* tiles of an encoder context, the RFX_TILE must stay the first member */
+typedef struct
+{
+	RFX_TILE tile;
+	UINT64 hash;
+	const RFX_ENCODED_TILE* hit;
+	RFX_ENCODED_TILE* encoded;
+} RFX_ENCODER_TILE;
+
+FREERDP_LOCAL void rfx_tile_cache_free(RFX_TILE_CACHE* cache);
+
+WINPR_ATTR_MALLOC(rfx_tile_cache_free, 1)
+FREERDP_LOCAL RFX_TILE_CACHE* rfx_tile_cache_new(size_t entries);
+
+FREERDP_LOCAL void rfx_tile_cache_clear(RFX_TILE_CACHE* cache);
+
+/* look up the pixels of an encoder tile, only reads the cache and may run concurrently */
+FREERDP_LOCAL BOOL rfx_tile_cache_lookup(const RFX_TILE_CACHE* WINPR_RESTRICT cache,
+                                         const RFX_CONTEXT* WINPR_RESTRICT context,
+                                         RFX_ENCODER_TILE* WINPR_RESTRICT tile);
+
+/* share cache hits with the tiles and store the freshly encoded tiles */
+FREERDP_LOCAL BOOL rfx_tile_cache_update(RFX_TILE_CACHE* WINPR_RESTRICT cache,
+                                         const RFX_CONTEXT* WINPR_RESTRICT context,
+                                         RFX_TILE** WINPR_RESTRICT tiles, size_t count);
+
+/* the number of tiles taken from the cache and of tiles encoded while it was enabled */
+FREERDP_LOCAL void rfx_tile_cache_get_stats(const RFX_TILE_CACHE* cache, UINT64* hits,
+                                            UINT64* misses);
+
+/* drop the reference an encoder tile holds on shared encoded data */
+FREERDP_LOCAL void rfx_encoder_tile_release(RFX_ENCODER_TILE* tile);
+
+#endif /* FREERDP_LIB_CODEC_RFX_CACHE_H */
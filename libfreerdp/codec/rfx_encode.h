@@ -23,6 +23,18 @@
 #include <freerdp/codec/rfx.h>
 #include <freerdp/api.h>
 
+/* splits up to 64x64 pixels into 64x64 R, G and B planes, padding with the last column and row */
+FREERDP_LOCAL void rfx_encode_format_rgb(const BYTE* WINPR_RESTRICT rgb_data, uint32_t width,
+                                         uint32_t height, uint32_t rowstride, UINT32 pixel_format,
+                                         const BYTE* WINPR_RESTRICT palette,
+                                         INT16* WINPR_RESTRICT r_buf, INT16* WINPR_RESTRICT g_buf,
+                                         INT16* WINPR_RESTRICT b_buf);
+
+/* converts up to 64x64 pixels in the context pixel format to 64x64 Y, Cb and Cr planes */
+FREERDP_LOCAL void rfx_encode_ycbcr(RFX_CONTEXT* WINPR_RESTRICT context,
+                                    const BYTE* WINPR_RESTRICT data, UINT32 width, UINT32 height,
+                                    UINT32 scanline, INT16* pSrcDst[3]);
+
 FREERDP_LOCAL void rfx_encode_rgb(RFX_CONTEXT* WINPR_RESTRICT context,
                                   RFX_TILE* WINPR_RESTRICT tile);
 
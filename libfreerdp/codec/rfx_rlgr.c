@@ -33,7 +33,7 @@
 #include <winpr/crt.h>
 #include <winpr/print.h>
 #include <winpr/sysinfo.h>
-#include <winpr/bitstream.h>
+#include <winpr/endian.h>
 #include <winpr/intrin.h>
 
 #include "rfx_bitstream.h"
@@ -149,12 +149,126 @@ static INLINE UINT32 lzcnt_s(UINT32 x)
 	return __lzcnt(x);
 }
 
+/*
+ * The decoder reads the stream through a 64 bit accumulator that is refilled a whole word at a
+ * time, so runs of up to 56 bits are counted with a single lzcnt and the unary and remainder
+ * parts of a code are extracted without refilling in between.
+ */
+typedef struct
+{
+	const BYTE* pointer;
+	const BYTE* end;
+	UINT64 accumulator; /* the next bits of the stream, most significant bit first */
+	UINT32 bits;        /* valid bits in the accumulator */
+	size_t remaining;   /* bits left in the stream */
+} RLGR_BIT_READER;
+
+#define RLGR_BIT_WINDOW 56 /* valid bits in the accumulator after a refill */
+
+static INLINE UINT32 lzcnt64_s(UINT64 x)
+{
+	const UINT32 hi = (UINT32)(x >> 32);
+
+	if (hi)
+		return lzcnt_s(hi);
+
+	return 32 + lzcnt_s((UINT32)x);
+}
+
+static INLINE void rlgr_reader_attach(RLGR_BIT_READER* WINPR_RESTRICT bs,
+                                      const BYTE* WINPR_RESTRICT data, size_t size)
+{
+	bs->pointer = data;
+	bs->end = &data[size];
+	bs->accumulator = 0;
+	bs->bits = 0;
+	bs->remaining = size * 8;
+}
+
+static INLINE void rlgr_reader_refill(RLGR_BIT_READER* WINPR_RESTRICT bs)
+{
+	if (bs->bits >= RLGR_BIT_WINDOW)
+		return;
+
+	if (bs->end - bs->pointer >= 8)
+	{
+		/* bits already in the accumulator are loaded again at the same position, which
+		 * leaves them alone */
+		bs->accumulator |= winpr_Data_Get_UINT64_BE(bs->pointer) >> bs->bits;
+		bs->pointer += (63 - bs->bits) >> 3;
+		bs->bits |= RLGR_BIT_WINDOW;
+	}
+	else
+	{
+		/* the end of the stream reads as 0 bits, the same as with a wBitStream */
+		while (bs->bits <= RLGR_BIT_WINDOW)
+		{
+			const UINT64 byte = (bs->pointer < bs->end) ? *bs->pointer++ : 0;
+			bs->accumulator |= byte << (RLGR_BIT_WINDOW - bs->bits);
+			bs->bits += 8;
+		}
+	}
+}
+
+/* the next nbits (1 to 32) bits of the stream, the reader must be refilled */
+static INLINE UINT32 rlgr_reader_peek(const RLGR_BIT_READER* WINPR_RESTRICT bs, UINT32 nbits)
+{
+	WINPR_ASSERT((nbits > 0) && (nbits <= 32));
+	WINPR_ASSERT(bs->bits >= nbits);
+	return (UINT32)(bs->accumulator >> (64 - nbits));
+}
+
+static INLINE void rlgr_reader_skip(RLGR_BIT_READER* WINPR_RESTRICT bs, UINT32 nbits)
+{
+	WINPR_ASSERT(bs->bits >= nbits);
+	WINPR_ASSERT(bs->remaining >= nbits);
+	bs->accumulator <<= nbits;
+	bs->bits -= nbits;
+	bs->remaining -= nbits;
+}
+
+/* counts and skips a run of 0 bits, or of 1 bits if ones is set, up to the end of the stream */
+static INLINE UINT32 rlgr_reader_count_run(RLGR_BIT_READER* WINPR_RESTRICT bs, BOOL ones)
+{
+	UINT32 count = 0;
+
+	for (;;)
+	{
+		rlgr_reader_refill(bs);
+
+		UINT32 cnt = lzcnt64_s(ones ? ~bs->accumulator : bs->accumulator);
+
+		if (cnt > RLGR_BIT_WINDOW)
+			cnt = RLGR_BIT_WINDOW;
+
+		if (cnt > bs->remaining)
+			cnt = WINPR_ASSERTING_INT_CAST(UINT32, bs->remaining);
+
+		rlgr_reader_skip(bs, cnt);
+		count += cnt;
+
+		if ((cnt < RLGR_BIT_WINDOW) || (bs->remaining == 0))
+			return count;
+	}
+}
+
+/* reads nbits (0 to 32) bits, the caller checks that enough bits are left */
+static INLINE UINT32 rlgr_reader_read(RLGR_BIT_READER* WINPR_RESTRICT bs, UINT32 nbits)
+{
+	if (nbits == 0)
+		return 0;
+
+	rlgr_reader_refill(bs);
+	const UINT32 val = rlgr_reader_peek(bs, nbits);
+	rlgr_reader_skip(bs, nbits);
+	return val;
+}
+
 int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize,
                     INT16* WINPR_RESTRICT pDstData, UINT32 rDstSize)
 {
 	uint32_t vk = 0;
 	size_t run = 0;
-	size_t cnt = 0;
 	size_t size = 0;
 	size_t offset = 0;
 	INT16 mag = 0;
@@ -168,8 +282,8 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* WINPR_RESTRICT pSrcData, UINT32
 	UINT32 val1 = 0;
 	UINT32 val2 = 0;
 	INT16* pOutput = NULL;
-	wBitStream* bs = NULL;
-	wBitStream s_bs = { 0 };
+	RLGR_BIT_READER s_bs = { 0 };
+	RLGR_BIT_READER* bs = &s_bs;
 	const SSIZE_T DstSize = rDstSize;
 
 	InitOnceExecuteOnce(&rfx_rlgr_init_once, rfx_rlgr_init, NULL, NULL);
@@ -191,12 +305,9 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* WINPR_RESTRICT pSrcData, UINT32
 
 	pOutput = pDstData;
 
-	bs = &s_bs;
-
-	BitStream_Attach(bs, pSrcData, SrcSize);
-	BitStream_Fetch(bs);
+	rlgr_reader_attach(bs, pSrcData, SrcSize);
 
-	while ((BitStream_GetRemainingLength(bs) > 0) && ((pOutput - pDstData) < DstSize))
+	while ((bs->remaining > 0) && ((pOutput - pDstData) < DstSize))
 	{
 		if (k)
 		{
@@ -206,35 +317,12 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* WINPR_RESTRICT pSrcData, UINT32
 
 			/* count number of leading 0s */
 
-			cnt = lzcnt_s(bs->accumulator);
-
-			size_t nbits = BitStream_GetRemainingLength(bs);
-
-			if (cnt > nbits)
-				cnt = WINPR_ASSERTING_INT_CAST(uint32_t, nbits);
-
-			vk = WINPR_ASSERTING_INT_CAST(uint32_t, cnt);
-
-			while ((cnt == 32) && (BitStream_GetRemainingLength(bs) > 0))
-			{
-				BitStream_Shift32(bs);
-
-				cnt = lzcnt_s(bs->accumulator);
+			vk = rlgr_reader_count_run(bs, FALSE);
 
-				nbits = BitStream_GetRemainingLength(bs);
-
-				if (cnt > nbits)
-					cnt = nbits;
-
-				vk += cnt;
-			}
-
-			BitStream_Shift(bs, (vk % 32));
-
-			if (BitStream_GetRemainingLength(bs) < 1)
+			if (bs->remaining < 1)
 				break;
 
-			BitStream_Shift(bs, 1);
+			rlgr_reader_skip(bs, 1);
 
 			while (vk--)
 			{
@@ -253,64 +341,33 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* WINPR_RESTRICT pSrcData, UINT32
 
 			/* next k bits contain run length remainder */
 
-			if (BitStream_GetRemainingLength(bs) < k)
+			if (bs->remaining < k)
 				break;
 
-			bs->mask = ((1 << k) - 1);
-			run += ((bs->accumulator >> (32 - k)) & bs->mask);
-			BitStream_Shift(bs, k);
+			run += rlgr_reader_read(bs, k);
 
 			/* read sign bit */
 
-			if (BitStream_GetRemainingLength(bs) < 1)
+			if (bs->remaining < 1)
 				break;
 
-			sign = (bs->accumulator & 0x80000000) ? 1 : 0;
-			BitStream_Shift(bs, 1);
+			sign = rlgr_reader_read(bs, 1);
 
 			/* count number of leading 1s */
 
-			cnt = lzcnt_s(~(bs->accumulator));
-
-			nbits = BitStream_GetRemainingLength(bs);
-
-			if (cnt > nbits)
-				cnt = nbits;
-
-			vk = WINPR_ASSERTING_INT_CAST(uint32_t, cnt);
-
-			while ((cnt == 32) && (BitStream_GetRemainingLength(bs) > 0))
-			{
-				BitStream_Shift32(bs);
+			vk = rlgr_reader_count_run(bs, TRUE);
 
-				cnt = lzcnt_s(~(bs->accumulator));
-
-				nbits = BitStream_GetRemainingLength(bs);
-
-				if (cnt > nbits)
-					cnt = nbits;
-
-				vk += cnt;
-			}
-
-			BitStream_Shift(bs, (vk % 32));
-
-			if (BitStream_GetRemainingLength(bs) < 1)
+			if (bs->remaining < 1)
 				break;
 
-			BitStream_Shift(bs, 1);
+			rlgr_reader_skip(bs, 1);
 
 			/* next kr bits contain code remainder */
 
-			if (BitStream_GetRemainingLength(bs) < kr)
+			if (bs->remaining < kr)
 				break;
 
-			bs->mask = ((1 << kr) - 1);
-			if (kr > 0)
-				code = (UINT16)((bs->accumulator >> (32 - kr)) & bs->mask);
-			else
-				code = 0;
-			BitStream_Shift(bs, kr);
+			code = (UINT16)rlgr_reader_read(bs, kr);
 
 			/* add (vk << kr) to code */
 
@@ -381,47 +438,19 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* WINPR_RESTRICT pSrcData, UINT32
 
 			/* count number of leading 1s */
 
-			cnt = lzcnt_s(~(bs->accumulator));
-
-			size_t nbits = BitStream_GetRemainingLength(bs);
-
-			if (cnt > nbits)
-				cnt = nbits;
-
-			vk = WINPR_ASSERTING_INT_CAST(uint32_t, cnt);
+			vk = rlgr_reader_count_run(bs, TRUE);
 
-			while ((cnt == 32) && (BitStream_GetRemainingLength(bs) > 0))
-			{
-				BitStream_Shift32(bs);
-
-				cnt = lzcnt_s(~(bs->accumulator));
-
-				nbits = BitStream_GetRemainingLength(bs);
-
-				if (cnt > nbits)
-					cnt = nbits;
-
-				vk += cnt;
-			}
-
-			BitStream_Shift(bs, (vk % 32));
-
-			if (BitStream_GetRemainingLength(bs) < 1)
+			if (bs->remaining < 1)
 				break;
 
-			BitStream_Shift(bs, 1);
+			rlgr_reader_skip(bs, 1);
 
 			/* next kr bits contain code remainder */
 
-			if (BitStream_GetRemainingLength(bs) < kr)
+			if (bs->remaining < kr)
 				break;
 
-			bs->mask = ((1 << kr) - 1);
-			if (kr > 0)
-				code = (UINT16)((bs->accumulator >> (32 - kr)) & bs->mask);
-			else
-				code = 0;
-			BitStream_Shift(bs, kr);
+			code = (UINT16)rlgr_reader_read(bs, kr);
 
 			/* add (vk << kr) to code */
 
@@ -503,15 +532,10 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* WINPR_RESTRICT pSrcData, UINT32
 					nIdx = 32 - lzcnt_s(WINPR_ASSERTING_INT_CAST(uint32_t, mag));
 				}
 
-				if (BitStream_GetRemainingLength(bs) < nIdx)
+				if (bs->remaining < nIdx)
 					break;
 
-				bs->mask = ((1 << nIdx) - 1);
-				if (nIdx > 0)
-					val1 = ((bs->accumulator >> (32 - nIdx)) & bs->mask);
-				else
-					val1 = 0;
-				BitStream_Shift(bs, nIdx);
+				val1 = rlgr_reader_read(bs, nIdx);
 
 				val2 = code - val1;
 
@@ -23,6 +23,7 @@
 #include <freerdp/config.h>
 
 #include <winpr/crt.h>
+#include <winpr/assert.h>
 #include <winpr/pool.h>
 #include <winpr/wlog.h>
 #include <winpr/collections.h>
@@ -31,6 +32,8 @@
 #include <freerdp/log.h>
 #include <freerdp/utils/profiler.h>
 
+#include "rfx_cache.h"
+
 #define RFX_TAG FREERDP_TAG("codec.rfx")
 #ifdef WITH_DEBUG_RFX
 #define DEBUG_RFX(...) WLog_DBG(RFX_TAG, __VA_ARGS__)
@@ -57,8 +60,6 @@ typedef enum
 	RFX_STATE_FINAL
 } RFX_STATE;
 
-typedef struct S_RFX_TILE_COMPOSE_WORK_PARAM RFX_TILE_COMPOSE_WORK_PARAM;
-
 typedef struct S_RFX_CONTEXT_PRIV RFX_CONTEXT_PRIV;
 struct S_RFX_CONTEXT_PRIV
 {
@@ -66,8 +67,7 @@ struct S_RFX_CONTEXT_PRIV
 	wObjectPool* TilePool;
 
 	BOOL UseThreads;
-	PTP_WORK* workObjects;
-	RFX_TILE_COMPOSE_WORK_PARAM* tileWorkParams;
+	WINPR_PARALLEL_FOR* ParallelFor;
 
 	DWORD MinThreadCount;
 	DWORD MaxThreadCount;
@@ -76,6 +76,7 @@ struct S_RFX_CONTEXT_PRIV
 	TP_CALLBACK_ENVIRON ThreadPoolEnv;
 
 	wBufferPool* BufferPool;
+	RFX_TILE_CACHE* TileCache;
 
 	/* profilers */
 	PROFILER_DEFINE(prof_rfx_decode_rgb)
@@ -96,6 +97,22 @@ struct S_RFX_CONTEXT_PRIV
 	PROFILER_DEFINE(prof_rfx_encode_format_rgb)
 };
 
+/* runs fn for [0, count) on the codec thread pool, or inline if threads are disabled */
+static INLINE BOOL rfx_context_parallel_for(RFX_CONTEXT_PRIV* WINPR_RESTRICT priv, size_t count,
+                                            size_t chunkSize, WINPR_PARALLEL_FOR_CALLBACK fn,
+                                            void* arg)
+{
+	WINPR_ASSERT(priv);
+	WINPR_ASSERT(fn);
+
+	if (priv->UseThreads)
+		return winpr_ParallelFor_Run(priv->ParallelFor, count, chunkSize, fn, arg);
+
+	if (count == 0)
+		return TRUE;
+	return fn(arg, 0, count);
+}
+
 struct S_RFX_MESSAGE
 {
 	UINT32 frameIdx;
@@ -176,6 +193,10 @@ struct S_RFX_CONTEXT
 	                   INT16* WINPR_RESTRICT buffer, UINT32 buffer_size);
 	int (*rlgr_encode)(RLGR_MODE mode, const INT16* WINPR_RESTRICT data, UINT32 data_size,
 	                   BYTE* WINPR_RESTRICT buffer, UINT32 buffer_size);
+	void (*encode_format_rgb)(const BYTE* WINPR_RESTRICT rgb_data, uint32_t width, uint32_t height,
+	                          uint32_t rowstride, UINT32 pixel_format,
+	                          const BYTE* WINPR_RESTRICT palette, INT16* WINPR_RESTRICT r_buf,
+	                          INT16* WINPR_RESTRICT g_buf, INT16* WINPR_RESTRICT b_buf);
 
 	/* private definitions */
 	RFX_CONTEXT_PRIV* priv;
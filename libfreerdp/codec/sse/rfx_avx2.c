@@ -0,0 +1,563 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RemoteFX Codec Library - AVX2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/assert.h>
+#include <winpr/cast.h>
+#include <winpr/platform.h>
+#include <freerdp/config.h>
+#include <freerdp/codec/color.h>
+
+#include "../rfx_types.h"
+#include "../rfx_encode.h"
+#include "rfx_avx2.h"
+
+#include "../../core/simd.h"
+
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+#include <string.h>
+#include <winpr/sysinfo.h>
+
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define __attribute__(...)
+#endif
+
+#ifndef __clang__
+#define ATTRIBUTES __gnu_inline__, __always_inline__, __artificial__
+#else
+#define ATTRIBUTES __gnu_inline__, __always_inline__
+#endif
+
+/*
+ * The horizontal DWT passes work on two rows at once, one per 128 bit lane, so that the 8
+ * coefficient wide sub-bands of the last level fill a register as well.
+ */
+static __inline __m256i __attribute__((ATTRIBUTES))
+mm256_load_rows(const INT16* WINPR_RESTRICT row0, const INT16* WINPR_RESTRICT row1)
+{
+	const __m128i lo = _mm_loadu_si128((const __m128i*)row0);
+	const __m128i hi = _mm_loadu_si128((const __m128i*)row1);
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+mm256_store_rows(INT16* WINPR_RESTRICT row0, INT16* WINPR_RESTRICT row1, __m256i val)
+{
+	_mm_storeu_si128((__m128i*)row0, _mm256_castsi256_si128(val));
+	_mm_storeu_si128((__m128i*)row1, _mm256_extracti128_si256(val, 1));
+}
+
+/* a register with lo in element 0 of the low lane and hi in element 0 of the high lane */
+static __inline __m256i __attribute__((ATTRIBUTES)) mm256_set_lanes_epi16(INT16 lo, INT16 hi)
+{
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_set1_epi16(lo)), _mm_set1_epi16(hi),
+	                               1);
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+rfx_quantization_decode_block_avx2(INT16* WINPR_RESTRICT buffer, size_t buffer_size, UINT32 factor)
+{
+	if (factor == 0)
+		return;
+
+	/* quantization values come from the wire, a value of 0 wraps the factor around */
+	const __m128i count = _mm_cvtsi32_si128((int)MIN(factor, 16));
+
+	for (size_t x = 0; x < buffer_size; x += 16)
+	{
+		__m256i* ptr = (__m256i*)&buffer[x];
+		_mm256_storeu_si256(ptr, _mm256_sll_epi16(_mm256_loadu_si256(ptr), count));
+	}
+}
+
+static void rfx_quantization_decode_avx2(INT16* WINPR_RESTRICT buffer,
+                                         const UINT32* WINPR_RESTRICT quantVals)
+{
+	WINPR_ASSERT(buffer);
+	WINPR_ASSERT(quantVals);
+
+	rfx_quantization_decode_block_avx2(&buffer[0], 1024, quantVals[8] - 1);    /* HL1 */
+	rfx_quantization_decode_block_avx2(&buffer[1024], 1024, quantVals[7] - 1); /* LH1 */
+	rfx_quantization_decode_block_avx2(&buffer[2048], 1024, quantVals[9] - 1); /* HH1 */
+	rfx_quantization_decode_block_avx2(&buffer[3072], 256, quantVals[5] - 1);  /* HL2 */
+	rfx_quantization_decode_block_avx2(&buffer[3328], 256, quantVals[4] - 1);  /* LH2 */
+	rfx_quantization_decode_block_avx2(&buffer[3584], 256, quantVals[6] - 1);  /* HH2 */
+	rfx_quantization_decode_block_avx2(&buffer[3840], 64, quantVals[2] - 1);   /* HL3 */
+	rfx_quantization_decode_block_avx2(&buffer[3904], 64, quantVals[1] - 1);   /* LH3 */
+	rfx_quantization_decode_block_avx2(&buffer[3968], 64, quantVals[3] - 1);   /* HH3 */
+	rfx_quantization_decode_block_avx2(&buffer[4032], 64, quantVals[0] - 1);   /* LL3 */
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+rfx_quantization_encode_block_avx2(INT16* WINPR_RESTRICT buffer, size_t buffer_size, UINT32 factor)
+{
+	/* a factor of 0 adds 0 and shifts by 0, which leaves the coefficient alone */
+	const __m256i half =
+	    _mm256_set1_epi16(WINPR_ASSERTING_INT_CAST(INT16, factor ? 1 << (factor - 1) : 0));
+	const __m128i count = _mm_cvtsi32_si128(WINPR_ASSERTING_INT_CAST(int, factor));
+	const __m256i half5 = _mm256_set1_epi16(1 << 4);
+
+	for (size_t x = 0; x < buffer_size; x += 16)
+	{
+		__m256i* ptr = (__m256i*)&buffer[x];
+		__m256i a = _mm256_loadu_si256(ptr);
+		a = _mm256_sra_epi16(_mm256_add_epi16(a, half), count);
+		/* The coefficients are scaled by << 5 at RGB->YCbCr phase, round that back in the same
+		 * pass */
+		a = _mm256_srai_epi16(_mm256_add_epi16(a, half5), 5);
+		_mm256_storeu_si256(ptr, a);
+	}
+}
+
+static void rfx_quantization_encode_avx2(INT16* WINPR_RESTRICT buffer,
+                                         const UINT32* WINPR_RESTRICT quantization_values)
+{
+	WINPR_ASSERT(buffer);
+	WINPR_ASSERT(quantization_values);
+	for (size_t x = 0; x < 10; x++)
+	{
+		WINPR_ASSERT(quantization_values[x] >= 6);
+		WINPR_ASSERT(quantization_values[x] <= 15);
+	}
+
+	rfx_quantization_encode_block_avx2(buffer, 1024, quantization_values[8] - 6);        /* HL1 */
+	rfx_quantization_encode_block_avx2(buffer + 1024, 1024, quantization_values[7] - 6); /* LH1 */
+	rfx_quantization_encode_block_avx2(buffer + 2048, 1024, quantization_values[9] - 6); /* HH1 */
+	rfx_quantization_encode_block_avx2(buffer + 3072, 256, quantization_values[5] - 6);  /* HL2 */
+	rfx_quantization_encode_block_avx2(buffer + 3328, 256, quantization_values[4] - 6);  /* LH2 */
+	rfx_quantization_encode_block_avx2(buffer + 3584, 256, quantization_values[6] - 6);  /* HH2 */
+	rfx_quantization_encode_block_avx2(buffer + 3840, 64, quantization_values[2] - 6);   /* HL3 */
+	rfx_quantization_encode_block_avx2(buffer + 3904, 64, quantization_values[1] - 6);   /* LH3 */
+	rfx_quantization_encode_block_avx2(buffer + 3968, 64, quantization_values[3] - 6);   /* HH3 */
+	rfx_quantization_encode_block_avx2(buffer + 4032, 64, quantization_values[0] - 6);   /* LL3 */
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_decode_block_horiz_avx2(INT16* WINPR_RESTRICT l, const INT16* WINPR_RESTRICT h,
+                                   INT16* WINPR_RESTRICT dst, size_t subband_width)
+{
+	const size_t total_width = subband_width << 1;
+
+	for (size_t y = 0; y < subband_width; y += 2)
+	{
+		INT16* l0 = &l[y * subband_width];
+		INT16* l1 = l0 + subband_width;
+		const INT16* h0 = &h[y * subband_width];
+		const INT16* h1 = h0 + subband_width;
+		INT16* dst0 = &dst[y * total_width];
+		INT16* dst1 = dst0 + total_width;
+		__m256i h_prev = _mm256_setzero_si256();
+
+		/* Even coefficients, stored back to l */
+		for (size_t n = 0; n < subband_width; n += 8)
+		{
+			/* dst[2n] = l[n] - ((h[n-1] + h[n] + 1) >> 1); */
+			const __m256i l_n = mm256_load_rows(&l0[n], &l1[n]);
+			const __m256i h_n = mm256_load_rows(&h0[n], &h1[n]);
+			const __m256i prev = (n == 0) ? _mm256_slli_si256(h_n, 14) : h_prev;
+			const __m256i h_n_m = _mm256_alignr_epi8(h_n, prev, 14);
+
+			__m256i tmp_n = _mm256_add_epi16(h_n, h_n_m);
+			tmp_n = _mm256_add_epi16(tmp_n, _mm256_set1_epi16(1));
+			tmp_n = _mm256_srai_epi16(tmp_n, 1);
+			mm256_store_rows(&l0[n], &l1[n], _mm256_sub_epi16(l_n, tmp_n));
+			h_prev = h_n;
+		}
+
+		/* Odd coefficients, interleaved with the even ones into dst */
+		for (size_t n = 0; n < subband_width; n += 8)
+		{
+			/* dst[2n + 1] = (h[n] << 1) + ((dst[2n] + dst[2n + 2]) >> 1); */
+			const size_t next = (n + 8 == subband_width) ? n + 7 : n + 8;
+			const __m256i dst_n = mm256_load_rows(&l0[n], &l1[n]);
+			const __m256i h_n = _mm256_slli_epi16(mm256_load_rows(&h0[n], &h1[n]), 1);
+			const __m256i dst_n_p =
+			    _mm256_alignr_epi8(mm256_set_lanes_epi16(l0[next], l1[next]), dst_n, 2);
+
+			__m256i tmp_n = _mm256_add_epi16(dst_n_p, dst_n);
+			tmp_n = _mm256_srai_epi16(tmp_n, 1);
+			tmp_n = _mm256_add_epi16(tmp_n, h_n);
+
+			const __m256i lo = _mm256_unpacklo_epi16(dst_n, tmp_n);
+			const __m256i hi = _mm256_unpackhi_epi16(dst_n, tmp_n);
+			_mm256_storeu_si256((__m256i*)&dst0[2 * n], _mm256_permute2x128_si256(lo, hi, 0x20));
+			_mm256_storeu_si256((__m256i*)&dst1[2 * n], _mm256_permute2x128_si256(lo, hi, 0x31));
+		}
+	}
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_decode_block_vert_avx2(const INT16* WINPR_RESTRICT l, const INT16* WINPR_RESTRICT h,
+                                  INT16* WINPR_RESTRICT dst, size_t subband_width)
+{
+	const INT16* l_ptr = l;
+	const INT16* h_ptr = h;
+	INT16* dst_ptr = dst;
+	const size_t total_width = subband_width + subband_width;
+
+	/* Even coefficients */
+	for (size_t n = 0; n < subband_width; n++)
+	{
+		for (size_t x = 0; x < total_width; x += 16)
+		{
+			/* dst[2n] = l[n] - ((h[n-1] + h[n] + 1) >> 1); */
+			const __m256i l_n = _mm256_loadu_si256((const __m256i*)l_ptr);
+			const __m256i h_n = _mm256_loadu_si256((const __m256i*)h_ptr);
+			__m256i tmp_n = _mm256_add_epi16(h_n, _mm256_set1_epi16(1));
+
+			if (n == 0)
+				tmp_n = _mm256_add_epi16(tmp_n, h_n);
+			else
+			{
+				const __m256i h_n_m = _mm256_loadu_si256((const __m256i*)(h_ptr - total_width));
+				tmp_n = _mm256_add_epi16(tmp_n, h_n_m);
+			}
+
+			tmp_n = _mm256_srai_epi16(tmp_n, 1);
+			_mm256_storeu_si256((__m256i*)dst_ptr, _mm256_sub_epi16(l_n, tmp_n));
+			l_ptr += 16;
+			h_ptr += 16;
+			dst_ptr += 16;
+		}
+
+		dst_ptr += total_width;
+	}
+
+	h_ptr = h;
+	dst_ptr = dst + total_width;
+
+	/* Odd coefficients */
+	for (size_t n = 0; n < subband_width; n++)
+	{
+		for (size_t x = 0; x < total_width; x += 16)
+		{
+			/* dst[2n + 1] = (h[n] << 1) + ((dst[2n] + dst[2n + 2]) >> 1); */
+			__m256i h_n = _mm256_loadu_si256((const __m256i*)h_ptr);
+			const __m256i dst_n_m = _mm256_loadu_si256((const __m256i*)(dst_ptr - total_width));
+			h_n = _mm256_slli_epi16(h_n, 1);
+			__m256i tmp_n = dst_n_m;
+
+			if (n == subband_width - 1)
+				tmp_n = _mm256_add_epi16(tmp_n, dst_n_m);
+			else
+			{
+				const __m256i dst_n_p =
+				    _mm256_loadu_si256((const __m256i*)(dst_ptr + total_width));
+				tmp_n = _mm256_add_epi16(tmp_n, dst_n_p);
+			}
+
+			tmp_n = _mm256_srai_epi16(tmp_n, 1);
+			_mm256_storeu_si256((__m256i*)dst_ptr, _mm256_add_epi16(tmp_n, h_n));
+			h_ptr += 16;
+			dst_ptr += 16;
+		}
+
+		dst_ptr += total_width;
+	}
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_decode_block_avx2(INT16* WINPR_RESTRICT buffer, INT16* WINPR_RESTRICT idwt,
+                             size_t subband_width)
+{
+	/* Inverse DWT in horizontal direction, results in 2 sub-bands in L, H order in tmp buffer idwt.
+	 */
+	/* The 4 sub-bands are stored in HL(0), LH(1), HH(2), LL(3) order. */
+	/* The lower part L uses LL(3) and HL(0). */
+	/* The higher part H uses LH(1) and HH(2). */
+	INT16* ll = buffer + 3ULL * subband_width * subband_width;
+	INT16* hl = buffer;
+	INT16* l_dst = idwt;
+	rfx_dwt_2d_decode_block_horiz_avx2(ll, hl, l_dst, subband_width);
+	INT16* lh = buffer + 1ULL * subband_width * subband_width;
+	INT16* hh = buffer + 2ULL * subband_width * subband_width;
+	INT16* h_dst = idwt + 2ULL * subband_width * subband_width;
+	rfx_dwt_2d_decode_block_horiz_avx2(lh, hh, h_dst, subband_width);
+	/* Inverse DWT in vertical direction, results are stored in original buffer. */
+	rfx_dwt_2d_decode_block_vert_avx2(l_dst, h_dst, buffer, subband_width);
+}
+
+static void rfx_dwt_2d_decode_avx2(INT16* WINPR_RESTRICT buffer, INT16* WINPR_RESTRICT dwt_buffer)
+{
+	WINPR_ASSERT(buffer);
+	WINPR_ASSERT(dwt_buffer);
+
+	rfx_dwt_2d_decode_block_avx2(&buffer[3840], dwt_buffer, 8);
+	rfx_dwt_2d_decode_block_avx2(&buffer[3072], dwt_buffer, 16);
+	rfx_dwt_2d_decode_block_avx2(&buffer[0], dwt_buffer, 32);
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_encode_block_vert_avx2(const INT16* WINPR_RESTRICT src, INT16* WINPR_RESTRICT l,
+                                  INT16* WINPR_RESTRICT h, size_t subband_width)
+{
+	const size_t total_width = subband_width << 1;
+
+	for (size_t n = 0; n < subband_width; n++)
+	{
+		for (size_t x = 0; x < total_width; x += 16)
+		{
+			const __m256i src_2n = _mm256_loadu_si256((const __m256i*)src);
+			const __m256i src_2n_1 = _mm256_loadu_si256((const __m256i*)(src + total_width));
+			__m256i src_2n_2 = src_2n;
+
+			if (n < subband_width - 1)
+				src_2n_2 = _mm256_loadu_si256((const __m256i*)(src + 2ULL * total_width));
+
+			/* h[n] = (src[2n + 1] - ((src[2n] + src[2n + 2]) >> 1)) >> 1 */
+			__m256i h_n = _mm256_add_epi16(src_2n, src_2n_2);
+			h_n = _mm256_srai_epi16(h_n, 1);
+			h_n = _mm256_sub_epi16(src_2n_1, h_n);
+			h_n = _mm256_srai_epi16(h_n, 1);
+			_mm256_storeu_si256((__m256i*)h, h_n);
+
+			__m256i h_n_m = h_n;
+			if (n != 0)
+				h_n_m = _mm256_loadu_si256((const __m256i*)(h - total_width));
+
+			/* l[n] = src[2n] + ((h[n - 1] + h[n]) >> 1) */
+			__m256i l_n = _mm256_add_epi16(h_n_m, h_n);
+			l_n = _mm256_srai_epi16(l_n, 1);
+			l_n = _mm256_add_epi16(l_n, src_2n);
+			_mm256_storeu_si256((__m256i*)l, l_n);
+			src += 16;
+			l += 16;
+			h += 16;
+		}
+
+		src += total_width;
+	}
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_encode_block_horiz_avx2(const INT16* WINPR_RESTRICT src, INT16* WINPR_RESTRICT l,
+                                   INT16* WINPR_RESTRICT h, size_t subband_width)
+{
+	const size_t total_width = subband_width << 1;
+	/* moves the even coefficients of each lane to the low, the odd ones to the high 64 bit */
+	const __m256i deinterleave =
+	    _mm256_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15, 0, 1, 4, 5, 8, 9, 12,
+	                     13, 2, 3, 6, 7, 10, 11, 14, 15);
+
+	for (size_t y = 0; y < subband_width; y += 2)
+	{
+		const INT16* src0 = &src[y * total_width];
+		const INT16* src1 = src0 + total_width;
+		INT16* l0 = &l[y * subband_width];
+		INT16* l1 = l0 + subband_width;
+		INT16* h0 = &h[y * subband_width];
+		INT16* h1 = h0 + subband_width;
+		__m256i h_prev = _mm256_setzero_si256();
+
+		for (size_t n = 0; n < subband_width; n += 8)
+		{
+			const size_t x = n << 1;
+			const size_t next = (n + 8 == subband_width) ? x + 14 : x + 16;
+			const __m256i a =
+			    _mm256_shuffle_epi8(mm256_load_rows(&src0[x], &src1[x]), deinterleave);
+			const __m256i b =
+			    _mm256_shuffle_epi8(mm256_load_rows(&src0[x + 8], &src1[x + 8]), deinterleave);
+			const __m256i src_2n = _mm256_unpacklo_epi64(a, b);
+			const __m256i src_2n_1 = _mm256_unpackhi_epi64(a, b);
+			const __m256i src_2n_2 =
+			    _mm256_alignr_epi8(mm256_set_lanes_epi16(src0[next], src1[next]), src_2n, 2);
+
+			/* h[n] = (src[2n + 1] - ((src[2n] + src[2n + 2]) >> 1)) >> 1 */
+			__m256i h_n = _mm256_add_epi16(src_2n, src_2n_2);
+			h_n = _mm256_srai_epi16(h_n, 1);
+			h_n = _mm256_sub_epi16(src_2n_1, h_n);
+			h_n = _mm256_srai_epi16(h_n, 1);
+			mm256_store_rows(&h0[n], &h1[n], h_n);
+
+			const __m256i prev = (n == 0) ? _mm256_slli_si256(h_n, 14) : h_prev;
+			const __m256i h_n_m = _mm256_alignr_epi8(h_n, prev, 14);
+
+			/* l[n] = src[2n] + ((h[n - 1] + h[n]) >> 1) */
+			__m256i l_n = _mm256_add_epi16(h_n_m, h_n);
+			l_n = _mm256_srai_epi16(l_n, 1);
+			l_n = _mm256_add_epi16(l_n, src_2n);
+			mm256_store_rows(&l0[n], &l1[n], l_n);
+			h_prev = h_n;
+		}
+	}
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_encode_block_avx2(INT16* WINPR_RESTRICT buffer, INT16* WINPR_RESTRICT dwt,
+                             size_t subband_width)
+{
+	/* DWT in vertical direction, results in 2 sub-bands in L, H order in tmp buffer dwt. */
+	INT16* l_src = dwt;
+	INT16* h_src = dwt + 2ULL * subband_width * subband_width;
+	rfx_dwt_2d_encode_block_vert_avx2(buffer, l_src, h_src, subband_width);
+	/* DWT in horizontal direction, results in 4 sub-bands in HL(0), LH(1), HH(2), LL(3) order,
+	 * stored in original buffer. */
+	/* The lower part L generates LL(3) and HL(0). */
+	/* The higher part H generates LH(1) and HH(2). */
+	INT16* ll = buffer + 3ULL * subband_width * subband_width;
+	INT16* hl = buffer;
+	INT16* lh = buffer + 1ULL * subband_width * subband_width;
+	INT16* hh = buffer + 2ULL * subband_width * subband_width;
+	rfx_dwt_2d_encode_block_horiz_avx2(l_src, ll, hl, subband_width);
+	rfx_dwt_2d_encode_block_horiz_avx2(h_src, lh, hh, subband_width);
+}
+
+static void rfx_dwt_2d_encode_avx2(INT16* WINPR_RESTRICT buffer, INT16* WINPR_RESTRICT dwt_buffer)
+{
+	WINPR_ASSERT(buffer);
+	WINPR_ASSERT(dwt_buffer);
+
+	rfx_dwt_2d_encode_block_avx2(buffer, dwt_buffer, 32);
+	rfx_dwt_2d_encode_block_avx2(buffer + 3072, dwt_buffer, 16);
+	rfx_dwt_2d_encode_block_avx2(buffer + 3840, dwt_buffer, 8);
+}
+
+static void rfx_encode_format_rgb_avx2(const BYTE* WINPR_RESTRICT rgb_data, uint32_t width,
+                                       uint32_t height, uint32_t rowstride, UINT32 pixel_format,
+                                       const BYTE* WINPR_RESTRICT palette,
+                                       INT16* WINPR_RESTRICT r_buf, INT16* WINPR_RESTRICT g_buf,
+                                       INT16* WINPR_RESTRICT b_buf)
+{
+	size_t r = 0;
+	size_t g = 0;
+	size_t b = 0;
+
+	/* byte offsets of the color channels in a pixel, other formats are left to the generic code */
+	switch (pixel_format)
+	{
+		case PIXEL_FORMAT_BGRX32:
+		case PIXEL_FORMAT_BGRA32:
+			b = 0;
+			g = 1;
+			r = 2;
+			break;
+
+		case PIXEL_FORMAT_XBGR32:
+		case PIXEL_FORMAT_ABGR32:
+			b = 1;
+			g = 2;
+			r = 3;
+			break;
+
+		case PIXEL_FORMAT_RGBX32:
+		case PIXEL_FORMAT_RGBA32:
+			r = 0;
+			g = 1;
+			b = 2;
+			break;
+
+		case PIXEL_FORMAT_XRGB32:
+		case PIXEL_FORMAT_ARGB32:
+			r = 1;
+			g = 2;
+			b = 3;
+			break;
+
+		default:
+			rfx_encode_format_rgb(rgb_data, width, height, rowstride, pixel_format, palette, r_buf,
+			                      g_buf, b_buf);
+			return;
+	}
+
+	WINPR_ASSERT((width > 0) && (width <= 64));
+	WINPR_ASSERT((height > 0) && (height <= 64));
+
+	/* gathers the bytes of each channel of 4 pixels per lane into a 32 bit element ... */
+	const __m256i shuffle = _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+	                                         0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+	/* ... and the channels of all 8 pixels into a 64 bit element */
+	const __m256i permute = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const BYTE* src = &rgb_data[1ULL * y * rowstride];
+		INT16* planes[4] = { 0 };
+		planes[r] = &r_buf[64ULL * y];
+		planes[g] = &g_buf[64ULL * y];
+		planes[b] = &b_buf[64ULL * y];
+		uint32_t x = 0;
+
+		for (; x + 16 <= width; x += 16)
+		{
+			__m256i p0 = _mm256_loadu_si256((const __m256i*)&src[4ULL * x]);
+			__m256i p1 = _mm256_loadu_si256((const __m256i*)&src[4ULL * x + 32]);
+			p0 = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(p0, shuffle), permute);
+			p1 = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(p1, shuffle), permute);
+
+			/* channels 0 and 2, 1 and 3 of all 16 pixels */
+			const __m256i c02 = _mm256_unpacklo_epi64(p0, p1);
+			const __m256i c13 = _mm256_unpackhi_epi64(p0, p1);
+			const __m256i c[4] = { _mm256_cvtepu8_epi16(_mm256_castsi256_si128(c02)),
+				                   _mm256_cvtepu8_epi16(_mm256_castsi256_si128(c13)),
+				                   _mm256_cvtepu8_epi16(_mm256_extracti128_si256(c02, 1)),
+				                   _mm256_cvtepu8_epi16(_mm256_extracti128_si256(c13, 1)) };
+
+			for (size_t channel = 0; channel < ARRAYSIZE(c); channel++)
+			{
+				if (planes[channel])
+					_mm256_storeu_si256((__m256i*)&planes[channel][x], c[channel]);
+			}
+		}
+
+		for (; x < width; x++)
+		{
+			r_buf[64ULL * y + x] = src[4ULL * x + r];
+			g_buf[64ULL * y + x] = src[4ULL * x + g];
+			b_buf[64ULL * y + x] = src[4ULL * x + b];
+		}
+
+		/* Fill the horizontal region outside of 64x64 tile size with the right-most pixel for
+		 * best quality */
+		for (; x < 64; x++)
+		{
+			r_buf[64ULL * y + x] = r_buf[64ULL * y + width - 1];
+			g_buf[64ULL * y + x] = g_buf[64ULL * y + width - 1];
+			b_buf[64ULL * y + x] = b_buf[64ULL * y + width - 1];
+		}
+	}
+
+	/* Fill the vertical region outside of 64x64 tile size with the last line. */
+	for (uint32_t y = height; y < 64; y++)
+	{
+		memcpy(&r_buf[64ULL * y], &r_buf[64ULL * (height - 1)], 64 * sizeof(INT16));
+		memcpy(&g_buf[64ULL * y], &g_buf[64ULL * (height - 1)], 64 * sizeof(INT16));
+		memcpy(&b_buf[64ULL * y], &b_buf[64ULL * (height - 1)], 64 * sizeof(INT16));
+	}
+}
+#endif
+
+void rfx_init_avx2(RFX_CONTEXT* context)
+{
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+	if (!IsProcessorFeaturePresent(PF_AVX2_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	PROFILER_RENAME(context->priv->prof_rfx_quantization_decode, "rfx_quantization_decode_avx2")
+	PROFILER_RENAME(context->priv->prof_rfx_quantization_encode, "rfx_quantization_encode_avx2")
+	PROFILER_RENAME(context->priv->prof_rfx_dwt_2d_decode, "rfx_dwt_2d_decode_avx2")
+	PROFILER_RENAME(context->priv->prof_rfx_dwt_2d_encode, "rfx_dwt_2d_encode_avx2")
+	PROFILER_RENAME(context->priv->prof_rfx_encode_format_rgb, "rfx_encode_format_rgb_avx2")
+	context->quantization_decode = rfx_quantization_decode_avx2;
+	context->quantization_encode = rfx_quantization_encode_avx2;
+	context->dwt_2d_decode = rfx_dwt_2d_decode_avx2;
+	context->dwt_2d_encode = rfx_dwt_2d_encode_avx2;
+	context->encode_format_rgb = rfx_encode_format_rgb_avx2;
+#else
+	WINPR_UNUSED(context);
+#endif
+}
@@ -68,6 +68,116 @@ fail:
 	return rc;
 }
 
+/* lines of 12 pixel high glyphs separated by blank rows */
+static void fill_text_like(BYTE* data, UINT32 width, UINT32 height, UINT32 seed)
+{
+	for (UINT32 y = 0; y < height; y++)
+	{
+		for (UINT32 x = 0; x < width; x++)
+		{
+			BYTE* pixel = &data[(1ULL * y * width + x) * 4];
+			const UINT32 letter = ((x / 8) * 7 + (y / 16) * 3 + seed) % 5;
+			const UINT32 gx = x % 8;
+			const UINT32 gy = y % 16;
+			const BOOL ink =
+			    (gy < 12) && (gx < 6) && (((gx + 1) * (gy + 3) * (letter + 2)) % 7 < 3);
+
+			pixel[0] = ink ? (BYTE)(letter * 40) : 0xFF;
+			pixel[1] = ink ? 0x20 : 0xFF;
+			pixel[2] = ink ? 0x20 : 0xFF;
+			pixel[3] = 0xFF;
+		}
+	}
+}
+
+static void fill_photo_like(BYTE* data, UINT32 width, UINT32 height, UINT32 seed)
+{
+	UINT32 state = seed;
+
+	for (size_t x = 0; x < 4ULL * width * height; x++)
+	{
+		state = state * 1103515245u + 12345u;
+		data[x] = (BYTE)(state >> 16);
+	}
+}
+
+static BOOL test_ClearRoundTripImage(CLEAR_CONTEXT* encoder, CLEAR_CONTEXT* decoder,
+                                     const BYTE* pSrcData, UINT32 width, UINT32 height)
+{
+	BOOL rc = FALSE;
+	wStream* s = Stream_New(NULL, 1024);
+	BYTE* pDstData = calloc(4ULL * width, height);
+
+	if (!s || !pDstData)
+		goto fail;
+
+	if (clear_compress_to_stream(encoder, s, pSrcData, PIXEL_FORMAT_BGRA32, 4 * width, width,
+	                             height) != 0)
+		goto fail;
+
+	if (clear_decompress(decoder, Stream_Buffer(s), (UINT32)Stream_GetPosition(s), width, height,
+	                     pDstData, PIXEL_FORMAT_BGRA32, 4 * width, 0, 0, width, height, NULL) != 0)
+		goto fail;
+
+	for (size_t x = 0; x < 1ULL * width * height; x++)
+	{
+		if (memcmp(&pSrcData[x * 4], &pDstData[x * 4], 3) != 0)
+		{
+			(void)fprintf(stderr, "clear round trip %" PRIu32 "x%" PRIu32 " mismatch at %" PRIuz
+			                      "\n",
+			              width, height, x);
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	Stream_Free(s, TRUE);
+	free(pDstData);
+	return rc;
+}
+
+static BOOL test_ClearRoundTrip(void)
+{
+	BOOL rc = FALSE;
+	const UINT32 sizes[][2] = { { 1, 1 }, { 8, 9 }, { 64, 64 }, { 320, 117 }, { 1024, 60 } };
+	CLEAR_CONTEXT* encoder = clear_context_new(TRUE);
+	CLEAR_CONTEXT* decoder = clear_context_new(FALSE);
+	BYTE* data = calloc(4ULL * 1024, 117);
+
+	if (!encoder || !decoder || !data)
+		goto fail;
+
+	/* repeated frames exercise the glyph and vBar cache hits */
+	for (UINT32 pass = 0; pass < 3; pass++)
+	{
+		for (size_t x = 0; x < ARRAYSIZE(sizes); x++)
+		{
+			const UINT32 width = sizes[x][0];
+			const UINT32 height = sizes[x][1];
+
+			memset(data, 0x7F, 4ULL * width * height);
+			if (!test_ClearRoundTripImage(encoder, decoder, data, width, height))
+				goto fail;
+
+			fill_text_like(data, width, height, pass % 2);
+			if (!test_ClearRoundTripImage(encoder, decoder, data, width, height))
+				goto fail;
+
+			fill_photo_like(data, width, height, pass);
+			if (!test_ClearRoundTripImage(encoder, decoder, data, width, height))
+				goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	clear_context_free(encoder);
+	clear_context_free(decoder);
+	free(data);
+	return rc;
+}
+
 int TestFreeRDPCodecClear(int argc, char* argv[])
 {
 	WINPR_UNUSED(argc);
@@ -87,5 +197,8 @@ int TestFreeRDPCodecClear(int argc, char* argv[])
 	if (!test_ClearDecompressExample(4, 7, 15, TEST_CLEAR_EXAMPLE_4, sizeof(TEST_CLEAR_EXAMPLE_4)))
 		return -1;
 
+	if (!test_ClearRoundTrip())
+		return -1;
+
 	return 0;
 }
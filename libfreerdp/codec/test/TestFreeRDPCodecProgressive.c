@@ -1120,6 +1120,129 @@ fail:
 	return res;
 }
 
+static BOOL test_encode_decode_surface(PROGRESSIVE_CONTEXT* progressiveEnc,
+                                       PROGRESSIVE_CONTEXT* progressiveDec, const wImage* image,
+                                       BYTE* resultData, UINT32* frameId, UINT32* firstSize)
+{
+	BYTE* dstData = NULL;
+	UINT32 dstSize = 0;
+	REGION16 invalidRegion = { 0 };
+	const UINT32 ColorFormat = PIXEL_FORMAT_BGRX32;
+
+	region16_init(&invalidRegion);
+	int rc = progressive_compress_surface(progressiveEnc, 0, image->data,
+	                                      image->scanline * image->height, ColorFormat,
+	                                      image->width, image->height, image->scanline, NULL,
+	                                      &dstData, &dstSize);
+	if (rc <= 0)
+		goto fail;
+
+	*firstSize = dstSize;
+	rc = progressive_decompress(progressiveDec, dstData, dstSize, resultData, ColorFormat,
+	                            image->scanline, 0, 0, &invalidRegion, 0, (*frameId)++);
+	if (rc < 0)
+		goto fail;
+
+	/* a few tiles per pass, the decoder must follow every quality step */
+	while (progressive_get_pending_upgrades(progressiveEnc, 0) > 0)
+	{
+		rc = progressive_compress_upgrade(progressiveEnc, 0, 7, &dstData, &dstSize);
+		if (rc <= 0)
+			goto fail;
+
+		rc = progressive_decompress(progressiveDec, dstData, dstSize, resultData, ColorFormat,
+		                            image->scanline, 0, 0, &invalidRegion, 0, (*frameId)++);
+		if (rc < 0)
+			goto fail;
+	}
+
+	rc = progressive_compress_upgrade(progressiveEnc, 0, 0, &dstData, &dstSize);
+fail:
+	region16_uninit(&invalidRegion);
+	return rc == 0;
+}
+
+static BOOL test_encode_decode_passes(const char* path)
+{
+	BOOL res = FALSE;
+	UINT32 frameId = 0;
+	UINT32 singleSize = 0;
+	UINT32 firstSize = 0;
+	BYTE* singleData = NULL;
+	BYTE* resultData = NULL;
+	wImage* image = winpr_image_new();
+	char* name = GetCombinedPath(path, "progressive.bmp");
+	PROGRESSIVE_CONTEXT* progressiveEnc = progressive_context_new(TRUE);
+	PROGRESSIVE_CONTEXT* progressiveDec = progressive_context_new(FALSE);
+
+	if (!image || !name || !progressiveEnc || !progressiveDec)
+		goto fail;
+
+	if (winpr_image_read(image, name) <= 0)
+		goto fail;
+
+	singleData = calloc(image->scanline, image->height);
+	resultData = calloc(image->scanline, image->height);
+	if (!singleData || !resultData)
+		goto fail;
+
+	if (progressive_create_surface_context(progressiveDec, 0, image->width, image->height) <= 0)
+		goto fail;
+
+	/* a single pass leaves nothing to upgrade */
+	if (!test_encode_decode_surface(progressiveEnc, progressiveDec, image, singleData, &frameId,
+	                                &singleSize))
+		goto fail;
+
+	for (size_t y = 0; y < image->height; y++)
+	{
+		for (size_t x = 0; x < image->width; x++)
+		{
+			const DWORD a = FreeRDPReadColor(&image->data[y * image->scanline + x * 4],
+			                                 PIXEL_FORMAT_BGRX32);
+			const DWORD b = FreeRDPReadColor(&singleData[y * image->scanline + x * 4],
+			                                 PIXEL_FORMAT_BGRX32);
+			if (!colordiff(PIXEL_FORMAT_BGRX32, a, b))
+			{
+				printf("single pass [%" PRIuz ":%" PRIuz "] %08" PRIX32 " != %08" PRIX32 "\n", x,
+				       y, a, b);
+				goto fail;
+			}
+		}
+	}
+
+	/* the passes add up to exactly what the single pass sends */
+	if (!progressive_context_set_passes(progressiveEnc, 4))
+		goto fail;
+
+	if (!test_encode_decode_surface(progressiveEnc, progressiveDec, image, resultData, &frameId,
+	                                &firstSize))
+		goto fail;
+
+	if (firstSize >= singleSize)
+	{
+		printf("first pass %" PRIu32 " bytes, single pass %" PRIu32 " bytes\n", firstSize,
+		       singleSize);
+		goto fail;
+	}
+
+	if (memcmp(singleData, resultData, 1ull * image->scanline * image->height) != 0)
+	{
+		printf("multi pass result differs from the single pass result\n");
+		goto fail;
+	}
+
+	res = TRUE;
+fail:
+	progressive_context_free(progressiveEnc);
+	progressive_context_free(progressiveDec);
+	winpr_image_free(image, TRUE);
+	free(singleData);
+	free(resultData);
+	free(name);
+	return res;
+}
+
 static BOOL read_cmd(FILE* fp, RDPGFX_SURFACE_COMMAND* cmd, UINT32* frameId)
 {
 	WINPR_ASSERT(fp);
@@ -1463,6 +1586,8 @@ int TestFreeRDPCodecProgressive(int argc, char* argv[])
 		    */
 		if (!test_encode_decode(ms_sample_path))
 			goto fail;
+		if (!test_encode_decode_passes(ms_sample_path))
+			goto fail;
 		rc = 0;
 	}
 
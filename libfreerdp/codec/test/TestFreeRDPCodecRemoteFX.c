@@ -842,6 +842,243 @@ static BOOL fuzzyCompareImage(const UINT32* crefImage, const BYTE* img, size_t n
 	return TRUE;
 }
 
+static BOOL decode_message(wStream* s, BYTE* dest, size_t stride)
+{
+	REGION16 region = { 0 };
+	RFX_CONTEXT* context = rfx_context_new(FALSE);
+
+	if (!context)
+		return FALSE;
+
+	region16_init(&region);
+	const BOOL rc = rfx_process_message(context, Stream_Buffer(s),
+	                                    (UINT32)Stream_GetPosition(s), 0, 0, dest, FORMAT,
+	                                    (UINT32)stride, IMG_HEIGHT, &region);
+	region16_uninit(&region);
+	rfx_context_free(context);
+	return rc;
+}
+
+/* Frame data written after rfx_write_message_header must decode behind the headers of any
+ * other encoder context */
+static BOOL test_shared_frame_data(void)
+{
+	BOOL rc = FALSE;
+	const size_t stride = FORMAT_SIZE * IMG_WIDTH;
+	const RFX_RECT rect = { 0, 0, IMG_WIDTH, IMG_HEIGHT };
+	RFX_CONTEXT* encoder = rfx_context_new(TRUE);
+	RFX_CONTEXT* other = rfx_context_new(TRUE);
+	RFX_MESSAGE* message = NULL;
+	wStream* s = Stream_New(NULL, 1024);
+	wStream* shared = Stream_New(NULL, 1024);
+	BYTE* dest = calloc(IMG_WIDTH * IMG_HEIGHT, FORMAT_SIZE);
+	BYTE* sharedDest = calloc(IMG_WIDTH * IMG_HEIGHT, FORMAT_SIZE);
+
+	if (!encoder || !other || !s || !shared || !dest || !sharedDest)
+		goto fail;
+
+	rfx_context_set_pixel_format(encoder, FORMAT);
+	if (!rfx_context_reset(encoder, IMG_WIDTH, IMG_HEIGHT) ||
+	    !rfx_context_reset(other, IMG_WIDTH, IMG_HEIGHT))
+		goto fail;
+
+	message = rfx_encode_message(encoder, &rect, 1, (const BYTE*)srefImage, IMG_WIDTH,
+	                             IMG_HEIGHT, stride);
+	if (!message)
+		goto fail;
+
+	if (!rfx_write_message_header(encoder, s))
+		goto fail;
+
+	const size_t start = Stream_GetPosition(s);
+	if (start == 0)
+		goto fail;
+
+	/* headers are only written once per reset */
+	if (!rfx_write_message_header(encoder, s) || (Stream_GetPosition(s) != start))
+		goto fail;
+
+	if (!rfx_write_message(encoder, s, message))
+		goto fail;
+
+	if (!rfx_write_message_header(other, shared) || (Stream_GetPosition(shared) != start) ||
+	    !Stream_EnsureRemainingCapacity(shared, Stream_GetPosition(s) - start))
+		goto fail;
+
+	Stream_Write(shared, Stream_Buffer(s) + start, Stream_GetPosition(s) - start);
+
+	if (!decode_message(s, dest, stride) || !decode_message(shared, sharedDest, stride))
+		goto fail;
+
+	rc = (memcmp(dest, sharedDest, IMG_WIDTH * IMG_HEIGHT * FORMAT_SIZE) == 0);
+fail:
+	if (message)
+		rfx_message_free(encoder, message);
+	rfx_context_free(encoder);
+	rfx_context_free(other);
+	Stream_Free(s, TRUE);
+	Stream_Free(shared, TRUE);
+	free(dest);
+	free(sharedDest);
+	return rc;
+}
+
+static BOOL encode_frame(RFX_CONTEXT* encoder, const BYTE* image, UINT32 width, UINT32 height,
+                         wStream* s)
+{
+	const RFX_RECT rect = { 0, 0, (UINT16)width, (UINT16)height };
+	RFX_MESSAGE* message =
+	    rfx_encode_message(encoder, &rect, 1, image, width, height, FORMAT_SIZE * width);
+
+	if (!message)
+		return FALSE;
+
+	Stream_SetPosition(s, 0);
+	const BOOL rc = rfx_write_message(encoder, s, message);
+	rfx_message_free(encoder, message);
+	return rc;
+}
+
+/* The tile cache must produce exactly the same stream as encoding every tile */
+static BOOL test_tile_cache(void)
+{
+	BOOL rc = FALSE;
+	/* all tiles are new in the first frame, the second reuses all of them and the third
+	 * encodes the changed tile again */
+	const UINT64 expectedHits[] = { 0, 6, 11, 17 };
+	const UINT64 expectedMisses[] = { 6, 6, 7, 7 };
+	const UINT32 width = 3 * IMG_WIDTH;
+	const UINT32 height = 2 * IMG_HEIGHT;
+	const size_t stride = FORMAT_SIZE * width;
+	RFX_CONTEXT* plain = rfx_context_new(TRUE);
+	RFX_CONTEXT* cached = rfx_context_new(TRUE);
+	wStream* s = Stream_New(NULL, 1024);
+	wStream* cachedStream = Stream_New(NULL, 1024);
+	BYTE* image = calloc(height, stride);
+
+	if (!plain || !cached || !s || !cachedStream || !image)
+		goto fail;
+
+	/* identical tiles except for the last one */
+	for (size_t y = 0; y < height; y++)
+	{
+		for (size_t x = 0; x < width; x++)
+		{
+			UINT32 color = srefImage[(y % IMG_HEIGHT) * IMG_WIDTH + (x % IMG_WIDTH)];
+			if ((x >= 2 * IMG_WIDTH) && (y >= IMG_HEIGHT))
+				color ^= 0x00ff00ff;
+			memcpy(&image[y * stride + x * FORMAT_SIZE], &color, sizeof(color));
+		}
+	}
+
+	rfx_context_set_pixel_format(plain, FORMAT);
+	rfx_context_set_pixel_format(cached, FORMAT);
+	if (!rfx_context_reset(plain, width, height) || !rfx_context_reset(cached, width, height) ||
+	    !rfx_context_set_tile_cache_size(cached, 6))
+		goto fail;
+
+	for (size_t frame = 0; frame < ARRAYSIZE(expectedHits); frame++)
+	{
+		/* change a single pixel to invalidate one cached tile */
+		if (frame == 2)
+			image[IMG_WIDTH * FORMAT_SIZE + 1] ^= 0x40;
+
+		if (!encode_frame(plain, image, width, height, s) ||
+		    !encode_frame(cached, image, width, height, cachedStream))
+			goto fail;
+
+		if ((Stream_GetPosition(s) != Stream_GetPosition(cachedStream)) ||
+		    (memcmp(Stream_Buffer(s), Stream_Buffer(cachedStream), Stream_GetPosition(s)) != 0))
+		{
+			printf("tile cache frame %" PRIuz " differs\n", frame);
+			goto fail;
+		}
+
+		UINT64 hits = 0;
+		UINT64 misses = 0;
+		if (!rfx_context_get_tile_cache_stats(cached, &hits, &misses))
+			goto fail;
+
+		if ((hits != expectedHits[frame]) || (misses != expectedMisses[frame]))
+		{
+			printf("tile cache frame %" PRIuz ": %" PRIu64 " hits, %" PRIu64 " misses\n", frame,
+			       hits, misses);
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	rfx_context_free(plain);
+	rfx_context_free(cached);
+	Stream_Free(s, TRUE);
+	Stream_Free(cachedStream, TRUE);
+	free(image);
+	return rc;
+}
+
+/* Coarser quantization values must be used for the following messages and shrink them */
+static BOOL test_quantization(void)
+{
+	BOOL rc = FALSE;
+	const size_t stride = FORMAT_SIZE * IMG_WIDTH;
+	const UINT32 invalid[] = { 6, 6, 6, 6, 7, 7, 8, 8, 8, 16 };
+	const UINT32 coarse[] = { 9, 9, 9, 10, 10, 10, 11, 12, 12, 13 };
+	RFX_CONTEXT* encoder = rfx_context_new(TRUE);
+	RFX_CONTEXT* decoder = rfx_context_new(FALSE);
+	wStream* s = Stream_New(NULL, 1024);
+	BYTE* dest = calloc(IMG_WIDTH * IMG_HEIGHT, FORMAT_SIZE);
+
+	if (!encoder || !decoder || !s || !dest)
+		goto fail;
+
+	rfx_context_set_pixel_format(encoder, FORMAT);
+	if (!rfx_context_reset(encoder, IMG_WIDTH, IMG_HEIGHT) ||
+	    !rfx_context_set_tile_cache_size(encoder, 1))
+		goto fail;
+
+	if (rfx_context_set_quantization(decoder, coarse) ||
+	    rfx_context_set_quantization(encoder, invalid))
+		goto fail;
+
+	if (!encode_frame(encoder, (const BYTE*)srefImage, IMG_WIDTH, IMG_HEIGHT, s))
+		goto fail;
+	const size_t fine = Stream_GetPosition(s);
+
+	/* the headers are sent again after a reset, the quantization values are kept */
+	if (!rfx_context_set_quantization(encoder, coarse) ||
+	    !rfx_context_reset(encoder, IMG_WIDTH, IMG_HEIGHT))
+		goto fail;
+
+	const RFX_RECT rect = { 0, 0, IMG_WIDTH, IMG_HEIGHT };
+	RFX_MESSAGE* message = rfx_encode_message(encoder, &rect, 1, (const BYTE*)srefImage,
+	                                          IMG_WIDTH, IMG_HEIGHT, stride);
+	if (!message)
+		goto fail;
+
+	UINT16 numQuant = 0;
+	const UINT32* quants = rfx_message_get_quants(message, &numQuant);
+	const BOOL used = (numQuant == 1) && (memcmp(quants, coarse, sizeof(coarse)) == 0);
+	Stream_SetPosition(s, 0);
+	const BOOL written = rfx_write_message(encoder, s, message);
+	rfx_message_free(encoder, message);
+
+	if (!used || !written || (Stream_GetPosition(s) >= fine))
+	{
+		printf("quantization not applied (%" PRIuz " >= %" PRIuz " bytes)\n",
+		       Stream_GetPosition(s), fine);
+		goto fail;
+	}
+
+	rc = decode_message(s, dest, stride);
+fail:
+	rfx_context_free(encoder);
+	rfx_context_free(decoder);
+	Stream_Free(s, TRUE);
+	free(dest);
+	return rc;
+}
+
 int TestFreeRDPCodecRemoteFX(int argc, char* argv[])
 {
 	int rc = -1;
@@ -885,6 +1122,15 @@ int TestFreeRDPCodecRemoteFX(int argc, char* argv[])
 	if (!fuzzyCompareImage(srefImage, dest, IMG_WIDTH * IMG_HEIGHT))
 		goto fail;
 
+	if (!test_shared_frame_data())
+		goto fail;
+
+	if (!test_tile_cache())
+		goto fail;
+
+	if (!test_quantization())
+		goto fail;
+
 	rc = 0;
 fail:
 	region16_uninit(&region);
@@ -0,0 +1,253 @@
+#include <freerdp/config.h>
+
+#include <winpr/crt.h>
+#include <winpr/crypto.h>
+
+#include <freerdp/codec/color.h>
+#include <freerdp/codec/rfx.h>
+
+#include "../rfx_types.h"
+#include "../rfx_dwt.h"
+#include "../rfx_encode.h"
+#include "../rfx_quantization.h"
+#include "../rfx_rlgr.h"
+#include "../sse/rfx_sse2.h"
+#include "../sse/rfx_avx2.h"
+#include "../neon/rfx_neon.h"
+
+typedef struct
+{
+	const char* name;
+	void (*init)(RFX_CONTEXT* context);
+} RFX_KERNELS;
+
+static const RFX_KERNELS kernels[] = { { "sse2", rfx_init_sse2 },
+#if defined(WITH_AVX2)
+	                                   { "avx2", rfx_init_avx2 },
+#endif
+	                                   { "neon", rfx_init_neon } };
+
+static void set_generic(RFX_CONTEXT* context)
+{
+	context->quantization_decode = rfx_quantization_decode;
+	context->quantization_encode = rfx_quantization_encode;
+	context->dwt_2d_decode = rfx_dwt_2d_decode;
+	context->dwt_2d_encode = rfx_dwt_2d_encode;
+	context->rlgr_decode = rfx_rlgr_decode;
+	context->rlgr_encode = rfx_rlgr_encode;
+	context->encode_format_rgb = rfx_encode_format_rgb;
+}
+
+/* fills the buffer with values in [-range, range) */
+static void fill_random(INT16* buffer, size_t count, UINT16 range)
+{
+	winpr_RAND(buffer, count * sizeof(INT16));
+
+	for (size_t x = 0; x < count; x++)
+		buffer[x] = (INT16)(((UINT16)buffer[x] % (2 * range)) - range);
+}
+
+static BOOL compare(const char* name, const char* what, const INT16* expected, const INT16* actual,
+                    size_t count)
+{
+	for (size_t x = 0; x < count; x++)
+	{
+		if (expected[x] != actual[x])
+		{
+			(void)fprintf(stderr, "[%s] %s mismatch at %" PRIuz ": expected %" PRId16 ", got %" PRId16 "\n",
+			              name, what, x, expected[x], actual[x]);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* values are kept small enough that no stage of the transform overflows 16 bit */
+static BOOL test_dwt(const char* name, const RFX_CONTEXT* context, INT16* expected, INT16* actual,
+                     INT16* temp)
+{
+	for (size_t iteration = 0; iteration < 16; iteration++)
+	{
+		fill_random(expected, 4096, 2048);
+		memcpy(actual, expected, 4096 * sizeof(INT16));
+		rfx_dwt_2d_encode(expected, temp);
+		context->dwt_2d_encode(actual, temp);
+
+		if (!compare(name, "dwt_2d_encode", expected, actual, 4096))
+			return FALSE;
+
+		fill_random(expected, 4096, 64);
+		memcpy(actual, expected, 4096 * sizeof(INT16));
+		rfx_dwt_2d_decode(expected, temp);
+		context->dwt_2d_decode(actual, temp);
+
+		if (!compare(name, "dwt_2d_decode", expected, actual, 4096))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL test_quantization(const char* name, const RFX_CONTEXT* context, INT16* expected,
+                              INT16* actual)
+{
+	const UINT32 quantVals[][10] = { { 6, 6, 6, 6, 7, 7, 8, 8, 8, 9 },
+		                             { 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+		                             { 15, 15, 15, 15, 15, 15, 15, 15, 15, 15 } };
+
+	for (size_t x = 0; x < ARRAYSIZE(quantVals); x++)
+	{
+		fill_random(expected, 4096, 8192);
+		memcpy(actual, expected, 4096 * sizeof(INT16));
+		rfx_quantization_encode(expected, quantVals[x]);
+		context->quantization_encode(actual, quantVals[x]);
+
+		if (!compare(name, "quantization_encode", expected, actual, 4096))
+			return FALSE;
+	}
+
+	fill_random(expected, 4096, 8);
+	memcpy(actual, expected, 4096 * sizeof(INT16));
+	rfx_quantization_decode(expected, quantVals[0]);
+	context->quantization_decode(actual, quantVals[0]);
+	return compare(name, "quantization_decode", expected, actual, 4096);
+}
+
+static BOOL test_format_rgb(const char* name, const RFX_CONTEXT* context, INT16* expected,
+                            INT16* actual)
+{
+	const UINT32 formats[] = { PIXEL_FORMAT_BGRX32, PIXEL_FORMAT_BGRA32, PIXEL_FORMAT_XBGR32,
+		                       PIXEL_FORMAT_ABGR32, PIXEL_FORMAT_RGBX32, PIXEL_FORMAT_RGBA32,
+		                       PIXEL_FORMAT_XRGB32, PIXEL_FORMAT_ARGB32, PIXEL_FORMAT_BGR24,
+		                       PIXEL_FORMAT_RGB16 };
+	const UINT32 sizes[][2] = { { 64, 64 }, { 63, 64 }, { 64, 31 }, { 17, 9 }, { 16, 16 }, { 1, 1 } };
+	const UINT32 stride = 64 * 4;
+	BYTE data[64ULL * 64 * 4] = { 0 };
+
+	winpr_RAND(data, sizeof(data));
+
+	for (size_t x = 0; x < ARRAYSIZE(formats); x++)
+	{
+		for (size_t y = 0; y < ARRAYSIZE(sizes); y++)
+		{
+			char what[128] = { 0 };
+			const UINT32 width = sizes[y][0];
+			const UINT32 height = sizes[y][1];
+
+			memset(expected, 0, 3ULL * 4096 * sizeof(INT16));
+			memset(actual, 0xFF, 3ULL * 4096 * sizeof(INT16));
+			rfx_encode_format_rgb(data, width, height, stride, formats[x], NULL, &expected[0],
+			                      &expected[4096], &expected[8192]);
+			context->encode_format_rgb(data, width, height, stride, formats[x], NULL, &actual[0],
+			                           &actual[4096], &actual[8192]);
+
+			(void)_snprintf(what, sizeof(what), "encode_format_rgb %s %" PRIu32 "x%" PRIu32,
+			                FreeRDPGetColorFormatName(formats[x]), width, height);
+
+			if (!compare(name, what, expected, actual, 3ULL * 4096))
+				return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* RLGR is not vectorized, it has to decode what the encoder wrote */
+static BOOL test_rlgr(INT16* coefficients, INT16* decoded)
+{
+	const RLGR_MODE modes[] = { RLGR1, RLGR3 };
+	BYTE* buffer = calloc(16384, sizeof(BYTE));
+
+	if (!buffer)
+		return FALSE;
+
+	for (size_t x = 0; x < ARRAYSIZE(modes); x++)
+	{
+		for (size_t iteration = 0; iteration < 64; iteration++)
+		{
+			BYTE rnd[4096] = { 0 };
+			winpr_RAND(rnd, sizeof(rnd));
+
+			/* mostly zeros with the occasional burst, like quantized wavelet coefficients */
+			for (size_t y = 0; y < 4096; y++)
+			{
+				const INT16 mag = (INT16)(rnd[y] % (1u << (rnd[(y + 1) % 4096] % 11)));
+				coefficients[y] = (rnd[y] < (iteration % 4) * 64) ? 0 : mag;
+
+				if (rnd[y] & 1)
+					coefficients[y] = (INT16)-coefficients[y];
+			}
+
+			/* the encoder codes a zero run reaching the end of the data as magnitude 1 */
+			if (coefficients[4095] == 0)
+				coefficients[4095] = 1;
+
+			memset(buffer, 0, 16384);
+			const int size = rfx_rlgr_encode(modes[x], coefficients, 4096, buffer, 16384);
+
+			if (size <= 0)
+				goto fail;
+
+			if (rfx_rlgr_decode(modes[x], buffer, (UINT32)size, decoded, 4096) < 0)
+				goto fail;
+
+			if (!compare("rlgr", (modes[x] == RLGR1) ? "RLGR1" : "RLGR3", coefficients, decoded,
+			             4096))
+				goto fail;
+
+			/* a truncated stream decodes to something, but must not read past the end */
+			if (rfx_rlgr_decode(modes[x], buffer, (UINT32)size / 2, decoded, 4096) < 0)
+				goto fail;
+		}
+	}
+
+	free(buffer);
+	return TRUE;
+fail:
+	free(buffer);
+	return FALSE;
+}
+
+int TestFreeRDPCodecRemoteFXKernels(int argc, char* argv[])
+{
+	int rc = -1;
+	INT16* expected = winpr_aligned_malloc(3ULL * 4096 * sizeof(INT16), 32);
+	INT16* actual = winpr_aligned_malloc(3ULL * 4096 * sizeof(INT16), 32);
+	INT16* temp = winpr_aligned_malloc(4096 * sizeof(INT16), 32);
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!expected || !actual || !temp)
+		goto fail;
+
+	for (size_t x = 0; x < ARRAYSIZE(kernels); x++)
+	{
+		RFX_CONTEXT* context = rfx_context_new(TRUE);
+
+		if (!context)
+			goto fail;
+
+		set_generic(context);
+		kernels[x].init(context);
+
+		const BOOL res = test_dwt(kernels[x].name, context, expected, actual, temp) &&
+		                 test_quantization(kernels[x].name, context, expected, actual) &&
+		                 test_format_rgb(kernels[x].name, context, expected, actual);
+		rfx_context_free(context);
+
+		if (!res)
+			goto fail;
+	}
+
+	if (!test_rlgr(expected, actual))
+		goto fail;
+
+	rc = 0;
+fail:
+	winpr_aligned_free(expected);
+	winpr_aligned_free(actual);
+	winpr_aligned_free(temp);
+	return rc;
+}
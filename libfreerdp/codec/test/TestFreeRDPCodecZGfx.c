@@ -253,6 +253,228 @@ fail:
 	return rc;
 }
 
+static void fill_gfx_like_data(BYTE* data, size_t size, UINT32 seed)
+{
+	/* a mix of short repeated records, solid runs and noise similar to GFX PDU payloads */
+	UINT32 state = seed;
+
+	for (size_t x = 0; x < size;)
+	{
+		state = state * 1103515245u + 12345u;
+		const size_t run = MIN(size - x, 16 + ((state >> 16) % 240));
+
+		switch ((state >> 8) % 4)
+		{
+			case 0:
+				memset(&data[x], (int)(state >> 24), run);
+				break;
+			case 1:
+				for (size_t y = 0; y < run; y++)
+					data[x + y] = (BYTE)(y % 13);
+				break;
+			case 2:
+				for (size_t y = 0; y < run; y++)
+				{
+					state = state * 1103515245u + 12345u;
+					data[x + y] = (BYTE)(state >> 24);
+				}
+				break;
+			default:
+				if (x >= run)
+					memcpy(&data[x], &data[x - run], run);
+				else
+					memset(&data[x], 0, run);
+				break;
+		}
+
+		x += run;
+	}
+}
+
+static BOOL test_ZGfxRoundTrip(ZGFX_CONTEXT* compressor, ZGFX_CONTEXT* decompressor,
+                               const BYTE* pdu, UINT32 size, size_t* pCompressed)
+{
+	BOOL rc = FALSE;
+	UINT32 Flags = 0;
+	UINT32 DstSize = 0;
+	BYTE* pDstData = NULL;
+	UINT32 OutSize = 0;
+	BYTE* pOutData = NULL;
+
+	if (zgfx_compress(compressor, pdu, size, &pDstData, &DstSize, &Flags) < 0)
+		goto fail;
+
+	if (zgfx_decompress(decompressor, pDstData, DstSize, &pOutData, &OutSize, Flags) < 0)
+		goto fail;
+
+	if ((OutSize != size) || (memcmp(pOutData, pdu, size) != 0))
+		goto fail;
+
+	*pCompressed += DstSize;
+	rc = TRUE;
+fail:
+	free(pDstData);
+	free(pOutData);
+	return rc;
+}
+
+static int test_ZGfxCompressLevel(UINT32 level, BYTE* pdu, size_t pduSize)
+{
+	int rc = -1;
+	size_t total = 0;
+	size_t totalCompressed = 0;
+	const size_t pduCount = 16; /* wraps the 2.5 MB history */
+	ZGFX_CONTEXT* compressor = zgfx_context_new(TRUE);
+	ZGFX_CONTEXT* decompressor = zgfx_context_new(FALSE);
+
+	if (!compressor || !decompressor)
+		goto fail;
+
+	if (!zgfx_context_set_compression_level(compressor, level))
+		goto fail;
+
+	for (size_t x = 0; x < pduCount; x++)
+	{
+		const UINT32 size = (UINT32)(pduSize - (x * 997) % 5000);
+		fill_gfx_like_data(pdu, size, (UINT32)(x % 3));
+
+		if (!test_ZGfxRoundTrip(compressor, decompressor, pdu, size, &totalCompressed))
+		{
+			printf("test_ZGfxCompressLevel: level %" PRIu32 " PDU %" PRIuz
+			       " round trip mismatch\n",
+			       level, x);
+			goto fail;
+		}
+
+		total += size;
+	}
+
+	printf("test_ZGfxCompressLevel: level %" PRIu32 " %" PRIuz " -> %" PRIuz " bytes\n", level,
+	       total, totalCompressed);
+
+	if ((level != ZGFX_COMPRESSION_LEVEL_NONE) && (totalCompressed >= total / 2))
+		goto fail;
+
+	rc = 0;
+fail:
+	zgfx_context_free(compressor);
+	zgfx_context_free(decompressor);
+	return rc;
+}
+
+static int test_ZGfxCompressLevels(void)
+{
+	int rc = -1;
+	const size_t pduSize = 200000;
+	BYTE* pdu = malloc(pduSize);
+
+	if (!pdu)
+		return -1;
+
+	for (UINT32 level = ZGFX_COMPRESSION_LEVEL_NONE; level <= ZGFX_COMPRESSION_LEVEL_BEST; level++)
+	{
+		if (test_ZGfxCompressLevel(level, pdu, pduSize) < 0)
+			goto fail;
+	}
+
+	rc = 0;
+fail:
+	free(pdu);
+	return rc;
+}
+
+static BOOL test_ZGfxBulkRoundTrip(ZGFX_CONTEXT* compressor, ZGFX_CONTEXT* decompressor,
+                                   wStream* s, const BYTE* data, UINT32 size, BOOL expectCompressed)
+{
+	const BYTE* pOutData = NULL;
+	UINT32 OutSize = 0;
+
+	Stream_SetPosition(s, 0);
+
+	if (!zgfx_compress_bulk(compressor, s, data, size))
+		return FALSE;
+
+	const size_t length = Stream_GetPosition(s);
+	const BYTE header = Stream_Buffer(s)[0];
+	const BOOL compressed = (header & PACKET_COMPRESSED) != 0;
+
+	printf("test_ZGfxBulk: %" PRIu32 " -> %" PRIuz " bytes\n", size, length);
+
+	if (compressed != expectCompressed)
+		return FALSE;
+
+	/* data that does not shrink is sent as is behind the header */
+	if (!compressed && (length != size + 1ull))
+		return FALSE;
+
+	if (compressed && (length > size / 2))
+		return FALSE;
+
+	if (!zgfx_decompress_bulk(decompressor, Stream_Buffer(s), (UINT32)length, &pOutData, &OutSize))
+		return FALSE;
+
+	return (OutSize == size) && (memcmp(pOutData, data, size) == 0);
+}
+
+static int test_ZGfxBulk(void)
+{
+	int rc = -1;
+	const UINT32 chunkSize = 8000;
+	BYTE* chunks = calloc(4, chunkSize);
+	BYTE* noise = malloc(chunkSize);
+	wStream* s = Stream_New(NULL, chunkSize + 1);
+	ZGFX_CONTEXT* compressor = zgfx_context_new(TRUE);
+	ZGFX_CONTEXT* decompressor = zgfx_context_new(FALSE);
+
+	if (!chunks || !noise || !s || !compressor || !decompressor)
+		goto fail;
+
+	UINT32 state = 42;
+
+	for (UINT32 x = 0; x < chunkSize; x++)
+	{
+		state = state * 1103515245u + 12345u;
+		noise[x] = (BYTE)(state >> 24);
+	}
+
+	for (UINT32 x = 0; x < 3; x++)
+		fill_gfx_like_data(&chunks[1ull * x * chunkSize], chunkSize, x);
+
+	/* the last chunk only matches the history of the previous segments */
+	memcpy(&chunks[3ull * chunkSize], &chunks[0], chunkSize);
+
+	for (UINT32 x = 0; x < 3; x++)
+	{
+		if (!test_ZGfxBulkRoundTrip(compressor, decompressor, s, &chunks[1ull * x * chunkSize],
+		                            chunkSize, TRUE))
+			goto fail;
+	}
+
+	/* noise is written uncompressed, both histories must still agree afterwards */
+	if (!test_ZGfxBulkRoundTrip(compressor, decompressor, s, noise, chunkSize, FALSE))
+		goto fail;
+
+	if (!test_ZGfxBulkRoundTrip(compressor, decompressor, s, &chunks[3ull * chunkSize], chunkSize,
+	                            TRUE))
+		goto fail;
+
+	/* a repeated raw segment is found in the history */
+	if (!test_ZGfxBulkRoundTrip(compressor, decompressor, s, noise, chunkSize, TRUE))
+		goto fail;
+
+	rc = 0;
+fail:
+	if (rc < 0)
+		printf("test_ZGfxBulk: round trip failed\n");
+
+	zgfx_context_free(compressor);
+	zgfx_context_free(decompressor);
+	Stream_Free(s, TRUE);
+	free(noise);
+	free(chunks);
+	return rc;
+}
+
 int TestFreeRDPCodecZGfx(int argc, char* argv[])
 {
 	WINPR_UNUSED(argc);
@@ -270,5 +492,11 @@ int TestFreeRDPCodecZGfx(int argc, char* argv[])
 	if (test_ZGfxCompressConsistent() < 0)
 		return -1;
 
+	if (test_ZGfxCompressLevels() < 0)
+		return -1;
+
+	if (test_ZGfxBulk() < 0)
+		return -1;
+
 	return 0;
 }
@@ -828,6 +828,58 @@ out:
 	return retCode;
 }
 
+static int test_set_banded_rects(void)
+{
+	REGION16 region;
+	REGION16 expected;
+	int retCode = -1;
+	UINT32 nbRects = 0;
+	UINT32 nbExpected = 0;
+	/* two touching bands with the same items are merged */
+	const RECTANGLE_16 banded[] = { { 0, 0, 16, 16 },   { 32, 0, 64, 16 }, { 0, 16, 16, 32 },
+		                            { 32, 16, 64, 32 }, { 16, 32, 48, 48 }, { 0, 64, 80, 80 } };
+	const RECTANGLE_16 overlapping[] = { { 0, 0, 16, 16 }, { 16, 0, 32, 16 } };
+	const RECTANGLE_16 unsorted[] = { { 0, 16, 16, 32 }, { 0, 0, 16, 16 } };
+	const RECTANGLE_16 uneven[] = { { 0, 0, 16, 16 }, { 32, 0, 48, 32 } };
+	region16_init(&region);
+	region16_init(&expected);
+
+	for (size_t i = 0; i < ARRAYSIZE(banded); i++)
+	{
+		if (!region16_union_rect(&expected, &expected, &banded[i]))
+			goto out;
+	}
+
+	if (!region16_set_banded_rects(&region, banded, ARRAYSIZE(banded)))
+		goto out;
+
+	const RECTANGLE_16* rects = region16_rects(&region, &nbRects);
+	const RECTANGLE_16* expectedRects = region16_rects(&expected, &nbExpected);
+
+	if ((nbRects != nbExpected) || (nbRects != 4))
+		goto out;
+
+	if (!compareRectangles(rects, expectedRects, (int)nbRects))
+		goto out;
+
+	if (!compareRectangles(region16_extents(&region), region16_extents(&expected), 1))
+		goto out;
+
+	if (region16_set_banded_rects(&region, overlapping, ARRAYSIZE(overlapping)) ||
+	    region16_set_banded_rects(&region, unsorted, ARRAYSIZE(unsorted)) ||
+	    region16_set_banded_rects(&region, uneven, ARRAYSIZE(uneven)))
+		goto out;
+
+	if (!region16_set_banded_rects(&region, NULL, 0) || !region16_is_empty(&region))
+		goto out;
+
+	retCode = 0;
+out:
+	region16_uninit(&expected);
+	region16_uninit(&region);
+	return retCode;
+}
+
 typedef int (*TestFunction)(void);
 struct UnitaryTest
 {
@@ -849,6 +901,7 @@ static struct UnitaryTest tests[] = { { "Basic trivial tests", test_basic },
 	                                  { "norbert's case", test_norbert_case },
 	                                  { "norbert's case 2", test_norbert2_case },
 	                                  { "empty rectangle case", test_empty_rectangle },
+	                                  { "banded rectangles", test_set_banded_rects },
 
 	                                  { NULL, NULL } };
 
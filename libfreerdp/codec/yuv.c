@@ -55,14 +55,12 @@ struct S_YUV_CONTEXT
 	UINT32 width, height;
 	BOOL useThreads;
 	BOOL encoder;
-	UINT32 nthreads;
-	UINT32 heightStep;
 
 	PTP_POOL threadPool;
 	TP_CALLBACK_ENVIRON ThreadPoolEnv;
+	WINPR_PARALLEL_FOR* parallelFor;
 
-	UINT32 work_object_count;
-	PTP_WORK* work_objects;
+	UINT32 work_param_count;
 	YUV_ENCODE_WORK_PARAM* work_enc_params;
 	YUV_PROCESS_WORK_PARAM* work_dec_params;
 	YUV_COMBINE_WORK_PARAM* work_combined_params;
@@ -167,11 +165,10 @@ BOOL yuv_context_reset(YUV_CONTEXT* WINPR_RESTRICT context, UINT32 width, UINT32
 
 	context->width = width;
 	context->height = height;
-	context->heightStep = (height / context->nthreads);
 
 	if (context->useThreads)
 	{
-		/* Preallocate workers for 16x16 tiles.
+		/* Preallocate work parameters for 16x16 tiles.
 		 * this is overallocation for most cases.
 		 *
 		 * ~2MB total for a 4k resolution, so negligible.
@@ -181,7 +178,7 @@ BOOL yuv_context_reset(YUV_CONTEXT* WINPR_RESTRICT context, UINT32 width, UINT32
 
 		const size_t count = pw * ph;
 
-		context->work_object_count = 0;
+		context->work_param_count = 0;
 		if (context->encoder)
 		{
 			void* tmp = winpr_aligned_recalloc(context->work_enc_params, count,
@@ -211,14 +208,7 @@ BOOL yuv_context_reset(YUV_CONTEXT* WINPR_RESTRICT context, UINT32 width, UINT32
 			context->work_combined_params = ctmp;
 		}
 
-		void* wtmp =
-		    winpr_aligned_recalloc((void*)context->work_objects, count, sizeof(PTP_WORK), 32);
-		if (!wtmp)
-			goto fail;
-		memset(wtmp, 0, count * sizeof(PTP_WORK));
-
-		context->work_objects = (PTP_WORK*)wtmp;
-		context->work_object_count = WINPR_ASSERTING_INT_CAST(uint32_t, count);
+		context->work_param_count = WINPR_ASSERTING_INT_CAST(uint32_t, count);
 	}
 	rc = TRUE;
 fail:
@@ -236,14 +226,12 @@ YUV_CONTEXT* yuv_context_new(BOOL encoder, UINT32 ThreadingFlags)
 	primitives_get();
 
 	ret->encoder = encoder;
-	ret->nthreads = 1;
 	if (!(ThreadingFlags & THREADING_FLAGS_DISABLE_THREADS))
 	{
 		GetNativeSystemInfo(&sysInfos);
 		ret->useThreads = (sysInfos.dwNumberOfProcessors > 1);
 		if (ret->useThreads)
 		{
-			ret->nthreads = sysInfos.dwNumberOfProcessors;
 			ret->threadPool = CreateThreadpool(NULL);
 			if (!ret->threadPool)
 			{
@@ -252,6 +240,10 @@ YUV_CONTEXT* yuv_context_new(BOOL encoder, UINT32 ThreadingFlags)
 
 			InitializeThreadpoolEnvironment(&ret->ThreadPoolEnv);
 			SetThreadpoolCallbackPool(&ret->ThreadPoolEnv, ret->threadPool);
+
+			ret->parallelFor = winpr_ParallelFor_New(&ret->ThreadPoolEnv);
+			if (!ret->parallelFor)
+				goto error_threadpool;
 		}
 	}
 
@@ -271,10 +263,10 @@ void yuv_context_free(YUV_CONTEXT* context)
 		return;
 	if (context->useThreads)
 	{
+		winpr_ParallelFor_Free(context->parallelFor);
 		if (context->threadPool)
 			CloseThreadpool(context->threadPool);
 		DestroyThreadpoolEnvironment(&context->ThreadPoolEnv);
-		winpr_aligned_free((void*)context->work_objects);
 		winpr_aligned_free(context->work_combined_params);
 		winpr_aligned_free(context->work_enc_params);
 		winpr_aligned_free(context->work_dec_params);
@@ -310,48 +302,41 @@ static INLINE YUV_PROCESS_WORK_PARAM pool_decode_param(const RECTANGLE_16* WINPR
 	return current;
 }
 
-static BOOL submit_object(PTP_WORK* WINPR_RESTRICT work_object, PTP_WORK_CALLBACK cb,
-                          const void* WINPR_RESTRICT param, YUV_CONTEXT* WINPR_RESTRICT context)
+typedef struct
 {
-	union
-	{
-		const void* cpv;
-		void* pv;
-	} cnv;
-
-	cnv.cpv = param;
-
-	if (!work_object)
-		return FALSE;
+	PTP_WORK_CALLBACK cb;
+	BYTE* params;
+	size_t paramSize;
+} YUV_WORK_BATCH;
 
-	*work_object = NULL;
+static BOOL pool_run_batch(void* arg, size_t first, size_t last)
+{
+	const YUV_WORK_BATCH* batch = (const YUV_WORK_BATCH*)arg;
 
-	if (!param || !context)
-		return FALSE;
+	WINPR_ASSERT(batch);
+	WINPR_ASSERT(batch->cb);
 
-	*work_object = CreateThreadpoolWork(cb, cnv.pv, &context->ThreadPoolEnv);
-	if (!*work_object)
-		return FALSE;
+	for (size_t x = first; x < last; x++)
+		batch->cb(NULL, &batch->params[x * batch->paramSize], NULL);
 
-	SubmitThreadpoolWork(*work_object);
 	return TRUE;
 }
 
-static void free_objects(PTP_WORK* work_objects, UINT32 waitCount)
+/* process the first count prepared parameters in batches on the context thread pool */
+static BOOL pool_run(YUV_CONTEXT* WINPR_RESTRICT context, PTP_WORK_CALLBACK cb, void* params,
+                     size_t paramSize, UINT32 count)
 {
-	WINPR_ASSERT(work_objects || (waitCount == 0));
-
-	for (UINT32 i = 0; i < waitCount; i++)
+	const YUV_WORK_BATCH batch = { cb, params, paramSize };
+	union
 	{
-		PTP_WORK cur = work_objects[i];
-		work_objects[i] = NULL;
+		const YUV_WORK_BATCH* cpv;
+		void* pv;
+	} cnv;
 
-		if (!cur)
-			continue;
+	WINPR_ASSERT(context);
+	cnv.cpv = &batch;
 
-		WaitForThreadpoolWorkCallbacks(cur, FALSE);
-		CloseThreadpoolWork(cur);
-	}
+	return winpr_ParallelFor_Run(context->parallelFor, count, 0, pool_run_batch, cnv.pv);
 }
 
 static BOOL intersects(UINT32 pos, const RECTANGLE_16* WINPR_RESTRICT regionRects,
@@ -395,7 +380,6 @@ static BOOL pool_decode(YUV_CONTEXT* WINPR_RESTRICT context, PTP_WORK_CALLBACK c
                         UINT32 nDstStep, const RECTANGLE_16* WINPR_RESTRICT regionRects,
                         UINT32 numRegionRects)
 {
-	BOOL rc = FALSE;
 	UINT32 waitCount = 0;
 	primitives_t* prims = primitives_get();
 
@@ -424,47 +408,44 @@ static BOOL pool_decode(YUV_CONTEXT* WINPR_RESTRICT context, PTP_WORK_CALLBACK c
 		return TRUE;
 	}
 
-	/* case where we use threads */
+	if (context->work_param_count == 0)
+		return FALSE;
+
+	/* case where we use threads, split into tiles ordered row by row so a batch shares lines */
 	for (UINT32 x = 0; x < numRegionRects; x++)
 	{
-		RECTANGLE_16 r = clamp(context, &regionRects[x], yuvHeight);
+		const RECTANGLE_16 r = clamp(context, &regionRects[x], yuvHeight);
 
 		if (intersects(x, regionRects, numRegionRects))
 			continue;
 
-		while (r.left < r.right)
+		for (UINT32 top = r.top; top < r.bottom; top += TILE_SIZE)
 		{
-			RECTANGLE_16 y = r;
-			y.right = MIN(r.right, r.left + TILE_SIZE);
-
-			while (y.top < y.bottom)
+			for (UINT32 left = r.left; left < r.right; left += TILE_SIZE)
 			{
-				RECTANGLE_16 z = y;
-
-				if (context->work_object_count <= waitCount)
+				const RECTANGLE_16 z = { WINPR_ASSERTING_INT_CAST(UINT16, left),
+					                     WINPR_ASSERTING_INT_CAST(UINT16, top),
+					                     WINPR_ASSERTING_INT_CAST(UINT16,
+					                                              MIN(r.right, left + TILE_SIZE)),
+					                     WINPR_ASSERTING_INT_CAST(
+					                         UINT16, MIN(r.bottom, top + TILE_SIZE)) };
+
+				if (waitCount >= context->work_param_count)
 				{
-					free_objects(context->work_objects, context->work_object_count);
+					if (!pool_run(context, cb, context->work_dec_params,
+					              sizeof(YUV_PROCESS_WORK_PARAM), waitCount))
+						return FALSE;
 					waitCount = 0;
 				}
 
-				YUV_PROCESS_WORK_PARAM* cur = &context->work_dec_params[waitCount];
-				z.bottom = MIN(z.bottom, z.top + TILE_SIZE);
-				if (rectangle_is_empty(&z))
-					continue;
-				*cur = pool_decode_param(&z, context, pYUVData, iStride, DstFormat, dest, nDstStep);
-				if (!submit_object(&context->work_objects[waitCount], cb, cur, context))
-					goto fail;
-				waitCount++;
-				y.top += TILE_SIZE;
+				context->work_dec_params[waitCount++] =
+				    pool_decode_param(&z, context, pYUVData, iStride, DstFormat, dest, nDstStep);
 			}
-
-			r.left += TILE_SIZE;
 		}
 	}
-	rc = TRUE;
-fail:
-	free_objects(context->work_objects, context->work_object_count);
-	return rc;
+
+	return pool_run(context, cb, context->work_dec_params, sizeof(YUV_PROCESS_WORK_PARAM),
+	                waitCount);
 }
 
 static INLINE BOOL check_rect(const YUV_CONTEXT* WINPR_RESTRICT yuv,
@@ -557,7 +538,6 @@ static BOOL pool_decode_rect(YUV_CONTEXT* WINPR_RESTRICT context, BYTE type,
                              BYTE* WINPR_RESTRICT pYUVDstData[3], const UINT32 iDstStride[3],
                              const RECTANGLE_16* WINPR_RESTRICT regionRects, UINT32 numRegionRects)
 {
-	BOOL rc = FALSE;
 	UINT32 waitCount = 0;
 	PTP_WORK_CALLBACK cb = yuv444_combine_work_callback;
 	primitives_t* prims = primitives_get();
@@ -580,28 +560,26 @@ static BOOL pool_decode_rect(YUV_CONTEXT* WINPR_RESTRICT context, BYTE type,
 		return TRUE;
 	}
 
+	if (context->work_param_count == 0)
+		return FALSE;
+
 	/* case where we use threads */
-	for (waitCount = 0; waitCount < numRegionRects; waitCount++)
+	for (UINT32 x = 0; x < numRegionRects; x++)
 	{
-		YUV_COMBINE_WORK_PARAM* current = NULL;
-
-		if (context->work_object_count <= waitCount)
+		if (waitCount >= context->work_param_count)
 		{
-			free_objects(context->work_objects, context->work_object_count);
+			if (!pool_run(context, cb, context->work_combined_params,
+			              sizeof(YUV_COMBINE_WORK_PARAM), waitCount))
+				return FALSE;
 			waitCount = 0;
 		}
-		current = &context->work_combined_params[waitCount];
-		*current = pool_decode_rect_param(&regionRects[waitCount], context, type, pYUVData, iStride,
-		                                  pYUVDstData, iDstStride);
 
-		if (!submit_object(&context->work_objects[waitCount], cb, current, context))
-			goto fail;
+		context->work_combined_params[waitCount++] = pool_decode_rect_param(
+		    &regionRects[x], context, type, pYUVData, iStride, pYUVDstData, iDstStride);
 	}
 
-	rc = TRUE;
-fail:
-	free_objects(context->work_objects, context->work_object_count);
-	return rc;
+	return pool_run(context, cb, context->work_combined_params, sizeof(YUV_COMBINE_WORK_PARAM),
+	                waitCount);
 }
 
 BOOL yuv444_context_decode(YUV_CONTEXT* WINPR_RESTRICT context, BYTE type,
@@ -794,7 +772,6 @@ static BOOL pool_encode(YUV_CONTEXT* WINPR_RESTRICT context, PTP_WORK_CALLBACK c
                         BYTE* WINPR_RESTRICT pYUVChromaData[],
                         const RECTANGLE_16* WINPR_RESTRICT regionRects, UINT32 numRegionRects)
 {
-	BOOL rc = FALSE;
 	primitives_t* prims = primitives_get();
 	UINT32 waitCount = 0;
 
@@ -823,47 +800,35 @@ static BOOL pool_encode(YUV_CONTEXT* WINPR_RESTRICT context, PTP_WORK_CALLBACK c
 		return TRUE;
 	}
 
-	/* case where we use threads */
-	for (UINT32 x = 0; x < numRegionRects; x++)
-	{
-		const RECTANGLE_16* rect = &regionRects[x];
-		const UINT32 height = rect->bottom - rect->top;
-		const UINT32 steps = (height + context->heightStep / 2) / context->heightStep;
-
-		waitCount += steps;
-	}
+	if (context->work_param_count == 0)
+		return FALSE;
 
+	/* case where we use threads, split the rectangles into bands of full lines */
 	for (UINT32 x = 0; x < numRegionRects; x++)
 	{
 		const RECTANGLE_16* rect = &regionRects[x];
-		const UINT32 height = rect->bottom - rect->top;
-		const UINT32 steps = (height + context->heightStep / 2) / context->heightStep;
 
-		for (UINT32 y = 0; y < steps; y++)
+		for (UINT32 top = rect->top; top < rect->bottom; top += TILE_SIZE)
 		{
 			RECTANGLE_16 r = *rect;
-			YUV_ENCODE_WORK_PARAM* current = NULL;
+			r.top = WINPR_ASSERTING_INT_CAST(UINT16, top);
+			r.bottom = WINPR_ASSERTING_INT_CAST(UINT16, MIN(rect->bottom, top + TILE_SIZE));
 
-			if (context->work_object_count <= waitCount)
+			if (waitCount >= context->work_param_count)
 			{
-				free_objects(context->work_objects, context->work_object_count);
+				if (!pool_run(context, cb, context->work_enc_params,
+				              sizeof(YUV_ENCODE_WORK_PARAM), waitCount))
+					return FALSE;
 				waitCount = 0;
 			}
 
-			current = &context->work_enc_params[waitCount];
-			r.top += y * context->heightStep;
-			*current = pool_encode_fill(&r, context, pSrcData, nSrcStep, SrcFormat, iStride,
-			                            pYUVLumaData, pYUVChromaData);
-			if (!submit_object(&context->work_objects[waitCount], cb, current, context))
-				goto fail;
-			waitCount++;
+			context->work_enc_params[waitCount++] = pool_encode_fill(
+			    &r, context, pSrcData, nSrcStep, SrcFormat, iStride, pYUVLumaData, pYUVChromaData);
 		}
 	}
 
-	rc = TRUE;
-fail:
-	free_objects(context->work_objects, context->work_object_count);
-	return rc;
+	return pool_run(context, cb, context->work_enc_params, sizeof(YUV_ENCODE_WORK_PARAM),
+	                waitCount);
 }
 
 BOOL yuv420_context_encode(YUV_CONTEXT* WINPR_RESTRICT context, const BYTE* WINPR_RESTRICT pSrcData,
@@ -42,6 +42,27 @@
  * Minimum match length: 3 bytes
  */
 
+#define ZGFX_HASH_BITS 16
+#define ZGFX_HASH_SIZE (1u << ZGFX_HASH_BITS)
+#define ZGFX_CHAIN_SIZE (1u << 17)
+#define ZGFX_CHAIN_MASK (ZGFX_CHAIN_SIZE - 1u)
+#define ZGFX_HASH_EMPTY UINT32_MAX
+
+typedef struct
+{
+	UINT32 maxChain;
+	UINT32 niceLength;
+	BOOL lazy;
+} ZGFX_COMPRESSION_PARAMS;
+
+/* indexed by ZGFX_COMPRESSION_LEVEL_* */
+static const ZGFX_COMPRESSION_PARAMS ZGFX_COMPRESSION_PARAMS_TABLE[] = {
+	{ 0, 0, FALSE },      /* passthrough */
+	{ 4, 32, FALSE },     /* fast */
+	{ 32, 258, TRUE },    /* default */
+	{ 512, 65535, TRUE }, /* best */
+};
+
 typedef struct
 {
 	UINT32 prefixLength;
@@ -69,6 +90,14 @@ struct S_ZGFX_CONTEXT
 	BYTE HistoryBuffer[2500000];
 	UINT32 HistoryIndex;
 	UINT32 HistoryBufferSize;
+	UINT32 HistoryFill;
+
+	UINT32 CompressionLevel;
+	wBitStream* bs;
+	UINT32* HashTable;
+	UINT32* ChainTable;
+	UINT16 LiteralCode[256];
+	BYTE LiteralBits[256];
 };
 
 static const ZGFX_TOKEN ZGFX_TOKEN_TABLE[] = {
@@ -144,6 +173,11 @@ static INLINE void zgfx_history_buffer_ring_write(ZGFX_CONTEXT* WINPR_RESTRICT z
 	if (count <= 0)
 		return;
 
+	if (count >= zgfx->HistoryBufferSize - zgfx->HistoryFill)
+		zgfx->HistoryFill = zgfx->HistoryBufferSize;
+	else
+		zgfx->HistoryFill += (UINT32)count;
+
 	if (count > zgfx->HistoryBufferSize)
 	{
 		const size_t residue = count - zgfx->HistoryBufferSize;
@@ -498,20 +532,264 @@ fail:
 	return status;
 }
 
+static INLINE UINT32 zgfx_hash(const BYTE* WINPR_RESTRICT p)
+{
+	const UINT32 v = ((UINT32)p[0] << 16) | ((UINT32)p[1] << 8) | p[2];
+	return (v * 2654435761u) >> (32 - ZGFX_HASH_BITS);
+}
+
+static INLINE void zgfx_hash_insert(ZGFX_CONTEXT* WINPR_RESTRICT zgfx,
+                                    const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize,
+                                    UINT32 segmentStart, UINT32 offset)
+{
+	if (offset + 3 > SrcSize)
+		return;
+
+	const UINT32 h = zgfx_hash(&pSrcData[offset]);
+	const UINT32 index = (segmentStart + offset) % zgfx->HistoryBufferSize;
+	zgfx->ChainTable[index & ZGFX_CHAIN_MASK] = zgfx->HashTable[h];
+	zgfx->HashTable[h] = index;
+}
+
+static INLINE UINT32 zgfx_match_length(const ZGFX_CONTEXT* WINPR_RESTRICT zgfx, UINT32 index,
+                                       const BYTE* WINPR_RESTRICT pSrc, UINT32 maxLength)
+{
+	UINT32 length = 0;
+
+	while (length < maxLength)
+	{
+		const UINT32 run = MIN(maxLength - length, zgfx->HistoryBufferSize - index);
+		const BYTE* history = &zgfx->HistoryBuffer[index];
+		UINT32 k = 0;
+
+		while ((k < run) && (history[k] == pSrc[length + k]))
+			k++;
+
+		length += k;
+
+		if (k < run)
+			break;
+
+		index = 0;
+	}
+
+	return length;
+}
+
+/**
+ * Walk the hash chain for the 3 byte prefix at pSrcData[offset] and return the longest match.
+ * The segment has already been written to the history ring, so candidates must not be older
+ * than the data still present in the ring once the rest of the segment is taken into account.
+ */
+static INLINE UINT32 zgfx_find_match(const ZGFX_CONTEXT* WINPR_RESTRICT zgfx,
+                                     const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize,
+                                     UINT32 segmentStart, UINT32 historyFill, UINT32 offset,
+                                     UINT32* WINPR_RESTRICT pDistance)
+{
+	const ZGFX_COMPRESSION_PARAMS* params =
+	    &ZGFX_COMPRESSION_PARAMS_TABLE[zgfx->CompressionLevel];
+	const UINT32 size = zgfx->HistoryBufferSize;
+	UINT32 bestLength = 0;
+	UINT32 lastDistance = 0;
+
+	if (offset + 3 > SrcSize)
+		return 0;
+
+	const UINT32 current = (segmentStart + offset) % size;
+	const UINT32 maxLength = MIN(SrcSize - offset, ZGFX_SEGMENTED_MAXSIZE);
+	const UINT32 maxDistance = MIN(historyFill + offset, size - (SrcSize - offset));
+	UINT32 candidate = zgfx->HashTable[zgfx_hash(&pSrcData[offset])];
+
+	for (UINT32 steps = 0; (candidate != ZGFX_HASH_EMPTY) && (steps < params->maxChain); steps++)
+	{
+		const UINT32 distance = (current + size - candidate) % size;
+
+		/* chain entries are strictly older, anything else is a stale slot */
+		if ((distance <= lastDistance) || (distance > maxDistance))
+			break;
+
+		lastDistance = distance;
+
+		const UINT32 check = (candidate + bestLength) % size;
+		if ((bestLength == 0) || ((bestLength < maxLength) &&
+		                          (zgfx->HistoryBuffer[check] == pSrcData[offset + bestLength])))
+		{
+			const UINT32 length =
+			    zgfx_match_length(zgfx, candidate, &pSrcData[offset], maxLength);
+
+			if (length > bestLength)
+			{
+				bestLength = length;
+				*pDistance = distance;
+
+				if (length >= params->niceLength)
+					break;
+			}
+		}
+
+		candidate = zgfx->ChainTable[candidate & ZGFX_CHAIN_MASK];
+	}
+
+	/* a far away 3 byte match costs more bits than the literals it replaces */
+	if ((bestLength == 3) && (*pDistance > 22175))
+		return 0;
+
+	return (bestLength >= 3) ? bestLength : 0;
+}
+
+static INLINE void zgfx_write_literal(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, BYTE c)
+{
+	BitStream_Write_Bits(zgfx->bs, zgfx->LiteralCode[c], zgfx->LiteralBits[c]);
+}
+
+static INLINE void zgfx_write_match(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, UINT32 distance,
+                                    UINT32 length)
+{
+	const ZGFX_TOKEN* token = NULL;
+
+	for (size_t x = 0; ZGFX_TOKEN_TABLE[x].prefixLength != 0; x++)
+	{
+		const ZGFX_TOKEN* cur = &ZGFX_TOKEN_TABLE[x];
+
+		if ((cur->tokenType == 1) && (cur->valueBase <= distance) &&
+		    ((distance - cur->valueBase) < (1u << cur->valueBits)))
+		{
+			token = cur;
+			break;
+		}
+	}
+
+	WINPR_ASSERT(token);
+	BitStream_Write_Bits(zgfx->bs, token->prefixCode, token->prefixLength);
+	BitStream_Write_Bits(zgfx->bs, distance - token->valueBase, token->valueBits);
+
+	if (length == 3)
+	{
+		BitStream_Write_Bits(zgfx->bs, 0, 1);
+	}
+	else
+	{
+		/* (k - 1) one bits, a zero bit and k bits of (length - 2^k) */
+		UINT32 k = 2;
+
+		while ((length >> (k + 1)) != 0)
+			k++;
+
+		BitStream_Write_Bits(zgfx->bs, ((1u << (k - 1)) - 1u) << 1, k);
+		BitStream_Write_Bits(zgfx->bs, length - (1u << k), k);
+	}
+}
+
+/**
+ * Encode a segment with the RDP 8.0 bulk compressor into zgfx->OutputBuffer.
+ * Returns FALSE if the result would not be smaller than the input, in which case the
+ * segment is sent uncompressed. The history ring is updated either way.
+ */
+static BOOL zgfx_compress_segment_rdp8(ZGFX_CONTEXT* WINPR_RESTRICT zgfx,
+                                       const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize)
+{
+	const ZGFX_COMPRESSION_PARAMS* params =
+	    &ZGFX_COMPRESSION_PARAMS_TABLE[zgfx->CompressionLevel];
+	const UINT32 segmentStart = zgfx->HistoryIndex;
+	const UINT32 historyFill = zgfx->HistoryFill;
+	wBitStream* bs = zgfx->bs;
+
+	zgfx_history_buffer_ring_write(zgfx, pSrcData, SrcSize);
+
+	/* the longest token is 59 bits, keep one byte for the padding count */
+	if (SrcSize < 16)
+		return FALSE;
+
+	const UINT32 limit = 8u * (SrcSize - 2u) - 64u;
+	BitStream_Attach(bs, zgfx->OutputBuffer, sizeof(zgfx->OutputBuffer));
+
+	UINT32 offset = 0;
+
+	while (offset < SrcSize)
+	{
+		UINT32 distance = 0;
+		UINT32 length =
+		    zgfx_find_match(zgfx, pSrcData, SrcSize, segmentStart, historyFill, offset, &distance);
+		zgfx_hash_insert(zgfx, pSrcData, SrcSize, segmentStart, offset);
+
+		while (params->lazy && (length > 0) && (length < params->niceLength) &&
+		       (offset + 1 < SrcSize))
+		{
+			UINT32 nextDistance = 0;
+			const UINT32 nextLength = zgfx_find_match(zgfx, pSrcData, SrcSize, segmentStart,
+			                                          historyFill, offset + 1, &nextDistance);
+
+			if (nextLength <= length)
+				break;
+
+			if (bs->position > limit)
+				return FALSE;
+
+			zgfx_write_literal(zgfx, pSrcData[offset]);
+			offset++;
+			zgfx_hash_insert(zgfx, pSrcData, SrcSize, segmentStart, offset);
+			length = nextLength;
+			distance = nextDistance;
+		}
+
+		if (bs->position > limit)
+			return FALSE;
+
+		if (length > 0)
+		{
+			zgfx_write_match(zgfx, distance, length);
+
+			for (UINT32 x = 1; x < length; x++)
+				zgfx_hash_insert(zgfx, pSrcData, SrcSize, segmentStart, offset + x);
+
+			offset += length;
+		}
+		else
+		{
+			zgfx_write_literal(zgfx, pSrcData[offset]);
+			offset++;
+		}
+	}
+
+	BitStream_Flush(bs);
+
+	const UINT32 cbData = (bs->position + 7) / 8;
+	zgfx->OutputBuffer[cbData] = (BYTE)((8 - (bs->position % 8)) % 8);
+	zgfx->OutputCount = cbData + 1;
+	return zgfx->OutputCount < SrcSize;
+}
+
 static BOOL zgfx_compress_segment(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, wStream* WINPR_RESTRICT s,
                                   const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize,
                                   UINT32* WINPR_RESTRICT pFlags)
 {
-	/* FIXME: Currently compression not implemented. Just copy the raw source */
-	if (!Stream_EnsureRemainingCapacity(s, SrcSize + 1))
+	BOOL compressed = FALSE;
+
+	if (zgfx->CompressionLevel != ZGFX_COMPRESSION_LEVEL_NONE)
+		compressed = zgfx_compress_segment_rdp8(zgfx, pSrcData, SrcSize);
+	else
+		zgfx_history_buffer_ring_write(zgfx, pSrcData, SrcSize);
+
+	const BYTE* pData = compressed ? zgfx->OutputBuffer : pSrcData;
+	const UINT32 DataSize = compressed ? zgfx->OutputCount : SrcSize;
+
+	if (!Stream_EnsureRemainingCapacity(s, DataSize + 1))
 	{
 		WLog_ERR(TAG, "Stream_EnsureRemainingCapacity failed!");
 		return FALSE;
 	}
 
 	(*pFlags) |= ZGFX_PACKET_COMPR_TYPE_RDP8; /* RDP 8.0 compression format */
-	Stream_Write_UINT8(s, WINPR_ASSERTING_INT_CAST(uint8_t, *pFlags)); /* header (1 byte) */
-	Stream_Write(s, pSrcData, SrcSize);
+	UINT32 header = (*pFlags) & ~(UINT32)PACKET_COMPRESSED;
+
+	if (compressed)
+	{
+		header |= PACKET_COMPRESSED;
+		(*pFlags) |= PACKET_COMPRESSED;
+	}
+
+	Stream_Write_UINT8(s, WINPR_ASSERTING_INT_CAST(uint8_t, header)); /* header (1 byte) */
+	Stream_Write(s, pData, DataSize);
 	return TRUE;
 }
 
@@ -618,9 +896,98 @@ int zgfx_compress(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, const BYTE* WINPR_RESTRICT
 	return status;
 }
 
+BOOL zgfx_compress_bulk(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, wStream* WINPR_RESTRICT sDst,
+                        const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize)
+{
+	UINT32 flags = 0;
+
+	WINPR_ASSERT(zgfx);
+	WINPR_ASSERT(sDst);
+	WINPR_ASSERT(pSrcData || (SrcSize == 0));
+
+	if (!zgfx->Compressor || (SrcSize > ZGFX_SEGMENTED_MAXSIZE))
+		return FALSE;
+
+	return zgfx_compress_segment(zgfx, sDst, pSrcData, SrcSize, &flags);
+}
+
+BOOL zgfx_decompress_bulk(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, const BYTE* WINPR_RESTRICT pSrcData,
+                          UINT32 SrcSize, const BYTE** WINPR_RESTRICT ppDstData,
+                          UINT32* WINPR_RESTRICT pDstSize)
+{
+	wStream sbuffer = { 0 };
+	wStream* stream = Stream_StaticConstInit(&sbuffer, pSrcData, SrcSize);
+
+	WINPR_ASSERT(zgfx);
+	WINPR_ASSERT(ppDstData);
+	WINPR_ASSERT(pDstSize);
+
+	*ppDstData = NULL;
+	*pDstSize = 0;
+
+	if (!zgfx_decompress_segment(zgfx, stream, SrcSize))
+		return FALSE;
+
+	*ppDstData = zgfx->OutputBuffer;
+	*pDstSize = zgfx->OutputCount;
+	return TRUE;
+}
+
+BOOL zgfx_context_set_compression_level(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, UINT32 level)
+{
+	WINPR_ASSERT(zgfx);
+
+	if (level >= ARRAYSIZE(ZGFX_COMPRESSION_PARAMS_TABLE))
+		return FALSE;
+
+	if ((level != ZGFX_COMPRESSION_LEVEL_NONE) && !zgfx->bs)
+		return FALSE;
+
+	zgfx->CompressionLevel = level;
+	return TRUE;
+}
+
+UINT32 zgfx_context_get_compression_level(const ZGFX_CONTEXT* WINPR_RESTRICT zgfx)
+{
+	WINPR_ASSERT(zgfx);
+	return zgfx->CompressionLevel;
+}
+
 void zgfx_context_reset(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, BOOL flush)
 {
 	zgfx->HistoryIndex = 0;
+	zgfx->HistoryFill = 0;
+
+	if (zgfx->HashTable)
+	{
+		for (size_t x = 0; x < ZGFX_HASH_SIZE; x++)
+			zgfx->HashTable[x] = ZGFX_HASH_EMPTY;
+	}
+}
+
+static void zgfx_init_literal_codes(ZGFX_CONTEXT* WINPR_RESTRICT zgfx)
+{
+	/* default: bit 0 followed by the 8 bit literal value */
+	for (size_t c = 0; c < ARRAYSIZE(zgfx->LiteralCode); c++)
+	{
+		zgfx->LiteralCode[c] = (UINT16)c;
+		zgfx->LiteralBits[c] = 9;
+	}
+
+	for (size_t x = 0; ZGFX_TOKEN_TABLE[x].prefixLength != 0; x++)
+	{
+		const ZGFX_TOKEN* token = &ZGFX_TOKEN_TABLE[x];
+
+		if ((token->tokenType != 0) || (token->valueBits != 0))
+			continue;
+
+		const BYTE c = (BYTE)token->valueBase;
+		if (token->prefixLength < zgfx->LiteralBits[c])
+		{
+			zgfx->LiteralCode[c] = (UINT16)token->prefixCode;
+			zgfx->LiteralBits[c] = (BYTE)token->prefixLength;
+		}
+	}
 }
 
 ZGFX_CONTEXT* zgfx_context_new(BOOL Compressor)
@@ -632,6 +999,23 @@ ZGFX_CONTEXT* zgfx_context_new(BOOL Compressor)
 	{
 		zgfx->Compressor = Compressor;
 		zgfx->HistoryBufferSize = sizeof(zgfx->HistoryBuffer);
+
+		if (Compressor)
+		{
+			zgfx->bs = BitStream_New();
+			zgfx->HashTable = calloc(ZGFX_HASH_SIZE, sizeof(UINT32));
+			zgfx->ChainTable = calloc(ZGFX_CHAIN_SIZE, sizeof(UINT32));
+
+			if (!zgfx->bs || !zgfx->HashTable || !zgfx->ChainTable)
+			{
+				zgfx_context_free(zgfx);
+				return NULL;
+			}
+
+			zgfx_init_literal_codes(zgfx);
+			zgfx->CompressionLevel = ZGFX_COMPRESSION_LEVEL_DEFAULT;
+		}
+
 		zgfx_context_reset(zgfx, FALSE);
 	}
 
@@ -640,5 +1024,11 @@ ZGFX_CONTEXT* zgfx_context_new(BOOL Compressor)
 
 void zgfx_context_free(ZGFX_CONTEXT* zgfx)
 {
+	if (!zgfx)
+		return;
+
+	BitStream_Free(zgfx->bs);
+	free(zgfx->HashTable);
+	free(zgfx->ChainTable);
 	free(zgfx);
 }
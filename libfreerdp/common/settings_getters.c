@@ -195,6 +195,9 @@ BOOL freerdp_settings_get_bool(const rdpSettings* settings, FreeRDP_Settings_Key
 		case FreeRDP_DumpRemoteFx:
 			return settings->DumpRemoteFx;
 
+		case FreeRDP_DynamicChannelCompression:
+			return settings->DynamicChannelCompression;
+
 		case FreeRDP_DynamicDaylightTimeDisabled:
 			return settings->DynamicDaylightTimeDisabled;
 
@@ -276,9 +279,15 @@ BOOL freerdp_settings_get_bool(const rdpSettings* settings, FreeRDP_Settings_Key
 		case FreeRDP_GfxAVC444v2:
 			return settings->GfxAVC444v2;
 
+		case FreeRDP_GfxClearCodec:
+			return settings->GfxClearCodec;
+
 		case FreeRDP_GfxH264:
 			return settings->GfxH264;
 
+		case FreeRDP_GfxMixedCodecs:
+			return settings->GfxMixedCodecs;
+
 		case FreeRDP_GfxPlanar:
 			return settings->GfxPlanar;
 
@@ -504,6 +513,9 @@ BOOL freerdp_settings_get_bool(const rdpSettings* settings, FreeRDP_Settings_Key
 		case FreeRDP_ServerMode:
 			return settings->ServerMode;
 
+		case FreeRDP_SharedMemoryPresentation:
+			return settings->SharedMemoryPresentation;
+
 		case FreeRDP_SmartSizing:
 			return settings->SmartSizing;
 
@@ -847,6 +859,10 @@ BOOL freerdp_settings_set_bool(rdpSettings* settings, FreeRDP_Settings_Keys_Bool
 			settings->DumpRemoteFx = cnv.c;
 			break;
 
+		case FreeRDP_DynamicChannelCompression:
+			settings->DynamicChannelCompression = cnv.c;
+			break;
+
 		case FreeRDP_DynamicDaylightTimeDisabled:
 			settings->DynamicDaylightTimeDisabled = cnv.c;
 			break;
@@ -955,10 +971,18 @@ BOOL freerdp_settings_set_bool(rdpSettings* settings, FreeRDP_Settings_Keys_Bool
 			settings->GfxAVC444v2 = cnv.c;
 			break;
 
+		case FreeRDP_GfxClearCodec:
+			settings->GfxClearCodec = cnv.c;
+			break;
+
 		case FreeRDP_GfxH264:
 			settings->GfxH264 = cnv.c;
 			break;
 
+		case FreeRDP_GfxMixedCodecs:
+			settings->GfxMixedCodecs = cnv.c;
+			break;
+
 		case FreeRDP_GfxPlanar:
 			settings->GfxPlanar = cnv.c;
 			break;
@@ -1259,6 +1283,10 @@ BOOL freerdp_settings_set_bool(rdpSettings* settings, FreeRDP_Settings_Keys_Bool
 			settings->ServerMode = cnv.c;
 			break;
 
+		case FreeRDP_SharedMemoryPresentation:
+			settings->SharedMemoryPresentation = cnv.c;
+			break;
+
 		case FreeRDP_SmartSizing:
 			settings->SmartSizing = cnv.c;
 			break;
@@ -1995,6 +2023,12 @@ UINT32 freerdp_settings_get_uint32(const rdpSettings* settings, FreeRDP_Settings
 		case FreeRDP_TlsSecLevel:
 			return settings->TlsSecLevel;
 
+		case FreeRDP_TransportWriteBatchDelay:
+			return settings->TransportWriteBatchDelay;
+
+		case FreeRDP_TransportWriteBatchThreshold:
+			return settings->TransportWriteBatchThreshold;
+
 		case FreeRDP_VCChunkSize:
 			return settings->VCChunkSize;
 
@@ -2521,6 +2555,14 @@ BOOL freerdp_settings_set_uint32(rdpSettings* settings, FreeRDP_Settings_Keys_UI
 			settings->TlsSecLevel = cnv.c;
 			break;
 
+		case FreeRDP_TransportWriteBatchDelay:
+			settings->TransportWriteBatchDelay = cnv.c;
+			break;
+
+		case FreeRDP_TransportWriteBatchThreshold:
+			settings->TransportWriteBatchThreshold = cnv.c;
+			break;
+
 		case FreeRDP_VCChunkSize:
 			settings->VCChunkSize = cnv.c;
 			break;
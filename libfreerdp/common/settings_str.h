@@ -90,6 +90,8 @@ static const struct settings_str_entry settings_map[] = {
 	{ FreeRDP_DrawGdiPlusEnabled, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_DrawGdiPlusEnabled" },
 	{ FreeRDP_DrawNineGridEnabled, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_DrawNineGridEnabled" },
 	{ FreeRDP_DumpRemoteFx, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_DumpRemoteFx" },
+	{ FreeRDP_DynamicChannelCompression, FREERDP_SETTINGS_TYPE_BOOL,
+	  "FreeRDP_DynamicChannelCompression" },
 	{ FreeRDP_DynamicDaylightTimeDisabled, FREERDP_SETTINGS_TYPE_BOOL,
 	  "FreeRDP_DynamicDaylightTimeDisabled" },
 	{ FreeRDP_DynamicResolutionUpdate, FREERDP_SETTINGS_TYPE_BOOL,
@@ -125,7 +127,9 @@ static const struct settings_str_entry settings_map[] = {
 	  "FreeRDP_GatewayUseSameCredentials" },
 	{ FreeRDP_GfxAVC444, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_GfxAVC444" },
 	{ FreeRDP_GfxAVC444v2, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_GfxAVC444v2" },
+	{ FreeRDP_GfxClearCodec, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_GfxClearCodec" },
 	{ FreeRDP_GfxH264, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_GfxH264" },
+	{ FreeRDP_GfxMixedCodecs, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_GfxMixedCodecs" },
 	{ FreeRDP_GfxPlanar, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_GfxPlanar" },
 	{ FreeRDP_GfxProgressive, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_GfxProgressive" },
 	{ FreeRDP_GfxProgressiveV2, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_GfxProgressiveV2" },
@@ -211,6 +215,8 @@ static const struct settings_str_entry settings_map[] = {
 	{ FreeRDP_SendPreconnectionPdu, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_SendPreconnectionPdu" },
 	{ FreeRDP_ServerLicenseRequired, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_ServerLicenseRequired" },
 	{ FreeRDP_ServerMode, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_ServerMode" },
+	{ FreeRDP_SharedMemoryPresentation, FREERDP_SETTINGS_TYPE_BOOL,
+	  "FreeRDP_SharedMemoryPresentation" },
 	{ FreeRDP_SmartSizing, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_SmartSizing" },
 	{ FreeRDP_SmartcardEmulation, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_SmartcardEmulation" },
 	{ FreeRDP_SmartcardLogon, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_SmartcardLogon" },
@@ -446,6 +452,10 @@ static const struct settings_str_entry settings_map[] = {
 	{ FreeRDP_TcpKeepAliveRetries, FREERDP_SETTINGS_TYPE_UINT32, "FreeRDP_TcpKeepAliveRetries" },
 	{ FreeRDP_ThreadingFlags, FREERDP_SETTINGS_TYPE_UINT32, "FreeRDP_ThreadingFlags" },
 	{ FreeRDP_TlsSecLevel, FREERDP_SETTINGS_TYPE_UINT32, "FreeRDP_TlsSecLevel" },
+	{ FreeRDP_TransportWriteBatchDelay, FREERDP_SETTINGS_TYPE_UINT32,
+	  "FreeRDP_TransportWriteBatchDelay" },
+	{ FreeRDP_TransportWriteBatchThreshold, FREERDP_SETTINGS_TYPE_UINT32,
+	  "FreeRDP_TransportWriteBatchThreshold" },
 	{ FreeRDP_VCChunkSize, FREERDP_SETTINGS_TYPE_UINT32, "FreeRDP_VCChunkSize" },
 	{ FreeRDP_VCFlags, FREERDP_SETTINGS_TYPE_UINT32, "FreeRDP_VCFlags" },
 	{ FreeRDP_XPan, FREERDP_SETTINGS_TYPE_INT32, "FreeRDP_XPan" },
@@ -52,6 +52,7 @@
 
 BOOL freerdp_channel_send(rdpRdp* rdp, UINT16 channelId, const BYTE* data, size_t size)
 {
+	BOOL rc = TRUE;
 	size_t left = 0;
 	UINT32 flags = 0;
 	size_t chunkSize = 0;
@@ -82,6 +83,10 @@ BOOL freerdp_channel_send(rdpRdp* rdp, UINT16 channelId, const BYTE* data, size_
 	flags = CHANNEL_FLAG_FIRST;
 	left = size;
 
+	/* queue all chunks of the channel PDU and send them in one go */
+	if (!transport_write_batch_begin(rdp->transport))
+		return FALSE;
+
 	while (left > 0)
 	{
 		if (left > rdp->settings->VCChunkSize)
@@ -100,14 +105,20 @@ BOOL freerdp_channel_send(rdpRdp* rdp, UINT16 channelId, const BYTE* data, size_
 		}
 
 		if (!freerdp_channel_send_packet(rdp, channelId, size, flags, data, chunkSize))
-			return FALSE;
+		{
+			rc = FALSE;
+			break;
+		}
 
 		data += chunkSize;
 		left -= chunkSize;
 		flags = 0;
 	}
 
-	return TRUE;
+	if (!transport_write_batch_end(rdp->transport))
+		return FALSE;
+
+	return rc;
 }
 
 BOOL freerdp_channel_process(freerdp* instance, wStream* s, UINT16 channelId, size_t packetLength)
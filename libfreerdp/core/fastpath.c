@@ -1162,8 +1162,8 @@ wStream* fastpath_update_pdu_init_new(rdpFastPath* fastpath)
 	return s;
 }
 
-BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s,
-                              BOOL skipCompression)
+static BOOL fastpath_send_update_pdu_fragments(rdpFastPath* fastpath, BYTE updateCode,
+                                               wStream* s, BOOL skipCompression)
 {
 	BOOL status = TRUE;
 	wStream* fs = NULL;
@@ -1369,6 +1369,25 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 	return status;
 }
 
+BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s,
+                              BOOL skipCompression)
+{
+	if (!fastpath || !fastpath->rdp)
+		return FALSE;
+
+	/* all fragments of an update leave in a single write */
+	rdpTransport* transport = fastpath->rdp->transport;
+	if (!transport_write_batch_begin(transport))
+		return FALSE;
+
+	const BOOL rc = fastpath_send_update_pdu_fragments(fastpath, updateCode, s, skipCompression);
+
+	if (!transport_write_batch_end(transport))
+		return FALSE;
+
+	return rc;
+}
+
 rdpFastPath* fastpath_new(rdpRdp* rdp)
 {
 	rdpFastPath* fastpath = NULL;
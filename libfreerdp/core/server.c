@@ -55,6 +55,22 @@
 
 #define DVC_MAX_DATA_PDU_SIZE 1600
 
+/* DVC PDUs are queued in batches of up to this size, each PDU prefixed with its length */
+#define DVC_SEND_BATCH_SIZE (64 * 1024)
+
+/* the length prefix, the DVC header and the bulk header of a PDU at most */
+#define DVC_SEND_PDU_OVERHEAD 12
+
+/* writers wait once this much is queued and not yet sent */
+#define WTS_SEND_QUEUE_LIMIT (4 * 1024 * 1024)
+#define WTS_SEND_QUEUE_TIMEOUT 1000
+
+enum
+{
+	WTS_SEND_ITEM_BUFFER = 0,    /* a malloc'ed buffer sent as a single channel message */
+	WTS_SEND_ITEM_DVC_BATCH = 1, /* a pooled stream of length prefixed DVC PDUs */
+};
+
 typedef struct
 {
 	UINT16 channelId;
@@ -92,6 +108,45 @@ static BOOL wts_queue_receive_data(rdpPeerChannel* channel, const BYTE* Buffer,
 	return MessageQueue_Post(channel->queue, messageCtx, 0, NULL, NULL);
 }
 
+static void wts_send_queue_add(WTSVirtualChannelManager* vcm, size_t length)
+{
+	WINPR_ASSERT(vcm);
+
+	EnterCriticalSection(&vcm->sendLock);
+	vcm->sendPending += length;
+	if (vcm->sendPending >= WTS_SEND_QUEUE_LIMIT)
+		(void)ResetEvent(vcm->sendEvent);
+	LeaveCriticalSection(&vcm->sendLock);
+}
+
+static void wts_send_queue_remove(WTSVirtualChannelManager* vcm, size_t length)
+{
+	WINPR_ASSERT(vcm);
+
+	EnterCriticalSection(&vcm->sendLock);
+	vcm->sendPending -= MIN(vcm->sendPending, length);
+	if (vcm->sendPending < WTS_SEND_QUEUE_LIMIT)
+		(void)SetEvent(vcm->sendEvent);
+	LeaveCriticalSection(&vcm->sendLock);
+}
+
+/**
+ * Keep writers from queueing faster than the transport sends. The thread sending the
+ * queue never waits for itself, and no writer waits longer than the timeout, so a
+ * stalled session can not block a channel for good.
+ */
+static void wts_send_queue_wait(WTSVirtualChannelManager* vcm)
+{
+	WINPR_ASSERT(vcm);
+
+	const DWORD sendThreadId = (DWORD)InterlockedCompareExchange(&vcm->sendThreadId, 0, 0);
+	if ((sendThreadId == 0) || (sendThreadId == GetCurrentThreadId()))
+		return;
+
+	if (WaitForSingleObject(vcm->sendEvent, WTS_SEND_QUEUE_TIMEOUT) == WAIT_TIMEOUT)
+		WLog_DBG(TAG, "send queue still full after %d ms", WTS_SEND_QUEUE_TIMEOUT);
+}
+
 static BOOL wts_queue_send_item(rdpPeerChannel* channel, BYTE* Buffer, UINT32 Length)
 {
 	BYTE* buffer = NULL;
@@ -104,8 +159,118 @@ static BOOL wts_queue_send_item(rdpPeerChannel* channel, BYTE* Buffer, UINT32 Le
 
 	WINPR_ASSERT(channel->channelId <= UINT16_MAX);
 	const UINT16 channelId = (UINT16)channel->channelId;
-	return MessageQueue_Post(channel->vcm->queue, (void*)(UINT_PTR)channelId, 0, (void*)buffer,
-	                         (void*)(UINT_PTR)length);
+	wts_send_queue_add(channel->vcm, length);
+	if (!MessageQueue_Post(channel->vcm->queue, (void*)(UINT_PTR)channelId, WTS_SEND_ITEM_BUFFER,
+	                       (void*)buffer, (void*)(UINT_PTR)length))
+	{
+		wts_send_queue_remove(channel->vcm, length);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL wts_queue_send_batch(rdpPeerChannel* channel, wStream* s)
+{
+	WINPR_ASSERT(channel);
+	WINPR_ASSERT(channel->vcm);
+	WINPR_ASSERT(s);
+
+	/* the pooled buffer stays allocated until sent, count all of it */
+	const size_t length = Stream_Capacity(s);
+	Stream_SealLength(s);
+	Stream_SetPosition(s, 0);
+
+	WINPR_ASSERT(channel->channelId <= UINT16_MAX);
+	const UINT16 channelId = (UINT16)channel->channelId;
+	wts_send_queue_add(channel->vcm, length);
+	if (!MessageQueue_Post(channel->vcm->queue, (void*)(UINT_PTR)channelId,
+	                       WTS_SEND_ITEM_DVC_BATCH, s, (void*)(UINT_PTR)length))
+	{
+		wts_send_queue_remove(channel->vcm, length);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Send the PDUs of a DVC batch, each as a single chunk channel message. The channel
+ * header is written in front of the PDU in the transport stream, the PDU is not copied
+ * anywhere else.
+ */
+static BOOL wts_send_batch(WTSVirtualChannelManager* vcm, UINT16 channelId, wStream* s)
+{
+	WINPR_ASSERT(vcm);
+	WINPR_ASSERT(vcm->client);
+	WINPR_ASSERT(vcm->client->context);
+	WINPR_ASSERT(vcm->client->SendChannelData);
+	WINPR_ASSERT(vcm->client->SendChannelPacket);
+
+	const UINT32 VCChunkSize =
+	    freerdp_settings_get_uint32(vcm->client->context->settings, FreeRDP_VCChunkSize);
+
+	while (Stream_GetRemainingLength(s) >= 2)
+	{
+		BOOL rc = FALSE;
+		const UINT16 length = Stream_Get_UINT16(s);
+
+		if (!Stream_CheckAndLogRequiredLength(TAG, s, length))
+			return FALSE;
+
+		const BYTE* pdu = Stream_ConstPointer(s);
+		if (length <= VCChunkSize)
+			rc = vcm->client->SendChannelPacket(vcm->client, channelId, length,
+			                                    CHANNEL_FLAG_FIRST | CHANNEL_FLAG_LAST, pdu,
+			                                    length);
+		else
+			rc = vcm->client->SendChannelData(vcm->client, channelId, pdu, length);
+
+		if (!rc)
+			return FALSE;
+
+		Stream_Seek(s, length);
+	}
+
+	return TRUE;
+}
+
+static void wts_virtual_channel_manager_free_message(void* obj)
+{
+	wMessage* msg = (wMessage*)obj;
+
+	if (msg)
+	{
+		if (msg->id == WTS_SEND_ITEM_DVC_BATCH)
+		{
+			wStream* s = msg->wParam;
+			Stream_Release(s);
+		}
+		else
+		{
+			BYTE* buffer = (BYTE*)msg->wParam;
+
+			if (buffer)
+				free(buffer);
+		}
+	}
+}
+
+/**
+ * Drop everything still queued after a send failed. The items would never be sent, and
+ * writers would keep waiting for them to leave the queue.
+ */
+static void wts_send_queue_discard(WTSVirtualChannelManager* vcm)
+{
+	wMessage message = { 0 };
+
+	WINPR_ASSERT(vcm);
+
+	while (MessageQueue_Peek(vcm->queue, &message, TRUE))
+	{
+		wts_virtual_channel_manager_free_message(&message);
+		wts_send_queue_remove(vcm, (size_t)(UINT_PTR)message.lParam);
+	}
 }
 
 static unsigned wts_read_variable_uint(wStream* s, int cbLen, UINT32* val)
@@ -162,9 +327,7 @@ static BOOL wts_read_drdynvc_capabilities_response(rdpPeerChannel* channel, UINT
 
 	WTSVirtualChannelManager* vcm = channel->vcm;
 	vcm->drdynvc_state = DRDYNVC_STATE_READY;
-
-	/* we only support version 1 for now (no compression yet) */
-	vcm->dvc_spoken_version = MAX(Version, 1);
+	vcm->dvc_spoken_version = MIN(Version, vcm->dvc_spoken_version);
 
 	return SetEvent(MessageQueue_Event(vcm->queue));
 }
@@ -202,38 +365,41 @@ static BOOL wts_read_drdynvc_create_response(rdpPeerChannel* channel, wStream* s
 	return status;
 }
 
-static BOOL wts_read_drdynvc_data_first(rdpPeerChannel* channel, wStream* s, int cbLen,
-                                        UINT32 length)
+static BOOL wts_read_drdynvc_data(rdpPeerChannel* channel, wStream* s, UINT32 length,
+                                  BOOL compressed)
 {
+	BOOL ret = FALSE;
+	const BYTE* data = NULL;
+
 	WINPR_ASSERT(channel);
 	WINPR_ASSERT(s);
-	const UINT32 value = wts_read_variable_uint(s, cbLen, &channel->dvc_total_length);
-
-	if (value == 0)
-		return FALSE;
-	if (value > length)
-		length = 0;
-	else
-		length -= value;
-
-	if (length > channel->dvc_total_length)
+	if (!Stream_CheckAndLogRequiredLength(TAG, s, length))
 		return FALSE;
 
-	Stream_SetPosition(channel->receiveData, 0);
+	data = Stream_ConstPointer(s);
+	const UINT32 wireLength = length;
 
-	if (!Stream_EnsureRemainingCapacity(channel->receiveData, channel->dvc_total_length))
-		return FALSE;
+	if (compressed)
+	{
+		if (!channel->decompressor)
+			channel->decompressor = zgfx_context_new(FALSE);
 
-	Stream_Write(channel->receiveData, Stream_ConstPointer(s), length);
-	return TRUE;
-}
+		if (!channel->decompressor ||
+		    !zgfx_decompress_bulk(channel->decompressor, data, length, &data, &length))
+		{
+			WLog_ERR(TAG, "ChannelId %" PRIu32 " failed to decompress data", channel->channelId);
+			return FALSE;
+		}
+	}
 
-static BOOL wts_read_drdynvc_data(rdpPeerChannel* channel, wStream* s, UINT32 length)
-{
-	BOOL ret = FALSE;
+	/* WTSChannelGetStatisticsByHandle reads them under the same lock */
+	EnterCriticalSection(&channel->writeLock);
+	channel->stats.ReceivedWireBytes += wireLength;
+	channel->stats.ReceivedPayloadBytes += length;
+	if (compressed)
+		channel->stats.ReceivedCompressedPdus++;
+	LeaveCriticalSection(&channel->writeLock);
 
-	WINPR_ASSERT(channel);
-	WINPR_ASSERT(s);
 	if (channel->dvc_total_length > 0)
 	{
 		if (Stream_GetPosition(channel->receiveData) + length > channel->dvc_total_length)
@@ -243,7 +409,7 @@ static BOOL wts_read_drdynvc_data(rdpPeerChannel* channel, wStream* s, UINT32 le
 			return FALSE;
 		}
 
-		Stream_Write(channel->receiveData, Stream_ConstPointer(s), length);
+		Stream_Write(channel->receiveData, data, length);
 
 		if (Stream_GetPosition(channel->receiveData) >= channel->dvc_total_length)
 		{
@@ -256,12 +422,35 @@ static BOOL wts_read_drdynvc_data(rdpPeerChannel* channel, wStream* s, UINT32 le
 	}
 	else
 	{
-		ret = wts_queue_receive_data(channel, Stream_ConstPointer(s), length);
+		ret = wts_queue_receive_data(channel, data, length);
 	}
 
 	return ret;
 }
 
+static BOOL wts_read_drdynvc_data_first(rdpPeerChannel* channel, wStream* s, int cbLen,
+                                        UINT32 length, BOOL compressed)
+{
+	WINPR_ASSERT(channel);
+	WINPR_ASSERT(s);
+	const UINT32 value = wts_read_variable_uint(s, cbLen, &channel->dvc_total_length);
+
+	if (value == 0)
+		return FALSE;
+	if (value > length)
+		length = 0;
+	else
+		length -= value;
+
+	Stream_SetPosition(channel->receiveData, 0);
+
+	if (!Stream_EnsureRemainingCapacity(channel->receiveData, channel->dvc_total_length))
+		return FALSE;
+
+	/* the total length is that of the uncompressed data */
+	return wts_read_drdynvc_data(channel, s, length, compressed);
+}
+
 static void wts_read_drdynvc_close_response(rdpPeerChannel* channel)
 {
 	WINPR_ASSERT(channel);
@@ -334,38 +523,37 @@ static BOOL wts_read_drdynvc_pdu(rdpPeerChannel* channel)
 				return wts_read_drdynvc_create_response(dvc, channel->receiveData, (UINT32)length);
 
 			case DATA_FIRST_PDU:
+			case DATA_FIRST_COMPRESSED_PDU:
 				if (dvc->dvc_open_state != DVC_OPEN_STATE_SUCCEEDED)
 				{
 					WLog_ERR(TAG,
 					         "ChannelId %" PRIu32 " did not open successfully. "
-					         "Ignoring DYNVC_DATA_FIRST PDU",
-					         ChannelId);
+					         "Ignoring %s PDU",
+					         ChannelId, drdynvc_get_packet_type(Cmd));
 					return TRUE;
 				}
 
-				return wts_read_drdynvc_data_first(dvc, channel->receiveData, Sp, (UINT32)length);
+				return wts_read_drdynvc_data_first(dvc, channel->receiveData, Sp, (UINT32)length,
+				                                   Cmd == DATA_FIRST_COMPRESSED_PDU);
 
 			case DATA_PDU:
+			case DATA_COMPRESSED_PDU:
 				if (dvc->dvc_open_state != DVC_OPEN_STATE_SUCCEEDED)
 				{
 					WLog_ERR(TAG,
 					         "ChannelId %" PRIu32 " did not open successfully. "
-					         "Ignoring DYNVC_DATA PDU",
-					         ChannelId);
+					         "Ignoring %s PDU",
+					         ChannelId, drdynvc_get_packet_type(Cmd));
 					return TRUE;
 				}
 
-				return wts_read_drdynvc_data(dvc, channel->receiveData, (UINT32)length);
+				return wts_read_drdynvc_data(dvc, channel->receiveData, (UINT32)length,
+				                             Cmd == DATA_COMPRESSED_PDU);
 
 			case CLOSE_REQUEST_PDU:
 				wts_read_drdynvc_close_response(dvc);
 				break;
 
-			case DATA_FIRST_COMPRESSED_PDU:
-			case DATA_COMPRESSED_PDU:
-				WLog_ERR(TAG, "Compressed data not handled");
-				break;
-
 			case SOFT_SYNC_RESPONSE_PDU:
 				WLog_ERR(TAG, "SoftSync response not handled yet(and rather strange to receive "
 				              "that packet as our code doesn't send SoftSync requests");
@@ -575,13 +763,26 @@ BOOL WTSVirtualChannelManagerOpen(HANDLE hServer)
 			wStream staticS = { 0 };
 			wStream* s = Stream_StaticInit(&staticS, capaBuffer, sizeof(capaBuffer));
 
+			WINPR_ASSERT(vcm->client);
+			WINPR_ASSERT(vcm->client->context);
+			/* older FreeRDP clients answer version 3 but can not decompress, so opt in only */
+			const BOOL compression = freerdp_settings_get_bool(vcm->client->context->settings,
+			                                                   FreeRDP_DynamicChannelCompression);
+
 			vcm->drdynvc_channel = channel;
-			vcm->dvc_spoken_version = 1;
-			Stream_Write_UINT8(s, 0x50);    /* Cmd=5 sp=0 cbId=0 */
-			Stream_Write_UINT8(s, 0x00);    /* Pad */
-			Stream_Write_UINT16(s, 0x0001); /* Version */
+			vcm->dvc_spoken_version = compression ? DRDYNVC_CAPS_VERSION_COMPRESSION : 1;
+			Stream_Write_UINT8(s, 0x50);                     /* Cmd=5 sp=0 cbId=0 */
+			Stream_Write_UINT8(s, 0x00);                     /* Pad */
+			Stream_Write_UINT16(s, vcm->dvc_spoken_version); /* Version */
 
-			/* TODO: shall implement version 2 and 3 */
+			if (vcm->dvc_spoken_version > 1)
+			{
+				/* the priority charges of the specification example */
+				Stream_Write_UINT16(s, 936);   /* PriorityCharge0 */
+				Stream_Write_UINT16(s, 3276);  /* PriorityCharge1 */
+				Stream_Write_UINT16(s, 9362);  /* PriorityCharge2 */
+				Stream_Write_UINT16(s, 37449); /* PriorityCharge3 */
+			}
 
 			const size_t pos = Stream_GetPosition(s);
 			WINPR_ASSERT(pos <= UINT32_MAX);
@@ -611,6 +812,13 @@ BOOL WTSVirtualChannelManagerCheckFileDescriptorEx(HANDLE hServer, BOOL autoOpen
 			return FALSE;
 	}
 
+	(void)InterlockedExchange(&vcm->sendThreadId, (LONG)GetCurrentThreadId());
+
+	/* hand all queued channel messages to the transport in one go */
+	WINPR_ASSERT(vcm->rdp);
+	if (!transport_write_batch_begin(vcm->rdp->transport))
+		return FALSE;
+
 	while (MessageQueue_Peek(vcm->queue, &message, TRUE))
 	{
 		BYTE* buffer = NULL;
@@ -622,17 +830,34 @@ BOOL WTSVirtualChannelManagerCheckFileDescriptorEx(HANDLE hServer, BOOL autoOpen
 
 		WINPR_ASSERT(vcm->client);
 		WINPR_ASSERT(vcm->client->SendChannelData);
-		if (!vcm->client->SendChannelData(vcm->client, channelId, buffer, length))
+		if (message.id == WTS_SEND_ITEM_DVC_BATCH)
 		{
-			status = FALSE;
+			wStream* s = message.wParam;
+			status = wts_send_batch(vcm, channelId, s);
+			Stream_Release(s);
 		}
+		else
+		{
+			if (!vcm->client->SendChannelData(vcm->client, channelId, buffer, length))
+			{
+				status = FALSE;
+			}
 
-		free(buffer);
+			free(buffer);
+		}
+
+		wts_send_queue_remove(vcm, length);
 
 		if (!status)
+		{
+			wts_send_queue_discard(vcm);
 			break;
+		}
 	}
 
+	if (!transport_write_batch_end(vcm->rdp->transport))
+		status = FALSE;
+
 	return status;
 }
 
@@ -756,6 +981,20 @@ UINT32 WTSChannelGetIdByHandle(HANDLE hChannelHandle)
 	return channel->channelId;
 }
 
+BOOL WTSChannelGetStatisticsByHandle(HANDLE hChannelHandle, DRDYNVC_CHANNEL_STATISTICS* stats)
+{
+	rdpPeerChannel* channel = hChannelHandle;
+
+	WINPR_ASSERT(stats);
+	if (!channel || (channel->channelType != RDP_PEER_CHANNEL_TYPE_DVC))
+		return FALSE;
+
+	EnterCriticalSection(&channel->writeLock);
+	*stats = channel->stats;
+	LeaveCriticalSection(&channel->writeLock);
+	return TRUE;
+}
+
 BOOL WTSChannelSetHandleByName(freerdp_peer* client, const char* channel_name, void* handle)
 {
 	rdpMcsChannel* channel = NULL;
@@ -936,19 +1175,6 @@ HANDLE WINAPI FreeRDP_WTSOpenServerW(LPWSTR pServerName)
 	return INVALID_HANDLE_VALUE;
 }
 
-static void wts_virtual_channel_manager_free_message(void* obj)
-{
-	wMessage* msg = (wMessage*)obj;
-
-	if (msg)
-	{
-		BYTE* buffer = (BYTE*)msg->wParam;
-
-		if (buffer)
-			free(buffer);
-	}
-}
-
 static void channel_free(rdpPeerChannel* channel)
 {
 	server_channel_common_free(channel);
@@ -1014,11 +1240,24 @@ HANDLE WINAPI FreeRDP_WTSOpenServerA(LPSTR pServerName)
 	if (!HashTable_Insert(g_ServerHandles, (void*)(UINT_PTR)vcm->SessionId, (void*)vcm))
 		goto error_free;
 
+	vcm->sendPool = StreamPool_New(TRUE, DVC_SEND_BATCH_SIZE);
+
+	if (!vcm->sendPool)
+		goto error_queue;
+
+	vcm->sendEvent = CreateEvent(NULL, TRUE, TRUE, NULL);
+
+	if (!vcm->sendEvent)
+		goto error_send;
+
+	if (!InitializeCriticalSectionAndSpinCount(&vcm->sendLock, 4000))
+		goto error_send_lock;
+
 	queueCallbacks.fnObjectFree = wts_virtual_channel_manager_free_message;
 	vcm->queue = MessageQueue_New(&queueCallbacks);
 
 	if (!vcm->queue)
-		goto error_queue;
+		goto error_send_queue;
 
 	vcm->dvc_channel_id_seq = 0;
 	vcm->dynamicVirtualChannels = HashTable_New(TRUE);
@@ -1045,6 +1284,12 @@ error_hashFunction:
 	HashTable_Free(vcm->dynamicVirtualChannels);
 error_dynamicVirtualChannels:
 	MessageQueue_Free(vcm->queue);
+error_send_queue:
+	DeleteCriticalSection(&vcm->sendLock);
+error_send_lock:
+	(void)CloseHandle(vcm->sendEvent);
+error_send:
+	StreamPool_Free(vcm->sendPool);
 error_queue:
 	HashTable_Remove(g_ServerHandles, (void*)(UINT_PTR)vcm->SessionId);
 error_free:
@@ -1082,6 +1327,9 @@ VOID WINAPI FreeRDP_WTSCloseServer(HANDLE hServer)
 		}
 
 		MessageQueue_Free(vcm->queue);
+		DeleteCriticalSection(&vcm->sendLock);
+		(void)CloseHandle(vcm->sendEvent);
+		StreamPool_Free(vcm->sendPool);
 		free(vcm);
 	}
 }
@@ -1545,13 +1793,160 @@ BOOL WINAPI FreeRDP_WTSVirtualChannelRead(HANDLE hChannelHandle, ULONG TimeOut,
 	return TRUE;
 }
 
+static BOOL wts_dvc_compression_enabled(const rdpPeerChannel* channel)
+{
+	WINPR_ASSERT(channel);
+	WINPR_ASSERT(channel->vcm);
+
+	if (channel->vcm->dvc_spoken_version < DRDYNVC_CAPS_VERSION_COMPRESSION)
+		return FALSE;
+
+	WINPR_ASSERT(channel->client);
+	WINPR_ASSERT(channel->client->context);
+	return freerdp_settings_get_bool(channel->client->context->settings,
+	                                 FreeRDP_DynamicChannelCompression);
+}
+
+/* the room the next PDU of the data takes in a batch */
+static size_t wts_drdynvc_pdu_size(UINT32 Length)
+{
+	return MIN(2ull + DVC_MAX_DATA_PDU_SIZE, 1ull * Length + DVC_SEND_PDU_OVERHEAD);
+}
+
+/* a batch for the data, or as much of it as fits, every PDU carries 1590 bytes at least */
+static size_t wts_drdynvc_batch_size(UINT32 Length)
+{
+	const size_t pdus = (Length + DRDYNVC_COMPRESSED_CHUNK_LENGTH - 1ull) /
+	                    DRDYNVC_COMPRESSED_CHUNK_LENGTH;
+	return MIN(DVC_SEND_BATCH_SIZE, Length + pdus * DVC_SEND_PDU_OVERHEAD);
+}
+
+/**
+ * Append a DVC PDU carrying the next chunk of the data to a batch.
+ * Chunks are compressed with the history of the channel if compressed is set.
+ */
+static BOOL wts_write_drdynvc_pdu(rdpPeerChannel* channel, wStream* s, const BYTE** pBuffer,
+                                  UINT32* pLength, BOOL first, BOOL compressed)
+{
+	int cbLen = 0;
+	BYTE Cmd = compressed ? DATA_COMPRESSED_PDU : DATA_PDU;
+	const BYTE* Buffer = *pBuffer;
+	const UINT32 Length = *pLength;
+
+	WINPR_ASSERT(channel);
+	if (!Stream_EnsureRemainingCapacity(s, wts_drdynvc_pdu_size(Length)))
+		return FALSE;
+
+	const size_t frame = Stream_GetPosition(s);
+	Stream_Seek_UINT16(s); /* PDU length, only used by the send queue */
+	Stream_Seek_UINT8(s);
+	const int cbChId = wts_write_variable_uint(s, channel->channelId);
+	size_t room = DVC_MAX_DATA_PDU_SIZE - (Stream_GetPosition(s) - frame - 2);
+
+	if (compressed)
+		room = DRDYNVC_COMPRESSED_CHUNK_LENGTH;
+
+	if (first && (Length > room))
+	{
+		/* the total length, before compression for compressed data */
+		const size_t pos = Stream_GetPosition(s);
+		cbLen = wts_write_variable_uint(s, Length);
+		Cmd = compressed ? DATA_FIRST_COMPRESSED_PDU : DATA_FIRST_PDU;
+
+		if (!compressed)
+			room -= Stream_GetPosition(s) - pos;
+	}
+
+	const UINT32 chunkLength = (UINT32)MIN(Length, room);
+	const size_t pos = Stream_GetPosition(s);
+
+	if (compressed)
+	{
+		if (!zgfx_compress_bulk(channel->compressor, s, Buffer, chunkLength))
+		{
+			WLog_ERR(TAG, "zgfx_compress_bulk failed!");
+			return FALSE;
+		}
+
+		channel->stats.SentCompressedPdus++;
+	}
+	else
+		Stream_Write(s, Buffer, chunkLength);
+
+	const size_t end = Stream_GetPosition(s);
+	Stream_SetPosition(s, frame);
+	Stream_Write_UINT16(s, WINPR_ASSERTING_INT_CAST(UINT16, end - frame - 2));
+	Stream_Write_UINT8(s, ((Cmd << 4) | (cbLen << 2) | cbChId) & 0xFF);
+	Stream_SetPosition(s, end);
+
+	channel->stats.SentPayloadBytes += chunkLength;
+	channel->stats.SentWireBytes += end - pos;
+
+	*pBuffer = &Buffer[chunkLength];
+	*pLength = Length - chunkLength;
+	return TRUE;
+}
+
+/**
+ * Split the data of a dynamic channel into DVC PDUs. The PDUs are built in pooled batch
+ * streams, headers in place, so the data is copied once and queued once per batch.
+ */
+static BOOL wts_write_drdynvc_data(rdpPeerChannel* channel, const BYTE* Buffer, UINT32 Length)
+{
+	BOOL first = TRUE;
+
+	WINPR_ASSERT(channel);
+	WINPR_ASSERT(channel->vcm);
+
+	WTSVirtualChannelManager* vcm = channel->vcm;
+	const BOOL compressed = wts_dvc_compression_enabled(channel);
+
+	if (compressed && !channel->compressor)
+	{
+		channel->compressor = zgfx_context_new(TRUE);
+
+		if (!channel->compressor)
+		{
+			SetLastError(E_OUTOFMEMORY);
+			return FALSE;
+		}
+	}
+
+	while (Length > 0)
+	{
+		wStream* s = StreamPool_Take(vcm->sendPool, wts_drdynvc_batch_size(Length));
+
+		if (!s)
+		{
+			WLog_ERR(TAG, "StreamPool_Take failed!");
+			SetLastError(E_OUTOFMEMORY);
+			return FALSE;
+		}
+
+		while ((Length > 0) && (Stream_GetRemainingCapacity(s) >= wts_drdynvc_pdu_size(Length)))
+		{
+			if (!wts_write_drdynvc_pdu(channel, s, &Buffer, &Length, first, compressed))
+			{
+				Stream_Release(s);
+				return FALSE;
+			}
+
+			first = FALSE;
+		}
+
+		if (!wts_queue_send_batch(vcm->drdynvc_channel, s))
+		{
+			Stream_Release(s);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
 BOOL WINAPI FreeRDP_WTSVirtualChannelWrite(HANDLE hChannelHandle, PCHAR Buffer, ULONG Length,
                                            PULONG pBytesWritten)
 {
-	wStream* s = NULL;
-	int cbLen = 0;
-	int cbChId = 0;
-	int first = 0;
 	BYTE* buffer = NULL;
 	UINT32 totalWritten = 0;
 	rdpPeerChannel* channel = (rdpPeerChannel*)hChannelHandle;
@@ -1560,8 +1955,10 @@ BOOL WINAPI FreeRDP_WTSVirtualChannelWrite(HANDLE hChannelHandle, PCHAR Buffer,
 	if (!channel)
 		return FALSE;
 
-	EnterCriticalSection(&channel->writeLock);
 	WINPR_ASSERT(channel->vcm);
+	wts_send_queue_wait(channel->vcm);
+
+	EnterCriticalSection(&channel->writeLock);
 	if (channel->channelType == RDP_PEER_CHANNEL_TYPE_SVC)
 	{
 		const ULONG length = Length;
@@ -1585,54 +1982,10 @@ BOOL WINAPI FreeRDP_WTSVirtualChannelWrite(HANDLE hChannelHandle, PCHAR Buffer,
 	}
 	else
 	{
-		rdpContext* context = NULL;
-
-		first = TRUE;
-		WINPR_ASSERT(channel->client);
-		context = channel->client->context;
-		WINPR_ASSERT(context);
-		while (Length > 0)
-		{
-			s = Stream_New(NULL, DVC_MAX_DATA_PDU_SIZE);
-
-			if (!s)
-			{
-				WLog_ERR(TAG, "Stream_New failed!");
-				SetLastError(E_OUTOFMEMORY);
-				goto fail;
-			}
-
-			buffer = Stream_Buffer(s);
-			Stream_Seek_UINT8(s);
-			cbChId = wts_write_variable_uint(s, channel->channelId);
-
-			if (first && (Length > Stream_GetRemainingLength(s)))
-			{
-				cbLen = wts_write_variable_uint(s, Length);
-				buffer[0] = ((DATA_FIRST_PDU << 4) | (cbLen << 2) | cbChId) & 0xFF;
-			}
-			else
-			{
-				buffer[0] = ((DATA_PDU << 4) | cbChId) & 0xFF;
-			}
+		if (!wts_write_drdynvc_data(channel, (const BYTE*)Buffer, Length))
+			goto fail;
 
-			first = FALSE;
-			size_t written = Stream_GetRemainingLength(s);
-
-			if (written > Length)
-				written = Length;
-
-			Stream_Write(s, Buffer, written);
-			const size_t length = Stream_GetPosition(s);
-			Stream_Free(s, FALSE);
-			if (length > UINT32_MAX)
-				goto fail;
-			Length -= written;
-			Buffer += written;
-			totalWritten += written;
-			if (!wts_queue_send_item(channel->vcm->drdynvc_channel, buffer, (UINT32)length))
-				goto fail;
-		}
+		totalWritten = Length;
 	}
 
 	if (pBytesWritten)
@@ -1938,6 +2291,8 @@ void server_channel_common_free(rdpPeerChannel* channel)
 		return;
 	MessageQueue_Free(channel->queue);
 	Stream_Free(channel->receiveData, TRUE);
+	zgfx_context_free(channel->compressor);
+	zgfx_context_free(channel->decompressor);
 	DeleteCriticalSection(&channel->writeLock);
 	free(channel);
 }
@@ -24,6 +24,8 @@
 #include <freerdp/freerdp.h>
 #include <freerdp/api.h>
 #include <freerdp/channels/wtsvc.h>
+#include <freerdp/channels/drdynvc.h>
+#include <freerdp/codec/zgfx.h>
 
 #include <winpr/synch.h>
 #include <winpr/stream.h>
@@ -70,6 +72,11 @@ struct rdp_peer_channel
 
 	char channelName[128];
 	CRITICAL_SECTION writeLock;
+
+	/* per direction RDP8 bulk histories, created on the first compressed PDU */
+	ZGFX_CONTEXT* compressor;
+	ZGFX_CONTEXT* decompressor;
+	DRDYNVC_CHANNEL_STATISTICS stats;
 };
 
 struct WTSVirtualChannelManager
@@ -89,6 +96,12 @@ struct WTSVirtualChannelManager
 	void* dvc_creation_status_userdata;
 
 	wHashTable* dynamicVirtualChannels;
+
+	wStreamPool* sendPool;
+	CRITICAL_SECTION sendLock;
+	HANDLE sendEvent; /* set while the send queue is below its limit */
+	size_t sendPending; /* bytes held by the queue, guarded by sendLock */
+	LONG sendThreadId; /* the thread draining the queue, use Interlocked functions */
 };
 
 FREERDP_LOCAL BOOL WINAPI FreeRDP_WTSStartRemoteControlSessionW(LPWSTR pTargetServerName,
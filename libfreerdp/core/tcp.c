@@ -458,6 +458,7 @@ typedef struct
 	BIO* bufferedBio;
 	BOOL readBlocked;
 	BOOL writeBlocked;
+	BOOL corked;
 	RingBuffer xmitBuffer;
 } WINPR_BIO_BUFFERED_SOCKET;
 
@@ -493,6 +494,10 @@ static int transport_bio_buffered_write(BIO* bio, const char* buf, int num)
 		return -1;
 	}
 
+	/* corked: collect everything and send it in one go when uncorked */
+	if (ptr->corked)
+		return ret;
+
 	nchunks = ringbuffer_peek(&ptr->xmitBuffer, chunks, ringbuffer_used(&ptr->xmitBuffer));
 	next_bio = BIO_next(bio);
 
@@ -608,6 +613,15 @@ static long transport_bio_buffered_ctrl(BIO* bio, int cmd, long arg1, void* arg2
 			status = (int)ptr->writeBlocked;
 			break;
 
+		case BIO_C_SET_CORK:
+			ptr->corked = (arg1 != 0);
+			status = 1;
+
+			if (!ptr->corked && ringbuffer_used(&ptr->xmitBuffer))
+				status = (transport_bio_buffered_write(bio, NULL, 0) >= 0) ? 1 : -1;
+
+			break;
+
 		default:
 			status = BIO_ctrl(BIO_next(bio), cmd, arg1, arg2);
 			break;
@@ -49,6 +49,7 @@ static const size_t bool_list_indices[] = {
 	FreeRDP_DrawGdiPlusEnabled,
 	FreeRDP_DrawNineGridEnabled,
 	FreeRDP_DumpRemoteFx,
+	FreeRDP_DynamicChannelCompression,
 	FreeRDP_DynamicDaylightTimeDisabled,
 	FreeRDP_DynamicResolutionUpdate,
 	FreeRDP_EmbeddedWindow,
@@ -76,7 +77,9 @@ static const size_t bool_list_indices[] = {
 	FreeRDP_GatewayUseSameCredentials,
 	FreeRDP_GfxAVC444,
 	FreeRDP_GfxAVC444v2,
+	FreeRDP_GfxClearCodec,
 	FreeRDP_GfxH264,
+	FreeRDP_GfxMixedCodecs,
 	FreeRDP_GfxPlanar,
 	FreeRDP_GfxProgressive,
 	FreeRDP_GfxProgressiveV2,
@@ -152,6 +155,7 @@ static const size_t bool_list_indices[] = {
 	FreeRDP_SendPreconnectionPdu,
 	FreeRDP_ServerLicenseRequired,
 	FreeRDP_ServerMode,
+	FreeRDP_SharedMemoryPresentation,
 	FreeRDP_SmartSizing,
 	FreeRDP_SmartcardEmulation,
 	FreeRDP_SmartcardLogon,
@@ -342,6 +346,8 @@ static const size_t uint32_list_indices[] = {
 	FreeRDP_TcpKeepAliveRetries,
 	FreeRDP_ThreadingFlags,
 	FreeRDP_TlsSecLevel,
+	FreeRDP_TransportWriteBatchDelay,
+	FreeRDP_TransportWriteBatchThreshold,
 	FreeRDP_VCChunkSize,
 	FreeRDP_VCFlags,
 };
@@ -77,6 +77,7 @@ struct rdp_transport
 	rdpNla* nla;
 	void* ReceiveExtra;
 	wStream* ReceiveBuffer;
+	size_t ReceiveAhead;
 	TransportRecv ReceiveCallback;
 	wStreamPool* ReceivePool;
 	HANDLE connectedEvent;
@@ -95,6 +96,9 @@ struct rdp_transport
 	HANDLE ioEvent;
 	BOOL useIoEvent;
 	BOOL earlyUserAuth;
+	wStream* WriteBatch;
+	UINT32 WriteBatchDepth;
+	UINT64 WriteBatchStart;
 };
 
 static void transport_ssl_cb(const SSL* ssl, int where, int ret)
@@ -777,7 +781,14 @@ static void transport_bio_error_log(rdpTransport* transport, LPCSTR biofunc, BIO
 	}
 }
 
-static SSIZE_T transport_read_layer(rdpTransport* transport, BYTE* data, size_t bytes)
+/**
+ * @brief Read from the front BIO
+ *
+ * @param partial If \b TRUE return as soon as some data was read, otherwise keep reading (in
+ * blocking mode) until \b bytes are available.
+ */
+static SSIZE_T transport_read_layer_ex(rdpTransport* transport, BYTE* data, size_t bytes,
+                                       BOOL partial)
 {
 	SSIZE_T read = 0;
 	rdpRdp* rdp = NULL;
@@ -845,11 +856,19 @@ static SSIZE_T transport_read_layer(rdpTransport* transport, BYTE* data, size_t
 #endif
 		read += status;
 		rdp->inBytes += WINPR_ASSERTING_INT_CAST(uint64_t, status);
+
+		if (partial)
+			break;
 	}
 
 	return read;
 }
 
+static SSIZE_T transport_read_layer(rdpTransport* transport, BYTE* data, size_t bytes)
+{
+	return transport_read_layer_ex(transport, data, bytes, FALSE);
+}
+
 /**
  * @brief Tries to read toRead bytes from the specified transport
  *
@@ -1055,6 +1074,81 @@ SSIZE_T transport_parse_pdu(rdpTransport* transport, wStream* s, BOOL* incomplet
 	return pduLength;
 }
 
+/**
+ * Reading ahead is only safe for the receive buffer owned by transport_check_fds, as the
+ * surplus is carried over to its successor. It is further limited to the established
+ * connection: during the security handshake other code reads from the layer directly and
+ * must not miss bytes we buffered.
+ */
+static BOOL transport_can_read_ahead(rdpTransport* transport, wStream* s)
+{
+	if (s != transport->ReceiveBuffer)
+		return FALSE;
+
+	if (transport->io.ReadBytes != transport_read_layer)
+		return FALSE;
+
+	if (transport->NlaMode || transport->RdstlsMode || transport->AadMode ||
+	    transport->earlyUserAuth)
+		return FALSE;
+
+	switch (transport->layer)
+	{
+		case TRANSPORT_LAYER_TLS:
+		case TRANSPORT_LAYER_TSG:
+		case TRANSPORT_LAYER_TSG_TLS:
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+/**
+ * @brief Read a PDU pulling in as much as the layer offers with each read.
+ *
+ * Data is read straight into the pool stream that is later handed to the receive callback.
+ * Bytes past the end of the PDU are left in the buffer, the stream length is set to the PDU
+ * length and transport->ReceiveAhead holds the number of surplus bytes.
+ */
+static int transport_read_pdu_ahead(rdpTransport* transport, wStream* s)
+{
+	size_t pduLength = 0;
+
+	for (;;)
+	{
+		Stream_SealLength(s);
+		const SSIZE_T status = parse_default_mode_pdu(transport, s);
+		if (status < 0)
+			return -1;
+
+		pduLength = (size_t)status;
+		const size_t position = Stream_GetPosition(s);
+		if ((pduLength > 0) && (position >= pduLength))
+			break;
+
+		const size_t missing = (pduLength > position) ? pduLength - position : 1;
+		if (!Stream_EnsureRemainingCapacity(s, MAX(BUFFER_SIZE, missing)))
+			return -1;
+
+		const SSIZE_T rc = transport_read_layer_ex(transport, Stream_Pointer(s),
+		                                           Stream_GetRemainingCapacity(s), TRUE);
+		if (rc <= 0)
+			return (rc == 0) ? 0 : -1;
+
+		Stream_Seek(s, (size_t)rc);
+	}
+
+	if (pduLength > INT32_MAX)
+		return -1;
+
+	WLog_Packet(transport->log, WLOG_TRACE, Stream_Buffer(s), pduLength, WLOG_PACKET_INBOUND);
+
+	transport->ReceiveAhead = Stream_GetPosition(s) - pduLength;
+	Stream_SetLength(s, pduLength);
+	Stream_SetPosition(s, 0);
+	return (int)pduLength;
+}
+
 static int transport_default_read_pdu(rdpTransport* transport, wStream* s)
 {
 	BOOL incomplete = 0;
@@ -1080,6 +1174,8 @@ static int transport_default_read_pdu(rdpTransport* transport, wStream* s)
 			Stream_Write_UINT8(s, c);
 		} while (c != '\0');
 	}
+	else if (transport_can_read_ahead(transport, s))
+		return transport_read_pdu_ahead(transport, s);
 	else if (transport->earlyUserAuth)
 	{
 		if (!Stream_EnsureCapacity(s, 4))
@@ -1148,42 +1244,45 @@ int transport_write(rdpTransport* transport, wStream* s)
 	return IFCALLRESULT(-1, transport->io.WritePdu, transport, s);
 }
 
-static int transport_default_write(rdpTransport* transport, wStream* s)
+/* must be called with WriteLock held */
+static BOOL transport_write_wait_flushed(rdpTransport* transport)
 {
-	int status = -1;
 	rdpContext* context = transport_get_context(transport);
 
-	WINPR_ASSERT(transport);
 	WINPR_ASSERT(context);
+	WINPR_ASSERT(context->settings);
 
-	if (!s)
-		return -1;
-
-	Stream_AddRef(s);
+	if (!transport->blocking && !context->settings->WaitForOutputBufferFlush)
+		return TRUE;
 
-	rdpRdp* rdp = context->rdp;
-	if (!rdp)
-		goto fail;
+	while (BIO_write_blocked(transport->frontBio))
+	{
+		if (BIO_wait_write(transport->frontBio, 100) < 0)
+		{
+			WLog_Print(transport->log, WLOG_ERROR, "error when selecting for write");
+			return FALSE;
+		}
 
-	EnterCriticalSection(&(transport->WriteLock));
-	if (!transport->frontBio)
-		goto out_cleanup;
+		if (BIO_flush(transport->frontBio) < 1)
+		{
+			WLog_Print(transport->log, WLOG_ERROR, "error when flushing outputBuffer");
+			return FALSE;
+		}
+	}
 
-	size_t length = Stream_GetPosition(s);
-	size_t writtenlength = length;
-	Stream_SetPosition(s, 0);
+	return TRUE;
+}
 
-	if (length > 0)
-	{
-		rdp->outBytes += length;
-		WLog_Packet(transport->log, WLOG_TRACE, Stream_Buffer(s), length, WLOG_PACKET_OUTBOUND);
-	}
+/* must be called with WriteLock held */
+static int transport_write_bio(rdpTransport* transport, const BYTE* data, size_t length)
+{
+	int status = -1;
 
 	while (length > 0)
 	{
 		ERR_clear_error();
 		const int towrite = (length > INT32_MAX) ? INT32_MAX : (int)length;
-		status = BIO_write(transport->frontBio, Stream_ConstPointer(s), towrite);
+		status = BIO_write(transport->frontBio, data, towrite);
 
 		if (status <= 0)
 		{
@@ -1194,52 +1293,162 @@ static int transport_default_write(rdpTransport* transport, wStream* s)
 			if (!BIO_should_retry(transport->frontBio))
 			{
 				WLog_ERR_BIO(transport, "BIO_should_retry", transport->frontBio);
-				goto out_cleanup;
+				return -1;
 			}
 
 			/* non-blocking can live with blocked IOs */
 			if (!transport->blocking)
 			{
 				WLog_ERR_BIO(transport, "BIO_write", transport->frontBio);
-				goto out_cleanup;
+				return -1;
 			}
 
 			if (BIO_wait_write(transport->frontBio, 100) < 0)
 			{
 				WLog_ERR_BIO(transport, "BIO_wait_write", transport->frontBio);
-				status = -1;
-				goto out_cleanup;
+				return -1;
 			}
 
 			continue;
 		}
 
-		WINPR_ASSERT(context->settings);
-		if (transport->blocking || context->settings->WaitForOutputBufferFlush)
-		{
-			while (BIO_write_blocked(transport->frontBio))
-			{
-				if (BIO_wait_write(transport->frontBio, 100) < 0)
-				{
-					WLog_Print(transport->log, WLOG_ERROR, "error when selecting for write");
-					status = -1;
-					goto out_cleanup;
-				}
-
-				if (BIO_flush(transport->frontBio) < 1)
-				{
-					WLog_Print(transport->log, WLOG_ERROR, "error when flushing outputBuffer");
-					status = -1;
-					goto out_cleanup;
-				}
-			}
-		}
+		if (!transport_write_wait_flushed(transport))
+			return -1;
 
 		length -= (size_t)status;
-		Stream_Seek(s, (size_t)status);
+		data += status;
+	}
+
+	return status;
+}
+
+/**
+ * Write the queued PDUs followed by \b data (may be \b NULL) as a single BIO_write.
+ * The socket BIO is corked for the duration so the TLS records produced end up in
+ * one send call. Must be called with WriteLock held.
+ */
+static int transport_write_batch_flush(rdpTransport* transport, const BYTE* data, size_t length)
+{
+	int status = 1;
+	wStream* batch = transport->WriteBatch;
+	const size_t queued = batch ? Stream_GetPosition(batch) : 0;
+
+	if (queued == 0)
+	{
+		if (length == 0)
+			return status;
+		return transport_write_bio(transport, data, length);
+	}
+
+	/* gateway BIO chains do not know about corking, they just get a larger write */
+	const BOOL corked = BIO_set_cork(transport->frontBio, TRUE) > 0;
+	status = transport_write_bio(transport, Stream_Buffer(batch), queued);
+	if ((status >= 0) && (length > 0))
+		status = transport_write_bio(transport, data, length);
+	if (corked && (BIO_set_cork(transport->frontBio, FALSE) < 0) && (status >= 0))
+	{
+		WLog_ERR_BIO(transport, "BIO_set_cork", transport->frontBio);
+		status = -1;
+	}
+
+	if ((status >= 0) && !transport_write_wait_flushed(transport))
+		status = -1;
+
+	Stream_SetPosition(batch, 0);
+	return status;
+}
+
+static BOOL transport_write_batch_expired(rdpTransport* transport)
+{
+	rdpContext* context = transport_get_context(transport);
+
+	WINPR_ASSERT(context);
+
+	if (!transport->WriteBatch || (Stream_GetPosition(transport->WriteBatch) == 0))
+		return FALSE;
+
+	const UINT32 delay =
+	    freerdp_settings_get_uint32(context->settings, FreeRDP_TransportWriteBatchDelay);
+	return (GetTickCount64() - transport->WriteBatchStart) >= delay;
+}
+
+/* must be called with WriteLock held */
+static int transport_write_batch_queue(rdpTransport* transport, const BYTE* data, size_t length)
+{
+	rdpContext* context = transport_get_context(transport);
+
+	WINPR_ASSERT(context);
+
+	const UINT32 threshold =
+	    freerdp_settings_get_uint32(context->settings, FreeRDP_TransportWriteBatchThreshold);
+
+	/* large PDUs are not worth copying, send them right after the queue */
+	if ((threshold == 0) || (length >= threshold))
+		return transport_write_batch_flush(transport, data, length);
+
+	if (!transport->WriteBatch)
+	{
+		transport->WriteBatch = Stream_New(NULL, threshold);
+		if (!transport->WriteBatch)
+			return -1;
+	}
+
+	if (Stream_GetPosition(transport->WriteBatch) == 0)
+		transport->WriteBatchStart = GetTickCount64();
+
+	if (!Stream_EnsureRemainingCapacity(transport->WriteBatch, length))
+		return -1;
+
+	Stream_Write(transport->WriteBatch, data, length);
+
+	if ((Stream_GetPosition(transport->WriteBatch) >= threshold) ||
+	    transport_write_batch_expired(transport))
+		return transport_write_batch_flush(transport, NULL, 0);
+
+	return (length > INT32_MAX) ? INT32_MAX : (int)length;
+}
+
+static int transport_default_write(rdpTransport* transport, wStream* s)
+{
+	int status = -1;
+	rdpContext* context = transport_get_context(transport);
+
+	WINPR_ASSERT(transport);
+	WINPR_ASSERT(context);
+
+	if (!s)
+		return -1;
+
+	Stream_AddRef(s);
+
+	rdpRdp* rdp = context->rdp;
+	if (!rdp)
+		goto fail;
+
+	EnterCriticalSection(&(transport->WriteLock));
+	if (!transport->frontBio)
+		goto out_cleanup;
+
+	const size_t length = Stream_GetPosition(s);
+	Stream_SetPosition(s, 0);
+
+	if (length == 0)
+		goto out_cleanup;
+
+	rdp->outBytes += length;
+	WLog_Packet(transport->log, WLOG_TRACE, Stream_Buffer(s), length, WLOG_PACKET_OUTBOUND);
+
+	if (transport->WriteBatchDepth > 0)
+		status = transport_write_batch_queue(transport, Stream_ConstBuffer(s), length);
+	else
+		status = transport_write_batch_flush(transport, Stream_ConstBuffer(s), length);
+
+	if (status >= 0)
+	{
+		Stream_Seek(s, length);
+		transport->written += length;
 	}
 
-	transport->written += writtenlength;
 out_cleanup:
 
 	if (status < 0)
@@ -1255,6 +1464,59 @@ fail:
 	return status;
 }
 
+BOOL transport_write_batch_begin(rdpTransport* transport)
+{
+	if (!transport)
+		return FALSE;
+
+	EnterCriticalSection(&(transport->WriteLock));
+	transport->WriteBatchDepth++;
+	LeaveCriticalSection(&(transport->WriteLock));
+	return TRUE;
+}
+
+BOOL transport_write_batch_end(rdpTransport* transport)
+{
+	int status = 1;
+
+	if (!transport)
+		return FALSE;
+
+	EnterCriticalSection(&(transport->WriteLock));
+	if (transport->WriteBatchDepth > 0)
+		transport->WriteBatchDepth--;
+
+	if ((transport->WriteBatchDepth == 0) && transport->frontBio)
+		status = transport_write_batch_flush(transport, NULL, 0);
+
+	if (status < 0)
+	{
+		transport->layer = TRANSPORT_LAYER_CLOSED;
+		freerdp_set_last_error_if_not(transport_get_context(transport),
+		                              FREERDP_ERROR_CONNECT_TRANSPORT_FAILED);
+	}
+	LeaveCriticalSection(&(transport->WriteLock));
+	return status >= 0;
+}
+
+static BOOL transport_write_batch_check(rdpTransport* transport)
+{
+	int status = 1;
+
+	EnterCriticalSection(&(transport->WriteLock));
+	if (transport->frontBio && transport_write_batch_expired(transport))
+		status = transport_write_batch_flush(transport, NULL, 0);
+
+	if (status < 0)
+	{
+		transport->layer = TRANSPORT_LAYER_CLOSED;
+		freerdp_set_last_error_if_not(transport_get_context(transport),
+		                              FREERDP_ERROR_CONNECT_TRANSPORT_FAILED);
+	}
+	LeaveCriticalSection(&(transport->WriteLock));
+	return status >= 0;
+}
+
 BOOL transport_get_public_key(rdpTransport* transport, const BYTE** data, DWORD* length)
 {
 	return IFCALLRESULT(FALSE, transport->io.GetPublicKey, transport, data, length);
@@ -1423,6 +1685,10 @@ int transport_check_fds(rdpTransport* transport)
 		return -1;
 	}
 
+	/* push out queued PDUs of a batch that is held open for too long */
+	if (!transport_write_batch_check(transport))
+		return -1;
+
 	/**
 	 * Note: transport_read_pdu tries to read one PDU from
 	 * the transport layer.
@@ -1450,6 +1716,22 @@ int transport_check_fds(rdpTransport* transport)
 	if (!(transport->ReceiveBuffer = StreamPool_Take(transport->ReceivePool, 0)))
 		return -1;
 
+	/* move bytes read past the end of the PDU to the next receive buffer */
+	if (transport->ReceiveAhead > 0)
+	{
+		const size_t ahead = transport->ReceiveAhead;
+		transport->ReceiveAhead = 0;
+
+		if (!Stream_EnsureCapacity(transport->ReceiveBuffer, ahead))
+		{
+			Stream_Release(received);
+			return -1;
+		}
+
+		const BYTE* data = Stream_ConstBuffer(received);
+		Stream_Write(transport->ReceiveBuffer, &data[Stream_Length(received)], ahead);
+	}
+
 	/**
 	 * status:
 	 * 	-1: error
@@ -1596,6 +1878,12 @@ static BOOL transport_default_disconnect(rdpTransport* transport)
 
 	EnterCriticalSection(&(transport->ReadLock));
 	EnterCriticalSection(&(transport->WriteLock));
+
+	/* partially received or read ahead data belongs to the old connection */
+	if (transport->ReceiveBuffer)
+		Stream_SetPosition(transport->ReceiveBuffer, 0);
+	transport->ReceiveAhead = 0;
+
 	if (transport->tls)
 	{
 		freerdp_tls_free(transport->tls);
@@ -1625,6 +1913,9 @@ static BOOL transport_default_disconnect(rdpTransport* transport)
 		transport->wst = NULL;
 	}
 
+	if (transport->WriteBatch)
+		Stream_SetPosition(transport->WriteBatch, 0);
+
 	transport->frontBio = NULL;
 	transport->layer = TRANSPORT_LAYER_TCP;
 	transport->earlyUserAuth = FALSE;
@@ -1726,6 +2017,7 @@ void transport_free(rdpTransport* transport)
 
 	nla_free(transport->nla);
 	StreamPool_Free(transport->ReceivePool);
+	Stream_Free(transport->WriteBatch, TRUE);
 	(void)CloseHandle(transport->connectedEvent);
 	(void)CloseHandle(transport->rereadEvent);
 	(void)CloseHandle(transport->ioEvent);
@@ -37,6 +37,7 @@
 
 #include "brush.h"
 #include "clipping.h"
+#include "rop.h"
 #include "../gdi/gdi.h"
 
 #define TAG FREERDP_TAG("gdi.bitmap")
@@ -463,6 +464,165 @@ static BOOL adjust_src_dst_coordinates(HGDI_DC hdcDest, INT32* pnXSrc, INT32* pn
 	return TRUE;
 }
 
+static BOOL BitBlt_rows_supported(HGDI_DC hdcDest)
+{
+	/* the kernels work on raw bytes, which requires whole byte pixels without padding bits */
+	switch (FreeRDPGetBitsPerPixel(hdcDest->format))
+	{
+		case 8:
+		case 16:
+		case 24:
+		case 32:
+			return TRUE;
+
+		default:
+			return FALSE;
+	}
+}
+
+static void BitBlt_fill_row(BYTE* WINPR_RESTRICT row, UINT32 format, size_t bpp, size_t width,
+                            UINT32 color)
+{
+	for (size_t x = 0; x < width; x++)
+		FreeRDPWriteColor(&row[x * bpp], format, color);
+}
+
+static BOOL BitBlt_pattern_row(HGDI_DC hdcDest, BYTE* WINPR_RESTRICT row, size_t bpp, INT32 nXDest,
+                               INT32 nYDest, size_t width)
+{
+	const HGDI_BITMAP hBmpBrush = hdcDest->brush->pattern;
+	const size_t period = MIN(width, WINPR_ASSERTING_INT_CAST(size_t, hBmpBrush->width));
+
+	for (size_t x = 0; x < period; x++)
+	{
+		const BYTE* patp = gdi_get_brush_pointer(
+		    hdcDest, WINPR_ASSERTING_INT_CAST(uint32_t, nXDest + (INT32)x),
+		    WINPR_ASSERTING_INT_CAST(uint32_t, nYDest));
+
+		if (!patp)
+		{
+			WLog_ERR(TAG, "patp=%p", (const void*)patp);
+			return FALSE;
+		}
+
+		memcpy(&row[x * bpp], patp, bpp);
+	}
+
+	/* the brush repeats horizontally */
+	for (size_t x = period; x < width; x++)
+		memcpy(&row[x * bpp], &row[(x - period) * bpp], bpp);
+
+	return TRUE;
+}
+
+static BOOL BitBlt_source_row(HGDI_DC hdcDest, HGDI_DC hdcSrc, BYTE* WINPR_RESTRICT row, size_t bpp,
+                              INT32 nXSrc, INT32 nYSrc, size_t width, const gdiPalette* palette)
+{
+	const UINT32 srcFormat = hdcSrc->format;
+	const UINT32 dstFormat = hdcDest->format;
+	const size_t srcBpp = FreeRDPGetBytesPerPixel(srcFormat);
+	const BYTE* first = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc);
+	const BYTE* last = gdi_get_bitmap_pointer(hdcSrc, nXSrc + (INT32)width - 1, nYSrc);
+
+	if (!first || !last)
+	{
+		WLog_ERR(TAG, "srcp=%p", (const void*)first);
+		return FALSE;
+	}
+
+	/* conversion is the identity if no channel is dropped or padded */
+	if ((srcFormat == dstFormat) &&
+	    (FreeRDPColorHasAlpha(dstFormat) || (FreeRDPGetBitsPerPixel(dstFormat) == 24)))
+	{
+		memcpy(row, first, width * bpp);
+		return TRUE;
+	}
+
+	for (size_t x = 0; x < width; x++)
+	{
+		UINT32 color = FreeRDPReadColor(&first[x * srcBpp], srcFormat);
+		color = FreeRDPConvertColor(color, srcFormat, dstFormat, palette);
+		FreeRDPWriteColor(&row[x * bpp], dstFormat, color);
+	}
+
+	return TRUE;
+}
+
+/* Applies the raster operation row by row with a kernel compiled for its ternary code.
+ * Source rows are converted into a scratch row first, which gives memmove semantics for
+ * overlapping blits as long as rows are processed away from the overlap. */
+static BOOL BitBlt_process_rows(HGDI_DC hdcDest, INT32 nXDest, INT32 nYDest, INT32 nWidth,
+                                INT32 nHeight, HGDI_DC hdcSrc, INT32 nXSrc, INT32 nYSrc,
+                                const char* rop, BOOL useSrc, BOOL usePat, UINT32 style,
+                                const gdiPalette* palette)
+{
+	const UINT32 format = hdcDest->format;
+	const size_t bpp = FreeRDPGetBytesPerPixel(format);
+	BYTE rop3 = 0;
+	BOOL patternRows = FALSE;
+
+	if ((nWidth <= 0) || (nHeight <= 0))
+		return TRUE;
+
+	const size_t width = (size_t)nWidth;
+	BYTE* scratch = calloc(2, width * bpp);
+	if (!scratch)
+		return FALSE;
+
+	BYTE* srcRow = scratch;
+	BYTE* patRow = &scratch[width * bpp];
+
+	/* BLACKNESS and WHITENESS depend on the pixel format, fill them like a solid brush */
+	if (strpbrk(rop, "01"))
+	{
+		rop3 = 0xF0;
+		BitBlt_fill_row(patRow, format, bpp, width, process_rop(0, 0, 0, rop, format));
+	}
+	else
+	{
+		/* evaluating the expression on the operand masks yields its truth table */
+		rop3 = (BYTE)process_rop(0xCCCCCCCC, 0xAAAAAAAA, 0xF0F0F0F0, rop, format);
+
+		if (usePat)
+		{
+			if (style == GDI_BS_SOLID)
+				BitBlt_fill_row(patRow, format, bpp, width, hdcDest->brush->color);
+			else
+				patternRows = TRUE;
+		}
+	}
+
+	const gdiRop3Kernel kernel = gdi_get_rop3_kernel(rop3);
+	const BOOL bottomUp = useSrc && (nYDest > nYSrc);
+	BOOL rc = FALSE;
+
+	for (INT32 i = 0; i < nHeight; i++)
+	{
+		const INT32 y = bottomUp ? nHeight - 1 - i : i;
+		BYTE* dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+
+		if (!dstp || !gdi_get_bitmap_pointer(hdcDest, nXDest + nWidth - 1, nYDest + y))
+		{
+			WLog_ERR(TAG, "dstp=%p", (const void*)dstp);
+			goto fail;
+		}
+
+		if (useSrc && !BitBlt_source_row(hdcDest, hdcSrc, srcRow, bpp, nXSrc, nYSrc + y, width,
+		                                 palette))
+			goto fail;
+
+		if (patternRows && !BitBlt_pattern_row(hdcDest, patRow, bpp, nXDest, nYDest + y, width))
+			goto fail;
+
+		kernel(dstp, useSrc ? srcRow : patRow, patRow, width * bpp);
+	}
+
+	rc = TRUE;
+fail:
+	free(scratch);
+	return rc;
+}
+
 static BOOL BitBlt_process(HGDI_DC hdcDest, INT32 nXDest, INT32 nYDest, INT32 nWidth, INT32 nHeight,
                            HGDI_DC hdcSrc, INT32 nXSrc, INT32 nYSrc, const char* rop,
                            const gdiPalette* palette)
@@ -521,6 +681,12 @@ static BOOL BitBlt_process(HGDI_DC hdcDest, INT32 nXDest, INT32 nYDest, INT32 nW
 		}
 	}
 
+	if (BitBlt_rows_supported(hdcDest))
+		return BitBlt_process_rows(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc,
+		                           rop, useSrc, usePat, style, palette);
+
+	/* generic per pixel fallback for formats the row kernels do not handle */
+
 	if ((nXDest > nXSrc) && (nYDest > nYSrc))
 	{
 		for (INT32 y = nHeight - 1; y >= 0; y--)
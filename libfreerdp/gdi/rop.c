@@ -0,0 +1,118 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * GDI Ternary Raster Operation Kernels
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <string.h>
+
+#include <winpr/crt.h>
+
+#include "rop.h"
+
+/**
+ * Bit n of a ternary raster operation code is the result for the operand bits
+ * P = (n >> 2) & 1, S = (n >> 1) & 1 and D = n & 1.
+ *
+ * The code is a compile time constant in every kernel below, so the compiler drops
+ * the unused terms and the bitwise operations are applied to whole 64 bit words.
+ */
+static INLINE UINT64 gdi_rop3_eval(BYTE code, UINT64 d, UINT64 s, UINT64 p)
+{
+	UINT64 r = 0;
+
+	if (code & 0x01)
+		r |= ~p & ~s & ~d;
+	if (code & 0x02)
+		r |= ~p & ~s & d;
+	if (code & 0x04)
+		r |= ~p & s & ~d;
+	if (code & 0x08)
+		r |= ~p & s & d;
+	if (code & 0x10)
+		r |= p & ~s & ~d;
+	if (code & 0x20)
+		r |= p & ~s & d;
+	if (code & 0x40)
+		r |= p & s & ~d;
+	if (code & 0x80)
+		r |= p & s & d;
+
+	return r;
+}
+
+static INLINE void gdi_rop3_row(BYTE code, BYTE* WINPR_RESTRICT dst,
+                                const BYTE* WINPR_RESTRICT src, const BYTE* WINPR_RESTRICT pat,
+                                size_t length)
+{
+	size_t x = 0;
+
+	for (; x + sizeof(UINT64) <= length; x += sizeof(UINT64))
+	{
+		UINT64 d = 0;
+		UINT64 s = 0;
+		UINT64 p = 0;
+
+		memcpy(&d, &dst[x], sizeof(d));
+		memcpy(&s, &src[x], sizeof(s));
+		memcpy(&p, &pat[x], sizeof(p));
+		d = gdi_rop3_eval(code, d, s, p);
+		memcpy(&dst[x], &d, sizeof(d));
+	}
+
+	for (; x < length; x++)
+		dst[x] = (BYTE)gdi_rop3_eval(code, dst[x], src[x], pat[x]);
+}
+
+#define GDI_ROP3_KERNEL(code)                                                                  \
+	static void gdi_rop3_kernel_##code(BYTE* WINPR_RESTRICT dst, const BYTE* WINPR_RESTRICT src, \
+	                                   const BYTE* WINPR_RESTRICT pat, size_t length)            \
+	{                                                                                          \
+		gdi_rop3_row(0x##code, dst, src, pat, length);                                         \
+	}
+
+#define GDI_ROP3_KERNEL_ENTRY(code) gdi_rop3_kernel_##code,
+
+#define GDI_ROP3_ROW(h, X)                                                                       \
+	X(h##0) X(h##1) X(h##2) X(h##3) X(h##4) X(h##5) X(h##6) X(h##7) X(h##8) X(h##9) X(h##A) \
+	X(h##B) X(h##C) X(h##D) X(h##E) X(h##F)
+
+#define GDI_ROP3_ALL(X)                                                                        \
+	GDI_ROP3_ROW(0, X)                                                                         \
+	GDI_ROP3_ROW(1, X)                                                                         \
+	GDI_ROP3_ROW(2, X)                                                                         \
+	GDI_ROP3_ROW(3, X)                                                                         \
+	GDI_ROP3_ROW(4, X)                                                                         \
+	GDI_ROP3_ROW(5, X)                                                                         \
+	GDI_ROP3_ROW(6, X)                                                                         \
+	GDI_ROP3_ROW(7, X)                                                                         \
+	GDI_ROP3_ROW(8, X)                                                                         \
+	GDI_ROP3_ROW(9, X)                                                                         \
+	GDI_ROP3_ROW(A, X)                                                                         \
+	GDI_ROP3_ROW(B, X)                                                                         \
+	GDI_ROP3_ROW(C, X)                                                                         \
+	GDI_ROP3_ROW(D, X)                                                                         \
+	GDI_ROP3_ROW(E, X)                                                                         \
+	GDI_ROP3_ROW(F, X)
+
+GDI_ROP3_ALL(GDI_ROP3_KERNEL)
+
+static const gdiRop3Kernel gdi_rop3_kernels[256] = { GDI_ROP3_ALL(GDI_ROP3_KERNEL_ENTRY) };
+
+gdiRop3Kernel gdi_get_rop3_kernel(BYTE rop3)
+{
+	return gdi_rop3_kernels[rop3];
+}
@@ -0,0 +1,41 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * GDI Ternary Raster Operation Kernels
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_GDI_ROP_H
+#define FREERDP_LIB_GDI_ROP_H
+
+#include <winpr/wtypes.h>
+
+#include <freerdp/api.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	/* Applies a ternary raster operation to a row of raw pixel bytes in place.
+	 * src and pat must already be in the destination pixel format. */
+	typedef void (*gdiRop3Kernel)(BYTE* WINPR_RESTRICT dst, const BYTE* WINPR_RESTRICT src,
+	                              const BYTE* WINPR_RESTRICT pat, size_t length);
+
+	FREERDP_LOCAL gdiRop3Kernel gdi_get_rop3_kernel(BYTE rop3);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_LIB_GDI_ROP_H */
@@ -546,6 +546,144 @@ fail:
 	return rc;
 }
 
+static BYTE test_rop3_byte(BYTE rop3, BYTE d, BYTE s, BYTE p)
+{
+	BYTE r = 0;
+
+	for (size_t bit = 0; bit < 8; bit++)
+	{
+		const size_t index = (((p >> bit) & 1) << 2) | (((s >> bit) & 1) << 1) | ((d >> bit) & 1);
+		r |= ((rop3 >> index) & 1) << bit;
+	}
+
+	return r;
+}
+
+static HGDI_BITMAP test_random_bitmap(UINT32 width, UINT32 height, UINT32 format, UINT32* seed)
+{
+	const size_t size = 1ull * width * height * FreeRDPGetBytesPerPixel(format);
+	BYTE* data = winpr_aligned_malloc(size, 16);
+
+	if (!data)
+		return NULL;
+
+	for (size_t x = 0; x < size; x++)
+	{
+		*seed = *seed * 1103515245 + 12345;
+		data[x] = (BYTE)(*seed >> 16);
+	}
+
+	HGDI_BITMAP bmp = gdi_CreateBitmap(width, height, format, data);
+	if (!bmp)
+		winpr_aligned_free(data);
+	return bmp;
+}
+
+/* Every ternary raster operation must match its truth table applied to the pixel bytes */
+static BOOL test_gdi_BitBlt_ternary(UINT32 format, BOOL pattern)
+{
+	BOOL rc = FALSE;
+	UINT32 seed = 42;
+	const INT32 width = 24;
+	const INT32 height = 12;
+	const INT32 nXDst = 3;
+	const INT32 nYDst = 2;
+	const INT32 nXSrc = 1;
+	const INT32 nYSrc = 4;
+	const INT32 nWidth = 19;
+	const INT32 nHeight = 7;
+	const size_t bpp = FreeRDPGetBytesPerPixel(format);
+	const UINT32 solid = FreeRDPGetColor(format, 0x12, 0x34, 0x56, 0x78);
+	BYTE solidBytes[4] = { 0 };
+	HGDI_DC hdcSrc = gdi_GetDC();
+	HGDI_DC hdcDst = gdi_GetDC();
+	HGDI_BITMAP hBmpSrc = test_random_bitmap(width, height, format, &seed);
+	HGDI_BITMAP hBmpDst = test_random_bitmap(width, height, format, &seed);
+	HGDI_BITMAP hBmpPat = test_random_bitmap(8, 8, format, &seed);
+	HGDI_BRUSH brush = NULL;
+	BYTE* original = NULL;
+	const size_t size = 1ull * width * height * bpp;
+
+	if (!hdcSrc || !hdcDst || !hBmpSrc || !hBmpDst || !hBmpPat)
+		goto fail;
+
+	brush = pattern ? gdi_CreatePatternBrush(hBmpPat) : gdi_CreateSolidBrush(solid);
+	original = malloc(size);
+	if (!brush || !original)
+		goto fail;
+
+	FreeRDPWriteColor(solidBytes, format, solid);
+	memcpy(original, hBmpDst->data, size);
+	hdcSrc->format = format;
+	hdcDst->format = format;
+	gdi_SelectObject(hdcSrc, (HGDIOBJECT)hBmpSrc);
+	gdi_SelectObject(hdcDst, (HGDIOBJECT)hBmpDst);
+	gdi_SelectObject(hdcDst, (HGDIOBJECT)brush);
+
+	for (size_t code = 0; code < 256; code++)
+	{
+		const BYTE rop3 = (BYTE)code;
+		const DWORD rop = gdi_rop3_code(rop3);
+
+		/* DSTCOPY is a plain copy from the source coordinates within the destination */
+		if (rop == GDI_DSTCOPY)
+			continue;
+
+		memcpy(hBmpDst->data, original, size);
+		if (!gdi_BitBlt(hdcDst, nXDst, nYDst, nWidth, nHeight, hdcSrc, nXSrc, nYSrc, rop, NULL))
+			goto fail;
+
+		for (INT32 y = 0; y < height; y++)
+		{
+			for (INT32 x = 0; x < width; x++)
+			{
+				const size_t offset = (1ull * y * width + x) * bpp;
+				const BOOL inside =
+				    (x >= nXDst) && (x < nXDst + nWidth) && (y >= nYDst) && (y < nYDst + nHeight);
+				BYTE expected[4] = { 0 };
+
+				memcpy(expected, &original[offset], bpp);
+				if (inside && ((rop3 == 0x00) || (rop3 == 0xFF)))
+				{
+					const BYTE v = rop3;
+					FreeRDPWriteColor(expected, format, FreeRDPGetColor(format, v, v, v, 0xFF));
+				}
+				else if (inside)
+				{
+					const BYTE* s = &hBmpSrc->data[(1ull * (y - nYDst + nYSrc) * width + x -
+					                                nXDst + nXSrc) *
+					                               bpp];
+					const BYTE* p =
+					    pattern ? &hBmpPat->data[(1ull * (y % 8) * 8 + (x % 8)) * bpp] : solidBytes;
+
+					for (size_t b = 0; b < bpp; b++)
+						expected[b] = test_rop3_byte(rop3, expected[b], s[b], p[b]);
+				}
+
+				if (memcmp(expected, &hBmpDst->data[offset], bpp) != 0)
+				{
+					(void)fprintf(stderr, "[%s] %s %s ROP=%s differs at %" PRId32 "x%" PRId32 "\n",
+					              __func__, FreeRDPGetColorFormatName(format),
+					              pattern ? "pattern" : "solid", gdi_rop3_string(rop), x, y);
+					goto fail;
+				}
+			}
+		}
+	}
+
+	rc = TRUE;
+fail:
+	gdi_SelectObject(hdcDst, NULL);
+	gdi_DeleteObject((HGDIOBJECT)brush);
+	gdi_DeleteObject((HGDIOBJECT)hBmpSrc);
+	gdi_DeleteObject((HGDIOBJECT)hBmpDst);
+	gdi_DeleteObject((HGDIOBJECT)hBmpPat);
+	gdi_DeleteDC(hdcSrc);
+	gdi_DeleteDC(hdcDst);
+	free(original);
+	return rc;
+}
+
 int TestGdiBitBlt(int argc, char* argv[])
 {
 	int rc = 0;
@@ -555,9 +693,18 @@ int TestGdiBitBlt(int argc, char* argv[])
 		                          PIXEL_FORMAT_BGR15,  PIXEL_FORMAT_ABGR15, PIXEL_FORMAT_BGR16,
 		                          PIXEL_FORMAT_BGR24,  PIXEL_FORMAT_BGRA32, PIXEL_FORMAT_BGRX32,
 		                          PIXEL_FORMAT_ABGR32, PIXEL_FORMAT_XBGR32 };
+	const UINT32 ternaryFormats[] = { PIXEL_FORMAT_ARGB32, PIXEL_FORMAT_BGRA32,
+		                              PIXEL_FORMAT_BGR24 };
 	WINPR_UNUSED(argc);
 	WINPR_UNUSED(argv);
 
+	for (size_t x = 0; x < ARRAYSIZE(ternaryFormats); x++)
+	{
+		if (!test_gdi_BitBlt_ternary(ternaryFormats[x], FALSE) ||
+		    !test_gdi_BitBlt_ternary(ternaryFormats[x], TRUE))
+			rc = -1;
+	}
+
 	for (size_t x = 0; x < ARRAYSIZE(formatList); x++)
 	{
 		/* Skip 8bpp, only supported on remote end. */
@@ -18,181 +18,1501 @@
  * limitations under the License.
  */
 
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include <winpr/crt.h>
+#include <winpr/file.h>
 #include <winpr/crypto.h>
+#include <winpr/stream.h>
 #include <winpr/sysinfo.h>
+#include <freerdp/settings.h>
 #include <freerdp/primitives.h>
+#include <freerdp/codec/color.h>
+#include <freerdp/codec/rfx.h>
+#include <freerdp/codec/nsc.h>
+#include <freerdp/codec/planar.h>
+#include <freerdp/codec/interleaved.h>
+#include <freerdp/codec/clear.h>
+
+/* The RemoteFX kernels are not exported, they are called through the dispatch table of
+ * a context, which also picks the SIMD variants the decoder would use. */
+#include "../../codec/rfx_types.h"
+
+#define BENCHMARK_TILE_SIZE 64
+#define BENCHMARK_TILE_PIXELS (BENCHMARK_TILE_SIZE * BENCHMARK_TILE_SIZE)
+#define BENCHMARK_CODEC_MAX_SIZE 1024
+#define BENCHMARK_ENCODE_BUFFER_SIZE (BENCHMARK_TILE_PIXELS * 4 * 2)
+#define BENCHMARK_RLGR_BUFFER_SIZE (BENCHMARK_TILE_PIXELS * sizeof(INT16))
+
+typedef struct
+{
+	BYTE* data;
+	UINT32 size;
+} primitives_benchmark_blob;
+
+typedef struct
+{
+	prim_size_t roi;
+	UINT32 pixels;
+	UINT32 stride;
+	UINT32 format;
+	BYTE* frames[2];
+	BYTE* output;
+	UINT16* rgb565;
+	BYTE* tiles;
+	UINT32 tilesStep;
+	BYTE* yuv[3];
+	BYTE* yuvOut[3];
+	BYTE* yuvAux[3];
+	UINT32 yuvSteps[3];
+	INT16* planes[3];
+	INT16* planesOut[3];
+
+	/* the codec benchmarks encode and decode the 64x64 tiles of a desktop like image */
+	prim_size_t codecRoi;
+	UINT32 codecTiles;
+	BYTE* codecImage;
+	BYTE* codecOutput;
+	BYTE* encodeBuffer;
+
+	RFX_CONTEXT* rfx;
+	RFX_CONTEXT* rfxEncoder;
+	wStream* rfxMessage;
+	wStream* rfxOutput;
+	INT16* rfxInput;
+	INT16* rfxDwt;
+	INT16* rfxQuantized;
+	INT16* rfxDequantized;
+	INT16* rfxWork;
+	INT16* rfxTemp;
+	INT16* rfxPlanes;
+	primitives_benchmark_blob* rlgr;
+
+	BITMAP_PLANAR_CONTEXT* planarEncoder;
+	BITMAP_PLANAR_CONTEXT* planarDecoder;
+	primitives_benchmark_blob* planarTiles;
+
+	BITMAP_INTERLEAVED_CONTEXT* interleavedEncoder;
+	BITMAP_INTERLEAVED_CONTEXT* interleavedDecoder;
+	primitives_benchmark_blob* interleavedTiles;
+
+	NSC_CONTEXT* nsc;
+	wStream* nscMessage;
+
+	CLEAR_CONTEXT* clearDecoder;
+	primitives_benchmark_blob* clearTiles;
+} primitives_benchmark;
+
+typedef BOOL (*primitives_benchmark_fn)(primitives_benchmark* bench, const primitives_t* prims);
+
+typedef struct
+{
+	const char* name;
+	primitives_benchmark_fn prepare; /* called before every run, not timed */
+	primitives_benchmark_fn run;
+} primitives_benchmark_entry;
+
+typedef struct
+{
+	const char* implementation;
+	const char* name;
+	UINT64 min;
+	UINT64 median;
+	UINT64 mean;
+} primitives_benchmark_result;
 
 typedef struct
 {
-	BYTE* channels[3];
-	UINT32 steps[3];
-	prim_size_t roi;
-	BYTE* outputBuffer;
-	BYTE* outputChannels[3];
-	BYTE* rgbBuffer;
-	UINT32 outputStride;
-	UINT32 testedFormat;
-} primitives_YUV_benchmark;
+	size_t iterations;
+	const char* filter;
+	const char* jsonFile;
+	const char* baselineFile;
+	UINT32 tolerance;
+	primitives_benchmark_result* results;
+	size_t count;
+	size_t capacity;
+} primitives_benchmark_run;
+
+static const UINT32 rfx_quant_vals[10] = { 6, 6, 6, 6, 7, 7, 8, 8, 8, 9 };
+
+static void primitives_benchmark_blobs_free(primitives_benchmark_blob* blobs, size_t count)
+{
+	if (!blobs)
+		return;
+
+	for (size_t x = 0; x < count; x++)
+		free(blobs[x].data);
+
+	free(blobs);
+}
+
+static void primitives_benchmark_free(primitives_benchmark* bench)
+{
+	if (!bench)
+		return;
+
+	for (size_t i = 0; i < 2; i++)
+		free(bench->frames[i]);
+
+	free(bench->output);
+	free(bench->rgb565);
+	free(bench->tiles);
+
+	for (size_t i = 0; i < 3; i++)
+	{
+		free(bench->yuv[i]);
+		free(bench->yuvOut[i]);
+		free(bench->yuvAux[i]);
+		winpr_aligned_free(bench->planes[i]);
+		winpr_aligned_free(bench->planesOut[i]);
+	}
+
+	free(bench->codecImage);
+	free(bench->codecOutput);
+	free(bench->encodeBuffer);
+
+	rfx_context_free(bench->rfx);
+	rfx_context_free(bench->rfxEncoder);
+	Stream_Free(bench->rfxMessage, TRUE);
+	Stream_Free(bench->rfxOutput, TRUE);
+	winpr_aligned_free(bench->rfxInput);
+	winpr_aligned_free(bench->rfxDwt);
+	winpr_aligned_free(bench->rfxQuantized);
+	winpr_aligned_free(bench->rfxDequantized);
+	winpr_aligned_free(bench->rfxWork);
+	winpr_aligned_free(bench->rfxTemp);
+	winpr_aligned_free(bench->rfxPlanes);
+	primitives_benchmark_blobs_free(bench->rlgr, bench->codecTiles);
+
+	freerdp_bitmap_planar_context_free(bench->planarEncoder);
+	freerdp_bitmap_planar_context_free(bench->planarDecoder);
+	primitives_benchmark_blobs_free(bench->planarTiles, bench->codecTiles);
+
+	bitmap_interleaved_context_free(bench->interleavedEncoder);
+	bitmap_interleaved_context_free(bench->interleavedDecoder);
+	primitives_benchmark_blobs_free(bench->interleavedTiles, bench->codecTiles);
+
+	nsc_context_free(bench->nsc);
+	Stream_Free(bench->nscMessage, TRUE);
+
+	clear_context_free(bench->clearDecoder);
+	primitives_benchmark_blobs_free(bench->clearTiles, bench->codecTiles);
+
+	const primitives_benchmark empty = { 0 };
+	*bench = empty;
+}
+
+static INT16* primitives_benchmark_planes_new(size_t count)
+{
+	return winpr_aligned_calloc(count, sizeof(INT16), 32);
+}
+
+static void primitives_benchmark_tile_origin(const primitives_benchmark* bench, size_t tile,
+                                             UINT32* x, UINT32* y)
+{
+	const UINT32 tilesPerRow = bench->codecRoi.width / BENCHMARK_TILE_SIZE;
+
+	*x = (UINT32)(tile % tilesPerRow) * BENCHMARK_TILE_SIZE;
+	*y = (UINT32)(tile / tilesPerRow) * BENCHMARK_TILE_SIZE;
+}
+
+static BYTE* primitives_benchmark_tile(const primitives_benchmark* bench, BYTE* image, size_t tile)
+{
+	UINT32 x = 0;
+	UINT32 y = 0;
+
+	primitives_benchmark_tile_origin(bench, tile, &x, &y);
+	return &image[1ULL * y * bench->stride + 4ULL * x];
+}
+
+/* a mix of what a desktop shows: flat areas, gradients, text and photos */
+static void primitives_benchmark_fill_desktop(primitives_benchmark* bench)
+{
+	const UINT32 format = bench->format;
+
+	winpr_RAND(bench->codecImage, 1ULL * bench->stride * bench->codecRoi.height);
+
+	for (UINT32 y = 0; y < bench->codecRoi.height; y++)
+	{
+		BYTE* line = &bench->codecImage[1ULL * y * bench->stride];
+
+		for (UINT32 x = 0; x < bench->codecRoi.width; x++)
+		{
+			const UINT32 tx = x / BENCHMARK_TILE_SIZE;
+			const UINT32 ty = y / BENCHMARK_TILE_SIZE;
+			BYTE* pixel = &line[4ULL * x];
+			UINT32 color = 0;
+
+			switch ((tx * 7 + ty * 3) % 4)
+			{
+				case 0:
+					color = FreeRDPGetColor(format, (BYTE)(tx * 40), (BYTE)(ty * 20), 0xC0, 0xFF);
+					break;
+				case 1:
+					color = FreeRDPGetColor(format, (BYTE)(x * 2), (BYTE)(y * 2), 0x80, 0xFF);
+					break;
+				case 2:
+					color = (pixel[0] < 32) ? FreeRDPGetColor(format, 0x20, 0x20, 0x20, 0xFF)
+					                        : FreeRDPGetColor(format, 0xFF, 0xFF, 0xFF, 0xFF);
+					break;
+				default:
+					continue;
+			}
+
+			FreeRDPWriteColor(pixel, format, color);
+		}
+	}
+}
+
+static BOOL primitives_benchmark_init_rfx(primitives_benchmark* bench)
+{
+	const size_t coefficients = 1ULL * bench->codecTiles * BENCHMARK_TILE_PIXELS;
+	const RFX_RECT rect = { 0, 0, (UINT16)bench->codecRoi.width, (UINT16)bench->codecRoi.height };
+	RFX_MESSAGE* message = NULL;
+
+	bench->rfx = rfx_context_new_ex(FALSE, THREADING_FLAGS_DISABLE_THREADS);
+	bench->rfxEncoder = rfx_context_new_ex(TRUE, THREADING_FLAGS_DISABLE_THREADS);
+	bench->rfxMessage = Stream_New(NULL, 1024);
+	bench->rfxOutput = Stream_New(NULL, 1024);
+	bench->rfxInput = primitives_benchmark_planes_new(coefficients);
+	bench->rfxDwt = primitives_benchmark_planes_new(coefficients);
+	bench->rfxQuantized = primitives_benchmark_planes_new(coefficients);
+	bench->rfxDequantized = primitives_benchmark_planes_new(coefficients);
+	bench->rfxWork = primitives_benchmark_planes_new(coefficients);
+	bench->rfxTemp = primitives_benchmark_planes_new(BENCHMARK_TILE_PIXELS);
+	bench->rfxPlanes = primitives_benchmark_planes_new(3ULL * BENCHMARK_TILE_PIXELS);
+	bench->rlgr = calloc(bench->codecTiles, sizeof(primitives_benchmark_blob));
+
+	if (!bench->rfx || !bench->rfxEncoder || !bench->rfxMessage || !bench->rfxOutput ||
+	    !bench->rfxInput || !bench->rfxDwt || !bench->rfxQuantized || !bench->rfxDequantized ||
+	    !bench->rfxWork || !bench->rfxTemp || !bench->rfxPlanes || !bench->rlgr)
+		return FALSE;
+
+	if (!rfx_context_reset(bench->rfxEncoder, bench->codecRoi.width, bench->codecRoi.height))
+		return FALSE;
+
+	rfx_context_set_pixel_format(bench->rfxEncoder, bench->format);
+	rfx_context_set_pixel_format(bench->rfx, bench->format);
+
+	if (!rfx_context_set_tile_cache_size(bench->rfxEncoder, 0))
+		return FALSE;
+
+	for (size_t tile = 0; tile < bench->codecTiles; tile++)
+	{
+		const size_t offset = tile * BENCHMARK_TILE_PIXELS;
+		INT16* input = &bench->rfxInput[offset];
+
+		bench->rfx->encode_format_rgb(primitives_benchmark_tile(bench, bench->codecImage, tile),
+		                              BENCHMARK_TILE_SIZE, BENCHMARK_TILE_SIZE, bench->stride,
+		                              bench->format, NULL, bench->rfxPlanes,
+		                              &bench->rfxPlanes[BENCHMARK_TILE_PIXELS],
+		                              &bench->rfxPlanes[2 * BENCHMARK_TILE_PIXELS]);
+
+		/* the luma range the encoder feeds into the transform */
+		for (size_t x = 0; x < BENCHMARK_TILE_PIXELS; x++)
+			input[x] = (INT16)((bench->rfxPlanes[x] - 128) * 32);
+
+		memcpy(&bench->rfxDwt[offset], input, BENCHMARK_TILE_PIXELS * sizeof(INT16));
+		bench->rfx->dwt_2d_encode(&bench->rfxDwt[offset], bench->rfxTemp);
+
+		memcpy(&bench->rfxQuantized[offset], &bench->rfxDwt[offset],
+		       BENCHMARK_TILE_PIXELS * sizeof(INT16));
+		bench->rfx->quantization_encode(&bench->rfxQuantized[offset], rfx_quant_vals);
+
+		memcpy(&bench->rfxDequantized[offset], &bench->rfxQuantized[offset],
+		       BENCHMARK_TILE_PIXELS * sizeof(INT16));
+		bench->rfx->quantization_decode(&bench->rfxDequantized[offset], rfx_quant_vals);
+
+		/* the encoder ors the bits into the buffer */
+		memset(bench->encodeBuffer, 0, BENCHMARK_RLGR_BUFFER_SIZE);
+
+		const int size =
+		    bench->rfx->rlgr_encode(RLGR3, &bench->rfxQuantized[offset], BENCHMARK_TILE_PIXELS,
+		                            bench->encodeBuffer, BENCHMARK_RLGR_BUFFER_SIZE);
+
+		if (size <= 0)
+			return FALSE;
+
+		bench->rlgr[tile].data = malloc((size_t)size);
+		if (!bench->rlgr[tile].data)
+			return FALSE;
+
+		memcpy(bench->rlgr[tile].data, bench->encodeBuffer, (size_t)size);
+		bench->rlgr[tile].size = (UINT32)size;
+	}
+
+	message = rfx_encode_message(bench->rfxEncoder, &rect, 1, bench->codecImage,
+	                             bench->codecRoi.width, bench->codecRoi.height, bench->stride);
+	if (!message)
+		return FALSE;
+
+	const BOOL rc = rfx_write_message(bench->rfxEncoder, bench->rfxMessage, message);
+	rfx_message_free(bench->rfxEncoder, message);
+	return rc;
+}
+
+static BOOL primitives_benchmark_init_planar(primitives_benchmark* bench)
+{
+	const DWORD flags = PLANAR_FORMAT_HEADER_NA | PLANAR_FORMAT_HEADER_RLE;
+
+	bench->planarEncoder =
+	    freerdp_bitmap_planar_context_new(flags, BENCHMARK_TILE_SIZE, BENCHMARK_TILE_SIZE);
+	bench->planarDecoder =
+	    freerdp_bitmap_planar_context_new(flags, BENCHMARK_TILE_SIZE, BENCHMARK_TILE_SIZE);
+	bench->planarTiles = calloc(bench->codecTiles, sizeof(primitives_benchmark_blob));
+
+	if (!bench->planarEncoder || !bench->planarDecoder || !bench->planarTiles)
+		return FALSE;
+
+	for (size_t tile = 0; tile < bench->codecTiles; tile++)
+	{
+		primitives_benchmark_blob* blob = &bench->planarTiles[tile];
+
+		blob->data = freerdp_bitmap_compress_planar(
+		    bench->planarEncoder, primitives_benchmark_tile(bench, bench->codecImage, tile),
+		    bench->format, BENCHMARK_TILE_SIZE, BENCHMARK_TILE_SIZE, bench->stride, NULL,
+		    &blob->size);
+
+		if (!blob->data)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL primitives_benchmark_init_interleaved(primitives_benchmark* bench)
+{
+	bench->interleavedEncoder = bitmap_interleaved_context_new(TRUE);
+	bench->interleavedDecoder = bitmap_interleaved_context_new(FALSE);
+	bench->interleavedTiles = calloc(bench->codecTiles, sizeof(primitives_benchmark_blob));
+
+	if (!bench->interleavedEncoder || !bench->interleavedDecoder || !bench->interleavedTiles)
+		return FALSE;
+
+	for (size_t tile = 0; tile < bench->codecTiles; tile++)
+	{
+		primitives_benchmark_blob* blob = &bench->interleavedTiles[tile];
+		UINT32 size = BENCHMARK_ENCODE_BUFFER_SIZE;
+		UINT32 x = 0;
+		UINT32 y = 0;
+
+		primitives_benchmark_tile_origin(bench, tile, &x, &y);
+
+		if (!interleaved_compress(bench->interleavedEncoder, bench->encodeBuffer, &size,
+		                          BENCHMARK_TILE_SIZE, BENCHMARK_TILE_SIZE, bench->codecImage,
+		                          bench->format, bench->stride, x, y, NULL, 24))
+			return FALSE;
+
+		blob->data = malloc(size);
+		if (!blob->data)
+			return FALSE;
+
+		memcpy(blob->data, bench->encodeBuffer, size);
+		blob->size = size;
+	}
+
+	return TRUE;
+}
+
+static BOOL primitives_benchmark_init_nsc(primitives_benchmark* bench)
+{
+	bench->nsc = nsc_context_new();
+	bench->nscMessage = Stream_New(NULL, 1024);
+
+	if (!bench->nsc || !bench->nscMessage)
+		return FALSE;
+
+	if (!nsc_context_reset(bench->nsc, bench->codecRoi.width, bench->codecRoi.height))
+		return FALSE;
+
+	if (!nsc_context_set_parameters(bench->nsc, NSC_COLOR_FORMAT, bench->format))
+		return FALSE;
+
+	return nsc_compose_message(bench->nsc, bench->nscMessage, bench->codecImage,
+	                           bench->codecRoi.width, bench->codecRoi.height, bench->stride);
+}
+
+static BOOL primitives_benchmark_init_clear(primitives_benchmark* bench)
+{
+	BOOL rc = FALSE;
+	CLEAR_CONTEXT* encoder = clear_context_new(TRUE);
+	wStream* s = Stream_New(NULL, 1024);
+
+	bench->clearDecoder = clear_context_new(FALSE);
+	bench->clearTiles = calloc(bench->codecTiles, sizeof(primitives_benchmark_blob));
+
+	if (!encoder || !s || !bench->clearDecoder || !bench->clearTiles)
+		goto fail;
+
+	/* the tiles reference the caches filled by the previous ones and are decoded in order */
+	for (size_t tile = 0; tile < bench->codecTiles; tile++)
+	{
+		primitives_benchmark_blob* blob = &bench->clearTiles[tile];
+
+		Stream_SetPosition(s, 0);
+
+		if (clear_compress_to_stream(encoder, s,
+		                             primitives_benchmark_tile(bench, bench->codecImage, tile),
+		                             bench->format, bench->stride, BENCHMARK_TILE_SIZE,
+		                             BENCHMARK_TILE_SIZE) < 0)
+			goto fail;
+
+		blob->size = (UINT32)Stream_GetPosition(s);
+		blob->data = malloc(blob->size);
+		if (!blob->data)
+			goto fail;
+
+		memcpy(blob->data, Stream_Buffer(s), blob->size);
+	}
+
+	rc = TRUE;
+fail:
+	Stream_Free(s, TRUE);
+	clear_context_free(encoder);
+	return rc;
+}
+
+static BOOL primitives_benchmark_init(primitives_benchmark* bench, UINT32 width, UINT32 height)
+{
+	const primitives_benchmark empty = { 0 };
+	*bench = empty;
+
+	bench->roi.width = width;
+	bench->roi.height = height;
+	bench->pixels = width * height;
+	bench->stride = width * 4;
+	bench->format = PIXEL_FORMAT_BGRA32;
+	bench->tilesStep = (width + 15) / 16;
+
+	for (size_t i = 0; i < 2; i++)
+	{
+		bench->frames[i] = calloc(bench->stride, height);
+		if (!bench->frames[i])
+			goto fail;
+
+		winpr_RAND(bench->frames[i], 1ULL * bench->stride * height);
+	}
+
+	bench->output = calloc(bench->stride, height);
+	bench->rgb565 = calloc(bench->pixels, sizeof(UINT16));
+	bench->tiles = calloc(bench->tilesStep, (height + 15) / 16);
+	if (!bench->output || !bench->rgb565 || !bench->tiles)
+		goto fail;
+
+	winpr_RAND(bench->rgb565, 1ULL * bench->pixels * sizeof(UINT16));
+
+	for (size_t i = 0; i < 3; i++)
+	{
+		/* the AVC444 auxiliary luma plane is padded to a multiple of 16 lines */
+		bench->yuv[i] = calloc(width, (height + 15) & ~15u);
+		bench->yuvOut[i] = calloc(width, (height + 15) & ~15u);
+		bench->yuvAux[i] = calloc(width, (height + 15) & ~15u);
+		bench->planes[i] = primitives_benchmark_planes_new(bench->pixels);
+		bench->planesOut[i] = primitives_benchmark_planes_new(bench->pixels);
+		if (!bench->yuv[i] || !bench->yuvOut[i] || !bench->yuvAux[i] || !bench->planes[i] ||
+		    !bench->planesOut[i])
+			goto fail;
+
+		winpr_RAND(bench->yuv[i], 1ULL * width * height);
+		winpr_RAND(bench->planes[i], 1ULL * bench->pixels * sizeof(INT16));
+		bench->yuvSteps[i] = width;
+
+		/* the range the RemoteFX decoder hands to the color conversions */
+		for (size_t x = 0; x < bench->pixels; x++)
+			bench->planes[i][x] = (INT16)(bench->planes[i][x] % 4096);
+	}
+
+	bench->codecRoi.width = MAX(BENCHMARK_TILE_SIZE, MIN(width, BENCHMARK_CODEC_MAX_SIZE) &
+	                                                     ~(BENCHMARK_TILE_SIZE - 1u));
+	bench->codecRoi.height = MAX(BENCHMARK_TILE_SIZE, MIN(height, BENCHMARK_CODEC_MAX_SIZE) &
+	                                                      ~(BENCHMARK_TILE_SIZE - 1u));
+	bench->codecTiles = (bench->codecRoi.width / BENCHMARK_TILE_SIZE) *
+	                    (bench->codecRoi.height / BENCHMARK_TILE_SIZE);
+	bench->codecImage = calloc(bench->stride, MAX(height, bench->codecRoi.height));
+	bench->codecOutput = calloc(bench->stride, MAX(height, bench->codecRoi.height));
+	bench->encodeBuffer = calloc(1, BENCHMARK_ENCODE_BUFFER_SIZE);
+	if (!bench->codecImage || !bench->codecOutput || !bench->encodeBuffer)
+		goto fail;
+
+	primitives_benchmark_fill_desktop(bench);
+
+	if (!primitives_benchmark_init_rfx(bench))
+	{
+		(void)fprintf(stderr, "failed to prepare the RemoteFX benchmark data\n");
+		goto fail;
+	}
+
+	if (!primitives_benchmark_init_planar(bench))
+	{
+		(void)fprintf(stderr, "failed to prepare the planar benchmark data\n");
+		goto fail;
+	}
+
+	if (!primitives_benchmark_init_interleaved(bench))
+	{
+		(void)fprintf(stderr, "failed to prepare the interleaved benchmark data\n");
+		goto fail;
+	}
+
+	if (!primitives_benchmark_init_nsc(bench))
+	{
+		(void)fprintf(stderr, "failed to prepare the NSCodec benchmark data\n");
+		goto fail;
+	}
+
+	if (!primitives_benchmark_init_clear(bench))
+	{
+		(void)fprintf(stderr, "failed to prepare the ClearCodec benchmark data\n");
+		goto fail;
+	}
+
+	return TRUE;
+
+fail:
+	primitives_benchmark_free(bench);
+	return FALSE;
+}
+
+static const char* print_time(UINT64 t, char* buffer, size_t size)
+{
+	(void)_snprintf(buffer, size, "%u.%03u.%03u.%03u", (unsigned)(t / 1000000000ull),
+	                (unsigned)((t / 1000000ull) % 1000), (unsigned)((t / 1000ull) % 1000),
+	                (unsigned)((t) % 1000));
+	return buffer;
+}
+
+static BOOL bench_copy(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->copy(bench->frames[0], bench->output,
+	                   (INT32)(bench->stride * bench->roi.height)) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_copy_8u(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->copy_8u(bench->frames[0], bench->output,
+	                      (INT32)(bench->stride * bench->roi.height)) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_copy_8u_AC4r(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->copy_8u_AC4r(bench->frames[0], (INT32)bench->stride, bench->output,
+	                           (INT32)bench->stride, (INT32)bench->roi.width,
+	                           (INT32)bench->roi.height) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_copy_no_overlap(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->copy_no_overlap(bench->output, bench->format, bench->stride, 0, 0,
+	                              bench->roi.width, bench->roi.height, bench->frames[0],
+	                              bench->format, bench->stride, 0, 0, NULL,
+	                              FREERDP_FLIP_NONE) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_copy_no_overlap_RGBX32(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->copy_no_overlap(bench->output, PIXEL_FORMAT_RGBX32, bench->stride, 0, 0,
+	                              bench->roi.width, bench->roi.height, bench->frames[0],
+	                              bench->format, bench->stride, 0, 0, NULL,
+	                              FREERDP_FLIP_NONE) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_copy_no_overlap_RGB16(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->copy_no_overlap(bench->output, bench->format, bench->stride, 0, 0,
+	                              bench->roi.width, bench->roi.height, (const BYTE*)bench->rgb565,
+	                              PIXEL_FORMAT_RGB16, bench->roi.width * 2, 0, 0, NULL,
+	                              FREERDP_FLIP_NONE) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_set_8u(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->set_8u(0xA5, bench->output, bench->stride * bench->roi.height) ==
+	       PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_set_32s(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->set_32s(-0x12345678, (INT32*)bench->output, bench->pixels) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_set_32u(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->set_32u(0x12345678, (UINT32*)bench->output, bench->pixels) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_zero(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->zero(bench->output, 1ULL * bench->stride * bench->roi.height) ==
+	       PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_add_16s(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->add_16s(bench->planes[0], bench->planes[1], bench->planesOut[0],
+	                      bench->pixels) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_add_16s_inplace(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->add_16s_inplace(bench->planesOut[0], bench->planesOut[1], bench->pixels) ==
+	       PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_andC_32u(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->andC_32u((const UINT32*)bench->frames[0], 0xFF00FF00, (UINT32*)bench->output,
+	                       (INT32)bench->pixels) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_orC_32u(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->orC_32u((const UINT32*)bench->frames[0], 0xFF000000, (UINT32*)bench->output,
+	                      (INT32)bench->pixels) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_lShiftC_16s(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->lShiftC_16s(bench->planes[0], 2, bench->planesOut[0], bench->pixels) ==
+	       PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_lShiftC_16s_inplace(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->lShiftC_16s_inplace(bench->planesOut[0], 2, bench->pixels) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_lShiftC_16u(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->lShiftC_16u((const UINT16*)bench->planes[0], 2, (UINT16*)bench->planesOut[0],
+	                          bench->pixels) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_rShiftC_16s(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->rShiftC_16s(bench->planes[0], 2, bench->planesOut[0], bench->pixels) ==
+	       PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_rShiftC_16u(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->rShiftC_16u((const UINT16*)bench->planes[0], 2, (UINT16*)bench->planesOut[0],
+	                          bench->pixels) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_shiftC_16s(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->shiftC_16s(bench->planes[0], -2, bench->planesOut[0], bench->pixels) ==
+	       PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_shiftC_16u(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->shiftC_16u((const UINT16*)bench->planes[0], 2, (UINT16*)bench->planesOut[0],
+	                         bench->pixels) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_alphaComp_argb(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->alphaComp_argb(bench->frames[0], bench->stride, bench->frames[1], bench->stride,
+	                             bench->output, bench->stride, bench->roi.width,
+	                             bench->roi.height) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_sign_16s(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->sign_16s(bench->planes[0], bench->planesOut[0], bench->pixels) ==
+	       PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_yCbCrToRGB_16s8u_P3AC4R(primitives_benchmark* bench, const primitives_t* prims)
+{
+	const INT16* src[3] = { bench->planes[0], bench->planes[1], bench->planes[2] };
+	const UINT32 step = (UINT32)(bench->roi.width * sizeof(INT16));
+
+	return prims->yCbCrToRGB_16s8u_P3AC4R(src, step, bench->output, bench->stride, bench->format,
+	                                      &bench->roi) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_yCbCrToRGB_16s16s_P3P3(primitives_benchmark* bench, const primitives_t* prims)
+{
+	const INT16* src[3] = { bench->planes[0], bench->planes[1], bench->planes[2] };
+	const INT32 step = (INT32)(bench->roi.width * sizeof(INT16));
+
+	return prims->yCbCrToRGB_16s16s_P3P3(src, step, bench->planesOut, step, &bench->roi) ==
+	       PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_RGBToYCbCr_16s16s_P3P3(primitives_benchmark* bench, const primitives_t* prims)
+{
+	const INT16* src[3] = { bench->planes[0], bench->planes[1], bench->planes[2] };
+	const INT32 step = (INT32)(bench->roi.width * sizeof(INT16));
+
+	return prims->RGBToYCbCr_16s16s_P3P3(src, step, bench->planesOut, step, &bench->roi) ==
+	       PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_RGBToRGB_16s8u_P3AC4R(primitives_benchmark* bench, const primitives_t* prims)
+{
+	const INT16* src[3] = { bench->planes[0], bench->planes[1], bench->planes[2] };
+	const UINT32 step = (UINT32)(bench->roi.width * sizeof(INT16));
+
+	return prims->RGBToRGB_16s8u_P3AC4R(src, step, bench->output, bench->stride, bench->format,
+	                                    &bench->roi) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_YCoCgToRGB_8u_AC4R(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->YCoCgToRGB_8u_AC4R(bench->frames[0], (INT32)bench->stride, bench->output,
+	                                 bench->format, (INT32)bench->stride, bench->roi.width,
+	                                 bench->roi.height, 2, TRUE) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_YUV420ToRGB_8u_P3AC4R(primitives_benchmark* bench, const primitives_t* prims)
+{
+	const BYTE* src[3] = { bench->yuv[0], bench->yuv[1], bench->yuv[2] };
+
+	return prims->YUV420ToRGB_8u_P3AC4R(src, bench->yuvSteps, bench->output, bench->stride,
+	                                    bench->format, &bench->roi) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_YUV444ToRGB_8u_P3AC4R(primitives_benchmark* bench, const primitives_t* prims)
+{
+	const BYTE* src[3] = { bench->yuv[0], bench->yuv[1], bench->yuv[2] };
+
+	return prims->YUV444ToRGB_8u_P3AC4R(src, bench->yuvSteps, bench->output, bench->stride,
+	                                    bench->format, &bench->roi) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_RGBToYUV420_8u_P3AC4R(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->RGBToYUV420_8u_P3AC4R(bench->frames[0], bench->format, bench->stride,
+	                                    bench->yuvOut, bench->yuvSteps,
+	                                    &bench->roi) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_RGBToYUV444_8u_P3AC4R(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->RGBToYUV444_8u_P3AC4R(bench->frames[0], bench->format, bench->stride,
+	                                    bench->yuvOut, bench->yuvSteps,
+	                                    &bench->roi) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_YUV420CombineToYUV444(primitives_benchmark* bench, const primitives_t* prims)
+{
+	const BYTE* src[3] = { bench->yuv[0], bench->yuv[1], bench->yuv[2] };
+	const RECTANGLE_16 rect = { 0, 0, (UINT16)bench->roi.width, (UINT16)bench->roi.height };
+
+	return prims->YUV420CombineToYUV444(AVC444_LUMA, src, bench->yuvSteps, bench->roi.width,
+	                                    bench->roi.height, bench->yuvOut, bench->yuvSteps,
+	                                    &rect) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_YUV444SplitToYUV420(primitives_benchmark* bench, const primitives_t* prims)
+{
+	const BYTE* src[3] = { bench->yuv[0], bench->yuv[1], bench->yuv[2] };
+
+	return prims->YUV444SplitToYUV420(src, bench->yuvSteps, bench->yuvOut, bench->yuvSteps,
+	                                  bench->yuvAux, bench->yuvSteps,
+	                                  &bench->roi) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_RGBToAVC444YUV(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->RGBToAVC444YUV(bench->frames[0], bench->format, bench->stride, bench->yuvOut,
+	                             bench->yuvSteps, bench->yuvAux, bench->yuvSteps,
+	                             &bench->roi) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_RGBToAVC444YUVv2(primitives_benchmark* bench, const primitives_t* prims)
+{
+	return prims->RGBToAVC444YUVv2(bench->frames[0], bench->format, bench->stride, bench->yuvOut,
+	                               bench->yuvSteps, bench->yuvAux, bench->yuvSteps,
+	                               &bench->roi) == PRIMITIVES_SUCCESS;
+}
+
+/* a frame update where every 8th row of tiles changed */
+static BOOL prepare_compare_tiles(primitives_benchmark* bench, const primitives_t* prims)
+{
+	WINPR_UNUSED(prims);
+	memcpy(bench->output, bench->frames[0], 1ULL * bench->stride * bench->roi.height);
+
+	for (UINT32 y = 0; y < bench->roi.height; y += 8 * 16)
+		bench->output[1ULL * y * bench->stride] ^= 0xFF;
+
+	return TRUE;
+}
+
+static BOOL bench_compare_tiles(primitives_benchmark* bench, const primitives_t* prims)
+{
+	UINT32 dirty = 0;
+
+	return prims->compare_tiles(bench->frames[0], bench->format, bench->stride, bench->output,
+	                            bench->format, bench->stride, bench->roi.width, bench->roi.height,
+	                            bench->tiles, bench->tilesStep, &dirty) == PRIMITIVES_SUCCESS;
+}
+
+static BOOL bench_rfx_encode_format_rgb(primitives_benchmark* bench, const primitives_t* prims)
+{
+	WINPR_UNUSED(prims);
+
+	for (size_t tile = 0; tile < bench->codecTiles; tile++)
+		bench->rfx->encode_format_rgb(primitives_benchmark_tile(bench, bench->codecImage, tile),
+		                              BENCHMARK_TILE_SIZE, BENCHMARK_TILE_SIZE, bench->stride,
+		                              bench->format, NULL, bench->rfxPlanes,
+		                              &bench->rfxPlanes[BENCHMARK_TILE_PIXELS],
+		                              &bench->rfxPlanes[2 * BENCHMARK_TILE_PIXELS]);
+	return TRUE;
+}
+
+static BOOL prepare_rfx_work(primitives_benchmark* bench, const INT16* src)
+{
+	memcpy(bench->rfxWork, src, 1ULL * bench->codecTiles * BENCHMARK_TILE_PIXELS * sizeof(INT16));
+	return TRUE;
+}
 
-static void primitives_YUV_benchmark_free(primitives_YUV_benchmark* bench)
+static BOOL prepare_rfx_dwt_2d_encode(primitives_benchmark* bench, const primitives_t* prims)
 {
-	if (!bench)
-		return;
+	WINPR_UNUSED(prims);
+	return prepare_rfx_work(bench, bench->rfxInput);
+}
 
-	free(bench->outputBuffer);
-	free(bench->rgbBuffer);
+static BOOL bench_rfx_dwt_2d_encode(primitives_benchmark* bench, const primitives_t* prims)
+{
+	WINPR_UNUSED(prims);
 
-	for (size_t i = 0; i < 3; i++)
+	for (size_t tile = 0; tile < bench->codecTiles; tile++)
+		bench->rfx->dwt_2d_encode(&bench->rfxWork[tile * BENCHMARK_TILE_PIXELS], bench->rfxTemp);
+	return TRUE;
+}
+
+static BOOL prepare_rfx_quantization_encode(primitives_benchmark* bench, const primitives_t* prims)
+{
+	WINPR_UNUSED(prims);
+	return prepare_rfx_work(bench, bench->rfxDwt);
+}
+
+static BOOL bench_rfx_quantization_encode(primitives_benchmark* bench, const primitives_t* prims)
+{
+	WINPR_UNUSED(prims);
+
+	for (size_t tile = 0; tile < bench->codecTiles; tile++)
+		bench->rfx->quantization_encode(&bench->rfxWork[tile * BENCHMARK_TILE_PIXELS],
+		                                rfx_quant_vals);
+	return TRUE;
+}
+
+static BOOL bench_rfx_rlgr_encode(primitives_benchmark* bench, const primitives_t* prims)
+{
+	WINPR_UNUSED(prims);
+
+	for (size_t tile = 0; tile < bench->codecTiles; tile++)
 	{
-		free(bench->outputChannels[i]);
-		free(bench->channels[i]);
+		memset(bench->encodeBuffer, 0, BENCHMARK_RLGR_BUFFER_SIZE);
+
+		if (bench->rfx->rlgr_encode(RLGR3, &bench->rfxQuantized[tile * BENCHMARK_TILE_PIXELS],
+		                            BENCHMARK_TILE_PIXELS, bench->encodeBuffer,
+		                            BENCHMARK_RLGR_BUFFER_SIZE) <= 0)
+			return FALSE;
 	}
 
-	const primitives_YUV_benchmark empty = { 0 };
-	*bench = empty;
+	return TRUE;
 }
 
-static primitives_YUV_benchmark primitives_YUV_benchmark_init(void)
+static BOOL bench_rfx_rlgr_decode(primitives_benchmark* bench, const primitives_t* prims)
 {
-	primitives_YUV_benchmark ret = { 0 };
-	ret.roi.width = 3840 * 4;
-	ret.roi.height = 2160 * 4;
-	ret.outputStride = ret.roi.width * 4;
-	ret.testedFormat = PIXEL_FORMAT_BGRA32;
+	WINPR_UNUSED(prims);
 
-	ret.outputBuffer = calloc(ret.outputStride, ret.roi.height);
-	if (!ret.outputBuffer)
-		goto fail;
-	ret.rgbBuffer = calloc(ret.outputStride, ret.roi.height);
-	if (!ret.rgbBuffer)
-		goto fail;
-	winpr_RAND(ret.rgbBuffer, 1ULL * ret.outputStride * ret.roi.height);
+	for (size_t tile = 0; tile < bench->codecTiles; tile++)
+	{
+		if (bench->rfx->rlgr_decode(RLGR3, bench->rlgr[tile].data, bench->rlgr[tile].size,
+		                            &bench->rfxWork[tile * BENCHMARK_TILE_PIXELS],
+		                            BENCHMARK_TILE_PIXELS) < 0)
+			return FALSE;
+	}
 
-	for (size_t i = 0; i < 3; i++)
+	return TRUE;
+}
+
+static BOOL prepare_rfx_quantization_decode(primitives_benchmark* bench, const primitives_t* prims)
+{
+	WINPR_UNUSED(prims);
+	return prepare_rfx_work(bench, bench->rfxQuantized);
+}
+
+static BOOL bench_rfx_quantization_decode(primitives_benchmark* bench, const primitives_t* prims)
+{
+	WINPR_UNUSED(prims);
+
+	for (size_t tile = 0; tile < bench->codecTiles; tile++)
+		bench->rfx->quantization_decode(&bench->rfxWork[tile * BENCHMARK_TILE_PIXELS],
+		                                rfx_quant_vals);
+	return TRUE;
+}
+
+static BOOL prepare_rfx_dwt_2d_decode(primitives_benchmark* bench, const primitives_t* prims)
+{
+	WINPR_UNUSED(prims);
+	return prepare_rfx_work(bench, bench->rfxDequantized);
+}
+
+static BOOL bench_rfx_dwt_2d_decode(primitives_benchmark* bench, const primitives_t* prims)
+{
+	WINPR_UNUSED(prims);
+
+	for (size_t tile = 0; tile < bench->codecTiles; tile++)
+		bench->rfx->dwt_2d_decode(&bench->rfxWork[tile * BENCHMARK_TILE_PIXELS], bench->rfxTemp);
+	return TRUE;
+}
+
+static BOOL bench_rfx_encode_message(primitives_benchmark* bench, const primitives_t* prims)
+{
+	const RFX_RECT rect = { 0, 0, (UINT16)bench->codecRoi.width, (UINT16)bench->codecRoi.height };
+
+	WINPR_UNUSED(prims);
+
+	RFX_MESSAGE* message = rfx_encode_message(bench->rfxEncoder, &rect, 1, bench->codecImage,
+	                                          bench->codecRoi.width, bench->codecRoi.height,
+	                                          bench->stride);
+	if (!message)
+		return FALSE;
+
+	Stream_SetPosition(bench->rfxOutput, 0);
+	const BOOL rc = rfx_write_message(bench->rfxEncoder, bench->rfxOutput, message);
+	rfx_message_free(bench->rfxEncoder, message);
+	return rc;
+}
+
+static BOOL bench_rfx_process_message(primitives_benchmark* bench, const primitives_t* prims)
+{
+	WINPR_UNUSED(prims);
+
+	return rfx_process_message(bench->rfx, Stream_Buffer(bench->rfxMessage),
+	                           (UINT32)Stream_GetPosition(bench->rfxMessage), 0, 0,
+	                           bench->codecOutput, bench->format, bench->stride,
+	                           bench->codecRoi.height, NULL);
+}
+
+static BOOL bench_planar_compress(primitives_benchmark* bench, const primitives_t* prims)
+{
+	WINPR_UNUSED(prims);
+
+	for (size_t tile = 0; tile < bench->codecTiles; tile++)
 	{
-		ret.channels[i] = calloc(ret.roi.width, ret.roi.height);
-		ret.outputChannels[i] = calloc(ret.roi.width, ret.roi.height);
-		if (!ret.channels[i] || !ret.outputChannels[i])
-			goto fail;
+		UINT32 size = BENCHMARK_ENCODE_BUFFER_SIZE;
 
-		winpr_RAND(ret.channels[i], 1ull * ret.roi.width * ret.roi.height);
-		ret.steps[i] = ret.roi.width;
+		if (!freerdp_bitmap_compress_planar(
+		        bench->planarEncoder, primitives_benchmark_tile(bench, bench->codecImage, tile),
+		        bench->format, BENCHMARK_TILE_SIZE, BENCHMARK_TILE_SIZE, bench->stride,
+		        bench->encodeBuffer, &size))
+			return FALSE;
 	}
 
-	return ret;
+	return TRUE;
+}
 
-fail:
-	primitives_YUV_benchmark_free(&ret);
-	return ret;
+static BOOL bench_planar_decompress(primitives_benchmark* bench, const primitives_t* prims)
+{
+	WINPR_UNUSED(prims);
+
+	for (size_t tile = 0; tile < bench->codecTiles; tile++)
+	{
+		UINT32 x = 0;
+		UINT32 y = 0;
+
+		primitives_benchmark_tile_origin(bench, tile, &x, &y);
+
+		/* the tiles carry no alpha plane, BGRX32 is decoded in place without a temp buffer */
+		if (!planar_decompress(bench->planarDecoder, bench->planarTiles[tile].data,
+		                       bench->planarTiles[tile].size, BENCHMARK_TILE_SIZE,
+		                       BENCHMARK_TILE_SIZE, bench->codecOutput, PIXEL_FORMAT_BGRX32,
+		                       bench->stride, x, y, BENCHMARK_TILE_SIZE, BENCHMARK_TILE_SIZE,
+		                       FALSE))
+			return FALSE;
+	}
+
+	return TRUE;
 }
 
-static const char* print_time(UINT64 t, char* buffer, size_t size)
+static BOOL bench_interleaved_compress(primitives_benchmark* bench, const primitives_t* prims)
 {
-	(void)_snprintf(buffer, size, "%u.%03u.%03u.%03u", (unsigned)(t / 1000000000ull),
-	                (unsigned)((t / 1000000ull) % 1000), (unsigned)((t / 1000ull) % 1000),
-	                (unsigned)((t) % 1000));
-	return buffer;
+	WINPR_UNUSED(prims);
+
+	for (size_t tile = 0; tile < bench->codecTiles; tile++)
+	{
+		UINT32 size = BENCHMARK_ENCODE_BUFFER_SIZE;
+		UINT32 x = 0;
+		UINT32 y = 0;
+
+		primitives_benchmark_tile_origin(bench, tile, &x, &y);
+
+		if (!interleaved_compress(bench->interleavedEncoder, bench->encodeBuffer, &size,
+		                          BENCHMARK_TILE_SIZE, BENCHMARK_TILE_SIZE, bench->codecImage,
+		                          bench->format, bench->stride, x, y, NULL, 24))
+			return FALSE;
+	}
+
+	return TRUE;
 }
 
-static BOOL primitives_YUV420_benchmark_run(primitives_YUV_benchmark* bench, primitives_t* prims)
+static BOOL bench_interleaved_decompress(primitives_benchmark* bench, const primitives_t* prims)
 {
-	const BYTE* channels[3] = { 0 };
+	WINPR_UNUSED(prims);
 
-	for (size_t i = 0; i < 3; i++)
-		channels[i] = bench->channels[i];
+	for (size_t tile = 0; tile < bench->codecTiles; tile++)
+	{
+		UINT32 x = 0;
+		UINT32 y = 0;
+
+		primitives_benchmark_tile_origin(bench, tile, &x, &y);
 
-	for (size_t x = 0; x < 10; x++)
+		if (!interleaved_decompress(bench->interleavedDecoder, bench->interleavedTiles[tile].data,
+		                            bench->interleavedTiles[tile].size, BENCHMARK_TILE_SIZE,
+		                            BENCHMARK_TILE_SIZE, 24, bench->codecOutput, bench->format,
+		                            bench->stride, x, y, BENCHMARK_TILE_SIZE,
+		                            BENCHMARK_TILE_SIZE, NULL))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL bench_nsc_process_message(primitives_benchmark* bench, const primitives_t* prims)
+{
+	WINPR_UNUSED(prims);
+
+	return nsc_process_message(bench->nsc, 32, bench->codecRoi.width, bench->codecRoi.height,
+	                           Stream_Buffer(bench->nscMessage),
+	                           (UINT32)Stream_GetPosition(bench->nscMessage), bench->codecOutput,
+	                           bench->format, bench->stride, 0, 0, bench->codecRoi.width,
+	                           bench->codecRoi.height, FREERDP_FLIP_NONE);
+}
+
+/* the first tile resets the decoder caches, the following ones reference them */
+static BOOL prepare_clear_decompress(primitives_benchmark* bench, const primitives_t* prims)
+{
+	WINPR_UNUSED(prims);
+	return clear_context_reset(bench->clearDecoder);
+}
+
+static BOOL bench_clear_decompress(primitives_benchmark* bench, const primitives_t* prims)
+{
+	WINPR_UNUSED(prims);
+
+	for (size_t tile = 0; tile < bench->codecTiles; tile++)
 	{
-		const UINT64 start = winpr_GetTickCount64NS();
-		pstatus_t status =
-		    prims->YUV420ToRGB_8u_P3AC4R(channels, bench->steps, bench->outputBuffer,
-		                                 bench->outputStride, bench->testedFormat, &bench->roi);
-		const UINT64 end = winpr_GetTickCount64NS();
-		if (status != PRIMITIVES_SUCCESS)
-		{
-			(void)fprintf(stderr, "Running YUV420ToRGB_8u_P3AC4R failed\n");
+		UINT32 x = 0;
+		UINT32 y = 0;
+
+		primitives_benchmark_tile_origin(bench, tile, &x, &y);
+
+		if (clear_decompress(bench->clearDecoder, bench->clearTiles[tile].data,
+		                     bench->clearTiles[tile].size, BENCHMARK_TILE_SIZE,
+		                     BENCHMARK_TILE_SIZE, bench->codecOutput, bench->format,
+		                     bench->stride, x, y, bench->codecRoi.width, bench->codecRoi.height,
+		                     NULL) < 0)
 			return FALSE;
-		}
-		const UINT64 diff = end - start;
-		char buffer[32] = { 0 };
-		printf("[%" PRIuz "] YUV420ToRGB_8u_P3AC4R %" PRIu32 "x%" PRIu32 " took %sns\n", x,
-		       bench->roi.width, bench->roi.height, print_time(diff, buffer, sizeof(buffer)));
 	}
 
 	return TRUE;
 }
 
-static BOOL primitives_YUV444_benchmark_run(primitives_YUV_benchmark* bench, primitives_t* prims)
+/* run once for every implementation returned by primitives_get_by_type */
+static const primitives_benchmark_entry primitives_benchmarks[] = {
+	{ "copy", NULL, bench_copy },
+	{ "copy_8u", NULL, bench_copy_8u },
+	{ "copy_8u_AC4r", NULL, bench_copy_8u_AC4r },
+	{ "copy_no_overlap", NULL, bench_copy_no_overlap },
+	{ "copy_no_overlap_RGBX32", NULL, bench_copy_no_overlap_RGBX32 },
+	{ "copy_no_overlap_RGB16", NULL, bench_copy_no_overlap_RGB16 },
+	{ "set_8u", NULL, bench_set_8u },
+	{ "set_32s", NULL, bench_set_32s },
+	{ "set_32u", NULL, bench_set_32u },
+	{ "zero", NULL, bench_zero },
+	{ "add_16s", NULL, bench_add_16s },
+	{ "add_16s_inplace", NULL, bench_add_16s_inplace },
+	{ "andC_32u", NULL, bench_andC_32u },
+	{ "orC_32u", NULL, bench_orC_32u },
+	{ "lShiftC_16s", NULL, bench_lShiftC_16s },
+	{ "lShiftC_16s_inplace", NULL, bench_lShiftC_16s_inplace },
+	{ "lShiftC_16u", NULL, bench_lShiftC_16u },
+	{ "rShiftC_16s", NULL, bench_rShiftC_16s },
+	{ "rShiftC_16u", NULL, bench_rShiftC_16u },
+	{ "shiftC_16s", NULL, bench_shiftC_16s },
+	{ "shiftC_16u", NULL, bench_shiftC_16u },
+	{ "alphaComp_argb", NULL, bench_alphaComp_argb },
+	{ "sign_16s", NULL, bench_sign_16s },
+	{ "yCbCrToRGB_16s8u_P3AC4R", NULL, bench_yCbCrToRGB_16s8u_P3AC4R },
+	{ "yCbCrToRGB_16s16s_P3P3", NULL, bench_yCbCrToRGB_16s16s_P3P3 },
+	{ "RGBToYCbCr_16s16s_P3P3", NULL, bench_RGBToYCbCr_16s16s_P3P3 },
+	{ "RGBToRGB_16s8u_P3AC4R", NULL, bench_RGBToRGB_16s8u_P3AC4R },
+	{ "YCoCgToRGB_8u_AC4R", NULL, bench_YCoCgToRGB_8u_AC4R },
+	{ "YUV420ToRGB_8u_P3AC4R", NULL, bench_YUV420ToRGB_8u_P3AC4R },
+	{ "YUV444ToRGB_8u_P3AC4R", NULL, bench_YUV444ToRGB_8u_P3AC4R },
+	{ "RGBToYUV420_8u_P3AC4R", NULL, bench_RGBToYUV420_8u_P3AC4R },
+	{ "RGBToYUV444_8u_P3AC4R", NULL, bench_RGBToYUV444_8u_P3AC4R },
+	{ "YUV420CombineToYUV444", NULL, bench_YUV420CombineToYUV444 },
+	{ "YUV444SplitToYUV420", NULL, bench_YUV444SplitToYUV420 },
+	{ "RGBToAVC444YUV", NULL, bench_RGBToAVC444YUV },
+	{ "RGBToAVC444YUVv2", NULL, bench_RGBToAVC444YUVv2 },
+	{ "compare_tiles", prepare_compare_tiles, bench_compare_tiles },
+};
+
+/* the codecs use primitives_get(), these run once with the autodetected implementation */
+static const primitives_benchmark_entry codec_benchmarks[] = {
+	{ "rfx_encode_format_rgb", NULL, bench_rfx_encode_format_rgb },
+	{ "rfx_dwt_2d_encode", prepare_rfx_dwt_2d_encode, bench_rfx_dwt_2d_encode },
+	{ "rfx_quantization_encode", prepare_rfx_quantization_encode, bench_rfx_quantization_encode },
+	{ "rfx_rlgr_encode", NULL, bench_rfx_rlgr_encode },
+	{ "rfx_rlgr_decode", NULL, bench_rfx_rlgr_decode },
+	{ "rfx_quantization_decode", prepare_rfx_quantization_decode, bench_rfx_quantization_decode },
+	{ "rfx_dwt_2d_decode", prepare_rfx_dwt_2d_decode, bench_rfx_dwt_2d_decode },
+	{ "rfx_encode_message", NULL, bench_rfx_encode_message },
+	{ "rfx_process_message", NULL, bench_rfx_process_message },
+	{ "planar_compress", NULL, bench_planar_compress },
+	{ "planar_decompress", NULL, bench_planar_decompress },
+	{ "interleaved_compress", NULL, bench_interleaved_compress },
+	{ "interleaved_decompress", NULL, bench_interleaved_decompress },
+	{ "nsc_process_message", NULL, bench_nsc_process_message },
+	{ "clear_decompress", prepare_clear_decompress, bench_clear_decompress },
+};
+
+static int compare_uint64(const void* a, const void* b)
 {
-	const BYTE* channels[3] = { 0 };
+	const UINT64 va = *(const UINT64*)a;
+	const UINT64 vb = *(const UINT64*)b;
 
-	for (size_t i = 0; i < 3; i++)
-		channels[i] = bench->channels[i];
+	if (va < vb)
+		return -1;
+	return (va > vb) ? 1 : 0;
+}
+
+static BOOL primitives_benchmark_add_result(primitives_benchmark_run* run,
+                                            const primitives_benchmark_result* result)
+{
+	if (run->count == run->capacity)
+	{
+		const size_t capacity = MAX(64, run->capacity * 2);
+		primitives_benchmark_result* tmp =
+		    realloc(run->results, capacity * sizeof(primitives_benchmark_result));
+		if (!tmp)
+			return FALSE;
+
+		run->results = tmp;
+		run->capacity = capacity;
+	}
+
+	run->results[run->count++] = *result;
+	return TRUE;
+}
+
+static BOOL primitives_benchmark_run_entry(primitives_benchmark_run* run,
+                                           primitives_benchmark* bench, const primitives_t* prims,
+                                           const char* implementation,
+                                           const primitives_benchmark_entry* entry)
+{
+	BOOL rc = FALSE;
+	UINT64 sum = 0;
+	UINT64* samples = NULL;
 
-	for (size_t x = 0; x < 10; x++)
+	if (run->filter && !strstr(entry->name, run->filter))
+		return TRUE;
+
+	samples = calloc(run->iterations, sizeof(UINT64));
+	if (!samples)
+		return FALSE;
+
+	/* the first run is not timed, it warms up the caches */
+	for (size_t x = 0; x <= run->iterations; x++)
 	{
+		if (entry->prepare && !entry->prepare(bench, prims))
+		{
+			(void)fprintf(stderr, "Preparing %s on %s failed\n", entry->name, implementation);
+			goto fail;
+		}
+
 		const UINT64 start = winpr_GetTickCount64NS();
-		pstatus_t status =
-		    prims->YUV444ToRGB_8u_P3AC4R(channels, bench->steps, bench->outputBuffer,
-		                                 bench->outputStride, bench->testedFormat, &bench->roi);
+		const BOOL status = entry->run(bench, prims);
 		const UINT64 end = winpr_GetTickCount64NS();
-		if (status != PRIMITIVES_SUCCESS)
+
+		if (!status)
 		{
-			(void)fprintf(stderr, "Running YUV444ToRGB_8u_P3AC4R failed\n");
-			return FALSE;
+			(void)fprintf(stderr, "Running %s on %s failed\n", entry->name, implementation);
+			goto fail;
+		}
+
+		if (x > 0)
+		{
+			samples[x - 1] = end - start;
+			sum += end - start;
 		}
-		const UINT64 diff = end - start;
-		char buffer[32] = { 0 };
-		printf("[%" PRIuz "] YUV444ToRGB_8u_P3AC4R %" PRIu32 "x%" PRIu32 " took %sns\n", x,
-		       bench->roi.width, bench->roi.height, print_time(diff, buffer, sizeof(buffer)));
 	}
 
+	qsort(samples, run->iterations, sizeof(UINT64), compare_uint64);
+
+	const primitives_benchmark_result result = { implementation, entry->name, samples[0],
+		                                         samples[run->iterations / 2],
+		                                         sum / run->iterations };
+	char min[32] = { 0 };
+	char median[32] = { 0 };
+
+	printf("%-22s %-28s min %sns median %sns\n", implementation, entry->name,
+	       print_time(result.min, min, sizeof(min)),
+	       print_time(result.median, median, sizeof(median)));
+	rc = primitives_benchmark_add_result(run, &result);
+fail:
+	free(samples);
+	return rc;
+}
+
+static BOOL primitives_benchmark_write_json(const primitives_benchmark_run* run)
+{
+	FILE* fp = winpr_fopen(run->jsonFile, "w");
+
+	if (!fp)
+	{
+		(void)fprintf(stderr, "failed to open %s\n", run->jsonFile);
+		return FALSE;
+	}
+
+	/* one result per line, primitives_benchmark_compare_baseline depends on that */
+	(void)fprintf(fp, "{\n\t\"iterations\": %" PRIuz ",\n\t\"results\": [\n", run->iterations);
+
+	for (size_t x = 0; x < run->count; x++)
+	{
+		const primitives_benchmark_result* result = &run->results[x];
+
+		(void)fprintf(fp,
+		              "\t\t{ \"implementation\": \"%s\", \"benchmark\": \"%s\", "
+		              "\"min_ns\": %" PRIu64 ", \"median_ns\": %" PRIu64 ", \"mean_ns\": %" PRIu64
+		              " }%s\n",
+		              result->implementation, result->name, result->min, result->median,
+		              result->mean, (x + 1 < run->count) ? "," : "");
+	}
+
+	(void)fprintf(fp, "\t]\n}\n");
+	return fclose(fp) == 0;
+}
+
+static BOOL json_line_string(const char* line, const char* key, char* value, size_t size)
+{
+	char pattern[64] = { 0 };
+
+	(void)_snprintf(pattern, sizeof(pattern), "\"%s\": \"", key);
+
+	const char* start = strstr(line, pattern);
+	if (!start)
+		return FALSE;
+
+	start += strlen(pattern);
+
+	const char* end = strchr(start, '"');
+	if (!end || ((size_t)(end - start) >= size))
+		return FALSE;
+
+	memcpy(value, start, (size_t)(end - start));
+	value[end - start] = '\0';
 	return TRUE;
 }
 
-static BOOL primitives_RGB2420_benchmark_run(primitives_YUV_benchmark* bench, primitives_t* prims)
+static BOOL json_line_number(const char* line, const char* key, UINT64* value)
+{
+	char pattern[64] = { 0 };
+	char* end = NULL;
+
+	(void)_snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+
+	const char* start = strstr(line, pattern);
+	if (!start)
+		return FALSE;
+
+	start += strlen(pattern);
+	errno = 0;
+	*value = strtoull(start, &end, 10);
+	return (errno == 0) && (end != start);
+}
+
+static char* read_file(const char* filename)
+{
+	char* data = NULL;
+	FILE* fp = winpr_fopen(filename, "rb");
+
+	if (!fp)
+		return NULL;
+
+	if (_fseeki64(fp, 0, SEEK_END) != 0)
+		goto fail;
+
+	const INT64 size = _ftelli64(fp);
+	if ((size < 0) || (_fseeki64(fp, 0, SEEK_SET) != 0))
+		goto fail;
+
+	data = calloc((size_t)size + 1, sizeof(char));
+	if (!data)
+		goto fail;
+
+	if (fread(data, 1, (size_t)size, fp) != (size_t)size)
+	{
+		free(data);
+		data = NULL;
+	}
+
+fail:
+	(void)fclose(fp);
+	return data;
+}
+
+/* reads files written by primitives_benchmark_write_json, compares the medians */
+static BOOL primitives_benchmark_compare_baseline(const primitives_benchmark_run* run)
 {
-	for (size_t x = 0; x < 10; x++)
+	size_t compared = 0;
+	size_t regressions = 0;
+	char* data = read_file(run->baselineFile);
+
+	if (!data)
 	{
-		const UINT64 start = winpr_GetTickCount64NS();
-		pstatus_t status =
-		    prims->RGBToYUV420_8u_P3AC4R(bench->rgbBuffer, bench->testedFormat, bench->outputStride,
-		                                 bench->outputChannels, bench->steps, &bench->roi);
-		const UINT64 end = winpr_GetTickCount64NS();
-		if (status != PRIMITIVES_SUCCESS)
+		(void)fprintf(stderr, "failed to read baseline %s\n", run->baselineFile);
+		return FALSE;
+	}
+
+	char* line = data;
+	while (line)
+	{
+		char implementation[64] = { 0 };
+		char name[64] = { 0 };
+		UINT64 baseline = 0;
+		char* next = strchr(line, '\n');
+
+		if (next)
+			*next++ = '\0';
+
+		if (json_line_string(line, "implementation", implementation, sizeof(implementation)) &&
+		    json_line_string(line, "benchmark", name, sizeof(name)) &&
+		    json_line_number(line, "median_ns", &baseline))
 		{
-			(void)fprintf(stderr, "Running RGBToYUV420_8u_P3AC4R failed\n");
-			return FALSE;
+			for (size_t x = 0; x < run->count; x++)
+			{
+				const primitives_benchmark_result* result = &run->results[x];
+
+				if ((strcmp(result->implementation, implementation) != 0) ||
+				    (strcmp(result->name, name) != 0))
+					continue;
+
+				compared++;
+
+				if (result->median > baseline + baseline * run->tolerance / 100)
+				{
+					(void)fprintf(stderr,
+					              "REGRESSION %s %s: median %" PRIu64 "ns, baseline %" PRIu64
+					              "ns, tolerance %" PRIu32 "%%\n",
+					              implementation, name, result->median, baseline, run->tolerance);
+					regressions++;
+				}
+				break;
+			}
 		}
-		const UINT64 diff = end - start;
-		char buffer[32] = { 0 };
-		printf("[%" PRIuz "] RGBToYUV420_8u_P3AC4R %" PRIu32 "x%" PRIu32 " took %sns\n", x,
-		       bench->roi.width, bench->roi.height, print_time(diff, buffer, sizeof(buffer)));
+
+		line = next;
+	}
+
+	free(data);
+
+	if (compared == 0)
+	{
+		(void)fprintf(stderr, "baseline %s has no results for this run\n", run->baselineFile);
+		return FALSE;
 	}
 
+	printf("compared %" PRIuz " of %" PRIuz " results against %s, %" PRIuz " regressions\n",
+	       compared, run->count, run->baselineFile, regressions);
+	return regressions == 0;
+}
+
+static void usage(const char* name)
+{
+	printf("Usage: %s [options]\n", name);
+	printf("\n");
+	printf("  --iterations <n>   timed runs per benchmark, default 10\n");
+	printf("  --size <w>x<h>     frame size of the primitives benchmarks, default 3840x2160\n");
+	printf("  --filter <text>    only run benchmarks with <text> in their name\n");
+	printf("  --json <file>      write the results to <file>\n");
+	printf("  --baseline <file>  compare the medians against a file written by --json and\n");
+	printf("                     fail if a benchmark got slower than the tolerance\n");
+	printf("  --tolerance <pct>  allowed slowdown in percent, default 10\n");
+}
+
+static BOOL parse_uint32(const char* value, UINT32 min, UINT32 max, UINT32* result)
+{
+	char* end = NULL;
+
+	if (!value)
+		return FALSE;
+
+	errno = 0;
+	const unsigned long val = strtoul(value, &end, 10);
+	if ((errno != 0) || (end == value) || (*end != '\0') || (val < min) || (val > max))
+		return FALSE;
+
+	*result = (UINT32)val;
 	return TRUE;
 }
 
-static BOOL primitives_RGB2444_benchmark_run(primitives_YUV_benchmark* bench, primitives_t* prims)
+static BOOL parse_size(const char* value, UINT32* width, UINT32* height)
+{
+	char buffer[32] = { 0 };
+
+	if (!value || (strlen(value) >= sizeof(buffer)))
+		return FALSE;
+
+	strncpy(buffer, value, sizeof(buffer) - 1);
+
+	char* sep = strchr(buffer, 'x');
+	if (!sep)
+		return FALSE;
+
+	*sep++ = '\0';
+	return parse_uint32(buffer, 16, UINT16_MAX, width) && parse_uint32(sep, 16, 8192, height);
+}
+
+static BOOL parse_args(primitives_benchmark_run* run, UINT32* width, UINT32* height, int argc,
+                       char* argv[])
 {
-	for (size_t x = 0; x < 10; x++)
+	for (int x = 1; x < argc; x++)
 	{
-		const UINT64 start = winpr_GetTickCount64NS();
-		pstatus_t status =
-		    prims->RGBToYUV444_8u_P3AC4R(bench->rgbBuffer, bench->testedFormat, bench->outputStride,
-		                                 bench->outputChannels, bench->steps, &bench->roi);
-		const UINT64 end = winpr_GetTickCount64NS();
-		if (status != PRIMITIVES_SUCCESS)
+		const char* arg = argv[x];
+		const char* value = (x + 1 < argc) ? argv[x + 1] : NULL;
+		UINT32 val = 0;
+
+		if (strcmp(arg, "--iterations") == 0)
 		{
-			(void)fprintf(stderr, "Running RGBToYUV444_8u_P3AC4R failed\n");
-			return FALSE;
+			if (!parse_uint32(value, 1, 100000, &val))
+				return FALSE;
+			run->iterations = val;
+		}
+		else if (strcmp(arg, "--size") == 0)
+		{
+			if (!parse_size(value, width, height))
+				return FALSE;
+		}
+		else if (strcmp(arg, "--filter") == 0)
+			run->filter = value;
+		else if (strcmp(arg, "--json") == 0)
+			run->jsonFile = value;
+		else if (strcmp(arg, "--baseline") == 0)
+			run->baselineFile = value;
+		else if (strcmp(arg, "--tolerance") == 0)
+		{
+			if (!parse_uint32(value, 0, 10000, &run->tolerance))
+				return FALSE;
 		}
-		const UINT64 diff = end - start;
-		char buffer[32] = { 0 };
-		printf("[%" PRIuz "] RGBToYUV444_8u_P3AC4R %" PRIu32 "x%" PRIu32 " took %sns\n", x,
-		       bench->roi.width, bench->roi.height, print_time(diff, buffer, sizeof(buffer)));
+		else
+			return FALSE;
+
+		if (!value)
+			return FALSE;
+		x++;
 	}
 
 	return TRUE;
@@ -200,53 +1520,77 @@ static BOOL primitives_RGB2444_benchmark_run(primitives_YUV_benchmark* bench, pr
 
 int main(int argc, char* argv[])
 {
-	WINPR_UNUSED(argc);
-	WINPR_UNUSED(argv);
-	primitives_YUV_benchmark bench = primitives_YUV_benchmark_init();
+	int rc = -1;
+	UINT32 width = 3840;
+	UINT32 height = 2160;
+	const primitives_t* tested[PRIMITIVES_AUTODETECT] = { 0 };
+	primitives_benchmark bench = { 0 };
+	primitives_benchmark_run run = { 0 };
+
+	run.iterations = 10;
+	run.tolerance = 10;
+
+	if (!parse_args(&run, &width, &height, argc, argv))
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	if (!primitives_benchmark_init(&bench, width, height))
+	{
+		(void)fprintf(stderr, "failed to allocate the benchmark data\n");
+		goto fail;
+	}
 
 	for (primitive_hints hint = PRIMITIVES_PURE_SOFT; hint < PRIMITIVES_AUTODETECT; hint++)
 	{
 		const char* hintstr = primtives_hint_str(hint);
-		primitives_t* prim = primitives_get_by_type(hint);
+		const primitives_t* prim = primitives_get_by_type(hint);
+		BOOL duplicate = FALSE;
+
 		if (!prim)
 		{
 			(void)fprintf(stderr, "failed to get primitives: %s\n", hintstr);
 			goto fail;
 		}
 
-		printf("Running YUV420 -> RGB benchmark on %s implementation:\n", hintstr);
-		if (!primitives_YUV420_benchmark_run(&bench, prim))
-		{
-			(void)fprintf(stderr, "YUV420 -> RGB benchmark failed\n");
-			goto fail;
-		}
-		printf("\n");
+		/* without OpenCL the GPU primitives are the CPU ones */
+		for (primitive_hints x = PRIMITIVES_PURE_SOFT; x < hint; x++)
+			duplicate |= (tested[x] == prim);
 
-		printf("Running RGB -> YUV420 benchmark on %s implementation:\n", hintstr);
-		if (!primitives_RGB2420_benchmark_run(&bench, prim))
+		tested[hint] = prim;
+
+		if (duplicate)
 		{
-			(void)fprintf(stderr, "RGB -> YUV420 benchmark failed\n");
-			goto fail;
+			printf("%s is the same implementation as a previous one, skipping\n", hintstr);
+			continue;
 		}
-		printf("\n");
 
-		printf("Running YUV444 -> RGB benchmark on %s implementation:\n", hintstr);
-		if (!primitives_YUV444_benchmark_run(&bench, prim))
+		for (size_t x = 0; x < ARRAYSIZE(primitives_benchmarks); x++)
 		{
-			(void)fprintf(stderr, "YUV444 -> RGB benchmark failed\n");
-			goto fail;
+			if (!primitives_benchmark_run_entry(&run, &bench, prim, hintstr,
+			                                    &primitives_benchmarks[x]))
+				goto fail;
 		}
-		printf("\n");
+	}
 
-		printf("Running RGB -> YUV444 benchmark on %s implementation:\n", hintstr);
-		if (!primitives_RGB2444_benchmark_run(&bench, prim))
-		{
-			(void)fprintf(stderr, "RGB -> YUV444 benchmark failed\n");
+	for (size_t x = 0; x < ARRAYSIZE(codec_benchmarks); x++)
+	{
+		if (!primitives_benchmark_run_entry(&run, &bench, primitives_get(),
+		                                    primtives_hint_str(PRIMITIVES_AUTODETECT),
+		                                    &codec_benchmarks[x]))
 			goto fail;
-		}
-		printf("\n");
 	}
+
+	if (run.jsonFile && !primitives_benchmark_write_json(&run))
+		goto fail;
+
+	if (run.baselineFile && !primitives_benchmark_compare_baseline(&run))
+		goto fail;
+
+	rc = 0;
 fail:
-	primitives_YUV_benchmark_free(&bench);
-	return 0;
+	free(run.results);
+	primitives_benchmark_free(&bench);
+	return rc;
 }
@@ -0,0 +1,144 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Optimized tile compare
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <string.h>
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+#include <winpr/sysinfo.h>
+
+#include "prim_internal.h"
+#include "prim_compare.h"
+
+#if defined(NEON_INTRINSICS_ENABLED)
+#include <arm_neon.h>
+
+static primitives_t* generic = NULL;
+
+static INLINE BOOL neon_compare_line(const BYTE* WINPR_RESTRICT pSrc1,
+                                     const BYTE* WINPR_RESTRICT pSrc2, size_t bytes, uint8x16_t mask)
+{
+	uint8x16_t acc = vdupq_n_u8(0);
+
+	for (size_t x = 0; x < bytes; x += 16)
+	{
+		const uint8x16_t a = vld1q_u8(&pSrc1[x]);
+		const uint8x16_t b = vld1q_u8(&pSrc2[x]);
+		acc = vorrq_u8(acc, veorq_u8(a, b));
+	}
+
+	const uint64x2_t acc64 = vreinterpretq_u64_u8(vandq_u8(acc, mask));
+	return (vgetq_lane_u64(acc64, 0) | vgetq_lane_u64(acc64, 1)) == 0;
+}
+
+static pstatus_t neon_compare_tiles(const BYTE* WINPR_RESTRICT pSrc1, DWORD format1,
+                                    UINT32 src1Step, const BYTE* WINPR_RESTRICT pSrc2,
+                                    DWORD format2, UINT32 src2Step, UINT32 width, UINT32 height,
+                                    BYTE* WINPR_RESTRICT pTiles, UINT32 tilesStep,
+                                    UINT32* WINPR_RESTRICT pDirty)
+{
+	prim_compare_t cmp = { 0 };
+	BYTE maskBytes[16] = { 0 };
+
+	if (!generic_compare_check_args(pSrc1, pSrc2, width, pTiles, tilesStep))
+		return -1;
+
+	if (!generic_compare_init(&cmp, format1, format2))
+		return -1;
+
+	if (cmp.same)
+		memset(maskBytes, 0xFF, sizeof(maskBytes));
+	else if (cmp.rgb32 && (memcmp(cmp.pos1, cmp.pos2, sizeof(cmp.pos1)) == 0))
+	{
+		for (size_t x = 0; x < sizeof(maskBytes); x += 4)
+		{
+			maskBytes[x + cmp.pos1[0]] = 0xFF;
+			maskBytes[x + cmp.pos1[1]] = 0xFF;
+			maskBytes[x + cmp.pos1[2]] = 0xFF;
+		}
+	}
+	else
+		return generic->compare_tiles(pSrc1, format1, src1Step, pSrc2, format2, src2Step, width,
+		                              height, pTiles, tilesStep, pDirty);
+
+	const uint8x16_t mask = vld1q_u8(maskBytes);
+	const size_t tileBytes = 1ull * PRIM_COMPARE_TILE_SIZE * cmp.bpp1;
+	const UINT32 nrow = (height + PRIM_COMPARE_TILE_SIZE - 1) / PRIM_COMPARE_TILE_SIZE;
+	const UINT32 ncol = (width + PRIM_COMPARE_TILE_SIZE - 1) / PRIM_COMPARE_TILE_SIZE;
+	UINT32 dirty = 0;
+
+	for (UINT32 ty = 0; ty < nrow; ty++)
+	{
+		BYTE* tiles = &pTiles[1ull * ty * tilesStep];
+		const UINT32 th = MIN(PRIM_COMPARE_TILE_SIZE, height - ty * PRIM_COMPARE_TILE_SIZE);
+
+		memset(tiles, 0, ncol);
+
+		for (UINT32 y = 0; y < th; y++)
+		{
+			const size_t line = 1ull * ty * PRIM_COMPARE_TILE_SIZE + y;
+			const BYTE* line1 = &pSrc1[line * src1Step];
+			const BYTE* line2 = &pSrc2[line * src2Step];
+
+			for (UINT32 tx = 0; tx < ncol; tx++)
+			{
+				const size_t x = 1ull * tx * PRIM_COMPARE_TILE_SIZE;
+				const UINT32 tw = MIN(PRIM_COMPARE_TILE_SIZE, width - (UINT32)x);
+				const BYTE* p1 = &line1[x * cmp.bpp1];
+				const BYTE* p2 = &line2[x * cmp.bpp2];
+
+				if (tiles[tx])
+					continue;
+
+				if (tw == PRIM_COMPARE_TILE_SIZE)
+				{
+					if (!neon_compare_line(p1, p2, tileBytes, mask))
+						tiles[tx] = 1;
+				}
+				else if (!generic_compare_pixels(&cmp, p1, p2, tw))
+					tiles[tx] = 1;
+			}
+		}
+
+		for (UINT32 tx = 0; tx < ncol; tx++)
+			dirty += tiles[tx];
+	}
+
+	if (pDirty)
+		*pDirty = dirty;
+
+	return PRIMITIVES_SUCCESS;
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_compare_neon(primitives_t* WINPR_RESTRICT prims)
+{
+#if defined(NEON_INTRINSICS_ENABLED)
+	generic = primitives_get_generic();
+
+	if (IsProcessorFeaturePresent(PF_ARM_NEON_INSTRUCTIONS_AVAILABLE))
+	{
+		WLog_VRB(PRIM_TAG, "NEON optimizations");
+		prims->compare_tiles = neon_compare_tiles;
+	}
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or neon intrinsics not available");
+	WINPR_UNUSED(prims);
+#endif
+}
@@ -0,0 +1,207 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Primitives tile compare
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <string.h>
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+#include <freerdp/codec/color.h>
+
+#include "prim_internal.h"
+#include "prim_compare.h"
+
+static BOOL compare_get_layout(DWORD format, BYTE pos[3])
+{
+	/* pixel formats are named by byte position in memory */
+	switch (format)
+	{
+		case PIXEL_FORMAT_ARGB32:
+		case PIXEL_FORMAT_XRGB32:
+			pos[0] = 1;
+			pos[1] = 2;
+			pos[2] = 3;
+			return TRUE;
+		case PIXEL_FORMAT_ABGR32:
+		case PIXEL_FORMAT_XBGR32:
+			pos[0] = 3;
+			pos[1] = 2;
+			pos[2] = 1;
+			return TRUE;
+		case PIXEL_FORMAT_RGBA32:
+		case PIXEL_FORMAT_RGBX32:
+			pos[0] = 0;
+			pos[1] = 1;
+			pos[2] = 2;
+			return TRUE;
+		case PIXEL_FORMAT_BGRA32:
+		case PIXEL_FORMAT_BGRX32:
+			pos[0] = 2;
+			pos[1] = 1;
+			pos[2] = 0;
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+BOOL generic_compare_init(prim_compare_t* WINPR_RESTRICT cmp, DWORD format1, DWORD format2)
+{
+	WINPR_ASSERT(cmp);
+
+	const prim_compare_t empty = { 0 };
+	*cmp = empty;
+	cmp->format1 = format1;
+	cmp->format2 = format2;
+	cmp->bpp1 = FreeRDPGetBytesPerPixel(format1);
+	cmp->bpp2 = FreeRDPGetBytesPerPixel(format2);
+
+	if ((cmp->bpp1 == 0) || (cmp->bpp2 == 0))
+		return FALSE;
+
+	cmp->same = (format1 == format2);
+
+	if (!cmp->same)
+		cmp->rgb32 = compare_get_layout(format1, cmp->pos1) && compare_get_layout(format2, cmp->pos2);
+
+	return TRUE;
+}
+
+BOOL generic_compare_pixels(const prim_compare_t* WINPR_RESTRICT cmp,
+                            const BYTE* WINPR_RESTRICT pSrc1, const BYTE* WINPR_RESTRICT pSrc2,
+                            UINT32 count)
+{
+	WINPR_ASSERT(cmp);
+
+	if (cmp->same)
+		return memcmp(pSrc1, pSrc2, 1ull * count * cmp->bpp1) == 0;
+
+	if (cmp->rgb32)
+	{
+		for (UINT32 x = 0; x < count; x++)
+		{
+			const BYTE* a = &pSrc1[4ull * x];
+			const BYTE* b = &pSrc2[4ull * x];
+
+			if ((a[cmp->pos1[0]] != b[cmp->pos2[0]]) || (a[cmp->pos1[1]] != b[cmp->pos2[1]]) ||
+			    (a[cmp->pos1[2]] != b[cmp->pos2[2]]))
+				return FALSE;
+		}
+
+		return TRUE;
+	}
+
+	for (UINT32 x = 0; x < count; x++)
+	{
+		BYTE ar = 0;
+		BYTE ag = 0;
+		BYTE ab = 0;
+		BYTE br = 0;
+		BYTE bg = 0;
+		BYTE bb = 0;
+		const UINT32 colorA = FreeRDPReadColor(&pSrc1[1ull * cmp->bpp1 * x], cmp->format1);
+		const UINT32 colorB = FreeRDPReadColor(&pSrc2[1ull * cmp->bpp2 * x], cmp->format2);
+		FreeRDPSplitColor(colorA, cmp->format1, &ar, &ag, &ab, NULL, NULL);
+		FreeRDPSplitColor(colorB, cmp->format2, &br, &bg, &bb, NULL, NULL);
+
+		if ((ar != br) || (ag != bg) || (ab != bb))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+BOOL generic_compare_check_args(const BYTE* pSrc1, const BYTE* pSrc2, UINT32 width,
+                                BYTE* pTiles, UINT32 tilesStep)
+{
+	if (!pSrc1 || !pSrc2 || !pTiles)
+		return FALSE;
+
+	return tilesStep >= (width + PRIM_COMPARE_TILE_SIZE - 1) / PRIM_COMPARE_TILE_SIZE;
+}
+
+/* ------------------------------------------------------------------------- */
+static pstatus_t general_compare_tiles(const BYTE* WINPR_RESTRICT pSrc1, DWORD format1,
+                                       UINT32 src1Step, const BYTE* WINPR_RESTRICT pSrc2,
+                                       DWORD format2, UINT32 src2Step, UINT32 width,
+                                       UINT32 height, BYTE* WINPR_RESTRICT pTiles,
+                                       UINT32 tilesStep, UINT32* WINPR_RESTRICT pDirty)
+{
+	prim_compare_t cmp = { 0 };
+
+	if (!generic_compare_check_args(pSrc1, pSrc2, width, pTiles, tilesStep))
+		return -1;
+
+	if (!generic_compare_init(&cmp, format1, format2))
+		return -1;
+
+	const UINT32 nrow = (height + PRIM_COMPARE_TILE_SIZE - 1) / PRIM_COMPARE_TILE_SIZE;
+	const UINT32 ncol = (width + PRIM_COMPARE_TILE_SIZE - 1) / PRIM_COMPARE_TILE_SIZE;
+	UINT32 dirty = 0;
+
+	for (UINT32 ty = 0; ty < nrow; ty++)
+	{
+		BYTE* tiles = &pTiles[1ull * ty * tilesStep];
+		const UINT32 th = MIN(PRIM_COMPARE_TILE_SIZE, height - ty * PRIM_COMPARE_TILE_SIZE);
+
+		memset(tiles, 0, ncol);
+
+		/* walk the lines so memory is read sequentially, skip tiles already known to differ */
+		for (UINT32 y = 0; y < th; y++)
+		{
+			const size_t line = 1ull * ty * PRIM_COMPARE_TILE_SIZE + y;
+			const BYTE* line1 = &pSrc1[line * src1Step];
+			const BYTE* line2 = &pSrc2[line * src2Step];
+
+			for (UINT32 tx = 0; tx < ncol; tx++)
+			{
+				const size_t x = 1ull * tx * PRIM_COMPARE_TILE_SIZE;
+				const UINT32 tw = MIN(PRIM_COMPARE_TILE_SIZE, width - (UINT32)x);
+
+				if (tiles[tx])
+					continue;
+
+				if (!generic_compare_pixels(&cmp, &line1[x * cmp.bpp1], &line2[x * cmp.bpp2], tw))
+					tiles[tx] = 1;
+			}
+		}
+
+		for (UINT32 tx = 0; tx < ncol; tx++)
+			dirty += tiles[tx];
+	}
+
+	if (pDirty)
+		*pDirty = dirty;
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_compare(primitives_t* WINPR_RESTRICT prims)
+{
+	prims->compare_tiles = general_compare_tiles;
+}
+
+void primitives_init_compare_opt(primitives_t* WINPR_RESTRICT prims)
+{
+	primitives_init_compare_sse2(prims);
+	primitives_init_compare_neon(prims);
+#if defined(WITH_AVX2)
+	primitives_init_compare_avx2(prims);
+#endif
+}
@@ -0,0 +1,55 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Primitives tile compare
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_PRIM_COMPARE_H
+#define FREERDP_LIB_PRIM_COMPARE_H
+
+#include <winpr/wtypes.h>
+#include <freerdp/config.h>
+#include <freerdp/primitives.h>
+
+#define PRIM_COMPARE_TILE_SIZE 16
+
+typedef struct
+{
+	DWORD format1;
+	DWORD format2;
+	UINT32 bpp1; /* bytes per pixel */
+	UINT32 bpp2;
+	BOOL same;   /* identical formats, compare bytes */
+	BOOL rgb32;  /* both 32bpp with 8 bit channels, pos1 and pos2 are valid */
+	BYTE pos1[3]; /* byte offset of red, green and blue in a pixel */
+	BYTE pos2[3];
+} prim_compare_t;
+
+BOOL generic_compare_init(prim_compare_t* WINPR_RESTRICT cmp, DWORD format1, DWORD format2);
+
+BOOL generic_compare_pixels(const prim_compare_t* WINPR_RESTRICT cmp,
+                            const BYTE* WINPR_RESTRICT pSrc1, const BYTE* WINPR_RESTRICT pSrc2,
+                            UINT32 count);
+
+BOOL generic_compare_check_args(const BYTE* pSrc1, const BYTE* pSrc2, UINT32 width,
+                                BYTE* pTiles, UINT32 tilesStep);
+
+void primitives_init_compare_sse2(primitives_t* WINPR_RESTRICT prims);
+void primitives_init_compare_neon(primitives_t* WINPR_RESTRICT prims);
+
+#if defined(WITH_AVX2)
+void primitives_init_compare_avx2(primitives_t* WINPR_RESTRICT prims);
+#endif
+
+#endif
@@ -0,0 +1,184 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Optimized tile compare
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <string.h>
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+#include <winpr/sysinfo.h>
+
+#include "prim_internal.h"
+#include "prim_compare.h"
+
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+#include <immintrin.h>
+
+static primitives_t* generic = NULL;
+
+static INLINE BOOL avx2_compare_line(const BYTE* WINPR_RESTRICT pSrc1,
+                                     const BYTE* WINPR_RESTRICT pSrc2, size_t bytes, __m256i mask)
+{
+	__m256i acc = _mm256_setzero_si256();
+	size_t x = 0;
+
+	for (; x + 32 <= bytes; x += 32)
+	{
+		const __m256i a = _mm256_loadu_si256((const __m256i*)&pSrc1[x]);
+		const __m256i b = _mm256_loadu_si256((const __m256i*)&pSrc2[x]);
+		acc = _mm256_or_si256(acc, _mm256_xor_si256(a, b));
+	}
+
+	/* tiles of 24 or 8 bpp formats are a multiple of 16 bytes only */
+	if (x < bytes)
+	{
+		const __m128i a = _mm_loadu_si128((const __m128i*)&pSrc1[x]);
+		const __m128i b = _mm_loadu_si128((const __m128i*)&pSrc2[x]);
+		acc = _mm256_or_si256(
+		    acc, _mm256_inserti128_si256(_mm256_setzero_si256(), _mm_xor_si128(a, b), 0));
+	}
+
+	return _mm256_testz_si256(acc, mask);
+}
+
+static INLINE BOOL avx2_compare_line_shuffle(const BYTE* WINPR_RESTRICT pSrc1,
+                                             const BYTE* WINPR_RESTRICT pSrc2, size_t bytes,
+                                             __m256i shuffle, __m256i mask)
+{
+	__m256i acc = _mm256_setzero_si256();
+
+	for (size_t x = 0; x < bytes; x += 32)
+	{
+		const __m256i a = _mm256_loadu_si256((const __m256i*)&pSrc1[x]);
+		const __m256i b = _mm256_loadu_si256((const __m256i*)&pSrc2[x]);
+		acc = _mm256_or_si256(acc, _mm256_xor_si256(a, _mm256_shuffle_epi8(b, shuffle)));
+	}
+
+	return _mm256_testz_si256(acc, mask);
+}
+
+static pstatus_t avx2_compare_tiles(const BYTE* WINPR_RESTRICT pSrc1, DWORD format1,
+                                    UINT32 src1Step, const BYTE* WINPR_RESTRICT pSrc2,
+                                    DWORD format2, UINT32 src2Step, UINT32 width, UINT32 height,
+                                    BYTE* WINPR_RESTRICT pTiles, UINT32 tilesStep,
+                                    UINT32* WINPR_RESTRICT pDirty)
+{
+	prim_compare_t cmp = { 0 };
+	BYTE maskBytes[32] = { 0 };
+	BYTE shuffleBytes[32] = { 0 };
+	BOOL doShuffle = FALSE;
+
+	if (!generic_compare_check_args(pSrc1, pSrc2, width, pTiles, tilesStep))
+		return -1;
+
+	if (!generic_compare_init(&cmp, format1, format2))
+		return -1;
+
+	if (cmp.same)
+		memset(maskBytes, 0xFF, sizeof(maskBytes));
+	else if (cmp.rgb32)
+	{
+		/* move the channels of the second image to the positions of the first one, the shuffle
+		 * works per 128 bit lane so the indices repeat every 16 bytes */
+		memset(shuffleBytes, 0x80, sizeof(shuffleBytes));
+
+		for (size_t x = 0; x < sizeof(maskBytes); x += 4)
+		{
+			for (size_t c = 0; c < 3; c++)
+			{
+				maskBytes[x + cmp.pos1[c]] = 0xFF;
+				shuffleBytes[x + cmp.pos1[c]] = (BYTE)((x % 16) + cmp.pos2[c]);
+			}
+		}
+
+		doShuffle = (memcmp(cmp.pos1, cmp.pos2, sizeof(cmp.pos1)) != 0);
+	}
+	else
+		return generic->compare_tiles(pSrc1, format1, src1Step, pSrc2, format2, src2Step, width,
+		                              height, pTiles, tilesStep, pDirty);
+
+	const __m256i mask = _mm256_loadu_si256((const __m256i*)maskBytes);
+	const __m256i shuffle = _mm256_loadu_si256((const __m256i*)shuffleBytes);
+	const size_t tileBytes = 1ull * PRIM_COMPARE_TILE_SIZE * cmp.bpp1;
+	const UINT32 nrow = (height + PRIM_COMPARE_TILE_SIZE - 1) / PRIM_COMPARE_TILE_SIZE;
+	const UINT32 ncol = (width + PRIM_COMPARE_TILE_SIZE - 1) / PRIM_COMPARE_TILE_SIZE;
+	UINT32 dirty = 0;
+
+	for (UINT32 ty = 0; ty < nrow; ty++)
+	{
+		BYTE* tiles = &pTiles[1ull * ty * tilesStep];
+		const UINT32 th = MIN(PRIM_COMPARE_TILE_SIZE, height - ty * PRIM_COMPARE_TILE_SIZE);
+
+		memset(tiles, 0, ncol);
+
+		for (UINT32 y = 0; y < th; y++)
+		{
+			const size_t line = 1ull * ty * PRIM_COMPARE_TILE_SIZE + y;
+			const BYTE* line1 = &pSrc1[line * src1Step];
+			const BYTE* line2 = &pSrc2[line * src2Step];
+
+			for (UINT32 tx = 0; tx < ncol; tx++)
+			{
+				const size_t x = 1ull * tx * PRIM_COMPARE_TILE_SIZE;
+				const UINT32 tw = MIN(PRIM_COMPARE_TILE_SIZE, width - (UINT32)x);
+				const BYTE* p1 = &line1[x * cmp.bpp1];
+				const BYTE* p2 = &line2[x * cmp.bpp2];
+				BOOL equal = FALSE;
+
+				if (tiles[tx])
+					continue;
+
+				if (tw != PRIM_COMPARE_TILE_SIZE)
+					equal = generic_compare_pixels(&cmp, p1, p2, tw);
+				else if (doShuffle)
+					equal = avx2_compare_line_shuffle(p1, p2, tileBytes, shuffle, mask);
+				else
+					equal = avx2_compare_line(p1, p2, tileBytes, mask);
+
+				if (!equal)
+					tiles[tx] = 1;
+			}
+		}
+
+		for (UINT32 tx = 0; tx < ncol; tx++)
+			dirty += tiles[tx];
+	}
+
+	if (pDirty)
+		*pDirty = dirty;
+
+	return PRIMITIVES_SUCCESS;
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_compare_avx2(primitives_t* WINPR_RESTRICT prims)
+{
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+	generic = primitives_get_generic();
+
+	if (IsProcessorFeaturePresent(PF_AVX2_INSTRUCTIONS_AVAILABLE))
+	{
+		WLog_VRB(PRIM_TAG, "AVX2 optimizations");
+		prims->compare_tiles = avx2_compare_tiles;
+	}
+
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or WITH_AVX2 or AVX2 intrinsics not available");
+	WINPR_UNUSED(prims);
+#endif
+}
@@ -0,0 +1,222 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Tile compare primitive tests
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <winpr/sysinfo.h>
+#include <freerdp/codec/color.h>
+
+#include "prim_test.h"
+
+#define TEST_WIDTH 197
+#define TEST_HEIGHT 77
+#define TEST_COLS ((TEST_WIDTH + 15) / 16)
+#define TEST_ROWS ((TEST_HEIGHT + 15) / 16)
+#define TEST_TILES_STEP (TEST_COLS + 3)
+
+typedef struct
+{
+	UINT32 x;
+	UINT32 y;
+} test_point_t;
+
+static const test_point_t changes[] = { { 0, 0 },   { 15, 0 },   { 16, 17 }, { 100, 31 },
+	                                    { 101, 31 }, { 196, 40 }, { 50, 76 }, { 196, 76 } };
+
+static BOOL test_compare_tiles_impl(const char* name, __compare_tiles_t fkt, const BYTE* src1,
+                                    DWORD format1, UINT32 step1, const BYTE* src2, DWORD format2,
+                                    UINT32 step2, const BYTE* expect, UINT32 expectDirty)
+{
+	BYTE tiles[TEST_TILES_STEP * TEST_ROWS];
+	UINT32 dirty = 0;
+
+	memset(tiles, 0xCC, sizeof(tiles));
+
+	const pstatus_t status = fkt(src1, format1, step1, src2, format2, step2, TEST_WIDTH,
+	                             TEST_HEIGHT, tiles, TEST_TILES_STEP, &dirty);
+	if (status != PRIMITIVES_SUCCESS)
+	{
+		printf("%s [%s/%s] failed with %" PRId32 "\n", name, FreeRDPGetColorFormatName(format1),
+		       FreeRDPGetColorFormatName(format2), status);
+		return FALSE;
+	}
+
+	if (dirty != expectDirty)
+	{
+		printf("%s [%s/%s] reported %" PRIu32 " dirty tiles, expected %" PRIu32 "\n", name,
+		       FreeRDPGetColorFormatName(format1), FreeRDPGetColorFormatName(format2), dirty,
+		       expectDirty);
+		return FALSE;
+	}
+
+	for (UINT32 ty = 0; ty < TEST_ROWS; ty++)
+	{
+		for (UINT32 tx = 0; tx < TEST_TILES_STEP; tx++)
+		{
+			const BYTE want = (tx < TEST_COLS) ? expect[ty * TEST_COLS + tx] : 0xCC;
+			const BYTE got = tiles[ty * TEST_TILES_STEP + tx];
+
+			if (want != got)
+			{
+				printf("%s [%s/%s] tile %" PRIu32 "x%" PRIu32 " is %" PRIu8 ", expected %" PRIu8
+				       "\n",
+				       name, FreeRDPGetColorFormatName(format1),
+				       FreeRDPGetColorFormatName(format2), tx, ty, got, want);
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+static BOOL test_compare_tiles_format(DWORD format1, DWORD format2)
+{
+	BOOL rc = FALSE;
+	BYTE expect[TEST_COLS * TEST_ROWS] = { 0 };
+	const UINT32 bpp1 = FreeRDPGetBytesPerPixel(format1);
+	const UINT32 bpp2 = FreeRDPGetBytesPerPixel(format2);
+	const UINT32 step1 = TEST_WIDTH * bpp1 + 13;
+	const UINT32 step2 = TEST_WIDTH * bpp2 + 64;
+	BYTE* src1 = calloc(TEST_HEIGHT, step1);
+	BYTE* src2 = calloc(TEST_HEIGHT, step2);
+
+	if (!src1 || !src2)
+		goto fail;
+
+	winpr_RAND(src1, 1ull * TEST_HEIGHT * step1);
+
+	if (!freerdp_image_copy_no_overlap(src2, format2, step2, 0, 0, TEST_WIDTH, TEST_HEIGHT, src1,
+	                                   format1, step1, 0, 0, NULL, FREERDP_FLIP_NONE))
+		goto fail;
+
+	if (!test_compare_tiles_impl("generic", generic->compare_tiles, src1, format1, step1, src2,
+	                             format2, step2, expect, 0))
+		goto fail;
+	if (!test_compare_tiles_impl("optimized", optimized->compare_tiles, src1, format1, step1,
+	                             src2, format2, step2, expect, 0))
+		goto fail;
+
+	UINT32 expectDirty = 0;
+	for (size_t i = 0; i < ARRAYSIZE(changes); i++)
+	{
+		const test_point_t* pt = &changes[i];
+		BYTE* dst = &src2[1ull * pt->y * step2 + 1ull * pt->x * bpp2];
+		BYTE r = 0;
+		BYTE g = 0;
+		BYTE b = 0;
+		BYTE a = 0;
+
+		FreeRDPSplitColor(FreeRDPReadColor(dst, format2), format2, &r, &g, &b, &a, NULL);
+		if (!FreeRDPWriteColor(dst, format2, FreeRDPGetColor(format2, r ^ 0x80, g, b, a)))
+			goto fail;
+
+		BYTE* tile = &expect[(pt->y / 16) * TEST_COLS + (pt->x / 16)];
+		if (!*tile)
+			expectDirty++;
+		*tile = 1;
+	}
+
+	if (!test_compare_tiles_impl("generic", generic->compare_tiles, src1, format1, step1, src2,
+	                             format2, step2, expect, expectDirty))
+		goto fail;
+	if (!test_compare_tiles_impl("optimized", optimized->compare_tiles, src1, format1, step1,
+	                             src2, format2, step2, expect, expectDirty))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	free(src1);
+	free(src2);
+	return rc;
+}
+
+static BOOL test_compare_tiles_func(void)
+{
+	const DWORD formats[][2] = { { PIXEL_FORMAT_BGRX32, PIXEL_FORMAT_BGRX32 },
+		                         { PIXEL_FORMAT_BGRA32, PIXEL_FORMAT_BGRX32 },
+		                         { PIXEL_FORMAT_BGRX32, PIXEL_FORMAT_RGBX32 },
+		                         { PIXEL_FORMAT_ARGB32, PIXEL_FORMAT_BGRA32 },
+		                         { PIXEL_FORMAT_BGRX32, PIXEL_FORMAT_BGR24 },
+		                         { PIXEL_FORMAT_RGB24, PIXEL_FORMAT_RGB24 },
+		                         { PIXEL_FORMAT_RGB16, PIXEL_FORMAT_RGB16 } };
+
+	for (size_t i = 0; i < ARRAYSIZE(formats); i++)
+	{
+		if (!test_compare_tiles_format(formats[i][0], formats[i][1]))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* ------------------------------------------------------------------------- */
+static BOOL test_compare_tiles_speed(void)
+{
+	BOOL rc = FALSE;
+	const UINT32 width = 1920;
+	const UINT32 height = 1080;
+	const UINT32 step = width * 4;
+	const UINT32 tilesStep = (width + 15) / 16;
+	BYTE* src1 = calloc(height, step);
+	BYTE* src2 = calloc(height, step);
+	BYTE* tiles = calloc((height + 15) / 16, tilesStep);
+	UINT32 dirty = 0;
+
+	if (!src1 || !src2 || !tiles)
+		goto fail;
+
+	winpr_RAND(src1, 1ull * height * step);
+	memcpy(src2, src1, 1ull * height * step);
+
+	if (!speed_test("compare_tiles", "BGRX32", g_Iterations / 10,
+	                (speed_test_fkt)generic->compare_tiles,
+	                (speed_test_fkt)optimized->compare_tiles, src1, PIXEL_FORMAT_BGRX32, step, src2,
+	                PIXEL_FORMAT_BGRX32, step, width, height, tiles, tilesStep, &dirty))
+		goto fail;
+	if (!speed_test("compare_tiles", "BGRX32/RGBX32", g_Iterations / 10,
+	                (speed_test_fkt)generic->compare_tiles,
+	                (speed_test_fkt)optimized->compare_tiles, src1, PIXEL_FORMAT_BGRX32, step, src2,
+	                PIXEL_FORMAT_RGBX32, step, width, height, tiles, tilesStep, &dirty))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	free(src1);
+	free(src2);
+	free(tiles);
+	return rc;
+}
+
+int TestPrimitivesCompare(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	prim_test_setup(FALSE);
+
+	if (!test_compare_tiles_func())
+		return -1;
+
+	if (g_TestPrimitivesPerformance)
+	{
+		if (!test_compare_tiles_speed())
+			return -1;
+	}
+
+	return 0;
+}
@@ -48,6 +48,9 @@
 
 #define TAG SERVER_TAG("shadow.x11")
 
+/* Damage regions with more rectangles are fetched as one bounding box */
+#define X11_SHADOW_MAX_DAMAGE_RECTS 32
+
 static UINT32 x11_shadow_enum_monitors(MONITOR_DEF* monitors, UINT32 maxMonitors);
 
 #ifdef WITH_PAM
@@ -738,6 +741,7 @@ static BOOL x11_shadow_check_resize(x11ShadowSubsystem* subsystem)
 		virtualScreen->right = attr.width - 1;
 		virtualScreen->bottom = attr.height - 1;
 		virtualScreen->flags = 1;
+		subsystem->full_capture = TRUE;
 		return TRUE;
 	}
 
@@ -760,27 +764,233 @@ static int x11_shadow_error_handler_for_capture(Display* display, XErrorEvent* e
 	return 0;
 }
 
+/**
+ * Collect the screen area that needs to be compared in surface coordinates.
+ * Uses the XDamage region when available, the whole surface otherwise.
+ */
+static BOOL x11_shadow_get_damage(x11ShadowSubsystem* subsystem, const rdpShadowSurface* surface,
+                                  const RECTANGLE_16* surfaceRect, REGION16* damage)
+{
+#if defined(WITH_XDAMAGE) && defined(WITH_XFIXES)
+	if (subsystem->use_xdamage)
+	{
+		/*
+		 * With a compositing manager the root window might miss damage of redirected
+		 * windows, so the whole screen is verified once per second.
+		 */
+		if (subsystem->composite &&
+		    (++subsystem->damage_frames >= subsystem->common.captureFrameRate))
+			subsystem->full_capture = TRUE;
+
+		if (!subsystem->full_capture)
+		{
+			int count = 0;
+			XLockDisplay(subsystem->display);
+			XDamageSubtract(subsystem->display, subsystem->xdamage, None,
+			                subsystem->xdamage_region);
+			XRectangle* rects =
+			    XFixesFetchRegion(subsystem->display, subsystem->xdamage_region, &count);
+			XUnlockDisplay(subsystem->display);
+
+			if (count > X11_SHADOW_MAX_DAMAGE_RECTS)
+			{
+				/* Too many rectangles, the bounding box is cheaper to fetch */
+				INT64 left = INT64_MAX;
+				INT64 top = INT64_MAX;
+				INT64 right = INT64_MIN;
+				INT64 bottom = INT64_MIN;
+
+				for (int i = 0; i < count; i++)
+				{
+					left = MIN(left, rects[i].x);
+					top = MIN(top, rects[i].y);
+					right = MAX(right, rects[i].x + rects[i].width);
+					bottom = MAX(bottom, rects[i].y + rects[i].height);
+				}
+
+				rects[0].x = WINPR_ASSERTING_INT_CAST(short, left);
+				rects[0].y = WINPR_ASSERTING_INT_CAST(short, top);
+				rects[0].width = WINPR_ASSERTING_INT_CAST(unsigned short, right - left);
+				rects[0].height = WINPR_ASSERTING_INT_CAST(unsigned short, bottom - top);
+				count = 1;
+			}
+
+			for (int i = 0; i < count; i++)
+			{
+				/* Damage is reported in root window coordinates */
+				const INT64 left = MAX(0, (INT64)rects[i].x - surface->x);
+				const INT64 top = MAX(0, (INT64)rects[i].y - surface->y);
+				const INT64 right =
+				    MIN(surfaceRect->right, (INT64)rects[i].x + rects[i].width - surface->x);
+				const INT64 bottom =
+				    MIN(surfaceRect->bottom, (INT64)rects[i].y + rects[i].height - surface->y);
+				RECTANGLE_16 rect = { 0 };
+
+				if ((left >= right) || (top >= bottom))
+					continue;
+
+				rect.left = (UINT16)left;
+				rect.top = (UINT16)top;
+				rect.right = (UINT16)right;
+				rect.bottom = (UINT16)bottom;
+
+				/* Keep the tiles of the compare on the screen wide 16x16 grid */
+				shadow_capture_align_clip_rect(&rect, surfaceRect);
+				region16_union_rect(damage, damage, &rect);
+			}
+
+			if (rects)
+				XFree(rects);
+
+			return TRUE;
+		}
+
+		/* The whole screen is compared, drop the pending damage */
+		XLockDisplay(subsystem->display);
+		XDamageSubtract(subsystem->display, subsystem->xdamage, None, None);
+		XUnlockDisplay(subsystem->display);
+	}
+#endif
+
+	subsystem->full_capture = FALSE;
+	subsystem->damage_frames = 0;
+	return region16_union_rect(damage, damage, surfaceRect);
+}
+
+/**
+ * Fetch the pixels of a surface area from the X server.
+ *
+ * @return The image holding the pixels or NULL on failure.
+ *         The image must be freed with XDestroyImage unless XShm is used.
+ */
+static XImage* x11_shadow_get_image(x11ShadowSubsystem* subsystem, const rdpShadowSurface* surface,
+                                    const RECTANGLE_16* rect, const BYTE** pData)
+{
+	const UINT32 width = rect->right - rect->left;
+	const UINT32 height = rect->bottom - rect->top;
+	XImage* image = NULL;
+
+#if defined(WITH_XDAMAGE)
+	if (subsystem->use_xshm)
+	{
+		image = subsystem->fb_image;
+		XCopyArea(subsystem->display, subsystem->root_window, subsystem->fb_pixmap,
+		          subsystem->xshm_gc, surface->x + rect->left, surface->y + rect->top, width,
+		          height, rect->left, rect->top);
+		XSync(subsystem->display, False);
+		*pData = (const BYTE*)&image->data[1ull * rect->top * WINPR_ASSERTING_INT_CAST(
+		                                                         UINT32, image->bytes_per_line) +
+		                                   1ull * rect->left *
+		                                       FreeRDPGetBytesPerPixel(subsystem->format)];
+		return image;
+	}
+#endif
+
+	image = XGetImage(subsystem->display, subsystem->root_window, surface->x + rect->left,
+	                  surface->y + rect->top, width, height, AllPlanes, ZPixmap);
+
+	if (image)
+		*pData = (const BYTE*)image->data;
+
+	return image;
+}
+
+/**
+ * Compare a damaged area with the surface and copy the changed tiles.
+ *
+ * @return TRUE on success
+ */
+static BOOL x11_shadow_update_rect(x11ShadowSubsystem* subsystem, rdpShadowSurface* surface,
+                                   const RECTANGLE_16* rect, REGION16* changed)
+{
+	BOOL rc = FALSE;
+	UINT32 numRects = 0;
+	const BYTE* data = NULL;
+	REGION16 tiles = { 0 };
+	XImage* image = x11_shadow_get_image(subsystem, surface, rect, &data);
+
+	if (!image)
+	{
+		/*
+		 * BadMatch error happened. The size may have been changed again.
+		 * Give up this frame and we will resize again in next frame
+		 */
+		return FALSE;
+	}
+
+	const UINT32 step = WINPR_ASSERTING_INT_CAST(UINT32, image->bytes_per_line);
+	const size_t bpp = FreeRDPGetBytesPerPixel(surface->format);
+
+	region16_init(&tiles);
+	EnterCriticalSection(&surface->lock);
+	BYTE* dst = &surface->data[1ull * rect->top * surface->scanline + 1ull * rect->left * bpp];
+	const int status = shadow_capture_compare_region_with_format(
+	    dst, surface->format, surface->scanline, data, subsystem->format, step, rect, &tiles);
+
+	if (status < 0)
+		goto out;
+
+	const RECTANGLE_16* rects = region16_rects(&tiles, &numRects);
+
+	for (UINT32 i = 0; i < numRects; i++)
+	{
+		const RECTANGLE_16* tile = &rects[i];
+
+		if (!freerdp_image_copy_no_overlap(
+		        surface->data, surface->format, surface->scanline, tile->left, tile->top,
+		        tile->right - tile->left, tile->bottom - tile->top, data, subsystem->format, step,
+		        tile->left - rect->left, tile->top - rect->top, NULL, FREERDP_FLIP_NONE))
+			goto out;
+	}
+
+	if (region16_is_empty(changed))
+	{
+		if (!region16_copy(changed, &tiles))
+			goto out;
+	}
+	else
+	{
+		for (UINT32 i = 0; i < numRects; i++)
+		{
+			if (!region16_union_rect(changed, changed, &rects[i]))
+				goto out;
+		}
+	}
+
+	rc = TRUE;
+out:
+	LeaveCriticalSection(&surface->lock);
+	region16_uninit(&tiles);
+
+	if (!subsystem->use_xshm)
+		XDestroyImage(image);
+
+	return rc;
+}
+
 static int x11_shadow_screen_grab(x11ShadowSubsystem* subsystem)
 {
 	int rc = 0;
 	size_t count = 0;
-	int status = -1;
-	int x = 0;
-	int y = 0;
-	int width = 0;
-	int height = 0;
-	XImage* image = NULL;
+	UINT32 numRects = 0;
 	rdpShadowServer* server = NULL;
 	rdpShadowSurface* surface = NULL;
-	RECTANGLE_16 invalidRect;
-	RECTANGLE_16 surfaceRect;
-	const RECTANGLE_16* extents = NULL;
+	RECTANGLE_16 surfaceRect = { 0 };
+	REGION16 damage = { 0 };
+	REGION16 changed = { 0 };
 	server = subsystem->common.server;
 	surface = server->surface;
 	count = ArrayList_Count(server->clients);
 
 	if (count < 1)
+	{
+		/* Nobody watched the changes in the meantime */
+		subsystem->full_capture = TRUE;
 		return 1;
+	}
+
+	region16_init(&damage);
+	region16_init(&changed);
 
 	EnterCriticalSection(&surface->lock);
 	surfaceRect.left = 0;
@@ -790,48 +1000,32 @@ static int x11_shadow_screen_grab(x11ShadowSubsystem* subsystem)
 	surfaceRect.bottom = WINPR_ASSERTING_INT_CAST(UINT16, surface->height);
 	LeaveCriticalSection(&surface->lock);
 
+	if (!x11_shadow_get_damage(subsystem, surface, &surfaceRect, &damage))
+		goto fail;
+
+	if (region16_is_empty(&damage))
+	{
+		/* Nothing was drawn since the last grab */
+		rc = 1;
+		goto fail;
+	}
+
 	XLockDisplay(subsystem->display);
 	/*
 	 * Ignore BadMatch error during image capture. The screen size may be
 	 * changed outside. We will resize to correct resolution at next frame
 	 */
 	XSetErrorHandler(x11_shadow_error_handler_for_capture);
-#if defined(WITH_XDAMAGE)
-	if (subsystem->use_xshm)
-	{
-		image = subsystem->fb_image;
-		XCopyArea(subsystem->display, subsystem->root_window, subsystem->fb_pixmap,
-		          subsystem->xshm_gc, 0, 0, subsystem->width, subsystem->height, 0, 0);
 
-		EnterCriticalSection(&surface->lock);
-		status = shadow_capture_compare_with_format(
-		    surface->data, surface->format, surface->scanline, surface->width, surface->height,
-		    (BYTE*)&(image->data[surface->width * 4ull]), subsystem->format,
-		    WINPR_ASSERTING_INT_CAST(UINT32, image->bytes_per_line), &invalidRect);
-		LeaveCriticalSection(&surface->lock);
-	}
-	else
-#endif
-	{
-		EnterCriticalSection(&surface->lock);
-		image = XGetImage(subsystem->display, subsystem->root_window, surface->x, surface->y,
-		                  surface->width, surface->height, AllPlanes, ZPixmap);
+	const RECTANGLE_16* rects = region16_rects(&damage, &numRects);
 
-		if (image)
-		{
-			status = shadow_capture_compare_with_format(
-			    surface->data, surface->format, surface->scanline, surface->width, surface->height,
-			    (BYTE*)image->data, subsystem->format,
-			    WINPR_ASSERTING_INT_CAST(UINT32, image->bytes_per_line), &invalidRect);
-		}
-		LeaveCriticalSection(&surface->lock);
-		if (!image)
+	for (UINT32 i = 0; i < numRects; i++)
+	{
+		if (!x11_shadow_update_rect(subsystem, surface, &rects[i], &changed))
 		{
-			/*
-			 * BadMatch error happened. The size may have been changed again.
-			 * Give up this frame and we will resize again in next frame
-			 */
-			goto fail_capture;
+			/* Retry the whole screen with the next frame */
+			subsystem->full_capture = TRUE;
+			break;
 		}
 	}
 
@@ -840,72 +1034,40 @@ static int x11_shadow_screen_grab(x11ShadowSubsystem* subsystem)
 	XSync(subsystem->display, False);
 	XUnlockDisplay(subsystem->display);
 
-	if (status)
+	if (!region16_is_empty(&changed))
 	{
-		BOOL empty = 0;
+		const RECTANGLE_16* changedRects = region16_rects(&changed, &numRects);
 		EnterCriticalSection(&surface->lock);
-		region16_union_rect(&(surface->invalidRegion), &(surface->invalidRegion), &invalidRect);
+
+		for (UINT32 i = 0; i < numRects; i++)
+			region16_union_rect(&(surface->invalidRegion), &(surface->invalidRegion),
+			                    &changedRects[i]);
+
 		region16_intersect_rect(&(surface->invalidRegion), &(surface->invalidRegion), &surfaceRect);
-		empty = region16_is_empty(&(surface->invalidRegion));
 		LeaveCriticalSection(&surface->lock);
 
-		if (!empty)
-		{
-			BOOL success = 0;
-			EnterCriticalSection(&surface->lock);
-			extents = region16_extents(&(surface->invalidRegion));
-			x = extents->left;
-			y = extents->top;
-			width = extents->right - extents->left;
-			height = extents->bottom - extents->top;
-			WINPR_ASSERT(image);
-			WINPR_ASSERT(image->bytes_per_line >= 0);
-			WINPR_ASSERT(width >= 0);
-			WINPR_ASSERT(height >= 0);
-			success = freerdp_image_copy_no_overlap(
-			    surface->data, surface->format, surface->scanline,
-			    WINPR_ASSERTING_INT_CAST(uint32_t, x), WINPR_ASSERTING_INT_CAST(uint32_t, y),
-			    WINPR_ASSERTING_INT_CAST(uint32_t, width),
-			    WINPR_ASSERTING_INT_CAST(uint32_t, height), (BYTE*)image->data, subsystem->format,
-			    WINPR_ASSERTING_INT_CAST(uint32_t, image->bytes_per_line),
-			    WINPR_ASSERTING_INT_CAST(UINT32, x), WINPR_ASSERTING_INT_CAST(UINT32, y), NULL,
-			    FREERDP_FLIP_NONE);
-			LeaveCriticalSection(&surface->lock);
-			if (!success)
-				goto fail_capture;
-
-			// x11_shadow_blend_cursor(subsystem);
-			count = ArrayList_Count(server->clients);
-			shadow_subsystem_frame_update(&subsystem->common);
-
-			if (count == 1)
-			{
-				rdpShadowClient* client = NULL;
-				client = (rdpShadowClient*)ArrayList_GetItem(server->clients, 0);
+		// x11_shadow_blend_cursor(subsystem);
+		count = ArrayList_Count(server->clients);
+		shadow_subsystem_frame_update(&subsystem->common);
 
-				if (client)
-					subsystem->common.captureFrameRate =
-					    shadow_encoder_preferred_fps(client->encoder);
-			}
+		if (count == 1)
+		{
+			rdpShadowClient* client = NULL;
+			client = (rdpShadowClient*)ArrayList_GetItem(server->clients, 0);
 
-			EnterCriticalSection(&surface->lock);
-			region16_clear(&(surface->invalidRegion));
-			LeaveCriticalSection(&surface->lock);
+			if (client)
+				subsystem->common.captureFrameRate = shadow_encoder_preferred_fps(client->encoder);
 		}
-	}
-
-	rc = 1;
-fail_capture:
-	if (!subsystem->use_xshm && image)
-		XDestroyImage(image);
 
-	if (rc != 1)
-	{
-		XSetErrorHandler(NULL);
-		XSync(subsystem->display, False);
-		XUnlockDisplay(subsystem->display);
+		EnterCriticalSection(&surface->lock);
+		region16_clear(&(surface->invalidRegion));
+		LeaveCriticalSection(&surface->lock);
 	}
 
+	rc = 1;
+fail:
+	region16_uninit(&damage);
+	region16_uninit(&changed);
 	return rc;
 }
 
@@ -969,7 +1131,7 @@ static DWORD WINAPI x11_shadow_subsystem_thread(LPVOID arg)
 		{
 			XLockDisplay(subsystem->display);
 
-			if (XEventsQueued(subsystem->display, QueuedAlready))
+			while (XEventsQueued(subsystem->display, QueuedAfterReading))
 			{
 				XNextEvent(subsystem->display, &xevent);
 				x11_shadow_handle_xevent(subsystem, &xevent);
@@ -1098,8 +1260,9 @@ static int x11_shadow_xdamage_init(x11ShadowSubsystem* subsystem)
 		return -1;
 
 	subsystem->xdamage_notify_event = damage_event + XDamageNotify;
+	/* The damage region is fetched with each grab, one event per frame is enough */
 	subsystem->xdamage =
-	    XDamageCreate(subsystem->display, subsystem->root_window, XDamageReportDeltaRectangles);
+	    XDamageCreate(subsystem->display, subsystem->root_window, XDamageReportNonEmpty);
 
 	if (!subsystem->xdamage)
 		return -1;
@@ -1323,9 +1486,6 @@ static int x11_shadow_subsystem_init(rdpShadowSubsystem* sub)
 
 	XFreeExtensionList(extensions);
 
-	if (subsystem->composite)
-		subsystem->use_xdamage = FALSE;
-
 	pfs = XListPixmapFormats(subsystem->display, &pf_count);
 
 	if (!pfs)
@@ -1511,7 +1671,8 @@ static rdpShadowSubsystem* x11_shadow_subsystem_new(void)
 	subsystem->composite = FALSE;
 	subsystem->use_xshm = FALSE; /* temporarily disabled */
 	subsystem->use_xfixes = TRUE;
-	subsystem->use_xdamage = FALSE;
+	subsystem->use_xdamage = TRUE;
+	subsystem->full_capture = TRUE;
 	subsystem->use_xinerama = TRUE;
 	return (rdpShadowSubsystem*)subsystem;
 }
@@ -97,6 +97,9 @@ struct x11_shadow_subsystem
 	XserverRegion xdamage_region;
 #endif
 
+	BOOL full_capture;      /* compare the whole screen in the next grab */
+	UINT32 damage_frames;   /* grabs since the last full compare */
+
 #ifdef WITH_XFIXES
 	int xfixes_cursor_notify_event;
 #endif
@@ -19,14 +19,21 @@
 #include <freerdp/config.h>
 
 #include <winpr/crt.h>
+#include <winpr/pool.h>
 #include <winpr/print.h>
+#include <winpr/synch.h>
+#include <winpr/interlocked.h>
 
 #include <freerdp/log.h>
+#include <freerdp/primitives.h>
 
 #include "shadow_surface.h"
 
 #include "shadow_capture.h"
 
+/* tile rows per stripe, fewer are not worth the thread handoff */
+#define SHADOW_CAPTURE_STRIPE_MIN_ROWS 8
+
 int shadow_capture_align_clip_rect(RECTANGLE_16* rect, const RECTANGLE_16* clip)
 {
 	int dx = 0;
@@ -84,130 +91,101 @@ int shadow_capture_compare(const BYTE* WINPR_RESTRICT pData1, UINT32 nStep1, UIN
 	                                          pData2, PIXEL_FORMAT_BGRX32, nStep2, rect);
 }
 
-static BOOL color_equal(UINT32 colorA, UINT32 formatA, UINT32 colorB, UINT32 formatB)
+typedef struct
 {
-	BYTE ar = 0;
-	BYTE ag = 0;
-	BYTE ab = 0;
-	BYTE aa = 0;
-	BYTE br = 0;
-	BYTE bg = 0;
-	BYTE bb = 0;
-	BYTE ba = 0;
-	FreeRDPSplitColor(colorA, formatA, &ar, &ag, &ab, &aa, NULL);
-	FreeRDPSplitColor(colorB, formatB, &br, &bg, &bb, &ba, NULL);
-
-	if (ar != br)
-		return FALSE;
-	if (ag != bg)
-		return FALSE;
-	if (ab != bb)
-		return FALSE;
-	if (aa != ba)
-		return FALSE;
-	return TRUE;
-}
-
-static BOOL pixel_equal(const BYTE* WINPR_RESTRICT a, UINT32 formatA, const BYTE* WINPR_RESTRICT b,
-                        UINT32 formatB, size_t count)
+	const BYTE* pData1;
+	UINT32 format1;
+	UINT32 nStep1;
+	const BYTE* pData2;
+	UINT32 format2;
+	UINT32 nStep2;
+	UINT32 nWidth;
+	UINT32 nHeight;
+	BYTE* tiles;
+	UINT32 tilesStep;
+	LONG dirty;
+} SHADOW_COMPARE;
+
+/* one loop for the process, like the default thread pool it runs on */
+static INIT_ONCE shadow_capture_compare_once = INIT_ONCE_STATIC_INIT;
+static CRITICAL_SECTION shadow_capture_compare_lock;
+static WINPR_PARALLEL_FOR* shadow_capture_compare_loop = NULL;
+
+static BOOL CALLBACK shadow_capture_compare_init(PINIT_ONCE once, PVOID param, PVOID* context)
 {
-	const size_t bppA = FreeRDPGetBytesPerPixel(formatA);
-	const size_t bppB = FreeRDPGetBytesPerPixel(formatB);
-
-	for (size_t x = 0; x < count; x++)
-	{
-		const UINT32 colorA = FreeRDPReadColor(&a[bppA * x], formatA);
-		const UINT32 colorB = FreeRDPReadColor(&b[bppB * x], formatB);
-		if (!color_equal(colorA, formatA, colorB, formatB))
-			return FALSE;
-	}
-
-	return TRUE;
-}
+	WINPR_UNUSED(once);
+	WINPR_UNUSED(param);
+	WINPR_UNUSED(context);
 
-static BOOL color_equal_no_alpha(UINT32 colorA, UINT32 formatA, UINT32 colorB, UINT32 formatB)
-{
-	BYTE ar = 0;
-	BYTE ag = 0;
-	BYTE ab = 0;
-	BYTE br = 0;
-	BYTE bg = 0;
-	BYTE bb = 0;
-	FreeRDPSplitColor(colorA, formatA, &ar, &ag, &ab, NULL, NULL);
-	FreeRDPSplitColor(colorB, formatB, &br, &bg, &bb, NULL, NULL);
-
-	if (ar != br)
-		return FALSE;
-	if (ag != bg)
-		return FALSE;
-	if (ab != bb)
+	if (!InitializeCriticalSectionAndSpinCount(&shadow_capture_compare_lock, 4000))
 		return FALSE;
+
+	shadow_capture_compare_loop = winpr_ParallelFor_New(NULL);
 	return TRUE;
 }
 
-static BOOL pixel_equal_no_alpha(const BYTE* WINPR_RESTRICT a, UINT32 formatA,
-                                 const BYTE* WINPR_RESTRICT b, UINT32 formatB, size_t count)
+/* compare the tile rows [first, last) */
+static BOOL shadow_capture_compare_rows(PVOID context, size_t first, size_t last)
 {
-	const size_t bppA = FreeRDPGetBytesPerPixel(formatA);
-	const size_t bppB = FreeRDPGetBytesPerPixel(formatB);
+	UINT32 dirty = 0;
+	SHADOW_COMPARE* compare = context;
+	const primitives_t* prims = primitives_get();
 
-	for (size_t x = 0; x < count; x++)
-	{
-		const UINT32 colorA = FreeRDPReadColor(&a[bppA * x], formatA);
-		const UINT32 colorB = FreeRDPReadColor(&b[bppB * x], formatB);
-		if (!color_equal_no_alpha(colorA, formatA, colorB, formatB))
-			return FALSE;
-	}
+	WINPR_ASSERT(compare);
+	WINPR_ASSERT(prims);
 
-	return TRUE;
-}
+	const size_t y = 16ull * first;
+	const UINT32 height = (UINT32)(MIN(compare->nHeight, 16ull * last) - y);
+	const pstatus_t status = prims->compare_tiles(
+	    &compare->pData1[y * compare->nStep1], compare->format1, compare->nStep1,
+	    &compare->pData2[y * compare->nStep2], compare->format2, compare->nStep2, compare->nWidth,
+	    height, &compare->tiles[first * compare->tilesStep], compare->tilesStep, &dirty);
 
-static BOOL pixel_equal_same_format(const BYTE* WINPR_RESTRICT a, UINT32 formatA,
-                                    const BYTE* WINPR_RESTRICT b, UINT32 formatB, size_t count)
-{
-	if (formatA != formatB)
+	if (status != PRIMITIVES_SUCCESS)
 		return FALSE;
-	const size_t bppA = FreeRDPGetBytesPerPixel(formatA);
-	return memcmp(a, b, count * bppA) == 0;
-}
 
-typedef BOOL (*pixel_equal_fn_t)(const BYTE* WINPR_RESTRICT a, UINT32 formatA,
-                                 const BYTE* WINPR_RESTRICT b, UINT32 formatB, size_t count);
+	(void)InterlockedExchangeAdd(&compare->dirty, WINPR_ASSERTING_INT_CAST(LONG, dirty));
+	return TRUE;
+}
 
-static pixel_equal_fn_t get_comparison_fn(DWORD format1, DWORD format2)
+/**
+ * Compare two images and write one byte per 16x16 tile to tiles, 1 if changed.
+ * Large images are compared in stripes of tile rows on the default thread pool. The loop
+ * must not run concurrently, a caller finding it busy compares on its own thread.
+ *
+ * @return the number of changed tiles or <0 for any error
+ */
+static int shadow_capture_compare_tiles(const BYTE* WINPR_RESTRICT pData1, UINT32 format1,
+                                        UINT32 nStep1, const BYTE* WINPR_RESTRICT pData2,
+                                        UINT32 format2, UINT32 nStep2, UINT32 nWidth,
+                                        UINT32 nHeight, BYTE* WINPR_RESTRICT tiles,
+                                        UINT32 tilesStep)
 {
-
-	if (format1 == format2)
-		return pixel_equal_same_format;
-
-	const UINT32 bpp1 = FreeRDPGetBitsPerPixel(format1);
-
-	if (!FreeRDPColorHasAlpha(format1) || !FreeRDPColorHasAlpha(format2))
+	SHADOW_COMPARE compare = { pData1, format1, nStep1, pData2, format2, nStep2,
+		                       nWidth, nHeight, tiles,  tilesStep, 0 };
+	const size_t nrow = (nHeight + 15) / 16;
+	BOOL rc = FALSE;
+
+	if (!pData1 || !pData2 || !tiles)
+		return -1;
+
+	if ((nrow > SHADOW_CAPTURE_STRIPE_MIN_ROWS) &&
+	    InitOnceExecuteOnce(&shadow_capture_compare_once, shadow_capture_compare_init, NULL,
+	                        NULL) &&
+	    shadow_capture_compare_loop && TryEnterCriticalSection(&shadow_capture_compare_lock))
 	{
-		/* In case we have RGBA32 and RGBX32 or similar assume the alpha data is equal.
-		 * This allows us to use the fast memcmp comparison. */
-		if ((bpp1 == 32) && FreeRDPAreColorFormatsEqualNoAlpha(format1, format2))
-		{
-			switch (format1)
-			{
-				case PIXEL_FORMAT_ARGB32:
-				case PIXEL_FORMAT_XRGB32:
-				case PIXEL_FORMAT_ABGR32:
-				case PIXEL_FORMAT_XBGR32:
-					return pixel_equal;
-				case PIXEL_FORMAT_RGBA32:
-				case PIXEL_FORMAT_RGBX32:
-				case PIXEL_FORMAT_BGRA32:
-				case PIXEL_FORMAT_BGRX32:
-					return pixel_equal;
-				default:
-					break;
-			}
-		}
-		return pixel_equal_no_alpha;
+		rc = winpr_ParallelFor_Run(shadow_capture_compare_loop, nrow,
+		                           SHADOW_CAPTURE_STRIPE_MIN_ROWS, shadow_capture_compare_rows,
+		                           &compare);
+		LeaveCriticalSection(&shadow_capture_compare_lock);
 	}
 	else
-		return pixel_equal_no_alpha;
+		rc = shadow_capture_compare_rows(&compare, 0, nrow);
+
+	if (!rc)
+		return -1;
+
+	return compare.dirty;
 }
 
 int shadow_capture_compare_with_format(const BYTE* WINPR_RESTRICT pData1, UINT32 format1,
@@ -215,78 +193,49 @@ int shadow_capture_compare_with_format(const BYTE* WINPR_RESTRICT pData1, UINT32
                                        const BYTE* WINPR_RESTRICT pData2, UINT32 format2,
                                        UINT32 nStep2, RECTANGLE_16* WINPR_RESTRICT rect)
 {
-	pixel_equal_fn_t pixel_equal_fn = get_comparison_fn(format1, format2);
-	BOOL allEqual = TRUE;
-	UINT32 tw = 0;
 	const UINT32 nrow = (nHeight + 15) / 16;
 	const UINT32 ncol = (nWidth + 15) / 16;
 	UINT32 l = ncol + 1;
 	UINT32 t = nrow + 1;
 	UINT32 r = 0;
 	UINT32 b = 0;
-	const size_t bppA = FreeRDPGetBytesPerPixel(format1);
-	const size_t bppB = FreeRDPGetBytesPerPixel(format2);
 	const RECTANGLE_16 empty = { 0 };
 	WINPR_ASSERT(rect);
 
 	*rect = empty;
 
-	for (size_t ty = 0; ty < nrow; ty++)
-	{
-		BOOL rowEqual = TRUE;
-		size_t th = ((ty + 1) == nrow) ? (nHeight % 16) : 16;
-
-		if (!th)
-			th = 16;
-
-		for (size_t tx = 0; tx < ncol; tx++)
-		{
-			BOOL equal = TRUE;
-			tw = ((tx + 1) == ncol) ? (nWidth % 16) : 16;
-
-			if (!tw)
-				tw = 16;
+	if ((nrow == 0) || (ncol == 0))
+		return 0;
 
-			const BYTE* p1 = &pData1[(ty * 16ULL * nStep1) + (tx * 16ull * bppA)];
-			const BYTE* p2 = &pData2[(ty * 16ULL * nStep2) + (tx * 16ull * bppB)];
+	BYTE* tiles = (BYTE*)calloc(nrow, ncol);
 
-			for (size_t k = 0; k < th; k++)
-			{
-				if (!pixel_equal_fn(p1, format1, p2, format2, tw))
-				{
-					equal = FALSE;
-					break;
-				}
-
-				p1 += nStep1;
-				p2 += nStep2;
-			}
+	if (!tiles)
+		return -1;
 
-			if (!equal)
-			{
-				rowEqual = FALSE;
-				if (l > tx)
-					l = (UINT32)tx;
+	const int dirty = shadow_capture_compare_tiles(pData1, format1, nStep1, pData2, format2, nStep2,
+	                                               nWidth, nHeight, tiles, ncol);
 
-				if (r < tx)
-					r = (UINT32)tx;
-			}
-		}
+	if (dirty <= 0)
+	{
+		free(tiles);
+		return dirty;
+	}
 
-		if (!rowEqual)
+	for (UINT32 ty = 0; ty < nrow; ty++)
+	{
+		for (UINT32 tx = 0; tx < ncol; tx++)
 		{
-			allEqual = FALSE;
+			if (!tiles[1ull * ty * ncol + tx])
+				continue;
 
-			if (t > ty)
-				t = (UINT32)ty;
-
-			if (b < ty)
-				b = (UINT32)ty;
+			l = MIN(l, tx);
+			r = MAX(r, tx);
+			t = MIN(t, ty);
+			b = MAX(b, ty);
 		}
 	}
 
-	if (allEqual)
-		return 0;
+	free(tiles);
 
 	WINPR_ASSERT(l * 16 <= UINT16_MAX);
 	WINPR_ASSERT(t * 16 <= UINT16_MAX);
@@ -308,6 +257,106 @@ int shadow_capture_compare_with_format(const BYTE* WINPR_RESTRICT pData1, UINT32
 	return 1;
 }
 
+static void shadow_capture_add_tiles(RECTANGLE_16* WINPR_RESTRICT rect,
+                                     const RECTANGLE_16* WINPR_RESTRICT area, size_t ty,
+                                     size_t firstTx, size_t lastTx)
+{
+	rect->left = (UINT16)MIN(area->right, area->left + firstTx * 16);
+	rect->top = (UINT16)MIN(area->bottom, area->top + ty * 16);
+	rect->right = (UINT16)MIN(area->right, area->left + (lastTx + 1) * 16);
+	rect->bottom = (UINT16)MIN(area->bottom, area->top + (ty + 1) * 16);
+}
+
+static BOOL shadow_capture_union_rects(REGION16* WINPR_RESTRICT region,
+                                       const RECTANGLE_16* WINPR_RESTRICT rects, UINT32 count)
+{
+	/* the runs are banded already, the region is built in one go */
+	if (region16_is_empty(region))
+		return region16_set_banded_rects(region, rects, count);
+
+	for (UINT32 i = 0; i < count; i++)
+	{
+		if (!region16_union_rect(region, region, &rects[i]))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+int shadow_capture_compare_region_with_format(const BYTE* WINPR_RESTRICT pData1, UINT32 format1,
+                                              UINT32 nStep1, const BYTE* WINPR_RESTRICT pData2,
+                                              UINT32 format2, UINT32 nStep2,
+                                              const RECTANGLE_16* WINPR_RESTRICT area,
+                                              REGION16* WINPR_RESTRICT region)
+{
+	if (!pData1 || !pData2 || !area || !region || (area->right < area->left) ||
+	    (area->bottom < area->top))
+		return -1;
+
+	const UINT32 nWidth = area->right - area->left;
+	const UINT32 nHeight = area->bottom - area->top;
+	const UINT32 nrow = (nHeight + 15) / 16;
+	const UINT32 ncol = (nWidth + 15) / 16;
+
+	if ((nrow == 0) || (ncol == 0))
+		return 0;
+
+	BYTE* tiles = (BYTE*)calloc(nrow, ncol);
+
+	if (!tiles)
+		return -1;
+
+	int rc = shadow_capture_compare_tiles(pData1, format1, nStep1, pData2, format2, nStep2, nWidth,
+	                                      nHeight, tiles, ncol);
+
+	/* a tile row has at most (ncol + 1) / 2 separate runs */
+	UINT32 count = 0;
+	RECTANGLE_16* rects = NULL;
+
+	if (rc > 0)
+	{
+		rects = (RECTANGLE_16*)calloc(1ull * nrow * ((ncol + 1) / 2), sizeof(RECTANGLE_16));
+
+		if (!rects)
+			rc = -1;
+	}
+
+	for (size_t ty = 0; (rc > 0) && (ty < nrow); ty++)
+	{
+		const BYTE* row = &tiles[ty * ncol];
+		/* first tile of the current run of changed tiles, ncol if there is none */
+		size_t run = ncol;
+
+		for (size_t tx = 0; tx < ncol; tx++)
+		{
+			if (row[tx])
+			{
+				if (run == ncol)
+					run = tx;
+			}
+			else if (run != ncol)
+			{
+				shadow_capture_add_tiles(&rects[count++], area, ty, run, tx - 1);
+				run = ncol;
+			}
+		}
+
+		if (run != ncol)
+			shadow_capture_add_tiles(&rects[count++], area, ty, run, ncol - 1);
+	}
+
+	if ((rc > 0) && !shadow_capture_union_rects(region, rects, count))
+		rc = -1;
+
+	free(rects);
+	free(tiles);
+
+	if (rc < 0)
+		return -1;
+
+	return (rc > 0) ? 1 : 0;
+}
+
 rdpShadowCapture* shadow_capture_new(rdpShadowServer* server)
 {
 	WINPR_ASSERT(server);
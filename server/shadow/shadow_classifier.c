@@ -0,0 +1,356 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Content classification of surface tiles
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <winpr/assert.h>
+#include <winpr/cast.h>
+
+#include <freerdp/codec/color.h>
+
+#include "shadow_classifier.h"
+
+#define SHADOW_CLASSIFIER_TILE_SIZE 64
+
+/* distinct colors of a tile that is text or flat UI no matter how many edges it has */
+#define SHADOW_CLASSIFIER_TEXT_COLORS 64
+/* above this a tile is an image even with many edges (anti aliased text has a few hundred) */
+#define SHADOW_CLASSIFIER_MAX_COLORS 512
+/* luma step counted as an edge and the percentage of edges making a tile text */
+#define SHADOW_CLASSIFIER_EDGE_STEP 64
+#define SHADOW_CLASSIFIER_TEXT_EDGES 8
+/* an image tile changing in this many frames in a row, with at most a gap of
+ * SHADOW_CLASSIFIER_VIDEO_GAP frames, is video */
+#define SHADOW_CLASSIFIER_VIDEO_FRAMES 10
+#define SHADOW_CLASSIFIER_VIDEO_GAP 2
+
+typedef struct
+{
+	UINT32 lastChange; /* frame the tile was last damaged in */
+	UINT32 changes;    /* frames in a row the tile was damaged in */
+	UINT32 classified; /* frame content was determined for */
+	SHADOW_CONTENT content;
+} SHADOW_CLASSIFIER_TILE;
+
+struct rdp_shadow_classifier
+{
+	UINT32 width;
+	UINT32 height;
+	UINT32 gridWidth;
+	UINT32 gridHeight;
+	UINT32 frame;
+	BOOL video; /* some tile is video */
+	SHADOW_CLASSIFIER_TILE* tiles;
+};
+
+static RECTANGLE_16 shadow_classifier_tile_rect(const rdpShadowClassifier* classifier, UINT32 x,
+                                                UINT32 y)
+{
+	RECTANGLE_16 rect = { 0 };
+	rect.left = WINPR_ASSERTING_INT_CAST(UINT16, x * SHADOW_CLASSIFIER_TILE_SIZE);
+	rect.top = WINPR_ASSERTING_INT_CAST(UINT16, y * SHADOW_CLASSIFIER_TILE_SIZE);
+	rect.right = WINPR_ASSERTING_INT_CAST(
+	    UINT16, MIN(classifier->width, (x + 1) * SHADOW_CLASSIFIER_TILE_SIZE));
+	rect.bottom = WINPR_ASSERTING_INT_CAST(
+	    UINT16, MIN(classifier->height, (y + 1) * SHADOW_CLASSIFIER_TILE_SIZE));
+	return rect;
+}
+
+static BOOL shadow_classifier_resize(rdpShadowClassifier* classifier, UINT32 width, UINT32 height)
+{
+	WINPR_ASSERT(classifier);
+
+	if ((classifier->width == width) && (classifier->height == height) && classifier->tiles)
+		return TRUE;
+
+	const UINT32 gridWidth = (width + SHADOW_CLASSIFIER_TILE_SIZE - 1) / SHADOW_CLASSIFIER_TILE_SIZE;
+	const UINT32 gridHeight =
+	    (height + SHADOW_CLASSIFIER_TILE_SIZE - 1) / SHADOW_CLASSIFIER_TILE_SIZE;
+	SHADOW_CLASSIFIER_TILE* tiles =
+	    calloc(MAX(1ull * gridWidth * gridHeight, 1), sizeof(SHADOW_CLASSIFIER_TILE));
+
+	if (!tiles)
+		return FALSE;
+
+	free(classifier->tiles);
+	classifier->tiles = tiles;
+	classifier->width = width;
+	classifier->height = height;
+	classifier->gridWidth = gridWidth;
+	classifier->gridHeight = gridHeight;
+	classifier->frame = 0;
+	classifier->video = FALSE;
+	return TRUE;
+}
+
+/**
+ * Count the distinct colors and the sharp luma steps between neighbours on
+ * every other row of the tile.
+ */
+static SHADOW_CONTENT shadow_classifier_measure(const BYTE* pSrcData, UINT32 SrcFormat,
+                                                UINT32 nSrcStep, const RECTANGLE_16* rect)
+{
+	UINT32 colors[2 * SHADOW_CLASSIFIER_MAX_COLORS] = { 0 };
+	UINT32 distinct = 0;
+	UINT32 edges = 0;
+	UINT32 pairs = 0;
+	const UINT32 bpp = FreeRDPGetBytesPerPixel(SrcFormat);
+
+	for (UINT32 y = rect->top; y < rect->bottom; y += 2)
+	{
+		const BYTE* line = &pSrcData[1ull * y * nSrcStep + 1ull * rect->left * bpp];
+		INT32 lastLuma = -1;
+
+		for (UINT32 x = 0; x < 1u * rect->right - rect->left; x++)
+		{
+			BYTE r = 0;
+			BYTE g = 0;
+			BYTE b = 0;
+			const UINT32 pixel = FreeRDPReadColor(&line[1ull * x * bpp], SrcFormat);
+			FreeRDPSplitColor(pixel, SrcFormat, &r, &g, &b, NULL, NULL);
+
+			const INT32 luma = (2 * r + 5 * g + b) / 8;
+			if (lastLuma >= 0)
+			{
+				pairs++;
+				if (abs(luma - lastLuma) >= SHADOW_CLASSIFIER_EDGE_STEP)
+					edges++;
+			}
+			lastLuma = luma;
+
+			/* 0 marks an empty slot, set the top bit to keep black apart */
+			const UINT32 color = 0x80000000 | ((UINT32)r << 16) | ((UINT32)g << 8) | b;
+			UINT32 slot = (color * 2654435761u) % ARRAYSIZE(colors);
+
+			while ((colors[slot] != 0) && (colors[slot] != color))
+				slot = (slot + 1) % ARRAYSIZE(colors);
+
+			if (colors[slot] == 0)
+			{
+				colors[slot] = color;
+
+				if (++distinct > SHADOW_CLASSIFIER_MAX_COLORS)
+					return SHADOW_CONTENT_IMAGE;
+			}
+		}
+	}
+
+	if (distinct <= SHADOW_CLASSIFIER_TEXT_COLORS)
+		return SHADOW_CONTENT_TEXT;
+
+	if (100ull * edges >= 1ull * SHADOW_CLASSIFIER_TEXT_EDGES * pairs)
+		return SHADOW_CONTENT_TEXT;
+
+	return SHADOW_CONTENT_IMAGE;
+}
+
+static SHADOW_CONTENT shadow_classifier_tile(rdpShadowClassifier* classifier, const BYTE* pSrcData,
+                                             UINT32 SrcFormat, UINT32 nSrcStep, UINT32 x, UINT32 y)
+{
+	SHADOW_CLASSIFIER_TILE* tile = &classifier->tiles[1ull * y * classifier->gridWidth + x];
+
+	if (tile->classified == classifier->frame)
+		return tile->content;
+
+	if ((tile->changes > 0) &&
+	    (classifier->frame - tile->lastChange <= SHADOW_CLASSIFIER_VIDEO_GAP))
+		tile->changes = MIN(tile->changes + 1, SHADOW_CLASSIFIER_VIDEO_FRAMES);
+	else
+		tile->changes = 1;
+
+	tile->lastChange = classifier->frame;
+	tile->classified = classifier->frame;
+
+	/* video stays video while it keeps changing, there is no need to look at it again */
+	if ((tile->content == SHADOW_CONTENT_VIDEO) &&
+	    (tile->changes >= SHADOW_CLASSIFIER_VIDEO_FRAMES))
+		return tile->content;
+
+	const RECTANGLE_16 rect = shadow_classifier_tile_rect(classifier, x, y);
+	tile->content = shadow_classifier_measure(pSrcData, SrcFormat, nSrcStep, &rect);
+
+	/* only images that keep changing are video, text (typing, scrolling) stays lossless */
+	if ((tile->content == SHADOW_CONTENT_IMAGE) &&
+	    (tile->changes >= SHADOW_CLASSIFIER_VIDEO_FRAMES))
+	{
+		tile->content = SHADOW_CONTENT_VIDEO;
+		classifier->video = TRUE;
+	}
+
+	return tile->content;
+}
+
+void shadow_classifier_reset(rdpShadowClassifier* classifier)
+{
+	if (!classifier)
+		return;
+
+	free(classifier->tiles);
+	classifier->tiles = NULL;
+	classifier->width = 0;
+	classifier->height = 0;
+	classifier->video = FALSE;
+}
+
+/**
+ * Start the next frame. Video that stopped changing is left at the quality of
+ * the video codec, its tiles are added to the refresh region.
+ */
+static BOOL shadow_classifier_next_frame(rdpShadowClassifier* classifier, REGION16* refresh)
+{
+	BOOL video = FALSE;
+
+	classifier->frame++;
+
+	if (!classifier->video)
+		return TRUE;
+
+	for (UINT32 y = 0; y < classifier->gridHeight; y++)
+	{
+		for (UINT32 x = 0; x < classifier->gridWidth; x++)
+		{
+			SHADOW_CLASSIFIER_TILE* tile = &classifier->tiles[1ull * y * classifier->gridWidth + x];
+
+			if (tile->content != SHADOW_CONTENT_VIDEO)
+				continue;
+
+			if (classifier->frame - tile->lastChange <= SHADOW_CLASSIFIER_VIDEO_GAP)
+			{
+				video = TRUE;
+				continue;
+			}
+
+			const RECTANGLE_16 rect = shadow_classifier_tile_rect(classifier, x, y);
+			tile->content = SHADOW_CONTENT_IMAGE;
+			tile->changes = 0;
+			if (!region16_union_rect(refresh, refresh, &rect))
+				return FALSE;
+		}
+	}
+
+	classifier->video = video;
+	return TRUE;
+}
+
+BOOL shadow_classifier_has_video(const rdpShadowClassifier* classifier)
+{
+	WINPR_ASSERT(classifier);
+	return classifier->video;
+}
+
+BOOL shadow_classifier_tick(rdpShadowClassifier* classifier, REGION16* refresh)
+{
+	WINPR_ASSERT(classifier);
+	WINPR_ASSERT(refresh);
+
+	return shadow_classifier_next_frame(classifier, refresh);
+}
+
+BOOL shadow_classifier_route_pending(REGION16* src, REGION16* image, const REGION16* pending)
+{
+	BOOL rc = FALSE;
+	UINT32 numRects = 0;
+	UINT32 numKept = 0;
+
+	if (region16_is_empty(pending) || region16_is_empty(src))
+		return TRUE;
+
+	const RECTANGLE_16* rects = region16_rects(src, &numRects);
+	RECTANGLE_16* kept = calloc(numRects, sizeof(RECTANGLE_16));
+
+	if (!kept)
+		return FALSE;
+
+	for (UINT32 index = 0; index < numRects; index++)
+	{
+		if (!region16_intersects_rect(pending, &rects[index]))
+			kept[numKept++] = rects[index];
+		else if (!region16_union_rect(image, image, &rects[index]))
+			goto out;
+	}
+
+	/* a subset of banded rectangles is still banded */
+	rc = (numKept == numRects) || region16_set_banded_rects(src, kept, numKept);
+out:
+	free(kept);
+	return rc;
+}
+
+BOOL shadow_classifier_classify(rdpShadowClassifier* classifier, const BYTE* pSrcData,
+                                UINT32 SrcFormat, UINT32 nSrcStep, UINT32 nWidth, UINT32 nHeight,
+                                const REGION16* damage, REGION16 regions[SHADOW_CONTENT_COUNT])
+{
+	UINT32 numRects = 0;
+
+	WINPR_ASSERT(classifier);
+	WINPR_ASSERT(pSrcData);
+	WINPR_ASSERT(damage);
+	WINPR_ASSERT(regions);
+
+	if (!shadow_classifier_resize(classifier, nWidth, nHeight))
+		return FALSE;
+
+	if (!shadow_classifier_next_frame(classifier, &regions[SHADOW_CONTENT_IMAGE]))
+		return FALSE;
+
+	const RECTANGLE_16* rects = region16_rects(damage, &numRects);
+
+	for (UINT32 index = 0; index < numRects; index++)
+	{
+		const RECTANGLE_16* damaged = &rects[index];
+		const UINT32 right = MIN(damaged->right, nWidth);
+		const UINT32 bottom = MIN(damaged->bottom, nHeight);
+
+		if ((damaged->left >= right) || (damaged->top >= bottom))
+			continue;
+
+		for (UINT32 y = damaged->top / SHADOW_CLASSIFIER_TILE_SIZE;
+		     y <= (bottom - 1) / SHADOW_CLASSIFIER_TILE_SIZE; y++)
+		{
+			for (UINT32 x = damaged->left / SHADOW_CLASSIFIER_TILE_SIZE;
+			     x <= (right - 1) / SHADOW_CLASSIFIER_TILE_SIZE; x++)
+			{
+				RECTANGLE_16 part = { 0 };
+				const RECTANGLE_16 rect = shadow_classifier_tile_rect(classifier, x, y);
+				const SHADOW_CONTENT content =
+				    shadow_classifier_tile(classifier, pSrcData, SrcFormat, nSrcStep, x, y);
+
+				if (!rectangles_intersection(&rect, damaged, &part))
+					continue;
+
+				if (!region16_union_rect(&regions[content], &regions[content], &part))
+					return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+rdpShadowClassifier* shadow_classifier_new(void)
+{
+	return calloc(1, sizeof(rdpShadowClassifier));
+}
+
+void shadow_classifier_free(rdpShadowClassifier* classifier)
+{
+	if (!classifier)
+		return;
+
+	free(classifier->tiles);
+	free(classifier);
+}
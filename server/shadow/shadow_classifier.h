@@ -0,0 +1,93 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Content classification of surface tiles
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_SERVER_SHADOW_CLASSIFIER_H
+#define FREERDP_SERVER_SHADOW_CLASSIFIER_H
+
+#include <winpr/crt.h>
+
+#include <freerdp/codec/region.h>
+
+/*
+ * Sorts the damaged 64x64 tiles of a surface by their content so every kind
+ * of content can be sent with the codec suiting it best:
+ * text and flat UI use few colors or have sharp edges, images have smooth
+ * gradients and video keeps changing over many consecutive frames.
+ */
+
+typedef enum
+{
+	SHADOW_CONTENT_TEXT,
+	SHADOW_CONTENT_IMAGE,
+	SHADOW_CONTENT_VIDEO,
+	SHADOW_CONTENT_COUNT
+} SHADOW_CONTENT;
+
+typedef struct rdp_shadow_classifier rdpShadowClassifier;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	void shadow_classifier_free(rdpShadowClassifier* classifier);
+
+	WINPR_ATTR_MALLOC(shadow_classifier_free, 1)
+	rdpShadowClassifier* shadow_classifier_new(void);
+
+	void shadow_classifier_reset(rdpShadowClassifier* classifier);
+
+	/**
+	 * Classify the tiles touched by the damaged region of a frame.
+	 * Tiles that stopped being video are added to the image region once more,
+	 * they were last sent with a lossy video codec.
+	 *
+	 * @param regions Initialized regions receiving the damaged areas per content
+	 * @return TRUE on success
+	 */
+	BOOL shadow_classifier_classify(rdpShadowClassifier* classifier, const BYTE* pSrcData,
+	                                UINT32 SrcFormat, UINT32 nSrcStep, UINT32 nWidth,
+	                                UINT32 nHeight, const REGION16* damage,
+	                                REGION16 regions[SHADOW_CONTENT_COUNT]);
+
+	/**
+	 * Start a frame without damage. Video that stopped changing while the screen
+	 * is static is only refreshed this way.
+	 *
+	 * @param refresh Initialized region receiving the tiles that stopped being video
+	 * @return TRUE on success
+	 */
+	BOOL shadow_classifier_tick(rdpShadowClassifier* classifier, REGION16* refresh);
+
+	/**
+	 * Move the rectangles of src touching progressive tiles waiting for upgrades
+	 * to the image region. The upgrades repaint whole tiles from the state of the
+	 * progressive encoder, which only encoding the tiles again brings up to date.
+	 *
+	 * @param pending The tiles waiting for upgrades
+	 * @return TRUE on success
+	 */
+	BOOL shadow_classifier_route_pending(REGION16* src, REGION16* image, const REGION16* pending);
+
+	/** @return TRUE if some tile is sent as video and needs a refresh once it stops */
+	BOOL shadow_classifier_has_video(const rdpShadowClassifier* classifier);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_SERVER_SHADOW_CLASSIFIER_H */
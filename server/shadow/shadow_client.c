@@ -31,6 +31,7 @@
 #include <winpr/interlocked.h>
 
 #include <freerdp/log.h>
+#include <freerdp/transport_io.h>
 #include <freerdp/channels/drdynvc.h>
 
 #include "shadow.h"
@@ -43,6 +44,26 @@ typedef struct
 	BOOL gfxSurfaceCreated;
 } SHADOW_GFX_STATUS;
 
+/* progressive tile upgrades are sent while the client is idle, a batch of tiles
+ * every SHADOW_PROGRESSIVE_UPGRADE_INTERVAL milliseconds */
+#define SHADOW_PROGRESSIVE_UPGRADE_TILES 64
+#define SHADOW_PROGRESSIVE_UPGRADE_INTERVAL 20
+
+/* video that stopped while the screen is static is refreshed once no frame was
+ * sent for a few SHADOW_VIDEO_REFRESH_INTERVAL milliseconds */
+#define SHADOW_VIDEO_REFRESH_INTERVAL 100
+
+/* round-trip time and bandwidth are measured every SHADOW_NETWORK_PROBE_INTERVAL
+ * milliseconds, a continuous bandwidth measurement spans one interval */
+#define SHADOW_NETWORK_PROBE_INTERVAL 1000
+
+typedef struct
+{
+	UINT64 next;
+	UINT16 sequenceNumber;
+	BOOL bandwidthStarted;
+} SHADOW_NETWORK_PROBE;
+
 /* See https://github.com/FreeRDP/FreeRDP/issues/10413
  *
  * Microsoft ditched support for RFX and multiple rectangles in BitmapUpdate for
@@ -138,6 +159,9 @@ static INLINE BOOL shadow_client_rdpgfx_release_surface(rdpShadowClient* client)
 	WINPR_ASSERT(context);
 
 	pdu.surfaceId = client->surfaceId++;
+	if (client->encoder && client->encoder->progressive)
+		progressive_delete_surface_context(client->encoder->progressive, pdu.surfaceId);
+
 	IFCALLRET(context->DeleteSurface, error, context, &pdu);
 
 	if (error)
@@ -177,6 +201,21 @@ static INLINE BOOL shadow_client_rdpgfx_reset_graphic(rdpShadowClient* client)
 		return FALSE;
 	}
 
+	/* The client restarts the ClearCodec sequence numbers (but keeps its caches) */
+	if (client->encoder && client->encoder->clear)
+		clear_context_reset(client->encoder->clear);
+
+	/* The client drops its progressive tiles, pending upgrades are gone with them */
+	if (client->encoder && client->encoder->progressive)
+		progressive_context_reset(client->encoder->progressive);
+
+	/* Start classifying from scratch on the new surface, it has none of the old content */
+	if (client->encoder)
+	{
+		shadow_classifier_reset(client->encoder->classifier);
+		shadow_motion_reset(client->encoder->motion);
+	}
+
 	client->first_frame = TRUE;
 	return TRUE;
 }
@@ -273,6 +312,12 @@ static BOOL shadow_client_context_new(freerdp_peer* peer, rdpContext* context)
 	if (!freerdp_settings_set_bool(settings, FreeRDP_GfxH264,
 	                               freerdp_settings_get_bool(srvSettings, FreeRDP_GfxH264)))
 		return FALSE;
+	if (!freerdp_settings_set_bool(settings, FreeRDP_GfxClearCodec,
+	                               freerdp_settings_get_bool(srvSettings, FreeRDP_GfxClearCodec)))
+		return FALSE;
+	if (!freerdp_settings_set_bool(settings, FreeRDP_GfxMixedCodecs,
+	                               freerdp_settings_get_bool(srvSettings, FreeRDP_GfxMixedCodecs)))
+		return FALSE;
 	if (!freerdp_settings_set_bool(settings, FreeRDP_DrawAllowSkipAlpha, TRUE))
 		return FALSE;
 	if (!freerdp_settings_set_bool(settings, FreeRDP_DrawAllowColorSubsampling, TRUE))
@@ -787,7 +832,112 @@ static INLINE void shadow_client_common_frame_acknowledge(rdpShadowClient* clien
 	 */
 	WINPR_ASSERT(client);
 	WINPR_ASSERT(client->encoder);
-	client->encoder->lastAckframeId = frameId;
+	shadow_encoder_frame_acknowledged(client->encoder, frameId);
+}
+
+static BOOL shadow_client_rtt_measure_response(rdpAutoDetect* autodetect,
+                                               RDP_TRANSPORT_TYPE transport, UINT16 sequenceNumber)
+{
+	WINPR_ASSERT(autodetect);
+	WINPR_UNUSED(transport);
+	WINPR_UNUSED(sequenceNumber);
+
+	rdpShadowClient* client = (rdpShadowClient*)autodetect->context;
+	WINPR_ASSERT(client);
+
+	if (client->encoder)
+		shadow_encoder_update_network(client->encoder, autodetect->netCharAverageRTT, 0, FALSE);
+	return TRUE;
+}
+
+static BOOL shadow_client_bandwidth_measure_results(rdpAutoDetect* autodetect,
+                                                    RDP_TRANSPORT_TYPE transport,
+                                                    UINT16 sequenceNumber, UINT16 responseType,
+                                                    UINT32 timeDelta, UINT32 byteCount)
+{
+	WINPR_ASSERT(autodetect);
+	WINPR_UNUSED(transport);
+	WINPR_UNUSED(sequenceNumber);
+	WINPR_UNUSED(responseType);
+
+	rdpShadowClient* client = (rdpShadowClient*)autodetect->context;
+	WINPR_ASSERT(client);
+
+	/* bytes per millisecond times 8 are kilobits per second */
+	if (client->encoder && (timeDelta > 0))
+		shadow_encoder_update_network(
+		    client->encoder, 0, (UINT32)MIN(8ull * byteCount / timeDelta, UINT32_MAX), FALSE);
+	return TRUE;
+}
+
+static BOOL shadow_client_network_characteristics_sync(rdpAutoDetect* autodetect,
+                                                       RDP_TRANSPORT_TYPE transport,
+                                                       UINT16 sequenceNumber, UINT32 bandwidth,
+                                                       UINT32 rtt)
+{
+	WINPR_ASSERT(autodetect);
+	WINPR_UNUSED(transport);
+	WINPR_UNUSED(sequenceNumber);
+
+	rdpShadowClient* client = (rdpShadowClient*)autodetect->context;
+	WINPR_ASSERT(client);
+
+	/* the client measured these at connect time, with a payload */
+	if (client->encoder)
+		shadow_encoder_update_network(client->encoder, rtt, bandwidth, bandwidth > 0);
+	return TRUE;
+}
+
+/**
+ * Function description
+ * Measure the round-trip time and the bandwidth while the client is active.
+ *
+ * @return the milliseconds until the next measurement is due
+ */
+static DWORD shadow_client_probe_network(rdpShadowClient* client, SHADOW_NETWORK_PROBE* probe)
+{
+	rdpContext* context = &client->context;
+
+	WINPR_ASSERT(probe);
+
+	if (!client->activated ||
+	    !freerdp_settings_get_bool(context->settings, FreeRDP_NetworkAutoDetect))
+		return INFINITE;
+
+	rdpAutoDetect* autodetect = autodetect_get(context);
+	if (!autodetect || !autodetect->RTTMeasureRequest || !autodetect->BandwidthMeasureStart ||
+	    !autodetect->BandwidthMeasureStop)
+		return INFINITE;
+
+	const UINT64 now = GetTickCount64();
+	if (now < probe->next)
+		return (DWORD)(probe->next - now);
+
+	probe->next = now + SHADOW_NETWORK_PROBE_INTERVAL;
+
+	/* the client reports the bytes received between start and stop, the encoder
+	 * decides whether the link was busy enough for that to be its capacity */
+	if (client->encoder)
+	{
+		if (probe->bandwidthStarted)
+			shadow_encoder_bandwidth_measure_stop(client->encoder);
+		else
+			shadow_encoder_bandwidth_measure_start(client->encoder);
+	}
+
+	const BOOL sent =
+	    (probe->bandwidthStarted
+	         ? autodetect->BandwidthMeasureStop(autodetect, RDP_TRANSPORT_TCP,
+	                                            probe->sequenceNumber++, 0)
+	         : autodetect->BandwidthMeasureStart(autodetect, RDP_TRANSPORT_TCP,
+	                                             probe->sequenceNumber++)) &&
+	    autodetect->RTTMeasureRequest(autodetect, RDP_TRANSPORT_TCP, probe->sequenceNumber++);
+
+	if (!sent)
+		WLog_WARN(TAG, "Failed to send network auto-detection requests");
+
+	probe->bandwidthStarted = !probe->bandwidthStarted;
+	return SHADOW_NETWORK_PROBE_INTERVAL;
 }
 
 static BOOL shadow_client_surface_frame_acknowledge(rdpContext* context, UINT32 frameId)
@@ -821,6 +971,48 @@ shadow_client_rdpgfx_frame_acknowledge(RdpgfxServerContext* context,
 	return CHANNEL_RC_OK;
 }
 
+static UINT
+shadow_client_rdpgfx_cache_import_offer(RdpgfxServerContext* context,
+                                        const RDPGFX_CACHE_IMPORT_OFFER_PDU* cacheImportOffer)
+{
+	RDPGFX_CACHE_IMPORT_REPLY_PDU* reply = NULL;
+	rdpShadowClient* client = NULL;
+
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(cacheImportOffer);
+
+	client = (rdpShadowClient*)context->custom;
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(client->encoder);
+
+	reply = calloc(1, sizeof(RDPGFX_CACHE_IMPORT_REPLY_PDU));
+	if (!reply)
+		return CHANNEL_RC_NO_MEMORY;
+
+	/* the reply has a slot for each entry offered, 0 for the ones not imported */
+	UINT32 imported = 0;
+	const UINT16 count = MIN(cacheImportOffer->cacheEntriesCount, RDPGFX_CACHE_ENTRY_MAX_COUNT);
+	for (UINT16 index = 0; index < count; index++)
+	{
+		const RDPGFX_CACHE_ENTRY_METADATA* entry = &cacheImportOffer->cacheEntries[index];
+		const UINT16 slot = shadow_gfx_cache_import(client->encoder->gfxCache, entry->cacheKey,
+		                                            entry->bitmapLength);
+		if (slot == 0)
+			continue;
+
+		reply->cacheSlots[index] = slot;
+		reply->importedEntriesCount = WINPR_ASSERTING_INT_CAST(UINT16, index + 1);
+		imported++;
+	}
+
+	WLog_DBG(TAG, "imported %" PRIu32 " of %" PRIu16 " offered cache entries", imported,
+	         cacheImportOffer->cacheEntriesCount);
+
+	UINT rc = IFCALLRESULT(CHANNEL_RC_OK, context->CacheImportReply, context, reply);
+	free(reply);
+	return rc;
+}
+
 static BOOL shadow_are_caps_filtered(const rdpSettings* settings, UINT32 caps)
 {
 	const UINT32 capList[] = { RDPGFX_CAPVERSION_8,   RDPGFX_CAPVERSION_81,
@@ -852,6 +1044,20 @@ static UINT shadow_client_send_caps_confirm(RdpgfxServerContext* context, rdpSha
 	WINPR_ASSERT(context->CapsConfirm);
 	UINT rc = context->CapsConfirm(context, pdu);
 	client->areGfxCapsReady = (rc == CHANNEL_RC_OK);
+
+	/* the client starts with an empty cache, sized as negotiated [MS-RDPEGFX] 3.3.1.2 */
+	if (client->areGfxCapsReady)
+	{
+		const BOOL small = freerdp_settings_get_bool(client->context.settings,
+		                                             FreeRDP_GfxSmallCache);
+		const UINT32 maxSlots = small ? 4096 : 25600;
+		const UINT64 maxBytes = (small ? 16ull : 100ull) * 1024 * 1024;
+
+		WINPR_ASSERT(client->encoder);
+		if (!shadow_gfx_cache_reset(client->encoder->gfxCache, maxSlots, maxBytes))
+			return CHANNEL_RC_NO_MEMORY;
+	}
+
 	return rc;
 }
 
@@ -1122,332 +1328,1203 @@ static INLINE UINT32 rdpgfx_estimate_h264_avc420(RDPGFX_AVC420_BITMAP_STREAM* ha
 }
 
 /**
- * Function description
+ * Sample the region and count distinct colors, text and UI elements use very few of them
+ * while photos and video use thousands.
  *
- * @return TRUE on success
+ * @return TRUE if the region is a good candidate for ClearCodec
  */
-static BOOL shadow_client_send_surface_gfx(rdpShadowClient* client, const BYTE* pSrcData,
-                                           UINT32 nSrcStep, UINT32 SrcFormat, UINT16 nXSrc,
-                                           UINT16 nYSrc, UINT16 nWidth, UINT16 nHeight)
+static BOOL shadow_client_is_low_entropy(const BYTE* pSrcData, UINT32 SrcFormat, UINT32 nSrcStep,
+                                         UINT32 nWidth, UINT32 nHeight)
 {
-	UINT32 id = 0;
-	UINT error = CHANNEL_RC_OK;
-	const rdpContext* context = (const rdpContext*)client;
-	const rdpSettings* settings = NULL;
-	rdpShadowEncoder* encoder = NULL;
-	RDPGFX_SURFACE_COMMAND cmd = { 0 };
-	RDPGFX_START_FRAME_PDU cmdstart = { 0 };
-	RDPGFX_END_FRAME_PDU cmdend = { 0 };
-	SYSTEMTIME sTime = { 0 };
-
-	if (!context || !pSrcData)
-		return FALSE;
-
-	settings = context->settings;
-	encoder = client->encoder;
-
-	if (!settings || !encoder)
+	const UINT32 maxColors = 256;
+	UINT32 colors[1024] = { 0 };
+	UINT32 distinct = 0;
+	const UINT32 bpp = FreeRDPGetBytesPerPixel(SrcFormat);
+	const UINT32 stepX = MAX(1, nWidth / 64);
+	const UINT32 stepY = MAX(1, nHeight / 64);
+
+	if ((nWidth == 0) || (nHeight == 0) || (bpp == 0))
 		return FALSE;
 
-	if (client->first_frame)
-	{
-		rfx_context_reset(encoder->rfx, nWidth, nHeight);
-		client->first_frame = FALSE;
-	}
-
-	cmdstart.frameId = shadow_encoder_create_frame_id(encoder);
-	GetSystemTime(&sTime);
-	cmdstart.timestamp = (UINT32)(sTime.wHour << 22U | sTime.wMinute << 16U | sTime.wSecond << 10U |
-	                              sTime.wMilliseconds);
-	cmdend.frameId = cmdstart.frameId;
-	cmd.surfaceId = client->surfaceId;
-	cmd.format = PIXEL_FORMAT_BGRX32;
-	cmd.left = nXSrc;
-	cmd.top = nYSrc;
-	cmd.right = cmd.left + nWidth;
-	cmd.bottom = cmd.top + nHeight;
-	cmd.width = nWidth;
-	cmd.height = nHeight;
-
-	id = freerdp_settings_get_uint32(settings, FreeRDP_RemoteFxCodecId);
-#ifdef WITH_GFX_H264
-	const BOOL GfxH264 = freerdp_settings_get_bool(settings, FreeRDP_GfxH264);
-	const BOOL GfxAVC444 = freerdp_settings_get_bool(settings, FreeRDP_GfxAVC444);
-	const BOOL GfxAVC444v2 = freerdp_settings_get_bool(settings, FreeRDP_GfxAVC444v2);
-	if (GfxAVC444 || GfxAVC444v2)
+	for (UINT32 y = 0; y < nHeight; y += stepY)
 	{
-		INT32 rc = 0;
-		RDPGFX_AVC444_BITMAP_STREAM avc444 = { 0 };
-		RECTANGLE_16 regionRect = { 0 };
-		BYTE version = GfxAVC444v2 ? 2 : 1;
+		const BYTE* line = &pSrcData[1ull * y * nSrcStep];
 
-		if (shadow_encoder_prepare(encoder, FREERDP_CODEC_AVC444) < 0)
+		for (UINT32 x = 0; x < nWidth; x += stepX)
 		{
-			WLog_ERR(TAG, "Failed to prepare encoder FREERDP_CODEC_AVC444");
-			return FALSE;
-		}
+			/* 0 marks an empty slot, set the top bit to keep black apart */
+			const UINT32 color =
+			    (FreeRDPReadColor(&line[1ull * x * bpp], SrcFormat) & 0x00FFFFFF) | 0x80000000;
+			UINT32 slot = (color * 2654435761u) >> 22;
 
-		WINPR_ASSERT(cmd.left <= UINT16_MAX);
-		WINPR_ASSERT(cmd.top <= UINT16_MAX);
-		WINPR_ASSERT(cmd.right <= UINT16_MAX);
-		WINPR_ASSERT(cmd.bottom <= UINT16_MAX);
-		regionRect.left = (UINT16)cmd.left;
-		regionRect.top = (UINT16)cmd.top;
-		regionRect.right = (UINT16)cmd.right;
-		regionRect.bottom = (UINT16)cmd.bottom;
-		rc = avc444_compress(encoder->h264, pSrcData, cmd.format, nSrcStep, nWidth, nHeight,
-		                     version, &regionRect, &avc444.LC, &avc444.bitstream[0].data,
-		                     &avc444.bitstream[0].length, &avc444.bitstream[1].data,
-		                     &avc444.bitstream[1].length, &avc444.bitstream[0].meta,
-		                     &avc444.bitstream[1].meta);
-		if (rc < 0)
-		{
-			WLog_ERR(TAG, "avc420_compress failed for avc444");
-			return FALSE;
-		}
+			while ((colors[slot] != 0) && (colors[slot] != color))
+				slot = (slot + 1) % ARRAYSIZE(colors);
 
-		/* rc > 0 means new data */
-		if (rc > 0)
-		{
-			avc444.cbAvc420EncodedBitstream1 = rdpgfx_estimate_h264_avc420(&avc444.bitstream[0]);
-			cmd.codecId = GfxAVC444v2 ? RDPGFX_CODECID_AVC444v2 : RDPGFX_CODECID_AVC444;
-			cmd.extra = (void*)&avc444;
-			IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, &cmd, &cmdstart,
-			          &cmdend);
-		}
+			if (colors[slot] == 0)
+			{
+				colors[slot] = color;
 
-		free_h264_metablock(&avc444.bitstream[0].meta);
-		free_h264_metablock(&avc444.bitstream[1].meta);
-		if (error)
-		{
-			WLog_ERR(TAG, "SurfaceFrameCommand failed with error %" PRIu32 "", error);
-			return FALSE;
+				if (++distinct > maxColors)
+					return FALSE;
+			}
 		}
 	}
-	else if (GfxH264)
-	{
-		INT32 rc = 0;
-		RDPGFX_AVC420_BITMAP_STREAM avc420 = { 0 };
-		RECTANGLE_16 regionRect;
-
-		if (shadow_encoder_prepare(encoder, FREERDP_CODEC_AVC420) < 0)
-		{
-			WLog_ERR(TAG, "Failed to prepare encoder FREERDP_CODEC_AVC420");
-			return FALSE;
-		}
-
-		WINPR_ASSERT(cmd.left <= UINT16_MAX);
-		WINPR_ASSERT(cmd.top <= UINT16_MAX);
-		WINPR_ASSERT(cmd.right <= UINT16_MAX);
-		WINPR_ASSERT(cmd.bottom <= UINT16_MAX);
-		regionRect.left = (UINT16)cmd.left;
-		regionRect.top = (UINT16)cmd.top;
-		regionRect.right = (UINT16)cmd.right;
-		regionRect.bottom = (UINT16)cmd.bottom;
-		rc = avc420_compress(encoder->h264, pSrcData, cmd.format, nSrcStep, nWidth, nHeight,
-		                     &regionRect, &avc420.data, &avc420.length, &avc420.meta);
-		if (rc < 0)
-		{
-			WLog_ERR(TAG, "avc420_compress failed");
-			return FALSE;
-		}
 
-		/* rc > 0 means new data */
-		if (rc > 0)
-		{
-			cmd.codecId = RDPGFX_CODECID_AVC420;
-			cmd.extra = (void*)&avc420;
+	return TRUE;
+}
 
-			IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, &cmd, &cmdstart,
-			          &cmdend);
-		}
-		free_h264_metablock(&avc420.meta);
+/**
+ * Function description
+ * Get the cache for encodings shared with other clients
+ *
+ * @return The cache or NULL if this client encodes on its own
+ */
+static rdpShadowEncodeCache* shadow_client_get_encode_cache(rdpShadowClient* client)
+{
+	WINPR_ASSERT(client);
 
-		if (error)
-		{
-			WLog_ERR(TAG, "SurfaceFrameCommand failed with error %" PRIu32 "", error);
-			return FALSE;
-		}
-	}
-	else
-#endif
-	    if (freerdp_settings_get_bool(settings, FreeRDP_RemoteFxCodec) && (id != 0))
-	{
-		BOOL rc = 0;
-		wStream* s = NULL;
-		RFX_RECT rect;
+	rdpShadowServer* server = client->server;
+	WINPR_ASSERT(server);
 
-		if (shadow_encoder_prepare(encoder, FREERDP_CODEC_REMOTEFX) < 0)
-		{
-			WLog_ERR(TAG, "Failed to prepare encoder FREERDP_CODEC_REMOTEFX");
-			return FALSE;
-		}
+	/* A single client has nobody to share with, do not copy its bitstreams */
+	if (!server->encodeCache || (ArrayList_Count(server->clients) < 2))
+		return NULL;
 
-		s = Stream_New(NULL, 1024);
-		WINPR_ASSERT(s);
+	return server->encodeCache;
+}
 
-		WINPR_ASSERT(cmd.left <= UINT16_MAX);
-		WINPR_ASSERT(cmd.top <= UINT16_MAX);
-		WINPR_ASSERT(cmd.right <= UINT16_MAX);
-		WINPR_ASSERT(cmd.bottom <= UINT16_MAX);
-		rect.x = (UINT16)cmd.left;
-		rect.y = (UINT16)cmd.top;
-		rect.width = WINPR_ASSERTING_INT_CAST(UINT16, cmd.right - cmd.left);
-		rect.height = WINPR_ASSERTING_INT_CAST(UINT16, cmd.bottom - cmd.top);
+static void shadow_client_init_encode_key(rdpShadowClient* client, SHADOW_ENCODE_KEY* key,
+                                          UINT32 codecId, UINT32 cmdType, UINT64 caps,
+                                          UINT32 left, UINT32 top, UINT32 right, UINT32 bottom)
+{
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(key);
 
-		rc = rfx_compose_message(encoder->rfx, s, &rect, 1, pSrcData, nWidth, nHeight, nSrcStep);
+	rdpShadowServer* server = client->server;
+	WINPR_ASSERT(server);
 
-		if (!rc)
-		{
-			WLog_ERR(TAG, "rfx_compose_message failed");
-			Stream_Free(s, TRUE);
-			return FALSE;
-		}
+	key->surface = client->inLobby ? server->lobby : server->surface;
+	key->codecId = codecId;
+	key->cmdType = cmdType;
+	key->caps = caps;
+	key->quality = (codecId == FREERDP_CODEC_REMOTEFX) ? client->encoder->rfxQuality : 0;
+	key->rect.left = WINPR_ASSERTING_INT_CAST(UINT16, left);
+	key->rect.top = WINPR_ASSERTING_INT_CAST(UINT16, top);
+	key->rect.right = WINPR_ASSERTING_INT_CAST(UINT16, right);
+	key->rect.bottom = WINPR_ASSERTING_INT_CAST(UINT16, bottom);
+}
 
-		/* rc > 0 means new data */
-		if (rc > 0)
-		{
-			const size_t pos = Stream_GetPosition(s);
-			WINPR_ASSERT(pos <= UINT32_MAX);
+static BOOL shadow_client_write_encoded_frame(wStream* s, const rdpShadowEncodedFrame* frame,
+                                              size_t index)
+{
+	size_t length = 0;
+	const BYTE* data = shadow_encoded_frame_get(frame, index, &length);
 
-			cmd.codecId = RDPGFX_CODECID_CAVIDEO;
-			cmd.data = Stream_Buffer(s);
-			cmd.length = (UINT32)pos;
+	if (!data || !Stream_EnsureRemainingCapacity(s, length))
+		return FALSE;
 
-			IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, &cmd, &cmdstart,
-			          &cmdend);
-		}
+	Stream_Write(s, data, length);
+	return TRUE;
+}
 
-		Stream_Free(s, TRUE);
-		if (error)
-		{
-			WLog_ERR(TAG, "SurfaceFrameCommand failed with error %" PRIu32 "", error);
-			return FALSE;
-		}
-	}
-	else if (freerdp_settings_get_bool(settings, FreeRDP_GfxProgressive))
-	{
-		INT32 rc = 0;
-		REGION16 region;
-		RECTANGLE_16 regionRect;
+/**
+ * Function description
+ * Compose a RemoteFX message, the frame data is shared with clients using the same parameters.
+ * The RemoteFX headers are always written by the client's own context.
+ *
+ * @return TRUE on success
+ */
+static BOOL shadow_client_compose_rfx_message(rdpShadowClient* client, wStream* s,
+                                              const RFX_RECT* rect, size_t numRects,
+                                              const BYTE* pSrcData, UINT32 nWidth,
+                                              UINT32 nHeight, UINT32 nSrcStep)
+{
+	BOOL rc = FALSE;
+	SHADOW_ENCODE_KEY key = { 0 };
+	rdpShadowEncoder* encoder = client->encoder;
+	rdpShadowEncodeCache* cache = shadow_client_get_encode_cache(client);
+	rdpShadowEncodedFrame* frame = NULL;
 
-		if (shadow_encoder_prepare(encoder, FREERDP_CODEC_PROGRESSIVE) < 0)
-		{
-			WLog_ERR(TAG, "Failed to prepare encoder FREERDP_CODEC_PROGRESSIVE");
-			return FALSE;
-		}
+	/* the cache is keyed by a single rectangle */
+	if (!cache || (numRects != 1))
+		return rfx_compose_message(encoder->rfx, s, rect, numRects, pSrcData, nWidth, nHeight,
+		                           nSrcStep);
 
-		WINPR_ASSERT(cmd.left <= UINT16_MAX);
-		WINPR_ASSERT(cmd.top <= UINT16_MAX);
-		WINPR_ASSERT(cmd.right <= UINT16_MAX);
-		WINPR_ASSERT(cmd.bottom <= UINT16_MAX);
-		regionRect.left = (UINT16)cmd.left;
-		regionRect.top = (UINT16)cmd.top;
-		regionRect.right = (UINT16)cmd.right;
-		regionRect.bottom = (UINT16)cmd.bottom;
-		region16_init(&region);
-		region16_union_rect(&region, &region, &regionRect);
-		rc = progressive_compress(encoder->progressive, pSrcData, nSrcStep * nHeight, cmd.format,
-		                          nWidth, nHeight, nSrcStep, &region, &cmd.data, &cmd.length);
-		region16_uninit(&region);
-		if (rc < 0)
-		{
-			WLog_ERR(TAG, "progressive_compress failed");
-			return FALSE;
-		}
+	/* The RLGR mode and pixel format are server wide and not part of the key */
+	shadow_client_init_encode_key(client, &key, FREERDP_CODEC_REMOTEFX, 0,
+	                              ((UINT64)nWidth << 32) | nHeight, rect->x, rect->y,
+	                              1ull * rect->x + rect->width, 1ull * rect->y + rect->height);
 
-		/* rc > 0 means new data */
-		if (rc > 0)
-		{
-			cmd.codecId = RDPGFX_CODECID_CAPROGRESSIVE;
+	if (!rfx_write_message_header(encoder->rfx, s))
+		return FALSE;
 
-			IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, &cmd, &cmdstart,
-			          &cmdend);
-		}
+	frame = shadow_encode_cache_get(cache, &key);
 
-		if (error)
-		{
-			WLog_ERR(TAG, "SurfaceFrameCommand failed with error %" PRIu32 "", error);
-			return FALSE;
-		}
-	}
-	else if (freerdp_settings_get_bool(settings, FreeRDP_GfxPlanar))
+	if (frame)
 	{
-		BOOL rc = 0;
-		const UINT32 w = cmd.right - cmd.left;
-		const UINT32 h = cmd.bottom - cmd.top;
-		const BYTE* src =
-		    &pSrcData[cmd.top * nSrcStep + cmd.left * FreeRDPGetBytesPerPixel(SrcFormat)];
-		if (shadow_encoder_prepare(encoder, FREERDP_CODEC_PLANAR) < 0)
-		{
-			WLog_ERR(TAG, "Failed to prepare encoder FREERDP_CODEC_PLANAR");
-			return FALSE;
-		}
+		rc = shadow_client_write_encoded_frame(s, frame, 0);
+		shadow_encoded_frame_release(frame);
+		return rc;
+	}
 
-		rc = freerdp_bitmap_planar_context_reset(encoder->planar, w, h);
-		WINPR_ASSERT(rc);
-		freerdp_planar_topdown_image(encoder->planar, TRUE);
+	RFX_MESSAGE* message =
+	    rfx_encode_message(encoder->rfx, rect, 1, pSrcData, nWidth, nHeight, nSrcStep);
 
-		cmd.data = freerdp_bitmap_compress_planar(encoder->planar, src, SrcFormat, w, h, nSrcStep,
-		                                          NULL, &cmd.length);
-		WINPR_ASSERT(cmd.data || (cmd.length == 0));
+	if (!message)
+		return FALSE;
 
-		cmd.codecId = RDPGFX_CODECID_PLANAR;
+	const size_t start = Stream_GetPosition(s);
+	rc = rfx_write_message(encoder->rfx, s, message);
+	rfx_message_free(encoder->rfx, message);
 
-		IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, &cmd, &cmdstart,
-		          &cmdend);
-		free(cmd.data);
-		if (error)
-		{
-			WLog_ERR(TAG, "SurfaceFrameCommand failed with error %" PRIu32 "", error);
-			return FALSE;
-		}
-	}
-	else
+	if (rc && (frame = shadow_encoded_frame_new(&key)))
 	{
-		BOOL rc = 0;
-		const UINT32 w = cmd.right - cmd.left;
-		const UINT32 h = cmd.bottom - cmd.top;
-		const UINT32 length = w * 4 * h;
-		BYTE* data = malloc(length);
+		if (shadow_encoded_frame_append(frame, Stream_Buffer(s) + start,
+		                                Stream_GetPosition(s) - start))
+			(void)shadow_encode_cache_add(cache, frame);
 
-		WINPR_ASSERT(data);
+		shadow_encoded_frame_release(frame);
+	}
 
-		rc = freerdp_image_copy_no_overlap(data, PIXEL_FORMAT_BGRA32, 0, 0, 0, w, h, pSrcData,
-		                                   SrcFormat, nSrcStep, cmd.left, cmd.top, NULL, 0);
-		WINPR_ASSERT(rc);
+	return rc;
+}
+
+typedef struct
+{
+	const BYTE* pSrcData;
+	UINT32 nSrcStep;
+	UINT32 SrcFormat;
+	UINT16 nWidth;
+	UINT16 nHeight;
+	/* NULL for commands sent within an explicit StartFrame / EndFrame pair */
+	const RDPGFX_START_FRAME_PDU* start;
+	const RDPGFX_END_FRAME_PDU* end;
+} SHADOW_GFX_FRAME;
+
+static BOOL shadow_client_send_gfx_command(rdpShadowClient* client, const SHADOW_GFX_FRAME* gfx,
+                                           const RDPGFX_SURFACE_COMMAND* cmd)
+{
+	UINT error = CHANNEL_RC_OK;
 
-		cmd.data = data;
-		cmd.length = length;
-		cmd.codecId = RDPGFX_CODECID_UNCOMPRESSED;
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(gfx);
+	WINPR_ASSERT(cmd);
 
-		IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, &cmd, &cmdstart,
-		          &cmdend);
-		free(data);
-		if (error)
-		{
-			WLog_ERR(TAG, "SurfaceFrameCommand failed with error %" PRIu32 "", error);
-			return FALSE;
-		}
+	IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, cmd, gfx->start,
+	          gfx->end);
+	if (error)
+	{
+		WLog_ERR(TAG, "SurfaceFrameCommand failed with error %" PRIu32 "", error);
+		return FALSE;
 	}
+
 	return TRUE;
 }
 
-static BOOL stream_surface_bits_supported(const rdpSettings* settings)
+static void shadow_client_set_gfx_command_rect(RDPGFX_SURFACE_COMMAND* cmd,
+                                               const RECTANGLE_16* rect)
 {
-	const UINT32 supported =
-	    freerdp_settings_get_uint32(settings, FreeRDP_SurfaceCommandsSupported);
-	return ((supported & SURFCMDS_STREAM_SURFACE_BITS) != 0);
+	WINPR_ASSERT(cmd);
+	WINPR_ASSERT(rect);
+
+	cmd->left = rect->left;
+	cmd->top = rect->top;
+	cmd->right = rect->right;
+	cmd->bottom = rect->bottom;
+	cmd->width = cmd->right - cmd->left;
+	cmd->height = cmd->bottom - cmd->top;
 }
 
-static BOOL set_surface_bits_supported(const rdpSettings* settings)
+#ifdef WITH_GFX_H264
+static BOOL shadow_client_send_gfx_avc444(rdpShadowClient* client, const SHADOW_GFX_FRAME* gfx,
+                                          RDPGFX_SURFACE_COMMAND* cmd, BOOL v2)
 {
-	const UINT32 supported =
-	    freerdp_settings_get_uint32(settings, FreeRDP_SurfaceCommandsSupported);
-	return ((supported & SURFCMDS_SET_SURFACE_BITS) != 0);
-}
+	BOOL sent = TRUE;
+	RDPGFX_AVC444_BITMAP_STREAM avc444 = { 0 };
+	RECTANGLE_16 regionRect = { 0 };
+	rdpShadowEncoder* encoder = client->encoder;
 
-static BOOL is_surface_command_supported(const rdpSettings* settings)
+	if (shadow_encoder_prepare(encoder, FREERDP_CODEC_AVC444) < 0)
+	{
+		WLog_ERR(TAG, "Failed to prepare encoder FREERDP_CODEC_AVC444");
+		return FALSE;
+	}
+
+	WINPR_ASSERT(cmd->left <= UINT16_MAX);
+	WINPR_ASSERT(cmd->top <= UINT16_MAX);
+	WINPR_ASSERT(cmd->right <= UINT16_MAX);
+	WINPR_ASSERT(cmd->bottom <= UINT16_MAX);
+	regionRect.left = (UINT16)cmd->left;
+	regionRect.top = (UINT16)cmd->top;
+	regionRect.right = (UINT16)cmd->right;
+	regionRect.bottom = (UINT16)cmd->bottom;
+	const INT32 rc = avc444_compress(
+	    encoder->h264, gfx->pSrcData, cmd->format, gfx->nSrcStep, gfx->nWidth, gfx->nHeight,
+	    v2 ? 2 : 1, &regionRect, &avc444.LC, &avc444.bitstream[0].data,
+	    &avc444.bitstream[0].length, &avc444.bitstream[1].data, &avc444.bitstream[1].length,
+	    &avc444.bitstream[0].meta, &avc444.bitstream[1].meta);
+	if (rc < 0)
+	{
+		WLog_ERR(TAG, "avc420_compress failed for avc444");
+		return FALSE;
+	}
+
+	/* rc > 0 means new data */
+	if (rc > 0)
+	{
+		avc444.cbAvc420EncodedBitstream1 = rdpgfx_estimate_h264_avc420(&avc444.bitstream[0]);
+		cmd->codecId = v2 ? RDPGFX_CODECID_AVC444v2 : RDPGFX_CODECID_AVC444;
+		cmd->extra = (void*)&avc444;
+		sent = shadow_client_send_gfx_command(client, gfx, cmd);
+		cmd->extra = NULL;
+	}
+
+	free_h264_metablock(&avc444.bitstream[0].meta);
+	free_h264_metablock(&avc444.bitstream[1].meta);
+	return sent;
+}
+
+/* Encodes the whole surface, only macroblocks within regionRect are sent */
+/**
+ * Function description
+ * Restrict the rectangles the client paints from an AVC420 frame to region.
+ * The encoder reports every changed block within the extents of the region,
+ * those outside of it are sent with other codecs.
+ *
+ * @return TRUE on success
+ */
+static BOOL shadow_client_clip_metablock(RDPGFX_H264_METABLOCK* meta, const REGION16* region)
+{
+	UINT32 numRects = 0;
+	UINT32 count = 0;
+	const RECTANGLE_16* rects = region16_rects(region, &numRects);
+
+	if (meta->numRegionRects == 0)
+		return TRUE;
+
+	for (UINT32 x = 0; x < meta->numRegionRects; x++)
+	{
+		for (UINT32 y = 0; y < numRects; y++)
+		{
+			if (rectangles_intersects(&meta->regionRects[x], &rects[y]))
+				count++;
+		}
+	}
+
+	RECTANGLE_16* regionRects = calloc(MAX(count, 1), sizeof(RECTANGLE_16));
+	RDPGFX_H264_QUANT_QUALITY* quantQualityVals =
+	    calloc(MAX(count, 1), sizeof(RDPGFX_H264_QUANT_QUALITY));
+
+	if (!regionRects || !quantQualityVals)
+	{
+		free(regionRects);
+		free(quantQualityVals);
+		return FALSE;
+	}
+
+	count = 0;
+	for (UINT32 x = 0; x < meta->numRegionRects; x++)
+	{
+		for (UINT32 y = 0; y < numRects; y++)
+		{
+			if (!rectangles_intersection(&meta->regionRects[x], &rects[y], &regionRects[count]))
+				continue;
+
+			quantQualityVals[count++] = meta->quantQualityVals[x];
+		}
+	}
+
+	free(meta->regionRects);
+	free(meta->quantQualityVals);
+	meta->regionRects = regionRects;
+	meta->quantQualityVals = quantQualityVals;
+	meta->numRegionRects = count;
+	return TRUE;
+}
+
+static BOOL shadow_client_send_gfx_avc420(rdpShadowClient* client, const SHADOW_GFX_FRAME* gfx,
+                                          RDPGFX_SURFACE_COMMAND* cmd,
+                                          const RECTANGLE_16* regionRect, const REGION16* region)
+{
+	BOOL sent = TRUE;
+	RDPGFX_AVC420_BITMAP_STREAM avc420 = { 0 };
+	rdpShadowEncoder* encoder = client->encoder;
+
+	if (shadow_encoder_prepare(encoder, FREERDP_CODEC_AVC420) < 0)
+	{
+		WLog_ERR(TAG, "Failed to prepare encoder FREERDP_CODEC_AVC420");
+		return FALSE;
+	}
+
+	const INT32 rc = avc420_compress(encoder->h264, gfx->pSrcData, cmd->format, gfx->nSrcStep,
+	                                 gfx->nWidth, gfx->nHeight, regionRect, &avc420.data,
+	                                 &avc420.length, &avc420.meta);
+	if (rc < 0)
+	{
+		WLog_ERR(TAG, "avc420_compress failed");
+		return FALSE;
+	}
+
+	/* the frame is sent even if nothing is left to paint, the decoder needs it */
+	if ((rc > 0) && region && !shadow_client_clip_metablock(&avc420.meta, region))
+		sent = FALSE;
+
+	/* rc > 0 means new data */
+	if (sent && (rc > 0))
+	{
+		cmd->codecId = RDPGFX_CODECID_AVC420;
+		cmd->extra = (void*)&avc420;
+		sent = shadow_client_send_gfx_command(client, gfx, cmd);
+		cmd->extra = NULL;
+	}
+
+	free_h264_metablock(&avc420.meta);
+	return sent;
+}
+#endif
+
+static BOOL shadow_client_send_gfx_clear(rdpShadowClient* client, const SHADOW_GFX_FRAME* gfx,
+                                         RDPGFX_SURFACE_COMMAND* cmd, const RECTANGLE_16* rect)
+{
+	rdpShadowEncoder* encoder = client->encoder;
+
+	/* ClearCodec is lossless and only needs the damaged area */
+	shadow_client_set_gfx_command_rect(cmd, rect);
+
+	const BYTE* src = &gfx->pSrcData[1ull * cmd->top * gfx->nSrcStep +
+	                                 1ull * cmd->left * FreeRDPGetBytesPerPixel(gfx->SrcFormat)];
+
+	if (shadow_encoder_prepare(encoder, FREERDP_CODEC_CLEARCODEC) < 0)
+	{
+		WLog_ERR(TAG, "Failed to prepare encoder FREERDP_CODEC_CLEARCODEC");
+		return FALSE;
+	}
+
+	Stream_SetPosition(encoder->bs, 0);
+	const int rc = clear_compress_to_stream(encoder->clear, encoder->bs, src, gfx->SrcFormat,
+	                                        gfx->nSrcStep, cmd->width, cmd->height);
+	if (rc < 0)
+	{
+		WLog_ERR(TAG, "clear_compress_to_stream failed");
+		return FALSE;
+	}
+
+	const size_t pos = Stream_GetPosition(encoder->bs);
+	WINPR_ASSERT(pos <= UINT32_MAX);
+
+	cmd->codecId = RDPGFX_CODECID_CLEARCODEC;
+	cmd->data = Stream_Buffer(encoder->bs);
+	cmd->length = (UINT32)pos;
+	return shadow_client_send_gfx_command(client, gfx, cmd);
+}
+
+static BOOL shadow_client_send_gfx_rfx(rdpShadowClient* client, const SHADOW_GFX_FRAME* gfx,
+                                       RDPGFX_SURFACE_COMMAND* cmd, const RECTANGLE_16* rects,
+                                       UINT32 numRects)
+{
+	if (shadow_encoder_prepare(client->encoder, FREERDP_CODEC_REMOTEFX) < 0)
+	{
+		WLog_ERR(TAG, "Failed to prepare encoder FREERDP_CODEC_REMOTEFX");
+		return FALSE;
+	}
+
+	RFX_RECT* rfxRects = calloc(MAX(numRects, 1), sizeof(RFX_RECT));
+	wStream* s = Stream_New(NULL, 1024);
+
+	if (!rfxRects || !s)
+	{
+		free(rfxRects);
+		Stream_Free(s, TRUE);
+		return FALSE;
+	}
+
+	for (UINT32 index = 0; index < numRects; index++)
+	{
+		const RECTANGLE_16* rect = &rects[index];
+		rfxRects[index].x = rect->left;
+		rfxRects[index].y = rect->top;
+		rfxRects[index].width = WINPR_ASSERTING_INT_CAST(UINT16, rect->right - rect->left);
+		rfxRects[index].height = WINPR_ASSERTING_INT_CAST(UINT16, rect->bottom - rect->top);
+	}
+
+	const BOOL composed =
+	    shadow_client_compose_rfx_message(client, s, rfxRects, numRects, gfx->pSrcData,
+	                                      gfx->nWidth, gfx->nHeight, gfx->nSrcStep);
+	free(rfxRects);
+
+	if (!composed)
+	{
+		WLog_ERR(TAG, "rfx_compose_message failed");
+		Stream_Free(s, TRUE);
+		return FALSE;
+	}
+
+	const size_t pos = Stream_GetPosition(s);
+	WINPR_ASSERT(pos <= UINT32_MAX);
+
+	cmd->codecId = RDPGFX_CODECID_CAVIDEO;
+	cmd->data = Stream_Buffer(s);
+	cmd->length = (UINT32)pos;
+
+	const BOOL sent = shadow_client_send_gfx_command(client, gfx, cmd);
+	Stream_Free(s, TRUE);
+	return sent;
+}
+
+static BOOL shadow_client_send_gfx_progressive(rdpShadowClient* client,
+                                               const SHADOW_GFX_FRAME* gfx,
+                                               RDPGFX_SURFACE_COMMAND* cmd, const REGION16* region)
+{
+	rdpShadowEncoder* encoder = client->encoder;
+
+	if (shadow_encoder_prepare(encoder, FREERDP_CODEC_PROGRESSIVE) < 0)
+	{
+		WLog_ERR(TAG, "Failed to prepare encoder FREERDP_CODEC_PROGRESSIVE");
+		return FALSE;
+	}
+
+	const int rc = progressive_compress_surface(
+	    encoder->progressive, client->surfaceId, gfx->pSrcData, gfx->nSrcStep * gfx->nHeight,
+	    cmd->format, gfx->nWidth, gfx->nHeight, gfx->nSrcStep, region, &cmd->data, &cmd->length);
+	if (rc < 0)
+	{
+		WLog_ERR(TAG, "progressive_compress_surface failed");
+		return FALSE;
+	}
+
+	/* rc > 0 means new data */
+	if (rc == 0)
+		return TRUE;
+
+	cmd->codecId = RDPGFX_CODECID_CAPROGRESSIVE;
+	return shadow_client_send_gfx_command(client, gfx, cmd);
+}
+
+static BOOL shadow_client_send_gfx_planar(rdpShadowClient* client, const SHADOW_GFX_FRAME* gfx,
+                                          RDPGFX_SURFACE_COMMAND* cmd, const RECTANGLE_16* rect)
+{
+	const rdpSettings* settings = client->context.settings;
+	rdpShadowEncoder* encoder = client->encoder;
+	SHADOW_ENCODE_KEY key = { 0 };
+	rdpShadowEncodeCache* cache = shadow_client_get_encode_cache(client);
+	rdpShadowEncodedFrame* frame = NULL;
+
+	shadow_client_set_gfx_command_rect(cmd, rect);
+
+	const UINT32 w = cmd->width;
+	const UINT32 h = cmd->height;
+	const BYTE* src = &gfx->pSrcData[1ull * cmd->top * gfx->nSrcStep +
+	                                 1ull * cmd->left * FreeRDPGetBytesPerPixel(gfx->SrcFormat)];
+
+	shadow_client_init_encode_key(
+	    client, &key, FREERDP_CODEC_PLANAR, 0,
+	    freerdp_settings_get_bool(settings, FreeRDP_DrawAllowSkipAlpha) ? 1 : 0, cmd->left,
+	    cmd->top, cmd->right, cmd->bottom);
+
+	if (cache)
+		frame = shadow_encode_cache_get(cache, &key);
+
+	if (frame)
+	{
+		size_t length = 0;
+		cmd->data =
+		    WINPR_CAST_CONST_PTR_AWAY(shadow_encoded_frame_get(frame, 0, &length), BYTE*);
+		cmd->length = WINPR_ASSERTING_INT_CAST(UINT32, length);
+	}
+	else
+	{
+		if (shadow_encoder_prepare(encoder, FREERDP_CODEC_PLANAR) < 0)
+		{
+			WLog_ERR(TAG, "Failed to prepare encoder FREERDP_CODEC_PLANAR");
+			return FALSE;
+		}
+
+		if (!freerdp_bitmap_planar_context_reset(encoder->planar, w, h))
+		{
+			WLog_ERR(TAG, "freerdp_bitmap_planar_context_reset failed");
+			return FALSE;
+		}
+		freerdp_planar_topdown_image(encoder->planar, TRUE);
+
+		cmd->data = freerdp_bitmap_compress_planar(encoder->planar, src, gfx->SrcFormat, w, h,
+		                                           gfx->nSrcStep, NULL, &cmd->length);
+		WINPR_ASSERT(cmd->data || (cmd->length == 0));
+
+		if (cache && cmd->data && (frame = shadow_encoded_frame_new(&key)))
+		{
+			if (shadow_encoded_frame_append(frame, cmd->data, cmd->length))
+				(void)shadow_encode_cache_add(cache, frame);
+
+			shadow_encoded_frame_release(frame);
+			frame = NULL;
+		}
+	}
+
+	cmd->codecId = RDPGFX_CODECID_PLANAR;
+
+	const BOOL sent = shadow_client_send_gfx_command(client, gfx, cmd);
+
+	if (frame)
+		shadow_encoded_frame_release(frame);
+	else
+		free(cmd->data);
+	cmd->data = NULL;
+	return sent;
+}
+
+static BOOL shadow_client_send_gfx_uncompressed(rdpShadowClient* client,
+                                                const SHADOW_GFX_FRAME* gfx,
+                                                RDPGFX_SURFACE_COMMAND* cmd,
+                                                const RECTANGLE_16* rect)
+{
+	shadow_client_set_gfx_command_rect(cmd, rect);
+
+	const UINT32 w = cmd->width;
+	const UINT32 h = cmd->height;
+	const UINT32 length = w * 4 * h;
+	BYTE* data = malloc(length);
+
+	if (!data)
+		return FALSE;
+
+	if (!freerdp_image_copy_no_overlap(data, PIXEL_FORMAT_BGRA32, 0, 0, 0, w, h, gfx->pSrcData,
+	                                   gfx->SrcFormat, gfx->nSrcStep, cmd->left, cmd->top, NULL,
+	                                   0))
+	{
+		free(data);
+		return FALSE;
+	}
+
+	cmd->data = data;
+	cmd->length = length;
+	cmd->codecId = RDPGFX_CODECID_UNCOMPRESSED;
+
+	const BOOL sent = shadow_client_send_gfx_command(client, gfx, cmd);
+	free(data);
+	cmd->data = NULL;
+	return sent;
+}
+
+static BOOL shadow_client_merge_region(REGION16* dst, REGION16* src)
+{
+	UINT32 numRects = 0;
+	const RECTANGLE_16* rects = region16_rects(src, &numRects);
+
+	for (UINT32 index = 0; index < numRects; index++)
+	{
+		if (!region16_union_rect(dst, dst, &rects[index]))
+			return FALSE;
+	}
+
+	region16_clear(src);
+	return TRUE;
+}
+
+/**
+ * Function description
+ * Find the parts of the damaged region that moved within the client surface and
+ * the region left to be encoded. Progressive tiles waiting for upgrades are
+ * encoded again: an upgrade would paint over a copy into them and a copy out of
+ * them would stay at the coarse quality.
+ *
+ * @return TRUE on success
+ */
+static BOOL shadow_client_detect_motion(rdpShadowClient* client, const SHADOW_GFX_FRAME* gfx,
+                                        const REGION16* damage, SHADOW_MOTION_MOVE* moves,
+                                        size_t maxMoves, size_t* count, REGION16* remaining)
+{
+	BOOL rc = FALSE;
+	REGION16 pending;
+	rdpShadowEncoder* encoder = client->encoder;
+
+	*count = 0;
+
+	if (!region16_copy(remaining, damage))
+		return FALSE;
+
+	if (!client->rdpgfx->SurfaceToSurface)
+		return TRUE;
+
+	if (!shadow_motion_detect(encoder->motion, gfx->pSrcData, gfx->SrcFormat, gfx->nSrcStep,
+	                          gfx->nWidth, gfx->nHeight, damage, moves, maxMoves, count))
+		return FALSE;
+
+	if (*count == 0)
+		return TRUE;
+
+	region16_init(&pending);
+
+	if (encoder->progressive &&
+	    !progressive_get_pending_region(encoder->progressive, client->surfaceId, &pending))
+		goto out;
+
+	for (size_t index = 0; index < *count; index++)
+	{
+		if (!shadow_motion_region_subtract(remaining, &moves[index].rect))
+			goto out;
+	}
+
+	for (size_t index = 0; (index < *count) && !region16_is_empty(&pending); index++)
+	{
+		UINT32 numRects = 0;
+		REGION16 part;
+		const SHADOW_MOTION_MOVE* move = &moves[index];
+		const RECTANGLE_16 source = {
+			WINPR_ASSERTING_INT_CAST(UINT16, move->rect.left - move->dx),
+			WINPR_ASSERTING_INT_CAST(UINT16, move->rect.top - move->dy),
+			WINPR_ASSERTING_INT_CAST(UINT16, move->rect.right - move->dx),
+			WINPR_ASSERTING_INT_CAST(UINT16, move->rect.bottom - move->dy)
+		};
+
+		region16_init(&part);
+		BOOL added = region16_intersect_rect(&part, &pending, &move->rect);
+		const RECTANGLE_16* rects = region16_rects(&part, &numRects);
+
+		/* the whole tile is painted by an upgrade */
+		for (UINT32 x = 0; added && (x < numRects); x++)
+		{
+			const RECTANGLE_16 tile = {
+				WINPR_ASSERTING_INT_CAST(UINT16, rects[x].left & ~63u),
+				WINPR_ASSERTING_INT_CAST(UINT16, rects[x].top & ~63u),
+				WINPR_ASSERTING_INT_CAST(UINT16, MIN((rects[x].right + 63u) & ~63u, gfx->nWidth)),
+				WINPR_ASSERTING_INT_CAST(UINT16,
+				                         MIN((rects[x].bottom + 63u) & ~63u, gfx->nHeight))
+			};
+			added = region16_union_rect(remaining, remaining, &tile);
+		}
+
+		if (added)
+			added = region16_intersect_rect(&part, &pending, &source);
+
+		rects = region16_rects(&part, &numRects);
+		for (UINT32 x = 0; added && (x < numRects); x++)
+		{
+			const RECTANGLE_16 copied = {
+				WINPR_ASSERTING_INT_CAST(UINT16, rects[x].left + move->dx),
+				WINPR_ASSERTING_INT_CAST(UINT16, rects[x].top + move->dy),
+				WINPR_ASSERTING_INT_CAST(UINT16, rects[x].right + move->dx),
+				WINPR_ASSERTING_INT_CAST(UINT16, rects[x].bottom + move->dy)
+			};
+			added = region16_union_rect(remaining, remaining, &copied);
+		}
+
+		region16_uninit(&part);
+		if (!added)
+			goto out;
+	}
+
+	rc = TRUE;
+out:
+	region16_uninit(&pending);
+	return rc;
+}
+
+static BOOL shadow_client_send_gfx_moves(rdpShadowClient* client, const SHADOW_MOTION_MOVE* moves,
+                                         size_t count)
+{
+	for (size_t index = 0; index < count; index++)
+	{
+		UINT error = CHANNEL_RC_OK;
+		const SHADOW_MOTION_MOVE* move = &moves[index];
+		RDPGFX_POINT16 destPt = { move->rect.left, move->rect.top };
+		RDPGFX_SURFACE_TO_SURFACE_PDU pdu = { 0 };
+
+		pdu.surfaceIdSrc = client->surfaceId;
+		pdu.surfaceIdDest = client->surfaceId;
+		pdu.rectSrc.left = WINPR_ASSERTING_INT_CAST(UINT16, move->rect.left - move->dx);
+		pdu.rectSrc.top = WINPR_ASSERTING_INT_CAST(UINT16, move->rect.top - move->dy);
+		pdu.rectSrc.right = WINPR_ASSERTING_INT_CAST(UINT16, move->rect.right - move->dx);
+		pdu.rectSrc.bottom = WINPR_ASSERTING_INT_CAST(UINT16, move->rect.bottom - move->dy);
+		pdu.destPtsCount = 1;
+		pdu.destPts = &destPt;
+
+		IFCALLRET(client->rdpgfx->SurfaceToSurface, error, client->rdpgfx, &pdu);
+		if (error)
+		{
+			WLog_ERR(TAG, "SurfaceToSurface failed with error %" PRIu32 "", error);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/*
+ * Single color tiles are filled by the client and left out of the damage to encode.
+ * Tiles waiting for a progressive upgrade are skipped, the upgrade would paint over them.
+ */
+static BOOL shadow_client_detect_solid(rdpShadowClient* client, const SHADOW_GFX_FRAME* gfx,
+                                       const REGION16* pending, REGION16* remaining,
+                                       SHADOW_SOLID_FILL** fills, size_t* count)
+{
+	*fills = NULL;
+	*count = 0;
+
+	if (!client->rdpgfx->SolidFill)
+		return TRUE;
+
+	if (!shadow_solid_detect(client->encoder->solid, gfx->pSrcData, gfx->SrcFormat,
+	                         gfx->nSrcStep, gfx->nWidth, gfx->nHeight, remaining, pending, fills,
+	                         count))
+		return FALSE;
+
+	for (size_t index = 0; index < *count; index++)
+	{
+		if (!shadow_motion_region_subtract(remaining, &(*fills)[index].rect))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL shadow_client_send_gfx_solid_fills(rdpShadowClient* client,
+                                               const SHADOW_GFX_FRAME* gfx,
+                                               const SHADOW_SOLID_FILL* fills, size_t count)
+{
+	RECTANGLE_16 rects[64] = { 0 };
+
+	/* the fills come ordered by color, one command fills all rectangles of a color */
+	for (size_t index = 0; index < count;)
+	{
+		UINT error = CHANNEL_RC_OK;
+		BYTE r = 0;
+		BYTE g = 0;
+		BYTE b = 0;
+		RDPGFX_SOLID_FILL_PDU pdu = { 0 };
+		const UINT32 color = fills[index].color;
+
+		while ((index < count) && (fills[index].color == color) &&
+		       (pdu.fillRectCount < ARRAYSIZE(rects)))
+			rects[pdu.fillRectCount++] = fills[index++].rect;
+
+		FreeRDPSplitColor(FreeRDPReadColor((const BYTE*)&color, gfx->SrcFormat), gfx->SrcFormat,
+		                  &r, &g, &b, NULL, NULL);
+		pdu.surfaceId = client->surfaceId;
+		pdu.fillPixel.R = r;
+		pdu.fillPixel.G = g;
+		pdu.fillPixel.B = b;
+		pdu.fillPixel.XA = 0xFF;
+		pdu.fillRects = rects;
+
+		IFCALLRET(client->rdpgfx->SolidFill, error, client->rdpgfx, &pdu);
+		if (error)
+		{
+			WLog_ERR(TAG, "SolidFill failed with error %" PRIu32 "", error);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* tiles the client has cached are copied from there and left out of the damage to encode */
+static BOOL shadow_client_lookup_gfx_cache(rdpShadowClient* client, const SHADOW_GFX_FRAME* gfx,
+                                           const REGION16* pending, REGION16* remaining,
+                                           SHADOW_GFX_CACHE_TILE** tiles, size_t* count)
+{
+	*tiles = NULL;
+	*count = 0;
+
+	if (!client->rdpgfx->CacheToSurface || !client->rdpgfx->SurfaceToCache)
+		return TRUE;
+
+	if (!shadow_gfx_cache_lookup(client->encoder->gfxCache, gfx->pSrcData, gfx->SrcFormat,
+	                             gfx->nSrcStep, gfx->nWidth, gfx->nHeight, remaining, tiles,
+	                             count))
+		return FALSE;
+
+	for (size_t index = 0; index < *count; index++)
+	{
+		SHADOW_GFX_CACHE_TILE* tile = &(*tiles)[index];
+
+		if (!tile->slot)
+			continue;
+
+		/* an upgrade still to come would paint over the copy */
+		if (region16_intersects_rect(pending, &tile->rect))
+			tile->slot = 0;
+		else if (!shadow_motion_region_subtract(remaining, &tile->rect))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL shadow_client_send_gfx_cache_hits(rdpShadowClient* client,
+                                              const SHADOW_GFX_CACHE_TILE* tiles, size_t count)
+{
+	for (size_t index = 0; index < count; index++)
+	{
+		UINT error = CHANNEL_RC_OK;
+		const SHADOW_GFX_CACHE_TILE* tile = &tiles[index];
+		RDPGFX_POINT16 destPt = { tile->rect.left, tile->rect.top };
+		RDPGFX_CACHE_TO_SURFACE_PDU pdu = { 0 };
+
+		if (!tile->slot)
+			continue;
+
+		pdu.cacheSlot = tile->slot;
+		pdu.surfaceId = client->surfaceId;
+		pdu.destPtsCount = 1;
+		pdu.destPts = &destPt;
+
+		IFCALLRET(client->rdpgfx->CacheToSurface, error, client->rdpgfx, &pdu);
+		if (error)
+		{
+			WLog_ERR(TAG, "CacheToSurface failed with error %" PRIu32 "", error);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* only tiles sent lossless are cached, the key stands for their exact pixels */
+static BOOL shadow_client_send_gfx_cache_stores(rdpShadowClient* client,
+                                                const SHADOW_GFX_CACHE_TILE* tiles, size_t count,
+                                                const REGION16* lossless)
+{
+	rdpShadowGfxCache* cache = client->encoder->gfxCache;
+
+	for (size_t index = 0; index < count; index++)
+	{
+		UINT error = CHANNEL_RC_OK;
+		UINT16 evicted = 0;
+		const SHADOW_GFX_CACHE_TILE* tile = &tiles[index];
+		const UINT32 size = 4u * (tile->rect.right - tile->rect.left) *
+		                    (tile->rect.bottom - tile->rect.top);
+		RDPGFX_SURFACE_TO_CACHE_PDU pdu = { 0 };
+
+		if (tile->slot || !shadow_gfx_cache_covered(lossless, &tile->rect))
+			continue;
+
+		pdu.cacheSlot = shadow_gfx_cache_add(cache, tile->key, size);
+		if (!pdu.cacheSlot)
+			continue;
+
+		while (shadow_gfx_cache_next_evicted(cache, &evicted))
+		{
+			const RDPGFX_EVICT_CACHE_ENTRY_PDU evict = { evicted };
+
+			IFCALLRET(client->rdpgfx->EvictCacheEntry, error, client->rdpgfx, &evict);
+			if (error)
+			{
+				WLog_ERR(TAG, "EvictCacheEntry failed with error %" PRIu32 "", error);
+				return FALSE;
+			}
+		}
+
+		pdu.surfaceId = client->surfaceId;
+		pdu.cacheKey = tile->key;
+		pdu.rectSrc = tile->rect;
+
+		IFCALLRET(client->rdpgfx->SurfaceToCache, error, client->rdpgfx, &pdu);
+		if (error)
+		{
+			WLog_ERR(TAG, "SurfaceToCache failed with error %" PRIu32 "", error);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * Function description
+ * Send the damaged region within a single frame. Scrolled or moved content is
+ * copied within the client surface first, then single color tiles are filled
+ * and tiles the client has cached are copied. Tiles sent lossless are cached
+ * afterwards.
+ * With mixed codecs a codec is picked per tile: video goes to AVC420, images to
+ * progressive (or RemoteFX) and text or flat UI to ClearCodec (or planar).
+ * Content without a negotiated codec falls back to the next kind.
+ * Otherwise the rest of the region goes to the first negotiated codec of AVC420,
+ * ClearCodec for low entropy content, RemoteFX, progressive and planar.
+ *
+ * @return TRUE on success
+ */
+static BOOL shadow_client_send_surface_gfx_region(rdpShadowClient* client, SHADOW_GFX_FRAME* gfx,
+                                                  const RDPGFX_SURFACE_COMMAND* cmd,
+                                                  const REGION16* damage)
+{
+	BOOL rc = FALSE;
+	UINT error = CHANNEL_RC_OK;
+	UINT32 numRects = 0;
+	size_t numMoves = 0;
+	size_t numFills = 0;
+	size_t numTiles = 0;
+	SHADOW_SOLID_FILL* fills = NULL;
+	SHADOW_GFX_CACHE_TILE* tiles = NULL;
+	REGION16 remaining;
+	REGION16 pending;
+	REGION16 regions[SHADOW_CONTENT_COUNT] = { 0 };
+	SHADOW_MOTION_MOVE moves[SHADOW_MOTION_MAX_MOVES] = { 0 };
+	const rdpSettings* settings = client->context.settings;
+	const RDPGFX_START_FRAME_PDU* start = gfx->start;
+	const RDPGFX_END_FRAME_PDU* end = gfx->end;
+
+	region16_init(&remaining);
+	region16_init(&pending);
+	for (size_t x = 0; x < ARRAYSIZE(regions); x++)
+		region16_init(&regions[x]);
+
+	BOOL video = FALSE;
+#ifdef WITH_GFX_H264
+	video = freerdp_settings_get_bool(settings, FreeRDP_GfxH264);
+#endif
+	const BOOL mixed = freerdp_settings_get_bool(settings, FreeRDP_GfxMixedCodecs);
+	const BOOL rfx = freerdp_settings_get_bool(settings, FreeRDP_RemoteFxCodec) &&
+	                 (freerdp_settings_get_uint32(settings, FreeRDP_RemoteFxCodecId) != 0);
+	BOOL progressive = freerdp_settings_get_bool(settings, FreeRDP_GfxProgressive);
+	BOOL clear = freerdp_settings_get_bool(settings, FreeRDP_GfxClearCodec);
+
+	if (!shadow_client_detect_motion(client, gfx, damage, moves, ARRAYSIZE(moves), &numMoves,
+	                                 &remaining))
+		goto out;
+
+	if (client->encoder->progressive &&
+	    !progressive_get_pending_region(client->encoder->progressive, client->surfaceId, &pending))
+		goto out;
+
+	if (!shadow_client_detect_solid(client, gfx, &pending, &remaining, &fills, &numFills))
+		goto out;
+
+	if (!shadow_client_lookup_gfx_cache(client, gfx, &pending, &remaining, &tiles, &numTiles))
+		goto out;
+
+	if (mixed)
+	{
+		if (!shadow_classifier_classify(client->encoder->classifier, gfx->pSrcData,
+		                                gfx->SrcFormat, gfx->nSrcStep, gfx->nWidth, gfx->nHeight,
+		                                &remaining, regions))
+			goto out;
+
+		if (!video && !shadow_client_merge_region(&regions[SHADOW_CONTENT_IMAGE],
+		                                          &regions[SHADOW_CONTENT_VIDEO]))
+			goto out;
+
+		if (!progressive && !rfx &&
+		    !shadow_client_merge_region(&regions[SHADOW_CONTENT_TEXT],
+		                                &regions[SHADOW_CONTENT_IMAGE]))
+			goto out;
+	}
+	else if (!region16_is_empty(&remaining))
+	{
+		SHADOW_CONTENT type = SHADOW_CONTENT_TEXT;
+		const RECTANGLE_16* dirty = region16_extents(&remaining);
+
+		if (video)
+			type = SHADOW_CONTENT_VIDEO;
+		else if (clear &&
+		         shadow_client_is_low_entropy(
+		             &gfx->pSrcData[1ull * dirty->top * gfx->nSrcStep +
+		                            1ull * dirty->left * FreeRDPGetBytesPerPixel(gfx->SrcFormat)],
+		             gfx->SrcFormat, gfx->nSrcStep, dirty->right - dirty->left,
+		             dirty->bottom - dirty->top))
+			type = SHADOW_CONTENT_TEXT;
+		else if (rfx || progressive)
+		{
+			/* RemoteFX goes first with a single codec */
+			progressive = !rfx;
+			type = SHADOW_CONTENT_IMAGE;
+		}
+		else
+			clear = FALSE;
+
+		if (!shadow_client_merge_region(&regions[type], &remaining))
+			goto out;
+	}
+
+	/* an upgrade repaints whole tiles from the state of the progressive encoder */
+	if (progressive &&
+	    (!shadow_classifier_route_pending(&regions[SHADOW_CONTENT_TEXT],
+	                                      &regions[SHADOW_CONTENT_IMAGE], &pending) ||
+	     !shadow_classifier_route_pending(&regions[SHADOW_CONTENT_VIDEO],
+	                                      &regions[SHADOW_CONTENT_IMAGE], &pending)))
+		goto out;
+
+	IFCALLRET(client->rdpgfx->StartFrame, error, client->rdpgfx, start);
+	if (error)
+	{
+		WLog_ERR(TAG, "StartFrame failed with error %" PRIu32 "", error);
+		goto out;
+	}
+
+	gfx->start = NULL;
+	gfx->end = NULL;
+
+	/* the client applies the commands of a frame in order, copies read what it had before */
+	if (!shadow_client_send_gfx_moves(client, moves, numMoves))
+		goto out;
+
+	if (!shadow_client_send_gfx_solid_fills(client, gfx, fills, numFills))
+		goto out;
+
+	if (!shadow_client_send_gfx_cache_hits(client, tiles, numTiles))
+		goto out;
+
+	/* video goes before the other codecs */
+#ifdef WITH_GFX_H264
+	if (!region16_is_empty(&regions[SHADOW_CONTENT_VIDEO]))
+	{
+		RDPGFX_SURFACE_COMMAND part = *cmd;
+		if (!shadow_client_send_gfx_avc420(client, gfx, &part,
+		                                   region16_extents(&regions[SHADOW_CONTENT_VIDEO]),
+		                                   &regions[SHADOW_CONTENT_VIDEO]))
+			goto out;
+	}
+#endif
+
+	if (!region16_is_empty(&regions[SHADOW_CONTENT_IMAGE]))
+	{
+		BOOL sent = FALSE;
+		RDPGFX_SURFACE_COMMAND part = *cmd;
+
+		if (progressive)
+			sent = shadow_client_send_gfx_progressive(client, gfx, &part,
+			                                          &regions[SHADOW_CONTENT_IMAGE]);
+		else
+		{
+			const RECTANGLE_16* images =
+			    region16_rects(&regions[SHADOW_CONTENT_IMAGE], &numRects);
+			sent = shadow_client_send_gfx_rfx(client, gfx, &part, images, numRects);
+		}
+		if (!sent)
+			goto out;
+	}
+
+	const RECTANGLE_16* rects = region16_rects(&regions[SHADOW_CONTENT_TEXT], &numRects);
+	for (UINT32 index = 0; index < numRects; index++)
+	{
+		BOOL sent = FALSE;
+		RDPGFX_SURFACE_COMMAND part = *cmd;
+
+		if (clear)
+			sent = shadow_client_send_gfx_clear(client, gfx, &part, &rects[index]);
+		else if (freerdp_settings_get_bool(settings, FreeRDP_GfxPlanar))
+			sent = shadow_client_send_gfx_planar(client, gfx, &part, &rects[index]);
+		else
+			sent = shadow_client_send_gfx_uncompressed(client, gfx, &part, &rects[index]);
+		if (!sent)
+			goto out;
+	}
+
+	if (!shadow_client_send_gfx_cache_stores(client, tiles, numTiles,
+	                                         &regions[SHADOW_CONTENT_TEXT]))
+		goto out;
+
+	IFCALLRET(client->rdpgfx->EndFrame, error, client->rdpgfx, end);
+	if (error)
+	{
+		WLog_ERR(TAG, "EndFrame failed with error %" PRIu32 "", error);
+		goto out;
+	}
+
+	rc = shadow_motion_update(client->encoder->motion, gfx->pSrcData, gfx->SrcFormat,
+	                          gfx->nSrcStep, gfx->nWidth, gfx->nHeight, damage);
+out:
+	/* a frame failing half way leaves the content of the client surface unknown */
+	if (!rc)
+		shadow_motion_reset(client->encoder->motion);
+
+	region16_uninit(&remaining);
+	region16_uninit(&pending);
+	for (size_t x = 0; x < ARRAYSIZE(regions); x++)
+		region16_uninit(&regions[x]);
+	return rc;
+}
+
+/**
+ * Function description
+ *
+ * @return TRUE on success
+ */
+static BOOL shadow_client_send_surface_gfx(rdpShadowClient* client, const BYTE* pSrcData,
+                                           UINT32 nSrcStep, UINT32 SrcFormat, UINT16 nXSrc,
+                                           UINT16 nYSrc, UINT16 nWidth, UINT16 nHeight,
+                                           const REGION16* damage)
+{
+	const rdpContext* context = (const rdpContext*)client;
+	const rdpSettings* settings = NULL;
+	rdpShadowEncoder* encoder = NULL;
+	RDPGFX_SURFACE_COMMAND cmd = { 0 };
+	RDPGFX_START_FRAME_PDU cmdstart = { 0 };
+	RDPGFX_END_FRAME_PDU cmdend = { 0 };
+	RECTANGLE_16 regionRect = { 0 };
+	SYSTEMTIME sTime = { 0 };
+
+	if (!context || !pSrcData)
+		return FALSE;
+
+	settings = context->settings;
+	encoder = client->encoder;
+
+	if (!settings || !encoder)
+		return FALSE;
+
+	if (client->first_frame)
+	{
+		rfx_context_reset(encoder->rfx, nWidth, nHeight);
+		client->first_frame = FALSE;
+	}
+
+	cmdstart.frameId = shadow_encoder_create_frame_id(encoder);
+	GetSystemTime(&sTime);
+	cmdstart.timestamp = (UINT32)(sTime.wHour << 22U | sTime.wMinute << 16U | sTime.wSecond << 10U |
+	                              sTime.wMilliseconds);
+	cmdend.frameId = cmdstart.frameId;
+	cmd.surfaceId = client->surfaceId;
+	cmd.format = PIXEL_FORMAT_BGRX32;
+	cmd.left = nXSrc;
+	cmd.top = nYSrc;
+	cmd.right = cmd.left + nWidth;
+	cmd.bottom = cmd.top + nHeight;
+	cmd.width = nWidth;
+	cmd.height = nHeight;
+
+	WINPR_ASSERT(cmd.right <= UINT16_MAX);
+	WINPR_ASSERT(cmd.bottom <= UINT16_MAX);
+	regionRect.left = nXSrc;
+	regionRect.top = nYSrc;
+	regionRect.right = (UINT16)cmd.right;
+	regionRect.bottom = (UINT16)cmd.bottom;
+
+	SHADOW_GFX_FRAME gfx = { pSrcData, nSrcStep, SrcFormat, nWidth, nHeight, &cmdstart, &cmdend };
+
+#ifdef WITH_GFX_H264
+	const BOOL GfxAVC444 = freerdp_settings_get_bool(settings, FreeRDP_GfxAVC444);
+	const BOOL GfxAVC444v2 = freerdp_settings_get_bool(settings, FreeRDP_GfxAVC444v2);
+	if (GfxAVC444 || GfxAVC444v2)
+		return shadow_client_send_gfx_avc444(client, &gfx, &cmd, GfxAVC444v2);
+#endif
+
+	if (damage)
+		return shadow_client_send_surface_gfx_region(client, &gfx, &cmd, damage);
+
+	REGION16 region;
+
+	region16_init(&region);
+	const BOOL sent = region16_union_rect(&region, &region, &regionRect) &&
+	                  shadow_client_send_surface_gfx_region(client, &gfx, &cmd, &region);
+	region16_uninit(&region);
+	return sent;
+}
+
+static BOOL stream_surface_bits_supported(const rdpSettings* settings)
+{
+	const UINT32 supported =
+	    freerdp_settings_get_uint32(settings, FreeRDP_SurfaceCommandsSupported);
+	return ((supported & SURFCMDS_STREAM_SURFACE_BITS) != 0);
+}
+
+static BOOL set_surface_bits_supported(const rdpSettings* settings)
+{
+	const UINT32 supported =
+	    freerdp_settings_get_uint32(settings, FreeRDP_SurfaceCommandsSupported);
+	return ((supported & SURFCMDS_SET_SURFACE_BITS) != 0);
+}
+
+static BOOL is_surface_command_supported(const rdpSettings* settings)
 {
 	if (stream_surface_bits_supported(settings))
 	{
@@ -1486,6 +2563,8 @@ static BOOL shadow_client_send_surface_bits(rdpShadowClient* client, BYTE* pSrcD
 	rdpSettings* settings = NULL;
 	rdpShadowEncoder* encoder = NULL;
 	SURFACE_BITS_COMMAND cmd = { 0 };
+	SHADOW_ENCODE_KEY key = { 0 };
+	rdpShadowEncodedFrame* frame = NULL;
 
 	if (!context || !pSrcData)
 		return FALSE;
@@ -1497,6 +2576,8 @@ static BOOL shadow_client_send_surface_bits(rdpShadowClient* client, BYTE* pSrcD
 	if (!update || !settings || !encoder)
 		return FALSE;
 
+	rdpShadowEncodeCache* cache = shadow_client_get_encode_cache(client);
+
 	if (encoder->frameAck)
 		frameId = shadow_encoder_create_frame_id(encoder);
 
@@ -1522,15 +2603,34 @@ static BOOL shadow_client_send_surface_bits(rdpShadowClient* client, BYTE* pSrcD
 
 		const UINT32 MultifragMaxRequestSize =
 		    freerdp_settings_get_uint32(settings, FreeRDP_MultifragMaxRequestSize);
-		RFX_MESSAGE_LIST* messages =
-		    rfx_encode_messages(encoder->rfx, &rect, 1, pSrcData,
-		                        freerdp_settings_get_uint32(settings, FreeRDP_DesktopWidth),
-		                        freerdp_settings_get_uint32(settings, FreeRDP_DesktopHeight),
-		                        nSrcStep, &numMessages, MultifragMaxRequestSize);
-		if (!messages)
+		RFX_MESSAGE_LIST* messages = NULL;
+		rdpShadowEncodedFrame* newFrame = NULL;
+
+		/* The message split depends on the client's fragmentation limit */
+		shadow_client_init_encode_key(client, &key, FREERDP_CODEC_REMOTEFX,
+		                              CMDTYPE_STREAM_SURFACE_BITS, MultifragMaxRequestSize,
+		                              nXSrc, nYSrc, 1ull * nXSrc + nWidth, 1ull * nYSrc + nHeight);
+
+		if (cache)
+			frame = shadow_encode_cache_get(cache, &key);
+
+		if (frame)
+			numMessages = shadow_encoded_frame_count(frame);
+		else
 		{
-			WLog_ERR(TAG, "rfx_encode_messages failed");
-			return FALSE;
+			messages =
+			    rfx_encode_messages(encoder->rfx, &rect, 1, pSrcData,
+			                        freerdp_settings_get_uint32(settings, FreeRDP_DesktopWidth),
+			                        freerdp_settings_get_uint32(settings, FreeRDP_DesktopHeight),
+			                        nSrcStep, &numMessages, MultifragMaxRequestSize);
+			if (!messages)
+			{
+				WLog_ERR(TAG, "rfx_encode_messages failed");
+				return FALSE;
+			}
+
+			if (cache)
+				newFrame = shadow_encoded_frame_new(&key);
 		}
 
 		cmd.cmdType = CMDTYPE_STREAM_SURFACE_BITS;
@@ -1552,14 +2652,41 @@ static BOOL shadow_client_send_surface_bits(rdpShadowClient* client, BYTE* pSrcD
 		{
 			Stream_SetPosition(s, 0);
 
-			const RFX_MESSAGE* msg = rfx_message_list_get(messages, i);
-			if (!rfx_write_message(encoder->rfx, s, msg))
+			if (!rfx_write_message_header(encoder->rfx, s))
 			{
-				WLog_ERR(TAG, "rfx_write_message failed");
+				WLog_ERR(TAG, "rfx_write_message_header failed");
 				ret = FALSE;
 				break;
 			}
 
+			if (frame)
+			{
+				if (!shadow_client_write_encoded_frame(s, frame, i))
+				{
+					WLog_ERR(TAG, "Failed to write shared RemoteFX message");
+					ret = FALSE;
+					break;
+				}
+			}
+			else
+			{
+				const size_t start = Stream_GetPosition(s);
+				const RFX_MESSAGE* msg = rfx_message_list_get(messages, i);
+				if (!rfx_write_message(encoder->rfx, s, msg))
+				{
+					WLog_ERR(TAG, "rfx_write_message failed");
+					ret = FALSE;
+					break;
+				}
+
+				if (newFrame && !shadow_encoded_frame_append(newFrame, Stream_Buffer(s) + start,
+				                                             Stream_GetPosition(s) - start))
+				{
+					shadow_encoded_frame_release(newFrame);
+					newFrame = NULL;
+				}
+			}
+
 			WINPR_ASSERT(Stream_GetPosition(s) <= UINT32_MAX);
 			cmd.bmp.bitmapDataLength = (UINT32)Stream_GetPosition(s);
 			cmd.bmp.bitmapData = Stream_Buffer(s);
@@ -1579,6 +2706,11 @@ static BOOL shadow_client_send_surface_bits(rdpShadowClient* client, BYTE* pSrcD
 			}
 		}
 
+		/* Only share complete frames */
+		if (ret && newFrame)
+			(void)shadow_encode_cache_add(cache, newFrame);
+
+		shadow_encoded_frame_release(newFrame);
 		rfx_message_list_free(messages);
 	}
 	else if (set_surface_bits_supported(settings) &&
@@ -1593,7 +2725,37 @@ static BOOL shadow_client_send_surface_bits(rdpShadowClient* client, BYTE* pSrcD
 		s = encoder->bs;
 		Stream_SetPosition(s, 0);
 		pSrcData = &pSrcData[(nYSrc * nSrcStep) + (nXSrc * 4)];
-		nsc_compose_message(encoder->nsc, s, pSrcData, nWidth, nHeight, nSrcStep);
+
+		const UINT64 caps =
+		    (1ull * freerdp_settings_get_uint32(settings, FreeRDP_NSCodecColorLossLevel) << 2) |
+		    (freerdp_settings_get_bool(settings, FreeRDP_NSCodecAllowSubsampling) ? 2 : 0) |
+		    (freerdp_settings_get_bool(settings, FreeRDP_NSCodecAllowDynamicColorFidelity) ? 1
+		                                                                                   : 0);
+		shadow_client_init_encode_key(client, &key, FREERDP_CODEC_NSCODEC,
+		                              CMDTYPE_SET_SURFACE_BITS, caps, nXSrc, nYSrc,
+		                              1ull * nXSrc + nWidth, 1ull * nYSrc + nHeight);
+
+		if (cache)
+			frame = shadow_encode_cache_get(cache, &key);
+
+		if (frame)
+		{
+			if (!shadow_client_write_encoded_frame(s, frame, 0))
+			{
+				shadow_encoded_frame_release(frame);
+				return FALSE;
+			}
+		}
+		else
+		{
+			nsc_compose_message(encoder->nsc, s, pSrcData, nWidth, nHeight, nSrcStep);
+
+			if (cache && (frame = shadow_encoded_frame_new(&key)))
+			{
+				if (shadow_encoded_frame_append(frame, Stream_Buffer(s), Stream_GetPosition(s)))
+					(void)shadow_encode_cache_add(cache, frame);
+			}
+		}
 		cmd.cmdType = CMDTYPE_SET_SURFACE_BITS;
 		cmd.bmp.bpp = 32;
 		WINPR_ASSERT(nsID <= UINT16_MAX);
@@ -1621,6 +2783,7 @@ static BOOL shadow_client_send_surface_bits(rdpShadowClient* client, BYTE* pSrcD
 		}
 	}
 
+	shadow_encoded_frame_release(frame);
 	return ret;
 }
 
@@ -1938,6 +3101,30 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GF
 	{
 		if (pStatus->gfxOpened && client->areGfxCapsReady)
 		{
+			REGION16 damage;
+			UINT32 numDamaged = 0;
+			const RECTANGLE_16* damaged = region16_rects(&invalidRegion, &numDamaged);
+			const INT64 subX = server->shareSubRect ? server->subRect.left : 0;
+			const INT64 subY = server->shareSubRect ? server->subRect.top : 0;
+
+			/* The damaged rectangles relative to pSrcData */
+			region16_init(&damage);
+			for (UINT32 index = 0; index < numDamaged; index++)
+			{
+				RECTANGLE_16 dirty = { 0 };
+				dirty.left = WINPR_ASSERTING_INT_CAST(UINT16, damaged[index].left - subX);
+				dirty.top = WINPR_ASSERTING_INT_CAST(UINT16, damaged[index].top - subY);
+				dirty.right = WINPR_ASSERTING_INT_CAST(UINT16, damaged[index].right - subX);
+				dirty.bottom = WINPR_ASSERTING_INT_CAST(UINT16, damaged[index].bottom - subY);
+
+				if (!region16_union_rect(&damage, &damage, &dirty))
+				{
+					region16_uninit(&damage);
+					ret = FALSE;
+					goto out;
+				}
+			}
+
 			/* GFX/h264 always full screen encoded */
 			nWidth = freerdp_settings_get_uint32(settings, FreeRDP_DesktopWidth);
 			nHeight = freerdp_settings_get_uint32(settings, FreeRDP_DesktopHeight);
@@ -1946,11 +3133,12 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GF
 			if (!pStatus->gfxSurfaceCreated)
 			{
 				/* Only init surface when we have h264 supported */
-				if (!(ret = shadow_client_rdpgfx_reset_graphic(client)))
-					goto out;
-
-				if (!(ret = shadow_client_rdpgfx_new_surface(client)))
+				if (!(ret = shadow_client_rdpgfx_reset_graphic(client)) ||
+				    !(ret = shadow_client_rdpgfx_new_surface(client)))
+				{
+					region16_uninit(&damage);
 					goto out;
+				}
 
 				pStatus->gfxSurfaceCreated = TRUE;
 			}
@@ -1960,7 +3148,8 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GF
 			WINPR_ASSERT(nHeight >= 0);
 			WINPR_ASSERT(nHeight <= UINT16_MAX);
 			ret = shadow_client_send_surface_gfx(client, pSrcData, nSrcStep, SrcFormat, 0, 0,
-			                                     (UINT16)nWidth, (UINT16)nHeight);
+			                                     (UINT16)nWidth, (UINT16)nHeight, &damage);
+			region16_uninit(&damage);
 		}
 		else
 		{
@@ -2000,6 +3189,142 @@ out:
 	return ret;
 }
 
+static BOOL shadow_client_progressive_upgrade_pending(rdpShadowClient* client,
+                                                      const SHADOW_GFX_STATUS* pStatus)
+{
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(pStatus);
+
+	if (!client->activated || client->suppressOutput || !pStatus->gfxOpened ||
+	    !pStatus->gfxSurfaceCreated || !client->encoder || !client->encoder->progressive)
+		return FALSE;
+
+	return progressive_get_pending_upgrades(client->encoder->progressive, client->surfaceId) > 0;
+}
+
+static BOOL shadow_client_video_refresh_pending(rdpShadowClient* client,
+                                                const SHADOW_GFX_STATUS* pStatus)
+{
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(pStatus);
+
+	if (!client->activated || client->suppressOutput || !pStatus->gfxSurfaceCreated ||
+	    !client->encoder || !client->encoder->classifier)
+		return FALSE;
+
+	if (!freerdp_settings_get_bool(client->context.settings, FreeRDP_GfxMixedCodecs))
+		return FALSE;
+
+	return shadow_classifier_has_video(client->encoder->classifier);
+}
+
+/**
+ * Function description
+ * Advance the content classification by a frame without damage and send the
+ * tiles that stopped being video again, they are left at the quality of the
+ * video codec otherwise.
+ *
+ * @return TRUE on success
+ */
+static BOOL shadow_client_send_video_refresh(rdpShadowClient* client, SHADOW_GFX_STATUS* pStatus)
+{
+	UINT32 numRects = 0;
+	REGION16 refresh;
+	const rdpShadowServer* server = client->server;
+	const UINT16 subX = server->shareSubRect ? server->subRect.left : 0;
+	const UINT16 subY = server->shareSubRect ? server->subRect.top : 0;
+
+	region16_init(&refresh);
+	BOOL rc = shadow_classifier_tick(client->encoder->classifier, &refresh);
+	const RECTANGLE_16* rects = region16_rects(&refresh, &numRects);
+
+	if (rc && (numRects > 0))
+	{
+		/* the invalid region is relative to the surface, not to the shared part of it */
+		EnterCriticalSection(&client->lock);
+		for (UINT32 index = 0; rc && (index < numRects); index++)
+		{
+			const RECTANGLE_16 rect = {
+				WINPR_ASSERTING_INT_CAST(UINT16, rects[index].left + subX),
+				WINPR_ASSERTING_INT_CAST(UINT16, rects[index].top + subY),
+				WINPR_ASSERTING_INT_CAST(UINT16, rects[index].right + subX),
+				WINPR_ASSERTING_INT_CAST(UINT16, rects[index].bottom + subY)
+			};
+			rc = region16_union_rect(&client->invalidRegion, &client->invalidRegion, &rect);
+		}
+		LeaveCriticalSection(&client->lock);
+
+		if (rc)
+			rc = shadow_client_send_surface_update(client, pStatus);
+	}
+
+	region16_uninit(&refresh);
+	return rc;
+}
+
+/**
+ * Function description
+ * Send the next quality pass of progressive tiles sent at a coarse quality.
+ * Nothing is sent while frames are still waiting for acknowledgement.
+ *
+ * @return TRUE on success
+ */
+static BOOL shadow_client_send_progressive_upgrade(rdpShadowClient* client)
+{
+	UINT error = CHANNEL_RC_OK;
+	RDPGFX_SURFACE_COMMAND cmd = { 0 };
+	RDPGFX_START_FRAME_PDU cmdstart = { 0 };
+	RDPGFX_END_FRAME_PDU cmdend = { 0 };
+	SYSTEMTIME sTime = { 0 };
+
+	WINPR_ASSERT(client);
+
+	rdpShadowEncoder* encoder = client->encoder;
+	const rdpSettings* settings = client->context.settings;
+	WINPR_ASSERT(encoder);
+	WINPR_ASSERT(settings);
+
+	if (shadow_encoder_inflight_frames(encoder) > 1)
+		return TRUE;
+
+	const int rc = progressive_compress_upgrade(encoder->progressive, client->surfaceId,
+	                                            SHADOW_PROGRESSIVE_UPGRADE_TILES, &cmd.data,
+	                                            &cmd.length);
+	if (rc < 0)
+	{
+		WLog_ERR(TAG, "progressive_compress_upgrade failed");
+		return FALSE;
+	}
+
+	/* rc > 0 means new data */
+	if (rc == 0)
+		return TRUE;
+
+	cmdstart.frameId = shadow_encoder_create_frame_id(encoder);
+	GetSystemTime(&sTime);
+	cmdstart.timestamp = (UINT32)(sTime.wHour << 22U | sTime.wMinute << 16U | sTime.wSecond << 10U |
+	                              sTime.wMilliseconds);
+	cmdend.frameId = cmdstart.frameId;
+	cmd.surfaceId = client->surfaceId;
+	cmd.codecId = RDPGFX_CODECID_CAPROGRESSIVE;
+	cmd.format = PIXEL_FORMAT_BGRX32;
+	cmd.right = freerdp_settings_get_uint32(settings, FreeRDP_DesktopWidth);
+	cmd.bottom = freerdp_settings_get_uint32(settings, FreeRDP_DesktopHeight);
+	cmd.width = cmd.right;
+	cmd.height = cmd.bottom;
+
+	IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, &cmd, &cmdstart,
+	          &cmdend);
+
+	if (error)
+	{
+		WLog_ERR(TAG, "SurfaceFrameCommand failed with error %" PRIu32 "", error);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 /**
  * Function description
  * Notify client for resize. The new desktop width/height
@@ -2220,7 +3545,10 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 	wMessageQueue* MsgQueue = NULL;
 	/* This should only be visited in client thread */
 	SHADOW_GFX_STATUS gfxstatus = { 0 };
+	SHADOW_NETWORK_PROBE probe = { 0 };
+	UINT64 lastFrame = GetTickCount64();
 	rdpUpdate* update = NULL;
+	rdpAutoDetect* autodetect = NULL;
 
 	WINPR_ASSERT(client);
 
@@ -2255,6 +3583,13 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 	update->SuppressOutput = shadow_client_suppress_output;
 	update->SurfaceFrameAcknowledge = shadow_client_surface_frame_acknowledge;
 
+	autodetect = autodetect_get(peer->context);
+	WINPR_ASSERT(autodetect);
+
+	autodetect->RTTMeasureResponse = shadow_client_rtt_measure_response;
+	autodetect->BandwidthMeasureResults = shadow_client_bandwidth_measure_results;
+	autodetect->NetworkCharacteristicsSync = shadow_client_network_characteristics_sync;
+
 	if ((!client->vcm) || (!subsystem->updateEvent))
 		goto out;
 
@@ -2303,11 +3638,59 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 			events[nCount++] = gfxevent;
 #endif
 
-		status = WaitForMultipleObjects(nCount, events, FALSE, INFINITE);
+		const BOOL upgradePending = shadow_client_progressive_upgrade_pending(client, &gfxstatus);
+		const BOOL refreshPending = shadow_client_video_refresh_pending(client, &gfxstatus);
+		const DWORD timeout =
+		    MIN(MIN(upgradePending ? SHADOW_PROGRESSIVE_UPGRADE_INTERVAL : INFINITE,
+		            refreshPending ? SHADOW_VIDEO_REFRESH_INTERVAL : INFINITE),
+		        shadow_client_probe_network(client, &probe));
+		status = WaitForMultipleObjects(nCount, events, FALSE, timeout);
 
 		if (status == WAIT_FAILED)
 			goto fail;
 
+		if ((status == WAIT_TIMEOUT) && upgradePending)
+		{
+			/* Nothing else to do, refine the tiles sent at a coarse quality */
+			rdpTransport* transport = freerdp_get_transport(&client->context);
+			const BOOL batched = transport_write_batch_begin(transport);
+			const BOOL sent = shadow_client_send_progressive_upgrade(client);
+
+			if (batched && !transport_write_batch_end(transport))
+			{
+				WLog_ERR(TAG, "Failed to flush progressive upgrade");
+				break;
+			}
+
+			if (!sent)
+			{
+				WLog_ERR(TAG, "Failed to send progressive upgrade");
+				break;
+			}
+		}
+
+		if (refreshPending && (GetTickCount64() - lastFrame >= SHADOW_VIDEO_REFRESH_INTERVAL))
+		{
+			/* The screen is static, video that stopped is only refreshed this way */
+			rdpTransport* transport = freerdp_get_transport(&client->context);
+			const BOOL batched = transport_write_batch_begin(transport);
+			const BOOL sent = shadow_client_send_video_refresh(client, &gfxstatus);
+
+			if (batched && !transport_write_batch_end(transport))
+			{
+				WLog_ERR(TAG, "Failed to flush video refresh");
+				break;
+			}
+
+			if (!sent)
+			{
+				WLog_ERR(TAG, "Failed to send video refresh");
+				break;
+			}
+
+			lastFrame = GetTickCount64();
+		}
+
 		if (WaitForSingleObject(UpdateEvent, 0) == WAIT_OBJECT_0)
 		{
 			/* The UpdateEvent means to start sending current frame. It is
@@ -2333,12 +3716,24 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 				}
 				else
 				{
-					/* Send frame */
-					if (!shadow_client_send_surface_update(client, &gfxstatus))
+					/* Send frame, the PDUs of a frame are flushed together at its end */
+					rdpTransport* transport = freerdp_get_transport(&client->context);
+					const BOOL batched = transport_write_batch_begin(transport);
+					const BOOL sent = shadow_client_send_surface_update(client, &gfxstatus);
+
+					if (batched && !transport_write_batch_end(transport))
+					{
+						WLog_ERR(TAG, "Failed to flush surface update");
+						break;
+					}
+
+					if (!sent)
 					{
 						WLog_ERR(TAG, "Failed to send surface update");
 						break;
 					}
+
+					lastFrame = GetTickCount64();
 				}
 			}
 			else
@@ -2400,6 +3795,8 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 					{
 						client->rdpgfx->FrameAcknowledge = shadow_client_rdpgfx_frame_acknowledge;
 						client->rdpgfx->CapsAdvertise = shadow_client_rdpgfx_caps_advertise;
+						client->rdpgfx->CacheImportOffer =
+						    shadow_client_rdpgfx_cache_import_offer;
 
 						if (!client->rdpgfx->Open(client->rdpgfx))
 						{
@@ -0,0 +1,232 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Shared encoding of surface updates for multiple clients
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <winpr/assert.h>
+#include <winpr/interlocked.h>
+#include <winpr/collections.h>
+
+#include <freerdp/log.h>
+
+#include "shadow.h"
+
+#define TAG SERVER_TAG("shadow.encode")
+
+struct rdp_shadow_encode_cache
+{
+	wArrayList* frames;
+	UINT32 generation;
+	UINT64 hits;
+	UINT64 misses;
+};
+
+struct rdp_shadow_encoded_frame
+{
+	SHADOW_ENCODE_KEY key;
+	LONG refCount;
+	wStream* data;
+	size_t* offsets; /* count + 1 message boundaries in data */
+	size_t count;
+};
+
+static BOOL shadow_encode_key_equal(const SHADOW_ENCODE_KEY* a, const SHADOW_ENCODE_KEY* b)
+{
+	WINPR_ASSERT(a);
+	WINPR_ASSERT(b);
+
+	return (a->surface == b->surface) && (a->codecId == b->codecId) &&
+	       (a->cmdType == b->cmdType) && (a->caps == b->caps) && (a->quality == b->quality) &&
+	       (a->rect.left == b->rect.left) && (a->rect.top == b->rect.top) &&
+	       (a->rect.right == b->rect.right) && (a->rect.bottom == b->rect.bottom);
+}
+
+static void shadow_encoded_frame_free(void* obj)
+{
+	shadow_encoded_frame_release((rdpShadowEncodedFrame*)obj);
+}
+
+rdpShadowEncodedFrame* shadow_encoded_frame_new(const SHADOW_ENCODE_KEY* key)
+{
+	WINPR_ASSERT(key);
+
+	rdpShadowEncodedFrame* frame =
+	    (rdpShadowEncodedFrame*)calloc(1, sizeof(rdpShadowEncodedFrame));
+
+	if (!frame)
+		return NULL;
+
+	frame->key = *key;
+	frame->refCount = 1;
+	frame->data = Stream_New(NULL, 4096);
+	frame->offsets = (size_t*)calloc(1, sizeof(size_t));
+
+	if (!frame->data || !frame->offsets)
+	{
+		shadow_encoded_frame_release(frame);
+		return NULL;
+	}
+
+	return frame;
+}
+
+void shadow_encoded_frame_release(rdpShadowEncodedFrame* frame)
+{
+	if (!frame)
+		return;
+
+	if (InterlockedDecrement(&frame->refCount) > 0)
+		return;
+
+	Stream_Free(frame->data, TRUE);
+	free(frame->offsets);
+	free(frame);
+}
+
+BOOL shadow_encoded_frame_append(rdpShadowEncodedFrame* frame, const BYTE* data, size_t length)
+{
+	WINPR_ASSERT(frame);
+	WINPR_ASSERT(data || (length == 0));
+
+	size_t* offsets = (size_t*)realloc(frame->offsets, (frame->count + 2) * sizeof(size_t));
+
+	if (!offsets)
+		return FALSE;
+
+	frame->offsets = offsets;
+
+	if (!Stream_EnsureRemainingCapacity(frame->data, length))
+		return FALSE;
+
+	Stream_Write(frame->data, data, length);
+	frame->offsets[++frame->count] = Stream_GetPosition(frame->data);
+	return TRUE;
+}
+
+size_t shadow_encoded_frame_count(const rdpShadowEncodedFrame* frame)
+{
+	WINPR_ASSERT(frame);
+	return frame->count;
+}
+
+const BYTE* shadow_encoded_frame_get(const rdpShadowEncodedFrame* frame, size_t index,
+                                     size_t* length)
+{
+	WINPR_ASSERT(frame);
+	WINPR_ASSERT(length);
+
+	if (index >= frame->count)
+		return NULL;
+
+	*length = frame->offsets[index + 1] - frame->offsets[index];
+	return Stream_Buffer(frame->data) + frame->offsets[index];
+}
+
+rdpShadowEncodedFrame* shadow_encode_cache_get(rdpShadowEncodeCache* cache,
+                                               const SHADOW_ENCODE_KEY* key)
+{
+	rdpShadowEncodedFrame* found = NULL;
+
+	WINPR_ASSERT(cache);
+	WINPR_ASSERT(key);
+
+	ArrayList_Lock(cache->frames);
+
+	for (size_t i = 0; i < ArrayList_Count(cache->frames); i++)
+	{
+		rdpShadowEncodedFrame* frame = ArrayList_GetItem(cache->frames, i);
+
+		if (shadow_encode_key_equal(&frame->key, key))
+		{
+			InterlockedIncrement(&frame->refCount);
+			found = frame;
+			break;
+		}
+	}
+
+	if (found)
+		cache->hits++;
+	else
+		cache->misses++;
+
+	ArrayList_Unlock(cache->frames);
+	return found;
+}
+
+BOOL shadow_encode_cache_add(rdpShadowEncodeCache* cache, rdpShadowEncodedFrame* frame)
+{
+	WINPR_ASSERT(cache);
+	WINPR_ASSERT(frame);
+
+	InterlockedIncrement(&frame->refCount);
+
+	if (!ArrayList_Append(cache->frames, frame))
+	{
+		InterlockedDecrement(&frame->refCount);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void shadow_encode_cache_next_frame(rdpShadowEncodeCache* cache)
+{
+	if (!cache)
+		return;
+
+	ArrayList_Lock(cache->frames);
+
+	if (ArrayList_Count(cache->frames) > 0)
+		WLog_VRB(TAG, "frame %" PRIu32 ": %" PRIuz " shared encodings", cache->generation,
+		         ArrayList_Count(cache->frames));
+
+	ArrayList_Clear(cache->frames);
+	cache->generation++;
+	ArrayList_Unlock(cache->frames);
+}
+
+rdpShadowEncodeCache* shadow_encode_cache_new(void)
+{
+	rdpShadowEncodeCache* cache = (rdpShadowEncodeCache*)calloc(1, sizeof(rdpShadowEncodeCache));
+
+	if (!cache)
+		return NULL;
+
+	cache->frames = ArrayList_New(TRUE);
+
+	if (!cache->frames)
+	{
+		free(cache);
+		return NULL;
+	}
+
+	wObject* obj = ArrayList_Object(cache->frames);
+	WINPR_ASSERT(obj);
+	obj->fnObjectFree = shadow_encoded_frame_free;
+	return cache;
+}
+
+void shadow_encode_cache_free(rdpShadowEncodeCache* cache)
+{
+	if (!cache)
+		return;
+
+	WLog_DBG(TAG, "shared encodings: %" PRIu64 " hits, %" PRIu64 " misses", cache->hits,
+	         cache->misses);
+	ArrayList_Free(cache->frames);
+	free(cache);
+}
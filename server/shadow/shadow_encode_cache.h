@@ -0,0 +1,76 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Shared encoding of surface updates for multiple clients
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_SERVER_SHADOW_ENCODE_CACHE_H
+#define FREERDP_SERVER_SHADOW_ENCODE_CACHE_H
+
+#include <freerdp/server/shadow.h>
+
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+
+/*
+ * Clients watching the same surface encode the same frame. The first client
+ * encoding a frame with a stateless codec stores the bitstream here, clients
+ * with the same key take a reference instead of encoding again.
+ * All entries are dropped when the subsystem publishes the next frame.
+ */
+
+typedef struct
+{
+	const rdpShadowSurface* surface;
+	UINT32 codecId;   /* FREERDP_CODEC_* */
+	UINT32 cmdType;   /* 0 for RDPGFX, CMDTYPE_* for surface bits */
+	UINT64 caps;      /* negotiated parameters the bitstream depends on */
+	UINT32 quality;   /* rate control quality level, 0 for codecs without one */
+	RECTANGLE_16 rect;
+} SHADOW_ENCODE_KEY;
+
+typedef struct rdp_shadow_encoded_frame rdpShadowEncodedFrame;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	void shadow_encode_cache_free(rdpShadowEncodeCache* cache);
+
+	WINPR_ATTR_MALLOC(shadow_encode_cache_free, 1)
+	rdpShadowEncodeCache* shadow_encode_cache_new(void);
+
+	void shadow_encode_cache_next_frame(rdpShadowEncodeCache* cache);
+
+	rdpShadowEncodedFrame* shadow_encode_cache_get(rdpShadowEncodeCache* cache,
+	                                               const SHADOW_ENCODE_KEY* key);
+	BOOL shadow_encode_cache_add(rdpShadowEncodeCache* cache, rdpShadowEncodedFrame* frame);
+
+	void shadow_encoded_frame_release(rdpShadowEncodedFrame* frame);
+
+	WINPR_ATTR_MALLOC(shadow_encoded_frame_release, 1)
+	rdpShadowEncodedFrame* shadow_encoded_frame_new(const SHADOW_ENCODE_KEY* key);
+
+	BOOL shadow_encoded_frame_append(rdpShadowEncodedFrame* frame, const BYTE* data,
+	                                 size_t length);
+	size_t shadow_encoded_frame_count(const rdpShadowEncodedFrame* frame);
+	const BYTE* shadow_encoded_frame_get(const rdpShadowEncodedFrame* frame, size_t index,
+	                                     size_t* length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_SERVER_SHADOW_ENCODE_CACHE_H */
@@ -19,6 +19,12 @@
 #include <freerdp/config.h>
 
 #include <winpr/assert.h>
+#include <winpr/sysinfo.h>
+
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#endif
 
 #include "shadow.h"
 
@@ -27,6 +33,29 @@
 #include <freerdp/log.h>
 #define TAG CLIENT_TAG("shadow")
 
+#define SHADOW_PROGRESSIVE_PASSES 3
+
+/* lower bound of the H.264 bit rate, the configured bit rate is the upper bound */
+#define SHADOW_RATE_MIN_BITRATE 250000
+/* highest H.264 quantization parameter used when the configured one is lower */
+#define SHADOW_RATE_MAX_QP 40
+/* queued bytes considered congestion while the bandwidth is unknown */
+#define SHADOW_RATE_MAX_SEND_QUEUE (256 * 1024)
+/* acknowledge latency above the lowest one seen that is considered queuing in the network */
+#define SHADOW_RATE_MAX_QUEUE_DELAY 150
+/* minimum time between two quality decreases if the round-trip time is shorter */
+#define SHADOW_RATE_MIN_INTERVAL 100
+/* frames a bandwidth measurement has to span to tell the capacity of the link */
+#define SHADOW_RATE_MEASURE_MIN_FRAMES 4
+
+/* RemoteFX quantization levels, from the codec default to a coarse quality */
+static const UINT32 shadow_rfx_quantization[][10] = { { 6, 6, 6, 6, 7, 7, 8, 8, 8, 9 },
+	                                                  { 7, 7, 7, 7, 8, 8, 9, 9, 9, 10 },
+	                                                  { 8, 8, 8, 8, 9, 9, 10, 10, 10, 11 },
+	                                                  { 9, 9, 9, 9, 10, 10, 11, 11, 11, 12 },
+	                                                  { 10, 10, 10, 10, 11, 11, 12, 12, 12,
+	                                                    13 } };
+
 UINT32 shadow_encoder_preferred_fps(rdpShadowEncoder* encoder)
 {
 	/* Return preferred fps calculated according to the last
@@ -49,35 +78,260 @@ UINT32 shadow_encoder_inflight_frames(rdpShadowEncoder* encoder)
 	           : encoder->frameId - encoder->lastAckframeId;
 }
 
-UINT32 shadow_encoder_create_frame_id(rdpShadowEncoder* encoder)
+BOOL shadow_encoder_get_rate_control(rdpShadowEncoder* encoder, SHADOW_RATE_CONTROL* rate)
+{
+	if (!encoder || !rate)
+		return FALSE;
+
+	EnterCriticalSection(&encoder->rateLock);
+	*rate = encoder->rate;
+	LeaveCriticalSection(&encoder->rateLock);
+	return TRUE;
+}
+
+static UINT32 shadow_encoder_send_queue(rdpShadowEncoder* encoder, BOOL* blocked)
+{
+	freerdp_peer* peer = encoder->client->context.peer;
+
+	*blocked = FALSE;
+	if (!peer)
+		return 0;
+
+	/* the transport keeps what the socket did not accept */
+	if (peer->IsWriteBlocked)
+		*blocked = peer->IsWriteBlocked(peer);
+
+#if defined(SIOCOUTQ)
+	int pending = 0;
+	if ((peer->sockfd >= 0) && (ioctl(peer->sockfd, SIOCOUTQ, &pending) == 0) && (pending > 0))
+		return (UINT32)pending;
+#endif
+
+	return 0;
+}
+
+static BOOL shadow_encoder_congested(const rdpShadowEncoder* encoder, BOOL blocked)
 {
-	UINT32 frameId = 0;
-	UINT32 inFlightFrames = shadow_encoder_inflight_frames(encoder);
+	const SHADOW_RATE_CONTROL* rate = &encoder->rate;
+
+	if (blocked || (rate->inFlightFrames > 1))
+		return TRUE;
+
+	/* more than a frame interval waiting to be sent */
+	if (rate->bandwidth > 0)
+	{
+		if (8ull * rate->sendQueue * rate->fps > 1000ull * rate->bandwidth)
+			return TRUE;
+	}
+	else if (rate->sendQueue > SHADOW_RATE_MAX_SEND_QUEUE)
+		return TRUE;
+
+	return (rate->ackLatency > encoder->baseAckLatency + SHADOW_RATE_MAX_QUEUE_DELAY);
+}
+
+static void shadow_encoder_rate_control(rdpShadowEncoder* encoder, UINT64 now)
+{
+	BOOL blocked = FALSE;
+	SHADOW_RATE_CONTROL* rate = &encoder->rate;
+	const UINT32 configuredQP = encoder->server->h264QP;
+	const UINT32 minBitRate = MIN(SHADOW_RATE_MIN_BITRATE, encoder->server->h264BitRate);
+	UINT32 maxBitRate = encoder->server->h264BitRate;
+
+	/* leave a quarter of the measured bandwidth to other traffic */
+	if (rate->bandwidth > 0)
+		maxBitRate = (UINT32)MIN(maxBitRate, 750ull * rate->bandwidth);
+
+	rate->inFlightFrames = shadow_encoder_inflight_frames(encoder);
+	rate->sendQueue = shadow_encoder_send_queue(encoder, &blocked);
+	rate->congested = shadow_encoder_congested(encoder, blocked);
+
+	/* a measurement only tells the capacity if the link never waited for data */
+	encoder->measureFrames++;
+	if ((rate->sendQueue == 0) && !blocked)
+		encoder->measureBusy = FALSE;
 
 	/*
 	 * Calculate preferred fps according to how much frames are
 	 * in-progress. Note that it only works when subsystem implementation
 	 * calls shadow_encoder_preferred_fps and takes the suggestion.
 	 */
-	if (inFlightFrames > 1)
+	if (rate->inFlightFrames > 1)
+		encoder->fps = (100 / (rate->inFlightFrames + 1) * encoder->maxFps) / 100;
+	else if (!rate->congested)
+		encoder->fps = MIN(encoder->fps + 2, encoder->maxFps);
+
+	if (rate->congested)
 	{
-		encoder->fps = (100 / (inFlightFrames + 1) * encoder->maxFps) / 100;
+		encoder->stableFrames = 0;
+
+		/* the effect of a decrease shows up a round trip later at the earliest */
+		if (now - encoder->lastDecrease >= MAX(rate->rtt, SHADOW_RATE_MIN_INTERVAL))
+		{
+			encoder->lastDecrease = now;
+			rate->h264BitRate = rate->h264BitRate / 100 * 85;
+			rate->h264QP = MIN(rate->h264QP + 2, MAX(configuredQP, SHADOW_RATE_MAX_QP));
+			rate->rfxQuality =
+			    MIN(rate->rfxQuality + 1, (UINT32)ARRAYSIZE(shadow_rfx_quantization) - 1);
+
+			if (rate->inFlightFrames <= 1)
+				encoder->fps = encoder->fps * 3 / 4;
+		}
 	}
-	else
+	else if (++encoder->stableFrames >= encoder->fps)
 	{
-		encoder->fps += 2;
-
-		if (encoder->fps > encoder->maxFps)
-			encoder->fps = encoder->maxFps;
+		/* about a second without congestion, try a better quality */
+		encoder->stableFrames = 0;
+		rate->h264BitRate += rate->h264BitRate / 10;
+
+		if (rate->h264QP > configuredQP)
+			rate->h264QP--;
+		if (rate->rfxQuality > 0)
+			rate->rfxQuality--;
 	}
 
 	if (encoder->fps < 1)
 		encoder->fps = 1;
 
-	frameId = ++encoder->frameId;
+	rate->fps = encoder->fps;
+	rate->h264BitRate = MAX(MIN(rate->h264BitRate, maxBitRate), minBitRate);
+}
+
+static BOOL shadow_encoder_apply_rate_control(rdpShadowEncoder* encoder)
+{
+	const SHADOW_RATE_CONTROL* rate = &encoder->rate;
+
+	/* the H.264 backends pick up changed options with the next frame */
+	if (encoder->h264)
+	{
+		if (!h264_context_set_option(encoder->h264, H264_CONTEXT_OPTION_BITRATE,
+		                             rate->h264BitRate) ||
+		    !h264_context_set_option(encoder->h264, H264_CONTEXT_OPTION_QP, rate->h264QP))
+			return FALSE;
+	}
+
+	if (encoder->rfx && (encoder->rfxQuality != rate->rfxQuality))
+	{
+		if (!rfx_context_set_quantization(encoder->rfx,
+		                                  shadow_rfx_quantization[rate->rfxQuality]))
+			return FALSE;
+
+		encoder->rfxQuality = rate->rfxQuality;
+	}
+
+	return TRUE;
+}
+
+UINT32 shadow_encoder_create_frame_id(rdpShadowEncoder* encoder)
+{
+	const UINT64 now = GetTickCount64();
+
+	/* acknowledgements read the send times from the channel thread */
+	EnterCriticalSection(&encoder->rateLock);
+	shadow_encoder_rate_control(encoder, now);
+	const UINT32 frameId = ++encoder->frameId;
+	encoder->frameSent[frameId % SHADOW_ENCODER_FRAME_HISTORY] = now;
+	LeaveCriticalSection(&encoder->rateLock);
+
+	if (!shadow_encoder_apply_rate_control(encoder))
+		WLog_WARN(TAG, "Failed to apply the rate control decisions");
+
 	return frameId;
 }
 
+void shadow_encoder_frame_acknowledged(rdpShadowEncoder* encoder, UINT32 frameId)
+{
+	WINPR_ASSERT(encoder);
+
+	EnterCriticalSection(&encoder->rateLock);
+	encoder->lastAckframeId = frameId;
+
+	/* clients may skip acknowledgements, only recent frames have a send time */
+	if ((frameId != 0) && (frameId <= encoder->frameId) &&
+	    (encoder->frameId - frameId < SHADOW_ENCODER_FRAME_HISTORY))
+	{
+		const UINT64 sent = encoder->frameSent[frameId % SHADOW_ENCODER_FRAME_HISTORY];
+		const UINT32 latency = (UINT32)MIN(GetTickCount64() - sent, UINT32_MAX);
+		SHADOW_RATE_CONTROL* rate = &encoder->rate;
+
+		if ((encoder->baseAckLatency == 0) || (latency < encoder->baseAckLatency))
+			encoder->baseAckLatency = MAX(latency, 1);
+		rate->ackLatency =
+		    (rate->ackLatency == 0) ? latency : (3 * rate->ackLatency + latency) / 4;
+	}
+	LeaveCriticalSection(&encoder->rateLock);
+}
+
+void shadow_encoder_update_network(rdpShadowEncoder* encoder, UINT32 rtt, UINT32 bandwidth,
+                                   BOOL capacity)
+{
+	WINPR_ASSERT(encoder);
+
+	EnterCriticalSection(&encoder->rateLock);
+	if (rtt > 0)
+		encoder->rate.rtt = rtt;
+
+	/*
+	 * Without a payload the client measures the data the server chose to send.
+	 * That is only the capacity of the link if it was kept busy, otherwise it is
+	 * merely a lower bound.
+	 */
+	if (capacity)
+		encoder->rate.bandwidth = bandwidth;
+	else if (bandwidth > 0)
+	{
+		if (encoder->measureValid || (bandwidth > encoder->rate.bandwidth))
+			encoder->rate.bandwidth = bandwidth;
+		encoder->measureValid = FALSE;
+	}
+	LeaveCriticalSection(&encoder->rateLock);
+}
+
+void shadow_encoder_bandwidth_measure_start(rdpShadowEncoder* encoder)
+{
+	WINPR_ASSERT(encoder);
+
+	EnterCriticalSection(&encoder->rateLock);
+	encoder->measureFrames = 0;
+	encoder->measureBusy = TRUE;
+	LeaveCriticalSection(&encoder->rateLock);
+}
+
+void shadow_encoder_bandwidth_measure_stop(rdpShadowEncoder* encoder)
+{
+	BOOL blocked = FALSE;
+
+	WINPR_ASSERT(encoder);
+
+	const UINT32 sendQueue = shadow_encoder_send_queue(encoder, &blocked);
+
+	EnterCriticalSection(&encoder->rateLock);
+	encoder->measureValid = encoder->measureBusy &&
+	                        (encoder->measureFrames >= SHADOW_RATE_MEASURE_MIN_FRAMES) &&
+	                        ((sendQueue > 0) || blocked);
+	encoder->measureBusy = FALSE;
+	LeaveCriticalSection(&encoder->rateLock);
+}
+
+static void shadow_encoder_reset_rate_control(rdpShadowEncoder* encoder)
+{
+	EnterCriticalSection(&encoder->rateLock);
+	encoder->rate.fps = encoder->fps;
+	encoder->rate.h264BitRate = encoder->server->h264BitRate;
+	encoder->rate.h264QP = encoder->server->h264QP;
+	encoder->rate.rfxQuality = 0;
+	encoder->rate.ackLatency = 0;
+	encoder->rate.inFlightFrames = 0;
+	encoder->rate.congested = FALSE;
+	encoder->rfxQuality = 0;
+	encoder->baseAckLatency = 0;
+	encoder->stableFrames = 0;
+	encoder->lastDecrease = 0;
+	encoder->measureFrames = 0;
+	encoder->measureBusy = FALSE;
+	encoder->measureValid = FALSE;
+	LeaveCriticalSection(&encoder->rateLock);
+}
+
 static int shadow_encoder_init_grid(rdpShadowEncoder* encoder)
 {
 	UINT32 tileSize = 0;
@@ -143,6 +397,17 @@ static int shadow_encoder_init_rfx(rdpShadowEncoder* encoder)
 	rfx_context_set_mode(encoder->rfx, freerdp_settings_get_uint32(encoder->server->settings,
 	                                                               FreeRDP_RemoteFxRlgrMode));
 	rfx_context_set_pixel_format(encoder->rfx, PIXEL_FORMAT_BGRX32);
+
+	if (!rfx_context_set_quantization(encoder->rfx,
+	                                  shadow_rfx_quantization[encoder->rate.rfxQuality]))
+		goto fail;
+	encoder->rfxQuality = encoder->rate.rfxQuality;
+
+	/* one screen worth of tiles covers redraws of unchanged content */
+	if (!rfx_context_set_tile_cache_size(encoder->rfx, 1ull * ((encoder->width + 63) / 64) *
+	                                                       ((encoder->height + 63) / 64)))
+		goto fail;
+
 	encoder->codecs |= FREERDP_CODEC_REMOTEFX;
 	return 1;
 fail:
@@ -249,12 +514,12 @@ static int shadow_encoder_init_h264(rdpShadowEncoder* encoder)
 	                             encoder->server->h264RateControlMode))
 		goto fail;
 	if (!h264_context_set_option(encoder->h264, H264_CONTEXT_OPTION_BITRATE,
-	                             encoder->server->h264BitRate))
+	                             encoder->rate.h264BitRate))
 		goto fail;
 	if (!h264_context_set_option(encoder->h264, H264_CONTEXT_OPTION_FRAMERATE,
 	                             encoder->server->h264FrameRate))
 		goto fail;
-	if (!h264_context_set_option(encoder->h264, H264_CONTEXT_OPTION_QP, encoder->server->h264QP))
+	if (!h264_context_set_option(encoder->h264, H264_CONTEXT_OPTION_QP, encoder->rate.h264QP))
 		goto fail;
 
 	encoder->codecs |= FREERDP_CODEC_AVC420 | FREERDP_CODEC_AVC444;
@@ -276,6 +541,10 @@ static int shadow_encoder_init_progressive(rdpShadowEncoder* encoder)
 	if (!progressive_context_reset(encoder->progressive))
 		goto fail;
 
+	/* coarse first pass, the refinements are sent while the client is idle */
+	if (!progressive_context_set_passes(encoder->progressive, SHADOW_PROGRESSIVE_PASSES))
+		goto fail;
+
 	encoder->codecs |= FREERDP_CODEC_PROGRESSIVE;
 	return 1;
 fail:
@@ -283,6 +552,24 @@ fail:
 	return -1;
 }
 
+static int shadow_encoder_init_clear(rdpShadowEncoder* encoder)
+{
+	WINPR_ASSERT(encoder);
+
+	/**
+	 * The client keeps its ClearCodec caches across encoder resets,
+	 * so the context (and with it the cache mirror) is kept until the encoder is freed.
+	 */
+	if (!encoder->clear)
+		encoder->clear = clear_context_new(TRUE);
+
+	if (!encoder->clear)
+		return -1;
+
+	encoder->codecs |= FREERDP_CODEC_CLEARCODEC;
+	return 1;
+}
+
 static int shadow_encoder_init(rdpShadowEncoder* encoder)
 {
 	encoder->width = encoder->server->screen->width;
@@ -373,6 +660,19 @@ static int shadow_encoder_uninit_progressive(rdpShadowEncoder* encoder)
 	return 1;
 }
 
+static int shadow_encoder_uninit_clear(rdpShadowEncoder* encoder)
+{
+	WINPR_ASSERT(encoder);
+	if (encoder->clear)
+	{
+		clear_context_free(encoder->clear);
+		encoder->clear = NULL;
+	}
+
+	encoder->codecs &= (UINT32)~FREERDP_CODEC_CLEARCODEC;
+	return 1;
+}
+
 static int shadow_encoder_uninit(rdpShadowEncoder* encoder)
 {
 	shadow_encoder_uninit_grid(encoder);
@@ -403,6 +703,9 @@ int shadow_encoder_reset(rdpShadowEncoder* encoder)
 	UINT32 codecs = encoder->codecs;
 	rdpContext* context = (rdpContext*)encoder->client;
 	rdpSettings* settings = context->settings;
+
+	/* the codecs are prepared again with the initial decisions */
+	shadow_encoder_reset_rate_control(encoder);
 	status = shadow_encoder_uninit(encoder);
 
 	if (status < 0)
@@ -485,6 +788,15 @@ int shadow_encoder_prepare(rdpShadowEncoder* encoder, UINT32 codecs)
 			return -1;
 	}
 
+	if ((codecs & FREERDP_CODEC_CLEARCODEC) && !(encoder->codecs & FREERDP_CODEC_CLEARCODEC))
+	{
+		WLog_DBG(TAG, "initializing ClearCodec encoder");
+		status = shadow_encoder_init_clear(encoder);
+
+		if (status < 0)
+			return -1;
+	}
+
 	return 1;
 }
 
@@ -501,8 +813,15 @@ rdpShadowEncoder* shadow_encoder_new(rdpShadowClient* client)
 	encoder->server = server;
 	encoder->fps = 16;
 	encoder->maxFps = 32;
-
-	if (shadow_encoder_init(encoder) < 0)
+	InitializeCriticalSection(&encoder->rateLock);
+	shadow_encoder_reset_rate_control(encoder);
+	encoder->classifier = shadow_classifier_new();
+	encoder->motion = shadow_motion_new();
+	encoder->gfxCache = shadow_gfx_cache_new();
+	encoder->solid = shadow_solid_new();
+
+	if (!encoder->classifier || !encoder->motion || !encoder->gfxCache || !encoder->solid ||
+	    (shadow_encoder_init(encoder) < 0))
 	{
 		shadow_encoder_free(encoder);
 		return NULL;
@@ -517,5 +836,11 @@ void shadow_encoder_free(rdpShadowEncoder* encoder)
 		return;
 
 	shadow_encoder_uninit(encoder);
+	shadow_encoder_uninit_clear(encoder);
+	shadow_classifier_free(encoder->classifier);
+	shadow_motion_free(encoder->motion);
+	shadow_gfx_cache_free(encoder->gfxCache);
+	shadow_solid_free(encoder->solid);
+	DeleteCriticalSection(&encoder->rateLock);
 	free(encoder);
 }
@@ -27,6 +27,13 @@
 
 #include <freerdp/server/shadow.h>
 
+#include "shadow_classifier.h"
+#include "shadow_motion.h"
+#include "shadow_gfx_cache.h"
+#include "shadow_solid.h"
+
+#define SHADOW_ENCODER_FRAME_HISTORY 32
+
 struct rdp_shadow_encoder
 {
 	rdpShadowClient* client;
@@ -51,6 +58,11 @@ struct rdp_shadow_encoder
 	BITMAP_INTERLEAVED_CONTEXT* interleaved;
 	H264_CONTEXT* h264;
 	PROGRESSIVE_CONTEXT* progressive;
+	CLEAR_CONTEXT* clear;
+	rdpShadowClassifier* classifier;
+	rdpShadowMotion* motion;
+	rdpShadowGfxCache* gfxCache;
+	rdpShadowSolid* solid;
 
 	UINT32 fps;
 	UINT32 maxFps;
@@ -58,6 +70,17 @@ struct rdp_shadow_encoder
 	UINT32 frameId;
 	UINT32 lastAckframeId;
 	UINT32 queueDepth;
+
+	CRITICAL_SECTION rateLock;
+	SHADOW_RATE_CONTROL rate;
+	UINT32 rfxQuality;     /* quantization level set on the RemoteFX encoder */
+	UINT32 baseAckLatency; /* lowest frame acknowledge latency seen */
+	UINT32 stableFrames;   /* frames since congestion was seen last */
+	UINT64 lastDecrease;   /* tick count of the last quality decrease */
+	UINT64 frameSent[SHADOW_ENCODER_FRAME_HISTORY];
+	UINT32 measureFrames; /* frames sent during the running bandwidth measurement */
+	BOOL measureBusy;     /* the send queue never ran empty during the measurement */
+	BOOL measureValid;    /* the last measurement that stopped saw the link busy */
 };
 
 #ifdef __cplusplus
@@ -68,6 +91,11 @@ extern "C"
 	int shadow_encoder_reset(rdpShadowEncoder* encoder);
 	int shadow_encoder_prepare(rdpShadowEncoder* encoder, UINT32 codecs);
 	UINT32 shadow_encoder_create_frame_id(rdpShadowEncoder* encoder);
+	void shadow_encoder_frame_acknowledged(rdpShadowEncoder* encoder, UINT32 frameId);
+	void shadow_encoder_update_network(rdpShadowEncoder* encoder, UINT32 rtt, UINT32 bandwidth,
+	                                   BOOL capacity);
+	void shadow_encoder_bandwidth_measure_start(rdpShadowEncoder* encoder);
+	void shadow_encoder_bandwidth_measure_stop(rdpShadowEncoder* encoder);
 
 	void shadow_encoder_free(rdpShadowEncoder* encoder);
 
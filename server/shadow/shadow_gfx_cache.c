@@ -0,0 +1,512 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Graphics pipeline bitmap cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <winpr/assert.h>
+#include <winpr/cast.h>
+
+#include <freerdp/log.h>
+#include <freerdp/codec/color.h>
+
+#include "shadow_gfx_cache.h"
+
+#define TAG SERVER_TAG("shadow.gfx.cache")
+
+/* larger entries offered for import can not be tiles of ours */
+#define SHADOW_GFX_CACHE_MAX_ENTRY (SHADOW_GFX_CACHE_TILE_SIZE * SHADOW_GFX_CACHE_TILE_SIZE * 4)
+
+#define SHADOW_GFX_CACHE_PRIME1 0x9E3779B185EBCA87ull
+#define SHADOW_GFX_CACHE_PRIME2 0xC2B2AE3D27D4EB4Full
+#define SHADOW_GFX_CACHE_PRIME3 0x165667B19E3779F9ull
+
+typedef struct
+{
+	UINT64 key;
+	UINT32 size; /* 0 if the slot is free */
+	UINT16 prev; /* recently used list while in use, free list otherwise */
+	UINT16 next;
+} SHADOW_GFX_CACHE_SLOT;
+
+struct rdp_shadow_gfx_cache
+{
+	UINT32 maxSlots;
+	UINT64 maxBytes;
+	UINT64 bytes;
+
+	/* indexed by slot, 0 is no slot */
+	SHADOW_GFX_CACHE_SLOT* slots;
+	UINT32 unused; /* slots above this were never handed out */
+	UINT16 freeList;
+	UINT16 head; /* most recently used */
+	UINT16 tail; /* least recently used */
+
+	/* key to slot, open addressing */
+	UINT16* buckets;
+	size_t capacity;
+
+	UINT16* evicted;
+	size_t evictedCount;
+	size_t evictedIndex;
+
+	SHADOW_GFX_CACHE_TILE* tiles;
+	size_t tilesCapacity;
+
+	UINT64 hits;
+	UINT64 misses;
+	UINT64 added;
+	UINT64 imported;
+};
+
+static INLINE UINT64 shadow_gfx_cache_rotl(UINT64 value, unsigned bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+static INLINE UINT64 shadow_gfx_cache_round(UINT64 hash, UINT64 value)
+{
+	value *= SHADOW_GFX_CACHE_PRIME2;
+	value = shadow_gfx_cache_rotl(value, 31) * SHADOW_GFX_CACHE_PRIME1;
+	return shadow_gfx_cache_rotl(hash ^ value, 27) * SHADOW_GFX_CACHE_PRIME1 +
+	       SHADOW_GFX_CACHE_PRIME3;
+}
+
+/* keys are stored by the client across sessions, they must only depend on the pixels */
+static UINT64 shadow_gfx_cache_hash(const BYTE* pSrcData, UINT32 nSrcStep,
+                                    const RECTANGLE_16* rect)
+{
+	const UINT32 width = rect->right - rect->left;
+	const UINT32 height = rect->bottom - rect->top;
+	const size_t length = 4ull * width;
+	UINT64 hash = SHADOW_GFX_CACHE_PRIME3 ^ (((UINT64)width << 16) | height);
+
+	for (UINT32 y = 0; y < height; y++)
+	{
+		const BYTE* line = &pSrcData[1ull * (rect->top + y) * nSrcStep + 4ull * rect->left];
+		size_t x = 0;
+
+		for (; x + 8 <= length; x += 8)
+		{
+			UINT64 value = 0;
+			memcpy(&value, &line[x], sizeof(value));
+			hash = shadow_gfx_cache_round(hash, value);
+		}
+
+		if (x < length)
+		{
+			UINT32 value = 0;
+			memcpy(&value, &line[x], sizeof(value));
+			hash = shadow_gfx_cache_round(hash, value);
+		}
+	}
+
+	hash ^= hash >> 33;
+	hash *= SHADOW_GFX_CACHE_PRIME2;
+	hash ^= hash >> 29;
+	hash *= SHADOW_GFX_CACHE_PRIME3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+static INLINE size_t shadow_gfx_cache_bucket(const rdpShadowGfxCache* cache, UINT64 key)
+{
+	return (size_t)(key * SHADOW_GFX_CACHE_PRIME1 >> 32) & (cache->capacity - 1);
+}
+
+static UINT16 shadow_gfx_cache_find(const rdpShadowGfxCache* cache, UINT64 key, size_t* bucket)
+{
+	size_t index = shadow_gfx_cache_bucket(cache, key);
+
+	while (cache->buckets[index])
+	{
+		const UINT16 slot = cache->buckets[index];
+
+		if (cache->slots[slot].key == key)
+		{
+			*bucket = index;
+			return slot;
+		}
+
+		index = (index + 1) & (cache->capacity - 1);
+	}
+
+	*bucket = index;
+	return 0;
+}
+
+static void shadow_gfx_cache_unmap(rdpShadowGfxCache* cache, size_t bucket)
+{
+	const size_t mask = cache->capacity - 1;
+	size_t hole = bucket;
+	size_t index = bucket;
+
+	/* shift the entries probing past the hole back so lookups still find them */
+	for (;;)
+	{
+		index = (index + 1) & mask;
+
+		const UINT16 slot = cache->buckets[index];
+		if (!slot)
+			break;
+
+		const size_t home = shadow_gfx_cache_bucket(cache, cache->slots[slot].key);
+		if (((index - home) & mask) >= ((index - hole) & mask))
+		{
+			cache->buckets[hole] = slot;
+			hole = index;
+		}
+	}
+
+	cache->buckets[hole] = 0;
+}
+
+static void shadow_gfx_cache_unlink(rdpShadowGfxCache* cache, UINT16 slot)
+{
+	SHADOW_GFX_CACHE_SLOT* entry = &cache->slots[slot];
+
+	if (entry->prev)
+		cache->slots[entry->prev].next = entry->next;
+	else
+		cache->head = entry->next;
+
+	if (entry->next)
+		cache->slots[entry->next].prev = entry->prev;
+	else
+		cache->tail = entry->prev;
+
+	entry->prev = 0;
+	entry->next = 0;
+}
+
+static void shadow_gfx_cache_link(rdpShadowGfxCache* cache, UINT16 slot)
+{
+	SHADOW_GFX_CACHE_SLOT* entry = &cache->slots[slot];
+
+	entry->prev = 0;
+	entry->next = cache->head;
+
+	if (cache->head)
+		cache->slots[cache->head].prev = slot;
+	else
+		cache->tail = slot;
+
+	cache->head = slot;
+}
+
+static void shadow_gfx_cache_touch(rdpShadowGfxCache* cache, UINT16 slot)
+{
+	if (cache->head == slot)
+		return;
+
+	shadow_gfx_cache_unlink(cache, slot);
+	shadow_gfx_cache_link(cache, slot);
+}
+
+static UINT16 shadow_gfx_cache_take_free(rdpShadowGfxCache* cache)
+{
+	if (cache->freeList)
+	{
+		const UINT16 slot = cache->freeList;
+		cache->freeList = cache->slots[slot].next;
+		cache->slots[slot].next = 0;
+		return slot;
+	}
+
+	if (cache->unused < cache->maxSlots)
+	{
+		cache->unused++;
+		return WINPR_ASSERTING_INT_CAST(UINT16, cache->unused);
+	}
+
+	return 0;
+}
+
+/* drop the least recently used entry, the client still holds it until evicted */
+static UINT16 shadow_gfx_cache_drop_tail(rdpShadowGfxCache* cache)
+{
+	size_t bucket = 0;
+	const UINT16 slot = cache->tail;
+	SHADOW_GFX_CACHE_SLOT* entry = &cache->slots[slot];
+
+	WINPR_ASSERT(slot);
+
+	const UINT16 found = shadow_gfx_cache_find(cache, entry->key, &bucket);
+	WINPR_ASSERT(found == slot);
+	WINPR_UNUSED(found);
+
+	shadow_gfx_cache_unmap(cache, bucket);
+	shadow_gfx_cache_unlink(cache, slot);
+	cache->bytes -= entry->size;
+	entry->size = 0;
+	entry->key = 0;
+	return slot;
+}
+
+static void shadow_gfx_cache_store(rdpShadowGfxCache* cache, UINT16 slot, size_t bucket,
+                                   UINT64 key, UINT32 size)
+{
+	SHADOW_GFX_CACHE_SLOT* entry = &cache->slots[slot];
+
+	entry->key = key;
+	entry->size = size;
+	cache->bytes += size;
+	cache->buckets[bucket] = slot;
+	shadow_gfx_cache_link(cache, slot);
+}
+
+static void shadow_gfx_cache_release(rdpShadowGfxCache* cache)
+{
+	if ((cache->hits > 0) || (cache->added > 0))
+		WLog_DBG(TAG,
+		         "%" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " added, %" PRIu64
+		         " imported",
+		         cache->hits, cache->misses, cache->added, cache->imported);
+
+	free(cache->slots);
+	free(cache->buckets);
+	free(cache->evicted);
+	cache->slots = NULL;
+	cache->buckets = NULL;
+	cache->evicted = NULL;
+}
+
+BOOL shadow_gfx_cache_covered(const REGION16* region, const RECTANGLE_16* rect)
+{
+	UINT32 numRects = 0;
+	UINT64 area = 0;
+	REGION16 part;
+
+	WINPR_ASSERT(region);
+	WINPR_ASSERT(rect);
+
+	region16_init(&part);
+
+	if (region16_intersect_rect(&part, region, rect))
+	{
+		const RECTANGLE_16* rects = region16_rects(&part, &numRects);
+		for (UINT32 index = 0; index < numRects; index++)
+			area += 1ull * (rects[index].right - rects[index].left) *
+			        (rects[index].bottom - rects[index].top);
+	}
+
+	region16_uninit(&part);
+	return (area > 0) && (area == 1ull * (rect->right - rect->left) * (rect->bottom - rect->top));
+}
+
+BOOL shadow_gfx_cache_reset(rdpShadowGfxCache* cache, UINT32 maxSlots, UINT64 maxBytes)
+{
+	WINPR_ASSERT(cache);
+
+	shadow_gfx_cache_release(cache);
+
+	const UINT32 count = MIN(maxSlots, UINT16_MAX);
+	SHADOW_GFX_CACHE_TILE* tiles = cache->tiles;
+	const size_t tilesCapacity = cache->tilesCapacity;
+
+	/* the tile array is only scratch space, it is kept */
+	*cache = (rdpShadowGfxCache){ 0 };
+	cache->tiles = tiles;
+	cache->tilesCapacity = tilesCapacity;
+
+	if (count == 0)
+		return TRUE;
+
+	cache->capacity = 1;
+	while (cache->capacity < 2ull * count)
+		cache->capacity <<= 1;
+
+	cache->slots = calloc(count + 1ull, sizeof(SHADOW_GFX_CACHE_SLOT));
+	cache->buckets = calloc(cache->capacity, sizeof(UINT16));
+	cache->evicted = calloc(count, sizeof(UINT16));
+
+	if (!cache->slots || !cache->buckets || !cache->evicted)
+	{
+		shadow_gfx_cache_release(cache);
+		return FALSE;
+	}
+
+	cache->maxSlots = count;
+	cache->maxBytes = maxBytes;
+	return TRUE;
+}
+
+BOOL shadow_gfx_cache_lookup(rdpShadowGfxCache* cache, const BYTE* pSrcData, UINT32 SrcFormat,
+                             UINT32 nSrcStep, UINT32 nWidth, UINT32 nHeight,
+                             const REGION16* region, SHADOW_GFX_CACHE_TILE** tiles, size_t* count)
+{
+	BOOL rc = TRUE;
+
+	WINPR_ASSERT(cache);
+	WINPR_ASSERT(region);
+	WINPR_ASSERT(tiles);
+	WINPR_ASSERT(count);
+
+	*tiles = cache->tiles;
+	*count = 0;
+
+	if ((cache->maxSlots == 0) || region16_is_empty(region) ||
+	    (FreeRDPGetBytesPerPixel(SrcFormat) != 4))
+		return TRUE;
+
+	const RECTANGLE_16* extents = region16_extents(region);
+	const UINT32 left = extents->left & ~(SHADOW_GFX_CACHE_TILE_SIZE - 1u);
+	const UINT32 top = extents->top & ~(SHADOW_GFX_CACHE_TILE_SIZE - 1u);
+	const UINT32 right = MIN(extents->right, nWidth);
+	const UINT32 bottom = MIN(extents->bottom, nHeight);
+
+	for (UINT32 y = top; rc && (y < bottom); y += SHADOW_GFX_CACHE_TILE_SIZE)
+	{
+		for (UINT32 x = left; x < right; x += SHADOW_GFX_CACHE_TILE_SIZE)
+		{
+			size_t bucket = 0;
+			const RECTANGLE_16 rect = {
+				WINPR_ASSERTING_INT_CAST(UINT16, x), WINPR_ASSERTING_INT_CAST(UINT16, y),
+				WINPR_ASSERTING_INT_CAST(UINT16, MIN(x + SHADOW_GFX_CACHE_TILE_SIZE, nWidth)),
+				WINPR_ASSERTING_INT_CAST(UINT16, MIN(y + SHADOW_GFX_CACHE_TILE_SIZE, nHeight))
+			};
+
+			/* partly damaged tiles are not in the client cache as a whole */
+			if (!shadow_gfx_cache_covered(region, &rect))
+				continue;
+
+			if (*count >= cache->tilesCapacity)
+			{
+				const size_t capacity = MAX(64, cache->tilesCapacity * 2);
+				SHADOW_GFX_CACHE_TILE* tmp =
+				    realloc(cache->tiles, capacity * sizeof(SHADOW_GFX_CACHE_TILE));
+
+				rc = (tmp != NULL);
+				if (!rc)
+					break;
+
+				cache->tiles = tmp;
+				cache->tilesCapacity = capacity;
+			}
+
+			SHADOW_GFX_CACHE_TILE* tile = &cache->tiles[(*count)++];
+			tile->rect = rect;
+			tile->key = shadow_gfx_cache_hash(pSrcData, nSrcStep, &rect);
+			tile->slot = shadow_gfx_cache_find(cache, tile->key, &bucket);
+
+			if (tile->slot)
+			{
+				shadow_gfx_cache_touch(cache, tile->slot);
+				cache->hits++;
+			}
+			else
+				cache->misses++;
+		}
+	}
+
+	*tiles = cache->tiles;
+	return rc;
+}
+
+UINT16 shadow_gfx_cache_add(rdpShadowGfxCache* cache, UINT64 key, UINT32 size)
+{
+	size_t bucket = 0;
+
+	WINPR_ASSERT(cache);
+
+	cache->evictedCount = 0;
+	cache->evictedIndex = 0;
+
+	if ((cache->maxSlots == 0) || (size > cache->maxBytes))
+		return 0;
+
+	/* the same content twice in one frame */
+	if (shadow_gfx_cache_find(cache, key, &bucket))
+		return 0;
+
+	UINT16 slot = shadow_gfx_cache_take_free(cache);
+	if (!slot)
+		slot = shadow_gfx_cache_drop_tail(cache);
+
+	while (cache->bytes + size > cache->maxBytes)
+	{
+		const UINT16 dropped = shadow_gfx_cache_drop_tail(cache);
+		cache->slots[dropped].next = cache->freeList;
+		cache->freeList = dropped;
+		cache->evicted[cache->evictedCount++] = dropped;
+	}
+
+	/* dropping entries moved the others around */
+	(void)shadow_gfx_cache_find(cache, key, &bucket);
+	shadow_gfx_cache_store(cache, slot, bucket, key, size);
+	cache->added++;
+	return slot;
+}
+
+BOOL shadow_gfx_cache_next_evicted(rdpShadowGfxCache* cache, UINT16* slot)
+{
+	WINPR_ASSERT(cache);
+	WINPR_ASSERT(slot);
+
+	if (cache->evictedIndex >= cache->evictedCount)
+		return FALSE;
+
+	*slot = cache->evicted[cache->evictedIndex++];
+	return TRUE;
+}
+
+UINT16 shadow_gfx_cache_import(rdpShadowGfxCache* cache, UINT64 key, UINT32 size)
+{
+	size_t bucket = 0;
+
+	WINPR_ASSERT(cache);
+
+	if ((cache->maxSlots == 0) || (size == 0) || (size > SHADOW_GFX_CACHE_MAX_ENTRY) ||
+	    (cache->bytes + size > cache->maxBytes))
+		return 0;
+
+	if (shadow_gfx_cache_find(cache, key, &bucket))
+		return 0;
+
+	const UINT16 slot = shadow_gfx_cache_take_free(cache);
+	if (!slot)
+		return 0;
+
+	/* imported entries are older than anything the session showed */
+	shadow_gfx_cache_store(cache, slot, bucket, key, size);
+	shadow_gfx_cache_unlink(cache, slot);
+
+	SHADOW_GFX_CACHE_SLOT* entry = &cache->slots[slot];
+	entry->prev = cache->tail;
+	if (cache->tail)
+		cache->slots[cache->tail].next = slot;
+	else
+		cache->head = slot;
+	cache->tail = slot;
+
+	cache->imported++;
+	return slot;
+}
+
+rdpShadowGfxCache* shadow_gfx_cache_new(void)
+{
+	return calloc(1, sizeof(rdpShadowGfxCache));
+}
+
+void shadow_gfx_cache_free(rdpShadowGfxCache* cache)
+{
+	if (!cache)
+		return;
+
+	shadow_gfx_cache_release(cache);
+	free(cache->tiles);
+	free(cache);
+}
@@ -0,0 +1,102 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Graphics pipeline bitmap cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_SERVER_SHADOW_GFX_CACHE_H
+#define FREERDP_SERVER_SHADOW_GFX_CACHE_H
+
+#include <winpr/crt.h>
+
+#include <freerdp/codec/region.h>
+
+/*
+ * Mirrors the bitmap cache of a graphics pipeline client. Tiles are keyed by
+ * a hash of their pixels, so a tile shown again (a toolbar, a dialog, a tab
+ * switched back to) is copied from the client cache with CacheToSurface
+ * instead of being encoded again. The keys only depend on the content, which
+ * lets entries the client kept from an earlier session be imported.
+ *
+ * Slots are recycled least recently used first, within the slot count and
+ * the memory the client reserves for its cache.
+ */
+
+#define SHADOW_GFX_CACHE_TILE_SIZE 64
+
+typedef struct
+{
+	RECTANGLE_16 rect;
+	UINT64 key;
+	UINT16 slot; /* 0 if the tile is not in the client cache */
+} SHADOW_GFX_CACHE_TILE;
+
+typedef struct rdp_shadow_gfx_cache rdpShadowGfxCache;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	void shadow_gfx_cache_free(rdpShadowGfxCache* cache);
+
+	WINPR_ATTR_MALLOC(shadow_gfx_cache_free, 1)
+	rdpShadowGfxCache* shadow_gfx_cache_new(void);
+
+	/**
+	 * Forget all entries, the client starts with an empty cache.
+	 * With maxSlots 0 nothing is cached.
+	 */
+	BOOL shadow_gfx_cache_reset(rdpShadowGfxCache* cache, UINT32 maxSlots, UINT64 maxBytes);
+
+	/**
+	 * Hash the tiles fully within region and look them up.
+	 * Tiles in the cache are marked recently used.
+	 *
+	 * @param tiles Receives the tiles, valid until the next call
+	 * @param count Receives the number of tiles
+	 * @return TRUE on success
+	 */
+	BOOL shadow_gfx_cache_lookup(rdpShadowGfxCache* cache, const BYTE* pSrcData, UINT32 SrcFormat,
+	                             UINT32 nSrcStep, UINT32 nWidth, UINT32 nHeight,
+	                             const REGION16* region, SHADOW_GFX_CACHE_TILE** tiles,
+	                             size_t* count);
+
+	/**
+	 * Pick the slot for a tile about to be sent with SurfaceToCache, evicting the least
+	 * recently used entries if needed. Slots emptied on the way are returned by
+	 * shadow_gfx_cache_next_evicted, they must be evicted on the client before the new
+	 * entry is stored.
+	 *
+	 * @return The slot or 0 if the tile is not cached
+	 */
+	UINT16 shadow_gfx_cache_add(rdpShadowGfxCache* cache, UINT64 key, UINT32 size);
+
+	BOOL shadow_gfx_cache_next_evicted(rdpShadowGfxCache* cache, UINT16* slot);
+
+	/**
+	 * Take over an entry of the client persistent cache. Nothing is evicted for it.
+	 *
+	 * @return The slot for the entry or 0 if it is not imported
+	 */
+	UINT16 shadow_gfx_cache_import(rdpShadowGfxCache* cache, UINT64 key, UINT32 size);
+
+	/** Check whether a rectangle lies within a region */
+	BOOL shadow_gfx_cache_covered(const REGION16* region, const RECTANGLE_16* rect);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_SERVER_SHADOW_GFX_CACHE_H */
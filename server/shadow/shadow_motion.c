@@ -0,0 +1,676 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Scroll and move detection
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <winpr/assert.h>
+#include <winpr/cast.h>
+
+#include <freerdp/codec/color.h>
+
+#include "shadow_motion.h"
+
+/* pixels of a hashed row segment */
+#define SHADOW_MOTION_BLOCK 32
+/* every this many rows of the new frame are searched for segments of the previous one */
+#define SHADOW_MOTION_ROW_STEP 8
+/* matching segments needed before a vector is considered, and how many are tried */
+#define SHADOW_MOTION_MIN_VOTES 4
+#define SHADOW_MOTION_MAX_VECTORS 64
+#define SHADOW_MOTION_MAX_CANDIDATES 8
+/* smaller damage is not worth searching, smaller moves are not worth a command */
+#define SHADOW_MOTION_MIN_WIDTH 64
+#define SHADOW_MOTION_MIN_HEIGHT 16
+#define SHADOW_MOTION_MIN_AREA (64 * 64)
+
+#define SHADOW_MOTION_HASH_BASE 0x100000001B3ull
+
+typedef struct
+{
+	UINT64 hash;
+	UINT32 generation; /* the entry is empty unless it matches the one of the table */
+	UINT16 x;
+	UINT16 y;
+	BOOL unique; /* segments found in more than one place do not vote */
+} SHADOW_MOTION_ENTRY;
+
+typedef struct
+{
+	INT32 dx;
+	INT32 dy;
+	UINT32 votes;
+	UINT16 x; /* first segment voting for the vector */
+	UINT16 y;
+} SHADOW_MOTION_VECTOR;
+
+struct rdp_shadow_motion
+{
+	UINT32 width;
+	UINT32 height;
+	size_t scanline;
+	BYTE* frame;    /* the frame last sent, 32bpp in the format of the surface */
+	REGION16 known; /* the parts of frame the client has */
+
+	SHADOW_MOTION_ENTRY* entries;
+	size_t capacity;
+	UINT32 generation;
+
+	/* one bit per hash bucket, most searched segments are not indexed and only test this */
+	UINT64* filter;
+	size_t filterBits;
+};
+
+static INLINE UINT32 shadow_motion_pixel(const BYTE* pixel)
+{
+	UINT32 value = 0;
+	memcpy(&value, pixel, sizeof(value));
+	return value;
+}
+
+static UINT64 shadow_motion_hash(const BYTE* line)
+{
+	UINT64 hash = 0;
+
+	for (size_t x = 0; x < SHADOW_MOTION_BLOCK; x++)
+		hash = hash * SHADOW_MOTION_HASH_BASE + shadow_motion_pixel(&line[4 * x]);
+
+	return hash;
+}
+
+/* segments of a single color are everywhere, they tell nothing about motion */
+static BOOL shadow_motion_uniform(const BYTE* line)
+{
+	const UINT32 first = shadow_motion_pixel(line);
+
+	for (size_t x = 1; x < SHADOW_MOTION_BLOCK; x++)
+	{
+		if (shadow_motion_pixel(&line[4 * x]) != first)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static INLINE const BYTE* shadow_motion_previous(const rdpShadowMotion* motion, UINT32 x, UINT32 y)
+{
+	return &motion->frame[1ull * y * motion->scanline + 4ull * x];
+}
+
+static INLINE const BYTE* shadow_motion_current(const BYTE* pSrcData, UINT32 nSrcStep, UINT32 x,
+                                                UINT32 y)
+{
+	return &pSrcData[1ull * y * nSrcStep + 4ull * x];
+}
+
+static UINT64 shadow_motion_mix(UINT64 hash)
+{
+	hash ^= hash >> 31;
+	return hash * 0x9E3779B97F4A7C15ull;
+}
+
+static size_t shadow_motion_slot(const rdpShadowMotion* motion, UINT64 hash)
+{
+	return (size_t)(shadow_motion_mix(hash) >> 32) & (motion->capacity - 1);
+}
+
+static size_t shadow_motion_filter_bit(const rdpShadowMotion* motion, UINT64 hash)
+{
+	return (size_t)shadow_motion_mix(hash) & (motion->filterBits - 1);
+}
+
+static BOOL shadow_motion_prepare_table(rdpShadowMotion* motion, size_t segments)
+{
+	size_t capacity = 1024;
+
+	while (capacity < 2 * segments)
+		capacity *= 2;
+
+	if (capacity > motion->capacity)
+	{
+		SHADOW_MOTION_ENTRY* entries = calloc(capacity, sizeof(SHADOW_MOTION_ENTRY));
+		UINT64* filter = calloc(capacity / 16, sizeof(UINT64));
+
+		if (!entries || !filter)
+		{
+			free(entries);
+			free(filter);
+			return FALSE;
+		}
+
+		free(motion->entries);
+		free(motion->filter);
+		motion->entries = entries;
+		motion->capacity = capacity;
+		motion->generation = 0;
+		motion->filter = filter;
+		motion->filterBits = capacity * 4;
+	}
+
+	memset(motion->filter, 0, motion->filterBits / 8);
+
+	if (++motion->generation == 0)
+	{
+		memset(motion->entries, 0, motion->capacity * sizeof(SHADOW_MOTION_ENTRY));
+		motion->generation = 1;
+	}
+
+	return TRUE;
+}
+
+/* the table is at least twice the number of segments, there always is a free slot */
+static void shadow_motion_insert(rdpShadowMotion* motion, UINT64 hash, UINT32 x, UINT32 y)
+{
+	size_t slot = shadow_motion_slot(motion, hash);
+	const size_t bit = shadow_motion_filter_bit(motion, hash);
+
+	motion->filter[bit / 64] |= 1ull << (bit % 64);
+
+	for (;;)
+	{
+		SHADOW_MOTION_ENTRY* entry = &motion->entries[slot];
+
+		if (entry->generation != motion->generation)
+		{
+			entry->hash = hash;
+			entry->generation = motion->generation;
+			entry->x = WINPR_ASSERTING_INT_CAST(UINT16, x);
+			entry->y = WINPR_ASSERTING_INT_CAST(UINT16, y);
+			entry->unique = TRUE;
+			return;
+		}
+
+		if (entry->hash == hash)
+		{
+			entry->unique = FALSE;
+			return;
+		}
+
+		slot = (slot + 1) & (motion->capacity - 1);
+	}
+}
+
+static const SHADOW_MOTION_ENTRY* shadow_motion_lookup(const rdpShadowMotion* motion, UINT64 hash)
+{
+	const size_t bit = shadow_motion_filter_bit(motion, hash);
+
+	if ((motion->filter[bit / 64] & (1ull << (bit % 64))) == 0)
+		return NULL;
+
+	size_t slot = shadow_motion_slot(motion, hash);
+
+	for (;;)
+	{
+		const SHADOW_MOTION_ENTRY* entry = &motion->entries[slot];
+
+		if (entry->generation != motion->generation)
+			return NULL;
+
+		if (entry->hash == hash)
+			return entry->unique ? entry : NULL;
+
+		slot = (slot + 1) & (motion->capacity - 1);
+	}
+}
+
+static void shadow_motion_vote(SHADOW_MOTION_VECTOR* vectors, size_t* count, INT32 dx, INT32 dy,
+                               UINT32 x, UINT32 y)
+{
+	for (size_t index = 0; index < *count; index++)
+	{
+		if ((vectors[index].dx == dx) && (vectors[index].dy == dy))
+		{
+			vectors[index].votes++;
+			return;
+		}
+	}
+
+	if (*count >= SHADOW_MOTION_MAX_VECTORS)
+		return;
+
+	SHADOW_MOTION_VECTOR* vector = &vectors[(*count)++];
+	vector->dx = dx;
+	vector->dy = dy;
+	vector->votes = 1;
+	vector->x = WINPR_ASSERTING_INT_CAST(UINT16, x);
+	vector->y = WINPR_ASSERTING_INT_CAST(UINT16, y);
+}
+
+static int shadow_motion_compare_votes(const void* a, const void* b)
+{
+	const SHADOW_MOTION_VECTOR* va = a;
+	const SHADOW_MOTION_VECTOR* vb = b;
+
+	if (va->votes == vb->votes)
+		return 0;
+	return (va->votes > vb->votes) ? -1 : 1;
+}
+
+static BOOL shadow_motion_match_row(const rdpShadowMotion* motion, const BYTE* pSrcData,
+                                    UINT32 nSrcStep, const SHADOW_MOTION_VECTOR* vector,
+                                    UINT32 left, UINT32 right, UINT32 y)
+{
+	const BYTE* current = shadow_motion_current(pSrcData, nSrcStep, left, y);
+	const BYTE* previous = shadow_motion_previous(
+	    motion, WINPR_ASSERTING_INT_CAST(UINT32, (INT64)left - vector->dx),
+	    WINPR_ASSERTING_INT_CAST(UINT32, (INT64)y - vector->dy));
+
+	return memcmp(current, previous, 4ull * (right - left)) == 0;
+}
+
+/**
+ * The columns from left down to limit matching on every row. Rows are scanned one after
+ * the other, each only as far as all rows before it matched.
+ */
+static UINT32 shadow_motion_extend_left(const rdpShadowMotion* motion, const BYTE* pSrcData,
+                                        UINT32 nSrcStep, const SHADOW_MOTION_VECTOR* vector,
+                                        UINT32 left, UINT32 top, UINT32 bottom, UINT32 limit)
+{
+	for (UINT32 y = top; (y < bottom) && (limit < left); y++)
+	{
+		UINT32 x = left;
+
+		while ((x > limit) &&
+		       shadow_motion_match_row(motion, pSrcData, nSrcStep, vector, x - 1, x, y))
+			x--;
+
+		limit = x;
+	}
+
+	return limit;
+}
+
+static UINT32 shadow_motion_extend_right(const rdpShadowMotion* motion, const BYTE* pSrcData,
+                                         UINT32 nSrcStep, const SHADOW_MOTION_VECTOR* vector,
+                                         UINT32 right, UINT32 top, UINT32 bottom, UINT32 limit)
+{
+	for (UINT32 y = top; (y < bottom) && (limit > right); y++)
+	{
+		UINT32 x = right;
+
+		while ((x < limit) &&
+		       shadow_motion_match_row(motion, pSrcData, nSrcStep, vector, x, x + 1, y))
+			x++;
+
+		limit = x;
+	}
+
+	return limit;
+}
+
+/**
+ * Grow the segment of a vector into the largest rectangle moved by it: first along the
+ * segment columns, then to the sides and once more along the full rows.
+ */
+static RECTANGLE_16 shadow_motion_grow(const rdpShadowMotion* motion, const BYTE* pSrcData,
+                                       UINT32 nSrcStep, const SHADOW_MOTION_VECTOR* vector,
+                                       const RECTANGLE_16* bounds)
+{
+	UINT32 left = vector->x;
+	UINT32 right = left + SHADOW_MOTION_BLOCK;
+	UINT32 top = vector->y;
+	UINT32 bottom = top + 1;
+
+	for (size_t pass = 0; pass < 2; pass++)
+	{
+		while ((top > bounds->top) &&
+		       shadow_motion_match_row(motion, pSrcData, nSrcStep, vector, left, right, top - 1))
+			top--;
+
+		while ((bottom < bounds->bottom) &&
+		       shadow_motion_match_row(motion, pSrcData, nSrcStep, vector, left, right, bottom))
+			bottom++;
+
+		if (pass > 0)
+			break;
+
+		left = shadow_motion_extend_left(motion, pSrcData, nSrcStep, vector, left, top, bottom,
+		                                 bounds->left);
+		right = shadow_motion_extend_right(motion, pSrcData, nSrcStep, vector, right, top, bottom,
+		                                   bounds->right);
+	}
+
+	const RECTANGLE_16 rect = { WINPR_ASSERTING_INT_CAST(UINT16, left),
+		                        WINPR_ASSERTING_INT_CAST(UINT16, top),
+		                        WINPR_ASSERTING_INT_CAST(UINT16, right),
+		                        WINPR_ASSERTING_INT_CAST(UINT16, bottom) };
+	return rect;
+}
+
+static BOOL shadow_motion_covered(const REGION16* region, const RECTANGLE_16* rect)
+{
+	UINT32 count = 0;
+	size_t area = 0;
+	REGION16 intersection = { 0 };
+
+	region16_init(&intersection);
+	if (region16_intersect_rect(&intersection, region, rect))
+	{
+		const RECTANGLE_16* rects = region16_rects(&intersection, &count);
+		for (UINT32 x = 0; x < count; x++)
+			area += 1ull * (rects[x].right - rects[x].left) * (rects[x].bottom - rects[x].top);
+	}
+	region16_uninit(&intersection);
+
+	return area == 1ull * (rect->right - rect->left) * (rect->bottom - rect->top);
+}
+
+/* index every aligned segment of the previous frame within the searched area */
+static BOOL shadow_motion_index(rdpShadowMotion* motion, const RECTANGLE_16* area)
+{
+	const UINT32 segments = (1u * area->right - area->left) / SHADOW_MOTION_BLOCK;
+
+	if (!shadow_motion_prepare_table(motion, 1ull * segments * (area->bottom - area->top)))
+		return FALSE;
+
+	for (UINT32 y = area->top; y < area->bottom; y++)
+	{
+		for (UINT32 index = 0; index < segments; index++)
+		{
+			const UINT32 x = area->left + index * SHADOW_MOTION_BLOCK;
+			const BYTE* line = shadow_motion_previous(motion, x, y);
+
+			if (!shadow_motion_uniform(line))
+				shadow_motion_insert(motion, shadow_motion_hash(line), x, y);
+		}
+	}
+
+	return TRUE;
+}
+
+/* look for the indexed segments at any position of some rows of the new frame */
+static size_t shadow_motion_search(const rdpShadowMotion* motion, const BYTE* pSrcData,
+                                   UINT32 nSrcStep, const RECTANGLE_16* area,
+                                   SHADOW_MOTION_VECTOR* vectors)
+{
+	size_t count = 0;
+	UINT64 power = 1;
+
+	for (size_t x = 1; x < SHADOW_MOTION_BLOCK; x++)
+		power *= SHADOW_MOTION_HASH_BASE;
+
+	for (UINT32 y = area->top; y < area->bottom; y += SHADOW_MOTION_ROW_STEP)
+	{
+		const BYTE* line = shadow_motion_current(pSrcData, nSrcStep, 0, y);
+		UINT64 hash = shadow_motion_hash(&line[4ull * area->left]);
+
+		for (UINT32 x = area->left; x + SHADOW_MOTION_BLOCK <= area->right; x++)
+		{
+			const SHADOW_MOTION_ENTRY* entry = shadow_motion_lookup(motion, hash);
+
+			if (entry && ((entry->x != x) || (entry->y != y)) &&
+			    (memcmp(&line[4ull * x], shadow_motion_previous(motion, entry->x, entry->y),
+			            4ull * SHADOW_MOTION_BLOCK) == 0))
+				shadow_motion_vote(vectors, &count, (INT32)x - entry->x, (INT32)y - entry->y, x,
+				                   y);
+
+			if (x + SHADOW_MOTION_BLOCK < area->right)
+			{
+				hash -= power * shadow_motion_pixel(&line[4ull * x]);
+				hash = hash * SHADOW_MOTION_HASH_BASE +
+				       shadow_motion_pixel(&line[4ull * (x + SHADOW_MOTION_BLOCK)]);
+			}
+		}
+	}
+
+	return count;
+}
+
+static BOOL shadow_motion_accept(const rdpShadowMotion* motion, const SHADOW_MOTION_MOVE* move,
+                                 const SHADOW_MOTION_MOVE* moves, size_t count)
+{
+	const RECTANGLE_16* rect = &move->rect;
+	const RECTANGLE_16 source = { WINPR_ASSERTING_INT_CAST(UINT16, rect->left - move->dx),
+		                          WINPR_ASSERTING_INT_CAST(UINT16, rect->top - move->dy),
+		                          WINPR_ASSERTING_INT_CAST(UINT16, rect->right - move->dx),
+		                          WINPR_ASSERTING_INT_CAST(UINT16, rect->bottom - move->dy) };
+
+	if (1ull * (rect->right - rect->left) * (rect->bottom - rect->top) < SHADOW_MOTION_MIN_AREA)
+		return FALSE;
+
+	/* the client copies what it has, not what was captured */
+	if (!shadow_motion_covered(&motion->known, &source))
+		return FALSE;
+
+	/* earlier moves are applied first and must not change the source */
+	for (size_t index = 0; index < count; index++)
+	{
+		if (rectangles_intersects(&moves[index].rect, rect) ||
+		    rectangles_intersects(&moves[index].rect, &source))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+void shadow_motion_reset(rdpShadowMotion* motion)
+{
+	if (!motion)
+		return;
+
+	free(motion->frame);
+	motion->frame = NULL;
+	motion->width = 0;
+	motion->height = 0;
+	motion->scanline = 0;
+	region16_clear(&motion->known);
+}
+
+BOOL shadow_motion_detect(rdpShadowMotion* motion, const BYTE* pSrcData, UINT32 SrcFormat,
+                          UINT32 nSrcStep, UINT32 nWidth, UINT32 nHeight, const REGION16* damage,
+                          SHADOW_MOTION_MOVE* moves, size_t maxMoves, size_t* count)
+{
+	SHADOW_MOTION_VECTOR vectors[SHADOW_MOTION_MAX_VECTORS] = { 0 };
+
+	WINPR_ASSERT(motion);
+	WINPR_ASSERT(pSrcData);
+	WINPR_ASSERT(damage);
+	WINPR_ASSERT(moves || (maxMoves == 0));
+	WINPR_ASSERT(count);
+
+	*count = 0;
+
+	if (!motion->frame || (motion->width != nWidth) || (motion->height != nHeight) ||
+	    (FreeRDPGetBytesPerPixel(SrcFormat) != 4) || (maxMoves == 0) ||
+	    region16_is_empty(damage))
+		return TRUE;
+
+	/* moved content leaves damage where it came from as well, so search the damage only */
+	const RECTANGLE_16* extents = region16_extents(damage);
+	const RECTANGLE_16 area = { extents->left, extents->top,
+		                        WINPR_ASSERTING_INT_CAST(UINT16, MIN(extents->right, nWidth)),
+		                        WINPR_ASSERTING_INT_CAST(UINT16, MIN(extents->bottom, nHeight)) };
+
+	if ((area.right < area.left + SHADOW_MOTION_MIN_WIDTH) ||
+	    (area.bottom < area.top + SHADOW_MOTION_MIN_HEIGHT) ||
+	    !region16_intersects_rect(&motion->known, &area))
+		return TRUE;
+
+	if (!shadow_motion_index(motion, &area))
+		return FALSE;
+
+	const size_t numVectors = shadow_motion_search(motion, pSrcData, nSrcStep, &area, vectors);
+	qsort(vectors, numVectors, sizeof(SHADOW_MOTION_VECTOR), shadow_motion_compare_votes);
+
+	size_t candidates = 0;
+
+	for (size_t index = 0; index < numVectors; index++)
+	{
+		const SHADOW_MOTION_VECTOR* vector = &vectors[index];
+		const RECTANGLE_16 seed = { vector->x, vector->y,
+			                        WINPR_ASSERTING_INT_CAST(UINT16,
+			                                                 vector->x + SHADOW_MOTION_BLOCK),
+			                        WINPR_ASSERTING_INT_CAST(UINT16, vector->y + 1) };
+		BOOL moved = FALSE;
+
+		if ((vector->votes < SHADOW_MOTION_MIN_VOTES) || (*count >= maxMoves) ||
+		    (candidates >= SHADOW_MOTION_MAX_CANDIDATES))
+			break;
+
+		for (size_t x = 0; x < *count; x++)
+			moved |= rectangles_intersects(&moves[x].rect, &seed);
+
+		if (moved)
+			continue;
+
+		candidates++;
+
+		/* both the destination and the source stay within the searched area */
+		const RECTANGLE_16 bounds = {
+			WINPR_ASSERTING_INT_CAST(UINT16, MAX(area.left, area.left + vector->dx)),
+			WINPR_ASSERTING_INT_CAST(UINT16, MAX(area.top, area.top + vector->dy)),
+			WINPR_ASSERTING_INT_CAST(UINT16, MIN(area.right, area.right + vector->dx)),
+			WINPR_ASSERTING_INT_CAST(UINT16, MIN(area.bottom, area.bottom + vector->dy))
+		};
+
+		SHADOW_MOTION_MOVE move = { 0 };
+		move.rect = shadow_motion_grow(motion, pSrcData, nSrcStep, vector, &bounds);
+		move.dx = vector->dx;
+		move.dy = vector->dy;
+
+		if (shadow_motion_accept(motion, &move, moves, *count))
+			moves[(*count)++] = move;
+	}
+
+	return TRUE;
+}
+
+BOOL shadow_motion_update(rdpShadowMotion* motion, const BYTE* pSrcData, UINT32 SrcFormat,
+                          UINT32 nSrcStep, UINT32 nWidth, UINT32 nHeight, const REGION16* damage)
+{
+	UINT32 numRects = 0;
+
+	WINPR_ASSERT(motion);
+	WINPR_ASSERT(pSrcData);
+	WINPR_ASSERT(damage);
+
+	if (FreeRDPGetBytesPerPixel(SrcFormat) != 4)
+	{
+		shadow_motion_reset(motion);
+		return TRUE;
+	}
+
+	if (!motion->frame || (motion->width != nWidth) || (motion->height != nHeight))
+	{
+		shadow_motion_reset(motion);
+
+		motion->frame = calloc(1ull * nWidth * nHeight, 4);
+		if (!motion->frame)
+			return FALSE;
+
+		motion->width = nWidth;
+		motion->height = nHeight;
+		motion->scanline = 4ull * nWidth;
+	}
+
+	const RECTANGLE_16* rects = region16_rects(damage, &numRects);
+
+	for (UINT32 index = 0; index < numRects; index++)
+	{
+		const RECTANGLE_16* rect = &rects[index];
+		const UINT32 right = MIN(rect->right, nWidth);
+		const UINT32 bottom = MIN(rect->bottom, nHeight);
+
+		if ((rect->left >= right) || (rect->top >= bottom))
+			continue;
+
+		for (UINT32 y = rect->top; y < bottom; y++)
+			memcpy(&motion->frame[1ull * y * motion->scanline + 4ull * rect->left],
+			       shadow_motion_current(pSrcData, nSrcStep, rect->left, y),
+			       4ull * (right - rect->left));
+
+		const RECTANGLE_16 clipped = { rect->left, rect->top,
+			                           WINPR_ASSERTING_INT_CAST(UINT16, right),
+			                           WINPR_ASSERTING_INT_CAST(UINT16, bottom) };
+		if (!region16_union_rect(&motion->known, &motion->known, &clipped))
+		{
+			shadow_motion_reset(motion);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+BOOL shadow_motion_region_subtract(REGION16* region, const RECTANGLE_16* rect)
+{
+	BOOL rc = TRUE;
+	UINT32 numRects = 0;
+	REGION16 result = { 0 };
+
+	WINPR_ASSERT(region);
+	WINPR_ASSERT(rect);
+
+	if (!region16_intersects_rect(region, rect))
+		return TRUE;
+
+	region16_init(&result);
+	const RECTANGLE_16* rects = region16_rects(region, &numRects);
+
+	for (UINT32 index = 0; rc && (index < numRects); index++)
+	{
+		RECTANGLE_16 cut = { 0 };
+		const RECTANGLE_16* r = &rects[index];
+
+		if (!rectangles_intersection(r, rect, &cut))
+		{
+			rc = region16_union_rect(&result, &result, r);
+			continue;
+		}
+
+		const RECTANGLE_16 parts[] = {
+			{ r->left, r->top, r->right, cut.top },       /* above */
+			{ r->left, cut.bottom, r->right, r->bottom }, /* below */
+			{ r->left, cut.top, cut.left, cut.bottom },   /* left */
+			{ cut.right, cut.top, r->right, cut.bottom }  /* right */
+		};
+
+		for (size_t x = 0; rc && (x < ARRAYSIZE(parts)); x++)
+		{
+			if (!rectangle_is_empty(&parts[x]))
+				rc = region16_union_rect(&result, &result, &parts[x]);
+		}
+	}
+
+	if (rc)
+		rc = region16_copy(region, &result);
+
+	region16_uninit(&result);
+	return rc;
+}
+
+rdpShadowMotion* shadow_motion_new(void)
+{
+	rdpShadowMotion* motion = calloc(1, sizeof(rdpShadowMotion));
+
+	if (!motion)
+		return NULL;
+
+	region16_init(&motion->known);
+	return motion;
+}
+
+void shadow_motion_free(rdpShadowMotion* motion)
+{
+	if (!motion)
+		return;
+
+	region16_uninit(&motion->known);
+	free(motion->entries);
+	free(motion->filter);
+	free(motion->frame);
+	free(motion);
+}
@@ -0,0 +1,86 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Scroll and move detection
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_SERVER_SHADOW_MOTION_H
+#define FREERDP_SERVER_SHADOW_MOTION_H
+
+#include <winpr/crt.h>
+
+#include <freerdp/codec/region.h>
+
+/*
+ * Finds areas of a frame that moved since the frame last sent to a client,
+ * like a scrolled document or a dragged window. The client copies those
+ * within its surface and only the newly exposed parts need to be encoded.
+ *
+ * Row segments of the previous frame are hashed, then the rows of the new
+ * frame are searched for them with a rolling hash. Every match votes for a
+ * motion vector and the vectors with most votes are grown into the largest
+ * rectangle matching pixel by pixel.
+ */
+
+#define SHADOW_MOTION_MAX_MOVES 4
+
+typedef struct
+{
+	RECTANGLE_16 rect; /* destination */
+	INT32 dx;          /* the source is rect moved by -dx, -dy */
+	INT32 dy;
+} SHADOW_MOTION_MOVE;
+
+typedef struct rdp_shadow_motion rdpShadowMotion;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	void shadow_motion_free(rdpShadowMotion* motion);
+
+	WINPR_ATTR_MALLOC(shadow_motion_free, 1)
+	rdpShadowMotion* shadow_motion_new(void);
+
+	/** Forget the frame known to the client, its surface was recreated */
+	void shadow_motion_reset(rdpShadowMotion* motion);
+
+	/**
+	 * Find the areas of the damaged region that moved within the frame known to the client.
+	 * The sources of the moves do not overlap the destinations of the moves before them, so
+	 * they can be copied in order before anything else of the frame is sent.
+	 *
+	 * @param moves Array receiving up to maxMoves moves
+	 * @param count Receives the number of moves found
+	 * @return TRUE on success
+	 */
+	BOOL shadow_motion_detect(rdpShadowMotion* motion, const BYTE* pSrcData, UINT32 SrcFormat,
+	                          UINT32 nSrcStep, UINT32 nWidth, UINT32 nHeight,
+	                          const REGION16* damage, SHADOW_MOTION_MOVE* moves, size_t maxMoves,
+	                          size_t* count);
+
+	/** Remember the damaged region of a frame as sent to the client */
+	BOOL shadow_motion_update(rdpShadowMotion* motion, const BYTE* pSrcData, UINT32 SrcFormat,
+	                          UINT32 nSrcStep, UINT32 nWidth, UINT32 nHeight,
+	                          const REGION16* damage);
+
+	/** Remove a rectangle from a region */
+	BOOL shadow_motion_region_subtract(REGION16* region, const RECTANGLE_16* rect);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_SERVER_SHADOW_MOTION_H */
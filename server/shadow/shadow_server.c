@@ -467,6 +467,18 @@ int shadow_server_parse_command_line(rdpShadowServer* server, int argc, char** a
 			if (!freerdp_settings_set_bool(settings, FreeRDP_GfxPlanar, arg->Value ? TRUE : FALSE))
 				return fail_at(arg, COMMAND_LINE_ERROR);
 		}
+		CommandLineSwitchCase(arg, "gfx-clear")
+		{
+			if (!freerdp_settings_set_bool(settings, FreeRDP_GfxClearCodec,
+			                               arg->Value ? TRUE : FALSE))
+				return fail_at(arg, COMMAND_LINE_ERROR);
+		}
+		CommandLineSwitchCase(arg, "gfx-mixed")
+		{
+			if (!freerdp_settings_set_bool(settings, FreeRDP_GfxMixedCodecs,
+			                               arg->Value ? TRUE : FALSE))
+				return fail_at(arg, COMMAND_LINE_ERROR);
+		}
 		CommandLineSwitchCase(arg, "gfx-avc420")
 		{
 			if (!freerdp_settings_set_bool(settings, FreeRDP_GfxH264, arg->Value ? TRUE : FALSE))
@@ -935,6 +947,9 @@ int shadow_server_init(rdpShadowServer* server)
 	if (!InitializeCriticalSectionAndSpinCount(&(server->lock), 4000))
 		goto fail;
 
+	if (!(server->encodeCache = shadow_encode_cache_new()))
+		goto fail;
+
 	status = shadow_server_init_config_path(server);
 
 	if (status < 0)
@@ -977,6 +992,8 @@ int shadow_server_uninit(rdpShadowServer* server)
 	shadow_subsystem_uninit(server->subsystem);
 	shadow_subsystem_free(server->subsystem);
 	server->subsystem = NULL;
+	shadow_encode_cache_free(server->encodeCache);
+	server->encodeCache = NULL;
 	freerdp_listener_free(server->listener);
 	server->listener = NULL;
 	free(server->CertificateFile);
@@ -0,0 +1,292 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Solid color tile detection
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <winpr/assert.h>
+#include <winpr/cast.h>
+
+#include <freerdp/primitives.h>
+#include <freerdp/codec/color.h>
+
+#include "shadow_solid.h"
+
+/* the tile size of the compare primitive */
+#define SHADOW_SOLID_COMPARE_TILE 16
+#define SHADOW_SOLID_COMPARE_TILES (SHADOW_SOLID_TILE_SIZE / SHADOW_SOLID_COMPARE_TILE)
+
+struct rdp_shadow_solid
+{
+	UINT32 columns;
+	UINT32* line;   /* the color of each tile of a row, repeated over its width */
+	BYTE* compared; /* result of the compare primitive for a tile row */
+	BYTE* uniform;  /* per tile of a row */
+	size_t* open;   /* per tile of a row, 1 + index of the fill starting there and ending above */
+	size_t* next;
+
+	SHADOW_SOLID_FILL* fills;
+	size_t capacity;
+};
+
+static BOOL shadow_solid_resize(rdpShadowSolid* solid, UINT32 columns)
+{
+	if (columns <= solid->columns)
+		return TRUE;
+
+	UINT32* line = realloc(solid->line, 4ull * SHADOW_SOLID_TILE_SIZE * columns);
+	if (line)
+		solid->line = line;
+
+	BYTE* compared = realloc(solid->compared, 1ull * SHADOW_SOLID_COMPARE_TILES *
+	                                              SHADOW_SOLID_COMPARE_TILES * columns);
+	if (compared)
+		solid->compared = compared;
+
+	BYTE* uniform = realloc(solid->uniform, columns);
+	if (uniform)
+		solid->uniform = uniform;
+
+	size_t* open = realloc(solid->open, sizeof(size_t) * columns);
+	if (open)
+		solid->open = open;
+
+	size_t* next = realloc(solid->next, sizeof(size_t) * columns);
+	if (next)
+		solid->next = next;
+
+	if (!line || !compared || !uniform || !open || !next)
+		return FALSE;
+
+	solid->columns = columns;
+	return TRUE;
+}
+
+static SHADOW_SOLID_FILL* shadow_solid_append(rdpShadowSolid* solid, size_t* count)
+{
+	if (*count >= solid->capacity)
+	{
+		const size_t capacity = MAX(64, solid->capacity * 2);
+		SHADOW_SOLID_FILL* tmp = realloc(solid->fills, capacity * sizeof(SHADOW_SOLID_FILL));
+
+		if (!tmp)
+			return NULL;
+
+		solid->fills = tmp;
+		solid->capacity = capacity;
+	}
+
+	return &solid->fills[(*count)++];
+}
+
+static int shadow_solid_compare_fills(const void* pva, const void* pvb)
+{
+	const SHADOW_SOLID_FILL* a = pva;
+	const SHADOW_SOLID_FILL* b = pvb;
+
+	if (a->color != b->color)
+		return (a->color < b->color) ? -1 : 1;
+	if (a->rect.top != b->rect.top)
+		return (a->rect.top < b->rect.top) ? -1 : 1;
+	if (a->rect.left != b->rect.left)
+		return (a->rect.left < b->rect.left) ? -1 : 1;
+	return 0;
+}
+
+static BOOL shadow_solid_tile_touched(const REGION16* damage, const REGION16* skip,
+                                      const RECTANGLE_16* rect)
+{
+	if (!region16_intersects_rect(damage, rect))
+		return FALSE;
+
+	return !skip || !region16_intersects_rect(skip, rect);
+}
+
+BOOL shadow_solid_detect(rdpShadowSolid* solid, const BYTE* pSrcData, UINT32 SrcFormat,
+                         UINT32 nSrcStep, UINT32 nWidth, UINT32 nHeight, const REGION16* damage,
+                         const REGION16* skip, SHADOW_SOLID_FILL** fills, size_t* count)
+{
+	const primitives_t* prims = primitives_get();
+
+	WINPR_ASSERT(solid);
+	WINPR_ASSERT(damage);
+	WINPR_ASSERT(fills);
+	WINPR_ASSERT(count);
+	WINPR_ASSERT(prims);
+
+	*fills = solid->fills;
+	*count = 0;
+
+	if (region16_is_empty(damage) || (FreeRDPGetBytesPerPixel(SrcFormat) != 4))
+		return TRUE;
+
+	const RECTANGLE_16* extents = region16_extents(damage);
+	const UINT32 right = MIN(extents->right, nWidth);
+	const UINT32 bottom = MIN(extents->bottom, nHeight);
+
+	if ((extents->left >= right) || (extents->top >= bottom))
+		return TRUE;
+
+	const UINT32 first = extents->left / SHADOW_SOLID_TILE_SIZE;
+	const UINT32 columns = (right + SHADOW_SOLID_TILE_SIZE - 1) / SHADOW_SOLID_TILE_SIZE - first;
+
+	if (!shadow_solid_resize(solid, columns))
+		return FALSE;
+
+	for (UINT32 c = 0; c < columns; c++)
+		solid->open[c] = 0;
+
+	for (UINT32 y = extents->top & ~(SHADOW_SOLID_TILE_SIZE - 1u); y < bottom;
+	     y += SHADOW_SOLID_TILE_SIZE)
+	{
+		UINT32 start = columns;
+		UINT32 end = 0;
+		const UINT32 height = MIN(SHADOW_SOLID_TILE_SIZE, nHeight - y);
+		const UINT16 top = WINPR_ASSERTING_INT_CAST(UINT16, y);
+		const UINT16 tileBottom = WINPR_ASSERTING_INT_CAST(UINT16, y + height);
+
+		for (UINT32 c = 0; c < columns; c++)
+		{
+			const UINT32 x = (first + c) * SHADOW_SOLID_TILE_SIZE;
+			const RECTANGLE_16 rect = { WINPR_ASSERTING_INT_CAST(UINT16, x), top,
+				                        WINPR_ASSERTING_INT_CAST(
+				                            UINT16, MIN(x + SHADOW_SOLID_TILE_SIZE, nWidth)),
+				                        tileBottom };
+
+			solid->uniform[c] = shadow_solid_tile_touched(damage, skip, &rect) ? 1 : 0;
+			solid->next[c] = 0;
+
+			if (!solid->uniform[c])
+				continue;
+
+			start = MIN(start, c);
+			end = c + 1;
+
+			UINT32 color = 0;
+			memcpy(&color, &pSrcData[1ull * y * nSrcStep + 4ull * x], sizeof(color));
+			for (UINT32 i = 0; i < SHADOW_SOLID_TILE_SIZE; i++)
+				solid->line[1ull * c * SHADOW_SOLID_TILE_SIZE + i] = color;
+		}
+
+		if (start < end)
+		{
+			const UINT32 x = (first + start) * SHADOW_SOLID_TILE_SIZE;
+			const UINT32 width = MIN((first + end) * SHADOW_SOLID_TILE_SIZE, nWidth) - x;
+			const UINT32 step = (width + SHADOW_SOLID_COMPARE_TILE - 1) / SHADOW_SOLID_COMPARE_TILE;
+
+			/* the color line is repeated for every row of the frame */
+			const pstatus_t status = prims->compare_tiles(
+			    &pSrcData[1ull * y * nSrcStep + 4ull * x], SrcFormat, nSrcStep,
+			    (const BYTE*)&solid->line[1ull * start * SHADOW_SOLID_TILE_SIZE], SrcFormat, 0,
+			    width, height, solid->compared, step, NULL);
+			if (status != PRIMITIVES_SUCCESS)
+				return FALSE;
+
+			const UINT32 rows =
+			    (height + SHADOW_SOLID_COMPARE_TILE - 1) / SHADOW_SOLID_COMPARE_TILE;
+			for (UINT32 c = start; c < end; c++)
+			{
+				const UINT32 left = (c - start) * SHADOW_SOLID_COMPARE_TILES;
+				const UINT32 cols = MIN(SHADOW_SOLID_COMPARE_TILES, step - left);
+
+				for (UINT32 row = 0; solid->uniform[c] && (row < rows); row++)
+				{
+					for (UINT32 col = 0; col < cols; col++)
+					{
+						if (solid->compared[1ull * row * step + left + col])
+						{
+							solid->uniform[c] = 0;
+							break;
+						}
+					}
+				}
+			}
+		}
+
+		/* merge runs of tiles with the same color, then with the same run above */
+		for (UINT32 c = start; c < end;)
+		{
+			if (!solid->uniform[c])
+			{
+				c++;
+				continue;
+			}
+
+			const UINT32 color = solid->line[1ull * c * SHADOW_SOLID_TILE_SIZE];
+			UINT32 last = c + 1;
+
+			while ((last < end) && solid->uniform[last] &&
+			       (solid->line[1ull * last * SHADOW_SOLID_TILE_SIZE] == color))
+				last++;
+
+			const RECTANGLE_16 rect = {
+				WINPR_ASSERTING_INT_CAST(UINT16, (first + c) * SHADOW_SOLID_TILE_SIZE), top,
+				WINPR_ASSERTING_INT_CAST(UINT16,
+				                         MIN((first + last) * SHADOW_SOLID_TILE_SIZE, nWidth)),
+				tileBottom
+			};
+
+			SHADOW_SOLID_FILL* above = solid->open[c] ? &solid->fills[solid->open[c] - 1] : NULL;
+
+			if (above && (above->color == color) && (above->rect.right == rect.right) &&
+			    (above->rect.bottom == rect.top))
+			{
+				above->rect.bottom = rect.bottom;
+				solid->next[c] = solid->open[c];
+			}
+			else
+			{
+				SHADOW_SOLID_FILL* fill = shadow_solid_append(solid, count);
+				if (!fill)
+					return FALSE;
+
+				fill->rect = rect;
+				fill->color = color;
+				solid->next[c] = *count;
+			}
+
+			c = last;
+		}
+
+		size_t* tmp = solid->open;
+		solid->open = solid->next;
+		solid->next = tmp;
+	}
+
+	if (*count > 1)
+		qsort(solid->fills, *count, sizeof(SHADOW_SOLID_FILL), shadow_solid_compare_fills);
+	*fills = solid->fills;
+	return TRUE;
+}
+
+rdpShadowSolid* shadow_solid_new(void)
+{
+	return calloc(1, sizeof(rdpShadowSolid));
+}
+
+void shadow_solid_free(rdpShadowSolid* solid)
+{
+	if (!solid)
+		return;
+
+	free(solid->line);
+	free(solid->compared);
+	free(solid->uniform);
+	free(solid->open);
+	free(solid->next);
+	free(solid->fills);
+	free(solid);
+}
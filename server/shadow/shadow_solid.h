@@ -0,0 +1,74 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Solid color tile detection
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_SERVER_SHADOW_SOLID_H
+#define FREERDP_SERVER_SHADOW_SOLID_H
+
+#include <winpr/crt.h>
+
+#include <freerdp/codec/region.h>
+
+/*
+ * Finds the damaged 64x64 tiles of a frame filled with a single color, like
+ * a cleared background or the margins around a document. Neighbouring tiles
+ * of the same color are merged into rectangles the client fills itself, they
+ * need not be encoded.
+ *
+ * Every tile row is compared against a line holding the color of the top
+ * left pixel of each tile, with the SIMD tile compare primitive.
+ */
+
+#define SHADOW_SOLID_TILE_SIZE 64
+
+typedef struct
+{
+	RECTANGLE_16 rect;
+	UINT32 color; /* in the format of the frame */
+} SHADOW_SOLID_FILL;
+
+typedef struct rdp_shadow_solid rdpShadowSolid;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	void shadow_solid_free(rdpShadowSolid* solid);
+
+	WINPR_ATTR_MALLOC(shadow_solid_free, 1)
+	rdpShadowSolid* shadow_solid_new(void);
+
+	/**
+	 * Find the single color tiles touched by the damaged region of a frame.
+	 * Tiles are filled as a whole, the parts outside of the damage are unchanged and have
+	 * the same color.
+	 *
+	 * @param skip Optional, tiles touching this region are left out
+	 * @param fills Receives the rectangles to fill ordered by color, valid until the next call
+	 * @param count Receives the number of rectangles
+	 * @return TRUE on success
+	 */
+	BOOL shadow_solid_detect(rdpShadowSolid* solid, const BYTE* pSrcData, UINT32 SrcFormat,
+	                         UINT32 nSrcStep, UINT32 nWidth, UINT32 nHeight,
+	                         const REGION16* damage, const REGION16* skip,
+	                         SHADOW_SOLID_FILL** fills, size_t* count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_SERVER_SHADOW_SOLID_H */
@@ -288,5 +288,9 @@ int shadow_subsystem_pointer_convert_alpha_pointer_data_to_format(
 
 void shadow_subsystem_frame_update(rdpShadowSubsystem* subsystem)
 {
+	/* The surface may have changed since the last frame, drop the shared encodings */
+	if (subsystem->server)
+		shadow_encode_cache_next_frame(subsystem->server->encodeCache);
+
 	shadow_multiclient_publish_and_wait(subsystem->updateEvent);
 }
@@ -0,0 +1,268 @@
+#include <winpr/crt.h>
+
+#include <freerdp/codec/color.h>
+#include <freerdp/codec/region.h>
+
+#include "../shadow_classifier.h"
+
+#define TEST_WIDTH 256
+#define TEST_HEIGHT 128
+#define TEST_STEP (TEST_WIDTH * 4)
+#define TEST_FORMAT PIXEL_FORMAT_BGRX32
+
+static const RECTANGLE_16 textTile = { 0, 0, 64, 64 };
+static const RECTANGLE_16 imageTile = { 64, 0, 128, 64 };
+
+/* black glyph like strokes on white */
+static void fill_text(BYTE* data, const RECTANGLE_16* rect, UINT32 seed)
+{
+	for (UINT32 y = rect->top; y < rect->bottom; y++)
+	{
+		for (UINT32 x = rect->left; x < rect->right; x++)
+		{
+			const BOOL ink = (((x + seed) % 7) < 2) && ((y % 12) < 9);
+			const UINT32 color = ink ? FreeRDPGetColor(TEST_FORMAT, 0, 0, 0, 0xFF)
+			                         : FreeRDPGetColor(TEST_FORMAT, 0xFF, 0xFF, 0xFF, 0xFF);
+			FreeRDPWriteColor(&data[1ull * y * TEST_STEP + 4ull * x], TEST_FORMAT, color);
+		}
+	}
+}
+
+/* a smooth gradient with more colors than text ever has */
+static void fill_image(BYTE* data, const RECTANGLE_16* rect, UINT32 seed)
+{
+	for (UINT32 y = rect->top; y < rect->bottom; y++)
+	{
+		for (UINT32 x = rect->left; x < rect->right; x++)
+		{
+			const BYTE r = (BYTE)(x * 3 + seed);
+			const BYTE g = (BYTE)(y * 3 + seed);
+			const BYTE b = (BYTE)(x + y + 2 * seed);
+			const UINT32 color = FreeRDPGetColor(TEST_FORMAT, r, g, b, 0xFF);
+			FreeRDPWriteColor(&data[1ull * y * TEST_STEP + 4ull * x], TEST_FORMAT, color);
+		}
+	}
+}
+
+static BOOL classify(rdpShadowClassifier* classifier, const BYTE* data, const RECTANGLE_16* rects,
+                     size_t count, REGION16 regions[SHADOW_CONTENT_COUNT])
+{
+	BOOL rc = TRUE;
+	REGION16 damage;
+
+	region16_init(&damage);
+	for (size_t x = 0; x < SHADOW_CONTENT_COUNT; x++)
+		region16_clear(&regions[x]);
+
+	for (size_t x = 0; rc && (x < count); x++)
+		rc = region16_union_rect(&damage, &damage, &rects[x]);
+
+	if (rc)
+		rc = shadow_classifier_classify(classifier, data, TEST_FORMAT, TEST_STEP, TEST_WIDTH,
+		                                TEST_HEIGHT, &damage, regions);
+
+	region16_uninit(&damage);
+	return rc;
+}
+
+static BOOL region_is(const REGION16* region, const RECTANGLE_16* rect)
+{
+	if (!rect)
+		return region16_is_empty(region);
+
+	if (region16_n_rects(region) != 1)
+		return FALSE;
+
+	return rectangles_equal(region16_extents(region), rect);
+}
+
+static BOOL check_regions(REGION16 regions[SHADOW_CONTENT_COUNT], const RECTANGLE_16* text,
+                          const RECTANGLE_16* image, const RECTANGLE_16* video)
+{
+	if (!region_is(&regions[SHADOW_CONTENT_TEXT], text))
+	{
+		(void)fprintf(stderr, "unexpected text region\n");
+		return FALSE;
+	}
+
+	if (!region_is(&regions[SHADOW_CONTENT_IMAGE], image))
+	{
+		(void)fprintf(stderr, "unexpected image region\n");
+		return FALSE;
+	}
+
+	if (!region_is(&regions[SHADOW_CONTENT_VIDEO], video))
+	{
+		(void)fprintf(stderr, "unexpected video region\n");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL test_classify_content(rdpShadowClassifier* classifier, BYTE* data,
+                                  REGION16 regions[SHADOW_CONTENT_COUNT])
+{
+	const RECTANGLE_16 damage[] = { textTile, imageTile };
+	const RECTANGLE_16 part = { 8, 8, 40, 24 };
+
+	fill_text(data, &textTile, 0);
+	fill_image(data, &imageTile, 0);
+
+	if (!classify(classifier, data, damage, ARRAYSIZE(damage), regions))
+		return FALSE;
+
+	if (!check_regions(regions, &textTile, &imageTile, NULL))
+		return FALSE;
+
+	/* only the damaged part of a tile is reported */
+	if (!classify(classifier, data, &part, 1, regions))
+		return FALSE;
+
+	return check_regions(regions, &part, NULL, NULL);
+}
+
+static BOOL test_classify_video(rdpShadowClassifier* classifier, BYTE* data,
+                                REGION16 regions[SHADOW_CONTENT_COUNT])
+{
+	const RECTANGLE_16 damage[] = { textTile, imageTile };
+
+	shadow_classifier_reset(classifier);
+
+	/* an image changing in every frame turns into video, text changing as often stays text */
+	for (UINT32 frame = 1; frame < 20; frame++)
+	{
+		const BOOL video = frame >= 10;
+
+		fill_text(data, &textTile, frame);
+		fill_image(data, &imageTile, frame);
+
+		if (!classify(classifier, data, damage, ARRAYSIZE(damage), regions))
+			return FALSE;
+
+		if (!check_regions(regions, &textTile, video ? NULL : &imageTile,
+		                   video ? &imageTile : NULL))
+		{
+			(void)fprintf(stderr, "frame %" PRIu32 "\n", frame);
+			return FALSE;
+		}
+
+		if (shadow_classifier_has_video(classifier) != video)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL test_refresh_video(rdpShadowClassifier* classifier, BYTE* data,
+                               REGION16 regions[SHADOW_CONTENT_COUNT])
+{
+	BOOL rc = FALSE;
+	REGION16 refresh;
+
+	region16_init(&refresh);
+
+	/* video that pauses briefly is not refreshed */
+	if (!shadow_classifier_tick(classifier, &refresh) || !region16_is_empty(&refresh) ||
+	    !shadow_classifier_has_video(classifier))
+		goto fail;
+
+	fill_image(data, &imageTile, 100);
+	if (!classify(classifier, data, &imageTile, 1, regions) ||
+	    !check_regions(regions, NULL, NULL, &imageTile))
+		goto fail;
+
+	/* a static screen refreshes the video once it stopped */
+	for (UINT32 frame = 0; frame < 2; frame++)
+	{
+		if (!shadow_classifier_tick(classifier, &refresh) || !region16_is_empty(&refresh))
+			goto fail;
+	}
+
+	if (!shadow_classifier_tick(classifier, &refresh) || !region_is(&refresh, &imageTile) ||
+	    shadow_classifier_has_video(classifier))
+		goto fail;
+
+	region16_clear(&refresh);
+	if (!shadow_classifier_tick(classifier, &refresh) || !region16_is_empty(&refresh))
+		goto fail;
+
+	/* the refreshed tile is an image again */
+	fill_image(data, &imageTile, 101);
+	if (!classify(classifier, data, &imageTile, 1, regions) ||
+	    !check_regions(regions, NULL, &imageTile, NULL))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	region16_uninit(&refresh);
+	return rc;
+}
+
+static BOOL test_refresh_damaged(rdpShadowClassifier* classifier, BYTE* data,
+                                 REGION16 regions[SHADOW_CONTENT_COUNT])
+{
+	const RECTANGLE_16 damage[] = { textTile, imageTile };
+
+	shadow_classifier_reset(classifier);
+
+	for (UINT32 frame = 0; frame < 10; frame++)
+	{
+		fill_image(data, &imageTile, frame);
+		if (!classify(classifier, data, &imageTile, 1, regions))
+			return FALSE;
+	}
+
+	if (!check_regions(regions, NULL, NULL, &imageTile))
+		return FALSE;
+
+	/* damage elsewhere refreshes the stopped video as an image */
+	for (UINT32 frame = 0; frame < 3; frame++)
+	{
+		fill_text(data, &textTile, frame);
+		if (!classify(classifier, data, damage, 1, regions))
+			return FALSE;
+
+		if (!check_regions(regions, &textTile, (frame == 2) ? &imageTile : NULL, NULL))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+int TestShadowClassifier(int argc, char* argv[])
+{
+	int rc = -1;
+	REGION16 regions[SHADOW_CONTENT_COUNT] = { 0 };
+	BYTE* data = calloc(TEST_HEIGHT, TEST_STEP);
+	rdpShadowClassifier* classifier = shadow_classifier_new();
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	for (size_t x = 0; x < ARRAYSIZE(regions); x++)
+		region16_init(&regions[x]);
+
+	if (!data || !classifier)
+		goto fail;
+
+	if (!test_classify_content(classifier, data, regions))
+		goto fail;
+
+	if (!test_classify_video(classifier, data, regions))
+		goto fail;
+
+	if (!test_refresh_video(classifier, data, regions))
+		goto fail;
+
+	if (!test_refresh_damaged(classifier, data, regions))
+		goto fail;
+
+	rc = 0;
+fail:
+	for (size_t x = 0; x < ARRAYSIZE(regions); x++)
+		region16_uninit(&regions[x]);
+	shadow_classifier_free(classifier);
+	free(data);
+	return rc;
+}
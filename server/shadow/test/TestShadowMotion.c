@@ -0,0 +1,226 @@
+#include <winpr/crt.h>
+#include <winpr/cast.h>
+
+#include <freerdp/codec/color.h>
+#include <freerdp/codec/region.h>
+
+#include "../shadow_motion.h"
+
+#define TEST_WIDTH 256
+#define TEST_HEIGHT 256
+#define TEST_STEP (TEST_WIDTH * 4)
+#define TEST_FORMAT PIXEL_FORMAT_BGRX32
+
+static const RECTANGLE_16 screen = { 0, 0, TEST_WIDTH, TEST_HEIGHT };
+
+/* a color of its own for every pixel, so every row segment is found in one place only */
+static UINT32 texture(UINT32 x, UINT32 y, UINT32 seed)
+{
+	UINT32 value = (x * 73856093u) ^ (y * 19349663u) ^ (seed * 83492791u);
+
+	value ^= value >> 16;
+	value *= 0x85EBCA6Bu;
+	value ^= value >> 13;
+	return value | 1;
+}
+
+static void put_pixel(BYTE* data, UINT32 x, UINT32 y, UINT32 value)
+{
+	memcpy(&data[1ull * y * TEST_STEP + 4ull * x], &value, sizeof(value));
+}
+
+static void fill(BYTE* data, const RECTANGLE_16* rect, INT32 dx, INT32 dy, UINT32 seed)
+{
+	for (UINT32 y = rect->top; y < rect->bottom; y++)
+	{
+		for (UINT32 x = rect->left; x < rect->right; x++)
+			put_pixel(data, x, y, texture((UINT32)((INT32)x - dx), (UINT32)((INT32)y - dy), seed));
+	}
+}
+
+static BOOL update(rdpShadowMotion* motion, const BYTE* data, const RECTANGLE_16* rects,
+                   size_t count)
+{
+	BOOL rc = TRUE;
+	REGION16 damage;
+
+	region16_init(&damage);
+
+	for (size_t x = 0; rc && (x < count); x++)
+		rc = region16_union_rect(&damage, &damage, &rects[x]);
+
+	if (rc)
+		rc = shadow_motion_update(motion, data, TEST_FORMAT, TEST_STEP, TEST_WIDTH, TEST_HEIGHT,
+		                          &damage);
+
+	region16_uninit(&damage);
+	return rc;
+}
+
+static BOOL detect(rdpShadowMotion* motion, const BYTE* data, SHADOW_MOTION_MOVE* moves,
+                   size_t* count)
+{
+	REGION16 damage;
+
+	region16_init(&damage);
+
+	BOOL rc = region16_union_rect(&damage, &damage, &screen);
+
+	if (rc)
+		rc = shadow_motion_detect(motion, data, TEST_FORMAT, TEST_STEP, TEST_WIDTH, TEST_HEIGHT,
+		                          &damage, moves, SHADOW_MOTION_MAX_MOVES, count);
+
+	region16_uninit(&damage);
+	return rc;
+}
+
+static BOOL check_move(rdpShadowMotion* motion, const BYTE* data, const RECTANGLE_16* rect,
+                       INT32 dx, INT32 dy)
+{
+	size_t count = 0;
+	SHADOW_MOTION_MOVE moves[SHADOW_MOTION_MAX_MOVES] = { 0 };
+
+	if (!detect(motion, data, moves, &count))
+		return FALSE;
+
+	if (!rect)
+	{
+		if (count == 0)
+			return TRUE;
+
+		(void)fprintf(stderr, "unexpected move by %" PRId32 "x%" PRId32 "\n", moves[0].dx,
+		              moves[0].dy);
+		return FALSE;
+	}
+
+	if (count != 1)
+	{
+		(void)fprintf(stderr, "found %" PRIuz " moves instead of one\n", count);
+		return FALSE;
+	}
+
+	if (!rectangles_equal(&moves[0].rect, rect) || (moves[0].dx != dx) || (moves[0].dy != dy))
+	{
+		(void)fprintf(stderr,
+		              "found move to %" PRIu16 "x%" PRIu16 "-%" PRIu16 "x%" PRIu16 " by %" PRId32
+		              "x%" PRId32 "\n",
+		              moves[0].rect.left, moves[0].rect.top, moves[0].rect.right,
+		              moves[0].rect.bottom, moves[0].dx, moves[0].dy);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL test_scroll_vertical(rdpShadowMotion* motion, BYTE* data)
+{
+	const RECTANGLE_16 scrolled = { 0, 0, TEST_WIDTH, TEST_HEIGHT - 24 };
+	const RECTANGLE_16 exposed = { 0, TEST_HEIGHT - 24, TEST_WIDTH, TEST_HEIGHT };
+
+	shadow_motion_reset(motion);
+	fill(data, &screen, 0, 0, 1);
+
+	if (!update(motion, data, &screen, 1))
+		return FALSE;
+
+	/* a document scrolled down by 24 rows, its content moves up */
+	fill(data, &scrolled, 0, -24, 1);
+	fill(data, &exposed, 0, 0, 2);
+	return check_move(motion, data, &scrolled, 0, -24);
+}
+
+static BOOL test_scroll_horizontal(rdpShadowMotion* motion, BYTE* data)
+{
+	const RECTANGLE_16 scrolled = { 0, 0, TEST_WIDTH - 40, TEST_HEIGHT };
+	const RECTANGLE_16 exposed = { TEST_WIDTH - 40, 0, TEST_WIDTH, TEST_HEIGHT };
+
+	shadow_motion_reset(motion);
+	fill(data, &screen, 0, 0, 1);
+
+	if (!update(motion, data, &screen, 1))
+		return FALSE;
+
+	fill(data, &scrolled, -40, 0, 1);
+	fill(data, &exposed, 0, 0, 2);
+	return check_move(motion, data, &scrolled, -40, 0);
+}
+
+/* a window with a black bottom part moved over a textured desktop */
+static void draw_window(BYTE* data, const RECTANGLE_16* window)
+{
+	const RECTANGLE_16 content = { window->left, window->top, window->right,
+		                           WINPR_ASSERTING_INT_CAST(UINT16, window->bottom - 32) };
+
+	fill(data, &screen, 0, 0, 1);
+	fill(data, &content, window->left, window->top, 3);
+
+	for (UINT32 y = content.bottom; y < window->bottom; y++)
+	{
+		for (UINT32 x = window->left; x < window->right; x++)
+			put_pixel(data, x, y, 0);
+	}
+}
+
+static BOOL test_move_window(rdpShadowMotion* motion, BYTE* data)
+{
+	const RECTANGLE_16 from = { 32, 32, 128, 128 };
+	const RECTANGLE_16 to = { 96, 112, 192, 208 };
+
+	shadow_motion_reset(motion);
+	draw_window(data, &from);
+
+	if (!update(motion, data, &screen, 1))
+		return FALSE;
+
+	draw_window(data, &to);
+	return check_move(motion, data, &to, 64, 80);
+}
+
+static BOOL test_move_unknown_source(rdpShadowMotion* motion, BYTE* data)
+{
+	const RECTANGLE_16 from = { 32, 32, 128, 128 };
+	const RECTANGLE_16 to = { 96, 112, 192, 208 };
+	/* everything but the rows holding the black part of the window */
+	const RECTANGLE_16 sent[] = { { 0, 0, TEST_WIDTH, 96 }, { 0, 128, TEST_WIDTH, TEST_HEIGHT } };
+
+	shadow_motion_reset(motion);
+	draw_window(data, &from);
+
+	if (!update(motion, data, sent, ARRAYSIZE(sent)))
+		return FALSE;
+
+	/* the unsent rows are black in the frame as well, the move must not copy them anyway */
+	draw_window(data, &to);
+	return check_move(motion, data, NULL, 0, 0);
+}
+
+int TestShadowMotion(int argc, char* argv[])
+{
+	int rc = -1;
+	BYTE* data = calloc(TEST_HEIGHT, TEST_STEP);
+	rdpShadowMotion* motion = shadow_motion_new();
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!data || !motion)
+		goto fail;
+
+	if (!test_scroll_vertical(motion, data))
+		goto fail;
+
+	if (!test_scroll_horizontal(motion, data))
+		goto fail;
+
+	if (!test_move_window(motion, data))
+		goto fail;
+
+	if (!test_move_unknown_source(motion, data))
+		goto fail;
+
+	rc = 0;
+fail:
+	shadow_motion_free(motion);
+	free(data);
+	return rc;
+}
@@ -0,0 +1,292 @@
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+
+#include <freerdp/codec/color.h>
+#include <freerdp/codec/region.h>
+#include <freerdp/codec/clear.h>
+#include <freerdp/codec/progressive.h>
+
+#include "../shadow_classifier.h"
+
+#define TEST_WIDTH 128
+#define TEST_HEIGHT 64
+#define TEST_STEP (TEST_WIDTH * 4)
+#define TEST_FORMAT PIXEL_FORMAT_BGRX32
+
+static const RECTANGLE_16 surfaceRect = { 0, 0, TEST_WIDTH, TEST_HEIGHT };
+static const RECTANGLE_16 textTile = { 0, 0, 64, 64 };
+static const RECTANGLE_16 imageTile = { 64, 0, 128, 64 };
+
+typedef struct
+{
+	PROGRESSIVE_CONTEXT* progressiveEnc;
+	PROGRESSIVE_CONTEXT* progressiveDec;
+	CLEAR_CONTEXT* clearEnc;
+	CLEAR_CONTEXT* clearDec;
+	wStream* s;
+	UINT32 frameId;
+	BYTE* surface; /* what the client shows */
+} TEST_SESSION;
+
+/* black glyph like strokes on white */
+static void fill_text(BYTE* data, const RECTANGLE_16* rect)
+{
+	for (UINT32 y = rect->top; y < rect->bottom; y++)
+	{
+		for (UINT32 x = rect->left; x < rect->right; x++)
+		{
+			const BOOL ink = ((x % 7) < 2) && ((y % 12) < 9);
+			const UINT32 color = ink ? FreeRDPGetColor(TEST_FORMAT, 0, 0, 0, 0xFF)
+			                         : FreeRDPGetColor(TEST_FORMAT, 0xFF, 0xFF, 0xFF, 0xFF);
+			FreeRDPWriteColor(&data[1ull * y * TEST_STEP + 4ull * x], TEST_FORMAT, color);
+		}
+	}
+}
+
+/* a smooth gradient far from black and white */
+static void fill_image(BYTE* data, const RECTANGLE_16* rect)
+{
+	for (UINT32 y = rect->top; y < rect->bottom; y++)
+	{
+		for (UINT32 x = rect->left; x < rect->right; x++)
+		{
+			const BYTE r = (BYTE)(0x60 + x / 2);
+			const BYTE g = (BYTE)(0x60 + y / 2);
+			const BYTE b = (BYTE)(0x60 + (x + y) / 4);
+			const UINT32 color = FreeRDPGetColor(TEST_FORMAT, r, g, b, 0xFF);
+			FreeRDPWriteColor(&data[1ull * y * TEST_STEP + 4ull * x], TEST_FORMAT, color);
+		}
+	}
+}
+
+static BOOL send_progressive(TEST_SESSION* session, const BYTE* data, const REGION16* region)
+{
+	BYTE* dst = NULL;
+	UINT32 length = 0;
+	REGION16 invalid;
+
+	const int rc = progressive_compress_surface(session->progressiveEnc, 0, data,
+	                                            TEST_STEP * TEST_HEIGHT, TEST_FORMAT, TEST_WIDTH,
+	                                            TEST_HEIGHT, TEST_STEP, region, &dst, &length);
+	if (rc <= 0)
+		return rc == 0;
+
+	region16_init(&invalid);
+	const INT32 status = progressive_decompress(session->progressiveDec, dst, length,
+	                                            session->surface, TEST_FORMAT, TEST_STEP, 0, 0,
+	                                            &invalid, 0, session->frameId++);
+	region16_uninit(&invalid);
+	return status >= 0;
+}
+
+static BOOL send_clear(TEST_SESSION* session, const BYTE* data, const REGION16* region)
+{
+	UINT32 numRects = 0;
+	const RECTANGLE_16* rects = region16_rects(region, &numRects);
+
+	for (UINT32 index = 0; index < numRects; index++)
+	{
+		const RECTANGLE_16* rect = &rects[index];
+		const UINT32 width = rect->right - rect->left;
+		const UINT32 height = rect->bottom - rect->top;
+
+		Stream_SetPosition(session->s, 0);
+		if (clear_compress_to_stream(session->clearEnc, session->s,
+		                             &data[1ull * rect->top * TEST_STEP + 4ull * rect->left],
+		                             TEST_FORMAT, TEST_STEP, width, height) < 0)
+			return FALSE;
+
+		const size_t length = Stream_GetPosition(session->s);
+		if (clear_decompress(session->clearDec, Stream_Buffer(session->s), (UINT32)length, width,
+		                     height, session->surface, TEST_FORMAT, TEST_STEP, rect->left,
+		                     rect->top, TEST_WIDTH, TEST_HEIGHT, NULL) < 0)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL send_upgrades(TEST_SESSION* session)
+{
+	while (progressive_get_pending_upgrades(session->progressiveEnc, 0) > 0)
+	{
+		BYTE* dst = NULL;
+		UINT32 length = 0;
+		REGION16 invalid;
+
+		if (progressive_compress_upgrade(session->progressiveEnc, 0, 0, &dst, &length) <= 0)
+			return FALSE;
+
+		region16_init(&invalid);
+		const INT32 status = progressive_decompress(session->progressiveDec, dst, length,
+		                                            session->surface, TEST_FORMAT, TEST_STEP, 0,
+		                                            0, &invalid, 0, session->frameId++);
+		region16_uninit(&invalid);
+		if (status < 0)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* the codecs are lossy, stale content is far off */
+static BOOL shows(const TEST_SESSION* session, const BYTE* data, const RECTANGLE_16* rect)
+{
+	for (UINT32 y = rect->top; y < rect->bottom; y++)
+	{
+		for (UINT32 x = rect->left; x < rect->right; x++)
+		{
+			BYTE ar = 0;
+			BYTE ag = 0;
+			BYTE ab = 0;
+			BYTE br = 0;
+			BYTE bg = 0;
+			BYTE bb = 0;
+			const size_t offset = 1ull * y * TEST_STEP + 4ull * x;
+
+			FreeRDPSplitColor(FreeRDPReadColor(&data[offset], TEST_FORMAT), TEST_FORMAT, &ar,
+			                  &ag, &ab, NULL, NULL);
+			FreeRDPSplitColor(FreeRDPReadColor(&session->surface[offset], TEST_FORMAT),
+			                  TEST_FORMAT, &br, &bg, &bb, NULL, NULL);
+
+			if ((abs(ar - br) > 0x25) || (abs(ag - bg) > 0x25) || (abs(ab - bb) > 0x25))
+			{
+				(void)fprintf(stderr,
+				              "[%" PRIu32 ":%" PRIu32 "] shows %02" PRIx8 "%02" PRIx8 "%02" PRIx8
+				              " instead of %02" PRIx8 "%02" PRIx8 "%02" PRIx8 "\n",
+				              x, y, br, bg, bb, ar, ag, ab);
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+/*
+ * A tile sent at a coarse progressive quality turns into text. Sent with
+ * ClearCodec the upgrades still to come would repaint it with the image.
+ */
+static BOOL test_text_over_pending(TEST_SESSION* session, BYTE* data)
+{
+	BOOL rc = FALSE;
+	REGION16 damage;
+	REGION16 pending;
+	REGION16 text;
+	REGION16 image;
+
+	region16_init(&damage);
+	region16_init(&pending);
+	region16_init(&text);
+	region16_init(&image);
+
+	fill_image(data, &surfaceRect);
+	if (!region16_union_rect(&damage, &damage, &surfaceRect) ||
+	    !send_progressive(session, data, &damage))
+		goto fail;
+
+	if (!progressive_get_pending_region(session->progressiveEnc, 0, &pending) ||
+	    !region16_intersects_rect(&pending, &textTile))
+		goto fail;
+
+	fill_text(data, &textTile);
+	if (!region16_union_rect(&text, &text, &textTile) ||
+	    !shadow_classifier_route_pending(&text, &image, &pending))
+		goto fail;
+
+	if (!region16_is_empty(&text) || !region16_intersects_rect(&image, &textTile))
+	{
+		(void)fprintf(stderr, "text over a pending tile was not routed to progressive\n");
+		goto fail;
+	}
+
+	if (!send_clear(session, data, &text) || !send_progressive(session, data, &image) ||
+	    !send_upgrades(session))
+		goto fail;
+
+	rc = shows(session, data, &textTile) && shows(session, data, &imageTile);
+fail:
+	region16_uninit(&damage);
+	region16_uninit(&pending);
+	region16_uninit(&text);
+	region16_uninit(&image);
+	return rc;
+}
+
+/* text away from pending tiles stays with ClearCodec */
+static BOOL test_text_elsewhere(TEST_SESSION* session, BYTE* data)
+{
+	BOOL rc = FALSE;
+	REGION16 pending;
+	REGION16 text;
+	REGION16 image;
+
+	region16_init(&pending);
+	region16_init(&text);
+	region16_init(&image);
+
+	fill_text(data, &textTile);
+	if (!progressive_get_pending_region(session->progressiveEnc, 0, &pending) ||
+	    !region16_is_empty(&pending))
+		goto fail;
+
+	if (!region16_union_rect(&text, &text, &textTile) ||
+	    !shadow_classifier_route_pending(&text, &image, &pending))
+		goto fail;
+
+	if (!region16_is_empty(&image) || !region16_intersects_rect(&text, &textTile))
+		goto fail;
+
+	if (!send_clear(session, data, &text))
+		goto fail;
+
+	rc = shows(session, data, &textTile);
+fail:
+	region16_uninit(&pending);
+	region16_uninit(&text);
+	region16_uninit(&image);
+	return rc;
+}
+
+int TestShadowPending(int argc, char* argv[])
+{
+	int rc = -1;
+	TEST_SESSION session = { 0 };
+	BYTE* data = calloc(TEST_STEP, TEST_HEIGHT);
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	session.progressiveEnc = progressive_context_new(TRUE);
+	session.progressiveDec = progressive_context_new(FALSE);
+	session.clearEnc = clear_context_new(TRUE);
+	session.clearDec = clear_context_new(FALSE);
+	session.s = Stream_New(NULL, 1024);
+	session.surface = calloc(TEST_STEP, TEST_HEIGHT);
+
+	if (!data || !session.progressiveEnc || !session.progressiveDec || !session.clearEnc ||
+	    !session.clearDec || !session.s || !session.surface)
+		goto fail;
+
+	if (!progressive_context_set_passes(session.progressiveEnc, 3) ||
+	    (progressive_create_surface_context(session.progressiveDec, 0, TEST_WIDTH, TEST_HEIGHT) <=
+	     0))
+		goto fail;
+
+	if (!test_text_over_pending(&session, data))
+		goto fail;
+
+	if (!test_text_elsewhere(&session, data))
+		goto fail;
+
+	rc = 0;
+fail:
+	progressive_context_free(session.progressiveEnc);
+	progressive_context_free(session.progressiveDec);
+	clear_context_free(session.clearEnc);
+	clear_context_free(session.clearDec);
+	Stream_Free(session.s, TRUE);
+	free(session.surface);
+	free(data);
+	return rc;
+}
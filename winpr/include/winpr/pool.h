@@ -275,6 +275,63 @@ extern "C"
 	}
 #endif
 
+	/* Parallel For */
+
+	/** @brief opaque handle for a reusable parallel for loop
+	 *  @since version 3.11.0
+	 */
+	typedef struct S_WINPR_PARALLEL_FOR WINPR_PARALLEL_FOR;
+
+	/** @brief callback processing the items \b [first, last) of a parallel for loop
+	 *
+	 *  @param context the context passed to \b winpr_ParallelFor_Run
+	 *  @param first the index of the first item to process
+	 *  @param last the index one past the last item to process
+	 *
+	 *  @return \b TRUE for success, \b FALSE to report a failure of the loop
+	 *  @since version 3.11.0
+	 */
+	typedef BOOL (*WINPR_PARALLEL_FOR_CALLBACK)(PVOID context, size_t first, size_t last);
+
+	/** @brief free a parallel for loop allocated with \b winpr_ParallelFor_New
+	 *
+	 *  @param pf the loop to free, may be \b NULL
+	 *  @since version 3.11.0
+	 */
+	WINPR_API void winpr_ParallelFor_Free(WINPR_PARALLEL_FOR* pf);
+
+	/** @brief allocate a parallel for loop running on a thread pool
+	 *
+	 *  The loop owns a single work object that is reused by every call to
+	 *  \b winpr_ParallelFor_Run, so it should be allocated once per codec/context and not per
+	 * frame.
+	 *
+	 *  @param pcbe the callback environment selecting the pool, \b NULL for the default pool
+	 *
+	 *  @return A new loop or \b NULL in case of failure
+	 *  @since version 3.11.0
+	 */
+	WINPR_ATTR_MALLOC(winpr_ParallelFor_Free, 1)
+	WINPR_API WINPR_PARALLEL_FOR* winpr_ParallelFor_New(PTP_CALLBACK_ENVIRON pcbe);
+
+	/** @brief run \b fn for all items \b [0, count) in chunks of \b chunkSize items
+	 *
+	 *  Chunks are handed out in ascending order to the pool threads and the calling thread,
+	 *  the call returns once all chunks have been processed. A loop must not be run
+	 *  concurrently or from within its own callback.
+	 *
+	 *  @param pf the loop to use
+	 *  @param count the number of items
+	 *  @param chunkSize the maximum number of items per callback, \b 0 to choose automatically
+	 *  @param fn the callback to run
+	 *  @param context an argument passed on to \b fn
+	 *
+	 *  @return \b TRUE if all callbacks succeeded, \b FALSE otherwise
+	 *  @since version 3.11.0
+	 */
+	WINPR_API BOOL winpr_ParallelFor_Run(WINPR_PARALLEL_FOR* pf, size_t count, size_t chunkSize,
+	                                     WINPR_PARALLEL_FOR_CALLBACK fn, PVOID context);
+
 #ifdef __cplusplus
 }
 #endif
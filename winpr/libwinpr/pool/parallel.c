@@ -0,0 +1,158 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Thread Pool API (Parallel For)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/config.h>
+
+#include <winpr/crt.h>
+#include <winpr/assert.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
+#include <winpr/pool.h>
+
+#include "../log.h"
+#define TAG WINPR_TAG("pool")
+
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+/* automatic chunking hands out this many chunks per thread to balance uneven items */
+#define PARALLEL_FOR_CHUNKS_PER_THREAD 4
+
+struct S_WINPR_PARALLEL_FOR
+{
+	PTP_WORK Work;
+	DWORD Threads;
+	volatile LONG Running;
+	volatile LONG Next;
+	volatile LONG Failed;
+	LONG Chunks;
+	size_t Count;
+	size_t ChunkSize;
+	WINPR_PARALLEL_FOR_CALLBACK Callback;
+	PVOID Context;
+};
+
+static void parallel_for_process_chunks(WINPR_PARALLEL_FOR* pf)
+{
+	WINPR_ASSERT(pf);
+	WINPR_ASSERT(pf->Callback);
+
+	for (;;)
+	{
+		const LONG chunk = InterlockedIncrement(&pf->Next) - 1;
+		if (chunk >= pf->Chunks)
+			break;
+
+		const size_t first = (size_t)chunk * pf->ChunkSize;
+		const size_t last = MIN(pf->Count, first + pf->ChunkSize);
+
+		if (!pf->Callback(pf->Context, first, last))
+			(void)InterlockedExchange(&pf->Failed, 1);
+	}
+}
+
+static VOID CALLBACK parallel_for_work_callback(PTP_CALLBACK_INSTANCE instance, PVOID context,
+                                                PTP_WORK work)
+{
+	WINPR_UNUSED(instance);
+	WINPR_UNUSED(work);
+
+	parallel_for_process_chunks((WINPR_PARALLEL_FOR*)context);
+}
+
+void winpr_ParallelFor_Free(WINPR_PARALLEL_FOR* pf)
+{
+	if (!pf)
+		return;
+
+	WINPR_ASSERT(InterlockedCompareExchange(&pf->Running, 0, 0) == 0);
+
+	if (pf->Work)
+		CloseThreadpoolWork(pf->Work);
+	free(pf);
+}
+
+WINPR_PARALLEL_FOR* winpr_ParallelFor_New(PTP_CALLBACK_ENVIRON pcbe)
+{
+	SYSTEM_INFO info = { 0 };
+	WINPR_PARALLEL_FOR* pf = (WINPR_PARALLEL_FOR*)calloc(1, sizeof(WINPR_PARALLEL_FOR));
+
+	if (!pf)
+		return NULL;
+
+	GetNativeSystemInfo(&info);
+	pf->Threads = MAX(1, info.dwNumberOfProcessors);
+
+	pf->Work = CreateThreadpoolWork(parallel_for_work_callback, pf, pcbe);
+	if (!pf->Work)
+	{
+		winpr_ParallelFor_Free(pf);
+		return NULL;
+	}
+
+	return pf;
+}
+
+BOOL winpr_ParallelFor_Run(WINPR_PARALLEL_FOR* pf, size_t count, size_t chunkSize,
+                           WINPR_PARALLEL_FOR_CALLBACK fn, PVOID context)
+{
+	if (!pf || !fn)
+		return FALSE;
+
+	if (count == 0)
+		return TRUE;
+
+	if (chunkSize == 0)
+		chunkSize = MAX(1, count / (1ull * pf->Threads * PARALLEL_FOR_CHUNKS_PER_THREAD));
+
+	const size_t chunks = count / chunkSize + ((count % chunkSize) ? 1 : 0);
+
+	/* every participant increments the chunk counter once more than there are chunks */
+	if (chunks > (size_t)(INT32_MAX - pf->Threads - 1))
+	{
+		WLog_ERR(TAG, "too many chunks %" PRIuz " for a parallel for", chunks);
+		return FALSE;
+	}
+
+	if (InterlockedCompareExchange(&pf->Running, 1, 0) != 0)
+	{
+		WLog_ERR(TAG, "parallel for is already running");
+		return FALSE;
+	}
+
+	pf->Count = count;
+	pf->ChunkSize = chunkSize;
+	pf->Chunks = (LONG)chunks;
+	pf->Callback = fn;
+	pf->Context = context;
+	(void)InterlockedExchange(&pf->Next, 0);
+	(void)InterlockedExchange(&pf->Failed, 0);
+
+	/* the calling thread processes chunks as well, so one submission less is needed */
+	const size_t submit = MIN(chunks, pf->Threads) - 1;
+	for (size_t x = 0; x < submit; x++)
+		SubmitThreadpoolWork(pf->Work);
+
+	parallel_for_process_chunks(pf);
+
+	if (submit > 0)
+		WaitForThreadpoolWorkCallbacks(pf->Work, FALSE);
+
+	const BOOL rc = InterlockedCompareExchange(&pf->Failed, 0, 0) == 0;
+	(void)InterlockedExchange(&pf->Running, 0);
+	return rc;
+}
@@ -20,7 +20,9 @@
 #include <winpr/config.h>
 
 #include <winpr/crt.h>
+#include <winpr/assert.h>
 #include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
 #include <winpr/pool.h>
 #include <winpr/library.h>
 
@@ -51,46 +53,179 @@ static BOOL CALLBACK init_module(PINIT_ONCE once, PVOID param, PVOID* context)
 }
 #endif
 
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+#define TP_DEQUE_INITIAL_SIZE 64
+#define TP_MIN_WORKER_CAPACITY 64
+#define TP_SPIN_COUNT 64
+
 static TP_POOL DEFAULT_POOL = {
 	0,    /* DWORD Minimum */
 	500,  /* DWORD Maximum */
-	NULL, /* wArrayList* Threads */
-	NULL, /* wQueue* PendingQueue */
-	NULL, /* HANDLE TerminateEvent */
-	NULL, /* wCountdownEvent* WorkComplete */
+	NULL, /* TP_WORKER* Workers */
+	0,    /* DWORD WorkerCapacity */
+	0,    /* LONG WorkerCount */
+	0,    /* LONG NextWorker */
+	0,    /* LONG Sleepers */
+	{ 0 } /* CRITICAL_SECTION Lock */
 };
+static INIT_ONCE init_once_default_pool = INIT_ONCE_STATIC_INIT;
 
-static DWORD WINAPI thread_pool_work_func(LPVOID arg)
+static BOOL deque_push(TP_WORKER* worker, PTP_WORK work)
+{
+	BOOL rc = FALSE;
+
+	EnterCriticalSection(&worker->Lock);
+	if (worker->Closed)
+		goto out;
+
+	if ((size_t)worker->Count == worker->Capacity)
+	{
+		const size_t capacity = worker->Capacity ? worker->Capacity * 2 : TP_DEQUE_INITIAL_SIZE;
+		PTP_WORK* items = (PTP_WORK*)calloc(capacity, sizeof(PTP_WORK));
+		if (!items)
+			goto out;
+
+		for (size_t x = 0; x < (size_t)worker->Count; x++)
+			items[x] = worker->Items[(worker->Head + x) % worker->Capacity];
+
+		free((void*)worker->Items);
+		worker->Items = items;
+		worker->Capacity = capacity;
+		worker->Head = 0;
+	}
+
+	worker->Items[(worker->Head + (size_t)worker->Count) % worker->Capacity] = work;
+	worker->Count++;
+	rc = TRUE;
+out:
+	LeaveCriticalSection(&worker->Lock);
+	return rc;
+}
+
+/* the owner takes the most recent item, thieves the oldest one */
+static PTP_WORK deque_pop(TP_WORKER* worker, BOOL steal)
 {
-	DWORD status = 0;
-	PTP_POOL pool = NULL;
 	PTP_WORK work = NULL;
-	HANDLE events[2];
-	PTP_CALLBACK_INSTANCE callbackInstance = NULL;
 
-	pool = (PTP_POOL)arg;
+	/* unlocked peek, pushers wake parked workers so a stale value is harmless */
+	if (worker->Count == 0)
+		return NULL;
+
+	EnterCriticalSection(&worker->Lock);
+	if (worker->Count > 0)
+	{
+		worker->Count--;
+
+		if (steal)
+		{
+			work = worker->Items[worker->Head];
+			worker->Head = (worker->Head + 1) % worker->Capacity;
+		}
+		else
+			work = worker->Items[(worker->Head + (size_t)worker->Count) % worker->Capacity];
+	}
+	LeaveCriticalSection(&worker->Lock);
+	return work;
+}
 
-	events[0] = pool->TerminateEvent;
-	events[1] = Queue_Event(pool->PendingQueue);
+static PTP_WORK thread_pool_find_work(TP_WORKER* worker)
+{
+	PTP_POOL pool = worker->Pool;
+	PTP_WORK work = deque_pop(worker, FALSE);
+
+	if (work)
+		return work;
 
-	while (1)
+	const DWORD count = (DWORD)pool->WorkerCount;
+	for (DWORD x = 1; x < count; x++)
 	{
-		status = WaitForMultipleObjects(2, events, FALSE, INFINITE);
+		work = deque_pop(&pool->Workers[(worker->Index + x) % count], TRUE);
+		if (work)
+			return work;
+	}
 
-		if (status == WAIT_OBJECT_0)
-			break;
+	return NULL;
+}
 
-		if (status != (WAIT_OBJECT_0 + 1))
-			break;
+static void thread_pool_wake_one(PTP_POOL pool)
+{
+	if (InterlockedCompareExchange(&pool->Sleepers, 0, 0) <= 0)
+		return;
 
-		callbackInstance = (PTP_CALLBACK_INSTANCE)Queue_Dequeue(pool->PendingQueue);
+	const DWORD count = (DWORD)pool->WorkerCount;
+	const DWORD start = (DWORD)InterlockedIncrement(&pool->NextWorker);
+	for (DWORD x = 0; x < count; x++)
+	{
+		TP_WORKER* worker = &pool->Workers[(start + x) % count];
 
-		if (callbackInstance)
+		if (InterlockedCompareExchange(&worker->Parked, 0, 1) == 1)
 		{
-			work = callbackInstance->Work;
-			work->WorkCallback(callbackInstance, work->CallbackParameter, work);
-			CountdownEvent_Signal(pool->WorkComplete, 1);
-			free(callbackInstance);
+			InterlockedDecrement(&pool->Sleepers);
+			(void)SetEvent(worker->Event);
+			return;
+		}
+	}
+}
+
+static void thread_pool_run(PTP_WORK work)
+{
+	TP_CALLBACK_INSTANCE instance = { 0 };
+
+	instance.Work = work;
+	work->WorkCallback(&instance, work->CallbackParameter, work);
+	threadpool_work_complete(work);
+}
+
+static DWORD WINAPI thread_pool_work_func(LPVOID arg)
+{
+	TP_WORKER* worker = (TP_WORKER*)arg;
+	PTP_POOL pool = worker->Pool;
+	SYSTEM_INFO info = { 0 };
+
+	GetSystemInfo(&info);
+
+	/* spinning only makes sense if the submitting thread can run at the same time */
+	const DWORD spin = (info.dwNumberOfProcessors > 1) ? TP_SPIN_COUNT : 0;
+
+	while (!worker->Stop)
+	{
+		PTP_WORK work = thread_pool_find_work(worker);
+
+		for (DWORD x = 0; !work && (x < spin) && !worker->Stop; x++)
+		{
+			(void)SwitchToThread();
+			work = thread_pool_find_work(worker);
+		}
+
+		if (!work)
+		{
+			/* announce that we park, then check again so no submission is missed.
+			 * winpr events are manual reset, clear a stale wakeup before announcing */
+			(void)ResetEvent(worker->Event);
+			InterlockedExchange(&worker->Parked, 1);
+			InterlockedIncrement(&pool->Sleepers);
+			work = thread_pool_find_work(worker);
+
+			if (!work && !worker->Stop)
+			{
+				(void)WaitForSingleObject(worker->Event, INFINITE);
+
+				/* woken by a stop request rather than by a submitter */
+				if (InterlockedCompareExchange(&worker->Parked, 0, 1) == 1)
+					InterlockedDecrement(&pool->Sleepers);
+			}
+			else if (InterlockedCompareExchange(&worker->Parked, 0, 1) == 1)
+				InterlockedDecrement(&pool->Sleepers);
+		}
+
+		if (work)
+		{
+			/* more work is queued, get help before running this item */
+			if (worker->Count > 0)
+				thread_pool_wake_one(pool);
+			thread_pool_run(work);
 		}
 	}
 
@@ -98,59 +233,189 @@ static DWORD WINAPI thread_pool_work_func(LPVOID arg)
 	return 0;
 }
 
-static void threads_close(void* thread)
+BOOL threadpool_submit_work(PTP_POOL pool, PTP_WORK work)
 {
-	(void)WaitForSingleObject(thread, INFINITE);
-	(void)CloseHandle(thread);
+	WINPR_ASSERT(pool);
+	WINPR_ASSERT(work);
+
+	for (;;)
+	{
+		const DWORD count = (DWORD)pool->WorkerCount;
+		if (count == 0)
+			return FALSE;
+
+		const DWORD index = (DWORD)InterlockedIncrement(&pool->NextWorker) % count;
+		if (deque_push(&pool->Workers[index], work))
+			break;
+
+		/* the worker is being stopped, retry with the reduced worker count */
+		if ((DWORD)pool->WorkerCount >= count)
+			return FALSE;
+	}
+
+	thread_pool_wake_one(pool);
+	return TRUE;
 }
 
-static BOOL InitializeThreadpool(PTP_POOL pool)
+void threadpool_cancel_work(PTP_POOL pool, PTP_WORK work)
 {
-	BOOL rc = FALSE;
-	wObject* obj = NULL;
+	WINPR_ASSERT(pool);
+	WINPR_ASSERT(work);
 
-	if (pool->Threads)
-		return TRUE;
+	for (DWORD x = 0; x < pool->WorkerCapacity; x++)
+	{
+		TP_WORKER* worker = &pool->Workers[x];
+		size_t canceled = 0;
 
-	if (!(pool->PendingQueue = Queue_New(TRUE, -1, -1)))
-		goto fail;
+		if (worker->Count == 0)
+			continue;
 
-	if (!(pool->WorkComplete = CountdownEvent_New(0)))
-		goto fail;
+		EnterCriticalSection(&worker->Lock);
+		size_t kept = 0;
+		for (size_t y = 0; y < (size_t)worker->Count; y++)
+		{
+			PTP_WORK cur = worker->Items[(worker->Head + y) % worker->Capacity];
+			if (cur == work)
+				canceled++;
+			else
+				worker->Items[(worker->Head + kept++) % worker->Capacity] = cur;
+		}
+		worker->Count = (LONG)kept;
+		LeaveCriticalSection(&worker->Lock);
 
-	if (!(pool->TerminateEvent = CreateEvent(NULL, TRUE, FALSE, NULL)))
-		goto fail;
+		while (canceled-- > 0)
+			threadpool_work_complete(work);
+	}
+}
+
+static BOOL thread_pool_start_worker(PTP_POOL pool, TP_WORKER* worker)
+{
+	worker->Stop = FALSE;
+	worker->Parked = 0;
+
+	if (!worker->Event && !(worker->Event = CreateEvent(NULL, TRUE, FALSE, NULL)))
+		return FALSE;
+	(void)ResetEvent(worker->Event);
+
+	EnterCriticalSection(&worker->Lock);
+	worker->Closed = FALSE;
+	LeaveCriticalSection(&worker->Lock);
+
+	worker->Thread = CreateThread(NULL, 0, thread_pool_work_func, (void*)worker, 0, NULL);
+	return worker->Thread != NULL;
+}
+
+static void thread_pool_stop_worker(PTP_POOL pool, TP_WORKER* worker, TP_WORKER* heir)
+{
+	if (!worker->Thread)
+		return;
+
+	EnterCriticalSection(&worker->Lock);
+	worker->Closed = TRUE;
+	LeaveCriticalSection(&worker->Lock);
 
-	if (!(pool->Threads = ArrayList_New(TRUE)))
-		goto fail;
+	/* hand what is still queued to a running worker, or drop it if the pool goes away */
+	PTP_WORK work = NULL;
+	while ((work = deque_pop(worker, TRUE)))
+	{
+		if (!heir || !deque_push(heir, work))
+			threadpool_work_complete(work);
+	}
 
-	obj = ArrayList_Object(pool->Threads);
-	obj->fnObjectFree = threads_close;
+	if (heir)
+		thread_pool_wake_one(pool);
+
+	InterlockedExchange(&worker->Stop, 1);
+	if (InterlockedCompareExchange(&worker->Parked, 0, 1) == 1)
+		InterlockedDecrement(&pool->Sleepers);
+	(void)SetEvent(worker->Event);
+
+	(void)WaitForSingleObject(worker->Thread, INFINITE);
+	(void)CloseHandle(worker->Thread);
+	worker->Thread = NULL;
+}
+
+static void thread_pool_resize(PTP_POOL pool, DWORD count)
+{
+	EnterCriticalSection(&pool->Lock);
+
+	count = MIN(count, pool->WorkerCapacity);
+	DWORD current = (DWORD)pool->WorkerCount;
+
+	while (current < count)
+	{
+		if (!thread_pool_start_worker(pool, &pool->Workers[current]))
+			break;
+		current++;
+		InterlockedExchange(&pool->WorkerCount, (LONG)current);
+	}
+
+	if (current > count)
+	{
+		InterlockedExchange(&pool->WorkerCount, (LONG)count);
+
+		for (DWORD x = count; x < current; x++)
+			thread_pool_stop_worker(pool, &pool->Workers[x], (count > 0) ? &pool->Workers[0] : NULL);
+	}
+
+	LeaveCriticalSection(&pool->Lock);
+}
+
+static BOOL InitializeThreadpool(PTP_POOL pool)
+{
+	if (pool->Workers)
+		return TRUE;
 
 	SYSTEM_INFO info = { 0 };
 	GetSystemInfo(&info);
 	if (info.dwNumberOfProcessors < 1)
 		info.dwNumberOfProcessors = 1;
+
+	if (!InitializeCriticalSectionAndSpinCount(&pool->Lock, 4000))
+		return FALSE;
+
+	pool->WorkerCapacity = MAX(TP_MIN_WORKER_CAPACITY, info.dwNumberOfProcessors);
+	pool->Workers = (TP_WORKER*)calloc(pool->WorkerCapacity, sizeof(TP_WORKER));
+	if (!pool->Workers)
+	{
+		DeleteCriticalSection(&pool->Lock);
+		return FALSE;
+	}
+
+	for (DWORD x = 0; x < pool->WorkerCapacity; x++)
+	{
+		TP_WORKER* worker = &pool->Workers[x];
+		worker->Pool = pool;
+		worker->Index = x;
+		worker->Closed = TRUE;
+		if (!InitializeCriticalSectionAndSpinCount(&worker->Lock, 4000))
+		{
+			pool->WorkerCapacity = x;
+			return FALSE;
+		}
+	}
+
 	if (!SetThreadpoolThreadMinimum(pool, info.dwNumberOfProcessors))
-		goto fail;
+		return FALSE;
 	SetThreadpoolThreadMaximum(pool, info.dwNumberOfProcessors);
 
-	rc = TRUE;
+	return TRUE;
+}
 
-fail:
-	return rc;
+static BOOL CALLBACK init_default_pool(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	WINPR_UNUSED(once);
+	WINPR_UNUSED(param);
+	WINPR_UNUSED(context);
+	return InitializeThreadpool(&DEFAULT_POOL);
 }
 
 PTP_POOL GetDefaultThreadpool(void)
 {
-	PTP_POOL pool = NULL;
-
-	pool = &DEFAULT_POOL;
-
-	if (!InitializeThreadpool(pool))
+	if (!InitOnceExecuteOnce(&init_once_default_pool, init_default_pool, NULL, NULL))
 		return NULL;
 
-	return pool;
+	return &DEFAULT_POOL;
 }
 
 PTP_POOL winpr_CreateThreadpool(PVOID reserved)
@@ -185,12 +450,22 @@ VOID winpr_CloseThreadpool(PTP_POOL ptpp)
 		return;
 	}
 #endif
-	(void)SetEvent(ptpp->TerminateEvent);
+	if (ptpp->Workers)
+	{
+		thread_pool_resize(ptpp, 0);
 
-	ArrayList_Free(ptpp->Threads);
-	Queue_Free(ptpp->PendingQueue);
-	CountdownEvent_Free(ptpp->WorkComplete);
-	(void)CloseHandle(ptpp->TerminateEvent);
+		for (DWORD x = 0; x < ptpp->WorkerCapacity; x++)
+		{
+			TP_WORKER* worker = &ptpp->Workers[x];
+			DeleteCriticalSection(&worker->Lock);
+			free((void*)worker->Items);
+			if (worker->Event)
+				(void)CloseHandle(worker->Event);
+		}
+
+		free(ptpp->Workers);
+		DeleteCriticalSection(&ptpp->Lock);
+	}
 
 	{
 		TP_POOL empty = { 0 };
@@ -203,33 +478,19 @@ VOID winpr_CloseThreadpool(PTP_POOL ptpp)
 
 BOOL winpr_SetThreadpoolThreadMinimum(PTP_POOL ptpp, DWORD cthrdMic)
 {
-	BOOL rc = FALSE;
 #ifdef _WIN32
 	InitOnceExecuteOnce(&init_once_module, init_module, NULL, NULL);
 	if (pSetThreadpoolThreadMinimum)
 		return pSetThreadpoolThreadMinimum(ptpp, cthrdMic);
 #endif
 	ptpp->Minimum = cthrdMic;
+	if (ptpp->Maximum < ptpp->Minimum)
+		ptpp->Maximum = ptpp->Minimum;
 
-	ArrayList_Lock(ptpp->Threads);
-	while (ArrayList_Count(ptpp->Threads) < ptpp->Minimum)
-	{
-		HANDLE thread = CreateThread(NULL, 0, thread_pool_work_func, (void*)ptpp, 0, NULL);
-		if (!thread)
-			goto fail;
+	if ((DWORD)ptpp->WorkerCount < ptpp->Minimum)
+		thread_pool_resize(ptpp, ptpp->Minimum);
 
-		if (!ArrayList_Append(ptpp->Threads, thread))
-		{
-			(void)CloseHandle(thread);
-			goto fail;
-		}
-	}
-
-	rc = TRUE;
-fail:
-	ArrayList_Unlock(ptpp->Threads);
-
-	return rc;
+	return (DWORD)ptpp->WorkerCount >= MIN(ptpp->Minimum, ptpp->WorkerCapacity);
 }
 
 VOID winpr_SetThreadpoolThreadMaximum(PTP_POOL ptpp, DWORD cthrdMost)
@@ -243,16 +504,11 @@ VOID winpr_SetThreadpoolThreadMaximum(PTP_POOL ptpp, DWORD cthrdMost)
 	}
 #endif
 	ptpp->Maximum = cthrdMost;
+	if (ptpp->Minimum > ptpp->Maximum)
+		ptpp->Minimum = ptpp->Maximum;
 
-	ArrayList_Lock(ptpp->Threads);
-	if (ArrayList_Count(ptpp->Threads) > ptpp->Maximum)
-	{
-		(void)SetEvent(ptpp->TerminateEvent);
-		ArrayList_Clear(ptpp->Threads);
-		(void)ResetEvent(ptpp->TerminateEvent);
-	}
-	ArrayList_Unlock(ptpp->Threads);
-	winpr_SetThreadpoolThreadMinimum(ptpp, ptpp->Minimum);
+	if ((DWORD)ptpp->WorkerCount > ptpp->Maximum)
+		thread_pool_resize(ptpp, ptpp->Maximum);
 }
 
 #endif /* WINPR_THREAD_POOL defined */
@@ -33,14 +33,33 @@ struct S_TP_CALLBACK_INSTANCE
 	PTP_WORK Work;
 };
 
+/* A worker thread with its own deque of pending work, idle workers steal from the others */
+typedef struct
+{
+	CRITICAL_SECTION Lock;
+	PTP_WORK* Items;
+	size_t Capacity;
+	size_t Head;
+	volatile LONG Count;
+	BOOL Closed;
+	HANDLE Thread;
+	HANDLE Event;
+	volatile LONG Parked;
+	volatile LONG Stop;
+	PTP_POOL Pool;
+	DWORD Index;
+} TP_WORKER;
+
 struct S_TP_POOL
 {
 	DWORD Minimum;
 	DWORD Maximum;
-	wArrayList* Threads;
-	wQueue* PendingQueue;
-	HANDLE TerminateEvent;
-	wCountdownEvent* WorkComplete;
+	TP_WORKER* Workers;
+	DWORD WorkerCapacity;
+	volatile LONG WorkerCount;
+	volatile LONG NextWorker;
+	volatile LONG Sleepers;
+	CRITICAL_SECTION Lock;
 };
 
 struct S_TP_WORK
@@ -48,6 +67,10 @@ struct S_TP_WORK
 	PVOID CallbackParameter;
 	PTP_WORK_CALLBACK WorkCallback;
 	PTP_CALLBACK_ENVIRON CallbackEnvironment;
+	volatile LONG RefCount;
+	volatile LONG Pending;
+	volatile LONG Waiters;
+	HANDLE Done;
 };
 
 struct S_TP_TIMER
@@ -77,14 +100,33 @@ struct S_TP_CALLBACK_INSTANCE
 	PTP_WORK Work;
 };
 
+/* A worker thread with its own deque of pending work, idle workers steal from the others */
+typedef struct
+{
+	CRITICAL_SECTION Lock;
+	PTP_WORK* Items;
+	size_t Capacity;
+	size_t Head;
+	volatile LONG Count;
+	BOOL Closed;
+	HANDLE Thread;
+	HANDLE Event;
+	volatile LONG Parked;
+	volatile LONG Stop;
+	PTP_POOL Pool;
+	DWORD Index;
+} TP_WORKER;
+
 struct S_TP_POOL
 {
 	DWORD Minimum;
 	DWORD Maximum;
-	wArrayList* Threads;
-	wQueue* PendingQueue;
-	HANDLE TerminateEvent;
-	wCountdownEvent* WorkComplete;
+	TP_WORKER* Workers;
+	DWORD WorkerCapacity;
+	volatile LONG WorkerCount;
+	volatile LONG NextWorker;
+	volatile LONG Sleepers;
+	CRITICAL_SECTION Lock;
 };
 
 struct S_TP_WORK
@@ -92,6 +134,10 @@ struct S_TP_WORK
 	PVOID CallbackParameter;
 	PTP_WORK_CALLBACK WorkCallback;
 	PTP_CALLBACK_ENVIRON CallbackEnvironment;
+	volatile LONG RefCount;
+	volatile LONG Pending;
+	volatile LONG Waiters;
+	HANDLE Done;
 };
 
 struct S_TP_TIMER
@@ -119,4 +165,8 @@ struct S_TP_CLEANUP_GROUP
 
 PTP_POOL GetDefaultThreadpool(void);
 
+BOOL threadpool_submit_work(PTP_POOL pool, PTP_WORK work);
+void threadpool_cancel_work(PTP_POOL pool, PTP_WORK work);
+void threadpool_work_complete(PTP_WORK work);
+
 #endif /* WINPR_POOL_PRIVATE_H */
@@ -0,0 +1,160 @@
+
+#include <winpr/crt.h>
+#include <winpr/pool.h>
+#include <winpr/interlocked.h>
+
+typedef struct
+{
+	LONG* visits;
+	size_t count;
+	size_t chunkSize;
+	size_t failAt;
+	volatile LONG badRanges;
+} test_parallel_for_t;
+
+static BOOL test_ParallelForCallback(PVOID context, size_t first, size_t last)
+{
+	test_parallel_for_t* test = context;
+	BOOL rc = TRUE;
+
+	if ((first >= last) || (last > test->count) ||
+	    ((test->chunkSize > 0) && (last - first > test->chunkSize)))
+		InterlockedIncrement(&test->badRanges);
+
+	for (size_t x = first; (x < last) && (x < test->count); x++)
+	{
+		InterlockedIncrement(&test->visits[x]);
+		if (x == test->failAt)
+			rc = FALSE;
+	}
+
+	return rc;
+}
+
+static BOOL test_run(WINPR_PARALLEL_FOR* pf, size_t count, size_t chunkSize, size_t failAt)
+{
+	BOOL rc = FALSE;
+	test_parallel_for_t test = { 0 };
+
+	test.visits = calloc(count + 1, sizeof(LONG));
+	test.count = count;
+	test.chunkSize = chunkSize;
+	test.failAt = failAt;
+
+	if (!test.visits)
+		return FALSE;
+
+	const BOOL status = winpr_ParallelFor_Run(pf, count, chunkSize, test_ParallelForCallback, &test);
+	if (status != (failAt >= count))
+	{
+		printf("winpr_ParallelFor_Run [%" PRIuz "/%" PRIuz "] returned %d\n", count, chunkSize,
+		       status);
+		goto fail;
+	}
+
+	if (test.badRanges != 0)
+	{
+		printf("winpr_ParallelFor_Run [%" PRIuz "/%" PRIuz "] passed %" PRId32 " invalid ranges\n",
+		       count, chunkSize, test.badRanges);
+		goto fail;
+	}
+
+	for (size_t x = 0; x < count; x++)
+	{
+		if (test.visits[x] != 1)
+		{
+			printf("winpr_ParallelFor_Run [%" PRIuz "/%" PRIuz "] item %" PRIuz
+			       " processed %" PRId32 " times\n",
+			       count, chunkSize, x, test.visits[x]);
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	free(test.visits);
+	return rc;
+}
+
+static BOOL test_loop(PTP_CALLBACK_ENVIRON pcbe)
+{
+	BOOL rc = FALSE;
+	const size_t counts[] = { 0, 1, 7, 64, 510, 4096 };
+	const size_t chunks[] = { 0, 1, 3, 16, 10000 };
+	WINPR_PARALLEL_FOR* pf = winpr_ParallelFor_New(pcbe);
+
+	if (!pf)
+	{
+		printf("winpr_ParallelFor_New failure\n");
+		return FALSE;
+	}
+
+	if (winpr_ParallelFor_Run(pf, 1, 0, NULL, NULL))
+		goto fail;
+
+	/* the loop object is reused for every run, like a codec would reuse it per frame */
+	for (size_t iteration = 0; iteration < 20; iteration++)
+	{
+		for (size_t x = 0; x < ARRAYSIZE(counts); x++)
+		{
+			for (size_t y = 0; y < ARRAYSIZE(chunks); y++)
+			{
+				if (!test_run(pf, counts[x], chunks[y], SIZE_MAX))
+					goto fail;
+			}
+		}
+	}
+
+	if (!test_run(pf, 510, 4, 257))
+		goto fail;
+	if (!test_run(pf, 510, 0, SIZE_MAX))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	winpr_ParallelFor_Free(pf);
+	return rc;
+}
+
+static BOOL test_private_pool(void)
+{
+	BOOL rc = FALSE;
+	TP_CALLBACK_ENVIRON environment;
+	PTP_POOL pool = CreateThreadpool(NULL);
+
+	if (!pool)
+	{
+		printf("CreateThreadpool failure\n");
+		return FALSE;
+	}
+
+	if (!SetThreadpoolThreadMinimum(pool, 4))
+	{
+		printf("SetThreadpoolThreadMinimum failure\n");
+		goto fail;
+	}
+
+	InitializeThreadpoolEnvironment(&environment);
+	SetThreadpoolCallbackPool(&environment, pool);
+
+	rc = test_loop(&environment);
+
+	DestroyThreadpoolEnvironment(&environment);
+fail:
+	CloseThreadpool(pool);
+	return rc;
+}
+
+int TestPoolParallelFor(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!test_loop(NULL))
+		return -1;
+
+	if (!test_private_pool())
+		return -1;
+
+	return 0;
+}
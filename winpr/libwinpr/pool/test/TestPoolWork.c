@@ -120,6 +120,76 @@ fail:
 	return rc;
 }
 
+static void CALLBACK test_CountCallback(PTP_CALLBACK_INSTANCE instance, void* context,
+                                        PTP_WORK work)
+{
+	WINPR_UNUSED(instance);
+	WINPR_UNUSED(work);
+	InterlockedIncrement((LONG*)context);
+}
+
+static BOOL test3(void)
+{
+	BOOL rc = FALSE;
+	PTP_POOL pool = NULL;
+	PTP_WORK work[64] = { 0 };
+	LONG counts[ARRAYSIZE(work)] = { 0 };
+	TP_CALLBACK_ENVIRON environment;
+	const LONG submits = 200;
+	printf("Per work object wait\n");
+
+	if (!(pool = CreateThreadpool(NULL)))
+		return FALSE;
+
+	if (!SetThreadpoolThreadMinimum(pool, 8))
+		goto fail;
+
+	InitializeThreadpoolEnvironment(&environment);
+	SetThreadpoolCallbackPool(&environment, pool);
+
+	for (size_t x = 0; x < ARRAYSIZE(work); x++)
+	{
+		work[x] = CreateThreadpoolWork(test_CountCallback, &counts[x], &environment);
+		if (!work[x])
+			goto fail;
+	}
+
+	for (LONG y = 0; y < submits; y++)
+	{
+		for (size_t x = 0; x < ARRAYSIZE(work); x++)
+			SubmitThreadpoolWork(work[x]);
+
+		/* shrink and grow the pool while work is queued */
+		if (y == submits / 2)
+			SetThreadpoolThreadMaximum(pool, 2);
+		if (y == 3 * submits / 4)
+			SetThreadpoolThreadMinimum(pool, 6);
+	}
+
+	for (size_t x = 0; x < ARRAYSIZE(work); x++)
+	{
+		WaitForThreadpoolWorkCallbacks(work[x], FALSE);
+
+		if (counts[x] != submits)
+		{
+			printf("work %" PRIuz " ran %" PRId32 " times, expected %" PRId32 "\n", x, counts[x],
+			       submits);
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	for (size_t x = 0; x < ARRAYSIZE(work); x++)
+	{
+		if (work[x])
+			CloseThreadpoolWork(work[x]);
+	}
+
+	CloseThreadpool(pool);
+	return rc;
+}
+
 int TestPoolWork(int argc, char* argv[])
 {
 
@@ -132,5 +202,8 @@ int TestPoolWork(int argc, char* argv[])
 	if (!test2())
 		return -1;
 
+	if (!test3())
+		return -1;
+
 	return 0;
 }
@@ -23,6 +23,7 @@
 #include <winpr/crt.h>
 #include <winpr/pool.h>
 #include <winpr/library.h>
+#include <winpr/interlocked.h>
 
 #include "pool.h"
 #include "../log.h"
@@ -92,6 +93,14 @@ PTP_WORK winpr_CreateThreadpoolWork(PTP_WORK_CALLBACK pfnwk, PVOID pv, PTP_CALLB
 		work->CallbackEnvironment = pcbe;
 		work->WorkCallback = pfnwk;
 		work->CallbackParameter = pv;
+		work->RefCount = 1;
+		work->Done = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+		if (!work->Done)
+		{
+			free(work);
+			return NULL;
+		}
 #ifndef _WIN32
 
 		if (pcbe->CleanupGroup)
@@ -103,6 +112,26 @@ PTP_WORK winpr_CreateThreadpoolWork(PTP_WORK_CALLBACK pfnwk, PVOID pv, PTP_CALLB
 	return work;
 }
 
+static void threadpool_work_release(PTP_WORK work)
+{
+	if (InterlockedDecrement(&work->RefCount) != 0)
+		return;
+
+	(void)CloseHandle(work->Done);
+	free(work);
+}
+
+void threadpool_work_complete(PTP_WORK work)
+{
+	WINPR_ASSERT(work);
+
+	if ((InterlockedDecrement(&work->Pending) == 0) &&
+	    (InterlockedCompareExchange(&work->Waiters, 0, 0) > 0))
+		(void)SetEvent(work->Done);
+
+	threadpool_work_release(work);
+}
+
 VOID winpr_CloseThreadpoolWork(PTP_WORK pwk)
 {
 #ifdef _WIN32
@@ -122,13 +151,13 @@ VOID winpr_CloseThreadpoolWork(PTP_WORK pwk)
 		ArrayList_Remove(pwk->CallbackEnvironment->CleanupGroup->groups, pwk);
 
 #endif
-	free(pwk);
+	/* callbacks still queued or running keep the object alive */
+	threadpool_work_release(pwk);
 }
 
 VOID winpr_SubmitThreadpoolWork(PTP_WORK pwk)
 {
 	PTP_POOL pool = NULL;
-	PTP_CALLBACK_INSTANCE callbackInstance = NULL;
 #ifdef _WIN32
 	InitOnceExecuteOnce(&init_once_module, init_module, NULL, NULL);
 
@@ -143,16 +172,19 @@ VOID winpr_SubmitThreadpoolWork(PTP_WORK pwk)
 	WINPR_ASSERT(pwk);
 	WINPR_ASSERT(pwk->CallbackEnvironment);
 	pool = pwk->CallbackEnvironment->Pool;
-	callbackInstance = (PTP_CALLBACK_INSTANCE)calloc(1, sizeof(TP_CALLBACK_INSTANCE));
 
-	if (callbackInstance)
+	InterlockedIncrement(&pwk->RefCount);
+	InterlockedIncrement(&pwk->Pending);
+
+	/* without worker threads the callback runs on the submitting thread */
+	if (!pool || !threadpool_submit_work(pool, pwk))
 	{
-		callbackInstance->Work = pwk;
-		CountdownEvent_AddCount(pool->WorkComplete, 1);
-		if (!Queue_Enqueue(pool->PendingQueue, callbackInstance))
-			free(callbackInstance);
+		TP_CALLBACK_INSTANCE instance = { 0 };
+
+		instance.Work = pwk;
+		pwk->WorkCallback(&instance, pwk->CallbackParameter, pwk);
+		threadpool_work_complete(pwk);
 	}
-	// NOLINTNEXTLINE(clang-analyzer-unix.Malloc): Queue_Enqueue takes ownership of callbackInstance
 }
 
 BOOL winpr_TrySubmitThreadpoolCallback(PTP_SIMPLE_CALLBACK pfns, PVOID pv,
@@ -171,7 +203,6 @@ BOOL winpr_TrySubmitThreadpoolCallback(PTP_SIMPLE_CALLBACK pfns, PVOID pv,
 
 VOID winpr_WaitForThreadpoolWorkCallbacks(PTP_WORK pwk, BOOL fCancelPendingCallbacks)
 {
-	HANDLE event = NULL;
 	PTP_POOL pool = NULL;
 
 #ifdef _WIN32
@@ -190,10 +221,27 @@ VOID winpr_WaitForThreadpoolWorkCallbacks(PTP_WORK pwk, BOOL fCancelPendingCallb
 	pool = pwk->CallbackEnvironment->Pool;
 	WINPR_ASSERT(pool);
 
-	event = CountdownEvent_WaitHandle(pool->WorkComplete);
+	if (fCancelPendingCallbacks)
+		threadpool_cancel_work(pool, pwk);
+
+	/* only callbacks of this work object are waited for, not the whole pool */
+	InterlockedIncrement(&pwk->Waiters);
+	while (InterlockedCompareExchange(&pwk->Pending, 0, 0) > 0)
+	{
+		if (WaitForSingleObject(pwk->Done, INFINITE) != WAIT_OBJECT_0)
+		{
+			WLog_ERR(TAG, "error waiting on work completion");
+			break;
+		}
+
+		/* the manual reset event is still set from an earlier round of submissions */
+		if (InterlockedCompareExchange(&pwk->Pending, 0, 0) > 0)
+			(void)ResetEvent(pwk->Done);
+	}
 
-	if (WaitForSingleObject(event, INFINITE) != WAIT_OBJECT_0)
-		WLog_ERR(TAG, "error waiting on work completion");
+	/* a reset above might have swallowed the wakeup of another waiter, pass it on */
+	if (InterlockedDecrement(&pwk->Waiters) > 0)
+		(void)SetEvent(pwk->Done);
 }
 
 #endif /* WINPR_THREAD_POOL defined */